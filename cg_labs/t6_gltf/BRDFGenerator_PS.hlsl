@@ -1,4 +1,5 @@
 #include "IBLheader.h"
+#include "IBLSampling.h"
 
 float sqr(float x)
 {
@@ -23,21 +24,6 @@ float geometry(float3 n, float3 v, float3 l, float roughness)
   return SchlickGGX(n, v, k) * SchlickGGX(n, l, k);
 }
 
-float RadicalInverse_VdC(uint bits)
-{
-  bits = (bits << 16u) | (bits >> 16u);
-  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-  return float(bits) * 2.3283064365386963e-10; // / 0x100000000
-}
-
-float2 Hammersley(uint i, uint N)
-{
-  return float2(float(i) / float(N), RadicalInverse_VdC(i));
-}
-
 float3 ImportanceSampleGGX(float2 Xi, float3 norm, float roughness)
 {
   float a = roughness * roughness;
@@ -67,27 +53,44 @@ float2 IntegrateBRDF(float NdotV, float roughness)
   float A = 0.0;
   float B = 0.0;
   float3 N = float3(0.0, 1.0, 0.0);
-  static const uint SAMPLE_COUNT = 1024u;
+  uint maxSamples = MaxSamples();
+  uint batchSize = BatchSize();
 
-  for (uint i = 0u; i < SAMPLE_COUNT; ++i)
+  RunningVariance rv = InitRunningVariance();
+  uint i = 0u;
+  [loop]
+  while (i < maxSamples)
   {
-    float2 Xi = Hammersley(i, SAMPLE_COUNT);
-    float3 H = ImportanceSampleGGX(Xi, N, roughness);
-    float3 L = normalize(2.0 * dot(V, H) * H - V);
-    float NdotL = max(L.y, 0.0);
-    float NdotH = max(H.y, 0.0);
-    float VdotH = max(dot(V, H), 0.0);
-    if (NdotL > 0.0)
+    uint batchEnd = min(i + batchSize, maxSamples);
+    [loop]
+    for (; i < batchEnd; ++i)
     {
-      float G = geometry(N, V, L, roughness);
-      float G_Vis = (G * VdotH) / (NdotH * NdotV);
-      float Fc = pow(1.0 - VdotH, 5.0);
-      A += (1.0 - Fc) * G_Vis;
-      B += Fc * G_Vis;
+      float2 Xi = ProgressiveSample(i);
+      float3 H = ImportanceSampleGGX(Xi, N, roughness);
+      float3 L = normalize(2.0 * dot(V, H) * H - V);
+      float NdotL = max(L.y, 0.0);
+      float NdotH = max(H.y, 0.0);
+      float VdotH = max(dot(V, H), 0.0);
+      float a = 0.0, b = 0.0;
+      if (NdotL > 0.0)
+      {
+        float G = geometry(N, V, L, roughness);
+        float G_Vis = (G * VdotH) / (NdotH * NdotV);
+        float Fc = pow(1.0 - VdotH, 5.0);
+        a = (1.0 - Fc) * G_Vis;
+        b = Fc * G_Vis;
+      }
+      A += a;
+      B += b;
+      AddSample(rv, a + b, 1.0);
     }
+
+    if (IsConverged(rv, i))
+      break;
   }
-  A /= float(SAMPLE_COUNT);
-  B /= float(SAMPLE_COUNT);
+  A /= float(i);
+  B /= float(i);
+  ReportTexelStats(rv, i);
   return float2(A, B);
 }
 
@@ -0,0 +1,153 @@
+#include "BatchDesc.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "../libs/json.hpp"
+
+using nlohmann::json;
+
+namespace {
+  void ReadVector(const json& object, const char* key, float out[3]) {
+    auto it = object.find(key);
+    if (it == object.end())
+      return;
+    if (!it->is_array() || it->size() != 3)
+      throw std::runtime_error(std::string("'") + key + "' should be array of 3 numbers");
+    for (int i = 0; i < 3; i++)
+      out[i] = (*it)[i].get<float>();
+  }
+
+  TonemapOperator ParseOperator(const std::string& name) {
+    if (name == "aces")
+      return TonemapOperator::acesFitted;
+    if (name == "agx")
+      return TonemapOperator::agx;
+    if (name == "reinhard")
+      return TonemapOperator::reinhardExtended;
+    if (name == "uncharted2")
+      return TonemapOperator::uncharted2;
+    throw std::runtime_error("unknown tonemap operator '" + name + "'");
+  }
+
+  BatchJob ParseJob(const json& object, size_t index) {
+    BatchJob job;
+    job.name = object.value("name", "job" + std::to_string(index));
+    job.scene.gltfPath = object.value("gltf", job.scene.gltfPath);
+    job.scene.binPath = object.value("bin", job.scene.binPath);
+    job.scene.environmentPath = object.value("environment", job.scene.environmentPath);
+    job.scene.lightsIntensity = object.value("lightsIntensity", job.scene.lightsIntensity);
+
+    auto lights = object.find("lights");
+    if (lights != object.end()) {
+      job.scene.lights.clear();
+      for (const json& l : *lights) {
+        SceneLightDesc light;
+        ReadVector(l, "position", light.position);
+        ReadVector(l, "color", light.color);
+        job.scene.lights.push_back(light);
+      }
+    }
+
+    auto views = object.find("views");
+    if (views != object.end()) {
+      for (const json& v : *views) {
+        BatchView view;
+        view.name = v.value("name", "view" + std::to_string(job.views.size()));
+        ReadVector(v, "eye", view.eye);
+        ReadVector(v, "target", view.target);
+        ReadVector(v, "up", view.up);
+        view.fovY = v.value("fov", view.fovY);
+        view.nearZ = v.value("near", view.nearZ);
+        view.farZ = v.value("far", view.farZ);
+        job.views.push_back(view);
+      }
+    }
+
+    auto orbit = object.find("orbit");
+    if (orbit != object.end() || job.views.empty()) {
+      const json& o = orbit != object.end() ? *orbit : json::object();
+      float target[3] = { 0.0f, 2.0f, 0.0f };
+      ReadVector(o, "target", target);
+      MakeOrbitViews(target, o.value("distance", 3.0f), o.value("height", 0.5f), o.value("count", 1u), o.value("fov", 90.0f), job.views);
+    }
+    return job;
+  }
+}
+
+bool ParseBatchDesc(const std::string& text, BatchDesc& desc, std::string& error) {
+  desc = BatchDesc();
+  try {
+    json root = json::parse(text);
+    BatchOutputSettings& output = desc.output;
+    output.width = root.value("width", output.width);
+    output.height = root.value("height", output.height);
+    output.outputDir = root.value("output", output.outputDir);
+    output.fixedExposure = root.value("exposure", output.fixedExposure);
+    if (root.contains("tonemap")) {
+      output.tonemap.op = ParseOperator(root["tonemap"].get<std::string>());
+      output.tonemap.exposureBias = TonemapLUTParams::DefaultExposureBias(output.tonemap.op);
+    }
+
+    output.bloom.enabled = root.contains("bloom");
+    if (output.bloom.enabled) {
+      const json& bloom = root["bloom"];
+      output.bloom.intensity = bloom.value("intensity", output.bloom.intensity);
+      output.bloom.threshold = bloom.value("threshold", output.bloom.threshold);
+    }
+
+    output.softRasterizer = root.value("rasterizer", std::string("gpu")) == "soft";
+
+    if (output.width == 0 || output.height == 0)
+      throw std::runtime_error("image size should be positive");
+
+    const json& jobs = root.at("jobs");
+    for (size_t i = 0; i < jobs.size(); i++)
+      desc.jobs.push_back(ParseJob(jobs[i], i));
+  }
+  catch (const std::exception& e) {
+    error = e.what();
+    return false;
+  }
+  return true;
+}
+
+bool LoadBatchDesc(const std::string& path, BatchDesc& desc, std::string& error) {
+  std::ifstream file(path);
+  if (!file) {
+    error = "can't open " + path;
+    return false;
+  }
+
+  std::stringstream text;
+  text << file.rdbuf();
+  return ParseBatchDesc(text.str(), desc, error);
+}
+
+void MakeOrbitViews(const float target[3], float distance, float height, uint32_t count, float fovY, std::vector<BatchView>& views) {
+  const float pi = 3.14159265358979f;
+  for (uint32_t i = 0; i < count; i++) {
+    float angle = 2.0f * pi * i / count;
+
+    BatchView view;
+    view.name = "orbit" + std::to_string(i);
+    view.eye[0] = target[0] + distance * std::sin(angle);
+    view.eye[1] = target[1] + height;
+    view.eye[2] = target[2] - distance * std::cos(angle);
+    for (int c = 0; c < 3; c++)
+      view.target[c] = target[c];
+    view.fovY = fovY;
+    views.push_back(view);
+  }
+}
+
+std::vector<size_t> SelectShard(size_t jobsCount, uint32_t shardIndex, uint32_t shardCount) {
+  std::vector<size_t> jobs;
+  if (shardCount == 0 || shardIndex >= shardCount)
+    return jobs;
+
+  for (size_t i = shardIndex; i < jobsCount; i += shardCount)
+    jobs.push_back(i);
+  return jobs;
+}
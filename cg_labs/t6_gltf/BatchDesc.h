@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bloom.h"
+#include "LuminanceHistogram.h"
+#include "TonemapLUT.h"
+
+struct SceneLightDesc {
+  float position[3] = { 2.0f, 2.0f, 2.0f };
+  float color[3] = { 1.0f, 0.0f, 0.0f };
+};
+
+// What Scene::Init loads, defaults are the interactive scene
+struct SceneDesc {
+  std::string gltfPath = "./src/models/rgo/scene.gltf";
+  std::string binPath = "./src/models/rgo/scene.bin";
+  std::string environmentPath = "./src/envs/env_1k_4.hdr";
+  std::vector<SceneLightDesc> lights = { SceneLightDesc() };
+  float lightsIntensity = 0.0f; // 0 - lights are off
+};
+
+struct BatchView {
+  std::string name;
+  float eye[3] = { 0.0f, 2.0f, -3.0f };
+  float target[3] = { 0.0f, 2.0f, 0.0f };
+  float up[3] = { 0.0f, 1.0f, 0.0f };
+  float fovY = 90.0f; // degrees
+  float nearZ = 0.01f;
+  float farZ = 100.0f;
+};
+
+struct BatchJob {
+  std::string name;
+  SceneDesc scene;
+  std::vector<BatchView> views;
+};
+
+// Postprocessing of batch images, CPU equivalent of Postprocessing with converged eye adaptation
+struct BatchOutputSettings {
+  uint32_t width = 512;
+  uint32_t height = 512;
+  std::string outputDir = "./batch";
+  float fixedExposure = 0.0f; // average luminance for exposure, 0 - metered by histogram
+  LuminanceHistogramParams metering;
+  TonemapLUTParams tonemap;
+  BloomSettings bloom;
+  bool softRasterizer = false; // scene is rendered by SoftRasterizer on CPU instead of D3D
+};
+
+// Batch of scenes rendered without window. JSON format:
+// {
+//   "width": 512, "height": 512, "output": "./batch",
+//   "exposure": 0 (or average luminance), "tonemap": "aces" | "agx" | "reinhard" | "uncharted2",
+//   "bloom": { "intensity": 0.05, "threshold": 4 } (no key - bloom is off),
+//   "rasterizer": "gpu" | "soft",
+//   "jobs": [ {
+//     "name": "rgo", "gltf": "...", "bin": "...", "environment": "....hdr",
+//     "lights": [ { "position": [2, 2, 2], "color": [1, 0, 0] } ], "lightsIntensity": 1,
+//     "views": [ { "name": "front", "eye": [0, 2, -3], "target": [0, 2, 0], "up": [0, 1, 0], "fov": 90 } ],
+//     "orbit": { "count": 8, "distance": 3, "height": 0.5, "target": [0, 2, 0], "fov": 90 }
+//   } ]
+// }
+// Omitted job fields take SceneDesc defaults, jobs without views get the orbit of 1 view.
+struct BatchDesc {
+  BatchOutputSettings output;
+  std::vector<BatchJob> jobs;
+};
+
+bool ParseBatchDesc(const std::string& text, BatchDesc& desc, std::string& error);
+bool LoadBatchDesc(const std::string& path, BatchDesc& desc, std::string& error);
+
+// Views around target at height above it, first one looks along +Z
+void MakeOrbitViews(const float target[3], float distance, float height, uint32_t count, float fovY, std::vector<BatchView>& views);
+
+// Jobs of shard index of count (round robin), so several processes split one batch
+std::vector<size_t> SelectShard(size_t jobsCount, uint32_t shardIndex, uint32_t shardCount);
@@ -0,0 +1,109 @@
+#include "BatchOutput.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../libs/stb_image_write.h"
+#include "LuminanceHistogram.h"
+#include "parallel.h"
+
+float ExposureFromAverageLuminance(float averageLum) {
+  const float lumMin = 0.0f, lumMax = 1000.0f;
+  float keyValue = 1.03f - 2.0f / (2.0f + std::log10(averageLum + 1.0f));
+  return keyValue / std::max(std::min(averageLum, lumMax), lumMin);
+}
+
+float MeterAverageLuminance(const HDRImage& image, const LuminanceHistogramParams& params) {
+  LuminanceHistogram histogram;
+  BuildLuminanceHistogram(image, params, histogram);
+  return std::exp2(histogram.AverageLog2(params));
+}
+
+void TonemapImage(const HDRImage& image, const TonemapLUT& lut, float exposure, const HDRImage* bloom, float bloomIntensity,
+  std::vector<uint8_t>& rgba8) {
+  rgba8.resize((size_t)image.width * image.height * 4);
+
+  ParallelFor(image.height, [&](size_t y) {
+    for (uint32_t x = 0; x < image.width; x++) {
+      const float* texel = image.Texel(x, (uint32_t)y);
+      float color[3] = { texel[0], texel[1], texel[2] };
+
+      if (bloom) {
+        float glow[3];
+        BloomSampleBilinear(*bloom, (x + 0.5f) / image.width, (y + 0.5f) / image.height, glow);
+        for (int c = 0; c < 3; c++)
+          color[c] += glow[c] * bloomIntensity;
+      }
+
+      for (int c = 0; c < 3; c++)
+        color[c] = std::max(color[c] * exposure, 0.0f);
+
+      float mapped[3];
+      lut.Sample(color, mapped);
+
+      uint8_t* out = &rgba8[((size_t)y * image.width + x) * 4];
+      for (int c = 0; c < 3; c++)
+        out[c] = (uint8_t)std::lround(std::min(std::max(mapped[c], 0.0f), 1.0f) * 255.0f);
+      out[3] = 255;
+    }
+  });
+}
+
+BatchOutputQueue::BatchOutputQueue(const BatchOutputSettings& settings, size_t maxInFlight)
+  : settings(settings), maxInFlight(maxInFlight > 0 ? maxInFlight : GetWorkerCount()) {
+  lut.Bake(settings.tonemap);
+}
+
+BatchOutputQueue::~BatchOutputQueue() {
+  Wait();
+}
+
+bool BatchOutputQueue::Process(const BatchOutputSettings& settings, const TonemapLUT& lut, const std::string& path, const HDRImage& image) {
+  if (image.width == 0 || image.height == 0)
+    return false;
+
+  float averageLum = settings.fixedExposure > 0.0f ? settings.fixedExposure : MeterAverageLuminance(image, settings.metering);
+
+  HDRImage bloom;
+  if (settings.bloom.enabled)
+    BuildBloomReference(image, settings.bloom, averageLum, bloom);
+
+  std::vector<uint8_t> rgba8;
+  TonemapImage(image, lut, ExposureFromAverageLuminance(averageLum), settings.bloom.enabled ? &bloom : nullptr,
+    settings.bloom.intensity, rgba8);
+  return stbi_write_png(path.c_str(), (int)image.width, (int)image.height, 4, rgba8.data(), (int)image.width * 4) != 0;
+}
+
+void BatchOutputQueue::Push(const std::string& path, HDRImage&& image) {
+  JobSystem& jobs = JobSystem::GetInstance();
+  while (inFlight.size() >= maxInFlight) {
+    jobs.Wait(*inFlight.front());
+    inFlight.pop_front();
+  }
+
+  // Image is moved into the task, it lives as long as the task
+  auto shared = std::make_shared<HDRImage>(std::move(image));
+  inFlight.emplace_back(new JobCounter());
+  jobs.Run([this, path, shared]() {
+    bool ok = Process(settings, lut, path, *shared);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (ok)
+      stats.written++;
+    else {
+      stats.failed++;
+      stats.failedPaths.push_back(path);
+    }
+  }, inFlight.back().get());
+}
+
+void BatchOutputQueue::Wait() {
+  for (auto& counter : inFlight)
+    JobSystem::GetInstance().Wait(*counter);
+  inFlight.clear();
+}
+
+BatchOutputStats BatchOutputQueue::GetStats() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return stats;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BatchDesc.h"
+#include "CubeMapConverter.h"
+#include "JobSystem.h"
+#include "TonemapLUT.h"
+
+// Same as getExposition of HDR.hlsl: scale of scene color for average luminance
+float ExposureFromAverageLuminance(float averageLum);
+
+// Histogram metering of Postprocessing, average luminance of the image
+float MeterAverageLuminance(const HDRImage& image, const LuminanceHistogramParams& params);
+
+// HDR.hlsl on CPU: exposure, bloom (normalized result of BuildBloomReference, may be null) and LUT,
+// rgba8 gets width * height * 4 bytes
+void TonemapImage(const HDRImage& image, const TonemapLUT& lut, float exposure, const HDRImage* bloom, float bloomIntensity,
+  std::vector<uint8_t>& rgba8);
+
+struct BatchOutputStats {
+  uint32_t written = 0;
+  uint32_t failed = 0;
+  std::vector<std::string> failedPaths;
+};
+
+// Postprocesses and writes rendered HDR images as PNG in jobs, so the renderer
+// goes on with next views while previous ones are tonemapped and encoded
+class BatchOutputQueue {
+public:
+  // maxInFlight == 0 means GetWorkerCount()
+  explicit BatchOutputQueue(const BatchOutputSettings& settings, size_t maxInFlight = 0);
+  ~BatchOutputQueue();
+
+  // Waits for the oldest image if maxInFlight are processed
+  void Push(const std::string& path, HDRImage&& image);
+
+  void Wait();
+
+  BatchOutputStats GetStats();
+
+  // Whole processing of one image on the calling thread
+  static bool Process(const BatchOutputSettings& settings, const TonemapLUT& lut, const std::string& path, const HDRImage& image);
+
+private:
+  BatchOutputSettings settings;
+  TonemapLUT lut;
+  size_t maxInFlight;
+  std::deque<std::unique_ptr<JobCounter>> inFlight;
+
+  std::mutex statsMutex;
+  BatchOutputStats stats;
+};
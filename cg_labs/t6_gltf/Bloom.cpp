@@ -0,0 +1,230 @@
+#include "Bloom.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+
+const BloomTap bloomBox13Taps[13] = {
+  { -2.0f, -2.0f, 0.03125f }, { 0.0f, -2.0f, 0.0625f }, { 2.0f, -2.0f, 0.03125f },
+  { -1.0f, -1.0f, 0.125f }, { 1.0f, -1.0f, 0.125f },
+  { -2.0f, 0.0f, 0.0625f }, { 0.0f, 0.0f, 0.125f }, { 2.0f, 0.0f, 0.0625f },
+  { -1.0f, 1.0f, 0.125f }, { 1.0f, 1.0f, 0.125f },
+  { -2.0f, 2.0f, 0.03125f }, { 0.0f, 2.0f, 0.0625f }, { 2.0f, 2.0f, 0.03125f },
+};
+
+const BloomTap bloomDualKawaseTaps[5] = {
+  { 0.0f, 0.0f, 0.5f },
+  { -1.0f, -1.0f, 0.125f }, { 1.0f, -1.0f, 0.125f }, { -1.0f, 1.0f, 0.125f }, { 1.0f, 1.0f, 0.125f },
+};
+
+const BloomTap bloomTentTaps[9] = {
+  { -1.0f, -1.0f, 0.0625f }, { 0.0f, -1.0f, 0.125f }, { 1.0f, -1.0f, 0.0625f },
+  { -1.0f, 0.0f, 0.125f }, { 0.0f, 0.0f, 0.25f }, { 1.0f, 0.0f, 0.125f },
+  { -1.0f, 1.0f, 0.0625f }, { 0.0f, 1.0f, 0.125f }, { 1.0f, 1.0f, 0.0625f },
+};
+
+namespace {
+  const float lumWeights[3] = { 0.2126f, 0.7151f, 0.0722f };
+
+  inline float Luminance(const float c[3]) {
+    return c[0] * lumWeights[0] + c[1] * lumWeights[1] + c[2] * lumWeights[2];
+  }
+
+  // Box13 groups of 2x2 boxes for Karis average: inner box and four corner boxes
+  const int box13Groups[5][4] = {
+    { 3, 4, 8, 9 },
+    { 0, 1, 5, 6 },
+    { 1, 2, 6, 7 },
+    { 5, 6, 10, 11 },
+    { 6, 7, 11, 12 },
+  };
+  const float box13GroupWeights[5] = { 0.5f, 0.125f, 0.125f, 0.125f, 0.125f };
+
+  uint32_t KernelTaps(BloomDownsample kernel) {
+    return kernel == BloomDownsample::box13 ? 13 : 5;
+  }
+
+  void AddPass(BloomPlan& plan, BloomPassDesc::Kind kind, uint32_t level, uint32_t taps) {
+    BloomPassDesc pass;
+    pass.kind = kind;
+    pass.level = level;
+    pass.width = plan.widths[level];
+    pass.height = plan.heights[level];
+    pass.taps = taps;
+    pass.cost = (uint64_t)pass.width * pass.height * taps;
+    plan.passes.push_back(pass);
+    plan.maxPassCost = std::max(plan.maxPassCost, pass.cost);
+    plan.totalCost += pass.cost;
+  }
+
+  BloomPlan PlanAtResolution(const BloomSettings& settings, BloomResolution resolution, uint32_t width, uint32_t height) {
+    BloomPlan plan;
+    plan.resolution = resolution;
+
+    uint32_t w = std::max(width >> (int)resolution, 1u);
+    uint32_t h = std::max(height >> (int)resolution, 1u);
+    plan.widths.push_back(w);
+    plan.heights.push_back(h);
+    while (plan.levels < settings.levels && std::min(w, h) >= 2) {
+      w /= 2;
+      h /= 2;
+      plan.widths.push_back(w);
+      plan.heights.push_back(h);
+      plan.levels++;
+    }
+
+    uint32_t taps = KernelTaps(settings.downsample);
+    AddPass(plan, BloomPassDesc::Kind::prefilter, 0, taps);
+    for (uint32_t level = 1; level <= plan.levels; level++)
+      AddPass(plan, BloomPassDesc::Kind::downsample, level, taps);
+    // Tent taps and the level itself
+    for (uint32_t level = plan.levels; level-- > 0;)
+      AddPass(plan, BloomPassDesc::Kind::upsample, level, 10);
+    return plan;
+  }
+}
+
+BloomPlan PlanBloom(const BloomSettings& settings, uint32_t width, uint32_t height) {
+  uint64_t budget = (uint64_t)(std::max(settings.passBudgetMTaps, 0.0f) * 1e6);
+  int resolution = (int)settings.resolution;
+
+  BloomPlan plan = PlanAtResolution(settings, (BloomResolution)resolution, width, height);
+  while (budget > 0 && plan.maxPassCost > budget) {
+    if (resolution == (int)BloomResolution::eighth) {
+      plan.budgetLimited = true;
+      break;
+    }
+    plan = PlanAtResolution(settings, (BloomResolution)++resolution, width, height);
+  }
+  return plan;
+}
+
+float BloomThresholdWeight(float lum, float threshold, float knee) {
+  if (!(lum > 0.0f))
+    return 0.0f;
+
+  float softKnee = std::max(threshold * knee, 1e-5f);
+  float soft = std::min(std::max(lum - threshold + softKnee, 0.0f), 2.0f * softKnee);
+  soft = soft * soft / (4.0f * softKnee);
+  return std::max(soft, lum - threshold) / lum;
+}
+
+void BloomSampleBilinear(const HDRImage& image, float u, float v, float out[3]) {
+  float x = u * image.width - 0.5f;
+  float y = v * image.height - 0.5f;
+  float fx = std::floor(x), fy = std::floor(y);
+  float tx = x - fx, ty = y - fy;
+
+  auto clampX = [&](float c) { return (uint32_t)std::min(std::max(c, 0.0f), (float)image.width - 1); };
+  auto clampY = [&](float c) { return (uint32_t)std::min(std::max(c, 0.0f), (float)image.height - 1); };
+  uint32_t x0 = clampX(fx), x1 = clampX(fx + 1);
+  uint32_t y0 = clampY(fy), y1 = clampY(fy + 1);
+
+  const float* c00 = image.Texel(x0, y0);
+  const float* c10 = image.Texel(x1, y0);
+  const float* c01 = image.Texel(x0, y1);
+  const float* c11 = image.Texel(x1, y1);
+  for (int c = 0; c < 3; c++) {
+    float top = c00[c] + (c10[c] - c00[c]) * tx;
+    float bottom = c01[c] + (c11[c] - c01[c]) * tx;
+    out[c] = top + (bottom - top) * ty;
+  }
+}
+
+void BloomDownsampleImage(const HDRImage& src, BloomDownsample kernel, bool prefilter, float threshold, float knee, HDRImage& dst) {
+  float texelU = 1.0f / src.width, texelV = 1.0f / src.height;
+
+  ParallelFor(dst.height, [&](size_t y) {
+    for (uint32_t x = 0; x < dst.width; x++) {
+      float u = (x + 0.5f) / dst.width;
+      float v = (y + 0.5f) / dst.height;
+      float color[3] = { 0.0f, 0.0f, 0.0f };
+
+      if (kernel == BloomDownsample::box13) {
+        float taps[13][3];
+        for (int i = 0; i < 13; i++)
+          BloomSampleBilinear(src, u + bloomBox13Taps[i].x * texelU, v + bloomBox13Taps[i].y * texelV, taps[i]);
+
+        // Karis average of boxes on prefilter keeps single bright texels from flickering
+        float weightSum = 0.0f;
+        for (int g = 0; g < 5; g++) {
+          float box[3] = { 0.0f, 0.0f, 0.0f };
+          for (int i = 0; i < 4; i++)
+            for (int c = 0; c < 3; c++)
+              box[c] += taps[box13Groups[g][i]][c] * 0.25f;
+
+          float weight = box13GroupWeights[g] * (prefilter ? 1.0f / (1.0f + Luminance(box)) : 1.0f);
+          for (int c = 0; c < 3; c++)
+            color[c] += box[c] * weight;
+          weightSum += weight;
+        }
+        for (int c = 0; c < 3; c++)
+          color[c] /= weightSum;
+      } else {
+        for (const BloomTap& tap : bloomDualKawaseTaps) {
+          float sample[3];
+          BloomSampleBilinear(src, u + tap.x * texelU, v + tap.y * texelV, sample);
+          for (int c = 0; c < 3; c++)
+            color[c] += sample[c] * tap.weight;
+        }
+      }
+
+      float weight = prefilter ? BloomThresholdWeight(Luminance(color), threshold, knee) : 1.0f;
+      float* texel = dst.Texel(x, (uint32_t)y);
+      for (int c = 0; c < 3; c++)
+        texel[c] = color[c] * weight;
+      texel[3] = 1.0f;
+    }
+  });
+}
+
+void BloomUpsampleImage(const HDRImage& low, const HDRImage& level, float radius, HDRImage& dst) {
+  float texelU = radius / low.width, texelV = radius / low.height;
+
+  ParallelFor(dst.height, [&](size_t y) {
+    for (uint32_t x = 0; x < dst.width; x++) {
+      float u = (x + 0.5f) / dst.width;
+      float v = (y + 0.5f) / dst.height;
+
+      const float* base = level.Texel(x, (uint32_t)y);
+      float* texel = dst.Texel(x, (uint32_t)y);
+      for (int c = 0; c < 3; c++)
+        texel[c] = base[c];
+      texel[3] = 1.0f;
+
+      for (const BloomTap& tap : bloomTentTaps) {
+        float sample[3];
+        BloomSampleBilinear(low, u + tap.x * texelU, v + tap.y * texelV, sample);
+        for (int c = 0; c < 3; c++)
+          texel[c] += sample[c] * tap.weight;
+      }
+    }
+  });
+}
+
+void BuildBloomReference(const HDRImage& input, const BloomSettings& settings, float averageLum, HDRImage& result) {
+  BloomPlan plan = PlanBloom(settings, input.width, input.height);
+
+  std::vector<HDRImage> levels(plan.levels + 1);
+  for (uint32_t i = 0; i <= plan.levels; i++)
+    levels[i].Resize(plan.widths[i], plan.heights[i]);
+
+  BloomDownsampleImage(input, settings.downsample, true, settings.threshold * averageLum, settings.knee, levels[0]);
+  for (uint32_t i = 1; i <= plan.levels; i++)
+    BloomDownsampleImage(levels[i - 1], settings.downsample, false, 0.0f, 0.0f, levels[i]);
+
+  HDRImage up = levels[plan.levels];
+  for (uint32_t i = plan.levels; i-- > 0;) {
+    HDRImage next;
+    next.Resize(plan.widths[i], plan.heights[i]);
+    BloomUpsampleImage(up, levels[i], settings.radius, next);
+    up = std::move(next);
+  }
+
+  float scale = 1.0f / (plan.levels + 1);
+  for (size_t i = 0; i < up.data.size(); i += 4)
+    for (int c = 0; c < 3; c++)
+      up.data[i + c] *= scale;
+  result = std::move(up);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CubeMapConverter.h"
+
+// Base level of bloom relative to scene, value is log2 of the divisor
+enum class BloomResolution : int
+{
+  half = 1,
+  quarter = 2,
+  eighth = 3,
+};
+
+enum class BloomDownsample : int
+{
+  box13 = 0,      // 13 taps of Jimenez (CoD: Advanced Warfare), Karis average on prefilter
+  dualKawase = 1, // 5 taps of dual filter (Bjorge)
+};
+
+struct BloomSettings {
+  bool enabled = true;
+  BloomResolution resolution = BloomResolution::half;
+  BloomDownsample downsample = BloomDownsample::box13;
+  uint32_t levels = 5;          // downsample levels below base
+  float threshold = 4.0f;       // luminance relative to adapted average
+  float knee = 0.5f;            // soft threshold width, part of threshold
+  float intensity = 0.05f;
+  float radius = 1.0f;          // tent upsample radius in source texels
+  float passBudgetMTaps = 0.0f; // > 0 - max texel fetches of one pass (millions), lowers resolution
+};
+
+struct BloomTap {
+  float x, y;   // offset in source texels from output texel center
+  float weight;
+};
+
+// Kernels shared with BloomHeader.h
+extern const BloomTap bloomBox13Taps[13];
+extern const BloomTap bloomDualKawaseTaps[5];
+extern const BloomTap bloomTentTaps[9];
+
+struct BloomPassDesc {
+  enum class Kind { prefilter, downsample, upsample };
+
+  Kind kind = Kind::prefilter;
+  uint32_t level = 0; // output level, 0 - base
+  uint32_t width = 0, height = 0;
+  uint32_t taps = 0;
+  uint64_t cost = 0;  // texel fetches
+};
+
+// Passes of bloom chain: prefilter into level 0, downsamples to levels 1..N,
+// upsamples back with tent filter adding every level (U[i] = L[i] + tent(U[i + 1]))
+struct BloomPlan {
+  BloomResolution resolution = BloomResolution::half; // after budget
+  bool budgetLimited = false;                          // budget is exceeded even at the lowest resolution
+  uint32_t levels = 0;
+  std::vector<uint32_t> widths, heights;               // by level
+  std::vector<BloomPassDesc> passes;                   // in execution order
+  uint64_t maxPassCost = 0;
+  uint64_t totalCost = 0;
+};
+
+BloomPlan PlanBloom(const BloomSettings& settings, uint32_t width, uint32_t height);
+
+// Soft threshold weight of color with luminance lum (Karis knee curve)
+float BloomThresholdWeight(float lum, float threshold, float knee);
+
+// CPU reference of bloom shaders. Sampling is bilinear with clamp like the GPU one,
+// output sizes are set by the caller.
+void BloomSampleBilinear(const HDRImage& image, float u, float v, float out[3]);
+void BloomDownsampleImage(const HDRImage& src, BloomDownsample kernel, bool prefilter, float threshold, float knee, HDRImage& dst);
+void BloomUpsampleImage(const HDRImage& low, const HDRImage& level, float radius, HDRImage& dst);
+
+// Whole chain by plan, result has base level size and is normalized by levels count
+void BuildBloomReference(const HDRImage& input, const BloomSettings& settings, float averageLum, HDRImage& result);
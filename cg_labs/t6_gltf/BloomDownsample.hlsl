@@ -0,0 +1,60 @@
+#include "BloomHeader.h"
+
+float ThresholdWeight(float lum)
+{
+	float softKnee = max(prefilter.x * prefilter.y, 1e-5f);
+	float soft = clamp(lum - prefilter.x + softKnee, 0.0f, 2.0f * softKnee);
+	soft = soft * soft / (4.0f * softKnee);
+	return lum > 0.0f ? max(soft, lum - prefilter.x) / lum : 0.0f;
+}
+
+float3 KarisBox(float3 a, float3 b, float3 c, float3 d, float weight, inout float weightSum)
+{
+	float3 box = (a + b + c + d) * 0.25f;
+	weight *= prefilter.z > 0.5f ? 1.0f / (1.0f + dot(box, ChannelsWeight)) : 1.0f;
+	weightSum += weight;
+	return box * weight;
+}
+
+float3 Box13(float2 uv)
+{
+	float3 a = SampleSource(uv, float2(-2, -2));
+	float3 b = SampleSource(uv, float2(0, -2));
+	float3 c = SampleSource(uv, float2(2, -2));
+	float3 d = SampleSource(uv, float2(-1, -1));
+	float3 e = SampleSource(uv, float2(1, -1));
+	float3 f = SampleSource(uv, float2(-2, 0));
+	float3 g = SampleSource(uv, float2(0, 0));
+	float3 h = SampleSource(uv, float2(2, 0));
+	float3 i = SampleSource(uv, float2(-1, 1));
+	float3 j = SampleSource(uv, float2(1, 1));
+	float3 k = SampleSource(uv, float2(-2, 2));
+	float3 l = SampleSource(uv, float2(0, 2));
+	float3 m = SampleSource(uv, float2(2, 2));
+
+	float weightSum = 0.0f;
+	float3 color = KarisBox(d, e, i, j, 0.5f, weightSum);
+	color += KarisBox(a, b, f, g, 0.125f, weightSum);
+	color += KarisBox(b, c, g, h, 0.125f, weightSum);
+	color += KarisBox(f, g, k, l, 0.125f, weightSum);
+	color += KarisBox(g, h, l, m, 0.125f, weightSum);
+	return color / weightSum;
+}
+
+float3 DualKawase(float2 uv)
+{
+	float3 color = SampleSource(uv, float2(0, 0)) * 0.5f;
+	color += SampleSource(uv, float2(-1, -1)) * 0.125f;
+	color += SampleSource(uv, float2(1, -1)) * 0.125f;
+	color += SampleSource(uv, float2(-1, 1)) * 0.125f;
+	color += SampleSource(uv, float2(1, 1)) * 0.125f;
+	return color;
+}
+
+float4 main(PSInput i) : SV_TARGET
+{
+	float3 color = prefilter.w > 0.5f ? DualKawase(i.texcoord) : Box13(i.texcoord);
+	if (prefilter.z > 0.5f)
+		color *= ThresholdWeight(dot(color, ChannelsWeight));
+	return float4(color, 1.0f);
+}
@@ -0,0 +1,23 @@
+// Bloom kernels shared by BloomDownsample and BloomUpsample, CPU reference is Bloom.cpp
+static const float3 ChannelsWeight = float3(0.2126f, 0.7151f, 0.0722f);
+
+sampler SourceSampler : register(s0);
+Texture2D Source : register(t0);
+
+cbuffer BloomBuffer : register(b0)
+{
+	float4 sourceTexel; // xy - source texel size, z - upsample radius
+	float4 prefilter;   // x - threshold, y - knee, z - 1 on prefilter, w - 1 for dual Kawase kernel
+};
+
+struct PSInput
+{
+	float4 pos : SV_Position;
+	float4 color : Color;
+	float2 texcoord: TEXCOORD0;
+};
+
+float3 SampleSource(float2 uv, float2 offset)
+{
+	return Source.SampleLevel(SourceSampler, uv + offset * sourceTexel.xy, 0).rgb;
+}
@@ -0,0 +1,20 @@
+#include "BloomHeader.h"
+
+// Level of downsample chain the upsampled lower level is added to
+Texture2D Level : register(t1);
+
+float4 main(PSInput i) : SV_TARGET
+{
+	float2 uv = i.texcoord;
+	float r = sourceTexel.z;
+
+	// 3x3 tent
+	float3 color = SampleSource(uv, float2(0, 0)) * 0.25f;
+	color += (SampleSource(uv, float2(0, -r)) + SampleSource(uv, float2(-r, 0)) +
+		SampleSource(uv, float2(r, 0)) + SampleSource(uv, float2(0, r))) * 0.125f;
+	color += (SampleSource(uv, float2(-r, -r)) + SampleSource(uv, float2(r, -r)) +
+		SampleSource(uv, float2(-r, r)) + SampleSource(uv, float2(r, r))) * 0.0625f;
+
+	color += Level.SampleLevel(SourceSampler, uv, 0).rgb;
+	return float4(color, 1.0f);
+}
@@ -1,9 +1,10 @@
 #include "box.h"
+#include "ShaderLibrary.h"
 
 HRESULT Box::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
   // Compile the vertex shader
   ID3DBlob* pVSBlob = nullptr;
-  HRESULT hr = CompileShaderFromFile(L"box_VS.hlsl", "main", "vs_5_0", &pVSBlob);
+  HRESULT hr = ShaderLibrary::GetInstance().Compile(L"box_VS.hlsl", "main", "vs_5_0", &pVSBlob);
   if (FAILED(hr))
   {
     MessageBox(nullptr,
@@ -40,7 +41,7 @@ HRESULT Box::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screen
 
   // Compile the pixel shader
   ID3DBlob* pPSBlob = nullptr;
-  hr = CompileShaderFromFile(L"box_PS.hlsl", "main", "ps_5_0", &pPSBlob);
+  hr = ShaderLibrary::GetInstance().Compile(L"box_PS.hlsl", "main", "ps_5_0", &pPSBlob);
   if (FAILED(hr))
   {
     MessageBox(nullptr,
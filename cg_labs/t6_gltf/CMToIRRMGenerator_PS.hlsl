@@ -1,8 +1,9 @@
 #include "IBLheader.h"
+#include "IBLSampling.h"
 
-cbuffer PrefilConstantbuffer : register(b0)
+cbuffer IRRConstantbuffer : register(b0)
 {
-  int4 params;  // N1 = params.x, N2 = params.y, 
+  int4 params;  // N1 = params.x, N2 = params.y (N1 * N2 - default max samples), params.z - source cube map face size
 };
 
 TextureCube tex : register(t0);
@@ -15,24 +16,46 @@ float4 main(PS_INPUT input) : SV_TARGET{
     float3 binormal = cross(normal, tangent);
 
     float3 irradiance = float3(0.0, 0.0, 0.0);
-    int N1 = params.x;
-    int N2 = params.y;
     float PI = acos(-1);
-
-    for (int i = 0; i < N1; i++)
+    float resolution = params.z;
+    float saTexel = 4.0 * PI / (6.0 * resolution * resolution);
+    float footprintSamples = FootprintSamples();
+    uint maxSamples = MaxSamples();
+    uint batchSize = BatchSize();
+
+    // Cosine weighted samples: irradiance / PI is the mean of sampled radiance
+    RunningVariance rv = InitRunningVariance();
+    uint i = 0u;
+    [loop]
+    while (i < maxSamples)
     {
-        for (int j = 0; j < N2; j++)
+        uint batchEnd = min(i + batchSize, maxSamples);
+        [loop]
+        for (; i < batchEnd; ++i)
         {
-            float phi = i * (2.0f * PI / N1);
-            float theta = j * (PI / 2.0f / N2);
-            float3 a = float3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            float2 Xi = ProgressiveSample(i);
+            float phi = 2.0f * PI * Xi.x;
+            float cosTheta = sqrt(1.0f - Xi.y);
+            float sinTheta = sqrt(Xi.y);
+            float3 a = float3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
             float3 t_sample = a.x * tangent + a.y * binormal + a.z * normal;
 
-            irradiance += tex.Sample(smplr, t_sample) * cos(theta) * sin(theta);
+            // Filtered importance sampling: sample covers its share of the hemisphere
+            float pdf = cosTheta / PI;
+            float saSample = 1.0 / (footprintSamples * pdf + 0.0001);
+            float lod = max(0.5 * log2(saSample / saTexel) + 1.0, 0.0);
+
+            float3 color = tex.SampleLevel(smplr, t_sample, lod).rgb;
+            irradiance += color;
+            AddSample(rv, SampleLuminance(color), 1.0);
         }
+
+        if (IsConverged(rv, i))
+            break;
     }
 
-    irradiance = PI * irradiance / (N1 * N2);
+    irradiance = irradiance / i;
+    ReportTexelStats(rv, i);
 
     return float4(irradiance, 0.0);
 }
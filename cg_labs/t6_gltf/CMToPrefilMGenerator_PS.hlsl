@@ -1,4 +1,5 @@
 #include "IBLheader.h"
+#include "IBLSampling.h"
 
 cbuffer PrefilConstantbuffer : register(b0)
 {
@@ -18,21 +19,6 @@ float posDot(float3 a, float3 b)
 	return max(dot(a, b), 0);
 }
 
-float RadicalInverse_VdC(uint bits)
-{
-	bits = (bits << 16u) | (bits >> 16u);
-	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-	return float(bits) * 2.3283064365386963e-10; // / 0x100000000
-}
-
-float2 Hammersley(uint i, uint N)
-{
-	return float2(float(i) / float(N), RadicalInverse_VdC(i));
-}
-
 float3 ImportanceSampleGGX(float2 Xi, float3 norm, float roughness)
 {
 	float a = roughness * roughness;
@@ -68,29 +54,45 @@ float4 main(PS_INPUT input) : SV_TARGET
 	float totalWeight = 0.0;
 	float3 prefilteredColor = float3(0, 0, 0);
 
-	float roughness = roughness4;
-	static const uint SAMPLE_COUNT = 1024u;
-	for (uint i = 0u; i < SAMPLE_COUNT; ++i) {
-		float2 Xi = Hammersley(i, SAMPLE_COUNT);
-		float3 H = ImportanceSampleGGX(Xi, norm, roughness);
-		float3 L = normalize(2.0 * dot(view, H) * H - view);
-		float ndotl = max(dot(norm, L), 0.0);
-		float ndoth = max(dot(norm, H), 0.0);
-		float hdotv = max(dot(H, view), 0.0);
-
-		float D = normalDistribution(H, norm, roughness);
-		float pdf = (D * ndoth / (4.0 * hdotv)) + 0.0001;
-		float resolution = 512.0;
-		float saTexel = 4.0 * 3.1415926 / (6.0 * resolution * resolution);
-		float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
-		float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel);
-
-		if (ndotl > 0.0) {
-			prefilteredColor += tex.SampleLevel(smplr, L, mipLevel) * ndotl;
-			totalWeight += ndotl;
+	float roughness = roughness4.x;
+	float resolution = roughness4.y;
+	float saTexel = 4.0 * 3.1415926 / (6.0 * resolution * resolution);
+	float footprintSamples = FootprintSamples();
+	uint maxSamples = MaxSamples();
+	uint batchSize = BatchSize();
+
+	RunningVariance rv = InitRunningVariance();
+	uint i = 0u;
+	[loop]
+	while (i < maxSamples) {
+		uint batchEnd = min(i + batchSize, maxSamples);
+		[loop]
+		for (; i < batchEnd; ++i) {
+			float2 Xi = ProgressiveSample(i);
+			float3 H = ImportanceSampleGGX(Xi, norm, roughness);
+			float3 L = normalize(2.0 * dot(view, H) * H - view);
+			float ndotl = max(dot(norm, L), 0.0);
+			float ndoth = max(dot(norm, H), 0.0);
+			float hdotv = max(dot(H, view), 0.0);
+
+			float D = normalDistribution(H, norm, roughness);
+			float pdf = (D * ndoth / (4.0 * hdotv)) + 0.0001;
+			float saSample = 1.0 / (footprintSamples * pdf + 0.0001);
+			float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel);
+
+			if (ndotl > 0.0) {
+				float3 color = tex.SampleLevel(smplr, L, mipLevel).rgb;
+				prefilteredColor += color * ndotl;
+				totalWeight += ndotl;
+				AddSample(rv, SampleLuminance(color), ndotl);
+			}
 		}
+
+		if (IsConverged(rv, i))
+			break;
 	}
-	prefilteredColor = prefilteredColor / totalWeight;
+	prefilteredColor = prefilteredColor / max(totalWeight, 0.0001);
+	ReportTexelStats(rv, i);
 
 	return float4(prefilteredColor, 1.0f);
 }
\ No newline at end of file
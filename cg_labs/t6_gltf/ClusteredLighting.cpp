@@ -0,0 +1,160 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+#include "parallel.h"
+
+ClusterGridDesc ClusterGridDesc::FromProjection(const float projection[16]) {
+  // m00 = 1 / (aspect * tan), m11 = 1 / tan, m22 = f / (f - n), m32 = -n * f / (f - n)
+  ClusterGridDesc desc;
+  desc.tanHalfFovX = 1.0f / projection[0];
+  desc.tanHalfFovY = 1.0f / projection[5];
+  desc.nearZ = -projection[14] / projection[10];
+  desc.farZ = desc.nearZ * projection[10] / (projection[10] - 1.0f);
+  return desc;
+}
+
+float ClusterGridDesc::GetSliceScale() const {
+  return slices / std::log(farZ / nearZ);
+}
+
+float ClusterGridDesc::GetSliceBias() const {
+  return -GetSliceScale() * std::log(nearZ);
+}
+
+float ClusteredLighting::GetLightRange(const ClusterLight& light) const {
+  float maxColor = std::max(std::max(light.color[0], light.color[1]), light.color[2]);
+  float energy = maxColor * light.color[3];
+  return energy > 0.0f ? std::sqrt(energy / cutoff) : 0.0f;
+}
+
+void ClusteredLighting::BuildSliceBounds(uint32_t slice, float* minX, float* maxX, float* minY, float* maxY) const {
+  float sliceNear = grid.nearZ * std::pow(grid.farZ / grid.nearZ, (float)slice / grid.slices);
+  float sliceFar = grid.nearZ * std::pow(grid.farZ / grid.nearZ, (float)(slice + 1) / grid.slices);
+
+  uint32_t tiles = grid.tilesX * grid.tilesY;
+  for (uint32_t tile = 0; tile < tiles; tile++) {
+    uint32_t x = tile % grid.tilesX, y = tile / grid.tilesX;
+
+    // Tile rows go from the top of the screen
+    float ndcX0 = -1.0f + 2.0f * x / grid.tilesX, ndcX1 = -1.0f + 2.0f * (x + 1) / grid.tilesX;
+    float ndcY0 = 1.0f - 2.0f * (y + 1) / grid.tilesY, ndcY1 = 1.0f - 2.0f * y / grid.tilesY;
+
+    // Tile edges scale with depth, box covers both slice planes
+    minX[tile] = std::min(ndcX0 * sliceNear, ndcX0 * sliceFar) * grid.tanHalfFovX;
+    maxX[tile] = std::max(ndcX1 * sliceNear, ndcX1 * sliceFar) * grid.tanHalfFovX;
+    minY[tile] = std::min(ndcY0 * sliceNear, ndcY0 * sliceFar) * grid.tanHalfFovY;
+    maxY[tile] = std::max(ndcY1 * sliceNear, ndcY1 * sliceFar) * grid.tanHalfFovY;
+  }
+
+  // Padding tiles never intersect
+  for (uint32_t tile = tiles; tile % 4 != 0; tile++) {
+    minX[tile] = minY[tile] = 1e30f;
+    maxX[tile] = maxY[tile] = -1e30f;
+  }
+}
+
+void ClusteredLighting::AssignSlice(uint32_t slice) {
+  uint32_t tiles = grid.tilesX * grid.tilesY;
+  uint32_t paddedTiles = (tiles + 3) / 4 * 4;
+  std::vector<float> bounds(4 * paddedTiles);
+  float* minX = &bounds[0];
+  float* maxX = minX + paddedTiles;
+  float* minY = maxX + paddedTiles;
+  float* maxY = minY + paddedTiles;
+  BuildSliceBounds(slice, minX, maxX, minY, maxY);
+
+  float sliceNear = grid.nearZ * std::pow(grid.farZ / grid.nearZ, (float)slice / grid.slices);
+  float sliceFar = grid.nearZ * std::pow(grid.farZ / grid.nearZ, (float)(slice + 1) / grid.slices);
+
+  std::vector<uint32_t>* sliceClusters = &clusterLights[(size_t)slice * tiles];
+  for (uint32_t tile = 0; tile < tiles; tile++)
+    sliceClusters[tile].clear();
+
+  const __m128 zero = _mm_setzero_ps();
+  for (const ViewSphere& sphere : spheres) {
+    if (slice < sphere.firstSlice || slice > sphere.lastSlice)
+      continue;
+
+    float dz = std::max(sliceNear - sphere.z, 0.0f) + std::max(sphere.z - sliceFar, 0.0f);
+    float rest = sphere.radius * sphere.radius - dz * dz;
+    if (rest < 0.0f)
+      continue;
+
+    // Squared distance from sphere center to 4 boxes
+    const __m128 cx = _mm_set1_ps(sphere.x), cy = _mm_set1_ps(sphere.y), r2 = _mm_set1_ps(rest);
+    for (uint32_t tile = 0; tile < paddedTiles; tile += 4) {
+      __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + tile), cx), zero),
+        _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(maxX + tile)), zero));
+      __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY + tile), cy), zero),
+        _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(maxY + tile)), zero));
+      __m128 dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+      int mask = _mm_movemask_ps(_mm_cmple_ps(dist, r2));
+      for (; mask != 0; mask &= mask - 1) {
+        uint32_t lane = mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : 3;
+        sliceClusters[tile + lane].push_back(sphere.lightId);
+      }
+    }
+  }
+}
+
+void ClusteredLighting::Build(const ClusterGridDesc& gridDesc, const float view[16], const std::vector<ClusterLight>& lights) {
+  auto start = std::chrono::high_resolution_clock::now();
+  grid = gridDesc;
+  stats = ClusterStats();
+
+  // Directional lights go first and are not clustered
+  sortedLights.clear();
+  for (const ClusterLight& light : lights)
+    if (light.position[3] > 0.5f)
+      sortedLights.push_back(light);
+  stats.globalLights = (uint32_t)sortedLights.size();
+
+  // Point lights to view space, ones out of depth range are dropped
+  float sliceScale = grid.GetSliceScale(), sliceBias = grid.GetSliceBias();
+  auto sliceOf = [&](float z) {
+    float slice = std::floor(std::log(std::max(z, grid.nearZ)) * sliceScale + sliceBias);
+    return (uint32_t)std::min(std::max(slice, 0.0f), (float)grid.slices - 1);
+  };
+  spheres.clear();
+  for (const ClusterLight& light : lights) {
+    if (light.position[3] > 0.5f)
+      continue;
+
+    ViewSphere sphere;
+    const float* p = light.position;
+    sphere.x = p[0] * view[0] + p[1] * view[4] + p[2] * view[8] + view[12];
+    sphere.y = p[0] * view[1] + p[1] * view[5] + p[2] * view[9] + view[13];
+    sphere.z = p[0] * view[2] + p[1] * view[6] + p[2] * view[10] + view[14];
+    sphere.radius = GetLightRange(light);
+    if (sphere.radius <= 0.0f || sphere.z + sphere.radius < grid.nearZ || sphere.z - sphere.radius > grid.farZ)
+      continue;
+
+    sphere.firstSlice = sliceOf(sphere.z - sphere.radius);
+    sphere.lastSlice = sliceOf(sphere.z + sphere.radius);
+    sphere.lightId = (uint32_t)sortedLights.size();
+    sortedLights.push_back(light);
+    spheres.push_back(sphere);
+  }
+  stats.pointLights = (uint32_t)spheres.size();
+
+  uint32_t clusterCount = grid.GetClusterCount();
+  clusterLights.resize(clusterCount);
+  ParallelFor(grid.slices, [this](size_t slice) { AssignSlice((uint32_t)slice); });
+
+  // Compact lists into one index buffer
+  clusters.resize(clusterCount);
+  indices.clear();
+  for (uint32_t cluster = 0; cluster < clusterCount; cluster++) {
+    const std::vector<uint32_t>& list = clusterLights[cluster];
+    clusters[cluster] = { (uint32_t)indices.size(), (uint32_t)list.size() };
+    indices.insert(indices.end(), list.begin(), list.end());
+    stats.maxPerCluster = std::max(stats.maxPerCluster, (uint32_t)list.size());
+  }
+  stats.indices = (uint32_t)indices.size();
+
+  stats.buildMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Light as pbrLightable_PS reads it from structured buffer.
+// position.w > 0.5 - directional light, xyz is direction towards it; color.w - intensity
+struct ClusterLight {
+  float position[4];
+  float color[4];
+};
+
+// Range of the cluster in the light index list
+struct ClusterRange {
+  uint32_t offset;
+  uint32_t count;
+};
+
+// View frustum split into tilesX * tilesY screen tiles and logarithmic depth slices
+struct ClusterGridDesc {
+  uint32_t tilesX = 16, tilesY = 9, slices = 24;
+  float tanHalfFovX = 1.0f, tanHalfFovY = 1.0f;
+  float nearZ = 0.01f, farZ = 100.0f;
+
+  // Frustum of perspective projection (XMMatrixPerspectiveFovLH layout, row-major)
+  static ClusterGridDesc FromProjection(const float projection[16]);
+
+  uint32_t GetClusterCount() const { return tilesX * tilesY * slices; }
+
+  // slice = log(z) * scale + bias
+  float GetSliceScale() const;
+  float GetSliceBias() const;
+};
+
+struct ClusterStats {
+  uint32_t globalLights = 0; // directional, shaded by every pixel
+  uint32_t pointLights = 0;  // in view frustum
+  uint32_t indices = 0;
+  uint32_t maxPerCluster = 0;
+  float buildMs = 0.0f;
+};
+
+// Assigns point lights to clusters on CPU: light spheres are tested against cluster boxes
+// four tiles at once, depth slices run in parallel.
+class ClusteredLighting {
+public:
+  // Point light influence ends where color.w / d^2 falls below cutoff
+  void SetCutoff(float value) { cutoff = value; }
+  float GetCutoff() const { return cutoff; }
+
+  float GetLightRange(const ClusterLight& light) const;
+
+  // view is row-major world to view matrix (row vectors)
+  void Build(const ClusterGridDesc& grid, const float view[16], const std::vector<ClusterLight>& lights);
+
+  // Directional lights first (GetStats().globalLights), then point lights of the index list
+  const std::vector<ClusterLight>& GetLights() const { return sortedLights; }
+  const std::vector<ClusterRange>& GetClusters() const { return clusters; }
+  const std::vector<uint32_t>& GetIndices() const { return indices; }
+  const ClusterGridDesc& GetGrid() const { return grid; }
+  const ClusterStats& GetStats() const { return stats; }
+
+private:
+  struct ViewSphere {
+    float x, y, z, radius;
+    uint32_t firstSlice, lastSlice;
+    uint32_t lightId;
+  };
+
+  // Tile boxes of one slice in SoA layout, padded to 4 tiles
+  void BuildSliceBounds(uint32_t slice, float* minX, float* maxX, float* minY, float* maxY) const;
+  void AssignSlice(uint32_t slice);
+
+  float cutoff = 1.0f / 256.0f;
+
+  ClusterGridDesc grid;
+  std::vector<ViewSphere> spheres;
+  std::vector<std::vector<uint32_t>> clusterLights;
+
+  std::vector<ClusterLight> sortedLights;
+  std::vector<ClusterRange> clusters;
+  std::vector<uint32_t> indices;
+  ClusterStats stats;
+};
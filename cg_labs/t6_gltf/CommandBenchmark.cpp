@@ -0,0 +1,170 @@
+#include "CommandBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "GfxCommandBuffer.h"
+#include "GfxNull.h"
+#include "GfxParallelSubmit.h"
+#include "JobSystem.h"
+
+namespace {
+  const uint32_t shaderCount = 16;
+  const uint32_t textureSets = 256;
+  const uint32_t tuningFrames = 20;
+
+  double NowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  struct SyntheticDraw {
+    float depth;
+    uint32_t shader;
+    uint32_t textureSet;
+    uint32_t mesh;
+  };
+
+  // Same bindings as Model records per mesh
+  void RecordDraw(GfxCommandBuffer& buffer, const SyntheticDraw& draw, uint64_t key) {
+    const GfxShaderStage vs = GfxShaderStage::vertex, ps = GfxShaderStage::pixel;
+    const GfxHandle textureBase = 1000, meshBase = 100000;
+
+    buffer.BeginPacket(key);
+    buffer.SetRasterizerState(1);
+    buffer.SetIndexBuffer(meshBase + 2 * draw.mesh, GfxFormat::r32Uint);
+    buffer.SetVertexBuffer(0, meshBase + 2 * draw.mesh + 1, 44);
+    buffer.SetInputLayout(2);
+    buffer.SetTopology(GfxTopology::triangleList);
+    buffer.SetShader(vs, 3);
+    buffer.SetConstantBuffer(vs, 0, meshBase * 2 + draw.mesh);
+    buffer.SetConstantBuffer(vs, 1, 4);
+    buffer.SetShader(ps, 10 + draw.shader);
+    buffer.SetConstantBuffer(ps, 0, meshBase * 2 + draw.mesh);
+    buffer.SetConstantBuffer(ps, 1, 4);
+    for (uint32_t slot = 0; slot < 3; slot++) {
+      buffer.SetShaderResource(ps, slot, textureBase + draw.textureSet * 3 + slot);
+      buffer.SetSampler(ps, slot, 5);
+    }
+    for (uint32_t slot = 3; slot < 11; slot++)
+      buffer.SetShaderResource(ps, slot, 20 + slot);
+    buffer.DrawIndexed(36);
+  }
+
+  uint64_t KeyOf(const SyntheticDraw& draw, CommandBenchOrder order) {
+    uint64_t material = ((uint64_t)draw.shader << 16) | draw.textureSet;
+    switch (order) {
+    case CommandBenchOrder::depthMaterial: return GfxSortKey::Opaque(draw.depth, material);
+    case CommandBenchOrder::material: return GfxSortKey::Make(0, 0, material);
+    default: return 0;
+    }
+  }
+}
+
+CommandBenchResult RunCommandBenchmark(uint32_t draws, uint32_t bufferCount, uint32_t repeats) {
+  JobSystem& jobs = JobSystem::GetInstance();
+  CommandBenchResult result;
+  result.draws = draws;
+  result.buffers = bufferCount > 0 ? bufferCount : (uint32_t)jobs.GetThreadCount();
+  repeats = std::max(repeats, 1u);
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> depth(0.1f, 500.0f);
+  std::vector<SyntheticDraw> scene(draws);
+  for (uint32_t i = 0; i < draws; i++)
+    scene[i] = { depth(rng), (uint32_t)(rng() % shaderCount), (uint32_t)(rng() % textureSets), i };
+
+  std::vector<GfxCommandBuffer> buffers(result.buffers);
+  std::vector<const GfxCommandBuffer*> sources;
+  for (const GfxCommandBuffer& buffer : buffers)
+    sources.push_back(&buffer);
+
+  GfxNullContext context;
+  GfxCommandList list;
+  for (int order = 0; order < (int)CommandBenchOrder::count; order++) {
+    CommandBenchOrderResult& orderResult = result.orders[order];
+    orderResult.mergeMs = orderResult.replayMs = 1e30;
+
+    for (uint32_t repeat = 0; repeat < repeats; repeat++) {
+      // Every buffer records a contiguous range of draws on its own job
+      double start = NowMs();
+      jobs.ParallelFor(buffers.size(), [&](size_t b) {
+        GfxCommandBuffer& buffer = buffers[b];
+        buffer.Clear();
+        size_t first = draws * b / buffers.size(), end = draws * (b + 1) / buffers.size();
+        for (size_t i = first; i < end; i++)
+          RecordDraw(buffer, scene[i], KeyOf(scene[i], (CommandBenchOrder)order));
+      });
+      double recordMs = NowMs() - start;
+      if (order == 0)
+        result.recordMs = repeat == 0 ? recordMs : std::min(result.recordMs, recordMs);
+
+      start = NowMs();
+      list.Merge(sources.data(), sources.size(), order != (int)CommandBenchOrder::recorded);
+      orderResult.mergeMs = std::min(orderResult.mergeMs, NowMs() - start);
+
+      context.InvalidateState();
+      context.ResetStats();
+      start = NowMs();
+      list.Replay(context);
+      orderResult.replayMs = std::min(orderResult.replayMs, NowMs() - start);
+      orderResult.stateChanges = context.GetStats().stateChanges;
+      orderResult.redundantSkipped = context.GetStats().redundantSkipped;
+    }
+
+    if (order == (int)CommandBenchOrder::depthMaterial) {
+      GfxCommandListStats stats = list.GetStats();
+      result.commands = stats.commands;
+      result.payloadBytes = stats.payloadBytes;
+
+      std::stringstream stream;
+      double start = NowMs();
+      list.Write(stream);
+      result.writeMs = NowMs() - start;
+      result.streamBytes = stream.str().size();
+
+      GfxCommandList loaded;
+      start = NowMs();
+      loaded.Read(stream);
+      result.readMs = NowMs() - start;
+
+      // Chunk size converges over the first frames, the first one is always serial
+      GfxNullDevice device;
+      GfxParallelSubmitter submitter;
+      result.submitMs = 1e30;
+      for (uint32_t frame = 0; frame < tuningFrames + repeats; frame++) {
+        start = NowMs();
+        submitter.Replay(device, list);
+        if (frame >= tuningFrames)
+          result.submitMs = std::min(result.submitMs, NowMs() - start);
+      }
+      result.submitChunks = submitter.GetStats().chunks;
+      result.submitPacketUs = submitter.GetStats().packetUs;
+    }
+  }
+  return result;
+}
+
+void WriteCommandBenchmark(std::ostream& out, const CommandBenchResult& result) {
+  static const char* orderNames[] = { "recorded", "depth, material", "material" };
+  char line[200];
+  snprintf(line, sizeof(line), "command buffer benchmark: %u draws in %u buffers, %u commands, %u payload bytes\n",
+    result.draws, result.buffers, result.commands, result.payloadBytes);
+  out << line;
+  snprintf(line, sizeof(line), "record %.3f ms, write %.3f ms, read %.3f ms, stream %llu bytes\n", result.recordMs, result.writeMs,
+    result.readMs, (unsigned long long)result.streamBytes);
+  out << line;
+  out << "order              merge ms  replay ms  state changes  redundant skipped\n";
+  for (int order = 0; order < (int)CommandBenchOrder::count; order++) {
+    const CommandBenchOrderResult& orderResult = result.orders[order];
+    snprintf(line, sizeof(line), "%-16s  %9.3f  %9.3f  %13llu  %17llu\n", orderNames[order], orderResult.mergeMs, orderResult.replayMs,
+      (unsigned long long)orderResult.stateChanges, (unsigned long long)orderResult.redundantSkipped);
+    out << line;
+  }
+  snprintf(line, sizeof(line), "parallel replay (depth, material): %.3f ms in %u chunks, %.3f us per packet\n", result.submitMs,
+    result.submitChunks, result.submitPacketUs);
+  out << line;
+}
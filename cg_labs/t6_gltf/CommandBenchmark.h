@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Order of packets in the merged list
+enum class CommandBenchOrder : int
+{
+  recorded = 0,      // concatenated, no sort
+  depthMaterial = 1, // GfxSortKey::Opaque, front to back then material
+  material = 2,      // material only
+  count = 3,
+};
+
+struct CommandBenchOrderResult {
+  double mergeMs = 0.0;
+  double replayMs = 0.0;        // into GfxNullContext with redundancy filter
+  uint64_t stateChanges = 0;    // bindings left after the filter
+  uint64_t redundantSkipped = 0;
+};
+
+// Synthetic draws (Model::Render like packets) recorded in parallel, merged, sorted and replayed headless
+struct CommandBenchResult {
+  uint32_t draws = 0;
+  uint32_t buffers = 0;
+  uint32_t commands = 0;
+  uint32_t payloadBytes = 0;
+  double recordMs = 0.0;
+  double writeMs = 0.0, readMs = 0.0; // binary serialization of the sorted list
+  uint64_t streamBytes = 0;
+  CommandBenchOrderResult orders[(int)CommandBenchOrder::count];
+  // Sorted list replayed by GfxParallelSubmitter on GfxNullDevice deferred contexts, after tuning frames
+  double submitMs = 0.0;
+  uint32_t submitChunks = 0;
+  double submitPacketUs = 0.0;
+};
+
+// buffers == 0 means JobSystem thread count; timings are best of repeats
+CommandBenchResult RunCommandBenchmark(uint32_t draws, uint32_t buffers = 0, uint32_t repeats = 5);
+
+void WriteCommandBenchmark(std::ostream& out, const CommandBenchResult& result);
@@ -0,0 +1,300 @@
+#include "CubeMapConverter.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CUBEMAP_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+  const float PI = 3.14159265358979f;
+
+  // Rows of one face converted by one task
+  const uint32_t rowsPerTask = 32;
+
+  // RGBA texel ops, one SSE register per texel
+#ifdef CUBEMAP_USE_SSE
+  typedef __m128 vec4;
+
+  inline vec4 Load4(const float* p) { return _mm_loadu_ps(p); }
+  inline void Store4(float* p, vec4 v) { _mm_storeu_ps(p, v); }
+  inline vec4 Zero4() { return _mm_setzero_ps(); }
+  inline vec4 Madd4(vec4 a, float s, vec4 acc) { return _mm_add_ps(acc, _mm_mul_ps(a, _mm_set1_ps(s))); }
+  inline vec4 Max04(vec4 a) { return _mm_max_ps(a, _mm_setzero_ps()); }
+#else
+  struct vec4 { float v[4]; };
+
+  inline vec4 Load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+  inline void Store4(float* p, vec4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+  inline vec4 Zero4() { return { { 0, 0, 0, 0 } }; }
+  inline vec4 Madd4(vec4 a, float s, vec4 acc) { for (int i = 0; i < 4; i++) acc.v[i] += a.v[i] * s; return acc; }
+  inline vec4 Max04(vec4 a) { for (int i = 0; i < 4; i++) a.v[i] = std::max(a.v[i], 0.0f); return a; }
+#endif
+
+  // Bilinear fetch from lat-long image: wraps around in longitude, clamps at the poles
+  inline vec4 FetchEquirect(const HDRImage& src, const float dir[3]) {
+    float u = 1.0f - atan2f(dir[2], dir[0]) / (2.0f * PI);
+    float v = 0.5f - asinf(std::max(-1.0f, std::min(1.0f, dir[1]))) / PI;
+
+    float fx = u * src.width - 0.5f;
+    float fy = std::max(0.0f, std::min(v * src.height - 0.5f, (float)(src.height - 1)));
+    float x0f = floorf(fx), y0f = floorf(fy);
+    float tx = fx - x0f, ty = fy - y0f;
+
+    int w = (int)src.width;
+    int x0 = ((int)x0f % w + w) % w;
+    int x1 = (x0 + 1) % w;
+    uint32_t y0 = (uint32_t)y0f;
+    uint32_t y1 = std::min(y0 + 1, src.height - 1);
+
+    vec4 res = Zero4();
+    res = Madd4(Load4(src.Texel(x0, y0)), (1 - tx) * (1 - ty), res);
+    res = Madd4(Load4(src.Texel(x1, y0)), tx * (1 - ty), res);
+    res = Madd4(Load4(src.Texel(x0, y1)), (1 - tx) * ty, res);
+    res = Madd4(Load4(src.Texel(x1, y1)), tx * ty, res);
+    return res;
+  }
+
+  // Zero order modified Bessel function of the first kind
+  double BesselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+      if (term < sum * 1e-12)
+        break;
+    }
+    return sum;
+  }
+
+  // 8 taps of 2x downsampling filter, tap i is at distance (i - 3.5) source texels from destination center
+  const int kaiserTaps = 8;
+
+  void KaiserWeights(float weights[kaiserTaps]) {
+    const double alpha = 4.0;
+    const double radius = 4.0;
+    double sum = 0;
+    double w[kaiserTaps];
+    for (int i = 0; i < kaiserTaps; i++) {
+      double d = i - 3.5;
+      double x = d / 2.0;
+      double sinc = sin(PI * x) / (PI * x);
+      double t = d / radius;
+      double window = BesselI0(alpha * sqrt(std::max(0.0, 1.0 - t * t))) / BesselI0(alpha);
+      w[i] = sinc * window;
+      sum += w[i];
+    }
+    for (int i = 0; i < kaiserTaps; i++)
+      weights[i] = (float)(w[i] / sum);
+  }
+}
+
+uint32_t CubeMapConverter::SuggestFaceSize(uint32_t equirectWidth) {
+  uint32_t size = 16;
+  while (size * 2 <= equirectWidth / 4 && size < 2048)
+    size *= 2;
+  return size;
+}
+
+uint32_t CubeMapConverter::FullMipCount(uint32_t size) {
+  uint32_t count = 1;
+  while (size > 1) {
+    size /= 2;
+    count++;
+  }
+  return count;
+}
+
+void CubeMapConverter::FaceDirection(uint32_t face, float u, float v, float dir[3]) {
+  switch (face) {
+  case 0: dir[0] = 1;  dir[1] = -v; dir[2] = -u; break; // +X
+  case 1: dir[0] = -1; dir[1] = -v; dir[2] = u;  break; // -X
+  case 2: dir[0] = u;  dir[1] = 1;  dir[2] = v;  break; // +Y
+  case 3: dir[0] = u;  dir[1] = -1; dir[2] = -v; break; // -Y
+  case 4: dir[0] = u;  dir[1] = -v; dir[2] = 1;  break; // +Z
+  default: dir[0] = -u; dir[1] = -v; dir[2] = -1; break; // -Z
+  }
+}
+
+void CubeMapConverter::DirectionToFace(const float dir[3], uint32_t& face, float& u, float& v) {
+  float ax = fabsf(dir[0]), ay = fabsf(dir[1]), az = fabsf(dir[2]);
+
+  if (ax >= ay && ax >= az) {
+    face = dir[0] > 0 ? 0 : 1;
+    u = (dir[0] > 0 ? -dir[2] : dir[2]) / ax;
+    v = -dir[1] / ax;
+  }
+  else if (ay >= az) {
+    face = dir[1] > 0 ? 2 : 3;
+    u = dir[0] / ay;
+    v = (dir[1] > 0 ? dir[2] : -dir[2]) / ay;
+  }
+  else {
+    face = dir[2] > 0 ? 4 : 5;
+    u = (dir[2] > 0 ? dir[0] : -dir[0]) / az;
+    v = -dir[1] / az;
+  }
+}
+
+void CubeMapConverter::SampleEquirect(const HDRImage& equirect, const float dir[3], float rgba[4]) {
+  Store4(rgba, FetchEquirect(equirect, dir));
+}
+
+void CubeMapConverter::SampleCube(const CubeMapImage& cube, uint32_t mip, const float dir[3], float rgba[4]) {
+  uint32_t face;
+  float u, v;
+  DirectionToFace(dir, face, u, v);
+
+  const HDRImage& src = cube.faces[face][mip];
+  float fx = std::max(0.0f, std::min((u + 1.0f) * 0.5f * src.width - 0.5f, (float)(src.width - 1)));
+  float fy = std::max(0.0f, std::min((v + 1.0f) * 0.5f * src.height - 0.5f, (float)(src.height - 1)));
+  uint32_t x0 = (uint32_t)fx, y0 = (uint32_t)fy;
+  uint32_t x1 = std::min(x0 + 1, src.width - 1), y1 = std::min(y0 + 1, src.height - 1);
+  float tx = fx - x0, ty = fy - y0;
+
+  vec4 res = Zero4();
+  res = Madd4(Load4(src.Texel(x0, y0)), (1 - tx) * (1 - ty), res);
+  res = Madd4(Load4(src.Texel(x1, y0)), tx * (1 - ty), res);
+  res = Madd4(Load4(src.Texel(x0, y1)), (1 - tx) * ty, res);
+  res = Madd4(Load4(src.Texel(x1, y1)), tx * ty, res);
+  Store4(rgba, res);
+}
+
+void CubeMapConverter::Convert(const HDRImage& equirect, CubeMapImage& cube) const {
+  uint32_t faceSize = params.faceSize > 0 ? params.faceSize : SuggestFaceSize(equirect.width);
+  ConvertBaseLevel(equirect, faceSize, cube);
+  BuildMipChain(cube);
+}
+
+void CubeMapConverter::ConvertBaseLevel(const HDRImage& equirect, uint32_t faceSize, CubeMapImage& cube) const {
+  cube.faceSize = faceSize;
+  cube.mipLevels = 1;
+  for (uint32_t face = 0; face < 6; face++) {
+    cube.faces[face].resize(1);
+    cube.faces[face][0].Resize(faceSize, faceSize);
+  }
+
+  if (equirect.width == 0 || equirect.height == 0)
+    return;
+
+  // Supersample when the face is much smaller than the source to avoid aliasing
+  uint32_t ss = std::max(1u, std::min(4u, equirect.width / (4 * faceSize)));
+  float ssWeight = 1.0f / (ss * ss);
+
+  uint32_t tasksPerFace = (faceSize + rowsPerTask - 1) / rowsPerTask;
+  ParallelFor(6 * tasksPerFace, [&](size_t task) {
+    uint32_t face = (uint32_t)(task / tasksPerFace);
+    uint32_t rowStart = (uint32_t)(task % tasksPerFace) * rowsPerTask;
+    uint32_t rowEnd = std::min(rowStart + rowsPerTask, faceSize);
+    HDRImage& dst = cube.faces[face][0];
+
+    for (uint32_t y = rowStart; y < rowEnd; y++)
+      for (uint32_t x = 0; x < faceSize; x++) {
+        vec4 color = Zero4();
+        for (uint32_t sy = 0; sy < ss; sy++)
+          for (uint32_t sx = 0; sx < ss; sx++) {
+            float u = 2.0f * (x + (sx + 0.5f) / ss) / faceSize - 1.0f;
+            float v = 2.0f * (y + (sy + 0.5f) / ss) / faceSize - 1.0f;
+
+            float dir[3];
+            FaceDirection(face, u, v, dir);
+            float invLen = 1.0f / sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+            dir[0] *= invLen;
+            dir[1] *= invLen;
+            dir[2] *= invLen;
+
+            color = Madd4(FetchEquirect(equirect, dir), ssWeight, color);
+          }
+        Store4(dst.Texel(x, y), color);
+      }
+  }, params.threads);
+}
+
+void CubeMapConverter::BuildMipChain(CubeMapImage& cube) const {
+  uint32_t fullCount = FullMipCount(cube.faceSize);
+  uint32_t mipLevels = params.mipLevels > 0 ? std::min(params.mipLevels, fullCount) : fullCount;
+
+  for (uint32_t face = 0; face < 6; face++)
+    cube.faces[face].resize(mipLevels);
+
+  // Each level needs previous level of all faces (seams), so faces are parallel within the level
+  for (uint32_t mip = 1; mip < mipLevels; mip++) {
+    uint32_t size = std::max(1u, cube.faceSize >> mip);
+    ParallelFor(6, [&](size_t face) {
+      HDRImage& dst = cube.faces[face][mip];
+      dst.Resize(size, size);
+
+      const HDRImage& src = cube.faces[face][mip - 1];
+      // Wide kernel makes no sense on tiny levels
+      if (params.mipFilter == CubeMipFilter::kaiser && src.width >= kaiserTaps)
+        DownsampleKaiser(cube, (uint32_t)face, mip - 1, dst);
+      else
+        DownsampleBox(src, dst);
+    }, params.threads);
+  }
+
+  cube.mipLevels = mipLevels;
+}
+
+void CubeMapConverter::DownsampleBox(const HDRImage& src, HDRImage& dst) const {
+  for (uint32_t y = 0; y < dst.height; y++)
+    for (uint32_t x = 0; x < dst.width; x++) {
+      uint32_t x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+      uint32_t y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+
+      vec4 sum = Zero4();
+      sum = Madd4(Load4(src.Texel(x0, y0)), 0.25f, sum);
+      sum = Madd4(Load4(src.Texel(x1, y0)), 0.25f, sum);
+      sum = Madd4(Load4(src.Texel(x0, y1)), 0.25f, sum);
+      sum = Madd4(Load4(src.Texel(x1, y1)), 0.25f, sum);
+      Store4(dst.Texel(x, y), sum);
+    }
+}
+
+void CubeMapConverter::DownsampleKaiser(const CubeMapImage& cube, uint32_t face, uint32_t srcMip, HDRImage& dst) const {
+  float weights[kaiserTaps];
+  KaiserWeights(weights);
+
+  const HDRImage& src = cube.faces[face][srcMip];
+  int size = (int)src.width;
+
+  // Texel of this mip, coordinates out of the face are reprojected to the neighbour face
+  auto fetch = [&](int x, int y) -> const float* {
+    if (x >= 0 && y >= 0 && x < size && y < size)
+      return src.Texel(x, y);
+
+    float dir[3];
+    FaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, dir);
+
+    uint32_t nFace;
+    float u, v;
+    DirectionToFace(dir, nFace, u, v);
+
+    int nx = std::max(0, std::min(size - 1, (int)floorf((u + 1.0f) * 0.5f * size)));
+    int ny = std::max(0, std::min(size - 1, (int)floorf((v + 1.0f) * 0.5f * size)));
+    return cube.faces[nFace][srcMip].Texel(nx, ny);
+  };
+
+  for (uint32_t y = 0; y < dst.height; y++)
+    for (uint32_t x = 0; x < dst.width; x++) {
+      int sx = 2 * (int)x - kaiserTaps / 2 + 1;
+      int sy = 2 * (int)y - kaiserTaps / 2 + 1;
+      bool inside = sx >= 0 && sy >= 0 && sx + kaiserTaps <= size && sy + kaiserTaps <= size;
+
+      vec4 sum = Zero4();
+      for (int j = 0; j < kaiserTaps; j++) {
+        vec4 row = Zero4();
+        for (int i = 0; i < kaiserTaps; i++) {
+          const float* texel = inside ? src.Texel(sx + i, sy + j) : fetch(sx + i, sy + j);
+          row = Madd4(Load4(texel), weights[i], row);
+        }
+        sum = Madd4(row, weights[j], sum);
+      }
+
+      // Negative lobes may ring below zero near very bright texels
+      Store4(dst.Texel(x, y), Max04(sum));
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// RGBA float image, 4 floats per texel, rows are tightly packed
+struct HDRImage {
+  uint32_t width = 0, height = 0;
+  std::vector<float> data;
+
+  void Resize(uint32_t w, uint32_t h) {
+    width = w;
+    height = h;
+    data.assign((size_t)w * h * 4, 0.0f);
+  }
+
+  float* Texel(uint32_t x, uint32_t y) { return &data[((size_t)y * width + x) * 4]; }
+  const float* Texel(uint32_t x, uint32_t y) const { return &data[((size_t)y * width + x) * 4]; }
+};
+
+// Cube map faces in D3D order (+X, -X, +Y, -Y, +Z, -Z), each with mip chain
+struct CubeMapImage {
+  uint32_t faceSize = 0;
+  uint32_t mipLevels = 0;
+  std::vector<HDRImage> faces[6]; // faces[face][mip]
+};
+
+enum class CubeMipFilter : int
+{
+  box = 0,    // 2x2 average
+  kaiser = 1, // 8x8 Kaiser windowed sinc, taps beyond face edge are fetched from neighbour faces
+};
+
+struct CubeMapConvertParams {
+  uint32_t faceSize = 0;   // 0 - choose from source width (SuggestFaceSize)
+  uint32_t mipLevels = 0;  // 0 - full chain down to 1x1
+  CubeMipFilter mipFilter = CubeMipFilter::kaiser;
+  uint32_t threads = 0;    // 0 - all workers
+};
+
+// CPU equirectangular (lat-long) to cube map conversion, matches HDRToCubeMap_PS mapping
+class CubeMapConverter {
+public:
+  CubeMapConverter() {};
+
+  CubeMapConverter(const CubeMapConvertParams& convertParams) : params(convertParams) {};
+
+  // Resample and build mip chain
+  void Convert(const HDRImage& equirect, CubeMapImage& cube) const;
+
+  // Separate stages: mip 0 only / mips from mip 0
+  void ConvertBaseLevel(const HDRImage& equirect, uint32_t faceSize, CubeMapImage& cube) const;
+  void BuildMipChain(CubeMapImage& cube) const;
+
+  // Face size with roughly the same texel density as source (4 faces around the equator)
+  static uint32_t SuggestFaceSize(uint32_t equirectWidth);
+  static uint32_t FullMipCount(uint32_t size);
+
+  // Direction through face point (u, v in [-1, 1], v goes down); u, v may be outside the face
+  static void FaceDirection(uint32_t face, float u, float v, float dir[3]);
+  static void DirectionToFace(const float dir[3], uint32_t& face, float& u, float& v);
+
+  // Bilinear fetches by direction (cube fetch is clamped to the face, no filtering across seams)
+  static void SampleEquirect(const HDRImage& equirect, const float dir[3], float rgba[4]);
+  static void SampleCube(const CubeMapImage& cube, uint32_t mip, const float dir[3], float rgba[4]);
+
+private:
+  void DownsampleBox(const HDRImage& src, HDRImage& dst) const;
+  void DownsampleKaiser(const CubeMapImage& cube, uint32_t face, uint32_t srcMip, HDRImage& dst) const;
+
+  CubeMapConvertParams params;
+};
@@ -1,20 +1,12 @@
 #include "D3DInclude.h"
 
 HRESULT D3DInclude::Open(D3D_INCLUDE_TYPE includeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes) {
-  FILE* pFile = nullptr;
-  fopen_s(&pFile, pFileName, "rb");
-  if (pFile == nullptr) {
+  uint32_t size = 0;
+  const char* buffer = tracker.Open(pFileName, pParentData, size);
+  if (buffer == nullptr) {
     return E_FAIL;
   }
 
-  fseek(pFile, 0, SEEK_END);
-  long size = ftell(pFile);
-  fseek(pFile, 0, SEEK_SET);
-
-  char* buffer = new char[size];
-  fread(buffer, 1, size, pFile);
-  fclose(pFile);
-
   *ppData = buffer;
   *pBytes = size;
 
@@ -22,6 +14,6 @@ HRESULT D3DInclude::Open(D3D_INCLUDE_TYPE includeType, LPCSTR pFileName, LPCVOID
 }
 
 HRESULT D3DInclude::Close(LPCVOID pData) {
-  free(const_cast<void*>(pData));
+  tracker.Close(pData);
   return S_OK;
 }
@@ -5,11 +5,20 @@
 #include <d3d11.h>
 #include <fstream>
 
+#include "ShaderCache.h"
+
 class D3DInclude : public ID3DInclude {
 public:
+  // sourceFile - file passed to D3DCompileFromFile, its includes are looked up next to it
+  explicit D3DInclude(const std::string& sourceFile) : tracker(sourceFile) {}
 
   HRESULT __stdcall Open(D3D_INCLUDE_TYPE includeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes);
 
   HRESULT __stdcall Close(LPCVOID pData);
 
+  // Files included by the compilation
+  const std::vector<std::string>& GetDependencies() const { return tracker.GetDependencies(); }
+
+private:
+  ShaderIncludeTracker tracker;
 };
@@ -0,0 +1,219 @@
+#include "EnvLightExtractor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  const double PI = 3.14159265358979;
+
+  inline double Luminance(const float* rgb) {
+    return 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+  }
+
+  // Light candidate: union of median cut regions
+  struct LightCandidate {
+    std::vector<size_t> regions;
+    double rgb[3] = { 0, 0, 0 };
+    double dir[3] = { 0, 0, 0 };
+    double energy = 0;
+    double solidAngle = 0;
+  };
+}
+
+void EnvLightExtractor::TexelDirection(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float dir[3]) {
+  // u = 1 - atan2(z, x) / 2pi, v = 0.5 - asin(y) / pi
+  double u = (x + 0.5) / width, v = (y + 0.5) / height;
+  double phi = (1.0 - u) * 2.0 * PI;
+  double lat = (0.5 - v) * PI;
+
+  dir[0] = (float)(cos(lat) * cos(phi));
+  dir[1] = (float)sin(lat);
+  dir[2] = (float)(cos(lat) * sin(phi));
+}
+
+double EnvLightExtractor::Energy(const Tables& tables, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const {
+  size_t stride = tables.width + 1;
+  const std::vector<double>& sat = tables.energySAT;
+  return sat[y1 * stride + x1] - sat[y0 * stride + x1] - sat[y1 * stride + x0] + sat[y0 * stride + x0];
+}
+
+void EnvLightExtractor::Split(const Tables& tables, const Region& region, uint32_t depth, std::vector<Region>& regions) const {
+  uint32_t w = region.x1 - region.x0, h = region.y1 - region.y0;
+  if (depth == 0 || (w <= 1 && h <= 1)) {
+    regions.push_back(region);
+    return;
+  }
+
+  // Split the angularly longer side at the energy median
+  double centerLat = PI * (0.5 - (region.y0 + region.y1) * 0.5 / tables.height);
+  double angularW = 2.0 * PI * w / tables.width * cos(centerLat);
+  double angularH = PI * h / tables.height;
+  bool splitX = (angularW >= angularH && w > 1) || h <= 1;
+
+  uint32_t lo = splitX ? region.x0 + 1 : region.y0 + 1;
+  uint32_t hi = splitX ? region.x1 - 1 : region.y1 - 1;
+  double half = region.energy * 0.5;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    double e = splitX ? Energy(tables, region.x0, region.y0, mid, region.y1) : Energy(tables, region.x0, region.y0, region.x1, mid);
+    if (e < half)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  Region a = region, b = region;
+  if (splitX)
+    a.x1 = b.x0 = lo;
+  else
+    a.y1 = b.y0 = lo;
+
+  for (Region* r : { &a, &b }) {
+    r->energy = Energy(tables, r->x0, r->y0, r->x1, r->y1);
+    r->solidAngle = (double)(r->x1 - r->x0) / tables.width * (tables.rowAnglePrefix[r->y1] - tables.rowAnglePrefix[r->y0]);
+  }
+
+  Split(tables, a, depth - 1, regions);
+  Split(tables, b, depth - 1, regions);
+}
+
+float EnvLightExtractor::Extract(const HDRImage& equirect, std::vector<ExtractedLight>& lights, HDRImage* residual) const {
+  lights.clear();
+  if (residual)
+    *residual = equirect;
+
+  uint32_t width = equirect.width, height = equirect.height;
+  if (width == 0 || height == 0)
+    return 0.0f;
+
+  // Solid angle and energy tables
+  Tables tables;
+  tables.width = width;
+  tables.height = height;
+  tables.rowSolidAngle.resize(height);
+  tables.rowAnglePrefix.assign(height + 1, 0.0);
+  for (uint32_t y = 0; y < height; y++) {
+    double lat = PI * (0.5 - (y + 0.5) / height);
+    tables.rowSolidAngle[y] = (2.0 * PI / width) * (PI / height) * cos(lat);
+    tables.rowAnglePrefix[y + 1] = tables.rowAnglePrefix[y] + tables.rowSolidAngle[y] * width;
+  }
+
+  size_t stride = width + 1;
+  tables.energySAT.assign(stride * (height + 1), 0.0);
+  for (uint32_t y = 0; y < height; y++) {
+    double rowSum = 0;
+    for (uint32_t x = 0; x < width; x++) {
+      rowSum += std::max(Luminance(equirect.Texel(x, y)), 0.0) * tables.rowSolidAngle[y];
+      tables.energySAT[(y + 1) * stride + x + 1] = tables.energySAT[y * stride + x + 1] + rowSum;
+    }
+  }
+
+  double totalEnergy = tables.energySAT[height * stride + width];
+  if (totalEnergy <= 0)
+    return 0.0f;
+
+  double threshold = totalEnergy / (4.0 * PI) * params.thresholdScale;
+
+  Region root = { 0, 0, width, height, totalEnergy, tables.rowAnglePrefix[height] };
+  std::vector<Region> regions;
+  Split(tables, root, params.medianCutDepth, regions);
+
+  // Every dense region becomes a candidate with energy above threshold only
+  std::vector<LightCandidate> candidates;
+  for (size_t i = 0; i < regions.size(); i++) {
+    const Region& r = regions[i];
+    if (r.solidAngle <= 0 || r.energy / r.solidAngle <= threshold)
+      continue;
+
+    LightCandidate c;
+    c.regions.push_back(i);
+    for (uint32_t y = r.y0; y < r.y1; y++)
+      for (uint32_t x = r.x0; x < r.x1; x++) {
+        const float* texel = equirect.Texel(x, y);
+        double lum = Luminance(texel);
+        if (lum <= threshold)
+          continue;
+
+        double k = (1.0 - threshold / lum) * tables.rowSolidAngle[y];
+        float dir[3];
+        TexelDirection(x, y, width, height, dir);
+        for (int ch = 0; ch < 3; ch++) {
+          c.rgb[ch] += texel[ch] * k;
+          c.dir[ch] += dir[ch] * (lum - threshold) * tables.rowSolidAngle[y];
+        }
+        c.energy += (lum - threshold) * tables.rowSolidAngle[y];
+        c.solidAngle += tables.rowSolidAngle[y];
+      }
+
+    if (c.energy > 0)
+      candidates.push_back(c);
+  }
+
+  // Merge regions of one source (e.g. sun cut in two)
+  double cosMerge = cos(params.mergeAngle * PI / 180.0);
+  auto normalized = [](const double d[3], double out[3]) {
+    double len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    for (int i = 0; i < 3; i++)
+      out[i] = len > 0 ? d[i] / len : 0.0;
+  };
+
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (size_t i = 0; i < candidates.size() && !merged; i++)
+      for (size_t j = i + 1; j < candidates.size() && !merged; j++) {
+        double a[3], b[3];
+        normalized(candidates[i].dir, a);
+        normalized(candidates[j].dir, b);
+        if (a[0] * b[0] + a[1] * b[1] + a[2] * b[2] < cosMerge)
+          continue;
+
+        LightCandidate& dst = candidates[i];
+        const LightCandidate& src = candidates[j];
+        dst.regions.insert(dst.regions.end(), src.regions.begin(), src.regions.end());
+        for (int ch = 0; ch < 3; ch++) {
+          dst.rgb[ch] += src.rgb[ch];
+          dst.dir[ch] += src.dir[ch];
+        }
+        dst.energy += src.energy;
+        dst.solidAngle += src.solidAngle;
+        candidates.erase(candidates.begin() + j);
+        merged = true;
+      }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const LightCandidate& a, const LightCandidate& b) { return a.energy > b.energy; });
+
+  double extracted = 0;
+  for (const LightCandidate& c : candidates) {
+    if (lights.size() >= params.maxLights || c.energy < totalEnergy * params.minEnergyShare)
+      break;
+
+    ExtractedLight light;
+    double dir[3];
+    normalized(c.dir, dir);
+    for (int ch = 0; ch < 3; ch++) {
+      light.direction[ch] = (float)dir[ch];
+      light.irradiance[ch] = (float)c.rgb[ch];
+    }
+    light.solidAngle = (float)c.solidAngle;
+    lights.push_back(light);
+    extracted += c.energy;
+
+    // Leave only energy below threshold in the environment
+    if (residual)
+      for (size_t regionIdx : c.regions) {
+        const Region& r = regions[regionIdx];
+        for (uint32_t y = r.y0; y < r.y1; y++)
+          for (uint32_t x = r.x0; x < r.x1; x++) {
+            float* texel = residual->Texel(x, y);
+            double lum = Luminance(texel);
+            if (lum > threshold)
+              for (int ch = 0; ch < 3; ch++)
+                texel[ch] = (float)(texel[ch] * threshold / lum);
+          }
+      }
+  }
+
+  return (float)(extracted / totalEnergy);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "CubeMapConverter.h"
+
+// Light found in environment map
+struct ExtractedLight {
+  float direction[3] = { 0, 1, 0 };  // towards the light, unit length
+  float irradiance[3] = { 0, 0, 0 }; // RGB irradiance it gives to surface facing it
+  float solidAngle = 0;              // size of the source (steradians)
+};
+
+struct EnvLightExtractorParams {
+  uint32_t maxLights = 2;
+  uint32_t medianCutDepth = 6;  // 2^depth regions
+  float thresholdScale = 8.0f;  // texels brighter than mean luminance * scale belong to lights
+  float minEnergyShare = 0.02f; // lights with less share of total energy are dropped
+  float mergeAngle = 15.0f;     // degrees, neighbour regions of one source are merged
+};
+
+// Median cut (Debevec 2005) over lat-long HDR image.
+// Regions with the highest energy density become directional lights; the energy above
+// threshold is removed from their texels, giving a residual environment for IBL.
+class EnvLightExtractor {
+public:
+  EnvLightExtractor() {};
+
+  EnvLightExtractor(const EnvLightExtractorParams& extractorParams) : params(extractorParams) {};
+
+  // residual may be nullptr if it is not needed; returns share of energy moved to lights
+  float Extract(const HDRImage& equirect, std::vector<ExtractedLight>& lights, HDRImage* residual) const;
+
+  // Direction of lat-long texel center, same mapping as HDRToCubeMap_PS
+  static void TexelDirection(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float dir[3]);
+
+private:
+  struct Region {
+    uint32_t x0, y0, x1, y1; // [x0, x1) x [y0, y1)
+    double energy;
+    double solidAngle;
+  };
+
+  struct Tables {
+    uint32_t width, height;
+    std::vector<double> energySAT;      // (width + 1) * (height + 1) summed area of luminance * solid angle
+    std::vector<double> rowSolidAngle;  // solid angle of one texel in row
+    std::vector<double> rowAnglePrefix; // solid angle of rows [0, y)
+  };
+
+  double Energy(const Tables& tables, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+  void Split(const Tables& tables, const Region& region, uint32_t depth, std::vector<Region>& regions) const;
+
+  EnvLightExtractorParams params;
+};
@@ -0,0 +1,32 @@
+#include "EyeAdaptation.h"
+
+#include <algorithm>
+#include <cmath>
+
+void EyeAdaptation::SetMeasurement(float luminance, float latencyS) {
+  target = luminance;
+  latency = std::max(latencyS, 0.0f);
+}
+
+float EyeAdaptation::GetEffectiveAdaptationTime() const {
+  if (!compensateLatency)
+    return adaptationS;
+  return std::max(adaptationS - latency, adaptationS * minAdaptationShare);
+}
+
+float EyeAdaptation::Update(float dt) {
+  float tau = GetEffectiveAdaptationTime();
+  if (tau <= 0.0f) {
+    exposure = target;
+    return exposure;
+  }
+
+  float gain = 1.0f - std::exp(-std::max(dt, 0.0f) / tau);
+  exposure += (target - exposure) * gain;
+  return exposure;
+}
+
+void EyeAdaptation::Reset(float luminance) {
+  exposure = target = luminance;
+  latency = 0.0f;
+}
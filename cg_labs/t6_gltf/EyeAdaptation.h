@@ -0,0 +1,37 @@
+#pragma once
+
+// Exponential eye adaptation driven by delayed luminance measurements.
+// Measurement of frame N arrives latency seconds later, so reaction to a light change is
+// delay + filter; with compensation the filter time constant is shortened by the delay
+// (down to minAdaptationShare of it), keeping the overall response close to adaptationS.
+class EyeAdaptation {
+public:
+  explicit EyeAdaptation(float adaptationS = 0.3f) : adaptationS(adaptationS) {}
+
+  void SetAdaptationTime(float seconds) { adaptationS = seconds; }
+  float GetAdaptationTime() const { return adaptationS; }
+  void SetLatencyCompensation(bool enable) { compensateLatency = enable; }
+  bool IsLatencyCompensated() const { return compensateLatency; }
+
+  // New luminance measured latencyS seconds ago
+  void SetMeasurement(float luminance, float latencyS);
+
+  // Advances adaptation by dt seconds, returns current exposure luminance
+  float Update(float dt);
+
+  float GetExposure() const { return exposure; }
+  float GetLatency() const { return latency; }
+  float GetEffectiveAdaptationTime() const;
+
+  void Reset(float luminance = 0.0f);
+
+  static constexpr float minAdaptationShare = 0.25f;
+
+private:
+  float adaptationS;
+  bool compensateLatency = true;
+
+  float exposure = 0.0f;
+  float target = 0.0f;
+  float latency = 0.0f;
+};
@@ -0,0 +1,395 @@
+#include "GfxCommandBuffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+  const uint32_t streamMagic = 0x43584647; // "GFXC"
+  const uint32_t streamVersion = 1;
+
+  // Payload bytes the command reads, 0 for commands without payload
+  // 64-bit, so sizes from a read stream do not wrap
+  uint64_t PayloadSize(const GfxCommand& command) {
+    switch (command.type) {
+    case GfxCommandType::renderTargets: return (uint64_t)command.args[0] * sizeof(GfxHandle);
+    case GfxCommandType::viewport: return sizeof(GfxViewport);
+    case GfxCommandType::clearRenderTarget: return 4 * sizeof(float);
+    case GfxCommandType::updateBuffer: return command.args[1];
+    case GfxCommandType::beginEvent: return 1;
+    default: return 0;
+    }
+  }
+
+  template<typename T>
+  void WriteArray(std::ostream& out, const std::vector<T>& values) {
+    if (!values.empty())
+      out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  template<typename T>
+  bool ReadArray(std::istream& in, std::vector<T>& values, uint32_t count) {
+    values.resize(count);
+    if (count > 0)
+      in.read(reinterpret_cast<char*>(values.data()), (std::streamsize)count * sizeof(T));
+    return (bool)in;
+  }
+}
+
+GfxCommand& GfxCommandBuffer::Add(GfxCommandType type, GfxShaderStage stage, uint32_t slot) {
+  // Commands before the first BeginPacket go to a packet with zero key
+  if (packets.empty())
+    BeginPacket(0);
+
+  stats.calls++;
+  commands.push_back({ type, (uint8_t)stage, (uint16_t)slot, GfxCommand::noPayload, { 0, 0, 0 } });
+  packets.back().commandCount++;
+  return commands.back();
+}
+
+uint32_t GfxCommandBuffer::AddPayload(const void* data, uint32_t size) {
+  // 4 byte alignment keeps floats and handles readable in place
+  uint32_t offset = (uint32_t)(payload.size() + 3) / 4 * 4;
+  payload.resize(offset + size);
+  if (size > 0)
+    memcpy(payload.data() + offset, data, size);
+  return offset;
+}
+
+void GfxCommandBuffer::BeginPacket(uint64_t sortKey) {
+  packets.push_back({ sortKey, (uint32_t)commands.size(), 0 });
+}
+
+void GfxCommandBuffer::Clear() {
+  commands.clear();
+  payload.clear();
+  packets.clear();
+}
+
+void GfxCommandBuffer::SetVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset) {
+  GfxCommand& command = Add(GfxCommandType::vertexBuffer, GfxShaderStage::vertex, slot);
+  command.args[0] = buffer;
+  command.args[1] = stride;
+  command.args[2] = offset;
+}
+
+void GfxCommandBuffer::SetIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) {
+  GfxCommand& command = Add(GfxCommandType::indexBuffer);
+  command.args[0] = buffer;
+  command.args[1] = (uint32_t)format;
+  command.args[2] = offset;
+}
+
+void GfxCommandBuffer::SetInputLayout(GfxHandle layout) {
+  Add(GfxCommandType::inputLayout).args[0] = layout;
+}
+
+void GfxCommandBuffer::SetTopology(GfxTopology topology) {
+  Add(GfxCommandType::topology).args[0] = (uint32_t)topology;
+}
+
+void GfxCommandBuffer::SetShader(GfxShaderStage stage, GfxHandle shader) {
+  Add(GfxCommandType::shader, stage).args[0] = shader;
+}
+
+void GfxCommandBuffer::SetConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) {
+  Add(GfxCommandType::constantBuffer, stage, slot).args[0] = buffer;
+}
+
+void GfxCommandBuffer::SetShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) {
+  Add(GfxCommandType::shaderResource, stage, slot).args[0] = resource;
+}
+
+void GfxCommandBuffer::SetSampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) {
+  Add(GfxCommandType::sampler, stage, slot).args[0] = sampler;
+}
+
+void GfxCommandBuffer::SetRasterizerState(GfxHandle state) {
+  Add(GfxCommandType::rasterizerState).args[0] = state;
+}
+
+void GfxCommandBuffer::SetDepthStencilState(GfxHandle state) {
+  Add(GfxCommandType::depthStencilState).args[0] = state;
+}
+
+void GfxCommandBuffer::SetRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) {
+  uint32_t offset = AddPayload(targets, count * sizeof(GfxHandle));
+  GfxCommand& command = Add(GfxCommandType::renderTargets);
+  command.payload = offset;
+  command.args[0] = count;
+  command.args[1] = depth;
+}
+
+void GfxCommandBuffer::SetViewport(const GfxViewport& viewport) {
+  uint32_t offset = AddPayload(&viewport, sizeof(viewport));
+  Add(GfxCommandType::viewport).payload = offset;
+}
+
+void GfxCommandBuffer::ClearRenderTarget(GfxHandle target, const float rgba[4]) {
+  uint32_t offset = AddPayload(rgba, 4 * sizeof(float));
+  GfxCommand& command = Add(GfxCommandType::clearRenderTarget);
+  command.payload = offset;
+  command.args[0] = target;
+}
+
+void GfxCommandBuffer::ClearDepth(GfxHandle depth, float value) {
+  GfxCommand& command = Add(GfxCommandType::clearDepth);
+  command.args[0] = depth;
+  memcpy(&command.args[1], &value, sizeof(value));
+}
+
+void GfxCommandBuffer::UpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) {
+  uint32_t offset = AddPayload(data, size);
+  GfxCommand& command = Add(GfxCommandType::updateBuffer);
+  command.payload = offset;
+  command.args[0] = buffer;
+  command.args[1] = size;
+  stats.bufferUpdates++;
+  stats.bytesUploaded += size;
+}
+
+void GfxCommandBuffer::Draw(uint32_t vertexCount, uint32_t firstVertex) {
+  GfxCommand& command = Add(GfxCommandType::draw);
+  command.args[0] = vertexCount;
+  command.args[1] = firstVertex;
+  stats.draws++;
+}
+
+void GfxCommandBuffer::DrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) {
+  GfxCommand& command = Add(GfxCommandType::drawIndexed);
+  command.args[0] = indexCount;
+  command.args[1] = firstIndex;
+  command.args[2] = (uint32_t)baseVertex;
+  stats.draws++;
+}
+
+void GfxCommandBuffer::Dispatch(uint32_t x, uint32_t y, uint32_t z) {
+  GfxCommand& command = Add(GfxCommandType::dispatch);
+  command.args[0] = x;
+  command.args[1] = y;
+  command.args[2] = z;
+  stats.dispatches++;
+}
+
+void GfxCommandBuffer::BeginEvent(const char* name) {
+  uint32_t offset = AddPayload(name, (uint32_t)strlen(name) + 1);
+  Add(GfxCommandType::beginEvent).payload = offset;
+}
+
+void GfxCommandBuffer::EndEvent() {
+  Add(GfxCommandType::endEvent);
+}
+
+void GfxCommandBuffer::InvalidateState() {
+  Add(GfxCommandType::invalidateState);
+}
+
+void GfxCommandList::Clear() {
+  commands.clear();
+  payload.clear();
+  packets.clear();
+  buffers = 0;
+}
+
+void GfxCommandList::Merge(const GfxCommandBuffer* const* sources, size_t count, bool sort) {
+  Clear();
+  buffers = (uint32_t)count;
+
+  refs.clear();
+  size_t totalCommands = 0, totalPayload = 0;
+  for (size_t b = 0; b < count; b++) {
+    const GfxCommandBuffer& buffer = *sources[b];
+    for (size_t p = 0; p < buffer.packets.size(); p++)
+      refs.push_back({ buffer.packets[p].sortKey, (uint32_t)b, (uint32_t)p });
+    totalCommands += buffer.commands.size();
+    totalPayload += buffer.payload.size() + 3;
+  }
+
+  if (sort)
+    SortRefs();
+
+  // Payloads are appended whole, commands are copied in packet order with rebased offsets
+  std::vector<uint32_t> bases(count);
+  payload.reserve(totalPayload);
+  for (size_t b = 0; b < count; b++) {
+    bases[b] = (uint32_t)(payload.size() + 3) / 4 * 4;
+    payload.resize(bases[b]);
+    payload.insert(payload.end(), sources[b]->payload.begin(), sources[b]->payload.end());
+  }
+
+  commands.reserve(totalCommands);
+  packets.reserve(refs.size());
+  for (const PacketRef& ref : refs) {
+    const GfxCommandBuffer& buffer = *sources[ref.buffer];
+    const GfxCommandPacket& source = buffer.packets[ref.packet];
+    size_t first = commands.size();
+    packets.push_back({ source.sortKey, (uint32_t)first, source.commandCount });
+    commands.insert(commands.end(), buffer.commands.begin() + source.firstCommand,
+      buffer.commands.begin() + source.firstCommand + source.commandCount);
+    for (size_t c = first; c < commands.size(); c++)
+      if (commands[c].payload != GfxCommand::noPayload)
+        commands[c].payload += bases[ref.buffer];
+  }
+}
+
+void GfxCommandList::SortRefs() {
+  // Stable LSD radix sort by bytes of the key, refs are in buffer and recording order before it.
+  // Bytes equal in all keys (unused layers, depth of material only keys) are skipped.
+  uint64_t differs = 0;
+  for (const PacketRef& ref : refs)
+    differs |= ref.sortKey ^ refs[0].sortKey;
+
+  sortScratch.resize(refs.size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    if (((differs >> shift) & 0xFF) == 0)
+      continue;
+
+    size_t offsets[256] = {};
+    for (const PacketRef& ref : refs)
+      offsets[(ref.sortKey >> shift) & 0xFF]++;
+    size_t sum = 0;
+    for (size_t& offset : offsets) {
+      size_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (const PacketRef& ref : refs)
+      sortScratch[offsets[(ref.sortKey >> shift) & 0xFF]++] = ref;
+    refs.swap(sortScratch);
+  }
+}
+
+void GfxCommandList::Replay(IGfxContext& context) const {
+  Replay(context, 0, (uint32_t)packets.size());
+}
+
+void GfxCommandList::Replay(IGfxContext& context, uint32_t firstPacket, uint32_t packetCount) const {
+  uint32_t end = std::min(firstPacket + packetCount, (uint32_t)packets.size());
+  for (uint32_t p = firstPacket; p < end; p++) {
+    const GfxCommandPacket& packet = packets[p];
+    for (uint32_t c = 0; c < packet.commandCount; c++)
+      Execute(context, commands[packet.firstCommand + c]);
+  }
+}
+
+void GfxCommandList::Execute(IGfxContext& context, const GfxCommand& command) const {
+  const GfxShaderStage stage = (GfxShaderStage)command.stage;
+  const uint32_t* args = command.args;
+  const uint8_t* data = command.payload != GfxCommand::noPayload ? payload.data() + command.payload : nullptr;
+
+  switch (command.type) {
+  case GfxCommandType::vertexBuffer: context.SetVertexBuffer(command.slot, args[0], args[1], args[2]); break;
+  case GfxCommandType::indexBuffer: context.SetIndexBuffer(args[0], (GfxFormat)args[1], args[2]); break;
+  case GfxCommandType::inputLayout: context.SetInputLayout(args[0]); break;
+  case GfxCommandType::topology: context.SetTopology((GfxTopology)args[0]); break;
+  case GfxCommandType::shader: context.SetShader(stage, args[0]); break;
+  case GfxCommandType::constantBuffer: context.SetConstantBuffer(stage, command.slot, args[0]); break;
+  case GfxCommandType::shaderResource: context.SetShaderResource(stage, command.slot, args[0]); break;
+  case GfxCommandType::sampler: context.SetSampler(stage, command.slot, args[0]); break;
+  case GfxCommandType::rasterizerState: context.SetRasterizerState(args[0]); break;
+  case GfxCommandType::depthStencilState: context.SetDepthStencilState(args[0]); break;
+  case GfxCommandType::renderTargets: context.SetRenderTargets(args[0], reinterpret_cast<const GfxHandle*>(data), args[1]); break;
+  case GfxCommandType::viewport: context.SetViewport(*reinterpret_cast<const GfxViewport*>(data)); break;
+  case GfxCommandType::clearRenderTarget: context.ClearRenderTarget(args[0], reinterpret_cast<const float*>(data)); break;
+  case GfxCommandType::clearDepth: {
+    float value;
+    memcpy(&value, &args[1], sizeof(value));
+    context.ClearDepth(args[0], value);
+    break;
+  }
+  case GfxCommandType::updateBuffer: context.UpdateBuffer(args[0], data, args[1]); break;
+  case GfxCommandType::draw: context.Draw(args[0], args[1]); break;
+  case GfxCommandType::drawIndexed: context.DrawIndexed(args[0], args[1], (int32_t)args[2]); break;
+  case GfxCommandType::dispatch: context.Dispatch(args[0], args[1], args[2]); break;
+  case GfxCommandType::beginEvent: context.BeginEvent(reinterpret_cast<const char*>(data)); break;
+  case GfxCommandType::endEvent: context.EndEvent(); break;
+  case GfxCommandType::invalidateState: context.InvalidateState(); break;
+  default: break;
+  }
+}
+
+GfxCommandListStats GfxCommandList::GetStats() const {
+  GfxCommandListStats stats;
+  stats.buffers = buffers;
+  stats.packets = (uint32_t)packets.size();
+  stats.commands = (uint32_t)commands.size();
+  stats.payloadBytes = (uint32_t)payload.size();
+  return stats;
+}
+
+bool GfxCommandList::Write(std::ostream& out) const {
+  uint32_t header[5] = { streamMagic, streamVersion, (uint32_t)packets.size(), (uint32_t)commands.size(), (uint32_t)payload.size() };
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  WriteArray(out, packets);
+  WriteArray(out, commands);
+  WriteArray(out, payload);
+  return (bool)out;
+}
+
+bool GfxCommandList::Read(std::istream& in) {
+  Clear();
+  uint32_t header[5] = {};
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!in || header[0] != streamMagic || header[1] != streamVersion)
+    return false;
+
+  if (!ReadArray(in, packets, header[2]) || !ReadArray(in, commands, header[3]) || !ReadArray(in, payload, header[4])) {
+    Clear();
+    return false;
+  }
+
+  // Replay trusts ranges, so they are checked once here
+  bool valid = true;
+  for (const GfxCommandPacket& packet : packets)
+    valid = valid && (uint64_t)packet.firstCommand + packet.commandCount <= commands.size();
+  for (const GfxCommand& command : commands) {
+    valid = valid && command.type < GfxCommandType::count && command.stage < (uint8_t)GfxShaderStage::count;
+    if (command.type == GfxCommandType::topology)
+      valid = valid && command.args[0] <= (uint32_t)GfxTopology::pointList;
+    if (command.type == GfxCommandType::renderTargets)
+      valid = valid && command.args[0] <= IGfxContext::maxRenderTargets;
+    uint64_t size = PayloadSize(command);
+    if (size == 0)
+      continue;
+    valid = valid && command.payload != GfxCommand::noPayload && (uint64_t)command.payload + size <= payload.size();
+    if (valid && command.type == GfxCommandType::beginEvent)
+      valid = memchr(payload.data() + command.payload, 0, payload.size() - command.payload) != nullptr;
+  }
+  if (!valid)
+    Clear();
+  buffers = valid ? 1 : 0;
+  return valid;
+}
+
+const char* GfxCommandList::GetCommandName(GfxCommandType type) {
+  static const char* names[] = {
+    "vertexBuffer", "indexBuffer", "inputLayout", "topology", "shader", "constantBuffer", "shaderResource",
+    "sampler", "rasterizerState", "depthStencilState", "renderTargets", "viewport", "clearRenderTarget",
+    "clearDepth", "updateBuffer", "draw", "drawIndexed", "dispatch", "beginEvent", "endEvent", "invalidateState",
+  };
+  return type < GfxCommandType::count ? names[(int)type] : "unknown";
+}
+
+void GfxCommandList::Dump(std::ostream& out) const {
+  static const char* stages[] = { "vs", "ps", "cs" };
+  char line[160];
+  for (size_t p = 0; p < packets.size(); p++) {
+    const GfxCommandPacket& packet = packets[p];
+    snprintf(line, sizeof(line), "packet %zu key %016llx layer %u depth %06llx material %09llx\n", p, (unsigned long long)packet.sortKey,
+      (unsigned)(packet.sortKey >> 60), (unsigned long long)((packet.sortKey >> 36) & 0xFFFFFF),
+      (unsigned long long)(packet.sortKey & GfxSortKey::materialMask));
+    out << line;
+
+    for (uint32_t c = 0; c < packet.commandCount; c++) {
+      const GfxCommand& command = commands[packet.firstCommand + c];
+      snprintf(line, sizeof(line), "  %-18s %s slot %2u args %u %u %u", GetCommandName(command.type),
+        command.stage < 3 ? stages[command.stage] : "??", command.slot, command.args[0], command.args[1], command.args[2]);
+      out << line;
+      if (command.type == GfxCommandType::beginEvent)
+        out << " \"" << reinterpret_cast<const char*>(payload.data() + command.payload) << "\"";
+      else if (command.payload != GfxCommand::noPayload)
+        out << " payload " << PayloadSize(command) << " bytes";
+      out << "\n";
+    }
+  }
+}
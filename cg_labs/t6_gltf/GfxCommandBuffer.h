@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "GfxDevice.h"
+
+enum class GfxCommandType : uint8_t
+{
+  vertexBuffer,
+  indexBuffer,
+  inputLayout,
+  topology,
+  shader,
+  constantBuffer,
+  shaderResource,
+  sampler,
+  rasterizerState,
+  depthStencilState,
+  renderTargets,
+  viewport,
+  clearRenderTarget,
+  clearDepth,
+  updateBuffer,
+  draw,
+  drawIndexed,
+  dispatch,
+  beginEvent,
+  endEvent,
+  invalidateState,
+  count,
+};
+
+// One recorded context call. Arrays, strings and buffer data live in the payload of the buffer.
+struct GfxCommand {
+  GfxCommandType type;
+  uint8_t stage;
+  uint16_t slot;
+  uint32_t payload; // byte offset in payload, noPayload if none
+  uint32_t args[3];
+
+  static const uint32_t noPayload = ~0u;
+};
+
+// Commands of one draw (or other unit) that are moved together when sorted
+struct GfxCommandPacket {
+  uint64_t sortKey;
+  uint32_t firstCommand;
+  uint32_t commandCount;
+};
+
+// 64-bit packet keys: layer in bits 60-63, depth in 36-59, material in 0-35.
+// Opaque goes front to back and then by material, transparent goes back to front.
+namespace GfxSortKey {
+  const uint64_t materialMask = (1ull << 36) - 1;
+
+  // Top 24 bits of a non-negative float keep its order
+  inline uint64_t DepthBits(float depth) {
+    union { float f; uint32_t u; } bits;
+    bits.f = depth > 0.0f ? depth : 0.0f;
+    return bits.u >> 7;
+  }
+
+  inline uint64_t Make(uint32_t layer, uint64_t depth, uint64_t material) {
+    return ((uint64_t)(layer & 0xF) << 60) | ((depth & 0xFFFFFF) << 36) | (material & materialMask);
+  }
+
+  inline uint64_t Opaque(float viewDepth, uint64_t material, uint32_t layer = 0) {
+    return Make(layer, DepthBits(viewDepth), material);
+  }
+
+  inline uint64_t Transparent(float viewDepth, uint64_t material, uint32_t layer = 8) {
+    return Make(layer, 0xFFFFFF - DepthBits(viewDepth), material);
+  }
+}
+
+// IGfxContext that records calls instead of running them, so drawing code records unchanged.
+// Every BeginPacket starts a packet that must set all state its draw needs: packets are reordered,
+// and the redundancy filter of the replay context drops repeated bindings.
+// One buffer per recording thread, GfxCommandList merges them.
+class GfxCommandBuffer : public IGfxContext {
+public:
+  void BeginPacket(uint64_t sortKey);
+  void Clear();
+
+  uint32_t GetPacketCount() const { return (uint32_t)packets.size(); }
+  uint32_t GetCommandCount() const { return (uint32_t)commands.size(); }
+
+  void SetVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset = 0) override;
+  void SetIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset = 0) override;
+  void SetInputLayout(GfxHandle layout) override;
+  void SetTopology(GfxTopology topology) override;
+  void SetShader(GfxShaderStage stage, GfxHandle shader) override;
+  void SetConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) override;
+  void SetShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) override;
+  void SetSampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) override;
+  void SetRasterizerState(GfxHandle state) override;
+  void SetDepthStencilState(GfxHandle state) override;
+  void SetRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) override;
+  void SetViewport(const GfxViewport& viewport) override;
+
+  void ClearRenderTarget(GfxHandle target, const float rgba[4]) override;
+  void ClearDepth(GfxHandle depth, float value) override;
+  // Data is copied into the payload
+  void UpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) override;
+
+  void Draw(uint32_t vertexCount, uint32_t firstVertex = 0) override;
+  void DrawIndexed(uint32_t indexCount, uint32_t firstIndex = 0, int32_t baseVertex = 0) override;
+  void Dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+
+  void BeginEvent(const char* name) override;
+  void EndEvent() override;
+
+  // Recorded too: replay context forgets its cached state at this point
+  void InvalidateState() override;
+
+  // Counts recorded calls (stateChanges stays zero, filtering happens on replay)
+  const GfxContextStats& GetStats() const override { return stats; }
+  void ResetStats() override { stats = GfxContextStats(); }
+
+private:
+  friend class GfxCommandList;
+
+  GfxCommand& Add(GfxCommandType type, GfxShaderStage stage = GfxShaderStage::vertex, uint32_t slot = 0);
+  uint32_t AddPayload(const void* data, uint32_t size);
+
+  std::vector<GfxCommand> commands;
+  std::vector<uint8_t> payload;
+  std::vector<GfxCommandPacket> packets;
+  GfxContextStats stats;
+};
+
+struct GfxCommandListStats {
+  uint32_t buffers = 0;
+  uint32_t packets = 0;
+  uint32_t commands = 0;
+  uint32_t payloadBytes = 0;
+};
+
+// Packets of several buffers merged into one stream in key order, ready to replay or save
+class GfxCommandList {
+public:
+  // Equal keys keep buffer order and recording order, sort == false only concatenates
+  void Merge(const GfxCommandBuffer* const* buffers, size_t count, bool sort = true);
+  void Clear();
+
+  // Runs packets in order on the context
+  void Replay(IGfxContext& context) const;
+  // Runs packets [first, first + count)
+  void Replay(IGfxContext& context, uint32_t firstPacket, uint32_t packetCount) const;
+
+  // Binary stream for offline analysis, Read returns false on a wrong or truncated stream
+  bool Write(std::ostream& out) const;
+  bool Read(std::istream& in);
+  // Readable listing: one line per packet and per command
+  void Dump(std::ostream& out) const;
+
+  const std::vector<GfxCommandPacket>& GetPackets() const { return packets; }
+  GfxCommandListStats GetStats() const;
+
+  static const char* GetCommandName(GfxCommandType type);
+
+private:
+  struct PacketRef {
+    uint64_t sortKey;
+    uint32_t buffer;
+    uint32_t packet;
+  };
+
+  void SortRefs();
+  void Execute(IGfxContext& context, const GfxCommand& command) const;
+
+  std::vector<GfxCommand> commands;
+  std::vector<uint8_t> payload;
+  std::vector<GfxCommandPacket> packets;
+  std::vector<PacketRef> refs, sortScratch;
+  uint32_t buffers = 0;
+};
@@ -0,0 +1,552 @@
+#include "GfxD3D11.h"
+#include "common.h"
+
+#include <cstring>
+#include <string>
+
+DXGI_FORMAT GfxD3D11Device::ToDXGI(GfxFormat format) {
+  switch (format) {
+  case GfxFormat::rgba8Unorm: return DXGI_FORMAT_R8G8B8A8_UNORM;
+  case GfxFormat::rgba16Float: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+  case GfxFormat::rgba32Float: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+  case GfxFormat::r11g11b10Float: return DXGI_FORMAT_R11G11B10_FLOAT;
+  case GfxFormat::r32Float: return DXGI_FORMAT_R32_FLOAT;
+  case GfxFormat::rg32Float: return DXGI_FORMAT_R32G32_FLOAT;
+  case GfxFormat::rgb32Float: return DXGI_FORMAT_R32G32B32_FLOAT;
+  case GfxFormat::r16Uint: return DXGI_FORMAT_R16_UINT;
+  case GfxFormat::r32Uint: return DXGI_FORMAT_R32_UINT;
+  case GfxFormat::d32Float: return DXGI_FORMAT_D32_FLOAT;
+  default: return DXGI_FORMAT_UNKNOWN;
+  }
+}
+
+static D3D11_TEXTURE_ADDRESS_MODE ToD3D11(GfxAddress address) {
+  switch (address) {
+  case GfxAddress::clamp: return D3D11_TEXTURE_ADDRESS_CLAMP;
+  case GfxAddress::mirror: return D3D11_TEXTURE_ADDRESS_MIRROR;
+  default: return D3D11_TEXTURE_ADDRESS_WRAP;
+  }
+}
+
+static D3D11_COMPARISON_FUNC ToD3D11(GfxComparison comparison) {
+  switch (comparison) {
+  case GfxComparison::never: return D3D11_COMPARISON_NEVER;
+  case GfxComparison::less: return D3D11_COMPARISON_LESS;
+  case GfxComparison::lessEqual: return D3D11_COMPARISON_LESS_EQUAL;
+  case GfxComparison::equal: return D3D11_COMPARISON_EQUAL;
+  case GfxComparison::greater: return D3D11_COMPARISON_GREATER;
+  default: return D3D11_COMPARISON_ALWAYS;
+  }
+}
+
+static D3D11_USAGE ToD3D11(GfxUsage usage) {
+  switch (usage) {
+  case GfxUsage::immutable: return D3D11_USAGE_IMMUTABLE;
+  case GfxUsage::dynamic: return D3D11_USAGE_DYNAMIC;
+  default: return D3D11_USAGE_DEFAULT;
+  }
+}
+
+static UINT ToD3D11Bind(uint32_t bind) {
+  UINT flags = 0;
+  if (bind & gfxBindVertexBuffer) flags |= D3D11_BIND_VERTEX_BUFFER;
+  if (bind & gfxBindIndexBuffer) flags |= D3D11_BIND_INDEX_BUFFER;
+  if (bind & gfxBindConstantBuffer) flags |= D3D11_BIND_CONSTANT_BUFFER;
+  if (bind & gfxBindShaderResource) flags |= D3D11_BIND_SHADER_RESOURCE;
+  if (bind & gfxBindRenderTarget) flags |= D3D11_BIND_RENDER_TARGET;
+  if (bind & gfxBindDepthStencil) flags |= D3D11_BIND_DEPTH_STENCIL;
+  if (bind & gfxBindUnorderedAccess) flags |= D3D11_BIND_UNORDERED_ACCESS;
+  return flags;
+}
+
+void GfxD3D11Device::Init(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext) {
+  device = d3dDevice;
+  immediateContext = d3dContext;
+  context.Init(d3dContext);
+  context.InvalidateState();
+
+  D3D11_FEATURE_DATA_THREADING threading = {};
+  driverCommandLists = d3dDevice &&
+    SUCCEEDED(d3dDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))) && threading.DriverCommandLists;
+}
+
+void GfxD3D11Device::Release() {
+  ReleaseDeferred();
+  for (size_t i = 0; i < objects.size(); i++)
+    Release((GfxHandle)(i + 1));
+  objects.clear();
+  freeHandles.clear();
+}
+
+void GfxD3D11Device::ReleaseDeferred() {
+  for (Deferred& entry : deferred) {
+    if (entry.commandList) entry.commandList->Release();
+    if (entry.annotation) entry.annotation->Release();
+    if (entry.d3dContext) entry.d3dContext->Release();
+    entry = Deferred();
+  }
+}
+
+IGfxContext* GfxD3D11Device::BeginDeferred(uint32_t index) {
+  if (index >= GetDeferredContextCount() || !device || !immediateContext)
+    return nullptr;
+
+  Deferred& entry = deferred[index];
+  if (!entry.d3dContext) {
+    if (FAILED(device->CreateDeferredContext(0, &entry.d3dContext)))
+      return nullptr;
+    entry.d3dContext->QueryInterface(__uuidof(ID3DUserDefinedAnnotation), reinterpret_cast<void**>(&entry.annotation));
+    entry.context.reset(new GfxD3D11Context(*this));
+    entry.context->Init(entry.d3dContext);
+    entry.context->SetDeferred(entry.annotation);
+  }
+  if (entry.commandList) {
+    entry.commandList->Release();
+    entry.commandList = nullptr;
+  }
+
+  // Command lists do not inherit state, output state of the main context is copied
+  ID3D11RenderTargetView* targets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+  ID3D11DepthStencilView* depth = nullptr;
+  immediateContext->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, targets, &depth);
+  entry.d3dContext->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, targets, depth);
+  for (ID3D11RenderTargetView* target : targets)
+    if (target) target->Release();
+  if (depth) depth->Release();
+
+  D3D11_VIEWPORT viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+  UINT viewportCount = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+  immediateContext->RSGetViewports(&viewportCount, viewports);
+  entry.d3dContext->RSSetViewports(viewportCount, viewports);
+
+  ID3D11DepthStencilState* depthState = nullptr;
+  UINT stencilRef = 0;
+  immediateContext->OMGetDepthStencilState(&depthState, &stencilRef);
+  entry.d3dContext->OMSetDepthStencilState(depthState, stencilRef);
+  if (depthState) depthState->Release();
+
+  ID3D11BlendState* blendState = nullptr;
+  FLOAT blendFactor[4];
+  UINT sampleMask = 0;
+  immediateContext->OMGetBlendState(&blendState, blendFactor, &sampleMask);
+  entry.d3dContext->OMSetBlendState(blendState, blendFactor, sampleMask);
+  if (blendState) blendState->Release();
+
+  entry.context->InvalidateState();
+  entry.context->ResetStats();
+  return entry.context.get();
+}
+
+bool GfxD3D11Device::FinishDeferred(uint32_t index) {
+  if (index >= maxDeferredContexts || !deferred[index].d3dContext)
+    return false;
+  return SUCCEEDED(deferred[index].d3dContext->FinishCommandList(FALSE, &deferred[index].commandList));
+}
+
+void GfxD3D11Device::ExecuteDeferred(uint32_t index) {
+  if (index >= maxDeferredContexts || !deferred[index].commandList)
+    return;
+
+  Deferred& entry = deferred[index];
+  immediateContext->ExecuteCommandList(entry.commandList, TRUE);
+  entry.commandList->Release();
+  entry.commandList = nullptr;
+  context.AddStats(entry.context->GetStats());
+}
+
+GfxHandle GfxD3D11Device::Add(const Object& object) {
+  if (!freeHandles.empty()) {
+    GfxHandle handle = freeHandles.back();
+    freeHandles.pop_back();
+    objects[handle - 1] = object;
+    return handle;
+  }
+
+  objects.push_back(object);
+  return (GfxHandle)objects.size();
+}
+
+const GfxD3D11Device::Object* GfxD3D11Device::Get(GfxHandle handle) const {
+  if (handle == gfxNullHandle || handle > objects.size())
+    return nullptr;
+  const Object& object = objects[handle - 1];
+  return object.object || object.srv ? &object : nullptr;
+}
+
+void GfxD3D11Device::Release(GfxHandle handle) {
+  if (handle == gfxNullHandle || handle > objects.size())
+    return;
+
+  Object& object = objects[handle - 1];
+  if (!object.object && !object.srv)
+    return;
+
+  if (object.srv) object.srv->Release();
+  if (object.rtv) object.rtv->Release();
+  if (object.dsv) object.dsv->Release();
+  if (object.object) object.object->Release();
+  object = Object();
+  freeHandles.push_back(handle);
+}
+
+GfxHandle GfxD3D11Device::CreateBuffer(const GfxBufferDesc& desc, const void* initialData) {
+  D3D11_BUFFER_DESC bufferDesc = {};
+  bufferDesc.ByteWidth = desc.size;
+  bufferDesc.Usage = ToD3D11(desc.usage);
+  bufferDesc.BindFlags = ToD3D11Bind(desc.bind);
+  bufferDesc.CPUAccessFlags = desc.usage == GfxUsage::dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+  bufferDesc.MiscFlags = desc.stride > 0 ? D3D11_RESOURCE_MISC_BUFFER_STRUCTURED : 0;
+  bufferDesc.StructureByteStride = desc.stride;
+
+  D3D11_SUBRESOURCE_DATA data = {};
+  data.pSysMem = initialData;
+  data.SysMemPitch = desc.size;
+
+  ID3D11Buffer* buffer = nullptr;
+  HRESULT hr = device->CreateBuffer(&bufferDesc, initialData ? &data : nullptr, &buffer);
+  if (FAILED(hr))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = buffer;
+  object.dynamic = desc.usage == GfxUsage::dynamic;
+  if (desc.bind & gfxBindShaderResource) {
+    hr = device->CreateShaderResourceView(buffer, nullptr, &object.srv);
+    if (FAILED(hr)) {
+      buffer->Release();
+      return gfxNullHandle;
+    }
+  }
+  return Add(object);
+}
+
+HRESULT GfxD3D11Device::CreateViews(ID3D11Resource* resource, const GfxTextureDesc& desc, Object& object) {
+  HRESULT hr = S_OK;
+  if (desc.bind & gfxBindShaderResource) {
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = ToDXGI(desc.format);
+    if (desc.cube) {
+      srvDesc.ViewDimension = desc.arraySize > 6 ? D3D11_SRV_DIMENSION_TEXTURECUBEARRAY : D3D11_SRV_DIMENSION_TEXTURECUBE;
+      srvDesc.TextureCubeArray.MipLevels = desc.mipLevels;
+      srvDesc.TextureCubeArray.NumCubes = desc.arraySize / 6;
+    }
+    else if (desc.arraySize > 1) {
+      srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+      srvDesc.Texture2DArray.MipLevels = desc.mipLevels;
+      srvDesc.Texture2DArray.ArraySize = desc.arraySize;
+    }
+    else {
+      srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+      srvDesc.Texture2D.MipLevels = desc.mipLevels;
+    }
+    hr = device->CreateShaderResourceView(resource, &srvDesc, &object.srv);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  // Target views cover the first mip of the first slice
+  if (desc.bind & gfxBindRenderTarget) {
+    hr = device->CreateRenderTargetView(resource, nullptr, &object.rtv);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  if (desc.bind & gfxBindDepthStencil) {
+    hr = device->CreateDepthStencilView(resource, nullptr, &object.dsv);
+    if (FAILED(hr))
+      return hr;
+  }
+  return S_OK;
+}
+
+GfxHandle GfxD3D11Device::CreateTexture(const GfxTextureDesc& desc, const GfxSubresourceData* initialData) {
+  D3D11_TEXTURE2D_DESC textureDesc = {};
+  textureDesc.Width = desc.width;
+  textureDesc.Height = desc.height;
+  textureDesc.MipLevels = desc.mipLevels;
+  textureDesc.ArraySize = desc.arraySize;
+  textureDesc.Format = ToDXGI(desc.format);
+  textureDesc.SampleDesc.Count = 1;
+  textureDesc.Usage = ToD3D11(desc.usage);
+  textureDesc.BindFlags = ToD3D11Bind(desc.bind);
+  textureDesc.CPUAccessFlags = desc.usage == GfxUsage::dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
+  textureDesc.MiscFlags = desc.cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+  std::vector<D3D11_SUBRESOURCE_DATA> data;
+  if (initialData) {
+    data.resize(desc.mipLevels * desc.arraySize);
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i].pSysMem = initialData[i].data;
+      data[i].SysMemPitch = initialData[i].rowPitch;
+    }
+  }
+
+  ID3D11Texture2D* texture = nullptr;
+  HRESULT hr = device->CreateTexture2D(&textureDesc, initialData ? data.data() : nullptr, &texture);
+  if (FAILED(hr))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = texture;
+  object.dynamic = desc.usage == GfxUsage::dynamic;
+  hr = CreateViews(texture, desc, object);
+  if (FAILED(hr)) {
+    GfxHandle handle = Add(object);
+    Release(handle);
+    return gfxNullHandle;
+  }
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::CreateSampler(const GfxSamplerDesc& desc) {
+  D3D11_SAMPLER_DESC samplerDesc = {};
+  samplerDesc.Filter = desc.filter == GfxFilter::point ? D3D11_FILTER_MIN_MAG_MIP_POINT :
+    desc.filter == GfxFilter::anisotropic ? D3D11_FILTER_ANISOTROPIC : D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+  samplerDesc.AddressU = ToD3D11(desc.addressU);
+  samplerDesc.AddressV = ToD3D11(desc.addressV);
+  samplerDesc.AddressW = ToD3D11(desc.addressW);
+  samplerDesc.MaxAnisotropy = desc.filter == GfxFilter::anisotropic ? 16 : 1;
+  samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+  samplerDesc.MinLOD = desc.minLod;
+  samplerDesc.MaxLOD = desc.maxLod;
+
+  ID3D11SamplerState* sampler = nullptr;
+  if (FAILED(device->CreateSamplerState(&samplerDesc, &sampler)))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = sampler;
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::CreateRasterizerState(const GfxRasterizerDesc& desc) {
+  D3D11_RASTERIZER_DESC rasterizerDesc = {};
+  rasterizerDesc.FillMode = desc.wireframe ? D3D11_FILL_WIREFRAME : D3D11_FILL_SOLID;
+  rasterizerDesc.CullMode = desc.cull == GfxCull::none ? D3D11_CULL_NONE : desc.cull == GfxCull::front ? D3D11_CULL_FRONT : D3D11_CULL_BACK;
+  rasterizerDesc.FrontCounterClockwise = desc.frontCounterClockwise;
+  rasterizerDesc.DepthClipEnable = desc.depthClip;
+
+  ID3D11RasterizerState* state = nullptr;
+  if (FAILED(device->CreateRasterizerState(&rasterizerDesc, &state)))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = state;
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::CreateDepthStencilState(const GfxDepthStencilDesc& desc) {
+  D3D11_DEPTH_STENCIL_DESC depthDesc = {};
+  depthDesc.DepthEnable = desc.depthEnable;
+  depthDesc.DepthWriteMask = desc.depthWrite ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+  depthDesc.DepthFunc = ToD3D11(desc.depthFunc);
+
+  ID3D11DepthStencilState* state = nullptr;
+  if (FAILED(device->CreateDepthStencilState(&depthDesc, &state)))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = state;
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::CreateShader(GfxShaderStage stage, const void* bytecode, size_t size) {
+  Object object;
+  object.stage = stage;
+
+  HRESULT hr = E_INVALIDARG;
+  if (stage == GfxShaderStage::vertex) {
+    ID3D11VertexShader* shader = nullptr;
+    hr = device->CreateVertexShader(bytecode, size, nullptr, &shader);
+    object.object = shader;
+  }
+  else if (stage == GfxShaderStage::pixel) {
+    ID3D11PixelShader* shader = nullptr;
+    hr = device->CreatePixelShader(bytecode, size, nullptr, &shader);
+    object.object = shader;
+  }
+  else if (stage == GfxShaderStage::compute) {
+    ID3D11ComputeShader* shader = nullptr;
+    hr = device->CreateComputeShader(bytecode, size, nullptr, &shader);
+    object.object = shader;
+  }
+  if (FAILED(hr))
+    return gfxNullHandle;
+
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::CreateInputLayout(const GfxInputElement* elements, uint32_t count, const void* vsBytecode, size_t size) {
+  std::vector<D3D11_INPUT_ELEMENT_DESC> inputDesc(count);
+  for (uint32_t i = 0; i < count; i++)
+    inputDesc[i] = { elements[i].semantic, elements[i].semanticIndex, ToDXGI(elements[i].format), 0, elements[i].offset, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+
+  ID3D11InputLayout* layout = nullptr;
+  if (FAILED(device->CreateInputLayout(inputDesc.data(), count, vsBytecode, size, &layout)))
+    return gfxNullHandle;
+
+  Object object;
+  object.object = layout;
+  return Add(object);
+}
+
+GfxHandle GfxD3D11Device::ImportShaderResource(void* nativeView) {
+  if (!nativeView)
+    return gfxNullHandle;
+
+  Object object;
+  object.srv = static_cast<ID3D11ShaderResourceView*>(nativeView);
+  object.srv->AddRef();
+  return Add(object);
+}
+
+void GfxD3D11Context::ApplyVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset) {
+  ID3D11Buffer* vertexBuffer = device.GetAs<ID3D11Buffer>(buffer);
+  UINT strides[] = { stride };
+  UINT offsets[] = { offset };
+  context->IASetVertexBuffers(slot, 1, &vertexBuffer, strides, offsets);
+}
+
+void GfxD3D11Context::ApplyIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) {
+  context->IASetIndexBuffer(device.GetAs<ID3D11Buffer>(buffer), GfxD3D11Device::ToDXGI(format), offset);
+}
+
+void GfxD3D11Context::ApplyInputLayout(GfxHandle layout) {
+  context->IASetInputLayout(device.GetAs<ID3D11InputLayout>(layout));
+}
+
+void GfxD3D11Context::ApplyTopology(GfxTopology topology) {
+  static const D3D11_PRIMITIVE_TOPOLOGY topologies[] = {
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
+    D3D11_PRIMITIVE_TOPOLOGY_LINELIST,
+    D3D11_PRIMITIVE_TOPOLOGY_POINTLIST,
+  };
+  context->IASetPrimitiveTopology(topologies[(int)topology]);
+}
+
+void GfxD3D11Context::ApplyShader(GfxShaderStage stage, GfxHandle shader) {
+  if (stage == GfxShaderStage::vertex)
+    context->VSSetShader(device.GetAs<ID3D11VertexShader>(shader), nullptr, 0);
+  else if (stage == GfxShaderStage::pixel)
+    context->PSSetShader(device.GetAs<ID3D11PixelShader>(shader), nullptr, 0);
+  else
+    context->CSSetShader(device.GetAs<ID3D11ComputeShader>(shader), nullptr, 0);
+}
+
+void GfxD3D11Context::ApplyConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) {
+  ID3D11Buffer* constantBuffer = device.GetAs<ID3D11Buffer>(buffer);
+  if (stage == GfxShaderStage::vertex)
+    context->VSSetConstantBuffers(slot, 1, &constantBuffer);
+  else if (stage == GfxShaderStage::pixel)
+    context->PSSetConstantBuffers(slot, 1, &constantBuffer);
+  else
+    context->CSSetConstantBuffers(slot, 1, &constantBuffer);
+}
+
+void GfxD3D11Context::ApplyShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) {
+  const GfxD3D11Device::Object* object = device.Get(resource);
+  ID3D11ShaderResourceView* srv = object ? object->srv : nullptr;
+  if (stage == GfxShaderStage::vertex)
+    context->VSSetShaderResources(slot, 1, &srv);
+  else if (stage == GfxShaderStage::pixel)
+    context->PSSetShaderResources(slot, 1, &srv);
+  else
+    context->CSSetShaderResources(slot, 1, &srv);
+}
+
+void GfxD3D11Context::ApplySampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) {
+  ID3D11SamplerState* samplerState = device.GetAs<ID3D11SamplerState>(sampler);
+  if (stage == GfxShaderStage::vertex)
+    context->VSSetSamplers(slot, 1, &samplerState);
+  else if (stage == GfxShaderStage::pixel)
+    context->PSSetSamplers(slot, 1, &samplerState);
+  else
+    context->CSSetSamplers(slot, 1, &samplerState);
+}
+
+void GfxD3D11Context::ApplyRasterizerState(GfxHandle state) {
+  context->RSSetState(device.GetAs<ID3D11RasterizerState>(state));
+}
+
+void GfxD3D11Context::ApplyDepthStencilState(GfxHandle state) {
+  context->OMSetDepthStencilState(device.GetAs<ID3D11DepthStencilState>(state), 0);
+}
+
+void GfxD3D11Context::ApplyRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) {
+  ID3D11RenderTargetView* rtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+  count = count < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT ? count : D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+  for (uint32_t i = 0; i < count; i++) {
+    const GfxD3D11Device::Object* object = device.Get(targets[i]);
+    rtvs[i] = object ? object->rtv : nullptr;
+  }
+  const GfxD3D11Device::Object* depthObject = device.Get(depth);
+  context->OMSetRenderTargets(count, rtvs, depthObject ? depthObject->dsv : nullptr);
+}
+
+void GfxD3D11Context::ApplyViewport(const GfxViewport& viewport) {
+  D3D11_VIEWPORT vp = { viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth };
+  context->RSSetViewports(1, &vp);
+}
+
+void GfxD3D11Context::ApplyClearRenderTarget(GfxHandle target, const float rgba[4]) {
+  const GfxD3D11Device::Object* object = device.Get(target);
+  if (object && object->rtv)
+    context->ClearRenderTargetView(object->rtv, rgba);
+}
+
+void GfxD3D11Context::ApplyClearDepth(GfxHandle depth, float value) {
+  const GfxD3D11Device::Object* object = device.Get(depth);
+  if (object && object->dsv)
+    context->ClearDepthStencilView(object->dsv, D3D11_CLEAR_DEPTH, value, 0);
+}
+
+void GfxD3D11Context::ApplyUpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) {
+  const GfxD3D11Device::Object* object = device.Get(buffer);
+  if (!object || !object->object)
+    return;
+
+  ID3D11Buffer* d3dBuffer = static_cast<ID3D11Buffer*>(object->object);
+  if (!object->dynamic) {
+    context->UpdateSubresource(d3dBuffer, 0, nullptr, data, 0, 0);
+    return;
+  }
+
+  D3D11_MAPPED_SUBRESOURCE subresource;
+  if (FAILED(context->Map(d3dBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource)))
+    return;
+  memcpy(subresource.pData, data, size);
+  context->Unmap(d3dBuffer, 0);
+}
+
+void GfxD3D11Context::ApplyDraw(uint32_t vertexCount, uint32_t firstVertex) {
+  context->Draw(vertexCount, firstVertex);
+}
+
+void GfxD3D11Context::ApplyDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) {
+  context->DrawIndexed(indexCount, firstIndex, baseVertex);
+}
+
+void GfxD3D11Context::ApplyDispatch(uint32_t x, uint32_t y, uint32_t z) {
+  context->Dispatch(x, y, z);
+}
+
+void GfxD3D11Context::ApplyBeginEvent(const char* name) {
+  // Deferred context without annotation: the event is skipped
+  if (deferred && !annotation)
+    return;
+
+  // Event names are ASCII
+  std::wstring wideName(name, name + strlen(name));
+  if (annotation)
+    annotation->BeginEvent(wideName.c_str());
+  else
+    beginEvent(wideName.c_str());
+}
+
+void GfxD3D11Context::ApplyEndEvent() {
+  if (annotation)
+    annotation->EndEvent();
+  else if (!deferred)
+    endEvent();
+}
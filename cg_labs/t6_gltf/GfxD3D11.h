@@ -0,0 +1,119 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <memory>
+#include <vector>
+
+#include "GfxDevice.h"
+
+class GfxD3D11Device;
+
+class GfxD3D11Context : public GfxContextBase {
+public:
+  GfxD3D11Context(GfxD3D11Device& owner) : device(owner) {};
+
+  void Init(ID3D11DeviceContext* d3dContext) { context = d3dContext; }
+  // Deferred contexts write events to their own annotation (if any) instead of beginEvent/endEvent,
+  // which belong to the main thread
+  void SetDeferred(ID3DUserDefinedAnnotation* d3dAnnotation) { deferred = true; annotation = d3dAnnotation; }
+
+protected:
+  void ApplyVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset) override;
+  void ApplyIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) override;
+  void ApplyInputLayout(GfxHandle layout) override;
+  void ApplyTopology(GfxTopology topology) override;
+  void ApplyShader(GfxShaderStage stage, GfxHandle shader) override;
+  void ApplyConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) override;
+  void ApplyShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) override;
+  void ApplySampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) override;
+  void ApplyRasterizerState(GfxHandle state) override;
+  void ApplyDepthStencilState(GfxHandle state) override;
+  void ApplyRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) override;
+  void ApplyViewport(const GfxViewport& viewport) override;
+  void ApplyClearRenderTarget(GfxHandle target, const float rgba[4]) override;
+  void ApplyClearDepth(GfxHandle depth, float value) override;
+  void ApplyUpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) override;
+  void ApplyDraw(uint32_t vertexCount, uint32_t firstVertex) override;
+  void ApplyDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) override;
+  void ApplyDispatch(uint32_t x, uint32_t y, uint32_t z) override;
+  void ApplyBeginEvent(const char* name) override;
+  void ApplyEndEvent() override;
+
+private:
+  GfxD3D11Device& device;
+  ID3D11DeviceContext* context = nullptr;
+  ID3DUserDefinedAnnotation* annotation = nullptr;
+  bool deferred = false;
+};
+
+// IGfxDevice over existing D3D11 device and immediate context (they are not owned).
+// Handles index a table of COM objects with views created from bind flags.
+class GfxD3D11Device : public IGfxDevice {
+public:
+  GfxD3D11Device() : context(*this) {};
+  ~GfxD3D11Device() { Release(); }
+
+  void Init(ID3D11Device* d3dDevice, ID3D11DeviceContext* d3dContext);
+  // Releases every object still alive and deferred contexts
+  void Release();
+
+  GfxHandle CreateBuffer(const GfxBufferDesc& desc, const void* initialData = nullptr) override;
+  GfxHandle CreateTexture(const GfxTextureDesc& desc, const GfxSubresourceData* initialData = nullptr) override;
+  GfxHandle CreateSampler(const GfxSamplerDesc& desc) override;
+  GfxHandle CreateRasterizerState(const GfxRasterizerDesc& desc) override;
+  GfxHandle CreateDepthStencilState(const GfxDepthStencilDesc& desc) override;
+  GfxHandle CreateShader(GfxShaderStage stage, const void* bytecode, size_t size) override;
+  GfxHandle CreateInputLayout(const GfxInputElement* elements, uint32_t count, const void* vsBytecode, size_t size) override;
+  GfxHandle ImportShaderResource(void* nativeView) override;
+  void Release(GfxHandle handle) override;
+
+  IGfxContext& GetContext() override { return context; }
+
+  // ID3D11DeviceContext deferred contexts are created on first use, lists run with ExecuteCommandList.
+  // None without driver command lists: the runtime emulates them slower than the main context replays
+  uint32_t GetDeferredContextCount() const override { return driverCommandLists ? maxDeferredContexts : 0; }
+  IGfxContext* BeginDeferred(uint32_t index) override;
+  bool FinishDeferred(uint32_t index) override;
+  void ExecuteDeferred(uint32_t index) override;
+
+  static DXGI_FORMAT ToDXGI(GfxFormat format);
+
+private:
+  friend class GfxD3D11Context;
+
+  struct Object {
+    IUnknown* object = nullptr; // buffer, texture, state, shader or layout
+    ID3D11ShaderResourceView* srv = nullptr;
+    ID3D11RenderTargetView* rtv = nullptr;
+    ID3D11DepthStencilView* dsv = nullptr;
+    GfxShaderStage stage = GfxShaderStage::vertex;
+    bool dynamic = false;
+  };
+
+  GfxHandle Add(const Object& object);
+  // nullptr for null or released handle
+  const Object* Get(GfxHandle handle) const;
+  template<typename T>
+  T* GetAs(GfxHandle handle) const {
+    const Object* object = Get(handle);
+    return object ? static_cast<T*>(object->object) : nullptr;
+  }
+  HRESULT CreateViews(ID3D11Resource* resource, const GfxTextureDesc& desc, Object& object);
+
+  struct Deferred {
+    ID3D11DeviceContext* d3dContext = nullptr;
+    ID3DUserDefinedAnnotation* annotation = nullptr;
+    ID3D11CommandList* commandList = nullptr;
+    std::unique_ptr<GfxD3D11Context> context;
+  };
+  void ReleaseDeferred();
+
+  ID3D11Device* device = nullptr;
+  ID3D11DeviceContext* immediateContext = nullptr;
+  GfxD3D11Context context;
+  Deferred deferred[maxDeferredContexts];
+  bool driverCommandLists = false;
+
+  std::vector<Object> objects; // [handle - 1]
+  std::vector<GfxHandle> freeHandles;
+};
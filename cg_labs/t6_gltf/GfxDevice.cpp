@@ -0,0 +1,199 @@
+#include "GfxDevice.h"
+
+#include <algorithm>
+#include <iterator>
+
+// std::fill and Changed take it by reference, so it needs a definition before C++17
+const GfxHandle GfxContextBase::unknownHandle;
+
+uint32_t IGfxDevice::FormatSize(GfxFormat format) {
+  switch (format) {
+  case GfxFormat::rgba8Unorm: return 4;
+  case GfxFormat::rgba16Float: return 8;
+  case GfxFormat::rgba32Float: return 16;
+  case GfxFormat::r11g11b10Float: return 4;
+  case GfxFormat::r32Float: return 4;
+  case GfxFormat::rg32Float: return 8;
+  case GfxFormat::rgb32Float: return 12;
+  case GfxFormat::r16Uint: return 2;
+  case GfxFormat::r32Uint: return 4;
+  case GfxFormat::d32Float: return 4;
+  default: return 0;
+  }
+}
+
+void GfxContextBase::AddStats(const GfxContextStats& other) {
+  stats.calls += other.calls;
+  stats.stateChanges += other.stateChanges;
+  stats.redundantSkipped += other.redundantSkipped;
+  stats.draws += other.draws;
+  stats.dispatches += other.dispatches;
+  stats.bufferUpdates += other.bufferUpdates;
+  stats.bytesUploaded += other.bytesUploaded;
+}
+
+template<typename T>
+bool GfxContextBase::Changed(T& cached, const T& value) {
+  stats.calls++;
+  if (filterRedundant && cached == value) {
+    stats.redundantSkipped++;
+    return false;
+  }
+
+  cached = value;
+  stats.stateChanges++;
+  return true;
+}
+
+bool GfxContextBase::Uncached() {
+  stats.calls++;
+  stats.stateChanges++;
+  return true;
+}
+
+void GfxContextBase::InvalidateState() {
+  vertexBuffer = indexBuffer = inputLayout = unknownHandle;
+  indexFormat = GfxFormat::unknown;
+  vertexStride = vertexOffset = indexOffset = 0;
+  topology = -1;
+  std::fill(std::begin(shaders), std::end(shaders), unknownHandle);
+  for (int stage = 0; stage < (int)GfxShaderStage::count; stage++) {
+    std::fill(std::begin(constantBuffers[stage]), std::end(constantBuffers[stage]), unknownHandle);
+    std::fill(std::begin(resources[stage]), std::end(resources[stage]), unknownHandle);
+    std::fill(std::begin(samplers[stage]), std::end(samplers[stage]), unknownHandle);
+  }
+  rasterizerState = depthStencilState = unknownHandle;
+}
+
+void GfxContextBase::SetVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset) {
+  // Only slot 0 is cached, other slots always go through
+  if (slot != 0) {
+    Uncached();
+    ApplyVertexBuffer(slot, buffer, stride, offset);
+    return;
+  }
+
+  stats.calls++;
+  if (filterRedundant && vertexBuffer == buffer && vertexStride == stride && vertexOffset == offset) {
+    stats.redundantSkipped++;
+    return;
+  }
+
+  vertexBuffer = buffer;
+  vertexStride = stride;
+  vertexOffset = offset;
+  stats.stateChanges++;
+  ApplyVertexBuffer(slot, buffer, stride, offset);
+}
+
+void GfxContextBase::SetIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) {
+  stats.calls++;
+  if (filterRedundant && indexBuffer == buffer && indexFormat == format && indexOffset == offset) {
+    stats.redundantSkipped++;
+    return;
+  }
+
+  indexBuffer = buffer;
+  indexFormat = format;
+  indexOffset = offset;
+  stats.stateChanges++;
+  ApplyIndexBuffer(buffer, format, offset);
+}
+
+void GfxContextBase::SetInputLayout(GfxHandle layout) {
+  if (Changed(inputLayout, layout))
+    ApplyInputLayout(layout);
+}
+
+void GfxContextBase::SetTopology(GfxTopology value) {
+  if (Changed(topology, (int)value))
+    ApplyTopology(value);
+}
+
+void GfxContextBase::SetShader(GfxShaderStage stage, GfxHandle shader) {
+  if (Changed(shaders[(int)stage], shader))
+    ApplyShader(stage, shader);
+}
+
+void GfxContextBase::SetConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) {
+  if (slot >= maxSlots ? Uncached() : Changed(constantBuffers[(int)stage][slot], buffer))
+    ApplyConstantBuffer(stage, slot, buffer);
+}
+
+void GfxContextBase::SetShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) {
+  if (slot >= maxSlots ? Uncached() : Changed(resources[(int)stage][slot], resource))
+    ApplyShaderResource(stage, slot, resource);
+}
+
+void GfxContextBase::SetSampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) {
+  if (slot >= maxSlots ? Uncached() : Changed(samplers[(int)stage][slot], sampler))
+    ApplySampler(stage, slot, sampler);
+}
+
+void GfxContextBase::SetRasterizerState(GfxHandle state) {
+  if (Changed(rasterizerState, state))
+    ApplyRasterizerState(state);
+}
+
+void GfxContextBase::SetDepthStencilState(GfxHandle state) {
+  if (Changed(depthStencilState, state))
+    ApplyDepthStencilState(state);
+}
+
+void GfxContextBase::SetRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) {
+  // Targets unbind resources in the backend, so cached resources are dropped
+  Uncached();
+  for (int stage = 0; stage < (int)GfxShaderStage::count; stage++)
+    std::fill(std::begin(resources[stage]), std::end(resources[stage]), unknownHandle);
+  ApplyRenderTargets(count, targets, depth);
+}
+
+void GfxContextBase::SetViewport(const GfxViewport& viewport) {
+  Uncached();
+  ApplyViewport(viewport);
+}
+
+void GfxContextBase::ClearRenderTarget(GfxHandle target, const float rgba[4]) {
+  stats.calls++;
+  ApplyClearRenderTarget(target, rgba);
+}
+
+void GfxContextBase::ClearDepth(GfxHandle depth, float value) {
+  stats.calls++;
+  ApplyClearDepth(depth, value);
+}
+
+void GfxContextBase::UpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) {
+  stats.calls++;
+  stats.bufferUpdates++;
+  stats.bytesUploaded += size;
+  ApplyUpdateBuffer(buffer, data, size);
+}
+
+void GfxContextBase::Draw(uint32_t vertexCount, uint32_t firstVertex) {
+  stats.calls++;
+  stats.draws++;
+  ApplyDraw(vertexCount, firstVertex);
+}
+
+void GfxContextBase::DrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) {
+  stats.calls++;
+  stats.draws++;
+  ApplyDrawIndexed(indexCount, firstIndex, baseVertex);
+}
+
+void GfxContextBase::Dispatch(uint32_t x, uint32_t y, uint32_t z) {
+  stats.calls++;
+  stats.dispatches++;
+  ApplyDispatch(x, y, z);
+}
+
+void GfxContextBase::BeginEvent(const char* name) {
+  stats.calls++;
+  ApplyBeginEvent(name);
+}
+
+void GfxContextBase::EndEvent() {
+  stats.calls++;
+  ApplyEndEvent();
+}
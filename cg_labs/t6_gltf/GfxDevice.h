@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Thin graphics device interface: GfxD3D11 runs it on D3D11, GfxNull only records calls,
+// so CPU side of the frame can be measured without GPU.
+// Resources are handles (0 - null). Views are implicit: texture is bound as shader resource, render target
+// or depth target according to its bind flags.
+typedef uint32_t GfxHandle;
+const GfxHandle gfxNullHandle = 0;
+
+enum class GfxFormat : int
+{
+  unknown = 0,
+  rgba8Unorm,
+  rgba16Float,
+  rgba32Float,
+  r11g11b10Float,
+  r32Float,
+  rg32Float,
+  rgb32Float,
+  r16Uint,
+  r32Uint,
+  d32Float,
+};
+
+enum GfxBindFlags : uint32_t
+{
+  gfxBindVertexBuffer = 1,
+  gfxBindIndexBuffer = 2,
+  gfxBindConstantBuffer = 4,
+  gfxBindShaderResource = 8,
+  gfxBindRenderTarget = 16,
+  gfxBindDepthStencil = 32,
+  gfxBindUnorderedAccess = 64,
+};
+
+enum class GfxUsage : int
+{
+  gpu = 0,       // UpdateBuffer copies through the context
+  immutable = 1, // initial data only
+  dynamic = 2,   // CPU writes every frame (map with discard)
+};
+
+enum class GfxShaderStage : int
+{
+  vertex = 0,
+  pixel = 1,
+  compute = 2,
+  count = 3,
+};
+
+enum class GfxTopology : int
+{
+  triangleList = 0,
+  triangleStrip = 1,
+  lineList = 2,
+  pointList = 3,
+};
+
+enum class GfxFilter : int { point = 0, linear = 1, anisotropic = 2 };
+enum class GfxAddress : int { wrap = 0, clamp = 1, mirror = 2 };
+enum class GfxCull : int { none = 0, front = 1, back = 2 };
+enum class GfxComparison : int { never = 0, less = 1, lessEqual = 2, equal = 3, greater = 4, always = 5 };
+
+struct GfxBufferDesc {
+  uint32_t size = 0;
+  uint32_t bind = gfxBindVertexBuffer;
+  GfxUsage usage = GfxUsage::gpu;
+  uint32_t stride = 0; // structured buffers
+};
+
+struct GfxTextureDesc {
+  uint32_t width = 1, height = 1;
+  uint32_t mipLevels = 1;
+  uint32_t arraySize = 1; // 6 per cube
+  GfxFormat format = GfxFormat::rgba8Unorm;
+  uint32_t bind = gfxBindShaderResource;
+  GfxUsage usage = GfxUsage::gpu;
+  bool cube = false;
+};
+
+// Initial data of one subresource, subresources go mip by mip of every array slice
+struct GfxSubresourceData {
+  const void* data = nullptr;
+  uint32_t rowPitch = 0;
+};
+
+struct GfxSamplerDesc {
+  GfxFilter filter = GfxFilter::linear;
+  GfxAddress addressU = GfxAddress::wrap, addressV = GfxAddress::wrap, addressW = GfxAddress::wrap;
+  float minLod = 0.0f, maxLod = 3.402823466e+38f;
+};
+
+struct GfxRasterizerDesc {
+  GfxCull cull = GfxCull::back;
+  bool wireframe = false;
+  bool frontCounterClockwise = false;
+  bool depthClip = true;
+};
+
+struct GfxDepthStencilDesc {
+  bool depthEnable = true;
+  bool depthWrite = true;
+  GfxComparison depthFunc = GfxComparison::less;
+};
+
+struct GfxInputElement {
+  const char* semantic;
+  uint32_t semanticIndex;
+  GfxFormat format;
+  uint32_t offset; // in the vertex of slot 0
+};
+
+struct GfxViewport {
+  float x = 0, y = 0, width = 0, height = 0;
+  float minDepth = 0, maxDepth = 1;
+};
+
+// Counters since the last ResetStats
+struct GfxContextStats {
+  uint64_t calls = 0;            // every context call
+  uint64_t stateChanges = 0;     // bindings and states passed to the backend
+  uint64_t redundantSkipped = 0; // bindings equal to the bound ones
+  uint64_t draws = 0;
+  uint64_t dispatches = 0;
+  uint64_t bufferUpdates = 0;
+  uint64_t bytesUploaded = 0;
+};
+
+class IGfxContext {
+public:
+  static const uint32_t maxSlots = 16; // per stage for constant buffers, resources and samplers
+  static const uint32_t maxRenderTargets = 8;
+
+  virtual ~IGfxContext() {};
+
+  virtual void SetVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset = 0) = 0;
+  virtual void SetIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset = 0) = 0;
+  virtual void SetInputLayout(GfxHandle layout) = 0;
+  virtual void SetTopology(GfxTopology topology) = 0;
+  virtual void SetShader(GfxShaderStage stage, GfxHandle shader) = 0;
+  virtual void SetConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) = 0;
+  virtual void SetShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) = 0;
+  virtual void SetSampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) = 0;
+  virtual void SetRasterizerState(GfxHandle state) = 0;
+  virtual void SetDepthStencilState(GfxHandle state) = 0;
+  virtual void SetRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) = 0;
+  virtual void SetViewport(const GfxViewport& viewport) = 0;
+
+  virtual void ClearRenderTarget(GfxHandle target, const float rgba[4]) = 0;
+  virtual void ClearDepth(GfxHandle depth, float value) = 0;
+
+  // Whole buffer: dynamic ones are mapped with discard, others are updated through the context
+  virtual void UpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) = 0;
+
+  virtual void Draw(uint32_t vertexCount, uint32_t firstVertex = 0) = 0;
+  virtual void DrawIndexed(uint32_t indexCount, uint32_t firstIndex = 0, int32_t baseVertex = 0) = 0;
+  virtual void Dispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
+
+  virtual void BeginEvent(const char* name) = 0;
+  virtual void EndEvent() = 0;
+
+  // Bindings were changed bypassing this context, cached state is forgotten
+  virtual void InvalidateState() = 0;
+
+  virtual const GfxContextStats& GetStats() const = 0;
+  virtual void ResetStats() = 0;
+};
+
+class IGfxDevice {
+public:
+  virtual ~IGfxDevice() {};
+
+  // gfxNullHandle on failure
+  virtual GfxHandle CreateBuffer(const GfxBufferDesc& desc, const void* initialData = nullptr) = 0;
+  virtual GfxHandle CreateTexture(const GfxTextureDesc& desc, const GfxSubresourceData* initialData = nullptr) = 0;
+  virtual GfxHandle CreateSampler(const GfxSamplerDesc& desc) = 0;
+  virtual GfxHandle CreateRasterizerState(const GfxRasterizerDesc& desc) = 0;
+  virtual GfxHandle CreateDepthStencilState(const GfxDepthStencilDesc& desc) = 0;
+  virtual GfxHandle CreateShader(GfxShaderStage stage, const void* bytecode, size_t size) = 0;
+  virtual GfxHandle CreateInputLayout(const GfxInputElement* elements, uint32_t count, const void* vsBytecode, size_t size) = 0;
+
+  // Shader resource view created outside (ID3D11ShaderResourceView* for D3D11), it is referenced until Release
+  virtual GfxHandle ImportShaderResource(void* nativeView) = 0;
+
+  // Any handle kind, null is ignored
+  virtual void Release(GfxHandle handle) = 0;
+
+  virtual IGfxContext& GetContext() = 0;
+
+  // Deferred contexts record on worker threads, their lists run on the main context in a chosen order.
+  // BeginDeferred is called on the main thread: the context gets render targets, viewport and output
+  // states of the main context (nullptr if index >= GetDeferredContextCount()). Recording and
+  // FinishDeferred may run on any thread, one thread per context; ExecuteDeferred runs on the main thread
+  // and keeps the main context state.
+  virtual uint32_t GetDeferredContextCount() const = 0;
+  virtual IGfxContext* BeginDeferred(uint32_t index) = 0;
+  virtual bool FinishDeferred(uint32_t index) = 0;
+  virtual void ExecuteDeferred(uint32_t index) = 0;
+
+  static const uint32_t maxDeferredContexts = 16;
+
+  static uint32_t FormatSize(GfxFormat format); // bytes per texel or index
+};
+
+// Redundant binding filter and stats shared by backends, they only implement Apply* of changed state
+class GfxContextBase : public IGfxContext {
+public:
+  GfxContextBase() { InvalidateState(); };
+
+  void SetVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset = 0) override;
+  void SetIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset = 0) override;
+  void SetInputLayout(GfxHandle layout) override;
+  void SetTopology(GfxTopology topology) override;
+  void SetShader(GfxShaderStage stage, GfxHandle shader) override;
+  void SetConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) override;
+  void SetShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) override;
+  void SetSampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) override;
+  void SetRasterizerState(GfxHandle state) override;
+  void SetDepthStencilState(GfxHandle state) override;
+  void SetRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) override;
+  void SetViewport(const GfxViewport& viewport) override;
+
+  void ClearRenderTarget(GfxHandle target, const float rgba[4]) override;
+  void ClearDepth(GfxHandle depth, float value) override;
+  void UpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) override;
+  void Draw(uint32_t vertexCount, uint32_t firstVertex = 0) override;
+  void DrawIndexed(uint32_t indexCount, uint32_t firstIndex = 0, int32_t baseVertex = 0) override;
+  void Dispatch(uint32_t x, uint32_t y, uint32_t z) override;
+  void BeginEvent(const char* name) override;
+  void EndEvent() override;
+
+  void InvalidateState() override;
+
+  const GfxContextStats& GetStats() const override { return stats; }
+  void ResetStats() override { stats = GfxContextStats(); }
+
+  // Off - every binding goes to the backend (to measure the filter)
+  void EnableRedundancyFilter(bool enable) { filterRedundant = enable; }
+
+  // Counters of a deferred context executed on this one
+  void AddStats(const GfxContextStats& other);
+
+protected:
+  virtual void ApplyVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t offset) = 0;
+  virtual void ApplyIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) = 0;
+  virtual void ApplyInputLayout(GfxHandle layout) = 0;
+  virtual void ApplyTopology(GfxTopology topology) = 0;
+  virtual void ApplyShader(GfxShaderStage stage, GfxHandle shader) = 0;
+  virtual void ApplyConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) = 0;
+  virtual void ApplyShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) = 0;
+  virtual void ApplySampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) = 0;
+  virtual void ApplyRasterizerState(GfxHandle state) = 0;
+  virtual void ApplyDepthStencilState(GfxHandle state) = 0;
+  virtual void ApplyRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) = 0;
+  virtual void ApplyViewport(const GfxViewport& viewport) = 0;
+  virtual void ApplyClearRenderTarget(GfxHandle target, const float rgba[4]) = 0;
+  virtual void ApplyClearDepth(GfxHandle depth, float value) = 0;
+  virtual void ApplyUpdateBuffer(GfxHandle buffer, const void* data, uint32_t size) = 0;
+  virtual void ApplyDraw(uint32_t vertexCount, uint32_t firstVertex) = 0;
+  virtual void ApplyDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) = 0;
+  virtual void ApplyDispatch(uint32_t x, uint32_t y, uint32_t z) = 0;
+  virtual void ApplyBeginEvent(const char* name) = 0;
+  virtual void ApplyEndEvent() = 0;
+
+  GfxContextStats stats;
+
+private:
+  // Returns true if value differs from cached one (and stores it), counts the call
+  template<typename T>
+  bool Changed(T& cached, const T& value);
+  // State that is not cached, always goes to the backend
+  bool Uncached();
+
+  // ~0u - unknown (after InvalidateState), so the first binding always goes through
+  static const GfxHandle unknownHandle = ~0u;
+
+  bool filterRedundant = true;
+  GfxHandle vertexBuffer = unknownHandle;
+  uint32_t vertexStride = 0, vertexOffset = 0;
+  GfxHandle indexBuffer = unknownHandle;
+  GfxFormat indexFormat = GfxFormat::unknown;
+  uint32_t indexOffset = 0;
+  GfxHandle inputLayout = unknownHandle;
+  int topology = -1;
+  GfxHandle shaders[(int)GfxShaderStage::count];
+  GfxHandle constantBuffers[(int)GfxShaderStage::count][maxSlots];
+  GfxHandle resources[(int)GfxShaderStage::count][maxSlots];
+  GfxHandle samplers[(int)GfxShaderStage::count][maxSlots];
+  GfxHandle rasterizerState = unknownHandle;
+  GfxHandle depthStencilState = unknownHandle;
+};
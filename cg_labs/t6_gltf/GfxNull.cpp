@@ -0,0 +1,65 @@
+#include "GfxNull.h"
+
+GfxHandle GfxNullDevice::NewHandle(uint64_t bytes) {
+  handleBytes.push_back(bytes);
+  liveResources++;
+  resourceBytes += bytes;
+  return (GfxHandle)handleBytes.size();
+}
+
+GfxHandle GfxNullDevice::CreateBuffer(const GfxBufferDesc& desc, const void* initialData) {
+  if (desc.size == 0 || (desc.usage == GfxUsage::immutable && initialData == nullptr))
+    return gfxNullHandle;
+  return NewHandle(desc.size);
+}
+
+GfxHandle GfxNullDevice::CreateTexture(const GfxTextureDesc& desc, const GfxSubresourceData* initialData) {
+  uint32_t texelSize = FormatSize(desc.format);
+  if (desc.width == 0 || desc.height == 0 || texelSize == 0 || (desc.usage == GfxUsage::immutable && initialData == nullptr))
+    return gfxNullHandle;
+
+  uint64_t bytes = 0;
+  uint32_t w = desc.width, h = desc.height;
+  for (uint32_t mip = 0; mip < desc.mipLevels; mip++) {
+    bytes += (uint64_t)w * h * texelSize;
+    w = w > 1 ? w / 2 : 1;
+    h = h > 1 ? h / 2 : 1;
+  }
+  return NewHandle(bytes * desc.arraySize);
+}
+
+void GfxNullDevice::Release(GfxHandle handle) {
+  if (handle == gfxNullHandle || handle > handleBytes.size() || handleBytes[handle - 1] == ~0ull)
+    return;
+
+  liveResources--;
+  resourceBytes -= handleBytes[handle - 1];
+  handleBytes[handle - 1] = ~0ull;
+}
+
+void GfxNullContext::Execute(GfxNullContext& deferred) {
+  AddStats(deferred.GetStats());
+  if (recording)
+    calls.insert(calls.end(), deferred.calls.begin(), deferred.calls.end());
+  deferred.ClearCalls();
+  deferred.ResetStats();
+}
+
+IGfxContext* GfxNullDevice::BeginDeferred(uint32_t index) {
+  if (index >= maxDeferredContexts)
+    return nullptr;
+
+  if (!deferred[index])
+    deferred[index].reset(new GfxNullContext());
+  GfxNullContext& deferredContext = *deferred[index];
+  deferredContext.InvalidateState();
+  deferredContext.ResetStats();
+  deferredContext.ClearCalls();
+  deferredContext.EnableRecording(context.IsRecording());
+  return &deferredContext;
+}
+
+void GfxNullDevice::ExecuteDeferred(uint32_t index) {
+  if (index < maxDeferredContexts && deferred[index])
+    context.Execute(*deferred[index]);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "GfxDevice.h"
+
+enum class GfxCallType : uint8_t
+{
+  vertexBuffer,
+  indexBuffer,
+  inputLayout,
+  topology,
+  shader,
+  constantBuffer,
+  shaderResource,
+  sampler,
+  rasterizerState,
+  depthStencilState,
+  renderTargets,
+  viewport,
+  clearRenderTarget,
+  clearDepth,
+  updateBuffer,
+  draw,
+  drawIndexed,
+  dispatch,
+  beginEvent,
+  endEvent,
+};
+
+// Call passed through the redundancy filter; args depend on type (stage/slot/handle, counts, sizes)
+struct GfxRecordedCall {
+  GfxCallType type;
+  uint32_t args[3];
+};
+
+class GfxNullContext : public GfxContextBase {
+public:
+  // Off by default, so benchmarks measure submission only
+  void EnableRecording(bool enable) { recording = enable; }
+  bool IsRecording() const { return recording; }
+  const std::vector<GfxRecordedCall>& GetCalls() const { return calls; }
+  void ClearCalls() { calls.clear(); }
+
+  // Takes calls and counters of a finished deferred context
+  void Execute(GfxNullContext& deferred);
+
+protected:
+  void ApplyVertexBuffer(uint32_t slot, GfxHandle buffer, uint32_t stride, uint32_t /*offset*/) override { Record(GfxCallType::vertexBuffer, slot, buffer, stride); }
+  void ApplyIndexBuffer(GfxHandle buffer, GfxFormat format, uint32_t offset) override { Record(GfxCallType::indexBuffer, buffer, (uint32_t)format, offset); }
+  void ApplyInputLayout(GfxHandle layout) override { Record(GfxCallType::inputLayout, layout); }
+  void ApplyTopology(GfxTopology topology) override { Record(GfxCallType::topology, (uint32_t)topology); }
+  void ApplyShader(GfxShaderStage stage, GfxHandle shader) override { Record(GfxCallType::shader, (uint32_t)stage, shader); }
+  void ApplyConstantBuffer(GfxShaderStage stage, uint32_t slot, GfxHandle buffer) override { Record(GfxCallType::constantBuffer, (uint32_t)stage, slot, buffer); }
+  void ApplyShaderResource(GfxShaderStage stage, uint32_t slot, GfxHandle resource) override { Record(GfxCallType::shaderResource, (uint32_t)stage, slot, resource); }
+  void ApplySampler(GfxShaderStage stage, uint32_t slot, GfxHandle sampler) override { Record(GfxCallType::sampler, (uint32_t)stage, slot, sampler); }
+  void ApplyRasterizerState(GfxHandle state) override { Record(GfxCallType::rasterizerState, state); }
+  void ApplyDepthStencilState(GfxHandle state) override { Record(GfxCallType::depthStencilState, state); }
+  void ApplyRenderTargets(uint32_t count, const GfxHandle* targets, GfxHandle depth) override { Record(GfxCallType::renderTargets, count, count > 0 ? targets[0] : 0, depth); }
+  void ApplyViewport(const GfxViewport& viewport) override { Record(GfxCallType::viewport, (uint32_t)viewport.width, (uint32_t)viewport.height); }
+  void ApplyClearRenderTarget(GfxHandle target, const float /*rgba*/[4]) override { Record(GfxCallType::clearRenderTarget, target); }
+  void ApplyClearDepth(GfxHandle depth, float /*value*/) override { Record(GfxCallType::clearDepth, depth); }
+  void ApplyUpdateBuffer(GfxHandle buffer, const void* /*data*/, uint32_t size) override { Record(GfxCallType::updateBuffer, buffer, size); }
+  void ApplyDraw(uint32_t vertexCount, uint32_t firstVertex) override { Record(GfxCallType::draw, vertexCount, firstVertex); }
+  void ApplyDrawIndexed(uint32_t indexCount, uint32_t firstIndex, int32_t baseVertex) override { Record(GfxCallType::drawIndexed, indexCount, firstIndex, (uint32_t)baseVertex); }
+  void ApplyDispatch(uint32_t x, uint32_t y, uint32_t z) override { Record(GfxCallType::dispatch, x, y, z); }
+  void ApplyBeginEvent(const char* /*name*/) override { Record(GfxCallType::beginEvent); }
+  void ApplyEndEvent() override { Record(GfxCallType::endEvent); }
+
+private:
+  void Record(GfxCallType type, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+    if (recording)
+      calls.push_back({ type, { a, b, c } });
+  }
+
+  bool recording = false;
+  std::vector<GfxRecordedCall> calls;
+};
+
+// Device without GPU: resources are only handles, context records calls.
+// Measures CPU cost of scene submission (culling, sorting, binding logic) without driver overhead.
+class GfxNullDevice : public IGfxDevice {
+public:
+  GfxHandle CreateBuffer(const GfxBufferDesc& desc, const void* initialData = nullptr) override;
+  GfxHandle CreateTexture(const GfxTextureDesc& desc, const GfxSubresourceData* initialData = nullptr) override;
+  GfxHandle CreateSampler(const GfxSamplerDesc& /*desc*/) override { return NewHandle(0); }
+  GfxHandle CreateRasterizerState(const GfxRasterizerDesc& /*desc*/) override { return NewHandle(0); }
+  GfxHandle CreateDepthStencilState(const GfxDepthStencilDesc& /*desc*/) override { return NewHandle(0); }
+  GfxHandle CreateShader(GfxShaderStage /*stage*/, const void* /*bytecode*/, size_t /*size*/) override { return NewHandle(0); }
+  GfxHandle CreateInputLayout(const GfxInputElement* /*elements*/, uint32_t /*count*/, const void* /*vsBytecode*/, size_t /*size*/) override { return NewHandle(0); }
+  GfxHandle ImportShaderResource(void* nativeView) override { return nativeView ? NewHandle(0) : gfxNullHandle; }
+  void Release(GfxHandle handle) override;
+
+  IGfxContext& GetContext() override { return context; }
+  GfxNullContext& GetNullContext() { return context; }
+
+  // Deferred contexts record like the main one, execution appends their calls to it
+  uint32_t GetDeferredContextCount() const override { return maxDeferredContexts; }
+  IGfxContext* BeginDeferred(uint32_t index) override;
+  bool FinishDeferred(uint32_t index) override { return index < maxDeferredContexts && deferred[index]; }
+  void ExecuteDeferred(uint32_t index) override;
+
+  uint32_t GetLiveResources() const { return liveResources; }
+  uint64_t GetResourceBytes() const { return resourceBytes; } // buffer and texture memory the device would allocate
+
+private:
+  GfxHandle NewHandle(uint64_t bytes);
+
+  GfxNullContext context;
+  std::unique_ptr<GfxNullContext> deferred[maxDeferredContexts];
+  std::vector<uint64_t> handleBytes; // [handle - 1], ~0 - released
+  uint32_t liveResources = 0;
+  uint64_t resourceBytes = 0;
+};
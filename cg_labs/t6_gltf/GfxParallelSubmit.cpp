@@ -0,0 +1,130 @@
+#include "GfxParallelSubmit.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "TraceRecorder.h"
+
+namespace {
+  // Weight of the newest measurement in the smoothed packet and list costs
+  const double costBlend = 0.1;
+
+  double NowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+GfxParallelSubmitter::GfxParallelSubmitter() : jobs(&JobSystem::GetInstance()) {
+}
+
+uint32_t GfxParallelSubmitter::ChooseChunkCount(const IGfxDevice& device, uint32_t packets) const {
+  if (!enabled || packetUs <= 0.0)
+    return 1;
+
+  double packetsPerChunk = std::max(targetChunkMs * 1000.0 / packetUs, (double)minPacketsPerChunk);
+  uint32_t chunks = (uint32_t)std::ceil(packets / packetsPerChunk);
+  // More chunks than threads only adds command lists to execute
+  uint32_t maxChunks = std::min(device.GetDeferredContextCount(), (uint32_t)jobs->GetThreadCount());
+
+  // n chunks take about replay / n + n * listUs, least at sqrt(replay / listUs);
+  // below 2 the main context alone is faster
+  if (listUs > 0.0)
+    maxChunks = std::min(maxChunks, (uint32_t)std::sqrt(packets * packetUs / listUs));
+  return std::max(std::min(chunks, maxChunks), 1u);
+}
+
+void GfxParallelSubmitter::UpdatePacketCost(double ms, uint32_t packets) {
+  if (packets == 0)
+    return;
+  double us = ms * 1000.0 / packets;
+  packetUs = packetUs > 0.0 ? packetUs + (us - packetUs) * costBlend : us;
+}
+
+void GfxParallelSubmitter::UpdateListCost(double ms, uint32_t lists) {
+  if (lists == 0)
+    return;
+  double us = ms * 1000.0 / lists;
+  listUs = listUs > 0.0 ? listUs + (us - listUs) * costBlend : us;
+}
+
+void GfxParallelSubmitter::ReplaySerial(IGfxContext& context, const GfxCommandList& list) {
+  double start = NowMs();
+  list.Replay(context);
+  stats.recordMs = NowMs() - start;
+  stats.executeMs = 0.0;
+  stats.chunks = 1;
+  stats.packetsPerChunk = stats.packets;
+  UpdatePacketCost(stats.recordMs, stats.packets);
+}
+
+void GfxParallelSubmitter::Replay(IGfxDevice& device, const GfxCommandList& list) {
+  IGfxContext& context = device.GetContext();
+  uint32_t packets = (uint32_t)list.GetPackets().size();
+  stats.packets = packets;
+  stats.fallbackChunks = 0;
+
+  uint32_t chunks = ChooseChunkCount(device, packets);
+  if (chunks < 2) {
+    ReplaySerial(context, list);
+    stats.packetUs = packetUs;
+    stats.listUs = listUs;
+    return;
+  }
+
+  // Contexts get state of the main context, so they are started before any job runs
+  IGfxContext* deferred[IGfxDevice::maxDeferredContexts] = {};
+  for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+    deferred[chunk] = device.BeginDeferred(chunk);
+    if (!deferred[chunk]) {
+      // Out of deferred contexts: the started ones are finished empty and never executed,
+      // the next BeginDeferred drops their lists. Everything replays on the main context
+      for (uint32_t started = 0; started < chunk; started++)
+        device.FinishDeferred(started);
+      ReplaySerial(context, list);
+      stats.packetUs = packetUs;
+      stats.listUs = listUs;
+      return;
+    }
+  }
+
+  chunkMs.assign(chunks, 0.0);
+  chunkFinished.assign(chunks, 0);
+  double start = NowMs();
+  jobs->ParallelFor(chunks, [&](size_t chunk) {
+    TRACE_SCOPE("Deferred chunk");
+    uint32_t first = (uint32_t)(packets * chunk / chunks), end = (uint32_t)(packets * (chunk + 1) / chunks);
+    double chunkStart = NowMs();
+    list.Replay(*deferred[chunk], first, end - first);
+    chunkFinished[chunk] = device.FinishDeferred((uint32_t)chunk) ? 1 : 0;
+    chunkMs[chunk] = NowMs() - chunkStart;
+  });
+  stats.recordMs = NowMs() - start;
+
+  // List order is kept: chunks run one after another on the main context
+  start = NowMs();
+  for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+    if (chunkFinished[chunk]) {
+      device.ExecuteDeferred(chunk);
+    } else {
+      uint32_t first = packets * chunk / chunks, end = packets * (chunk + 1) / chunks;
+      context.InvalidateState();
+      list.Replay(context, first, end - first);
+      stats.fallbackChunks++;
+    }
+  }
+  stats.executeMs = NowMs() - start;
+
+  double totalChunkMs = 0.0;
+  for (double ms : chunkMs)
+    totalChunkMs += ms;
+  UpdatePacketCost(totalChunkMs, packets);
+  // Fallback replays are not list executions
+  if (stats.fallbackChunks == 0)
+    UpdateListCost(stats.executeMs, chunks);
+  stats.chunks = chunks;
+  stats.packetsPerChunk = (packets + chunks - 1) / chunks;
+  stats.packetUs = packetUs;
+  stats.listUs = listUs;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GfxCommandBuffer.h"
+#include "GfxDevice.h"
+
+class JobSystem;
+
+struct GfxParallelSubmitStats {
+  uint32_t packets = 0;
+  uint32_t chunks = 0;          // 1 - replayed on the main context
+  uint32_t packetsPerChunk = 0;
+  uint32_t fallbackChunks = 0;  // deferred chunks that failed to finish and were replayed on the main context
+  double packetUs = 0.0;        // smoothed replay cost of one packet, chunk size is tuned from it
+  double listUs = 0.0;          // smoothed ExecuteDeferred cost of one chunk, limits the chunk count
+  double recordMs = 0.0;        // replay of all chunks, wall time
+  double executeMs = 0.0;       // ExecuteDeferred of all chunks on the main thread
+};
+
+// Replays a command list on the main context or splits it into chunks of packets that are
+// replayed on deferred contexts by JobSystem jobs and executed on the main context in list order.
+// Chunks are sized so one takes about the target time: small lists stay on the main context,
+// where a deferred list would cost more than it saves. Every chunk adds a list to execute on the
+// main thread, so there are no more chunks than pays off for the measured execute cost.
+class GfxParallelSubmitter {
+public:
+  // Chunks run on JobSystem::GetInstance() or on the given pool
+  GfxParallelSubmitter();
+  explicit GfxParallelSubmitter(JobSystem& jobSystem) : jobs(&jobSystem) {}
+
+  void Enable(bool enable) { enabled = enable; }
+  bool IsEnabled() const { return enabled; }
+  void SetTargetChunkMs(double ms) { targetChunkMs = ms; }
+  double GetTargetChunkMs() const { return targetChunkMs; }
+
+  // Main thread only; state of the main context is kept when chunks run deferred
+  void Replay(IGfxDevice& device, const GfxCommandList& list);
+
+  const GfxParallelSubmitStats& GetStats() const { return stats; }
+
+private:
+  uint32_t ChooseChunkCount(const IGfxDevice& device, uint32_t packets) const;
+  void ReplaySerial(IGfxContext& context, const GfxCommandList& list);
+  void UpdatePacketCost(double ms, uint32_t packets);
+  void UpdateListCost(double ms, uint32_t lists);
+
+  static const uint32_t minPacketsPerChunk = 16;
+
+  JobSystem* jobs;
+  bool enabled = true;
+  double targetChunkMs = 0.2;
+  double packetUs = 0.0; // 0 - not measured yet
+  double listUs = 0.0;
+  GfxParallelSubmitStats stats;
+  std::vector<double> chunkMs;
+  std::vector<uint8_t> chunkFinished;
+};
@@ -1,9 +1,15 @@
-static const float WhiteLumen = 11.2f;
 static const float lumMin = 0;
 static const float lumMax = 1000;
 
-sampler SceneTextureSampler;
-Texture2D SceneTexture;
+sampler SceneTextureSampler : register(s0);
+Texture2D SceneTexture : register(t0);
+
+// Operator, grading and output transform baked by TonemapLUT (see TonemapLUT.h)
+sampler ClampSampler : register(s1);
+Texture3D TonemapLUT : register(t1);
+
+// Result of bloom chain at lower resolution
+Texture2D BloomTexture : register(t2);
 
 struct PSInput
 {
@@ -15,20 +21,10 @@ struct PSInput
 cbuffer CBuf
 {
 	float4 averageLumen;
+	float4 lutParams; // min log2, 1 / (max log2 - min log2), LUT size
+	float4 bloomParams; // x - intensity divided by bloom levels count
 };
 
-float3 Uncharted2Tonemap(float3 x)
-{
-	static const float A = 0.10;
-	static const float B = 0.50;
-	static const float C = 0.10;
-	static const float D = 0.20;
-	static const float E = 0.02;
-	static const float F = 0.30;
-
-	return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
-}
-
 float getExposition()
 {
 	float keyValue = 1.03f - 2.0f / (2.0f + log10(averageLumen.x + 1));
@@ -38,12 +34,13 @@ float getExposition()
 float4 main(PSInput i) : SV_Target
 {
 	float3 color = SceneTexture.Sample(SceneTextureSampler, i.texcoord).rgb;
+	color += BloomTexture.SampleLevel(ClampSampler, i.texcoord, 0).rgb * bloomParams.x;
 
-	float E = getExposition();
-	float3 toneMappedCol = Uncharted2Tonemap(color * E * 8);
-	float3 whiteScale = 1.0f / Uncharted2Tonemap(WhiteLumen);
+	float3 exposed = max(color * getExposition(), 0.0f);
 
-	float4 final_color = float4(pow(abs(toneMappedCol * whiteScale), 1.0f / 2.2f), 1.0f);
+	// log2 shaper, zero goes to -inf and is clamped to the first texel
+	float3 t = saturate((log2(exposed) - lutParams.x) * lutParams.y);
+	float3 uvw = t * ((lutParams.z - 1.0f) / lutParams.z) + 0.5f / lutParams.z;
 
-	return final_color;
+	return float4(TonemapLUT.SampleLevel(ClampSampler, uvw, 0).rgb, 1.0f);
 }
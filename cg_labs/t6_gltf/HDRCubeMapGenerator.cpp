@@ -1,42 +1,8 @@
 #include "HDRCubeMapGenerator.h"
-#include "D3DInclude.h"
+#include "ShaderLibrary.h"
 #include "renderer.h"
-
-HRESULT HDRCubeMapGenerator::CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
-{
-  HRESULT hr = S_OK;
-
-  DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-  // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-  // Setting this flag improves the shader debugging experience, but still allows 
-  // the shaders to be optimized and to run exactly the way they will run in 
-  // the release configuration of this program.
-  dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-  // Disable optimizations to further improve shader debugging
-  dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-  D3DInclude includeObj;
-
-  ID3DBlob* pErrorBlob = nullptr;
-  hr = D3DCompileFromFile(szFileName, nullptr, &includeObj, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
-
-  if (FAILED(hr))
-  {
-    if (pErrorBlob)
-    {
-      OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
-      pErrorBlob->Release();
-    }
-    return hr;
-  }
-
-  if (pErrorBlob)
-    pErrorBlob->Release();
-
-  return S_OK;
-}
+#include "parallel.h"
+#include "RadianceHDRDecoder.h"
 
 HRESULT HDRCubeMapGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* context) {
   // Init constants
@@ -85,7 +51,7 @@ HRESULT HDRCubeMapGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* con
   flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
 
-  HRESULT hr = D3DCompileFromFile(L"HDRToCubeMap_VS.hlsl", NULL, NULL, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
+  HRESULT hr = ShaderLibrary::GetInstance().Compile(L"HDRToCubeMap_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
@@ -93,7 +59,7 @@ HRESULT HDRCubeMapGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* con
   if (FAILED(hr))
     return hr;
 
-  hr = D3DCompileFromFile(L"HDRToCubeMap_PS.hlsl", NULL, NULL, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
+  hr = ShaderLibrary::GetInstance().Compile(L"HDRToCubeMap_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
@@ -235,6 +201,88 @@ HRESULT HDRCubeMapGenerator::GenerateCubeMap(ID3D11Device* device, ID3D11DeviceC
   return hr;
 }
 
+HRESULT HDRCubeMapGenerator::LoadEquirect(const wchar_t* filename, CubeMapConvertParams& params, HDRImage& equirect) {
+  RadianceHDRDecoder decoder;
+  if (!decoder.Open(filename))
+    return E_FAIL;
+
+  // Texels beyond cube map density are averaged while streaming, so huge sources never exist as float copy
+  if (params.faceSize == 0)
+    params.faceSize = CubeMapConverter::SuggestFaceSize(decoder.GetWidth());
+  UINT downsample = max(decoder.GetWidth() / (4 * params.faceSize), 1u);
+
+  if (!decoder.ReadImage(equirect, downsample))
+    return E_FAIL;
+  return S_OK;
+}
+
+HRESULT HDRCubeMapGenerator::GenerateCubeMapFromFile(ID3D11Device* device, const wchar_t* filename, const CubeMapConvertParams& params, HDRTextureFormat format) {
+  CubeMapConvertParams convertParams = params;
+  HDRImage equirect;
+  HRESULT hr = LoadEquirect(filename, convertParams, equirect);
+  if (FAILED(hr))
+    return hr;
+
+  return GenerateCubeMap(device, equirect, convertParams, format);
+}
+
+HRESULT HDRCubeMapGenerator::GenerateCubeMap(ID3D11Device* device, const HDRImage& equirect, const CubeMapConvertParams& params, HDRTextureFormat format) {
+  CubeMapImage cube;
+  CubeMapConverter(params).Convert(equirect, cube);
+  g_hdrTextureSize = cube.faceSize;
+
+  // BC6H needs block aligned top level
+  if (format == HDRTextureFormat::bc6h && cube.faceSize % 4 != 0)
+    format = HDRTextureFormat::rgba16f;
+
+  // Encode faces in parallel and measure the format error on mip 0
+  std::vector<EncodedHDRImage> encoded(6 * cube.mipLevels);
+  HDRFormatErrorReport faceReports[6];
+  ParallelFor(6, [&](size_t face) {
+    for (UINT mip = 0; mip < cube.mipLevels; mip++)
+      HDRFormatEncoder::Encode(cube.faces[face][mip], format, encoded[D3D11CalcSubresource(mip, (UINT)face, cube.mipLevels)]);
+
+    if (format != HDRTextureFormat::rgba32f) {
+      HDRImage decoded;
+      HDRFormatEncoder::Decode(encoded[D3D11CalcSubresource(0, (UINT)face, cube.mipLevels)], decoded);
+      faceReports[face] = HDRFormatEncoder::Compare(cube.faces[face][0], decoded);
+    }
+  });
+
+  g_errorReport = HDRFormatErrorReport();
+  for (UINT face = 0; face < 6; face++)
+    g_errorReport.Accumulate(faceReports[face]);
+
+  // Create cube map texture with all mips
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Format = ToDXGIFormat(format);
+  desc.Width = cube.faceSize;
+  desc.Height = cube.faceSize;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.Usage = D3D11_USAGE_IMMUTABLE;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+  desc.MipLevels = cube.mipLevels;
+  desc.ArraySize = 6;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+
+  std::vector<D3D11_SUBRESOURCE_DATA> data(encoded.size());
+  for (size_t i = 0; i < encoded.size(); i++) {
+    data[i].pSysMem = encoded[i].data.data();
+    data[i].SysMemPitch = encoded[i].rowPitch;
+    data[i].SysMemSlicePitch = 0;
+  }
+
+  HRESULT hr = device->CreateTexture2D(&desc, data.data(), &g_pCubeMapTexture);
+  if (FAILED(hr))
+    return hr;
+
+  // Create subresource
+  hr = device->CreateShaderResourceView(g_pCubeMapTexture, nullptr, &g_pCMSRV);
+  return hr;
+}
+
 void HDRCubeMapGenerator::Release() {
   if (g_pCMSRV) g_pCMSRV->Release();
   if (g_pCubeMapTexture) g_pCubeMapTexture->Release();
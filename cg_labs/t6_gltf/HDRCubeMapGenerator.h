@@ -4,6 +4,8 @@
 #include <DirectXMath.h>
 
 #include "common.h"
+#include "CubeMapConverter.h"
+#include "HDRFormats.h"
 
 using namespace DirectX;
 
@@ -13,13 +15,25 @@ public:
 
   HRESULT GenerateCubeMap(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* txtSRV);
 
+	// CPU path: equirect is resampled on CPU and uploaded with full mip chain (no Init needed)
+	HRESULT GenerateCubeMap(ID3D11Device* device, const HDRImage& equirect, const CubeMapConvertParams& params = CubeMapConvertParams(),
+		HDRTextureFormat format = HDRTextureFormat::rgba16f);
+	HRESULT GenerateCubeMapFromFile(ID3D11Device* device, const wchar_t* filename, const CubeMapConvertParams& params = CubeMapConvertParams(),
+		HDRTextureFormat format = HDRTextureFormat::rgba16f);
+
+	// Streams .hdr file into lat-long image not denser than the cube map; sets params.faceSize if it is 0
+	static HRESULT LoadEquirect(const wchar_t* filename, CubeMapConvertParams& params, HDRImage& equirect);
+
+	// Error of the format used by last CPU path generation against float data (mip 0 only)
+	const HDRFormatErrorReport& GetErrorReport() { return g_errorReport; };
+
 	ID3D11ShaderResourceView* GetSRV() { return g_pCMSRV; };
 
+	UINT GetFaceSize() { return g_hdrTextureSize; };
+
 	void Release();
 
 private:
-	HRESULT CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
-
 	void SetViewPort(ID3D11DeviceContext* context, UINT width, UINT hight);
 
 	ID3D11PixelShader* g_pPixelShader = nullptr;
@@ -43,5 +57,6 @@ private:
 	XMMATRIX mViews[6];
 	XMMATRIX g_mMatrises[6];
 
-	UINT g_hdrTextureSize;
+	UINT g_hdrTextureSize = 512;
+	HDRFormatErrorReport g_errorReport;
 };
@@ -0,0 +1,526 @@
+#include "HDRFormats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HDRFORMATS_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+  inline uint32_t AsUint(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+  }
+
+  inline float AsFloat(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+
+  // Float to half with round to nearest even. Finite values beyond half range saturate to 65504
+  // (HDR sources go past it, inf would spread through the IBL bakes), inf and NaN stay
+  inline uint16_t FloatToHalfScalar(float value) {
+    const uint32_t f32infty = 255u << 23;
+    const uint32_t f16max = (127u + 16u) << 23;
+    const uint32_t halfMax = 0x7bff;
+    const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t f = AsUint(value);
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint32_t o;
+    if (f >= f16max)
+      o = (f > f32infty) ? 0x7e00 : (f == f32infty ? 0x7c00 : halfMax);
+    else if (f < (113u << 23))
+      o = AsUint(AsFloat(f) + AsFloat(denormMagic)) - denormMagic;
+    else {
+      uint32_t mantOdd = (f >> 13) & 1;
+      f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+      f += mantOdd;
+      o = std::min(f >> 13, halfMax); // [65520, 65536) rounds up to inf
+    }
+    return (uint16_t)(o | (sign >> 16));
+  }
+
+#ifdef HDRFORMATS_USE_SSE
+  // Same as FloatToHalfScalar for 4 values, results are in low 16 bits of each lane (sign extended)
+  inline __m128i FloatToHalfSSE(__m128 f) {
+    const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i nanBit = _mm_set1_epi32(0x200);
+    const __m128i infAsHalf = _mm_set1_epi32(0x7c00);
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+    const __m128i f32infty = _mm_set1_epi32(255 << 23);
+    const __m128i halfMax = _mm_set1_epi32(0x7bff);
+
+    __m128 justSign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000u)));
+    __m128 absf = _mm_xor_ps(f, justSign);
+    __m128i absInt = _mm_castps_si128(absf);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absf, absf));
+    __m128i isRegular = _mm_cmpgt_epi32(f16max, absInt);
+    __m128i isSpecial = _mm_or_si128(isNan, _mm_cmpeq_epi32(absInt, f32infty));
+    __m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, nanBit), infAsHalf);
+    __m128i overflow = _mm_or_si128(_mm_and_si128(isSpecial, infOrNan), _mm_andnot_si128(isSpecial, halfMax));
+
+    // Result is subnormal
+    __m128i isSub = _mm_cmpgt_epi32(minNormal, absInt);
+    __m128 sub1 = _mm_add_ps(absf, _mm_castsi128_ps(subnormMagic));
+    __m128i sub2 = _mm_sub_epi32(_mm_castps_si128(sub1), subnormMagic);
+
+    // Result is normal
+    __m128i mantOdd = _mm_srai_epi32(_mm_slli_epi32(absInt, 31 - 13), 31);
+    __m128i round1 = _mm_add_epi32(absInt, normalBias);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(round1, mantOdd), 13);
+    __m128i normalOver = _mm_cmpgt_epi32(normal, halfMax);
+    normal = _mm_or_si128(_mm_and_si128(normalOver, halfMax), _mm_andnot_si128(normalOver, normal));
+
+    __m128i nonSpecial = _mm_or_si128(_mm_and_si128(sub2, isSub), _mm_andnot_si128(isSub, normal));
+    __m128i joined = _mm_or_si128(_mm_and_si128(nonSpecial, isRegular), _mm_andnot_si128(isRegular, overflow));
+
+    __m128i signShift = _mm_srai_epi32(_mm_castps_si128(justSign), 16);
+    return _mm_or_si128(joined, signShift);
+  }
+#endif
+
+  // Positive half to unsigned small float with 5 bit exponent and mantBits mantissa (R11G11B10)
+  inline uint32_t HalfToSmallFloat(uint16_t h, uint32_t mantBits) {
+    if (h & 0x8000)
+      return 0;
+
+    uint32_t exp = (h >> 10) & 0x1f;
+    if (exp == 31)
+      return (h & 0x3ff) ? 0 : (31u << mantBits); // NaN is flushed to 0, inf kept
+
+    uint32_t shift = 10 - mantBits;
+    uint32_t v = h;
+    v = (v + ((1u << (shift - 1)) - 1) + ((v >> shift) & 1)) >> shift;
+    return std::min(v, (31u << mantBits) - 1);
+  }
+
+  inline float SmallFloatToFloat(uint32_t v, uint32_t mantBits) {
+    uint32_t exp = v >> mantBits;
+    uint32_t mant = v & ((1u << mantBits) - 1);
+    if (exp == 0)
+      return ldexpf((float)mant, -14 - (int)mantBits);
+    if (exp == 31)
+      return mant ? NAN : INFINITY;
+    return ldexpf(1.0f + (float)mant / (1u << mantBits), (int)exp - 15);
+  }
+
+  // BC6H helpers (mode 11 only: one region, 10 bit endpoints, 4 bit indices)
+  const int bc6hWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+  void WriteBits(uint8_t block[16], uint32_t& pos, uint32_t value, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, pos++)
+      if (value & (1u << i))
+        block[pos >> 3] |= (uint8_t)(1u << (pos & 7));
+  }
+
+  uint32_t ReadBits(const uint8_t block[16], uint32_t& pos, uint32_t count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; i++, pos++)
+      if (block[pos >> 3] & (1u << (pos & 7)))
+        value |= 1u << i;
+    return value;
+  }
+
+  inline int UnquantizeUF16(int q) {
+    if (q == 0)
+      return 0;
+    if (q == 1023)
+      return 0xFFFF;
+    return ((q << 16) + 0x8000) >> 10;
+  }
+
+  // Half bits of palette entry
+  inline int InterpolateUF16(int unq0, int unq1, int index) {
+    int w = bc6hWeights[index];
+    int unq = (unq0 * (64 - w) + unq1 * w + 32) >> 6;
+    return (unq * 31) >> 6;
+  }
+
+  inline int QuantizeUF16(float halfBits) {
+    int q = (int)lroundf(halfBits / 31.0f - 0.5f);
+    return std::max(0, std::min(1023, q));
+  }
+}
+
+void HDRFormatErrorReport::Accumulate(const HDRFormatErrorReport& other) {
+  size_t total = texels + other.texels;
+  if (total == 0)
+    return;
+
+  rmse = sqrt((rmse * rmse * texels + other.rmse * other.rmse * other.texels) / total);
+  logRmse = sqrt((logRmse * logRmse * texels + other.logRmse * other.logRmse * other.texels) / total);
+  maxAbsError = std::max(maxAbsError, other.maxAbsError);
+  maxRelError = std::max(maxRelError, other.maxRelError);
+  texels = total;
+}
+
+uint32_t HDRFormatEncoder::BytesPerTexel(HDRTextureFormat format) {
+  switch (format) {
+  case HDRTextureFormat::rgba32f: return 16;
+  case HDRTextureFormat::rgba16f: return 8;
+  case HDRTextureFormat::r11g11b10f:
+  case HDRTextureFormat::rgb9e5: return 4;
+  default: return 0;
+  }
+}
+
+uint32_t HDRFormatEncoder::RowPitch(HDRTextureFormat format, uint32_t width) {
+  if (format == HDRTextureFormat::bc6h)
+    return ((width + 3) / 4) * 16;
+  return width * BytesPerTexel(format);
+}
+
+uint32_t HDRFormatEncoder::RowsCount(HDRTextureFormat format, uint32_t height) {
+  if (format == HDRTextureFormat::bc6h)
+    return (height + 3) / 4;
+  return height;
+}
+
+bool HDRFormatEncoder::IsRenderable(HDRTextureFormat format) {
+  return format == HDRTextureFormat::rgba32f || format == HDRTextureFormat::rgba16f || format == HDRTextureFormat::r11g11b10f;
+}
+
+const char* HDRFormatEncoder::GetName(HDRTextureFormat format) {
+  switch (format) {
+  case HDRTextureFormat::rgba32f: return "R32G32B32A32_FLOAT";
+  case HDRTextureFormat::rgba16f: return "R16G16B16A16_FLOAT";
+  case HDRTextureFormat::r11g11b10f: return "R11G11B10_FLOAT";
+  case HDRTextureFormat::rgb9e5: return "R9G9B9E5_SHAREDEXP";
+  case HDRTextureFormat::bc6h: return "BC6H_UF16";
+  default: return "unknown";
+  }
+}
+
+void HDRFormatEncoder::FloatToHalf(const float* src, uint16_t* dst, size_t count) {
+  size_t i = 0;
+#ifdef HDRFORMATS_USE_SSE
+  for (; i + 8 <= count; i += 8) {
+    __m128i lo = FloatToHalfSSE(_mm_loadu_ps(src + i));
+    __m128i hi = FloatToHalfSSE(_mm_loadu_ps(src + i + 4));
+    // Values are sign extended 16 bit, so signed saturation keeps them as is
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+  for (; i < count; i++)
+    dst[i] = FloatToHalfScalar(src[i]);
+}
+
+float HDRFormatEncoder::HalfToFloat(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+
+  if (exp == 0) {
+    float value = ldexpf((float)mant, -24);
+    return sign ? -value : value;
+  }
+  if (exp == 31)
+    return AsFloat(sign | 0x7f800000u | (mant << 13));
+  return AsFloat(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+uint32_t HDRFormatEncoder::PackR11G11B10(const float rgb[3]) {
+  float rgbx[4] = { rgb[0], rgb[1], rgb[2], 0.0f };
+  uint16_t h[4];
+  FloatToHalf(rgbx, h, 4);
+
+  return HalfToSmallFloat(h[0], 6) | (HalfToSmallFloat(h[1], 6) << 11) | (HalfToSmallFloat(h[2], 5) << 22);
+}
+
+void HDRFormatEncoder::UnpackR11G11B10(uint32_t packed, float rgb[3]) {
+  rgb[0] = SmallFloatToFloat(packed & 0x7ff, 6);
+  rgb[1] = SmallFloatToFloat((packed >> 11) & 0x7ff, 6);
+  rgb[2] = SmallFloatToFloat((packed >> 22) & 0x3ff, 5);
+}
+
+uint32_t HDRFormatEncoder::PackRGB9E5(const float rgb[3]) {
+  const float maxf9 = float(0x1FF << 7);
+  const float minf9 = 1.0f / (1 << 16);
+
+  float c[3];
+  for (int i = 0; i < 3; i++)
+    c[i] = (rgb[i] >= 0.0f) ? std::min(rgb[i], maxf9) : 0.0f; // NaN goes to 0 too
+
+  float maxColor = std::max(std::max(std::max(c[0], c[1]), c[2]), minf9);
+
+  // Round up leaving 9 bits in fraction (including assumed 1)
+  uint32_t exp = (AsUint(maxColor) + 0x00004000u) >> 23;
+  float scale = AsFloat(0x83000000u - (exp << 23));
+
+  uint32_t m[3];
+  for (int i = 0; i < 3; i++)
+    m[i] = std::min((uint32_t)lroundf(c[i] * scale), 0x1FFu);
+
+  return m[0] | (m[1] << 9) | (m[2] << 18) | ((exp - 0x6f) << 27);
+}
+
+void HDRFormatEncoder::UnpackRGB9E5(uint32_t packed, float rgb[3]) {
+  int exp = (int)(packed >> 27) - 15 - 9;
+  rgb[0] = ldexpf((float)(packed & 0x1ff), exp);
+  rgb[1] = ldexpf((float)((packed >> 9) & 0x1ff), exp);
+  rgb[2] = ldexpf((float)((packed >> 18) & 0x1ff), exp);
+}
+
+void HDRFormatEncoder::EncodeBC6HBlock(const float texels[16][4], uint8_t block[16]) {
+  // Work in half bits space, BC6H interpolates there (roughly logarithmic)
+  float points[16][3];
+  float mean[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; i++) {
+    float rgbx[4] = { texels[i][0], texels[i][1], texels[i][2], 0.0f };
+    uint16_t h[4];
+    FloatToHalf(rgbx, h, 4);
+    for (int c = 0; c < 3; c++) {
+      // Unsigned format: negative and NaN go to 0, inf to max
+      uint16_t v = (h[c] & 0x8000) || (h[c] & 0x7fff) > 0x7c00 ? 0 : std::min<uint16_t>(h[c], 0x7bff);
+      points[i][c] = (float)v;
+      mean[c] += points[i][c] / 16.0f;
+    }
+  }
+
+  // Principal axis by power iteration on covariance
+  float cov[6] = { 0, 0, 0, 0, 0, 0 };
+  for (int i = 0; i < 16; i++) {
+    float d[3] = { points[i][0] - mean[0], points[i][1] - mean[1], points[i][2] - mean[2] };
+    cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+    cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+  }
+
+  float axis[3] = { 1, 1, 1 };
+  for (int iter = 0; iter < 8; iter++) {
+    float a[3] = {
+      cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+      cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+    };
+    float len = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if (len < 1e-6f)
+      break;
+    for (int c = 0; c < 3; c++)
+      axis[c] = a[c] / len;
+  }
+
+  float tMin = 0, tMax = 0;
+  for (int i = 0; i < 16; i++) {
+    float t = (points[i][0] - mean[0]) * axis[0] + (points[i][1] - mean[1]) * axis[1] + (points[i][2] - mean[2]) * axis[2];
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  int q[2][3], unq[2][3];
+  for (int c = 0; c < 3; c++) {
+    q[0][c] = QuantizeUF16(mean[c] + axis[c] * tMin);
+    q[1][c] = QuantizeUF16(mean[c] + axis[c] * tMax);
+  }
+
+  // Pick the nearest palette entry for every texel
+  int indices[16];
+  for (int e = 0; e < 2; e++)
+    for (int c = 0; c < 3; c++)
+      unq[e][c] = UnquantizeUF16(q[e][c]);
+
+  int palette[16][3];
+  for (int k = 0; k < 16; k++)
+    for (int c = 0; c < 3; c++)
+      palette[k][c] = InterpolateUF16(unq[0][c], unq[1][c], k);
+
+  for (int i = 0; i < 16; i++) {
+    float bestError = 1e30f;
+    indices[i] = 0;
+    for (int k = 0; k < 16; k++) {
+      float error = 0;
+      for (int c = 0; c < 3; c++) {
+        float d = points[i][c] - palette[k][c];
+        error += d * d;
+      }
+      if (error < bestError) {
+        bestError = error;
+        indices[i] = k;
+      }
+    }
+  }
+
+  // Anchor texel index has implicit zero high bit
+  if (indices[0] & 8) {
+    for (int c = 0; c < 3; c++)
+      std::swap(q[0][c], q[1][c]);
+    for (int i = 0; i < 16; i++)
+      indices[i] = 15 - indices[i];
+  }
+
+  memset(block, 0, 16);
+  uint32_t pos = 0;
+  WriteBits(block, pos, 0x03, 5); // mode 11
+  for (int e = 0; e < 2; e++)
+    for (int c = 0; c < 3; c++)
+      WriteBits(block, pos, q[e][c], 10);
+
+  WriteBits(block, pos, indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    WriteBits(block, pos, indices[i], 4);
+}
+
+void HDRFormatEncoder::DecodeBC6HBlock(const uint8_t block[16], float texels[16][4]) {
+  uint32_t pos = 0;
+  uint32_t mode = ReadBits(block, pos, 5);
+  if (mode != 0x03) {
+    // Only the mode written by EncodeBC6HBlock is supported
+    for (int i = 0; i < 16; i++)
+      texels[i][0] = texels[i][1] = texels[i][2] = 0.0f, texels[i][3] = 1.0f;
+    return;
+  }
+
+  int unq[2][3];
+  for (int e = 0; e < 2; e++)
+    for (int c = 0; c < 3; c++)
+      unq[e][c] = UnquantizeUF16((int)ReadBits(block, pos, 10));
+
+  for (int i = 0; i < 16; i++) {
+    int index = (int)ReadBits(block, pos, i == 0 ? 3 : 4);
+    for (int c = 0; c < 3; c++)
+      texels[i][c] = HalfToFloat((uint16_t)InterpolateUF16(unq[0][c], unq[1][c], index));
+    texels[i][3] = 1.0f;
+  }
+}
+
+void HDRFormatEncoder::Encode(const HDRImage& src, HDRTextureFormat format, EncodedHDRImage& dst) {
+  dst.format = format;
+  dst.width = src.width;
+  dst.height = src.height;
+  dst.rowPitch = RowPitch(format, src.width);
+  dst.data.assign((size_t)dst.rowPitch * RowsCount(format, src.height), 0);
+
+  switch (format) {
+  case HDRTextureFormat::rgba32f:
+    memcpy(dst.data.data(), src.data.data(), src.data.size() * sizeof(float));
+    break;
+
+  case HDRTextureFormat::rgba16f:
+    FloatToHalf(src.data.data(), reinterpret_cast<uint16_t*>(dst.data.data()), src.data.size());
+    break;
+
+  case HDRTextureFormat::r11g11b10f: {
+    std::vector<uint16_t> halfRow((size_t)src.width * 4);
+    for (uint32_t y = 0; y < src.height; y++) {
+      FloatToHalf(src.Texel(0, y), halfRow.data(), halfRow.size());
+      uint32_t* row = reinterpret_cast<uint32_t*>(&dst.data[(size_t)y * dst.rowPitch]);
+      for (uint32_t x = 0; x < src.width; x++) {
+        const uint16_t* h = &halfRow[x * 4];
+        row[x] = HalfToSmallFloat(h[0], 6) | (HalfToSmallFloat(h[1], 6) << 11) | (HalfToSmallFloat(h[2], 5) << 22);
+      }
+    }
+    break;
+  }
+
+  case HDRTextureFormat::rgb9e5:
+    for (uint32_t y = 0; y < src.height; y++) {
+      uint32_t* row = reinterpret_cast<uint32_t*>(&dst.data[(size_t)y * dst.rowPitch]);
+      for (uint32_t x = 0; x < src.width; x++)
+        row[x] = PackRGB9E5(src.Texel(x, y));
+    }
+    break;
+
+  case HDRTextureFormat::bc6h: {
+    uint32_t blocksX = (src.width + 3) / 4, blocksY = (src.height + 3) / 4;
+    for (uint32_t by = 0; by < blocksY; by++)
+      for (uint32_t bx = 0; bx < blocksX; bx++) {
+        // Blocks of tiny mips are padded by edge texels
+        float texels[16][4];
+        for (uint32_t i = 0; i < 16; i++) {
+          uint32_t x = std::min(bx * 4 + i % 4, src.width - 1);
+          uint32_t y = std::min(by * 4 + i / 4, src.height - 1);
+          memcpy(texels[i], src.Texel(x, y), 4 * sizeof(float));
+        }
+        EncodeBC6HBlock(texels, &dst.data[(size_t)by * dst.rowPitch + bx * 16]);
+      }
+    break;
+  }
+  }
+}
+
+void HDRFormatEncoder::Decode(const EncodedHDRImage& src, HDRImage& dst) {
+  dst.Resize(src.width, src.height);
+
+  for (uint32_t y = 0; y < src.height; y++)
+    for (uint32_t x = 0; x < src.width; x++) {
+      float* out = dst.Texel(x, y);
+      out[3] = 1.0f;
+
+      switch (src.format) {
+      case HDRTextureFormat::rgba32f:
+        memcpy(out, &src.data[(size_t)y * src.rowPitch + x * 16], 4 * sizeof(float));
+        break;
+
+      case HDRTextureFormat::rgba16f: {
+        const uint16_t* h = reinterpret_cast<const uint16_t*>(&src.data[(size_t)y * src.rowPitch + x * 8]);
+        for (int c = 0; c < 4; c++)
+          out[c] = HalfToFloat(h[c]);
+        break;
+      }
+
+      case HDRTextureFormat::r11g11b10f:
+        UnpackR11G11B10(*reinterpret_cast<const uint32_t*>(&src.data[(size_t)y * src.rowPitch + x * 4]), out);
+        break;
+
+      case HDRTextureFormat::rgb9e5:
+        UnpackRGB9E5(*reinterpret_cast<const uint32_t*>(&src.data[(size_t)y * src.rowPitch + x * 4]), out);
+        break;
+
+      case HDRTextureFormat::bc6h:
+        // Decoded block by block below
+        break;
+      }
+    }
+
+  if (src.format != HDRTextureFormat::bc6h)
+    return;
+
+  uint32_t blocksX = (src.width + 3) / 4, blocksY = (src.height + 3) / 4;
+  for (uint32_t by = 0; by < blocksY; by++)
+    for (uint32_t bx = 0; bx < blocksX; bx++) {
+      float texels[16][4];
+      DecodeBC6HBlock(&src.data[(size_t)by * src.rowPitch + bx * 16], texels);
+      for (uint32_t i = 0; i < 16; i++) {
+        uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+        if (x < src.width && y < src.height)
+          memcpy(dst.Texel(x, y), texels[i], 4 * sizeof(float));
+      }
+    }
+}
+
+HDRFormatErrorReport HDRFormatEncoder::Compare(const HDRImage& reference, const HDRImage& test) {
+  HDRFormatErrorReport report;
+  if (reference.width != test.width || reference.height != test.height)
+    return report;
+
+  double sumSqr = 0, sumLogSqr = 0;
+  size_t count = (size_t)reference.width * reference.height;
+  for (size_t i = 0; i < count; i++)
+    for (int c = 0; c < 3; c++) {
+      double a = reference.data[i * 4 + c], b = test.data[i * 4 + c];
+      double diff = fabs(a - b);
+      sumSqr += diff * diff;
+      report.maxAbsError = std::max(report.maxAbsError, diff);
+      report.maxRelError = std::max(report.maxRelError, diff / std::max(fabs(a), 1e-3));
+
+      double logDiff = log2(1.0 + std::max(a, 0.0)) - log2(1.0 + std::max(b, 0.0));
+      sumLogSqr += logDiff * logDiff;
+    }
+
+  report.texels = count;
+  if (count > 0) {
+    report.rmse = sqrt(sumSqr / (count * 3));
+    report.logRmse = sqrt(sumLogSqr / (count * 3));
+  }
+  return report;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CubeMapConverter.h"
+
+#ifdef _WIN32
+#include <dxgiformat.h>
+#endif
+
+// Texel formats HDR textures may be stored in
+enum class HDRTextureFormat : int
+{
+  rgba32f = 0,    // 16 bytes per texel, reference
+  rgba16f = 1,    // 8 bytes per texel
+  r11g11b10f = 2, // 4 bytes per texel, no sign, 6/6/5 bits mantissa
+  rgb9e5 = 3,     // 4 bytes per texel, shared exponent (not renderable)
+  bc6h = 4,       // 1 byte per texel, BC6H unsigned (not renderable)
+};
+
+// Image in some HDRTextureFormat, rows of texels (or of 4x4 blocks for BC6H)
+struct EncodedHDRImage {
+  HDRTextureFormat format = HDRTextureFormat::rgba32f;
+  uint32_t width = 0, height = 0;
+  uint32_t rowPitch = 0; // bytes between rows of texels / blocks
+  std::vector<uint8_t> data;
+};
+
+// Difference between reference and encoded image (RGB only)
+struct HDRFormatErrorReport {
+  double rmse = 0;          // root mean square of absolute error
+  double maxAbsError = 0;
+  double maxRelError = 0;   // |a - b| / max(|a|, 1e-3)
+  double logRmse = 0;       // rmse of log2(1 + value), closer to perceived error
+  size_t texels = 0;
+
+  // Merge report of other image in (e.g. of another face)
+  void Accumulate(const HDRFormatErrorReport& other);
+};
+
+// CPU encoders/decoders of compact HDR formats
+class HDRFormatEncoder {
+public:
+  static uint32_t BytesPerTexel(HDRTextureFormat format); // 0 for block compressed
+  static uint32_t RowPitch(HDRTextureFormat format, uint32_t width);
+  static uint32_t RowsCount(HDRTextureFormat format, uint32_t height);
+  static bool IsRenderable(HDRTextureFormat format);
+  static const char* GetName(HDRTextureFormat format);
+
+  static void Encode(const HDRImage& src, HDRTextureFormat format, EncodedHDRImage& dst);
+  static void Decode(const EncodedHDRImage& src, HDRImage& dst);
+
+  static HDRFormatErrorReport Compare(const HDRImage& reference, const HDRImage& test);
+
+  // Round to nearest even, finite values beyond half range saturate to +-65504.
+  // SSE2 for 4 values at once if available
+  static void FloatToHalf(const float* src, uint16_t* dst, size_t count);
+  static float HalfToFloat(uint16_t h);
+
+  static uint32_t PackR11G11B10(const float rgb[3]);
+  static void UnpackR11G11B10(uint32_t packed, float rgb[3]);
+  static uint32_t PackRGB9E5(const float rgb[3]);
+  static void UnpackRGB9E5(uint32_t packed, float rgb[3]);
+
+  // One 4x4 block, texels are RGBA floats in row order
+  static void EncodeBC6HBlock(const float texels[16][4], uint8_t block[16]);
+  static void DecodeBC6HBlock(const uint8_t block[16], float texels[16][4]);
+};
+
+#ifdef _WIN32
+inline DXGI_FORMAT ToDXGIFormat(HDRTextureFormat format) {
+  switch (format) {
+  case HDRTextureFormat::rgba16f: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+  case HDRTextureFormat::r11g11b10f: return DXGI_FORMAT_R11G11B10_FLOAT;
+  case HDRTextureFormat::rgb9e5: return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
+  case HDRTextureFormat::bc6h: return DXGI_FORMAT_BC6H_UF16;
+  default: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+  }
+}
+#endif
@@ -0,0 +1,29 @@
+// Log2 luminance histogram shared by LumHistogram_CS and LumHistogramAverage_CS,
+// CPU reference is LuminanceHistogram.cpp
+#define HISTOGRAM_BINS 256
+#define HISTOGRAM_WEIGHT_SCALE 256.0f
+
+static const float BlackLum = 1e-5f;
+static const float3 ChannelsWeight = float3(0.2126f, 0.7151f, 0.0722f);
+
+cbuffer HistogramBuffer : register(b0)
+{
+	float4 binsParams;  // x - min log2 luminance, y - bins per log2 unit, z - center weight
+	float4 percentiles; // x - low, y - high
+	uint4 inputSize;    // x, y - size of HDR texture
+};
+
+// Bin 0 takes black pixels, others split [min, max] log2 range
+uint LuminanceBin(float lum)
+{
+	if (!(lum >= BlackLum))
+		return 0;
+
+	float t = clamp((log2(lum) - binsParams.x) * binsParams.y, 0.0f, HISTOGRAM_BINS - 2);
+	return 1 + (uint)t;
+}
+
+float BinLog2(uint bin)
+{
+	return binsParams.x + (bin - 0.5f) / binsParams.y;
+}
@@ -0,0 +1,80 @@
+#include "IBLBakeQuality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+IBLSamplingQuality& IBLBakeQuality::Get(IBLMapKind kind) {
+  return kind == IBLMapKind::irradiance ? irradiance : (kind == IBLMapKind::prefiltered ? prefiltered : brdf);
+}
+
+const IBLSamplingQuality& IBLBakeQuality::Get(IBLMapKind kind) const {
+  return kind == IBLMapKind::irradiance ? irradiance : (kind == IBLMapKind::prefiltered ? prefiltered : brdf);
+}
+
+IBLMapQualityReport& IBLBakeQualityReport::Get(IBLMapKind kind) {
+  return kind == IBLMapKind::irradiance ? irradiance : (kind == IBLMapKind::prefiltered ? prefiltered : brdf);
+}
+
+const IBLMapQualityReport& IBLBakeQualityReport::Get(IBLMapKind kind) const {
+  return kind == IBLMapKind::irradiance ? irradiance : (kind == IBLMapKind::prefiltered ? prefiltered : brdf);
+}
+
+void RunningVariance::Add(double x, double weight) {
+  count++;
+  if (weight <= 0)
+    return;
+
+  sumWeights += weight;
+  sumSquaredWeights += weight * weight;
+  double delta = x - mean;
+  mean += delta * weight / sumWeights;
+  m2 += weight * delta * (x - mean);
+}
+
+double RunningVariance::Variance() const {
+  return sumWeights > 0 ? std::max(m2 / sumWeights, 0.0) : 0.0;
+}
+
+double RunningVariance::EffectiveCount() const {
+  return sumSquaredWeights > 0 ? sumWeights * sumWeights / sumSquaredWeights : 0.0;
+}
+
+double RunningVariance::RelativeError() const {
+  double n = EffectiveCount();
+  if (n <= 0)
+    return 0.0;
+  return std::sqrt(Variance() / n) / std::max(mean, 1e-4);
+}
+
+bool RunningVariance::IsConverged(const IBLSamplingQuality& quality) const {
+  return quality.targetError > 0 && count >= quality.minSamples && RelativeError() <= quality.targetError;
+}
+
+IBLMapQualityReport MakeQualityReport(const IBLSamplingStats& stats, uint32_t samplesCap, double gpuMs) {
+  IBLMapQualityReport report;
+  report.valid = stats.texels > 0;
+  report.texels = stats.texels;
+  report.samplesCap = samplesCap;
+  report.gpuMs = gpuMs;
+  if (!report.valid)
+    return report;
+
+  float maxError;
+  memcpy(&maxError, &stats.maxErrorBits, sizeof(maxError));
+  report.meanSamples = (double)stats.samples / stats.texels;
+  report.meanError = (double)stats.errorSum / IBLSamplingStats::errorScale / stats.texels;
+  report.maxError = maxError;
+  return report;
+}
+
+uint32_t FitSamplesToBudget(const IBLSamplingQuality& quality, uint32_t usedSamplesCap, double measuredMs) {
+  uint32_t minCap = std::max(quality.minSamples, 1u);
+  uint32_t maxCap = std::max(quality.maxSamples, minCap);
+  if (quality.timeBudgetMs <= 0 || measuredMs <= 0 || usedSamplesCap == 0)
+    return maxCap;
+
+  // Cost is close to linear in the cap: converged texels stop early anyway
+  double cap = usedSamplesCap * quality.timeBudgetMs / measuredMs;
+  return (uint32_t)std::min(std::max(cap, (double)minCap), (double)maxCap);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+
+enum class IBLMapKind : int
+{
+  irradiance = 0,
+  prefiltered = 1,
+  brdf = 2,
+};
+
+// Adaptive sampling of one IBL map: every texel takes batches of samples until relative
+// standard error of its luminance drops below targetError, but no more than maxSamples
+struct IBLSamplingQuality {
+  float targetError = 0.02f;  // 0 - always maxSamples (fixed count like before)
+  uint32_t minSamples = 32;
+  uint32_t maxSamples = 1024;
+  uint32_t batchSize = 32;    // error is checked after every batch
+  float timeBudgetMs = 0.0f;  // > 0 - sample cap of next bakes is fitted to measured GPU time of the map
+};
+
+struct IBLBakeQuality {
+  IBLSamplingQuality irradiance = { 0.01f, 32, 200 * 50, 32, 0.0f };
+  IBLSamplingQuality prefiltered = { 0.02f, 32, 1024, 32, 0.0f };
+  IBLSamplingQuality brdf = { 0.005f, 64, 1024, 64, 0.0f };
+
+  IBLSamplingQuality& Get(IBLMapKind kind);
+  const IBLSamplingQuality& Get(IBLMapKind kind) const;
+};
+
+// GPU counters of one map written by IBL shaders (see IBLSampling.h)
+struct IBLSamplingStats {
+  static const uint32_t errorScale = 10000; // errorSum fixed point scale, errors are clamped to 1
+
+  uint32_t samples = 0;
+  uint32_t texels = 0;
+  uint32_t errorSum = 0;
+  uint32_t maxErrorBits = 0; // float bits of max error (positive floats compare as uints)
+};
+
+struct IBLMapQualityReport {
+  bool valid = false;
+  uint32_t texels = 0;
+  uint32_t samplesCap = 0;  // maxSamples used by the bake
+  double meanSamples = 0;
+  double meanError = 0;     // relative standard error of texels
+  double maxError = 0;
+  double gpuMs = 0;         // 0 - timing is not available
+};
+
+struct IBLBakeQualityReport {
+  IBLMapQualityReport irradiance;
+  IBLMapQualityReport prefiltered;
+  IBLMapQualityReport brdf;
+
+  IBLMapQualityReport& Get(IBLMapKind kind);
+  const IBLMapQualityReport& Get(IBLMapKind kind) const;
+};
+
+// Weighted running mean and variance (West's incremental algorithm), CPU reference of the estimator in IBLSampling.h
+class RunningVariance {
+public:
+  void Add(double x, double weight = 1.0);
+
+  uint32_t Count() const { return count; }
+  double Mean() const { return mean; }
+  double Variance() const;
+  double EffectiveCount() const;
+
+  // Standard error of mean relative to mean
+  double RelativeError() const;
+
+  bool IsConverged(const IBLSamplingQuality& quality) const;
+
+private:
+  uint32_t count = 0;
+  double sumWeights = 0, sumSquaredWeights = 0;
+  double mean = 0, m2 = 0;
+};
+
+IBLMapQualityReport MakeQualityReport(const IBLSamplingStats& stats, uint32_t samplesCap, double gpuMs);
+
+// Sample cap for next bake so the map takes about quality.timeBudgetMs, within [minSamples, maxSamples]
+uint32_t FitSamplesToBudget(const IBLSamplingQuality& quality, uint32_t usedSamplesCap, double measuredMs);
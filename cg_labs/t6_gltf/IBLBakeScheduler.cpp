@@ -0,0 +1,99 @@
+#include "IBLBakeScheduler.h"
+
+void IBLBakeScheduler::AddFaceTiles(IBLBakeStage stage, uint32_t face, uint32_t mip, uint32_t size, uint32_t tileSize, double samplesPerTexel) {
+  for (uint32_t y = 0; y < size; y += tileSize)
+    for (uint32_t x = 0; x < size; x += tileSize) {
+      IBLBakeItem item;
+      item.stage = stage;
+      item.face = face;
+      item.mip = mip;
+      item.x = x;
+      item.y = y;
+      item.width = (x + tileSize > size) ? size - x : tileSize;
+      item.height = (y + tileSize > size) ? size - y : tileSize;
+      item.workUnits = (double)item.width * item.height * samplesPerTexel;
+
+      items.push_back(item);
+      totalUnits += item.workUnits;
+    }
+}
+
+void IBLBakeScheduler::Begin(const IBLBakeLayout& layout) {
+  items.clear();
+  nextItem = 0;
+  totalUnits = doneUnits = 0;
+  failed = false;
+
+  uint32_t tileSize = layout.tileSize > 0 ? layout.tileSize : 1;
+
+  for (uint32_t face = 0; face < 6; face++)
+    AddFaceTiles(IBLBakeStage::irradiance, face, 0, layout.irradienceTextureSize, tileSize, layout.irradienceSamples);
+
+  for (uint32_t face = 0; face < 6; face++) {
+    uint32_t size = layout.prefilTextureSize;
+    for (uint32_t mip = 0; mip < layout.prefilMipMapLevels && size > 0; mip++) {
+      AddFaceTiles(IBLBakeStage::prefiltered, face, mip, size, tileSize, layout.prefilSamples);
+      size /= 2;
+    }
+  }
+
+  active = !items.empty();
+}
+
+void IBLBakeScheduler::Cancel() {
+  items.clear();
+  nextItem = 0;
+  totalUnits = doneUnits = 0;
+  active = false;
+}
+
+bool IBLBakeScheduler::Step(IBLBakeExecutor& executor, double budgetMs) {
+  lastStepPredictedMs = 0;
+  lastStepWorkUnits = 0;
+  lastStepItems = 0;
+
+  if (!active)
+    return false;
+
+  while (nextItem < items.size()) {
+    const IBLBakeItem& item = items[nextItem];
+    double predictedMs = item.workUnits * msPerUnit;
+
+    // Always make progress, even if single item doesn't fit into the budget
+    if (lastStepItems > 0 && lastStepPredictedMs + predictedMs > budgetMs)
+      break;
+
+    if (!executor.ExecuteItem(item)) {
+      failed = true;
+      Cancel();
+      return false;
+    }
+
+    lastStepPredictedMs += predictedMs;
+    lastStepWorkUnits += item.workUnits;
+    lastStepItems++;
+    doneUnits += item.workUnits;
+    nextItem++;
+  }
+
+  if (nextItem < items.size())
+    return false;
+
+  executor.FinishBake();
+  active = false;
+  return true;
+}
+
+void IBLBakeScheduler::ReportMeasuredCost(double workUnits, double ms) {
+  if (workUnits <= 0 || ms <= 0)
+    return;
+
+  double measured = ms / workUnits;
+  msPerUnit += (measured - msPerUnit) * costSmoothing;
+}
+
+float IBLBakeScheduler::GetProgress() const {
+  if (totalUnits <= 0)
+    return active ? 0.0f : 1.0f;
+  return (float)(doneUnits / totalUnits);
+}
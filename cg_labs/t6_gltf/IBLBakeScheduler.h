@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Kinds of work the IBL bake is split into
+enum class IBLBakeStage : int
+{
+  irradiance = 0,
+  prefiltered = 1,
+};
+
+// One slice of the IBL bake: a texel tile of one face of one mip level
+struct IBLBakeItem {
+  IBLBakeStage stage = IBLBakeStage::irradiance;
+  uint32_t face = 0;
+  uint32_t mip = 0;
+  uint32_t x = 0, y = 0;          // tile origin in texels of the mip
+  uint32_t width = 0, height = 0; // tile size in texels
+  double workUnits = 0;           // texels * samples per texel, used for cost prediction
+};
+
+// Sizes of the maps to bake (same meaning as IBLMapsGenerator constructor params)
+struct IBLBakeLayout {
+  uint32_t irradienceTextureSize = 16;
+  uint32_t irradienceSamples = 200 * 50;  // N1 * N2
+  uint32_t prefilTextureSize = 128;
+  uint32_t prefilMipMapLevels = 5;
+  uint32_t prefilSamples = 1024;
+  uint32_t tileSize = 32;
+};
+
+// Executes bake items on some device. IBLMapsGenerator implements it for D3D11,
+// anything else (e.g. a mock which only logs items) may be plugged instead.
+class IBLBakeExecutor {
+public:
+  virtual ~IBLBakeExecutor() = default;
+
+  // Submit the work of one item, return false on error
+  virtual bool ExecuteItem(const IBLBakeItem& item) = 0;
+
+  // Called once after the last item was executed
+  virtual void FinishBake() = 0;
+};
+
+// Splits IBL bake into items and runs them in per-frame time slices.
+// Cost of item is predicted as workUnits * msPerUnit, where msPerUnit is calibrated
+// by measured timings (ReportMeasuredCost) which may arrive a few frames late.
+class IBLBakeScheduler {
+public:
+  void Begin(const IBLBakeLayout& layout);
+
+  // Cancel current bake (already executed items are lost)
+  void Cancel();
+
+  // Runs items while predicted cost fits into budget (at least one item per call).
+  // Returns true when the bake has been finished during this call.
+  bool Step(IBLBakeExecutor& executor, double budgetMs);
+
+  // Feed back real cost of some executed work (e.g. from GPU timestamp queries)
+  void ReportMeasuredCost(double workUnits, double ms);
+
+  bool IsActive() const { return active; }
+  bool HasFailed() const { return failed; }
+  float GetProgress() const;
+  size_t GetItemsLeft() const { return items.size() - nextItem; }
+
+  // Accounting of the last Step call
+  double GetLastStepPredictedMs() const { return lastStepPredictedMs; }
+  double GetLastStepWorkUnits() const { return lastStepWorkUnits; }
+  size_t GetLastStepItems() const { return lastStepItems; }
+  double GetMsPerUnit() const { return msPerUnit; }
+
+private:
+  void AddFaceTiles(IBLBakeStage stage, uint32_t face, uint32_t mip, uint32_t size, uint32_t tileSize, double samplesPerTexel);
+
+  std::vector<IBLBakeItem> items;
+  size_t nextItem = 0;
+  double totalUnits = 0, doneUnits = 0;
+  bool active = false;
+  bool failed = false;
+
+  // ~1ns per sample to start with, refined by ReportMeasuredCost
+  double msPerUnit = 1e-6;
+  static constexpr double costSmoothing = 0.25;
+
+  double lastStepPredictedMs = 0;
+  double lastStepWorkUnits = 0;
+  size_t lastStepItems = 0;
+};
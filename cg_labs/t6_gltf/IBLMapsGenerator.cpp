@@ -1,43 +1,7 @@
 #include "IBLMapsGenerator.h"
-#include "D3DInclude.h"
+#include "ShaderLibrary.h"
 #include "renderer.h"
 
-HRESULT IBLMapsGenerator::CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
-{
-  HRESULT hr = S_OK;
-
-  DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-  // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-  // Setting this flag improves the shader debugging experience, but still allows 
-  // the shaders to be optimized and to run exactly the way they will run in 
-  // the release configuration of this program.
-  dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-  // Disable optimizations to further improve shader debugging
-  dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-  D3DInclude includeObj;
-
-  ID3DBlob* pErrorBlob = nullptr;
-  hr = D3DCompileFromFile(szFileName, nullptr, &includeObj, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
-
-  if (FAILED(hr))
-  {
-    if (pErrorBlob)
-    {
-      OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
-      pErrorBlob->Release();
-    }
-    return hr;
-  }
-
-  if (pErrorBlob)
-    pErrorBlob->Release();
-
-  return S_OK;
-}
-
 void IBLMapsGenerator::InitMatricies() {
   
   g_mMatrises[0] = XMMatrixRotationY(XM_PIDIV2);  // +X
@@ -77,6 +41,10 @@ void IBLMapsGenerator::InitMatricies() {
 }
 
 HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* context) {
+  // Maps are rendered and copied from render targets
+  if (!HDRFormatEncoder::IsRenderable(g_mapsFormat))
+    return E_INVALIDARG;
+
   // Compile shaders
   ID3D10Blob* vertexShaderBuffer = nullptr;
   ID3D10Blob* iirPixelShaderBuffer = nullptr;
@@ -87,7 +55,7 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
 
-  HRESULT hr = CompileShaderFromFile(L"IBLMapsGenerator_vs.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
+  HRESULT hr = ShaderLibrary::GetInstance().Compile(L"IBLMapsGenerator_vs.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
   if (FAILED(hr))
     return hr;
 
@@ -95,7 +63,7 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
-  hr = CompileShaderFromFile(L"CMToIRRMGenerator_PS.hlsl", "main", "ps_5_0", &iirPixelShaderBuffer);
+  hr = ShaderLibrary::GetInstance().Compile(L"CMToIRRMGenerator_PS.hlsl", "main", "ps_5_0", &iirPixelShaderBuffer);
   if (FAILED(hr))
     return hr;
 
@@ -103,7 +71,7 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
-  hr = CompileShaderFromFile(L"CMToPrefilMGenerator_PS.hlsl", "main", "ps_5_0", &prefilPixelMShaderBuffer);
+  hr = ShaderLibrary::GetInstance().Compile(L"CMToPrefilMGenerator_PS.hlsl", "main", "ps_5_0", &prefilPixelMShaderBuffer);
   if (FAILED(hr))
     return hr;
 
@@ -111,7 +79,7 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
-  hr = CompileShaderFromFile(L"BRDFGenerator_PS.hlsl", "main", "ps_5_0", &BRDFPixelMShaderBuffer);
+  hr = ShaderLibrary::GetInstance().Compile(L"BRDFGenerator_PS.hlsl", "main", "ps_5_0", &BRDFPixelMShaderBuffer);
   if (FAILED(hr))
     return hr;
 
@@ -171,6 +139,50 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
+  D3D11_BUFFER_DESC descQCB = { 0 };
+  descQCB.Usage = D3D11_USAGE_DEFAULT;
+  descQCB.ByteWidth = sizeof(QualityConstantBuffer);
+  descQCB.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  descQCB.CPUAccessFlags = 0;
+  descQCB.MiscFlags = 0;
+  descQCB.StructureByteStride = 0;
+
+  hr = device->CreateBuffer(&descQCB, nullptr, &g_pQualityConstantBuffer);
+  if (FAILED(hr))
+    return hr;
+
+  // Sampling counters of irradience, prefiltered and BRDF maps written by shaders
+  D3D11_BUFFER_DESC descStats = { 0 };
+  descStats.Usage = D3D11_USAGE_DEFAULT;
+  descStats.ByteWidth = sizeof(IBLSamplingStats) * 3;
+  descStats.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+  descStats.CPUAccessFlags = 0;
+  descStats.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+  descStats.StructureByteStride = 0;
+
+  hr = device->CreateBuffer(&descStats, nullptr, &g_pStatsBuffer);
+  if (FAILED(hr))
+    return hr;
+
+  D3D11_UNORDERED_ACCESS_VIEW_DESC descStatsUAV = {};
+  descStatsUAV.Format = DXGI_FORMAT_R32_TYPELESS;
+  descStatsUAV.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+  descStatsUAV.Buffer.FirstElement = 0;
+  descStatsUAV.Buffer.NumElements = descStats.ByteWidth / 4;
+  descStatsUAV.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+
+  hr = device->CreateUnorderedAccessView(g_pStatsBuffer, &descStatsUAV, &g_pStatsUAV);
+  if (FAILED(hr))
+    return hr;
+
+  hr = CreateStatsReadback(device, g_envStats, IBLMapKind::irradiance, 2);
+  if (FAILED(hr))
+    return hr;
+
+  hr = CreateStatsReadback(device, g_brdfStats, IBLMapKind::brdf, 1);
+  if (FAILED(hr))
+    return hr;
+
   // Init sampler
   D3D11_SAMPLER_DESC descSmplr = {};
 
@@ -188,7 +200,7 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
 
   // cleate render target texture for IRR
   D3D11_TEXTURE2D_DESC hdrtd = {};
-  hdrtd.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  hdrtd.Format = ToDXGIFormat(g_mapsFormat);
   hdrtd.Width = g_irradienceTextureSize;
   hdrtd.Height = g_irradienceTextureSize;
   hdrtd.BindFlags = D3D11_BIND_RENDER_TARGET;
@@ -208,27 +220,9 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
-  // Create irradience cube map texture
-  D3D11_TEXTURE2D_DESC desc = {};
-  desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  desc.Width = g_irradienceTextureSize;
-  desc.Height = g_irradienceTextureSize;
-  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-  desc.Usage = D3D11_USAGE_DEFAULT;
-  desc.CPUAccessFlags = 0;
-  desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-  desc.MipLevels = 1;
-  desc.ArraySize = 6;
-  desc.SampleDesc.Count = 1;
-  desc.SampleDesc.Quality = 0;
-
-  hr = device->CreateTexture2D(&desc, nullptr, &g_pIRRMap);
-  if (FAILED(hr))
-    return hr;
-
   // cleate render target texture for prefiltered color
   D3D11_TEXTURE2D_DESC prefilHdrtd = {};
-  prefilHdrtd.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  prefilHdrtd.Format = ToDXGIFormat(g_mapsFormat);
   prefilHdrtd.Width = g_prefilTextureSize;
   prefilHdrtd.Height = g_prefilTextureSize;
   prefilHdrtd.BindFlags = D3D11_BIND_RENDER_TARGET;
@@ -248,21 +242,8 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   if (FAILED(hr))
     return hr;
 
-  // Create prefiled color map
-  D3D11_TEXTURE2D_DESC pcmDesc = {};
-  pcmDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  pcmDesc.Width = g_prefilTextureSize;
-  pcmDesc.Height = g_prefilTextureSize;
-  pcmDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-  pcmDesc.Usage = D3D11_USAGE_DEFAULT;
-  pcmDesc.CPUAccessFlags = 0;
-  pcmDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-  pcmDesc.MipLevels = g_prefilMipMapLevels;
-  pcmDesc.ArraySize = 6;
-  pcmDesc.SampleDesc.Count = 1;
-  pcmDesc.SampleDesc.Quality = 0;
-
-  hr = device->CreateTexture2D(&pcmDesc, nullptr, &g_pPrefilMap);
+  // Create front set of irradience and prefiltered color maps
+  hr = CreateMapsSet(device, g_mapSets[g_frontSet]);
   if (FAILED(hr))
     return hr;
 
@@ -303,9 +284,94 @@ HRESULT IBLMapsGenerator::Init(ID3D11Device* device, ID3D11DeviceContext* contex
   brdfDesc.SampleDesc.Quality = 0;
 
   hr = device->CreateTexture2D(&brdfDesc, nullptr, &g_pBRDFMap);
+  if (FAILED(hr))
+    return hr;
+
+  // Rasterizer state to draw only tile of the face while baking incrementally
+  D3D11_RASTERIZER_DESC descRast = {};
+  descRast.FillMode = D3D11_FILL_SOLID;
+  descRast.CullMode = D3D11_CULL_NONE;
+  descRast.FrontCounterClockwise = false;
+  descRast.DepthClipEnable = true;
+  descRast.ScissorEnable = true;
+
+  hr = device->CreateRasterizerState(&descRast, &g_pScissorRasterizerState);
+  if (FAILED(hr))
+    return hr;
+
+  // Queries to measure GPU cost of incremental bake steps
+  for (UINT i = 0; i < bakeTimingsCount; i++) {
+    D3D11_QUERY_DESC qd = {};
+    qd.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+    hr = device->CreateQuery(&qd, &g_bakeTimings[i].pDisjoint);
+    if (FAILED(hr))
+      return hr;
+
+    qd.Query = D3D11_QUERY_TIMESTAMP;
+    hr = device->CreateQuery(&qd, &g_bakeTimings[i].pStart);
+    if (FAILED(hr))
+      return hr;
+    hr = device->CreateQuery(&qd, &g_bakeTimings[i].pEnd);
+    if (FAILED(hr))
+      return hr;
+  }
+
   return hr;
 }
 
+HRESULT IBLMapsGenerator::CreateMapsSet(ID3D11Device* device, IBLMapsSet& set) {
+  // Create irradience cube map texture
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Format = ToDXGIFormat(g_mapsFormat);
+  desc.Width = g_irradienceTextureSize;
+  desc.Height = g_irradienceTextureSize;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+  desc.MipLevels = 1;
+  desc.ArraySize = 6;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+
+  HRESULT hr = device->CreateTexture2D(&desc, nullptr, &set.pIRRMap);
+  if (FAILED(hr))
+    return hr;
+
+  hr = device->CreateShaderResourceView(set.pIRRMap, nullptr, &set.pIRRMapSRV);
+  if (FAILED(hr))
+    return hr;
+
+  // Create prefiled color map
+  D3D11_TEXTURE2D_DESC pcmDesc = {};
+  pcmDesc.Format = ToDXGIFormat(g_mapsFormat);
+  pcmDesc.Width = g_prefilTextureSize;
+  pcmDesc.Height = g_prefilTextureSize;
+  pcmDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  pcmDesc.Usage = D3D11_USAGE_DEFAULT;
+  pcmDesc.CPUAccessFlags = 0;
+  pcmDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+  pcmDesc.MipLevels = g_prefilMipMapLevels;
+  pcmDesc.ArraySize = 6;
+  pcmDesc.SampleDesc.Count = 1;
+  pcmDesc.SampleDesc.Quality = 0;
+
+  hr = device->CreateTexture2D(&pcmDesc, nullptr, &set.pPrefilMap);
+  if (FAILED(hr))
+    return hr;
+
+  hr = device->CreateShaderResourceView(set.pPrefilMap, nullptr, &set.pPrefilMapSRV);
+  return hr;
+}
+
+void IBLMapsGenerator::ReleaseMapsSet(IBLMapsSet& set) {
+  if (set.pPrefilMapSRV) set.pPrefilMapSRV->Release();
+  if (set.pPrefilMap) set.pPrefilMap->Release();
+  if (set.pIRRMapSRV) set.pIRRMapSRV->Release();
+  if (set.pIRRMap) set.pIRRMap->Release();
+  set = IBLMapsSet();
+}
+
 void IBLMapsGenerator::SetViewPort(ID3D11DeviceContext* context, UINT width, UINT hight)
 {
   D3D11_VIEWPORT viewport = {};
@@ -326,69 +392,249 @@ void IBLMapsGenerator::SetViewPort(ID3D11DeviceContext* context, UINT width, UIN
   context->RSSetScissorRects(1, &rect);
 }
 
+UINT IBLMapsGenerator::GetSourceFaceSize(ID3D11ShaderResourceView* cmSRV) {
+  ID3D11Resource* resource = nullptr;
+  cmSRV->GetResource(&resource);
+
+  D3D11_TEXTURE2D_DESC desc = {};
+  static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+  resource->Release();
+
+  return desc.Width;
+}
+
 HRESULT IBLMapsGenerator::GenerateMaps(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV) {
+  auto hr = GenerateEnvironmentMaps(device, context, cmSRV);
+  if (FAILED(hr))
+    return hr;
+
+  beginEvent(L"counting BRDF");
+  hr = GenerateBRDF(device, context);
+  endEvent();
+  return hr;
+}
+
+HRESULT IBLMapsGenerator::GenerateEnvironmentMaps(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV) {
+  g_sourceFaceSize = GetSourceFaceSize(cmSRV);
+  BeginStats(context, g_envStats, true);
+
   beginEvent(L"irradince cm generating");
   auto hr = GenerateIrranienceMap(device, context, cmSRV);
   endEvent();
   if (FAILED(hr))
     return hr;
+  StampStats(context, g_envStats);
 
   beginEvent(L"prefiltered color generating");
   hr = GeneratePrefilteredMap(device, context, cmSRV);
   endEvent();
   if (FAILED(hr))
     return hr;
+  StampStats(context, g_envStats);
 
-  beginEvent(L"counting BRDF");
-  hr = GenerateBRDF(device, context);
-  endEvent();
-  return hr;
+  EndStats(context, g_envStats);
+  return S_OK;
+}
+
+void IBLMapsGenerator::SetBakeQuality(const IBLBakeQuality& quality) {
+  g_quality = quality;
+  for (int kind = 0; kind < 3; kind++)
+    g_samplesCaps[kind] = FitSamplesToBudget(g_quality.Get((IBLMapKind)kind), 0, 0.0);
+}
+
+void IBLMapsGenerator::SetSamplingQuality(ID3D11DeviceContext* context, IBLMapKind kind) {
+  const IBLSamplingQuality& quality = g_quality.Get(kind);
+  QualityConstantBuffer qcb = {};
+  qcb.quality = XMFLOAT4(quality.targetError, (float)quality.minSamples, (float)g_samplesCaps[(int)kind], (float)max(quality.batchSize, 1u));
+  qcb.statsParams = XMUINT4((UINT)kind, 0, 0, 0);
+
+  context->UpdateSubresource(g_pQualityConstantBuffer, 0, nullptr, &qcb, 0, 0);
+  context->PSSetConstantBuffers(1, 1, &g_pQualityConstantBuffer);
+}
+
+HRESULT IBLMapsGenerator::CreateStatsReadback(ID3D11Device* device, StatsReadback& readback, IBLMapKind firstMap, UINT mapsCount) {
+  readback.firstMap = (UINT)firstMap;
+  readback.mapsCount = mapsCount;
+  readback.stampsCount = mapsCount + 1;
+
+  D3D11_BUFFER_DESC desc = { 0 };
+  desc.Usage = D3D11_USAGE_STAGING;
+  desc.ByteWidth = sizeof(IBLSamplingStats) * 3;
+  desc.BindFlags = 0;
+  desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+  HRESULT hr = device->CreateBuffer(&desc, nullptr, &readback.pStaging);
+  if (FAILED(hr))
+    return hr;
+
+  D3D11_QUERY_DESC qd = {};
+  qd.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+  hr = device->CreateQuery(&qd, &readback.pDisjoint);
+  if (FAILED(hr))
+    return hr;
+
+  qd.Query = D3D11_QUERY_TIMESTAMP;
+  for (UINT i = 0; i < readback.stampsCount; i++) {
+    hr = device->CreateQuery(&qd, &readback.pStamps[i]);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  return S_OK;
+}
+
+void IBLMapsGenerator::ReleaseStatsReadback(StatsReadback& readback) {
+  if (readback.pStaging) readback.pStaging->Release();
+  if (readback.pDisjoint) readback.pDisjoint->Release();
+  for (auto& stamp : readback.pStamps)
+    if (stamp) stamp->Release();
+  readback = StatsReadback();
+}
+
+void IBLMapsGenerator::BeginStats(ID3D11DeviceContext* context, StatsReadback& readback, bool timed) {
+  // Previous results which were not read yet are dropped
+  UINT zeros[4] = { 0, 0, 0, 0 };
+  context->ClearUnorderedAccessViewUint(g_pStatsUAV, zeros);
+
+  for (UINT i = 0; i < readback.mapsCount; i++)
+    readback.samplesCaps[i] = g_samplesCaps[readback.firstMap + i];
+  readback.timed = timed;
+  readback.pending = false;
+  readback.stampsCount = 0;
+  if (timed) {
+    context->Begin(readback.pDisjoint);
+    StampStats(context, readback);
+  }
+}
+
+void IBLMapsGenerator::StampStats(ID3D11DeviceContext* context, StatsReadback& readback) {
+  if (readback.timed && readback.stampsCount < readback.mapsCount + 1)
+    context->End(readback.pStamps[readback.stampsCount++]);
+}
+
+void IBLMapsGenerator::EndStats(ID3D11DeviceContext* context, StatsReadback& readback) {
+  if (readback.timed)
+    context->End(readback.pDisjoint);
+  context->CopyResource(readback.pStaging, g_pStatsBuffer);
+  readback.pending = true;
+}
+
+bool IBLMapsGenerator::ReadStats(ID3D11DeviceContext* context, StatsReadback& readback) {
+  if (!readback.pending)
+    return false;
+
+  // GPU time per map: from timestamps or from measured incremental bake steps (all of them have to arrive)
+  double mapMs[3] = { 0, 0, 0 };
+  if (readback.timed) {
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+    if (context->GetData(readback.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+      return false;
+
+    UINT64 stamps[3] = {};
+    for (UINT i = 0; i < readback.stampsCount; i++)
+      if (context->GetData(readback.pStamps[i], &stamps[i], sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        return false;
+
+    if (!disjoint.Disjoint && disjoint.Frequency > 0)
+      for (UINT i = 0; i + 1 < readback.stampsCount; i++)
+        mapMs[i] = (double)(stamps[i + 1] - stamps[i]) * 1000.0 / disjoint.Frequency;
+  }
+  else {
+    for (UINT i = 0; i < bakeTimingsCount; i++)
+      if (g_bakeTimings[i].pending)
+        return false;
+
+    for (UINT i = 0; i < readback.mapsCount && readback.firstMap + i < 2; i++) {
+      const StageTiming& stage = g_bakeStageTimings[readback.firstMap + i];
+      mapMs[i] = stage.measuredUnits > 0 ? stage.ms * stage.totalUnits / stage.measuredUnits : 0.0;
+    }
+  }
+
+  D3D11_MAPPED_SUBRESOURCE mapped = {};
+  if (context->Map(readback.pStaging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) != S_OK)
+    return false;
+
+  const IBLSamplingStats* stats = reinterpret_cast<const IBLSamplingStats*>(mapped.pData);
+  for (UINT i = 0; i < readback.mapsCount; i++) {
+    IBLMapKind kind = (IBLMapKind)(readback.firstMap + i);
+    IBLMapQualityReport report = MakeQualityReport(stats[readback.firstMap + i], readback.samplesCaps[i], mapMs[i]);
+    g_qualityReport.Get(kind) = report;
+
+    // Sample cap of next bakes follows the time budget
+    if (g_quality.Get(kind).timeBudgetMs > 0 && report.gpuMs > 0)
+      g_samplesCaps[(int)kind] = FitSamplesToBudget(g_quality.Get(kind), report.samplesCap, report.gpuMs);
+  }
+  context->Unmap(readback.pStaging, 0);
+
+  readback.pending = false;
+  return true;
+}
+
+void IBLMapsGenerator::PollQualityReport(ID3D11DeviceContext* context) {
+  PollBakeTimings(context);
+  ReadStats(context, g_envStats);
+  ReadStats(context, g_brdfStats);
 }
 
 HRESULT IBLMapsGenerator::GenerateIrranienceMap(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV) {
   context->ClearState();
-  context->OMSetRenderTargets(1, &g_pIRRTextureRTV, nullptr);
   Renderer::GetInstance().EnableDepth(false);
 
+  float clearColor[4] = { 0.9f, 0.3f, 0.1f, 1.0f };
+  D3D11_RECT face = { 0, 0, (LONG)g_irradienceTextureSize, (LONG)g_irradienceTextureSize };
+
+  for (UINT i = 0; i < 6; ++i)
+  {
+    context->ClearRenderTargetView(g_pIRRTextureRTV, clearColor);
+    SetTilePipeline(context, g_pIRRTextureRTV, g_pIrrCMPixelShader, cmSRV, g_irradienceTextureSize, face);
+    DrawIrradienceTile(context, g_mapSets[g_frontSet], i, face);
+  }
+
+  Renderer::GetInstance().EnableDepth(true);
+  return S_OK;
+}
+
+void IBLMapsGenerator::SetTilePipeline(ID3D11DeviceContext* context, ID3D11RenderTargetView* rtv, ID3D11PixelShader* ps, ID3D11ShaderResourceView* srv, UINT size, const D3D11_RECT& tile) {
+  context->OMSetRenderTargetsAndUnorderedAccessViews(1, &rtv, nullptr, 1, 1, &g_pStatsUAV, nullptr);
+
   // set view port & scissors rect
-  SetViewPort(context, g_irradienceTextureSize, g_irradienceTextureSize);
+  SetViewPort(context, size, size);
+  context->RSSetScissorRects(1, &tile);
+  context->RSSetState(g_pScissorRasterizerState);
 
   context->IASetInputLayout(nullptr);
   context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
   context->VSSetShader(g_pVertexShader, nullptr, 0);
-  context->PSSetShader(g_pIrrCMPixelShader, nullptr, 0);
-  context->PSSetShaderResources(0, 1, &cmSRV);
+  context->PSSetShader(ps, nullptr, 0);
+  context->PSSetShaderResources(0, 1, &srv);
   context->PSSetSamplers(0, 1, &g_pSamplerState);
+}
 
-  float clearColor[4] = { 0.9f, 0.3f, 0.1f, 1.0f };
+void IBLMapsGenerator::DrawIrradienceTile(ID3D11DeviceContext* context, IBLMapsSet& set, UINT face, const D3D11_RECT& tile) {
   ConstantBuffer cb = {};
   IRRConstantBuffer icb = {};
   icb.param.x = N1;
   icb.param.y = N2;
+  icb.param.z = (INT)g_sourceFaceSize;
 
-  for (UINT i = 0; i < 6; ++i)
-  {
-    context->ClearRenderTargetView(g_pIRRTextureRTV, clearColor);
-    XMStoreFloat4x4(&cb.projectionMatrix, XMMatrixTranspose(g_mMatrises[i]));
-    XMStoreFloat4x4(&cb.viewProjectionMatrix, XMMatrixTranspose(mViews[i] * mProjection));
-
-    context->UpdateSubresource(g_pIRRConstantBuffer, 0, nullptr, &icb, 0, 0);
-    context->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb, 0, 0);
-    context->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-    context->PSSetConstantBuffers(0, 1, &g_pIRRConstantBuffer);
-    context->Draw(4, 0);
-    context->CopySubresourceRegion(g_pIRRMap, i, 0, 0, 0, g_pIRRTexture, 0, nullptr);
-  }
+  XMStoreFloat4x4(&cb.projectionMatrix, XMMatrixTranspose(g_mMatrises[face]));
+  XMStoreFloat4x4(&cb.viewProjectionMatrix, XMMatrixTranspose(mViews[face] * mProjection));
 
-  // Create subresource
-  HRESULT hr = device->CreateShaderResourceView(g_pIRRMap, nullptr, &g_pIRRMapSRV);
-  Renderer::GetInstance().EnableDepth(true);
-  return hr;
+  context->UpdateSubresource(g_pIRRConstantBuffer, 0, nullptr, &icb, 0, 0);
+  context->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb, 0, 0);
+  context->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+  context->PSSetConstantBuffers(0, 1, &g_pIRRConstantBuffer);
+  SetSamplingQuality(context, IBLMapKind::irradiance);
+  context->Draw(4, 0);
+
+  D3D11_BOX box = { (UINT)tile.left, (UINT)tile.top, 0, (UINT)tile.right, (UINT)tile.bottom, 1 };
+  context->CopySubresourceRegion(set.pIRRMap, face, box.left, box.top, 0, g_pIRRTexture, 0, &box);
 }
 
 HRESULT IBLMapsGenerator::GenerateBRDF(ID3D11Device* device, ID3D11DeviceContext* context) {
   context->ClearState();
-  context->OMSetRenderTargets(1, &g_pBRDFTextureRTV, nullptr);
+  BeginStats(context, g_brdfStats, true);
+  context->OMSetRenderTargetsAndUnorderedAccessViews(1, &g_pBRDFTextureRTV, nullptr, 1, 1, &g_pStatsUAV, nullptr);
   Renderer::GetInstance().EnableDepth(false);
 
   // set view port & scissors rect
@@ -408,69 +654,205 @@ HRESULT IBLMapsGenerator::GenerateBRDF(ID3D11Device* device, ID3D11DeviceContext
 
   context->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb, 0, 0);
   context->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+  SetSamplingQuality(context, IBLMapKind::brdf);
   context->Draw(4, 0);
   context->CopySubresourceRegion(g_pBRDFMap, 0, 0, 0, 0, g_pBRDFTexture, 0, nullptr);
+  StampStats(context, g_brdfStats);
+  EndStats(context, g_brdfStats);
   
   // Create subresource
-  HRESULT hr = device->CreateShaderResourceView(g_pBRDFMap, nullptr, &g_pBRDFMapSRV);
+  HRESULT hr = S_OK;
+  if (!g_pBRDFMapSRV)
+    hr = device->CreateShaderResourceView(g_pBRDFMap, nullptr, &g_pBRDFMapSRV);
   Renderer::GetInstance().EnableDepth(true);
   return hr;
 }
 
 HRESULT IBLMapsGenerator::GeneratePrefilteredMap(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV) {
   context->ClearState();
-  context->OMSetRenderTargets(1, &g_pPrefilTextureRTV, nullptr);
   Renderer::GetInstance().EnableDepth(false);
 
-  // set view port & scissors rect
-  SetViewPort(context, g_prefilTextureSize, g_prefilTextureSize);
-
-  context->IASetInputLayout(nullptr);
-  context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-  context->VSSetShader(g_pVertexShader, nullptr, 0);
-  context->PSSetShader(g_pPrefilPixelShader, nullptr, 0);
-  context->PSSetShaderResources(0, 1, &cmSRV);
-  context->PSSetSamplers(0, 1, &g_pSamplerState);
-
   float clearColor[4] = { 0.9f, 0.3f, 0.1f, 1.0f };
-  ConstantBuffer cb = {};
-  PrefilConstantBuffer pcb = {};
-  
-  D3D11_BOX mipMapCube = {};
-  mipMapCube.left = mipMapCube.top = mipMapCube.front = 0;
-  mipMapCube.back = 1;
-  
+
   for (UINT i = 0; i < 6; ++i)
   {
-    XMStoreFloat4x4(&cb.projectionMatrix, XMMatrixTranspose(g_mMatrises[i]));
-    XMStoreFloat4x4(&cb.viewProjectionMatrix, XMMatrixTranspose(mViews[i] * mProjection));
-    context->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb, 0, 0);
-
     UINT currentPrefilTextSize = g_prefilTextureSize;
     for (UINT j = 0; j < g_prefilMipMapLevels; j++) {
+      D3D11_RECT mip = { 0, 0, (LONG)currentPrefilTextSize, (LONG)currentPrefilTextSize };
+
       context->ClearRenderTargetView(g_pPrefilTextureRTV, clearColor);
+      SetTilePipeline(context, g_pPrefilTextureRTV, g_pPrefilPixelShader, cmSRV, currentPrefilTextSize, mip);
+      DrawPrefilteredTile(context, g_mapSets[g_frontSet], i, j, mip);
+
+      currentPrefilTextSize = (UINT)(currentPrefilTextSize / 2);
+    }
+  }
+
+  Renderer::GetInstance().EnableDepth(true);
+  return S_OK;
+}
 
-      pcb.roughness.x = j / (g_prefilMipMapLevels - 1);
-      context->UpdateSubresource(g_pPrefilConstantBuffer, 0, nullptr, &pcb, 0, 0);
-      context->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
-      context->PSSetConstantBuffers(0, 1, &g_pPrefilConstantBuffer);
+void IBLMapsGenerator::DrawPrefilteredTile(ID3D11DeviceContext* context, IBLMapsSet& set, UINT face, UINT mip, const D3D11_RECT& tile) {
+  ConstantBuffer cb = {};
+  PrefilConstantBuffer pcb = {};
 
-      mipMapCube.right = currentPrefilTextSize;
-      mipMapCube.bottom = currentPrefilTextSize;
+  XMStoreFloat4x4(&cb.projectionMatrix, XMMatrixTranspose(g_mMatrises[face]));
+  XMStoreFloat4x4(&cb.viewProjectionMatrix, XMMatrixTranspose(mViews[face] * mProjection));
+  context->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb, 0, 0);
 
+  pcb.roughness.x = g_prefilMipMapLevels > 1 ? (float)mip / (g_prefilMipMapLevels - 1) : 0.0f;
+  pcb.roughness.y = (float)g_sourceFaceSize;
+  context->UpdateSubresource(g_pPrefilConstantBuffer, 0, nullptr, &pcb, 0, 0);
+  context->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+  context->PSSetConstantBuffers(0, 1, &g_pPrefilConstantBuffer);
+  SetSamplingQuality(context, IBLMapKind::prefiltered);
+  context->Draw(4, 0);
 
-      SetViewPort(context, currentPrefilTextSize, currentPrefilTextSize);
-      context->Draw(4, 0);
-      context->CopySubresourceRegion(g_pPrefilMap, D3D11CalcSubresource(j, i, g_prefilMipMapLevels), 0, 0, 0, g_pPrefilTexture, 0, &mipMapCube);
-      
-      currentPrefilTextSize = (UINT)(currentPrefilTextSize / 2);
+  D3D11_BOX box = { (UINT)tile.left, (UINT)tile.top, 0, (UINT)tile.right, (UINT)tile.bottom, 1 };
+  context->CopySubresourceRegion(set.pPrefilMap, D3D11CalcSubresource(mip, face, g_prefilMipMapLevels), box.left, box.top, 0, g_pPrefilTexture, 0, &box);
+}
+
+HRESULT IBLMapsGenerator::BeginIncrementalBake(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV) {
+  CancelIncrementalBake();
+
+  IBLMapsSet& back = g_mapSets[1 - g_frontSet];
+  if (!back.pIRRMap) {
+    HRESULT hr = CreateMapsSet(device, back);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  g_pBakeSourceSRV = cmSRV;
+  g_pBakeSourceSRV->AddRef();
+  g_sourceFaceSize = GetSourceFaceSize(cmSRV);
+
+  IBLBakeLayout layout;
+  layout.irradienceTextureSize = g_irradienceTextureSize;
+  layout.irradienceSamples = g_samplesCaps[(int)IBLMapKind::irradiance];
+  layout.prefilTextureSize = g_prefilTextureSize;
+  layout.prefilMipMapLevels = g_prefilMipMapLevels;
+  layout.prefilSamples = g_samplesCaps[(int)IBLMapKind::prefiltered];
+  scheduler.Begin(layout);
+
+  // Counters are collected over all steps, time comes from measured steps
+  for (auto& stage : g_bakeStageTimings)
+    stage = StageTiming();
+  BeginStats(context, g_envStats, false);
+
+  return S_OK;
+}
+
+void IBLMapsGenerator::CancelIncrementalBake() {
+  scheduler.Cancel();
+  if (g_pBakeSourceSRV) {
+    g_pBakeSourceSRV->Release();
+    g_pBakeSourceSRV = nullptr;
+  }
+}
+
+HRESULT IBLMapsGenerator::StepIncrementalBake(ID3D11Device* device, ID3D11DeviceContext* context, float budgetMs, bool& finished) {
+  finished = false;
+  PollBakeTimings(context);
+
+  if (!scheduler.IsActive())
+    return S_OK;
+
+  beginEvent(L"Incremental IBL bake step");
+
+  // Measure the step on GPU if there is free timing slot
+  BakeTiming& timing = g_bakeTimings[g_nextBakeTiming];
+  bool measure = !timing.pending;
+  if (measure) {
+    context->Begin(timing.pDisjoint);
+    context->End(timing.pStart);
+  }
+
+  for (auto& stage : g_bakeStageTimings)
+    stage.stepUnits = 0;
+
+  g_pBakeContext = context;
+  finished = scheduler.Step(*this, budgetMs);
+  g_pBakeContext = nullptr;
+
+  if (measure) {
+    context->End(timing.pEnd);
+    context->End(timing.pDisjoint);
+    timing.workUnits = scheduler.GetLastStepWorkUnits();
+    for (int stage = 0; stage < 2; stage++)
+      timing.stageUnits[stage] = g_bakeStageTimings[stage].stepUnits;
+    timing.pending = true;
+    g_nextBakeTiming = (g_nextBakeTiming + 1) % bakeTimingsCount;
+  }
+
+  endEvent();
+
+  return scheduler.HasFailed() ? E_FAIL : S_OK;
+}
+
+void IBLMapsGenerator::PollBakeTimings(ID3D11DeviceContext* context) {
+  for (UINT i = 0; i < bakeTimingsCount; i++) {
+    BakeTiming& timing = g_bakeTimings[i];
+    if (!timing.pending)
+      continue;
+
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+    if (context->GetData(timing.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+      continue;
+
+    UINT64 start = 0, end = 0;
+    if (context->GetData(timing.pStart, &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+        context->GetData(timing.pEnd, &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+      continue;
+
+    if (!disjoint.Disjoint && disjoint.Frequency > 0) {
+      double ms = (double)(end - start) * 1000.0 / disjoint.Frequency;
+      scheduler.ReportMeasuredCost(timing.workUnits, ms);
+
+      // Split step time between stages by their work
+      for (int stage = 0; stage < 2 && timing.workUnits > 0; stage++) {
+        g_bakeStageTimings[stage].ms += ms * timing.stageUnits[stage] / timing.workUnits;
+        g_bakeStageTimings[stage].measuredUnits += timing.stageUnits[stage];
+      }
     }
+    timing.pending = false;
   }
+}
 
-  // Create subresource
-  HRESULT hr = device->CreateShaderResourceView(g_pPrefilMap, nullptr, &g_pPrefilMapSRV);
-  Renderer::GetInstance().EnableDepth(true);
-  return hr;
+bool IBLMapsGenerator::ExecuteItem(const IBLBakeItem& item) {
+  if (!g_pBakeContext || !g_pBakeSourceSRV)
+    return false;
+
+  IBLMapsSet& back = g_mapSets[1 - g_frontSet];
+  D3D11_RECT tile = { (LONG)item.x, (LONG)item.y, (LONG)(item.x + item.width), (LONG)(item.y + item.height) };
+  StageTiming& stageTiming = g_bakeStageTimings[item.stage == IBLBakeStage::irradiance ? 0 : 1];
+  stageTiming.stepUnits += item.workUnits;
+  stageTiming.totalUnits += item.workUnits;
+
+  if (item.stage == IBLBakeStage::irradiance) {
+    SetTilePipeline(g_pBakeContext, g_pIRRTextureRTV, g_pIrrCMPixelShader, g_pBakeSourceSRV, g_irradienceTextureSize, tile);
+    DrawIrradienceTile(g_pBakeContext, back, item.face, tile);
+  }
+  else {
+    SetTilePipeline(g_pBakeContext, g_pPrefilTextureRTV, g_pPrefilPixelShader, g_pBakeSourceSRV, max(g_prefilTextureSize >> item.mip, 1u), tile);
+    DrawPrefilteredTile(g_pBakeContext, back, item.face, item.mip, tile);
+  }
+
+  // Unbind RTV and counters so they can be used by the rest of the frame
+  ID3D11RenderTargetView* nullRTV = nullptr;
+  ID3D11UnorderedAccessView* nullUAV = nullptr;
+  g_pBakeContext->OMSetRenderTargetsAndUnorderedAccessViews(1, &nullRTV, nullptr, 1, 1, &nullUAV, nullptr);
+  return true;
+}
+
+void IBLMapsGenerator::FinishBake() {
+  g_frontSet = 1 - g_frontSet;
+  if (g_pBakeContext)
+    EndStats(g_pBakeContext, g_envStats);
+
+  if (g_pBakeSourceSRV) {
+    g_pBakeSourceSRV->Release();
+    g_pBakeSourceSRV = nullptr;
+  }
 }
 
 void IBLMapsGenerator::Release() {
@@ -480,13 +862,27 @@ void IBLMapsGenerator::Release() {
   if (g_pBRDFTextureRTV) g_pBRDFTextureRTV->Release();
   if (g_pBRDFTexture) g_pBRDFTexture->Release();
 
-  if (g_pPrefilMapSRV) g_pPrefilMapSRV->Release();
-  if (g_pPrefilMap) g_pPrefilMap->Release();
+  CancelIncrementalBake();
+  ReleaseMapsSet(g_mapSets[0]);
+  ReleaseMapsSet(g_mapSets[1]);
+
+  for (UINT i = 0; i < bakeTimingsCount; i++) {
+    if (g_bakeTimings[i].pEnd) g_bakeTimings[i].pEnd->Release();
+    if (g_bakeTimings[i].pStart) g_bakeTimings[i].pStart->Release();
+    if (g_bakeTimings[i].pDisjoint) g_bakeTimings[i].pDisjoint->Release();
+    g_bakeTimings[i] = BakeTiming();
+  }
+  if (g_pScissorRasterizerState) g_pScissorRasterizerState->Release();
+
+  ReleaseStatsReadback(g_envStats);
+  ReleaseStatsReadback(g_brdfStats);
+  if (g_pStatsUAV) g_pStatsUAV->Release();
+  if (g_pStatsBuffer) g_pStatsBuffer->Release();
+  if (g_pQualityConstantBuffer) g_pQualityConstantBuffer->Release();
+
   if (g_pPrefilTextureRTV) g_pPrefilTextureRTV->Release();
   if (g_pPrefilTexture) g_pPrefilTexture->Release();
 
-  if (g_pIRRMapSRV) g_pIRRMapSRV->Release();
-  if (g_pIRRMap) g_pIRRMap->Release();
   if (g_pIRRTextureRTV) g_pIRRTextureRTV->Release();
   if (g_pIRRTexture) g_pIRRTexture->Release();
 
@@ -3,15 +3,20 @@
 #include <d3d11.h>
 #include <DirectXMath.h>
 
+#include "IBLBakeQuality.h"
+#include "IBLBakeScheduler.h"
+#include "HDRFormats.h"
+
 using namespace DirectX;
 
 struct IBLMaps {
 	ID3D11ShaderResourceView* pIRRMapSRV = nullptr;
 	ID3D11ShaderResourceView* pPrefilMapSRV = nullptr;
 	ID3D11ShaderResourceView* pBRDFMapSRV = nullptr;
+	bool octahedral = false; // irradience and prefiltered maps are octahedral 2D textures (see octahedral.h)
 };
 
-class IBLMapsGenerator {
+class IBLMapsGenerator : public IBLBakeExecutor {
 public:
 	IBLMapsGenerator() {
 		N1 = 200;
@@ -20,6 +25,8 @@ public:
 		g_prefilTextureSize = 128;
 		g_BRDFTextureSize = 128;
 		g_prefilMipMapLevels = 5;
+		g_quality.irradiance.maxSamples = N1 * N2;
+		SetBakeQuality(g_quality);
 		InitMatricies();
 	};
 
@@ -30,27 +37,97 @@ public:
 		g_prefilTextureSize = prefilTextureSize;
 		g_BRDFTextureSize = BRDFTextureSize;
 		g_prefilMipMapLevels = prefilMipMapLevels;
+		g_quality.irradiance.maxSamples = N1 * N2;
+		SetBakeQuality(g_quality);
 		InitMatricies();
 	}
 
+	// Format of irradience and prefiltered maps, must be renderable; call before Init
+	void SetMapsFormat(HDRTextureFormat format) { g_mapsFormat = format; }
+
+	// Adaptive sample counts of maps (constructor N1 * N2 is the irradience cap), applied to next bake
+	void SetBakeQuality(const IBLBakeQuality& quality);
+	const IBLBakeQuality& GetBakeQuality() const { return g_quality; }
+
+	// Samples, error and GPU time of last bakes, read back a few frames later without stalls
+	void PollQualityReport(ID3D11DeviceContext* context);
+	const IBLBakeQualityReport& GetQualityReport() const { return g_qualityReport; }
+
 	HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context);
 
 	HRESULT GenerateMaps(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV);
+	// Irradience and prefiltered maps only (BRDF does not depend on environment)
+	HRESULT GenerateEnvironmentMaps(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV);
+
+	// Incremental (time-sliced) regeneration of maps for new environment.
+	// Maps are baked into back set, GetMaps() returns front set until bake is finished.
+	HRESULT BeginIncrementalBake(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV);
+	// Runs bake items for ~budgetMs of GPU time; 'finished' becomes true on the frame front and back sets were swapped
+	HRESULT StepIncrementalBake(ID3D11Device* device, ID3D11DeviceContext* context, float budgetMs, bool& finished);
+	void CancelIncrementalBake();
+
+	bool IsBaking() const { return scheduler.IsActive(); }
+	float GetBakeProgress() const { return scheduler.GetProgress(); }
+	const IBLBakeScheduler& GetScheduler() const { return scheduler; }
 
 	IBLMaps GetMaps() {
 		IBLMaps maps = {};
-		maps.pIRRMapSRV = g_pIRRMapSRV;
-		maps.pPrefilMapSRV = g_pPrefilMapSRV;
+		maps.pIRRMapSRV = g_mapSets[g_frontSet].pIRRMapSRV;
+		maps.pPrefilMapSRV = g_mapSets[g_frontSet].pPrefilMapSRV;
 		maps.pBRDFMapSRV = g_pBRDFMapSRV;
 		return maps;
 	}
 
 	void Release();
 
+	// IBLBakeExecutor
+	bool ExecuteItem(const IBLBakeItem& item) override;
+	void FinishBake() override;
+
 private:
+	// Environment dependent maps; two sets to bake one while other is used for rendering
+	struct IBLMapsSet {
+		ID3D11Texture2D* pIRRMap = nullptr;
+		ID3D11ShaderResourceView* pIRRMapSRV = nullptr;
+		ID3D11Texture2D* pPrefilMap = nullptr;
+		ID3D11ShaderResourceView* pPrefilMapSRV = nullptr;
+	};
+
 	void InitMatricies();
 
-	HRESULT CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
+	HRESULT CreateMapsSet(ID3D11Device* device, IBLMapsSet& set);
+	void ReleaseMapsSet(IBLMapsSet& set);
+
+	// Draw region of one face into the RTV and copy it into the set
+	void DrawIrradienceTile(ID3D11DeviceContext* context, IBLMapsSet& set, UINT face, const D3D11_RECT& tile);
+	void DrawPrefilteredTile(ID3D11DeviceContext* context, IBLMapsSet& set, UINT face, UINT mip, const D3D11_RECT& tile);
+	void SetTilePipeline(ID3D11DeviceContext* context, ID3D11RenderTargetView* rtv, ID3D11PixelShader* ps, ID3D11ShaderResourceView* srv, UINT size, const D3D11_RECT& tile);
+
+	// GPU timing of incremental steps to calibrate the scheduler
+	void PollBakeTimings(ID3D11DeviceContext* context);
+
+	// Sampling counters of maps [firstMap, firstMap + mapsCount) with optional per map timestamps
+	struct StatsReadback {
+		ID3D11Buffer* pStaging = nullptr;
+		ID3D11Query* pDisjoint = nullptr;
+		ID3D11Query* pStamps[3] = {};
+		UINT stampsCount = 0;
+		UINT firstMap = 0;
+		UINT mapsCount = 0;
+		UINT samplesCaps[3] = {};
+		bool timed = false;
+		bool pending = false;
+	};
+
+	HRESULT CreateStatsReadback(ID3D11Device* device, StatsReadback& readback, IBLMapKind firstMap, UINT mapsCount);
+	void ReleaseStatsReadback(StatsReadback& readback);
+	void BeginStats(ID3D11DeviceContext* context, StatsReadback& readback, bool timed);
+	void StampStats(ID3D11DeviceContext* context, StatsReadback& readback);
+	void EndStats(ID3D11DeviceContext* context, StatsReadback& readback);
+	bool ReadStats(ID3D11DeviceContext* context, StatsReadback& readback);
+
+	// Sampling params of the map for IBL shaders (b1)
+	void SetSamplingQuality(ID3D11DeviceContext* context, IBLMapKind kind);
 
 	HRESULT GenerateIrranienceMap(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV);
 	HRESULT GeneratePrefilteredMap(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11ShaderResourceView* cmSRV);
@@ -58,6 +135,9 @@ private:
 
 	void SetViewPort(ID3D11DeviceContext* context, UINT width, UINT hight);
 
+	// Face size of mip 0 of the environment cube map (for mip selection while prefiltering)
+	UINT GetSourceFaceSize(ID3D11ShaderResourceView* cmSRV);
+
 	ID3D11VertexShader* g_pVertexShader = nullptr;
 	ID3D11SamplerState* g_pSamplerState = nullptr;
 
@@ -66,18 +146,12 @@ private:
 	//  - for texture and RTV where to draw sides
 	ID3D11Texture2D* g_pIRRTexture = nullptr;
 	ID3D11RenderTargetView* g_pIRRTextureRTV = nullptr;
-	//  - for cubeMap and its' ShaderResourceView where to draw sides
-	ID3D11Texture2D* g_pIRRMap = nullptr;
-	ID3D11ShaderResourceView* g_pIRRMapSRV = nullptr;
 
 	// Vars for generating prefiltered color
 	ID3D11PixelShader* g_pPrefilPixelShader = nullptr;
 	//  - for texture and RTV where to draw sides
 	ID3D11Texture2D* g_pPrefilTexture = nullptr;
 	ID3D11RenderTargetView* g_pPrefilTextureRTV = nullptr;
-	//  - for maps for diff roughness and its' ShaderResourceView where to draw
-	ID3D11Texture2D* g_pPrefilMap = nullptr;
-	ID3D11ShaderResourceView* g_pPrefilMapSRV = nullptr;
 
 	// Vars for generating preintegrated BRDF color
 	ID3D11PixelShader* g_pBRDFPixelShader = nullptr;
@@ -97,16 +171,62 @@ private:
 
 	struct PrefilConstantBuffer
 	{
-		XMFLOAT4 roughness; // roughness.r - roughness
+		XMFLOAT4 roughness; // roughness.r - roughness, roughness.g - source cube map face size
 	};
 	ID3D11Buffer* g_pPrefilConstantBuffer = nullptr;
 
 	struct IRRConstantBuffer
 	{
-		XMINT4 param; // roughness.r - roughness
+		XMINT4 param; // x, y - N1, N2, z - source cube map face size
 	};
 	ID3D11Buffer* g_pIRRConstantBuffer = nullptr;
 
+	struct QualityConstantBuffer
+	{
+		XMFLOAT4 quality;    // target error, min samples, max samples, batch size
+		XMUINT4 statsParams; // x - map counters index
+	};
+	ID3D11Buffer* g_pQualityConstantBuffer = nullptr;
+
+	// Vars for bake quality
+	IBLBakeQuality g_quality;
+	UINT g_samplesCaps[3] = {}; // max samples of next bake (fitted to time budgets)
+	ID3D11Buffer* g_pStatsBuffer = nullptr;
+	ID3D11UnorderedAccessView* g_pStatsUAV = nullptr;
+	StatsReadback g_envStats;
+	StatsReadback g_brdfStats;
+	// GPU time of incremental bake per stage, extrapolated from measured steps
+	struct StageTiming {
+		double ms = 0;
+		double measuredUnits = 0;
+		double totalUnits = 0;
+		double stepUnits = 0;
+	};
+	StageTiming g_bakeStageTimings[2];
+	IBLBakeQualityReport g_qualityReport;
+
+
+	//  - front/back sets of irradience and prefiltered maps
+	IBLMapsSet g_mapSets[2];
+	UINT g_frontSet = 0;
+
+	// Vars for incremental baking
+	IBLBakeScheduler scheduler;
+	ID3D11ShaderResourceView* g_pBakeSourceSRV = nullptr;
+	ID3D11DeviceContext* g_pBakeContext = nullptr; // valid only inside StepIncrementalBake
+	ID3D11RasterizerState* g_pScissorRasterizerState = nullptr;
+
+	struct BakeTiming {
+		ID3D11Query* pDisjoint = nullptr;
+		ID3D11Query* pStart = nullptr;
+		ID3D11Query* pEnd = nullptr;
+		double workUnits = 0;
+		double stageUnits[2] = { 0, 0 }; // irradiance, prefiltered
+		bool pending = false;
+	};
+	static const UINT bakeTimingsCount = 4;
+	BakeTiming g_bakeTimings[bakeTimingsCount];
+	UINT g_nextBakeTiming = 0;
 
 	XMMATRIX mProjection;
 	XMMATRIX mViews[6];
@@ -118,4 +238,6 @@ private:
 	UINT g_prefilTextureSize = 128;
 	UINT g_BRDFTextureSize = 128;
 	UINT g_prefilMipMapLevels = 5;
+	UINT g_sourceFaceSize = 512;
+	HDRTextureFormat g_mapsFormat = HDRTextureFormat::r11g11b10f;
 };
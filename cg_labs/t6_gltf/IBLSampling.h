@@ -0,0 +1,104 @@
+// Adaptive sampling for IBL maps generation (see IBLBakeQuality.h)
+
+cbuffer SamplingQualityBuffer : register (b1)
+{
+	float4 quality;    // x - target relative error (0 - always max samples), y - min samples, z - max samples, w - batch size
+	uint4 statsParams; // x - index of map counters in bakeStats
+};
+
+// Per map: samples, texels, error sum (fixed point), max error bits
+RWByteAddressBuffer bakeStats : register (u1);
+
+static const float STATS_ERROR_SCALE = 10000.0;
+
+float RadicalInverse_VdC(uint bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+}
+
+// Unlike Hammersley set every prefix of this sequence is well distributed, so sampling may stop after any batch
+float2 ProgressiveSample(uint i)
+{
+	return float2(frac(i * 0.6180339887), RadicalInverse_VdC(i));
+}
+
+float SampleLuminance(float3 color)
+{
+	return dot(color, float3(0.2126, 0.7152, 0.0722));
+}
+
+// Weighted running mean and variance, same as RunningVariance on CPU
+struct RunningVariance
+{
+	float sumWeights;
+	float sumSquaredWeights;
+	float mean;
+	float m2;
+};
+
+RunningVariance InitRunningVariance()
+{
+	RunningVariance rv = (RunningVariance)0;
+	return rv;
+}
+
+void AddSample(inout RunningVariance rv, float x, float weight)
+{
+	if (weight <= 0)
+		return;
+
+	rv.sumWeights += weight;
+	rv.sumSquaredWeights += weight * weight;
+	float delta = x - rv.mean;
+	rv.mean += delta * weight / rv.sumWeights;
+	rv.m2 += weight * delta * (x - rv.mean);
+}
+
+float RelativeError(RunningVariance rv)
+{
+	if (rv.sumSquaredWeights <= 0)
+		return 0;
+
+	float variance = max(rv.m2 / rv.sumWeights, 0);
+	float count = rv.sumWeights * rv.sumWeights / rv.sumSquaredWeights;
+	return sqrt(variance / count) / max(rv.mean, 1e-4);
+}
+
+uint MaxSamples()
+{
+	return max((uint)quality.z, 1u);
+}
+
+uint BatchSize()
+{
+	return max((uint)quality.w, 1u);
+}
+
+// Sample count which defines filter footprint (mip level) of one sample. It is the sample cap even when
+// a texel stops earlier: source mips stay as sharp as with the fixed count, and early stops are allowed
+// only when the error of these samples is already low
+float FootprintSamples()
+{
+	return (float)MaxSamples();
+}
+
+bool IsConverged(RunningVariance rv, uint samples)
+{
+	return quality.x > 0 && samples >= (uint)quality.y && RelativeError(rv) <= quality.x;
+}
+
+void ReportTexelStats(RunningVariance rv, uint samples)
+{
+	float error = RelativeError(rv);
+	uint offset = statsParams.x * 16;
+	uint dummy;
+	bakeStats.InterlockedAdd(offset, samples, dummy);
+	bakeStats.InterlockedAdd(offset + 4, 1, dummy);
+	bakeStats.InterlockedAdd(offset + 8, (uint)(min(error, 1.0) * STATS_ERROR_SCALE), dummy);
+	bakeStats.InterlockedMax(offset + 12, asuint(error), dummy);
+}
@@ -0,0 +1,108 @@
+#include "JobBenchmark.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "JobSystem.h"
+#include "parallel.h"
+
+namespace {
+  const uint32_t emptyJobs = 100000;
+  const uint32_t chainJobs = 20000;
+  const uint32_t loopIterations = 1000000;
+  const uint32_t computeTasks = 512;
+  const uint32_t computeSteps = 20000;
+
+  double NowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Keeps results alive so the compiler does not drop the work
+  std::atomic<uint64_t> sink(0);
+
+  float ComputeTask(uint32_t seed) {
+    float x = (float)seed;
+    for (uint32_t step = 0; step < computeSteps; step++)
+      x = std::sin(x) * 1.5f + 0.25f;
+    return x;
+  }
+
+  void RunPool(JobSystem& jobs, JobBenchResult& result) {
+    // Empty jobs, all waited at once
+    {
+      JobCounter counter;
+      double start = NowMs();
+      for (uint32_t i = 0; i < emptyJobs; i++)
+        jobs.Run([]() {}, &counter);
+      jobs.Wait(counter);
+      result.emptyJobNs = (NowMs() - start) * 1e6 / emptyJobs;
+    }
+
+    // Chain of dependent jobs, each starts when the previous one ends
+    {
+      std::vector<std::unique_ptr<JobCounter>> chain;
+      chain.reserve(chainJobs);
+      double start = NowMs();
+      chain.emplace_back(new JobCounter());
+      jobs.Run([]() {}, chain.back().get());
+      for (uint32_t i = 1; i < chainJobs; i++) {
+        JobCounter& previous = *chain.back();
+        chain.emplace_back(new JobCounter());
+        jobs.RunAfter(previous, []() {}, chain.back().get());
+      }
+      for (auto& counter : chain)
+        jobs.Wait(*counter);
+      result.dependencyNs = (NowMs() - start) * 1e6 / chainJobs;
+    }
+
+    // ParallelFor with grain 1, cost is all scheduling
+    {
+      std::atomic<uint64_t> sum(0);
+      double start = NowMs();
+      jobs.ParallelFor(loopIterations, [&sum](size_t i) {
+        if ((i & 1023) == 0)
+          sum += i;
+      });
+      result.parallelForNs = (NowMs() - start) * 1e6 / loopIterations;
+      sink += sum;
+    }
+
+    // Same compute bound work for every pool size
+    {
+      std::vector<float> values(computeTasks);
+      double start = NowMs();
+      JobCounter counter;
+      for (uint32_t task = 0; task < computeTasks; task++)
+        jobs.Run([&values, task]() { values[task] = ComputeTask(task); }, &counter);
+      jobs.Wait(counter);
+      result.computeMs = NowMs() - start;
+      for (float value : values)
+        sink += (uint64_t)(value * 1000.0f);
+    }
+  }
+}
+
+std::vector<JobBenchResult> RunJobBenchmark(uint32_t maxThreads) {
+  std::vector<JobBenchResult> results;
+  for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+    JobBenchResult result;
+    result.threads = threads;
+    JobSystem jobs(threads);
+    RunPool(jobs, result);
+    result.speedup = results.empty() ? 1.0 : results.front().computeMs / result.computeMs;
+    results.push_back(result);
+  }
+  return results;
+}
+
+void WriteJobBenchmark(std::ostream& out, const std::vector<JobBenchResult>& results) {
+  out << "job system benchmark, " << GetWorkerCount() << " hardware threads\n";
+  out << "threads  empty job ns  dependency ns  parallel for ns  compute ms  speedup  efficiency\n";
+  for (const JobBenchResult& result : results) {
+    char line[160];
+    snprintf(line, sizeof(line), "%7u  %12.1f  %13.1f  %15.1f  %10.2f  %7.2f  %9.0f%%\n", result.threads, result.emptyJobNs,
+      result.dependencyNs, result.parallelForNs, result.computeMs, result.speedup, result.speedup * 100.0 / result.threads);
+    out << line;
+  }
+}
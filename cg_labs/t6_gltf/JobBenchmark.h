@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// One pool size of RunJobBenchmark
+struct JobBenchResult {
+  uint32_t threads = 0;
+  double emptyJobNs = 0.0;     // Run + Wait of an empty job, from the main thread
+  double dependencyNs = 0.0;   // latency of a job started by RunAfter in a chain
+  double parallelForNs = 0.0;  // per iteration of ParallelFor with almost empty body
+  double computeMs = 0.0;      // fixed compute bound workload split into jobs
+  double speedup = 0.0;        // computeMs of 1 thread / computeMs
+};
+
+// Scheduling overhead and scaling of JobSystem for 1, 2, 4 ... maxThreads threads.
+// Pools bigger than the number of cores are oversubscribed.
+std::vector<JobBenchResult> RunJobBenchmark(uint32_t maxThreads = 64);
+
+void WriteJobBenchmark(std::ostream& out, const std::vector<JobBenchResult>& results);
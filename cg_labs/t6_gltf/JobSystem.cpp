@@ -0,0 +1,223 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "parallel.h"
+#include "TraceRecorder.h"
+
+namespace {
+  // Pool and worker index of the calling thread, index -1 for threads outside pools
+  struct WorkerSlot {
+    const JobSystem* system = nullptr;
+    int index = -1;
+  };
+  thread_local WorkerSlot currentWorker;
+
+  // Tries before idle worker goes to sleep
+  const int spinCount = 64;
+}
+
+JobSystem& JobSystem::GetInstance() {
+  static JobSystem instance;
+  return instance;
+}
+
+JobSystem::JobSystem(size_t threads) : stop(false), queued(0), sleeping(0) {
+  size_t count = threads > 0 ? threads : GetWorkerCount();
+  for (size_t i = 0; i < count; i++)
+    queues.emplace_back(new Queue());
+
+  workers.reserve(count - 1);
+  for (size_t i = 0; i + 1 < count; i++)
+    workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem() {
+  // Workers leave once the queues are empty, jobs they push meanwhile still run
+  stop = true;
+  {
+    std::lock_guard<std::mutex> guard(sleepLock);
+  }
+  wake.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+
+  // Pool without workers
+  Task task;
+  while (Pop(task))
+    Execute(task);
+}
+
+int JobSystem::GetWorkerIndex() const {
+  return currentWorker.system == this ? currentWorker.index : -1;
+}
+
+void JobSystem::Push(Task&& task) {
+  int index = GetWorkerIndex();
+  Queue& queue = index >= 0 ? *queues[index] : *queues.back();
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+  }
+
+  // Sleeper increments sleeping before it checks queued, so one of them sees the other
+  queued++;
+  if (sleeping.load() > 0) {
+    {
+      std::lock_guard<std::mutex> guard(sleepLock);
+    }
+    wake.notify_one();
+  }
+}
+
+bool JobSystem::Pop(Task& task) {
+  // Own deque from the back, others (shared queue first) from the front
+  int index = GetWorkerIndex();
+  size_t count = queues.size();
+  for (size_t i = 0; i < count; i++) {
+    size_t victim = index >= 0 ? (index + i) % count : (count - 1 + i) % count;
+    Queue& queue = *queues[victim];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty())
+      continue;
+
+    if (i == 0 && index >= 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    }
+    else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+void JobSystem::Execute(Task& task) {
+  {
+    TRACE_SCOPE("Job");
+    task.job();
+  }
+  Finish(task.counter);
+}
+
+void JobSystem::Finish(JobCounter* counter) {
+  if (!counter)
+    return;
+
+  std::vector<std::function<void()>> continuations;
+  {
+    std::lock_guard<std::mutex> guard(counter->lock);
+    if (--counter->pending == 0) {
+      continuations.swap(counter->continuations);
+      counter->done.notify_all();
+    }
+  }
+  for (auto& continuation : continuations)
+    continuation();
+}
+
+void JobSystem::Run(Job job, JobCounter* counter) {
+  if (counter)
+    counter->pending++;
+  Push({ std::move(job), counter });
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter) {
+  if (counter)
+    counter->pending++;
+
+  {
+    std::lock_guard<std::mutex> guard(dependency.lock);
+    if (dependency.pending.load() != 0) {
+      auto shared = std::make_shared<Job>(std::move(job));
+      dependency.continuations.push_back([this, shared, counter]() { Push({ std::move(*shared), counter }); });
+      return;
+    }
+  }
+  Push({ std::move(job), counter });
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+  int idle = 0;
+  while (!counter.IsDone()) {
+    Task task;
+    if (Pop(task)) {
+      Execute(task);
+      idle = 0;
+    }
+    else if (++idle < spinCount)
+      std::this_thread::yield();
+    else {
+      // Nothing to help with: sleep until done, look for new jobs now and then
+      std::unique_lock<std::mutex> lock(counter.lock);
+      counter.done.wait_for(lock, std::chrono::milliseconds(1), [&counter]() { return counter.IsDone(); });
+    }
+  }
+
+  // Last Finish leaves the counter after unlocking it
+  std::lock_guard<std::mutex> guard(counter.lock);
+}
+
+void JobSystem::WorkerLoop(size_t index) {
+  currentWorker.system = this;
+  currentWorker.index = (int)index;
+
+  int idle = 0;
+  for (;;) {
+    Task task;
+    if (Pop(task)) {
+      Execute(task);
+      idle = 0;
+      continue;
+    }
+    if (stop)
+      break;
+    if (++idle < spinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepLock);
+    sleeping++;
+    wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+    sleeping--;
+    idle = 0;
+  }
+}
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxJobs, size_t grain) {
+  if (count == 0)
+    return;
+
+  grain = std::max<size_t>(grain, 1);
+  size_t chunks = (count + grain - 1) / grain;
+  size_t jobs = std::min(maxJobs > 0 ? maxJobs : GetThreadCount(), chunks);
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; i++)
+      body(i);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  auto loop = [&]() {
+    for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain)) {
+      size_t end = std::min(begin + grain, count);
+      for (size_t i = begin; i < end; i++)
+        body(i);
+    }
+  };
+
+  // Jobs of the pool are traced by Execute, the calling thread traces its loop the same way
+  JobCounter counter;
+  for (size_t j = 1; j < jobs; j++)
+    Run(loop, &counter);
+  {
+    TRACE_SCOPE("Job");
+    loop();
+  }
+  Wait(counter);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+// Number of unfinished jobs attached to it. Jobs started with RunAfter wait until it drops to zero.
+// Counter must outlive its jobs: JobSystem::Wait on it before destruction.
+class JobCounter {
+public:
+  JobCounter() : pending(0) {}
+  JobCounter(const JobCounter&) = delete;
+  JobCounter& operator=(const JobCounter&) = delete;
+
+  bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class JobSystem;
+
+  std::atomic<uint32_t> pending;
+  std::mutex lock;                // guards continuations and the last decrement
+  std::condition_variable done;
+  std::vector<std::function<void()>> continuations;
+};
+
+// Work-stealing scheduler: every worker has its own deque, takes newest jobs from it and steals
+// oldest ones from others when it is empty. Threads outside the pool push into a shared queue.
+// Waiting threads run jobs instead of blocking, so jobs may wait for other jobs (nested ParallelFor).
+// Jobs still queued on destruction run before the pool stops.
+class JobSystem {
+public:
+  // Shared pool with GetWorkerCount() threads, ParallelFor of parallel.h runs on it
+  static JobSystem& GetInstance();
+
+  // threads - threads that run jobs including the waiting one, pool has threads - 1 workers.
+  // 0 means GetWorkerCount()
+  explicit JobSystem(size_t threads = 0);
+  ~JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  size_t GetThreadCount() const { return workers.size() + 1; }
+
+  // counter may be null for fire-and-forget jobs
+  void Run(Job job, JobCounter* counter = nullptr);
+
+  // Starts job when dependency is done, counter is increased right away
+  void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+
+  // Runs queued jobs until counter is done
+  void Wait(JobCounter& counter);
+
+  // Calls body(i) for i in [0, count) in at most maxJobs parallel loops (0 - GetThreadCount()),
+  // the calling thread runs one of them. Iterations are taken in chunks of grain.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxJobs = 0, size_t grain = 1);
+
+private:
+  struct Task {
+    Job job;
+    JobCounter* counter;
+  };
+
+  struct Queue {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  void Push(Task&& task);
+  bool Pop(Task& task);
+  void Execute(Task& task);
+  void Finish(JobCounter* counter);
+  void WorkerLoop(size_t index);
+  int GetWorkerIndex() const;
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Queue>> queues; // one per worker, the last is shared by other threads
+  std::atomic<bool> stop;
+
+  // Idle workers sleep until there are queued tasks (may be below zero for a moment while pushing)
+  std::atomic<int32_t> queued;
+  std::atomic<uint32_t> sleeping;
+  std::mutex sleepLock;
+  std::condition_variable wake;
+};
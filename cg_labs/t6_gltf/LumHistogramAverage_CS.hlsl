@@ -0,0 +1,61 @@
+#include "HistogramHeader.h"
+
+RWByteAddressBuffer Histogram : register(u0);
+RWTexture2D<float4> AverageLumen : register(u1);
+
+groupshared uint prefix[HISTOGRAM_BINS];
+groupshared float sums[HISTOGRAM_BINS];
+groupshared float weights[HISTOGRAM_BINS];
+
+// One group, thread per bin: weighted mean of log2 luminance between percentiles
+[numthreads(HISTOGRAM_BINS, 1, 1)]
+void main(uint gi : SV_GroupIndex)
+{
+	// Bin 0 (black pixels) is not metered, histogram is cleared for next frame
+	uint count = gi > 0 ? Histogram.Load(gi * 4) : 0;
+	Histogram.Store(gi * 4, 0);
+	prefix[gi] = count;
+	GroupMemoryBarrierWithGroupSync();
+
+	// Inclusive prefix sum
+	[unroll]
+	for (uint offset = 1; offset < HISTOGRAM_BINS; offset <<= 1)
+	{
+		uint value = gi >= offset ? prefix[gi - offset] : 0;
+		GroupMemoryBarrierWithGroupSync();
+		prefix[gi] += value;
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	// Part of the bin inside [low, high] of cumulative weight
+	float total = (float)prefix[HISTOGRAM_BINS - 1];
+	float low = total * min(percentiles.x, percentiles.y);
+	float high = total * max(percentiles.x, percentiles.y);
+	float end = (float)prefix[gi];
+	float begin = end - (float)count;
+	float inside = max(min(end, high) - max(begin, low), 0.0f);
+
+	sums[gi] = inside * BinLog2(gi);
+	weights[gi] = inside;
+	GroupMemoryBarrierWithGroupSync();
+
+	[unroll]
+	for (uint stride = HISTOGRAM_BINS / 2; stride > 0; stride >>= 1)
+	{
+		if (gi < stride)
+		{
+			sums[gi] += sums[gi + stride];
+			weights[gi] += weights[gi + stride];
+		}
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	if (gi == 0)
+	{
+		float averageLog2 = weights[0] > 0.0f ? sums[0] / weights[0] : binsParams.x;
+
+		// Same encoding as downsampled BrightnessCalc output
+		float brightness = log(exp2(averageLog2) + 1.0f);
+		AverageLumen[uint2(0, 0)] = float4(brightness, brightness, brightness, 1.0f);
+	}
+}
@@ -0,0 +1,27 @@
+#include "HistogramHeader.h"
+
+Texture2D<float4> HDRTexture : register(t0);
+RWByteAddressBuffer Histogram : register(u0);
+
+groupshared uint localBins[HISTOGRAM_BINS];
+
+[numthreads(16, 16, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint gi : SV_GroupIndex)
+{
+	localBins[gi] = 0;
+	GroupMemoryBarrierWithGroupSync();
+
+	if (id.x < inputSize.x && id.y < inputSize.y)
+	{
+		float lum = dot(HDRTexture.Load(int3(id.xy, 0)).rgb, ChannelsWeight);
+
+		// Center weighted metering, fixed point weight
+		float2 d = (id.xy + 0.5f) * (2.0f / inputSize.xy) - 1.0f;
+		float w = max(1.0f - binsParams.z * min(dot(d, d), 1.0f), 0.0f);
+		InterlockedAdd(localBins[LuminanceBin(lum)], (uint)(w * HISTOGRAM_WEIGHT_SCALE + 0.5f));
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	if (localBins[gi] > 0)
+		Histogram.InterlockedAdd(gi * 4, localBins[gi]);
+}
@@ -0,0 +1,214 @@
+#include "LuminanceHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LUMHISTOGRAM_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+  // Same weights as BrightnessCalc.hlsl
+  const float channelsWeight[3] = { 0.2126f, 0.7151f, 0.0722f };
+
+  struct BinMapping {
+    float minLog2;
+    float binsPerLog2; // (bins - 1) / range
+    float centerWeight;
+  };
+
+  BinMapping MakeMapping(const LuminanceHistogramParams& params) {
+    float range = std::max(params.maxLog2Lum - params.minLog2Lum, 1e-3f);
+    return { params.minLog2Lum, (luminanceHistogramBins - 1) / range, params.centerWeight };
+  }
+
+  inline uint32_t BinOfLog2(float log2Lum, const BinMapping& mapping) {
+    float t = std::min(std::max((log2Lum - mapping.minLog2) * mapping.binsPerLog2, 0.0f), (float)(luminanceHistogramBins - 2));
+    return 1 + (uint32_t)t;
+  }
+
+  void AccumulateRowsScalar(const HDRImage& image, const BinMapping& mapping, const LuminanceHistogramParams& params,
+    uint32_t firstRow, uint32_t lastRow, uint32_t* bins) {
+    for (uint32_t y = firstRow; y < lastRow; y++) {
+      float dy = (y + 0.5f) * (2.0f / image.height) - 1.0f;
+      for (uint32_t x = 0; x < image.width; x++) {
+        const float* texel = image.Texel(x, y);
+        float lum = texel[0] * channelsWeight[0] + texel[1] * channelsWeight[1] + texel[2] * channelsWeight[2];
+        uint32_t bin = lum >= LuminanceHistogram::blackLum ? BinOfLog2(std::log2(lum), mapping) : 0;
+        float dx = (x + 0.5f) * (2.0f / image.width) - 1.0f;
+        bins[bin] += LuminancePixelWeight(dx, dy, params);
+      }
+    }
+  }
+
+#ifdef LUMHISTOGRAM_USE_SSE
+  // log2 of positive normal floats: exponent + 2 / ln2 * atanh(s), s = (m - 1) / (m + 1), m in [sqrt(0.5), sqrt(2))
+  inline __m128 Log2SSE(__m128 x) {
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(1.0f));
+
+    __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+    m = _mm_sub_ps(m, _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+    e = _mm_add_ps(e, _mm_and_ps(big, _mm_set1_ps(1.0f)));
+
+    __m128 s = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_add_ps(m, _mm_set1_ps(1.0f)));
+    __m128 s2 = _mm_mul_ps(s, s);
+    __m128 p = _mm_add_ps(_mm_set1_ps(1.0f / 5.0f), _mm_mul_ps(s2, _mm_set1_ps(1.0f / 7.0f)));
+    p = _mm_add_ps(_mm_set1_ps(1.0f / 3.0f), _mm_mul_ps(s2, p));
+    p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(s2, p));
+    return _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(s, p), _mm_set1_ps(2.88539008f)));
+  }
+
+  void AccumulateRowsSSE(const HDRImage& image, const BinMapping& mapping, const LuminanceHistogramParams& params,
+    uint32_t firstRow, uint32_t lastRow, uint32_t* bins) {
+    const __m128 wr = _mm_set1_ps(channelsWeight[0]), wg = _mm_set1_ps(channelsWeight[1]), wb = _mm_set1_ps(channelsWeight[2]);
+    const __m128 black = _mm_set1_ps(LuminanceHistogram::blackLum);
+    const __m128 minLog2 = _mm_set1_ps(mapping.minLog2), binsPerLog2 = _mm_set1_ps(mapping.binsPerLog2);
+    const __m128 maxT = _mm_set1_ps((float)(luminanceHistogramBins - 2));
+    const __m128 dxScale = _mm_set1_ps(2.0f / image.width);
+    const __m128 centerWeight = _mm_set1_ps(mapping.centerWeight);
+    const __m128 weightScale = _mm_set1_ps((float)LuminanceHistogram::weightScale);
+
+    alignas(16) int32_t binIdx[4];
+    alignas(16) int32_t weights[4];
+    for (uint32_t y = firstRow; y < lastRow; y++) {
+      float dy = (y + 0.5f) * (2.0f / image.height) - 1.0f;
+      __m128 dy2 = _mm_set1_ps(dy * dy);
+
+      uint32_t x = 0;
+      for (; x + 4 <= image.width; x += 4) {
+        // RGBA of 4 pixels transposed into channels
+        __m128 p0 = _mm_loadu_ps(image.Texel(x, y)), p1 = _mm_loadu_ps(image.Texel(x + 1, y));
+        __m128 p2 = _mm_loadu_ps(image.Texel(x + 2, y)), p3 = _mm_loadu_ps(image.Texel(x + 3, y));
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        __m128 lum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, wr), _mm_mul_ps(p1, wg)), _mm_mul_ps(p2, wb));
+
+        __m128 t = _mm_mul_ps(_mm_sub_ps(Log2SSE(_mm_max_ps(lum, black)), minLog2), binsPerLog2);
+        t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), maxT);
+        __m128i bin = _mm_add_epi32(_mm_cvttps_epi32(t), _mm_set1_epi32(1));
+        // NaN and dark pixels go to bin 0
+        bin = _mm_and_si128(bin, _mm_castps_si128(_mm_cmpge_ps(lum, black)));
+        _mm_store_si128((__m128i*)binIdx, bin);
+
+        __m128 px = _mm_add_ps(_mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f), _mm_set1_ps((float)x));
+        __m128 dx = _mm_sub_ps(_mm_mul_ps(px, dxScale), _mm_set1_ps(1.0f));
+        __m128 r2 = _mm_min_ps(_mm_add_ps(_mm_mul_ps(dx, dx), dy2), _mm_set1_ps(1.0f));
+        __m128 w = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(centerWeight, r2));
+        w = _mm_add_ps(_mm_mul_ps(_mm_max_ps(w, _mm_setzero_ps()), weightScale), _mm_set1_ps(0.5f));
+        _mm_store_si128((__m128i*)weights, _mm_cvttps_epi32(w));
+
+        for (int i = 0; i < 4; i++)
+          bins[binIdx[i]] += (uint32_t)weights[i];
+      }
+
+      // Row tail
+      for (; x < image.width; x++) {
+        const float* texel = image.Texel(x, y);
+        float lum = texel[0] * channelsWeight[0] + texel[1] * channelsWeight[1] + texel[2] * channelsWeight[2];
+        uint32_t bin = lum >= LuminanceHistogram::blackLum ? BinOfLog2(std::log2(lum), mapping) : 0;
+        float dx = (x + 0.5f) * (2.0f / image.width) - 1.0f;
+        bins[bin] += LuminancePixelWeight(dx, dy, params);
+      }
+    }
+  }
+#endif
+}
+
+void LuminanceHistogram::Clear() {
+  memset(bins, 0, sizeof(bins));
+}
+
+uint64_t LuminanceHistogram::Total() const {
+  uint64_t total = 0;
+  for (uint32_t bin : bins)
+    total += bin;
+  return total;
+}
+
+float LuminanceHistogram::AverageLog2(const LuminanceHistogramParams& params) const {
+  uint64_t total = Total() - bins[0];
+  if (total == 0)
+    return params.minLog2Lum;
+
+  double low = total * (double)std::min(params.lowPercentile, params.highPercentile);
+  double high = total * (double)std::max(params.lowPercentile, params.highPercentile);
+
+  // Part of every bin inside [low, high] of cumulative weight
+  double sum = 0, weight = 0, cumulative = 0;
+  for (uint32_t bin = 1; bin < luminanceHistogramBins; bin++) {
+    double begin = cumulative;
+    cumulative += bins[bin];
+    double inside = std::min(cumulative, high) - std::max(begin, low);
+    if (inside <= 0)
+      continue;
+
+    sum += inside * LuminanceBinLog2(bin, params);
+    weight += inside;
+  }
+
+  return weight > 0 ? (float)(sum / weight) : params.minLog2Lum;
+}
+
+float LuminanceHistogram::Difference(const LuminanceHistogram& a, const LuminanceHistogram& b) {
+  double totalA = (double)a.Total(), totalB = (double)b.Total();
+  if (totalA == 0 || totalB == 0)
+    return totalA == totalB ? 0.0f : 1.0f;
+
+  double diff = 0;
+  for (uint32_t bin = 0; bin < luminanceHistogramBins; bin++)
+    diff += std::abs(a.bins[bin] / totalA - b.bins[bin] / totalB);
+  return (float)(diff * 0.5);
+}
+
+uint32_t LuminanceBin(float luminance, const LuminanceHistogramParams& params) {
+  if (!(luminance >= LuminanceHistogram::blackLum))
+    return 0;
+  return BinOfLog2(std::log2(luminance), MakeMapping(params));
+}
+
+float LuminanceBinLog2(uint32_t bin, const LuminanceHistogramParams& params) {
+  BinMapping mapping = MakeMapping(params);
+  return mapping.minLog2 + (bin - 1 + 0.5f) / mapping.binsPerLog2;
+}
+
+uint32_t LuminancePixelWeight(float dx, float dy, const LuminanceHistogramParams& params) {
+  float r2 = std::min(dx * dx + dy * dy, 1.0f);
+  float w = std::max(1.0f - params.centerWeight * r2, 0.0f);
+  return (uint32_t)(w * LuminanceHistogram::weightScale + 0.5f);
+}
+
+void BuildLuminanceHistogram(const HDRImage& image, const LuminanceHistogramParams& params, LuminanceHistogram& histogram,
+  bool useSimd) {
+  histogram.Clear();
+  if (image.width == 0 || image.height == 0)
+    return;
+
+  // Bands of rows with own histograms, merged at the end
+  const uint32_t rowsPerBand = 32;
+  uint32_t bands = (image.height + rowsPerBand - 1) / rowsPerBand;
+  std::vector<LuminanceHistogram> bandHistograms(bands);
+  BinMapping mapping = MakeMapping(params);
+
+  ParallelFor(bands, [&](size_t band) {
+    uint32_t firstRow = (uint32_t)band * rowsPerBand;
+    uint32_t lastRow = std::min(firstRow + rowsPerBand, image.height);
+    uint32_t* bins = bandHistograms[band].bins;
+#ifdef LUMHISTOGRAM_USE_SSE
+    if (useSimd) {
+      AccumulateRowsSSE(image, mapping, params, firstRow, lastRow, bins);
+      return;
+    }
+#endif
+    AccumulateRowsScalar(image, mapping, params, firstRow, lastRow, bins);
+  });
+
+  for (const LuminanceHistogram& band : bandHistograms)
+    for (uint32_t bin = 0; bin < luminanceHistogramBins; bin++)
+      histogram.bins[bin] += band.bins[bin];
+}
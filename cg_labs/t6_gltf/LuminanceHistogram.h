@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "CubeMapConverter.h"
+
+// Log2 luminance histogram for auto exposure. Bin 0 takes black pixels, bins 1..255 split
+// [minLog2Lum, maxLog2Lum]. Pixels are weighted towards the screen center, weights are
+// fixed point so GPU (LumHistogram_CS.hlsl) and CPU histograms can be compared bin by bin.
+static const uint32_t luminanceHistogramBins = 256;
+
+struct LuminanceHistogramParams {
+  float minLog2Lum = -10.0f;
+  float maxLog2Lum = 10.0f;
+  float lowPercentile = 0.10f;  // darkest share of weighted pixels is rejected
+  float highPercentile = 0.95f; // and everything above this one
+  float centerWeight = 0.5f;    // 0 - uniform, 1 - screen corners are ignored
+};
+
+struct LuminanceHistogram {
+  static const uint32_t weightScale = 256; // fixed point of pixel weight
+  static constexpr float blackLum = 1e-5f; // lower luminance goes to bin 0
+
+  uint32_t bins[luminanceHistogramBins] = {};
+
+  void Clear();
+  uint64_t Total() const;
+
+  // Weighted mean of log2 luminance between percentiles (bin 0 excluded), minLog2Lum if empty
+  float AverageLog2(const LuminanceHistogramParams& params) const;
+
+  // Total variation distance of normalized histograms, 0 - same, 1 - disjoint
+  static float Difference(const LuminanceHistogram& a, const LuminanceHistogram& b);
+};
+
+// Bin of luminance (same math as the shader)
+uint32_t LuminanceBin(float luminance, const LuminanceHistogramParams& params);
+
+// Log2 luminance of bin center
+float LuminanceBinLog2(uint32_t bin, const LuminanceHistogramParams& params);
+
+// Fixed point weight of pixel, 0 - center of the image
+uint32_t LuminancePixelWeight(float dx, float dy, const LuminanceHistogramParams& params);
+
+// CPU reference of the GPU histogram: rows are split between threads, SSE2 for 4 pixels at once
+// if available (useSimd = false gives plain scalar code with exact log2)
+void BuildLuminanceHistogram(const HDRImage& image, const LuminanceHistogramParams& params, LuminanceHistogram& histogram,
+  bool useSimd = true);
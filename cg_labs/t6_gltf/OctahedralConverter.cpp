@@ -0,0 +1,376 @@
+#include "OctahedralConverter.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  const float PI = 3.14159265358979f;
+
+  // Rows of one mip resampled by one task
+  const uint32_t rowsPerTask = 16;
+
+  inline float SignNotZero(float x) {
+    return x >= 0.0f ? 1.0f : -1.0f;
+  }
+
+  inline void Normalize(float v[3]) {
+    float invLen = 1.0f / sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] *= invLen;
+    v[1] *= invLen;
+    v[2] *= invLen;
+  }
+
+  float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float)(bits * 2.3283064365386963e-10);
+  }
+
+  // Sample direction in tangent space (normal is +z), its weight and source lod
+  struct FilterSample {
+    float dir[3];
+    float weight;
+    float lod;
+  };
+
+  // GGX lobe for N = V (same assumption as CMToPrefilMGenerator_PS)
+  std::vector<FilterSample> GGXSamples(float roughness, uint32_t count, float saTexel) {
+    std::vector<FilterSample> samples;
+    float a = roughness * roughness;
+    for (uint32_t i = 0; i < count; i++) {
+      float phi = 2.0f * PI * i / count;
+      float xi = RadicalInverse(i);
+      float cosTheta = sqrtf((1.0f - xi) / (1.0f + (a * a - 1.0f) * xi));
+      float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+
+      float h[3] = { cosf(phi) * sinTheta, sinf(phi) * sinTheta, cosTheta };
+      FilterSample s;
+      s.dir[0] = 2.0f * cosTheta * h[0];
+      s.dir[1] = 2.0f * cosTheta * h[1];
+      s.dir[2] = 2.0f * cosTheta * h[2] - 1.0f;
+      s.weight = s.dir[2];
+      if (s.weight <= 0.0f)
+        continue;
+
+      float d = a * a / (PI * powf(cosTheta * cosTheta * (a * a - 1.0f) + 1.0f, 2.0f));
+      float pdf = d * 0.25f + 0.0001f;
+      float saSample = 1.0f / (count * pdf);
+      s.lod = std::max(0.0f, 0.5f * log2f(saSample / saTexel));
+      samples.push_back(s);
+    }
+    return samples;
+  }
+
+  // Cosine weighted hemisphere, plain average of samples gives irradiance / PI
+  std::vector<FilterSample> CosineSamples(uint32_t count, float saTexel) {
+    std::vector<FilterSample> samples(count);
+    for (uint32_t i = 0; i < count; i++) {
+      float phi = 2.0f * PI * i / count;
+      float xi = RadicalInverse(i);
+      float cosTheta = sqrtf(1.0f - xi);
+      float sinTheta = sqrtf(xi);
+
+      FilterSample& s = samples[i];
+      s.dir[0] = cosf(phi) * sinTheta;
+      s.dir[1] = sinf(phi) * sinTheta;
+      s.dir[2] = cosTheta;
+      s.weight = 1.0f;
+
+      float pdf = cosTheta / PI + 0.0001f;
+      s.lod = std::max(0.0f, 0.5f * log2f(1.0f / (count * pdf * saTexel)) + 1.0f);
+    }
+    return samples;
+  }
+
+  // Weighted sum of source fetches along samples rotated to normal n
+  void Convolve(const OctahedralImage& source, const std::vector<FilterSample>& samples, const float n[3], float rgba[4]) {
+    float up[3] = { 0.0f, 0.0f, 1.0f };
+    if (fabsf(n[2]) >= 0.999f) {
+      up[0] = 1.0f;
+      up[2] = 0.0f;
+    }
+    float t[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+    Normalize(t);
+    float b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+    float sum[4] = { 0, 0, 0, 0 };
+    float totalWeight = 0.0f;
+    for (const FilterSample& s : samples) {
+      float dir[3];
+      for (int i = 0; i < 3; i++)
+        dir[i] = t[i] * s.dir[0] + b[i] * s.dir[1] + n[i] * s.dir[2];
+
+      float texel[4];
+      OctahedralConverter::Sample(source, dir, s.lod, texel);
+      for (int c = 0; c < 4; c++)
+        sum[c] += texel[c] * s.weight;
+      totalWeight += s.weight;
+    }
+
+    for (int c = 0; c < 4; c++)
+      rgba[c] = totalWeight > 0.0f ? sum[c] / totalWeight : 0.0f;
+    rgba[3] = 1.0f;
+  }
+
+  void Bilinear(const HDRImage& mip, uint32_t border, float u, float v, float rgba[4]) {
+    uint32_t size = mip.width - 2 * border;
+    float fx = std::max(0.0f, std::min(border + (u * 0.5f + 0.5f) * size - 0.5f, (float)(mip.width - 1)));
+    float fy = std::max(0.0f, std::min(border + (v * 0.5f + 0.5f) * size - 0.5f, (float)(mip.height - 1)));
+    uint32_t x0 = (uint32_t)fx, y0 = (uint32_t)fy;
+    uint32_t x1 = std::min(x0 + 1, mip.width - 1), y1 = std::min(y0 + 1, mip.height - 1);
+    float tx = fx - x0, ty = fy - y0;
+
+    const float* t00 = mip.Texel(x0, y0);
+    const float* t10 = mip.Texel(x1, y0);
+    const float* t01 = mip.Texel(x0, y1);
+    const float* t11 = mip.Texel(x1, y1);
+    for (int c = 0; c < 4; c++)
+      rgba[c] = (t00[c] * (1 - tx) + t10[c] * tx) * (1 - ty) + (t01[c] * (1 - tx) + t11[c] * tx) * ty;
+  }
+}
+
+uint32_t OctahedralImage::MaxMipLevels(uint32_t size, uint32_t border) {
+  uint32_t count = 0;
+  while ((size >> count) >= 2 * border + 2)
+    count++;
+  return std::max(count, 1u);
+}
+
+void OctahedralConverter::Encode(const float dir[3], float& u, float& v) {
+  float invL1 = 1.0f / (fabsf(dir[0]) + fabsf(dir[1]) + fabsf(dir[2]));
+  u = dir[0] * invL1;
+  v = dir[2] * invL1;
+
+  // Lower hemisphere is folded over the diagonals
+  if (dir[1] < 0.0f) {
+    float fu = (1.0f - fabsf(v)) * SignNotZero(u);
+    float fv = (1.0f - fabsf(u)) * SignNotZero(v);
+    u = fu;
+    v = fv;
+  }
+}
+
+void OctahedralConverter::Decode(float u, float v, float dir[3]) {
+  dir[0] = u;
+  dir[1] = 1.0f - fabsf(u) - fabsf(v);
+  dir[2] = v;
+  if (dir[1] < 0.0f) {
+    dir[0] = (1.0f - fabsf(v)) * SignNotZero(u);
+    dir[2] = (1.0f - fabsf(u)) * SignNotZero(v);
+  }
+  Normalize(dir);
+}
+
+void OctahedralConverter::FillBorder(HDRImage& mip, uint32_t border) {
+  int size = (int)mip.width - 2 * (int)border;
+  int b = (int)border;
+
+  for (int y = 0; y < (int)mip.height; y++)
+    for (int x = 0; x < (int)mip.width; x++) {
+      int ix = x - b, iy = y - b;
+      if (ix >= 0 && iy >= 0 && ix < size && iy < size)
+        continue;
+
+      // Outer edges of the map are mirrored around their middles: (1 + d, v) == (1 - d, -v)
+      if (ix < 0 || ix >= size) {
+        ix = ix < 0 ? -1 - ix : 2 * size - 1 - ix;
+        iy = size - 1 - iy;
+      }
+      if (iy < 0 || iy >= size) {
+        iy = iy < 0 ? -1 - iy : 2 * size - 1 - iy;
+        ix = size - 1 - ix;
+      }
+      ix = std::max(0, std::min(size - 1, ix));
+      iy = std::max(0, std::min(size - 1, iy));
+
+      const float* src = mip.Texel(ix + b, iy + b);
+      float* dst = mip.Texel(x, y);
+      for (int c = 0; c < 4; c++)
+        dst[c] = src[c];
+    }
+}
+
+void OctahedralConverter::Sample(const OctahedralImage& oct, const float dir[3], float lod, float rgba[4]) {
+  float u, v;
+  Encode(dir, u, v);
+
+  lod = std::max(0.0f, std::min(lod, (float)(oct.MipLevels() - 1)));
+  uint32_t mip0 = (uint32_t)lod;
+  float t = lod - mip0;
+
+  Bilinear(oct.mips[mip0], oct.border, u, v, rgba);
+  if (t > 0.0f && mip0 + 1 < oct.MipLevels()) {
+    float next[4];
+    Bilinear(oct.mips[mip0 + 1], oct.border, u, v, next);
+    for (int c = 0; c < 4; c++)
+      rgba[c] += (next[c] - rgba[c]) * t;
+  }
+}
+
+template<typename TexelFunc>
+void OctahedralConverter::ResampleMip(HDRImage& dst, uint32_t mipSize, uint32_t border, TexelFunc texel) const {
+  dst.Resize(mipSize, mipSize);
+  uint32_t size = mipSize - 2 * border;
+
+  uint32_t tasks = (size + rowsPerTask - 1) / rowsPerTask;
+  ParallelFor(tasks, [&](size_t task) {
+    uint32_t rowStart = (uint32_t)task * rowsPerTask;
+    uint32_t rowEnd = std::min(rowStart + rowsPerTask, size);
+    for (uint32_t y = rowStart; y < rowEnd; y++)
+      for (uint32_t x = 0; x < size; x++) {
+        float dir[3];
+        Decode(2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f, dir);
+        texel(dir, dst.Texel(x + border, y + border));
+      }
+  }, params.threads);
+
+  FillBorder(dst, border);
+}
+
+void OctahedralConverter::FromEquirect(const HDRImage& equirect, OctahedralImage& oct) const {
+  uint32_t size = params.size > 0 ? params.size : 2 * CubeMapConverter::SuggestFaceSize(equirect.width);
+  oct.size = size;
+  oct.border = params.border;
+  oct.mips.resize(1);
+
+  // Supersample when the map is much smaller than the source
+  uint32_t ss = std::max(1u, std::min(4u, equirect.width / (2 * size)));
+  ResampleMip(oct.mips[0], size, oct.border, [&](const float dir[3], float* rgba) {
+    if (ss == 1) {
+      CubeMapConverter::SampleEquirect(equirect, dir, rgba);
+      return;
+    }
+
+    // Jitter inside the texel footprint: directions of neighbour texel centers are one texel apart
+    float step = 2.0f / ((size - 2 * oct.border) * ss);
+    float u, v;
+    Encode(dir, u, v);
+    float sum[4] = { 0, 0, 0, 0 };
+    for (uint32_t sy = 0; sy < ss; sy++)
+      for (uint32_t sx = 0; sx < ss; sx++) {
+        float sampleDir[3], texel[4];
+        Decode(std::max(-1.0f, std::min(1.0f, u + (sx + 0.5f - ss * 0.5f) * step)),
+          std::max(-1.0f, std::min(1.0f, v + (sy + 0.5f - ss * 0.5f) * step)), sampleDir);
+        CubeMapConverter::SampleEquirect(equirect, sampleDir, texel);
+        for (int c = 0; c < 4; c++)
+          sum[c] += texel[c];
+      }
+    for (int c = 0; c < 4; c++)
+      rgba[c] = sum[c] / (ss * ss);
+  });
+
+  BuildMipChain(oct);
+}
+
+void OctahedralConverter::FromCube(const CubeMapImage& cube, OctahedralImage& oct) const {
+  uint32_t size = params.size > 0 ? params.size : 2 * cube.faceSize;
+  oct.size = size;
+  oct.border = params.border;
+  oct.mips.resize(1);
+
+  // Fetch from the cube mip with matching density
+  uint32_t mip = 0;
+  while (mip + 1 < cube.mipLevels && (cube.faceSize >> (mip + 1)) * 2 >= size)
+    mip++;
+
+  ResampleMip(oct.mips[0], size, oct.border, [&](const float dir[3], float* rgba) {
+    CubeMapConverter::SampleCube(cube, mip, dir, rgba);
+  });
+
+  BuildMipChain(oct);
+}
+
+void OctahedralConverter::ToCube(const OctahedralImage& oct, uint32_t faceSize, CubeMapImage& cube) const {
+  cube.faceSize = faceSize;
+  cube.mipLevels = 1;
+  for (uint32_t face = 0; face < 6; face++) {
+    cube.faces[face].resize(1);
+    cube.faces[face][0].Resize(faceSize, faceSize);
+  }
+
+  ParallelFor(6, [&](size_t face) {
+    HDRImage& dst = cube.faces[face][0];
+    for (uint32_t y = 0; y < faceSize; y++)
+      for (uint32_t x = 0; x < faceSize; x++) {
+        float dir[3];
+        CubeMapConverter::FaceDirection((uint32_t)face, 2.0f * (x + 0.5f) / faceSize - 1.0f, 2.0f * (y + 0.5f) / faceSize - 1.0f, dir);
+        Normalize(dir);
+        Sample(oct, dir, 0.0f, dst.Texel(x, y));
+      }
+  }, params.threads);
+}
+
+void OctahedralConverter::BuildMipChain(OctahedralImage& oct) const {
+  uint32_t fullCount = OctahedralImage::MaxMipLevels(oct.size, oct.border);
+  uint32_t mipLevels = params.mipLevels > 0 ? std::min(params.mipLevels, fullCount) : fullCount;
+  oct.mips.resize(mipLevels);
+
+  uint32_t b = oct.border;
+  for (uint32_t mip = 1; mip < mipLevels; mip++) {
+    const HDRImage& src = oct.mips[mip - 1];
+    HDRImage& dst = oct.mips[mip];
+    uint32_t size = (oct.size >> mip) - 2 * b;
+    dst.Resize(size + 2 * b, size + 2 * b);
+
+    // Taps at quarters of destination texel, each covers about 2x2 source texels
+    float quarter = 0.5f / size;
+    for (uint32_t y = 0; y < size; y++)
+      for (uint32_t x = 0; x < size; x++) {
+        float u = 2.0f * (x + 0.5f) / size - 1.0f, v = 2.0f * (y + 0.5f) / size - 1.0f;
+        float* out = dst.Texel(x + b, y + b);
+        for (int c = 0; c < 4; c++)
+          out[c] = 0.0f;
+
+        for (int tap = 0; tap < 4; tap++) {
+          float texel[4];
+          Bilinear(src, b, u + (tap & 1 ? quarter : -quarter), v + (tap & 2 ? quarter : -quarter), texel);
+          for (int c = 0; c < 4; c++)
+            out[c] += 0.25f * texel[c];
+        }
+      }
+    FillBorder(dst, b);
+  }
+}
+
+void OctahedralConverter::Prefilter(const OctahedralImage& source, const OctahedralPrefilterParams& prefilterParams,
+  OctahedralImage& prefiltered, OctahedralImage& irradiance) const {
+  float sourceSize = (float)source.InnerSize(0);
+  float saTexel = 4.0f * PI / (sourceSize * sourceSize);
+
+  // Every mip is a separate roughness, so there is no box mip chain here
+  prefiltered.size = prefilterParams.prefilteredSize;
+  prefiltered.border = params.border;
+  prefiltered.mips.resize(std::min(prefilterParams.prefilteredMips, OctahedralImage::MaxMipLevels(prefiltered.size, prefiltered.border)));
+
+  for (uint32_t mip = 0; mip < prefiltered.MipLevels(); mip++) {
+    uint32_t size = prefiltered.size >> mip;
+    float roughness = prefiltered.MipLevels() > 1 ? (float)mip / (prefiltered.MipLevels() - 1) : 0.0f;
+
+    if (roughness == 0.0f) {
+      // Mirror reflection: source at matching density
+      float lod = std::max(0.0f, log2f(sourceSize / (size - 2 * prefiltered.border)));
+      ResampleMip(prefiltered.mips[mip], size, prefiltered.border, [&](const float dir[3], float* rgba) {
+        Sample(source, dir, lod, rgba);
+      });
+      continue;
+    }
+
+    std::vector<FilterSample> samples = GGXSamples(roughness, prefilterParams.prefilteredSamples, saTexel);
+    ResampleMip(prefiltered.mips[mip], size, prefiltered.border, [&](const float dir[3], float* rgba) {
+      Convolve(source, samples, dir, rgba);
+    });
+  }
+
+  irradiance.size = prefilterParams.irradianceSize;
+  irradiance.border = params.border;
+  irradiance.mips.resize(1);
+
+  std::vector<FilterSample> samples = CosineSamples(prefilterParams.irradianceSamples, saTexel);
+  ResampleMip(irradiance.mips[0], irradiance.size, irradiance.border, [&](const float dir[3], float* rgba) {
+    Convolve(source, samples, dir, rgba);
+  });
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CubeMapConverter.h"
+
+// Octahedral (2D) environment map with mip chain.
+// Mip is (size >> mip) texels wide like a usual 2D texture, outer 'border' texels of it are padding
+// which repeats texels across the folded octahedron edges, so bilinear fetch never needs wrapping logic.
+struct OctahedralImage {
+  uint32_t size = 0;
+  uint32_t border = 1;
+  std::vector<HDRImage> mips;
+
+  uint32_t MipLevels() const { return (uint32_t)mips.size(); }
+  uint32_t InnerSize(uint32_t mip) const { return mips[mip].width - 2 * border; }
+
+  // Levels while inner part is at least 2x2
+  static uint32_t MaxMipLevels(uint32_t size, uint32_t border);
+};
+
+struct OctahedralConvertParams {
+  uint32_t size = 0;      // mip 0 size with border; 0 - 2x cube face size / quarter of equirect width
+  uint32_t border = 1;
+  uint32_t mipLevels = 0; // 0 - full chain down to 1x1
+  uint32_t threads = 0;   // 0 - all workers
+};
+
+struct OctahedralPrefilterParams {
+  uint32_t prefilteredSize = 256; // same texel density as 128 cube faces
+  uint32_t prefilteredMips = 5;   // roughness = mip / (mips - 1)
+  uint32_t prefilteredSamples = 256;
+  uint32_t irradianceSize = 32;
+  uint32_t irradianceSamples = 512;
+};
+
+// CPU conversions between lat-long, cube and octahedral maps and IBL prefiltering in octahedral space.
+// Direction mapping is the same as octahedral.h in shaders: y is the pole axis, lower hemisphere is folded out.
+class OctahedralConverter {
+public:
+  OctahedralConverter() {};
+
+  OctahedralConverter(const OctahedralConvertParams& convertParams) : params(convertParams) {};
+
+  // Resample and build mip chain
+  void FromEquirect(const HDRImage& equirect, OctahedralImage& oct) const;
+  void FromCube(const CubeMapImage& cube, OctahedralImage& oct) const;
+
+  // Mip 0 of the cube only, CubeMapConverter::BuildMipChain makes the rest
+  void ToCube(const OctahedralImage& oct, uint32_t faceSize, CubeMapImage& cube) const;
+
+  // Every level is 4 bilinear taps of previous one (inner sizes are not exactly halved), borders are refilled
+  void BuildMipChain(OctahedralImage& oct) const;
+
+  // GGX prefiltered radiance (one roughness per mip) and cosine convolved irradiance.
+  // Source mips are selected by sample solid angle, so few samples are enough.
+  void Prefilter(const OctahedralImage& source, const OctahedralPrefilterParams& prefilterParams,
+    OctahedralImage& prefiltered, OctahedralImage& irradiance) const;
+
+  // u, v in [-1, 1]
+  static void Encode(const float dir[3], float& u, float& v);
+  static void Decode(float u, float v, float dir[3]);
+
+  // Copy inner texels into padding of one mip
+  static void FillBorder(HDRImage& mip, uint32_t border);
+
+  // Trilinear fetch, lod is clamped to existing mips
+  static void Sample(const OctahedralImage& oct, const float dir[3], float lod, float rgba[4]);
+
+private:
+  // Calls texel(dir, rgba) for every inner texel of dst and fills its border
+  template<typename TexelFunc>
+  void ResampleMip(HDRImage& dst, uint32_t mipSize, uint32_t border, TexelFunc texel) const;
+
+  OctahedralConvertParams params;
+};
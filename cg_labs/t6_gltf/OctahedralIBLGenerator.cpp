@@ -0,0 +1,77 @@
+#include "OctahedralIBLGenerator.h"
+#include "parallel.h"
+
+HRESULT OctahedralIBLGenerator::GenerateMaps(ID3D11Device* device, const HDRImage& equirect, UINT sourceSize,
+  const OctahedralPrefilterParams& params, HDRTextureFormat format) {
+  Release();
+
+  // Padded mips are not multiple of 4
+  if (format == HDRTextureFormat::bc6h)
+    format = HDRTextureFormat::rgba16f;
+
+  OctahedralConvertParams convertParams;
+  convertParams.size = sourceSize;
+  OctahedralConverter converter(convertParams);
+
+  OctahedralImage source, prefiltered, irradiance;
+  converter.FromEquirect(equirect, source);
+  converter.Prefilter(source, params, prefiltered, irradiance);
+
+  HRESULT hr = Upload(device, irradiance, format, &g_pIRRMap, &g_pIRRMapSRV);
+  if (FAILED(hr))
+    return hr;
+
+  return Upload(device, prefiltered, format, &g_pPrefilMap, &g_pPrefilMapSRV);
+}
+
+HRESULT OctahedralIBLGenerator::Upload(ID3D11Device* device, const OctahedralImage& image, HDRTextureFormat format,
+  ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv) {
+  std::vector<EncodedHDRImage> encoded(image.MipLevels());
+  ParallelFor(encoded.size(), [&](size_t mip) {
+    HDRFormatEncoder::Encode(image.mips[mip], format, encoded[mip]);
+  });
+
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Format = ToDXGIFormat(format);
+  desc.Width = image.size;
+  desc.Height = image.size;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.Usage = D3D11_USAGE_IMMUTABLE;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = 0;
+  desc.MipLevels = image.MipLevels();
+  desc.ArraySize = 1;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+
+  std::vector<D3D11_SUBRESOURCE_DATA> data(encoded.size());
+  for (size_t i = 0; i < encoded.size(); i++) {
+    data[i].pSysMem = encoded[i].data.data();
+    data[i].SysMemPitch = encoded[i].rowPitch;
+    data[i].SysMemSlicePitch = 0;
+  }
+
+  HRESULT hr = device->CreateTexture2D(&desc, data.data(), texture);
+  if (FAILED(hr))
+    return hr;
+
+  return device->CreateShaderResourceView(*texture, nullptr, srv);
+}
+
+void OctahedralIBLGenerator::FillMaps(IBLMaps& maps) const {
+  maps.pIRRMapSRV = g_pIRRMapSRV;
+  maps.pPrefilMapSRV = g_pPrefilMapSRV;
+  maps.octahedral = true;
+}
+
+void OctahedralIBLGenerator::Release() {
+  if (g_pIRRMapSRV) g_pIRRMapSRV->Release();
+  if (g_pIRRMap) g_pIRRMap->Release();
+  if (g_pPrefilMapSRV) g_pPrefilMapSRV->Release();
+  if (g_pPrefilMap) g_pPrefilMap->Release();
+
+  g_pIRRMapSRV = nullptr;
+  g_pIRRMap = nullptr;
+  g_pPrefilMapSRV = nullptr;
+  g_pPrefilMap = nullptr;
+}
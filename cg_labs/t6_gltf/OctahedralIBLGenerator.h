@@ -0,0 +1,31 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "HDRFormats.h"
+#include "IBLMapsGenerator.h"
+#include "OctahedralConverter.h"
+
+// IBL maps in octahedral layout: one 2D texture (with mips) per map instead of 6 faces.
+// Maps are baked on CPU from lat-long environment, pbrLightable_PS reads them with OCTAHEDRAL_IBL defined.
+class OctahedralIBLGenerator {
+public:
+	// sourceSize - octahedral environment size (with border) the maps are filtered from, 0 - match equirect
+	HRESULT GenerateMaps(ID3D11Device* device, const HDRImage& equirect, UINT sourceSize = 0,
+		const OctahedralPrefilterParams& params = OctahedralPrefilterParams(), HDRTextureFormat format = HDRTextureFormat::r11g11b10f);
+
+	bool HasMaps() const { return g_pIRRMapSRV != nullptr && g_pPrefilMapSRV != nullptr; };
+
+	// Replace irradience and prefiltered maps, BRDF map is kept
+	void FillMaps(IBLMaps& maps) const;
+
+	void Release();
+
+private:
+	HRESULT Upload(ID3D11Device* device, const OctahedralImage& image, HDRTextureFormat format, ID3D11Texture2D** texture, ID3D11ShaderResourceView** srv);
+
+	ID3D11Texture2D* g_pIRRMap = nullptr;
+	ID3D11ShaderResourceView* g_pIRRMapSRV = nullptr;
+	ID3D11Texture2D* g_pPrefilMap = nullptr;
+	ID3D11ShaderResourceView* g_pPrefilMapSRV = nullptr;
+};
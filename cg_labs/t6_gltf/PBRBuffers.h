@@ -3,16 +3,28 @@ cbuffer WorldMatrixBuffer : register (b0)
   float4x4 worldMatrix;
   float4 pbr;
   float4 albedo;
+  float4 probeWeights;  // x, y - local reflection probes, z - skybox
+  int4 probeSlots;      // x, y - cube array slices, z - probes count
+  float4 probePos[2];
+  float4 probeBoxMin[2]; // parallax correction box
+  float4 probeBoxMax[2];
 };
 
 cbuffer SceneMatrixBuffer : register (b1)
 {
   float4x4 viewProjectionMatrix;
   float4 cameraPos;
-  int4 lightCount; // x - light count (max 10)
-  float4 lightPos[10];
-  float4 lightColor[10];
+  int4 lightCount; // x - directional lights, y - all lights
   float4 viewMode;
+  int4 clusterSize;    // x, y - screen tiles, z - depth slices
+  float4 clusterDepth; // slice = log(view z) * x + y
+};
+
+// Light list, directional lights go first (see ClusteredLighting.h)
+struct SceneLight
+{
+  float4 position; // w > 0.5 - directional light, xyz is direction towards it
+  float4 color;    // w - intensity
 };
 
 struct VS_INPUT
@@ -0,0 +1,280 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+  std::atomic<uint32_t> profilerIds(0);
+
+  int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // FNV-1a over characters, so the same name hashes equally from char and wchar_t
+  template<typename Char>
+  uint64_t HashName(const Char* name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; name++) {
+      hash ^= (uint64_t)(uint32_t)*name;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  uint64_t NodeKey(uint32_t parent, uint64_t nameHash) {
+    return nameHash ^ ((uint64_t)parent * 0x9E3779B97F4A7C15ull);
+  }
+
+  std::string ToName(const char* name) {
+    return name;
+  }
+
+  // Event names are ASCII, others are replaced
+  std::string ToName(const wchar_t* name) {
+    std::string result;
+    for (; *name; name++)
+      result += *name < 128 ? (char)*name : '?';
+    return result;
+  }
+}
+
+Profiler& Profiler::GetInstance() {
+  static Profiler instance;
+  return instance;
+}
+
+Profiler::Profiler() : id(profilerIds++), inFrame(false), frameThread(0) {
+  ProfilerNode frame;
+  frame.name = "Frame";
+  nodes.push_back(frame);
+  nodeIds[NodeKey(~0u, HashName("Frame"))] = frameNode;
+  cpuHistory.resize(1);
+  gpuHistory.resize(1);
+}
+
+Profiler::~Profiler() = default;
+
+Profiler::ThreadState& Profiler::GetThreadState() {
+  // Per thread: states of every profiler it used
+  thread_local std::vector<std::pair<uint32_t, ThreadState*>> states;
+  for (auto& state : states)
+    if (state.first == id)
+      return *state.second;
+
+  std::lock_guard<std::mutex> guard(threadsLock);
+  threads.emplace_back(new ThreadState());
+  threads.back()->index = (uint32_t)threads.size() - 1;
+  states.push_back({ id, threads.back().get() });
+  return *threads.back();
+}
+
+template<typename Char>
+void Profiler::BeginNamed(const Char* name, bool gpu) {
+  ThreadState& state = GetThreadState();
+  uint32_t parent = state.stack.empty() ? ~0u : state.stack.back().node;
+  uint64_t key = NodeKey(parent, HashName(name));
+
+  uint32_t node;
+  auto cached = state.nodeCache.find(key);
+  if (cached != state.nodeCache.end())
+    node = cached->second;
+  else {
+    std::lock_guard<std::mutex> guard(nodesLock);
+    auto it = nodeIds.find(key);
+    if (it != nodeIds.end())
+      node = it->second;
+    else {
+      ProfilerNode info;
+      info.name = ToName(name);
+      info.parent = parent;
+      info.depth = parent == ~0u ? 0 : nodes[parent].depth + 1;
+      node = (uint32_t)nodes.size();
+      nodes.push_back(info);
+      nodeIds[key] = node;
+    }
+    state.nodeCache[key] = node;
+  }
+
+  gpu = gpu && gpuTimer && IsFrameThread(state);
+  if (gpu)
+    gpuTimer->BeginScope(node);
+  state.stack.push_back({ node, NowNs(), gpu });
+}
+
+void Profiler::BeginScope(const char* name, bool gpu) {
+  BeginNamed(name, gpu);
+}
+
+void Profiler::BeginScope(const wchar_t* name, bool gpu) {
+  BeginNamed(name, gpu);
+}
+
+void Profiler::EndScope() {
+  ThreadState& state = GetThreadState();
+  if (state.stack.empty())
+    return;
+
+  OpenScope scope = state.stack.back();
+  state.stack.pop_back();
+  int64_t end = NowNs();
+  if (scope.gpu && gpuTimer)
+    gpuTimer->EndScope(scope.node);
+
+  std::lock_guard<std::mutex> guard(state.lock);
+  if (state.closed.size() < maxClosedScopes)
+    state.closed.push_back({ scope.node, (uint32_t)state.stack.size(), scope.startNs, end });
+  else
+    state.dropped++;
+}
+
+void Profiler::BeginFrame() {
+  if (inFrame)
+    EndFrame();
+
+  ThreadState& state = GetThreadState();
+  frameThread = state.index;
+  inFrame = true;
+  frameStartNs = NowNs();
+  if (gpuTimer) {
+    gpuTimer->BeginFrame(frameIndex);
+    gpuTimer->BeginScope(frameNode);
+  }
+  state.stack.push_back({ frameNode, frameStartNs, gpuTimer != nullptr });
+}
+
+void Profiler::EndFrame() {
+  // Frame scope is the bottom of the stack, unclosed scopes above it end with the frame,
+  // so their GPU timestamp pairs are complete
+  ThreadState& state = GetThreadState();
+  while (state.stack.size() > 1)
+    EndScope();
+  EndScope();
+  inFrame = false;
+  if (gpuTimer)
+    gpuTimer->EndFrame();
+
+  lastCpuFrame.clear();
+  lastDroppedScopes = 0;
+  {
+    std::lock_guard<std::mutex> guard(threadsLock);
+    for (auto& thread : threads) {
+      std::lock_guard<std::mutex> threadGuard(thread->lock);
+      for (const ClosedScope& scope : thread->closed) {
+        ProfilerSample sample;
+        sample.node = scope.node;
+        sample.thread = thread->index;
+        sample.depth = scope.depth;
+        sample.startMs = (scope.startNs - frameStartNs) * 1e-6f;
+        sample.endMs = (scope.endNs - frameStartNs) * 1e-6f;
+        lastCpuFrame.push_back(sample);
+      }
+      thread->closed.clear();
+      lastDroppedScopes += thread->dropped;
+      thread->dropped = 0;
+    }
+  }
+  PushTotals(lastCpuFrame, false);
+
+  // All finished GPU frames go into history, the newest is shown
+  uint64_t gpuFrame = 0;
+  std::vector<ProfilerSample> gpuSamples;
+  while (gpuTimer && gpuTimer->Poll(gpuFrame, gpuSamples)) {
+    {
+      std::lock_guard<std::mutex> guard(nodesLock);
+      for (ProfilerSample& sample : gpuSamples)
+        sample.depth = sample.node < nodes.size() ? nodes[sample.node].depth : 0;
+    }
+    PushTotals(gpuSamples, true);
+    lastGpuFrame.swap(gpuSamples);
+    gpuLatency = (uint32_t)(frameIndex - gpuFrame);
+  }
+
+  frameIndex++;
+}
+
+void Profiler::SetGpuTimer(ProfilerGpuTimer* timer) {
+  gpuTimer = timer;
+  lastGpuFrame.clear();
+}
+
+void Profiler::SetHistorySize(uint32_t frames) {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  historySize = std::max(frames, 1u);
+  for (History& history : cpuHistory)
+    history = History();
+  for (History& history : gpuHistory)
+    history = History();
+}
+
+void Profiler::PushTotals(const std::vector<ProfilerSample>& samples, bool gpu) {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  std::vector<History>& histories = gpu ? gpuHistory : cpuHistory;
+  histories.resize(nodes.size());
+
+  // Node may run several times per frame
+  std::vector<float> totals(nodes.size(), -1.0f);
+  for (const ProfilerSample& sample : samples)
+    if (sample.node < totals.size())
+      totals[sample.node] = std::max(totals[sample.node], 0.0f) + (sample.endMs - sample.startMs);
+
+  for (size_t node = 0; node < totals.size(); node++) {
+    if (totals[node] < 0.0f)
+      continue;
+    if (histories[node].values.size() != historySize)
+      histories[node].values.resize(historySize);
+    histories[node].Push(totals[node]);
+  }
+}
+
+void Profiler::History::Push(float value) {
+  values[next] = value;
+  next = (next + 1) % values.size();
+  count = std::min(count + 1, (uint32_t)values.size());
+  last = value;
+}
+
+ProfilerStats Profiler::History::Get() const {
+  ProfilerStats stats;
+  stats.samples = count;
+  stats.last = last;
+  if (count == 0)
+    return stats;
+
+  // Nearest rank percentiles
+  std::vector<float> sorted(values.begin(), values.begin() + count);
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&](float p) {
+    uint32_t rank = (uint32_t)std::ceil(p * count);
+    return sorted[std::max(rank, 1u) - 1];
+  };
+  stats.p50 = percentile(0.50f);
+  stats.p95 = percentile(0.95f);
+  stats.p99 = percentile(0.99f);
+  return stats;
+}
+
+uint32_t Profiler::GetNodeCount() const {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  return (uint32_t)nodes.size();
+}
+
+ProfilerNode Profiler::GetNode(uint32_t node) const {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  return node < nodes.size() ? nodes[node] : ProfilerNode();
+}
+
+ProfilerStats Profiler::GetCpuStats(uint32_t node) const {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  return node < cpuHistory.size() ? cpuHistory[node].Get() : ProfilerStats();
+}
+
+ProfilerStats Profiler::GetGpuStats(uint32_t node) const {
+  std::lock_guard<std::mutex> guard(nodesLock);
+  return node < gpuHistory.size() ? gpuHistory[node].Get() : ProfilerStats();
+}
+
+uint32_t Profiler::GetThreadCount() const {
+  std::lock_guard<std::mutex> guard(threadsLock);
+  return (uint32_t)threads.size();
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TraceRecorder.h"
+
+// Scopes are recorded in debug builds (or with PROFILER_ENABLED defined), in release
+// beginEvent/endEvent and PROFILE_SCOPE compile to nothing. Profiler class itself is always available.
+#if !defined(PROFILER_ENABLED) && defined(_DEBUG)
+#define PROFILER_ENABLED
+#endif
+
+// Closed scope of a frame, times are relative to the frame start
+struct ProfilerSample {
+  uint32_t node = 0;
+  uint32_t thread = 0;
+  uint32_t depth = 0;
+  float startMs = 0.0f;
+  float endMs = 0.0f;
+};
+
+// Scope in the hierarchy: same name under different parents gives different nodes
+struct ProfilerNode {
+  std::string name;
+  uint32_t parent = ~0u;
+  uint32_t depth = 0;
+};
+
+// Percentiles of per frame totals of the node over history
+struct ProfilerStats {
+  float last = 0.0f;
+  float p50 = 0.0f, p95 = 0.0f, p99 = 0.0f;
+  uint32_t samples = 0;
+};
+
+// GPU half: timestamps around scopes of the frame thread, read back frames later.
+// ProfilerD3D11 implements it with timestamp query pairs.
+class ProfilerGpuTimer {
+public:
+  virtual ~ProfilerGpuTimer() = default;
+
+  virtual void BeginFrame(uint64_t frame) = 0;
+  virtual void BeginScope(uint32_t node) = 0;
+  virtual void EndScope(uint32_t node) = 0;
+  virtual void EndFrame() = 0;
+
+  // Oldest finished frame, samples have node, startMs and endMs (relative to the frame start)
+  virtual bool Poll(uint64_t& frame, std::vector<ProfilerSample>& samples) = 0;
+};
+
+// Hierarchical CPU/GPU profiler fed by beginEvent/endEvent and PROFILE_SCOPE.
+// Every thread has its own scope stack, closed scopes are collected in EndFrame. Without frames
+// (headless runs) every thread keeps at most maxClosedScopes of them, the rest are counted as dropped.
+class Profiler {
+public:
+  static Profiler& GetInstance();
+
+  Profiler();
+  ~Profiler();
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  // Scopes must be closed on the thread that opened them. gpu - also time the scope on GPU
+  // (only on the frame thread between BeginFrame and EndFrame)
+  void BeginScope(const char* name, bool gpu = false);
+  void BeginScope(const wchar_t* name, bool gpu = false);
+  void EndScope();
+
+  // Opens root "Frame" scope on the calling thread; EndFrame closes it and gathers all threads
+  void BeginFrame();
+  void EndFrame();
+
+  // Not owned, nullptr disables GPU timing
+  void SetGpuTimer(ProfilerGpuTimer* timer);
+
+  void SetHistorySize(uint32_t frames);
+
+  uint64_t GetFrameIndex() const { return frameIndex; }
+  uint32_t GetNodeCount() const;
+  ProfilerNode GetNode(uint32_t node) const;
+  ProfilerStats GetCpuStats(uint32_t node) const;
+  ProfilerStats GetGpuStats(uint32_t node) const;
+
+  // Samples of the last finished frame, GPU ones are GetGpuLatency() frames older
+  const std::vector<ProfilerSample>& GetLastCpuFrame() const { return lastCpuFrame; }
+  const std::vector<ProfilerSample>& GetLastGpuFrame() const { return lastGpuFrame; }
+  uint32_t GetGpuLatency() const { return gpuLatency; }
+  uint32_t GetThreadCount() const;
+  // Scopes over maxClosedScopes of a thread since the previous EndFrame
+  uint64_t GetLastDroppedScopes() const { return lastDroppedScopes; }
+
+  static const uint32_t frameNode = 0;
+  static const uint32_t maxClosedScopes = 65536;
+
+private:
+  struct OpenScope {
+    uint32_t node;
+    int64_t startNs;
+    bool gpu;
+  };
+
+  struct ClosedScope {
+    uint32_t node;
+    uint32_t depth;
+    int64_t startNs, endNs;
+  };
+
+  struct ThreadState {
+    uint32_t index = 0;
+    std::vector<OpenScope> stack;
+    std::unordered_map<uint64_t, uint32_t> nodeCache; // (parent, name hash) -> node
+    std::mutex lock;                                  // guards closed and dropped
+    std::vector<ClosedScope> closed;
+    uint64_t dropped = 0;
+  };
+
+  struct History {
+    std::vector<float> values;
+    uint32_t next = 0, count = 0;
+    float last = 0.0f;
+
+    void Push(float value);
+    ProfilerStats Get() const;
+  };
+
+  ThreadState& GetThreadState();
+  template<typename Char>
+  void BeginNamed(const Char* name, bool gpu);
+  bool IsFrameThread(const ThreadState& state) const { return inFrame && state.index == frameThread; }
+  void PushTotals(const std::vector<ProfilerSample>& samples, bool gpu);
+
+  const uint32_t id; // thread states are kept per profiler instance
+
+  mutable std::mutex nodesLock;
+  std::vector<ProfilerNode> nodes;
+  std::unordered_map<uint64_t, uint32_t> nodeIds;
+  std::vector<History> cpuHistory, gpuHistory;
+  uint32_t historySize = 256;
+
+  mutable std::mutex threadsLock;
+  std::vector<std::unique_ptr<ThreadState>> threads;
+
+  ProfilerGpuTimer* gpuTimer = nullptr;
+  std::atomic<bool> inFrame;
+  std::atomic<uint32_t> frameThread;
+  uint64_t frameIndex = 0;
+  int64_t frameStartNs = 0;
+  uint32_t gpuLatency = 0;
+  uint64_t lastDroppedScopes = 0;
+
+  std::vector<ProfilerSample> lastCpuFrame, lastGpuFrame;
+};
+
+// Scope guard for CPU code (also written to TraceRecorder), use PROFILE_SCOPE so release builds drop it
+class ProfileScope {
+public:
+  explicit ProfileScope(const char* name) : trace(name) { Profiler::GetInstance().BeginScope(name); }
+  ~ProfileScope() { Profiler::GetInstance().EndScope(); }
+
+private:
+  TraceScope trace;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#ifdef PROFILER_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
@@ -0,0 +1,123 @@
+#include "ProfilerD3D11.h"
+
+HRESULT ProfilerD3D11::Init(ID3D11Device* device, ID3D11DeviceContext* context, uint32_t framesInFlight) {
+  pDevice = device;
+  pContext = context;
+  frames.resize(framesInFlight);
+
+  D3D11_QUERY_DESC qd = {};
+  qd.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+  for (Frame& frame : frames) {
+    HRESULT hr = pDevice->CreateQuery(&qd, &frame.pDisjoint);
+    if (FAILED(hr))
+      return hr;
+  }
+  return S_OK;
+}
+
+void ProfilerD3D11::Release() {
+  for (Frame& frame : frames) {
+    if (frame.pDisjoint) frame.pDisjoint->Release();
+    for (auto stamp : frame.stamps)
+      stamp->Release();
+  }
+  frames.clear();
+  recording = nullptr;
+  current = oldest = 0;
+}
+
+uint32_t ProfilerD3D11::Stamp(Frame& frame) {
+  if (frame.usedStamps == frame.stamps.size()) {
+    if (frame.stamps.size() >= maxQueriesPerFrame)
+      return ~0u;
+
+    D3D11_QUERY_DESC qd = {};
+    qd.Query = D3D11_QUERY_TIMESTAMP;
+    ID3D11Query* query = nullptr;
+    if (FAILED(pDevice->CreateQuery(&qd, &query)))
+      return ~0u;
+    frame.stamps.push_back(query);
+  }
+
+  pContext->End(frame.stamps[frame.usedStamps]);
+  return frame.usedStamps++;
+}
+
+void ProfilerD3D11::BeginFrame(uint64_t index) {
+  // All frames in flight: this one is not timed
+  recording = nullptr;
+  if (frames.empty() || frames[current].pending)
+    return;
+
+  Frame& frame = frames[current];
+  frame.scopes.clear();
+  frame.open.clear();
+  frame.usedStamps = 0;
+  frame.index = index;
+  pContext->Begin(frame.pDisjoint);
+  recording = &frame;
+}
+
+void ProfilerD3D11::BeginScope(uint32_t node) {
+  if (!recording)
+    return;
+
+  recording->open.push_back((uint32_t)recording->scopes.size());
+  recording->scopes.push_back({ node, Stamp(*recording), ~0u });
+}
+
+void ProfilerD3D11::EndScope(uint32_t node) {
+  if (!recording || recording->open.empty())
+    return;
+
+  Scope& scope = recording->scopes[recording->open.back()];
+  recording->open.pop_back();
+  if (scope.node == node)
+    scope.endQuery = Stamp(*recording);
+}
+
+void ProfilerD3D11::EndFrame() {
+  if (!recording)
+    return;
+
+  pContext->End(recording->pDisjoint);
+  recording->pending = true;
+  recording = nullptr;
+  current = (current + 1) % frames.size();
+}
+
+bool ProfilerD3D11::Poll(uint64_t& index, std::vector<ProfilerSample>& samples) {
+  if (frames.empty() || !frames[oldest].pending)
+    return false;
+
+  Frame& frame = frames[oldest];
+  D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+  if (pContext->GetData(frame.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+    return false;
+
+  // Timestamps are done once disjoint query is
+  std::vector<UINT64> stamps(frame.usedStamps);
+  for (uint32_t i = 0; i < frame.usedStamps; i++)
+    if (pContext->GetData(frame.stamps[i], &stamps[i], sizeof(UINT64), 0) != S_OK)
+      return false;
+
+  samples.clear();
+  if (!disjoint.Disjoint && frame.usedStamps > 0) {
+    double toMs = 1000.0 / disjoint.Frequency;
+    for (const Scope& scope : frame.scopes) {
+      if (scope.beginQuery == ~0u || scope.endQuery == ~0u)
+        continue;
+
+      ProfilerSample sample;
+      sample.node = scope.node;
+      sample.startMs = (float)((stamps[scope.beginQuery] - stamps[0]) * toMs);
+      sample.endMs = (float)((stamps[scope.endQuery] - stamps[0]) * toMs);
+      samples.push_back(sample);
+    }
+  }
+
+  index = frame.index;
+  frame.pending = false;
+  oldest = (oldest + 1) % frames.size();
+  return true;
+}
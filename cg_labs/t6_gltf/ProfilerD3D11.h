@@ -0,0 +1,49 @@
+#pragma once
+
+#include <d3d11.h>
+#include <vector>
+
+#include "Profiler.h"
+
+// GPU timer of Profiler: timestamp query pair per scope and disjoint query per frame.
+// Frames are kept in a ring and read without flushing, so results come a few frames late.
+class ProfilerD3D11 : public ProfilerGpuTimer {
+public:
+  HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context, uint32_t framesInFlight = 4);
+  void Release();
+
+  void BeginFrame(uint64_t frame) override;
+  void BeginScope(uint32_t node) override;
+  void EndScope(uint32_t node) override;
+  void EndFrame() override;
+  bool Poll(uint64_t& frame, std::vector<ProfilerSample>& samples) override;
+
+  // Scopes beyond the limit of a frame are not timed
+  static const uint32_t maxQueriesPerFrame = 512;
+
+private:
+  struct Scope {
+    uint32_t node;
+    uint32_t beginQuery, endQuery;
+  };
+
+  struct Frame {
+    ID3D11Query* pDisjoint = nullptr;
+    std::vector<ID3D11Query*> stamps;
+    std::vector<Scope> scopes;
+    std::vector<uint32_t> open; // indices into scopes
+    uint32_t usedStamps = 0;
+    uint64_t index = 0;
+    bool pending = false;
+    bool recording = false;
+  };
+
+  // Next free timestamp of the frame (created on demand), ~0u if the limit is reached
+  uint32_t Stamp(Frame& frame);
+
+  ID3D11Device* pDevice = nullptr;
+  ID3D11DeviceContext* pContext = nullptr;
+  std::vector<Frame> frames;
+  uint32_t current = 0, oldest = 0;
+  Frame* recording = nullptr;
+};
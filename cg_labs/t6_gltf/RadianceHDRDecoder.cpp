@@ -0,0 +1,347 @@
+#include "RadianceHDRDecoder.h"
+#include "HDRFormats.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RADIANCE_USE_SSE
+#include <emmintrin.h>
+#endif
+
+bool MappedFile::Open(const wchar_t* filename) {
+  Close();
+
+#ifdef _WIN32
+  HANDLE fh = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (fh == INVALID_HANDLE_VALUE)
+    return false;
+  fileHandle = fh;
+
+  LARGE_INTEGER fileSize = {};
+  if (!GetFileSizeEx(fh, &fileSize) || fileSize.QuadPart == 0) {
+    Close();
+    return false;
+  }
+
+  mappingHandle = CreateFileMappingW(fh, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mappingHandle) {
+    Close();
+    return false;
+  }
+
+  data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  if (!data) {
+    Close();
+    return false;
+  }
+  size = (size_t)fileSize.QuadPart;
+#else
+  std::wstring wpath(filename);
+  std::string path(wpath.begin(), wpath.end());
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st = {};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  void* mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  madvise(mapped, (size_t)st.st_size, MADV_SEQUENTIAL);
+  data = static_cast<const uint8_t*>(mapped);
+  size = (size_t)st.st_size;
+#endif
+  return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+  if (data) UnmapViewOfFile(data);
+  if (mappingHandle) CloseHandle(mappingHandle);
+  if (fileHandle) CloseHandle(fileHandle);
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+#else
+  if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+  data = nullptr;
+  size = 0;
+}
+
+bool RadianceHDRDecoder::Open(const wchar_t* filename) {
+  Close();
+
+  if (!file.Open(filename)) {
+    error = "can't open file";
+    return false;
+  }
+
+  if (!ParseHeader()) {
+    file.Close();
+    return false;
+  }
+
+  scanline.resize((size_t)width * 4);
+  return true;
+}
+
+void RadianceHDRDecoder::Close() {
+  file.Close();
+  pos = 0;
+  width = height = 0;
+  nextRow = 0;
+  error.clear();
+}
+
+bool RadianceHDRDecoder::ParseHeader() {
+  const char* text = reinterpret_cast<const char*>(file.GetData());
+  size_t size = file.GetSize();
+
+  auto readLine = [&](std::string& line) {
+    line.clear();
+    while (pos < size && text[pos] != '\n')
+      line += text[pos++];
+    if (pos >= size)
+      return false;
+    pos++;
+    return true;
+  };
+
+  std::string line;
+  if (!readLine(line) || (line != "#?RADIANCE" && line != "#?RGBE")) {
+    error = "not a Radiance HDR file";
+    return false;
+  }
+
+  // Variables up to the empty line
+  bool formatOk = false;
+  while (true) {
+    if (!readLine(line)) {
+      error = "unexpected end of header";
+      return false;
+    }
+    if (line.empty())
+      break;
+    if (line == "FORMAT=32-bit_rle_rgbe")
+      formatOk = true;
+    else if (line.compare(0, 7, "FORMAT=") == 0) {
+      error = "unsupported pixel format " + line;
+      return false;
+    }
+  }
+  if (!formatOk) {
+    error = "no FORMAT in header";
+    return false;
+  }
+
+  // Resolution string
+  if (!readLine(line)) {
+    error = "no resolution string";
+    return false;
+  }
+
+  int h = 0, w = 0;
+  char yAxis[3] = {}, xAxis[3] = {};
+  if (sscanf(line.c_str(), "%2s %d %2s %d", yAxis, &h, xAxis, &w) != 4 ||
+      strcmp(yAxis, "-Y") != 0 || strcmp(xAxis, "+X") != 0 || w <= 0 || h <= 0) {
+    error = "unsupported resolution string " + line;
+    return false;
+  }
+
+  width = (uint32_t)w;
+  height = (uint32_t)h;
+  return true;
+}
+
+bool RadianceHDRDecoder::DecodeScanline(uint8_t* rgbe) {
+  const uint8_t* data = file.GetData();
+  size_t size = file.GetSize();
+
+  if (pos + 4 > size)
+    return false;
+
+  // New RLE: 2, 2, width (big endian), then each component run length encoded separately
+  bool newRLE = width >= 8 && width < 0x8000 && data[pos] == 2 && data[pos + 1] == 2 && !(data[pos + 2] & 0x80);
+  if (newRLE) {
+    if (((uint32_t)data[pos + 2] << 8 | data[pos + 3]) != width)
+      return false;
+    pos += 4;
+
+    for (uint32_t c = 0; c < 4; c++) {
+      uint32_t x = 0;
+      while (x < width) {
+        if (pos >= size)
+          return false;
+        uint32_t count = data[pos++];
+
+        if (count > 128) {
+          count -= 128;
+          if (count > width - x || pos >= size)
+            return false;
+          uint8_t value = data[pos++];
+          for (uint32_t i = 0; i < count; i++)
+            rgbe[(x++) * 4 + c] = value;
+        }
+        else {
+          if (count == 0 || count > width - x || pos + count > size)
+            return false;
+          for (uint32_t i = 0; i < count; i++)
+            rgbe[(x++) * 4 + c] = data[pos++];
+        }
+      }
+    }
+    return true;
+  }
+
+  // Flat pixels with old style runs (1, 1, 1, count repeats previous pixel)
+  uint32_t x = 0, shift = 0;
+  while (x < width) {
+    if (pos + 4 > size)
+      return false;
+    const uint8_t* p = data + pos;
+    pos += 4;
+
+    if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+      if (x == 0)
+        return false;
+      uint32_t count = (uint32_t)p[3] << shift;
+      if (count > width - x)
+        return false;
+      for (uint32_t i = 0; i < count; i++, x++)
+        memcpy(rgbe + x * 4, rgbe + (x - 1) * 4, 4);
+      shift += 8;
+    }
+    else {
+      memcpy(rgbe + (x++) * 4, p, 4);
+      shift = 0;
+    }
+  }
+  return true;
+}
+
+void RadianceHDRDecoder::RGBEToFloat(const uint8_t* rgbe, float* dst, size_t count) {
+  size_t i = 0;
+#ifdef RADIANCE_USE_SSE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i expBias = _mm_set1_epi32(136 - 127);
+  const __m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  for (; i < count; i++) {
+    int packed;
+    memcpy(&packed, rgbe + i * 4, 4);
+    __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+    // scale = 2^(e - 136) built from exponent bits; e <= 9 gives denormals which are flushed to 0
+    __m128i e = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i scaleBits = _mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(e, expBias), 23), _mm_cmpgt_epi32(e, expBias));
+    __m128 rgb = _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_castsi128_ps(scaleBits));
+
+    __m128 res = _mm_or_ps(_mm_andnot_ps(alphaMask, rgb), _mm_and_ps(alphaMask, one));
+    _mm_storeu_ps(dst + i * 4, res);
+  }
+#endif
+  for (; i < count; i++) {
+    const uint8_t* p = rgbe + i * 4;
+    float scale = p[3] > 9 ? ldexpf(1.0f, (int)p[3] - 136) : 0.0f;
+    dst[i * 4 + 0] = p[0] * scale;
+    dst[i * 4 + 1] = p[1] * scale;
+    dst[i * 4 + 2] = p[2] * scale;
+    dst[i * 4 + 3] = 1.0f;
+  }
+}
+
+bool RadianceHDRDecoder::ReadRows(uint32_t rowCount, float* dst, size_t dstPitch) {
+  if (dstPitch == 0)
+    dstPitch = (size_t)width * 4;
+
+  for (uint32_t r = 0; r < rowCount; r++) {
+    if (nextRow >= height || !DecodeScanline(scanline.data())) {
+      error = "corrupted scanline";
+      return false;
+    }
+    RGBEToFloat(scanline.data(), dst + r * dstPitch, width);
+    nextRow++;
+  }
+  return true;
+}
+
+bool RadianceHDRDecoder::ReadRows(uint32_t rowCount, uint16_t* dst, size_t dstPitch) {
+  if (dstPitch == 0)
+    dstPitch = (size_t)width * 4;
+
+  std::vector<float> row((size_t)width * 4);
+  for (uint32_t r = 0; r < rowCount; r++) {
+    if (!ReadRows(1, row.data()))
+      return false;
+    HDRFormatEncoder::FloatToHalf(row.data(), dst + r * dstPitch, row.size());
+  }
+  return true;
+}
+
+bool RadianceHDRDecoder::ReadBands(uint32_t bandRows, const std::function<void(const float* rows, uint32_t firstRow, uint32_t rowCount)>& callback) {
+  bandRows = std::max(bandRows, 1u);
+  std::vector<float> band((size_t)width * 4 * bandRows);
+
+  while (nextRow < height) {
+    uint32_t firstRow = nextRow;
+    uint32_t count = std::min(bandRows, height - nextRow);
+    if (!ReadRows(count, band.data()))
+      return false;
+    callback(band.data(), firstRow, count);
+  }
+  return true;
+}
+
+bool RadianceHDRDecoder::ReadImage(HDRImage& image, uint32_t downsample) {
+  TRACE_SCOPE("HDR decode");
+  downsample = std::max(downsample, 1u);
+  if (downsample == 1) {
+    image.Resize(width, height);
+    return ReadRows(height - nextRow, image.data.data());
+  }
+
+  // Average downsample x downsample boxes band by band
+  uint32_t dstWidth = std::max(width / downsample, 1u), dstHeight = std::max(height / downsample, 1u);
+  image.Resize(dstWidth, dstHeight);
+
+  return ReadBands(downsample, [&](const float* rows, uint32_t firstRow, uint32_t rowCount) {
+    uint32_t dstY = firstRow / downsample;
+    if (dstY >= dstHeight)
+      return;
+
+    uint32_t boxWidth = width / dstWidth;
+    float weight = 1.0f / (boxWidth * rowCount);
+    for (uint32_t x = 0; x < dstWidth; x++) {
+      float* out = image.Texel(x, dstY);
+      float sum[4] = { 0, 0, 0, 0 };
+      for (uint32_t r = 0; r < rowCount; r++)
+        for (uint32_t i = 0; i < boxWidth; i++) {
+          const float* in = rows + ((size_t)r * width + x * boxWidth + i) * 4;
+          for (int c = 0; c < 4; c++)
+            sum[c] += in[c];
+        }
+      for (int c = 0; c < 4; c++)
+        out[c] = sum[c] * weight;
+    }
+  });
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CubeMapConverter.h"
+
+// Read only memory mapping of whole file
+class MappedFile {
+public:
+  MappedFile() {};
+  ~MappedFile() { Close(); };
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const wchar_t* filename);
+  void Close();
+
+  const uint8_t* GetData() const { return data; }
+  size_t GetSize() const { return size; }
+
+private:
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#endif
+};
+
+// Radiance RGBE (.hdr) decoder.
+// Scanlines are decoded sequentially straight from the mapped file, so the image
+// can be consumed in row bands without keeping the whole float copy in memory.
+class RadianceHDRDecoder {
+public:
+  // Parses header; only 32-bit_rle_rgbe with standard "-Y H +X W" orientation is supported
+  bool Open(const wchar_t* filename);
+  void Close();
+
+  uint32_t GetWidth() const { return width; }
+  uint32_t GetHeight() const { return height; }
+  uint32_t GetNextRow() const { return nextRow; }
+  const std::string& GetError() const { return error; }
+
+  // Decode next rowCount rows (RGBA, alpha = 1); pitch is in elements, 0 - width * 4
+  bool ReadRows(uint32_t rowCount, float* dst, size_t dstPitch = 0);
+  bool ReadRows(uint32_t rowCount, uint16_t* dst, size_t dstPitch = 0);
+
+  // Decode rest of the image by bands of bandRows rows; callback gets RGBA float rows
+  bool ReadBands(uint32_t bandRows, const std::function<void(const float* rows, uint32_t firstRow, uint32_t rowCount)>& callback);
+
+  // Whole image, optionally box-downsampled by integer factor while streaming
+  bool ReadImage(HDRImage& image, uint32_t downsample = 1);
+
+  // RGBE texels to RGBA float, SSE2 for one texel per register if available
+  static void RGBEToFloat(const uint8_t* rgbe, float* dst, size_t count);
+
+private:
+  bool ParseHeader();
+  bool DecodeScanline(uint8_t* rgbe);
+
+  MappedFile file;
+  size_t pos = 0;
+  uint32_t width = 0, height = 0;
+  uint32_t nextRow = 0;
+  std::vector<uint8_t> scanline; // RGBE of one row
+  std::string error;
+};
@@ -0,0 +1,52 @@
+#include "ReadbackRing.h"
+
+#include <algorithm>
+
+void ReadbackRing::Resize(uint32_t size) {
+  entries.assign(std::max(size, 1u), Entry());
+  Reset();
+}
+
+void ReadbackRing::Reset() {
+  oldest = 0;
+  inFlight = 0;
+  stats = ReadbackRingStats();
+}
+
+bool ReadbackRing::Submit(ReadbackSlots& slots, uint64_t frame, double time) {
+  if (inFlight == entries.size()) {
+    stats.skipped++;
+    return false;
+  }
+
+  uint32_t slot = (oldest + inFlight) % (uint32_t)entries.size();
+  entries[slot].frame = frame;
+  entries[slot].time = time;
+  slots.Copy(slot);
+  inFlight++;
+  stats.submitted++;
+  return true;
+}
+
+bool ReadbackRing::Poll(ReadbackSlots& slots, uint64_t currentFrame, ReadbackResult& result) {
+  // Copies finish in order, so the first unfinished one stops the poll
+  bool hasResult = false;
+  while (inFlight > 0) {
+    float value;
+    if (!slots.TryRead(oldest, value))
+      break;
+
+    const Entry& entry = entries[oldest];
+    result.value = value;
+    result.frame = entry.frame;
+    result.submitTime = entry.time;
+    result.latencyFrames = (uint32_t)(currentFrame - entry.frame);
+    stats.maxLatencyFrames = std::max(stats.maxLatencyFrames, result.latencyFrames);
+    stats.read++;
+    hasResult = true;
+
+    oldest = (oldest + 1) % (uint32_t)entries.size();
+    inFlight--;
+  }
+  return hasResult;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Storage of readback ring: N slots, each with its own copy destination and fence.
+// Postprocessing implements it with staging textures and event queries, a fake with
+// scripted readiness may be plugged instead.
+class ReadbackSlots {
+public:
+  virtual ~ReadbackSlots() = default;
+
+  // Enqueue GPU copy of current source value into the slot and signal its fence
+  virtual void Copy(uint32_t slot) = 0;
+
+  // Non-blocking read of the slot, false if the copy is not finished yet
+  virtual bool TryRead(uint32_t slot, float& value) = 0;
+};
+
+struct ReadbackResult {
+  float value = 0.0f;
+  uint64_t frame = 0;       // frame which value was copied at
+  double submitTime = 0.0;  // caller's time of that frame
+  uint32_t latencyFrames = 0;
+};
+
+struct ReadbackRingStats {
+  uint64_t submitted = 0;
+  uint64_t read = 0;
+  uint64_t skipped = 0; // frames without free slot
+  uint32_t maxLatencyFrames = 0;
+};
+
+// Ring of in-flight GPU -> CPU copies of a single value. Every frame a copy is submitted
+// into a free slot and finished copies are read in submission order, so the value
+// arrives a few frames late instead of stalling the CPU on Map.
+class ReadbackRing {
+public:
+  explicit ReadbackRing(uint32_t size = 3) { Resize(size); }
+
+  // Drops all in-flight copies
+  void Resize(uint32_t size);
+  void Reset();
+
+  // Submit copy of this frame, returns false (frame skipped) if all slots are in flight
+  bool Submit(ReadbackSlots& slots, uint64_t frame, double time);
+
+  // Reads finished copies, result is the newest of them; returns false if nothing has arrived
+  bool Poll(ReadbackSlots& slots, uint64_t currentFrame, ReadbackResult& result);
+
+  uint32_t GetSize() const { return (uint32_t)entries.size(); }
+  uint32_t GetInFlight() const { return inFlight; }
+  const ReadbackRingStats& GetStats() const { return stats; }
+
+private:
+  struct Entry {
+    uint64_t frame = 0;
+    double time = 0.0;
+  };
+
+  std::vector<Entry> entries;
+  uint32_t oldest = 0;   // slot of the oldest in-flight copy
+  uint32_t inFlight = 0;
+  ReadbackRingStats stats;
+};
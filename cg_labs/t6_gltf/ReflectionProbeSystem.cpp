@@ -0,0 +1,246 @@
+#include "ReflectionProbeSystem.h"
+#include "renderer.h"
+
+namespace {
+  // Same faces as HDRCubeMapGenerator views
+  const XMFLOAT3 FACE_DIRS[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+  const XMFLOAT3 FACE_UPS[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+}
+
+HRESULT ReflectionProbeSystem::Init(ID3D11Device* device, ID3D11DeviceContext* context) {
+  mProjection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.01f, 100.0f);
+
+  HRESULT hr = prefilter.Init(device, context);
+  if (FAILED(hr))
+    return hr;
+
+  hr = CreateCaptureTargets(device);
+  if (FAILED(hr))
+    return hr;
+
+  return CreateArrays(device);
+}
+
+HRESULT ReflectionProbeSystem::CreateCaptureTargets(ID3D11Device* device) {
+  // Cube map rendered face by face, mips are generated for prefiltering
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+  desc.Width = g_captureSize;
+  desc.Height = g_captureSize;
+  desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+  desc.MipLevels = 0;
+  desc.ArraySize = 6;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+
+  HRESULT hr = device->CreateTexture2D(&desc, nullptr, &g_pCaptureTexture);
+  if (FAILED(hr))
+    return hr;
+
+  hr = device->CreateShaderResourceView(g_pCaptureTexture, nullptr, &g_pCaptureSRV);
+  if (FAILED(hr))
+    return hr;
+
+  for (UINT face = 0; face < 6; face++) {
+    D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+    rtvDesc.Format = desc.Format;
+    rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
+    rtvDesc.Texture2DArray.MipSlice = 0;
+    rtvDesc.Texture2DArray.FirstArraySlice = face;
+    rtvDesc.Texture2DArray.ArraySize = 1;
+
+    hr = device->CreateRenderTargetView(g_pCaptureTexture, &rtvDesc, &g_pCaptureRTV[face]);
+    if (FAILED(hr))
+      return hr;
+  }
+
+  D3D11_TEXTURE2D_DESC depthDesc = {};
+  depthDesc.Format = DXGI_FORMAT_D32_FLOAT;
+  depthDesc.Width = g_captureSize;
+  depthDesc.Height = g_captureSize;
+  depthDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+  depthDesc.Usage = D3D11_USAGE_DEFAULT;
+  depthDesc.MipLevels = 1;
+  depthDesc.ArraySize = 1;
+  depthDesc.SampleDesc.Count = 1;
+  depthDesc.SampleDesc.Quality = 0;
+
+  hr = device->CreateTexture2D(&depthDesc, nullptr, &g_pCaptureDepth);
+  if (FAILED(hr))
+    return hr;
+
+  return device->CreateDepthStencilView(g_pCaptureDepth, nullptr, &g_pCaptureDSV);
+}
+
+HRESULT ReflectionProbeSystem::CreateArrays(ID3D11Device* device) {
+  g_arraySlots = max(manager.GetParams().cacheSlots, 1u);
+
+  D3D11_TEXTURE2D_DESC desc = {};
+  desc.Format = ToDXGIFormat(HDRTextureFormat::r11g11b10f); // format of IBLMapsGenerator maps
+  desc.Width = irradienceSize;
+  desc.Height = irradienceSize;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+  desc.MipLevels = 1;
+  desc.ArraySize = 6 * g_arraySlots;
+  desc.SampleDesc.Count = 1;
+  desc.SampleDesc.Quality = 0;
+
+  HRESULT hr = device->CreateTexture2D(&desc, nullptr, &g_pIRRArray);
+  if (FAILED(hr))
+    return hr;
+
+  D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+  srvDesc.Format = desc.Format;
+  srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+  srvDesc.TextureCubeArray.MostDetailedMip = 0;
+  srvDesc.TextureCubeArray.MipLevels = 1;
+  srvDesc.TextureCubeArray.First2DArrayFace = 0;
+  srvDesc.TextureCubeArray.NumCubes = g_arraySlots;
+
+  hr = device->CreateShaderResourceView(g_pIRRArray, &srvDesc, &g_pIRRArraySRV);
+  if (FAILED(hr))
+    return hr;
+
+  desc.Width = prefilteredSize;
+  desc.Height = prefilteredSize;
+  desc.MipLevels = prefilteredMips;
+
+  hr = device->CreateTexture2D(&desc, nullptr, &g_pPrefilArray);
+  if (FAILED(hr))
+    return hr;
+
+  srvDesc.TextureCubeArray.MipLevels = prefilteredMips;
+  return device->CreateShaderResourceView(g_pPrefilArray, &srvDesc, &g_pPrefilArraySRV);
+}
+
+void ReflectionProbeSystem::ReleaseArrays() {
+  if (g_pIRRArraySRV) g_pIRRArraySRV->Release();
+  if (g_pIRRArray) g_pIRRArray->Release();
+  if (g_pPrefilArraySRV) g_pPrefilArraySRV->Release();
+  if (g_pPrefilArray) g_pPrefilArray->Release();
+
+  g_pIRRArraySRV = nullptr;
+  g_pIRRArray = nullptr;
+  g_pPrefilArraySRV = nullptr;
+  g_pPrefilArray = nullptr;
+}
+
+void ReflectionProbeSystem::Release() {
+  ReleaseArrays();
+  prefilter.Release();
+
+  for (auto& rtv : g_pCaptureRTV)
+    if (rtv) rtv->Release();
+  if (g_pCaptureSRV) g_pCaptureSRV->Release();
+  if (g_pCaptureTexture) g_pCaptureTexture->Release();
+  if (g_pCaptureDSV) g_pCaptureDSV->Release();
+  if (g_pCaptureDepth) g_pCaptureDepth->Release();
+}
+
+HRESULT ReflectionProbeSystem::SetParams(ID3D11Device* device, const ReflectionProbeParams& params) {
+  bool resize = params.cacheSlots != manager.GetParams().cacheSlots;
+  manager.SetParams(params);
+  if (!resize)
+    return S_OK;
+
+  ReleaseArrays();
+  manager.InvalidateAll();
+  return CreateArrays(device);
+}
+
+void ReflectionProbeSystem::BeginFrame(XMFLOAT3 cameraPos) {
+  float pos[3] = { cameraPos.x, cameraPos.y, cameraPos.z };
+  manager.BeginFrame(pos);
+}
+
+ProbeShadingData ReflectionProbeSystem::GetShadingData(XMFLOAT3 pos) {
+  float p[3] = { pos.x, pos.y, pos.z };
+  ProbeBlend blend = manager.Blend(p);
+
+  ProbeShadingData data;
+  float weights[ProbeBlend::maxProbes] = {};
+  int slots[ProbeBlend::maxProbes] = {};
+  for (uint32_t i = 0; i < blend.count; i++) {
+    const ReflectionProbeDesc& desc = manager.GetDesc(blend.probes[i]);
+    weights[i] = blend.weights[i];
+    slots[i] = (int)blend.slots[i];
+    data.position[i] = XMFLOAT4(desc.position[0], desc.position[1], desc.position[2], 1.0f);
+    data.boxMin[i] = XMFLOAT4(desc.projectionMin[0], desc.projectionMin[1], desc.projectionMin[2], 0.0f);
+    data.boxMax[i] = XMFLOAT4(desc.projectionMax[0], desc.projectionMax[1], desc.projectionMax[2], 0.0f);
+  }
+  data.weights = XMFLOAT4(weights[0], weights[1], blend.skyWeight, 0.0f);
+  data.slots = XMINT4(slots[0], slots[1], (int)blend.count, 0);
+  return data;
+}
+
+HRESULT ReflectionProbeSystem::Update(ID3D11Device* device, ID3D11DeviceContext* context, const ProbeCaptureFunc& capture) {
+  manager.ScheduleCaptures(toCapture);
+  lastFrameCaptures = 0;
+
+  for (uint32_t id : toCapture) {
+    HRESULT hr = CaptureProbe(device, context, id, capture);
+    if (FAILED(hr))
+      return hr;
+
+    manager.OnCaptured(id);
+    lastFrameCaptures++;
+  }
+
+  return S_OK;
+}
+
+HRESULT ReflectionProbeSystem::CaptureProbe(ID3D11Device* device, ID3D11DeviceContext* context, uint32_t id, const ProbeCaptureFunc& capture) {
+  const ReflectionProbeDesc& desc = manager.GetDesc(id);
+  XMFLOAT3 position(desc.position[0], desc.position[1], desc.position[2]);
+  XMVECTOR eye = XMVectorSet(position.x, position.y, position.z, 1.0f);
+
+  beginEvent(L"Reflection probe capture");
+  D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (float)g_captureSize, (float)g_captureSize, 0.0f, 1.0f };
+  float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+  for (UINT face = 0; face < 6; face++) {
+    context->ClearState();
+    context->OMSetRenderTargets(1, &g_pCaptureRTV[face], g_pCaptureDSV);
+    context->RSSetViewports(1, &viewport);
+    context->ClearRenderTargetView(g_pCaptureRTV[face], clearColor);
+    context->ClearDepthStencilView(g_pCaptureDSV, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    Renderer::GetInstance().EnableDepth(true);
+
+    XMMATRIX view = XMMatrixLookToLH(eye, XMLoadFloat3(&FACE_DIRS[face]), XMLoadFloat3(&FACE_UPS[face]));
+    capture(context, view, mProjection, position);
+  }
+  context->OMSetRenderTargets(0, nullptr, nullptr);
+  context->GenerateMips(g_pCaptureSRV);
+  endEvent();
+
+  beginEvent(L"Reflection probe prefiltering");
+  HRESULT hr = prefilter.GenerateEnvironmentMaps(device, context, g_pCaptureSRV);
+  endEvent();
+  if (FAILED(hr))
+    return hr;
+
+  // Copy maps into the probe slot
+  IBLMaps maps = prefilter.GetMaps();
+  ID3D11Resource* irrMap = nullptr;
+  ID3D11Resource* prefilMap = nullptr;
+  maps.pIRRMapSRV->GetResource(&irrMap);
+  maps.pPrefilMapSRV->GetResource(&prefilMap);
+
+  UINT slot = (UINT)manager.GetSlot(id);
+  for (UINT face = 0; face < 6; face++) {
+    context->CopySubresourceRegion(g_pIRRArray, D3D11CalcSubresource(0, slot * 6 + face, 1), 0, 0, 0,
+      irrMap, D3D11CalcSubresource(0, face, 1), nullptr);
+    for (UINT mip = 0; mip < prefilteredMips; mip++)
+      context->CopySubresourceRegion(g_pPrefilArray, D3D11CalcSubresource(mip, slot * 6 + face, prefilteredMips), 0, 0, 0,
+        prefilMap, D3D11CalcSubresource(mip, face, prefilteredMips), nullptr);
+  }
+
+  irrMap->Release();
+  prefilMap->Release();
+  return S_OK;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <d3d11.h>
+#include <directxmath.h>
+#include <functional>
+#include <vector>
+
+#include "IBLMapsGenerator.h"
+#include "ReflectionProbes.h"
+
+using namespace DirectX;
+
+// Probe part of model WorldMatrixBuffer (see PBRBuffers.h)
+struct ProbeShadingData {
+  XMFLOAT4 weights = XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f); // x, y - probes, z - skybox
+  XMINT4 slots = XMINT4(0, 0, 0, 0);                   // x, y - cube array slices, z - probes count
+  XMFLOAT4 position[ProbeBlend::maxProbes] = {};
+  XMFLOAT4 boxMin[ProbeBlend::maxProbes] = {};
+  XMFLOAT4 boxMax[ProbeBlend::maxProbes] = {};
+};
+
+// Renders scene from probe position into bound render target (viewport is set)
+typedef std::function<void(ID3D11DeviceContext* context, XMMATRIX viewMatrix, XMMATRIX projectionMatrix, XMFLOAT3 position)> ProbeCaptureFunc;
+
+// Local reflection probes: scene captures prefiltered by IBLMapsGenerator and kept in cube map arrays,
+// one slice per cache slot of ReflectionProbeManager.
+class ReflectionProbeSystem {
+public:
+  ReflectionProbeSystem() {};
+
+  ReflectionProbeSystem(const ReflectionProbeParams& params, UINT captureSize = 128) : manager(params) {
+    g_captureSize = captureSize;
+  };
+
+  HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context);
+  void Release();
+
+  // Cache size change recreates arrays, probes are captured again
+  HRESULT SetParams(ID3D11Device* device, const ReflectionProbeParams& params);
+  const ReflectionProbeParams& GetParams() const { return manager.GetParams(); }
+
+  ReflectionProbeManager& GetManager() { return manager; }
+
+  void BeginFrame(XMFLOAT3 cameraPos);
+
+  // Blend of probes at object position, requests captures of probes around it
+  ProbeShadingData GetShadingData(XMFLOAT3 pos);
+
+  // Capture and prefilter probes scheduled for this frame
+  HRESULT Update(ID3D11Device* device, ID3D11DeviceContext* context, const ProbeCaptureFunc& capture);
+
+  ID3D11ShaderResourceView* GetIrradianceSRV() { return g_pIRRArraySRV; }
+  ID3D11ShaderResourceView* GetPrefilteredSRV() { return g_pPrefilArraySRV; }
+
+  UINT GetLastFrameCaptures() const { return lastFrameCaptures; }
+
+private:
+  HRESULT CreateCaptureTargets(ID3D11Device* device);
+  HRESULT CreateArrays(ID3D11Device* device);
+  void ReleaseArrays();
+
+  HRESULT CaptureProbe(ID3D11Device* device, ID3D11DeviceContext* context, uint32_t id, const ProbeCaptureFunc& capture);
+
+  static const UINT irradienceSize = 16;
+  static const UINT prefilteredSize = 64;
+  static const UINT prefilteredMips = 5; // matches MAX_REFLECTION_LOD in pbrLightable_PS
+
+  ReflectionProbeManager manager;
+  IBLMapsGenerator prefilter = IBLMapsGenerator(irradienceSize, 64, 16, prefilteredSize, 32, prefilteredMips);
+  std::vector<uint32_t> toCapture;
+  UINT lastFrameCaptures = 0;
+
+  // Scene capture cube map with mips for prefiltering
+  UINT g_captureSize = 128;
+  ID3D11Texture2D* g_pCaptureTexture = nullptr;
+  ID3D11ShaderResourceView* g_pCaptureSRV = nullptr;
+  ID3D11RenderTargetView* g_pCaptureRTV[6] = {};
+  ID3D11Texture2D* g_pCaptureDepth = nullptr;
+  ID3D11DepthStencilView* g_pCaptureDSV = nullptr;
+
+  // Prefiltered probes, 6 slices per cache slot
+  ID3D11Texture2D* g_pIRRArray = nullptr;
+  ID3D11ShaderResourceView* g_pIRRArraySRV = nullptr;
+  ID3D11Texture2D* g_pPrefilArray = nullptr;
+  ID3D11ShaderResourceView* g_pPrefilArraySRV = nullptr;
+  UINT g_arraySlots = 0;
+
+  XMMATRIX mProjection;
+};
@@ -0,0 +1,356 @@
+#include "ReflectionProbes.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  // Probes covering more cells go to the list checked on every query
+  const int64_t MAX_PROBE_CELLS = 4096;
+}
+
+void ReflectionProbeManager::SetParams(const ReflectionProbeParams& probeParams) {
+  bool regrid = probeParams.cellSize != params.cellSize;
+  params = probeParams;
+
+  // Slots beyond new cache size are lost
+  for (uint32_t slot = params.cacheSlots; slot < slotOwners.size(); slot++)
+    if (slotOwners[slot] >= 0) {
+      Probe& probe = probes[slotOwners[slot]];
+      probe.slot = -1;
+      probe.captured = false;
+    }
+  if (slotOwners.size() > params.cacheSlots)
+    slotOwners.resize(params.cacheSlots);
+
+  if (regrid) {
+    grid.clear();
+    largeProbes.clear();
+    for (uint32_t id = 0; id < probes.size(); id++)
+      if (probes[id].alive)
+        InsertToGrid(id);
+  }
+}
+
+uint32_t ReflectionProbeManager::AddProbe(const ReflectionProbeDesc& desc) {
+  uint32_t id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+  }
+  else {
+    id = (uint32_t)probes.size();
+    probes.emplace_back();
+  }
+
+  probes[id] = Probe();
+  probes[id].desc = desc;
+  probes[id].alive = true;
+  InsertToGrid(id);
+  return id;
+}
+
+void ReflectionProbeManager::UpdateProbe(uint32_t id, const ReflectionProbeDesc& desc) {
+  if (!IsAlive(id))
+    return;
+
+  RemoveFromGrid(id);
+  probes[id].desc = desc;
+  probes[id].captured = false;
+  InsertToGrid(id);
+}
+
+void ReflectionProbeManager::RemoveProbe(uint32_t id) {
+  if (!IsAlive(id))
+    return;
+
+  RemoveFromGrid(id);
+  ReleaseSlot(id);
+  probes[id].alive = false;
+  freeIds.push_back(id);
+}
+
+void ReflectionProbeManager::Clear() {
+  probes.clear();
+  freeIds.clear();
+  grid.clear();
+  largeProbes.clear();
+  slotOwners.clear();
+}
+
+void ReflectionProbeManager::Invalidate(uint32_t id) {
+  if (IsAlive(id))
+    probes[id].captured = false;
+}
+
+void ReflectionProbeManager::InvalidateAll() {
+  for (Probe& probe : probes)
+    probe.captured = false;
+}
+
+void ReflectionProbeManager::BeginFrame(const float cameraPos[3]) {
+  frame++;
+  for (int i = 0; i < 3; i++)
+    camera[i] = cameraPos[i];
+}
+
+ProbeBlend ReflectionProbeManager::Blend(const float pos[3]) {
+  ProbeBlend blend;
+
+  struct Candidate {
+    uint32_t id;
+    float weight;
+  };
+  Candidate found[16];
+  uint32_t foundCount = 0;
+
+  // Higher priority first, then higher weight
+  auto before = [this](const Candidate& a, const Candidate& b) {
+    int pa = probes[a.id].desc.priority, pb = probes[b.id].desc.priority;
+    return pa != pb ? pa > pb : a.weight > b.weight;
+  };
+
+  auto check = [&](uint32_t id) {
+    Probe& probe = probes[id];
+    float weight = InfluenceWeight(probe.desc, pos);
+    if (weight <= 0.0f)
+      return;
+
+    probe.lastUsedFrame = frame;
+    probe.requestedFrame = frame;
+    if (!probe.captured || probe.slot < 0)
+      return;
+
+    // Keep the most important ones if too many overlap: the least important is replaced
+    Candidate c = { id, weight };
+    if (foundCount < sizeof(found) / sizeof(found[0])) {
+      found[foundCount++] = c;
+      return;
+    }
+    Candidate* least = std::min_element(found, found + foundCount, [&](const Candidate& a, const Candidate& b) { return before(b, a); });
+    if (before(c, *least))
+      *least = c;
+  };
+
+  int cell[3];
+  for (int i = 0; i < 3; i++)
+    cell[i] = (int)std::floor(pos[i] / params.cellSize);
+
+  auto it = grid.find(MakeKey(cell[0], cell[1], cell[2]));
+  if (it != grid.end())
+    for (uint32_t id : it->second)
+      check(id);
+  for (uint32_t id : largeProbes)
+    check(id);
+
+  // Higher priority is layered on top, the rest of weight goes to lower ones and the sky
+  std::sort(found, found + foundCount, before);
+
+  float remaining = 1.0f;
+  for (uint32_t i = 0; i < foundCount && blend.count < ProbeBlend::maxProbes; i++) {
+    float weight = found[i].weight * remaining;
+    blend.probes[blend.count] = found[i].id;
+    blend.slots[blend.count] = (uint32_t)probes[found[i].id].slot;
+    blend.weights[blend.count] = weight;
+    blend.count++;
+    remaining -= weight;
+  }
+  blend.skyWeight = std::max(remaining, 0.0f);
+
+  return blend;
+}
+
+void ReflectionProbeManager::ScheduleCaptures(std::vector<uint32_t>& toCapture) {
+  toCapture.clear();
+
+  std::vector<uint32_t> requested;
+  for (uint32_t id = 0; id < probes.size(); id++) {
+    const Probe& probe = probes[id];
+    if (probe.alive && !probe.captured && frame - probe.requestedFrame <= 1)
+      requested.push_back(id);
+  }
+
+  auto distance2 = [this](uint32_t id) {
+    const float* p = probes[id].desc.position;
+    float d = 0;
+    for (int i = 0; i < 3; i++)
+      d += (p[i] - camera[i]) * (p[i] - camera[i]);
+    return d;
+  };
+
+  std::sort(requested.begin(), requested.end(), [&](uint32_t a, uint32_t b) {
+    int pa = probes[a].desc.priority, pb = probes[b].desc.priority;
+    return pa != pb ? pa > pb : distance2(a) < distance2(b);
+  });
+
+  for (uint32_t id : requested) {
+    if (toCapture.size() >= params.maxCapturesPerFrame)
+      break;
+
+    if (probes[id].slot < 0) {
+      int slot = AcquireSlot();
+      if (slot < 0)
+        break;
+
+      probes[id].slot = slot;
+      slotOwners[slot] = (int)id;
+    }
+    toCapture.push_back(id);
+  }
+}
+
+void ReflectionProbeManager::OnCaptured(uint32_t id) {
+  if (!IsAlive(id) || probes[id].slot < 0)
+    return;
+
+  probes[id].captured = true;
+  capturesCount++;
+}
+
+ReflectionProbeStats ReflectionProbeManager::GetStats() const {
+  ReflectionProbeStats stats;
+  for (const Probe& probe : probes) {
+    if (!probe.alive)
+      continue;
+
+    stats.probes++;
+    if (probe.captured)
+      stats.resident++;
+    else if (frame - probe.requestedFrame <= 1)
+      stats.pending++;
+  }
+  stats.captures = capturesCount;
+  stats.evictions = evictionsCount;
+  return stats;
+}
+
+float ReflectionProbeManager::InfluenceWeight(const ReflectionProbeDesc& desc, const float pos[3]) {
+  float dist = INFINITY;
+  for (int i = 0; i < 3; i++) {
+    float inside = std::min(pos[i] - desc.influenceMin[i], desc.influenceMax[i] - pos[i]);
+    if (inside < 0.0f)
+      return 0.0f;
+    dist = std::min(dist, inside);
+  }
+
+  if (desc.blendDistance <= 0.0f)
+    return 1.0f;
+
+  float t = std::min(dist / desc.blendDistance, 1.0f);
+  return t * t * (3.0f - 2.0f * t);
+}
+
+void ReflectionProbeManager::BoxProject(const ReflectionProbeDesc& desc, const float pos[3], const float dir[3], float res[3]) {
+  // Distance to the far side of the box along dir, same as ProbeDirection in pbrLightable_PS
+  float dist = INFINITY;
+  for (int i = 0; i < 3; i++) {
+    if (dir[i] == 0.0f)
+      continue;
+
+    float t1 = (desc.projectionMax[i] - pos[i]) / dir[i];
+    float t2 = (desc.projectionMin[i] - pos[i]) / dir[i];
+    dist = std::min(dist, std::max(t1, t2));
+  }
+
+  // Outside of the box - no correction
+  if (!(dist > 0.0f) || std::isinf(dist)) {
+    for (int i = 0; i < 3; i++)
+      res[i] = dir[i];
+    return;
+  }
+
+  for (int i = 0; i < 3; i++)
+    res[i] = pos[i] + dir[i] * dist - desc.position[i];
+}
+
+ReflectionProbeManager::CellKey ReflectionProbeManager::MakeKey(int x, int y, int z) const {
+  const int64_t mask = (1 << 21) - 1;
+  return ((int64_t)(x & mask) << 42) | ((int64_t)(y & mask) << 21) | (int64_t)(z & mask);
+}
+
+void ReflectionProbeManager::CellRange(const float minP[3], const float maxP[3], int cellMin[3], int cellMax[3]) const {
+  for (int i = 0; i < 3; i++) {
+    cellMin[i] = (int)std::floor(minP[i] / params.cellSize);
+    cellMax[i] = (int)std::floor(maxP[i] / params.cellSize);
+  }
+}
+
+void ReflectionProbeManager::InsertToGrid(uint32_t id) {
+  const ReflectionProbeDesc& desc = probes[id].desc;
+  int cellMin[3], cellMax[3];
+  CellRange(desc.influenceMin, desc.influenceMax, cellMin, cellMax);
+
+  int64_t cells = 1;
+  for (int i = 0; i < 3; i++)
+    cells *= std::max<int64_t>((int64_t)cellMax[i] - cellMin[i] + 1, 0);
+  if (cells > MAX_PROBE_CELLS) {
+    largeProbes.push_back(id);
+    return;
+  }
+
+  for (int z = cellMin[2]; z <= cellMax[2]; z++)
+    for (int y = cellMin[1]; y <= cellMax[1]; y++)
+      for (int x = cellMin[0]; x <= cellMax[0]; x++)
+        grid[MakeKey(x, y, z)].push_back(id);
+}
+
+void ReflectionProbeManager::RemoveFromGrid(uint32_t id) {
+  auto erase = [id](std::vector<uint32_t>& ids) {
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+  };
+
+  erase(largeProbes);
+
+  const ReflectionProbeDesc& desc = probes[id].desc;
+  int cellMin[3], cellMax[3];
+  CellRange(desc.influenceMin, desc.influenceMax, cellMin, cellMax);
+  int64_t cells = 1;
+  for (int i = 0; i < 3; i++)
+    cells *= std::max<int64_t>((int64_t)cellMax[i] - cellMin[i] + 1, 0);
+  if (cells > MAX_PROBE_CELLS)
+    return;
+
+  for (int z = cellMin[2]; z <= cellMax[2]; z++)
+    for (int y = cellMin[1]; y <= cellMax[1]; y++)
+      for (int x = cellMin[0]; x <= cellMax[0]; x++) {
+        auto it = grid.find(MakeKey(x, y, z));
+        if (it == grid.end())
+          continue;
+
+        erase(it->second);
+        if (it->second.empty())
+          grid.erase(it);
+      }
+}
+
+void ReflectionProbeManager::ReleaseSlot(uint32_t id) {
+  Probe& probe = probes[id];
+  if (probe.slot >= 0 && probe.slot < (int)slotOwners.size())
+    slotOwners[probe.slot] = -1;
+  probe.slot = -1;
+  probe.captured = false;
+}
+
+int ReflectionProbeManager::AcquireSlot() {
+  if (slotOwners.size() < params.cacheSlots)
+    slotOwners.resize(params.cacheSlots, -1);
+
+  for (uint32_t slot = 0; slot < slotOwners.size(); slot++)
+    if (slotOwners[slot] < 0)
+      return (int)slot;
+
+  // Evict least recently used probe which was not needed for keepFrames
+  int victim = -1;
+  for (uint32_t slot = 0; slot < slotOwners.size(); slot++) {
+    const Probe& probe = probes[slotOwners[slot]];
+    if (frame - probe.lastUsedFrame <= params.keepFrames)
+      continue;
+    if (victim < 0 || probe.lastUsedFrame < probes[slotOwners[victim]].lastUsedFrame)
+      victim = (int)slot;
+  }
+  if (victim < 0)
+    return -1;
+
+  ReleaseSlot((uint32_t)slotOwners[victim]);
+  evictionsCount++;
+  return victim;
+}
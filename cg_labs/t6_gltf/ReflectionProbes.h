@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct ReflectionProbeDesc {
+  float position[3] = { 0, 0, 0 };        // capture point
+  float influenceMin[3] = { -5, -5, -5 }; // probe affects shading inside this box
+  float influenceMax[3] = { 5, 5, 5 };
+  float blendDistance = 1.0f;             // weight fades to 0 over this distance towards influence border
+  float projectionMin[3] = { -5, -5, -5 }; // box for parallax correction (usually room walls)
+  float projectionMax[3] = { 5, 5, 5 };
+  int priority = 0;                        // higher priority probes are blended on top (inner rooms over halls)
+};
+
+struct ReflectionProbeParams {
+  uint32_t cacheSlots = 16;         // cube array slices for captured probes
+  uint32_t maxCapturesPerFrame = 1;
+  uint32_t keepFrames = 60;         // probe unused for this many frames may lose its slot
+  float cellSize = 8.0f;            // lookup grid cell
+};
+
+// Probes affecting one point; weights of probes and sky sum to 1
+struct ProbeBlend {
+  static const uint32_t maxProbes = 2; // fixed by pbrLightable_PS
+
+  uint32_t count = 0;
+  uint32_t probes[maxProbes] = {};
+  uint32_t slots[maxProbes] = {};
+  float weights[maxProbes] = {};
+  float skyWeight = 1.0f;
+};
+
+struct ReflectionProbeStats {
+  uint32_t probes = 0;
+  uint32_t resident = 0;    // probes with captured slot
+  uint32_t pending = 0;     // requested but not captured
+  uint64_t captures = 0;
+  uint64_t evictions = 0;
+};
+
+// CPU side of reflection probes: spatial lookup, blend weights, slot cache (LRU) and capture scheduling.
+// Probes are requested by Blend() queries, so only probes near shaded objects are captured and kept.
+class ReflectionProbeManager {
+public:
+  ReflectionProbeManager() {};
+
+  ReflectionProbeManager(const ReflectionProbeParams& probeParams) : params(probeParams) {};
+
+  void SetParams(const ReflectionProbeParams& probeParams);
+  const ReflectionProbeParams& GetParams() const { return params; }
+
+  uint32_t AddProbe(const ReflectionProbeDesc& desc);
+  void UpdateProbe(uint32_t id, const ReflectionProbeDesc& desc); // moves probe, capture becomes outdated
+  void RemoveProbe(uint32_t id);
+  void Clear();
+
+  // Capture again (scene or environment changed)
+  void Invalidate(uint32_t id);
+  void InvalidateAll();
+
+  bool IsAlive(uint32_t id) const { return id < probes.size() && probes[id].alive; }
+  const ReflectionProbeDesc& GetDesc(uint32_t id) const { return probes[id].desc; }
+  uint32_t GetProbeCapacity() const { return (uint32_t)probes.size(); }
+  int GetSlot(uint32_t id) const { return probes[id].slot; }
+  bool IsCaptured(uint32_t id) const { return probes[id].captured; }
+
+  // Frame counter for LRU, camera position orders captures
+  void BeginFrame(const float cameraPos[3]);
+
+  // Weights at point; marks found probes as used, not captured ones are requested and skipped
+  ProbeBlend Blend(const float pos[3]);
+
+  // Probes to capture this frame (slots are assigned), at most maxCapturesPerFrame
+  void ScheduleCaptures(std::vector<uint32_t>& toCapture);
+  void OnCaptured(uint32_t id);
+
+  ReflectionProbeStats GetStats() const;
+
+  // Weight of probe at point without blending with others, 0 outside influence box
+  static float InfluenceWeight(const ReflectionProbeDesc& desc, const float pos[3]);
+
+  // Parallax corrected lookup direction: ray from pos hits projection box, result points from probe center to the hit
+  static void BoxProject(const ReflectionProbeDesc& desc, const float pos[3], const float dir[3], float res[3]);
+
+private:
+  struct Probe {
+    ReflectionProbeDesc desc;
+    bool alive = false;
+    bool captured = false;
+    int slot = -1;
+    uint64_t lastUsedFrame = 0;
+    uint64_t requestedFrame = 0;
+  };
+
+  typedef int64_t CellKey;
+
+  CellKey MakeKey(int x, int y, int z) const;
+  void CellRange(const float minP[3], const float maxP[3], int cellMin[3], int cellMax[3]) const;
+  void InsertToGrid(uint32_t id);
+  void RemoveFromGrid(uint32_t id);
+  void ReleaseSlot(uint32_t id);
+  int AcquireSlot();
+
+  ReflectionProbeParams params;
+  std::vector<Probe> probes;
+  std::vector<uint32_t> freeIds;
+  std::unordered_map<CellKey, std::vector<uint32_t>> grid;
+  std::vector<uint32_t> largeProbes; // influence covers too many cells, checked for every query
+
+  std::vector<int> slotOwners; // probe id per slot, -1 - free
+  uint64_t frame = 1;
+  float camera[3] = { 0, 0, 0 };
+  uint64_t capturesCount = 0;
+  uint64_t evictionsCount = 0;
+};
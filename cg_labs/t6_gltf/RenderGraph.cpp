@@ -0,0 +1,253 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace {
+  void AddUnique(std::vector<uint32_t>& list, uint32_t value) {
+    if (std::find(list.begin(), list.end(), value) == list.end())
+      list.push_back(value);
+  }
+}
+
+void RenderGraph::Reset() {
+  resources.clear();
+  passes.clear();
+  order.clear();
+  error.clear();
+  compiled = false;
+}
+
+uint32_t RenderGraph::CreateResource(const std::string& name, const TransientResourceDesc& desc) {
+  Resource resource;
+  resource.name = name;
+  resource.desc = desc;
+  resources.push_back(resource);
+  return (uint32_t)resources.size() - 1;
+}
+
+uint32_t RenderGraph::ImportResource(const std::string& name) {
+  Resource resource;
+  resource.name = name;
+  resource.imported = true;
+  resources.push_back(resource);
+  return (uint32_t)resources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(uint32_t resource) {
+  resources[resource].output = true;
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, PassFunc func) {
+  Pass pass;
+  pass.name = name;
+  pass.func = func;
+  passes.push_back(pass);
+  return (uint32_t)passes.size() - 1;
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t resource) {
+  AddUnique(passes[pass].reads, resource);
+  AddUnique(resources[resource].readers, pass);
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t resource) {
+  AddUnique(passes[pass].writes, resource);
+  AddUnique(resources[resource].writers, pass);
+}
+
+void RenderGraph::SetSideEffect(uint32_t pass) {
+  passes[pass].sideEffect = true;
+}
+
+bool RenderGraph::Compile() {
+  order.clear();
+  error.clear();
+  compiled = false;
+
+  for (const Resource& resource : resources) {
+    if (!resource.imported && resource.writers.empty() && !resource.readers.empty()) {
+      error = "Transient resource '" + resource.name + "' is read but never written";
+      return false;
+    }
+  }
+
+  Cull();
+  if (!Sort())
+    return false;
+  ComputeLifetimes();
+  ComputeBarriers();
+
+  compiled = true;
+  return true;
+}
+
+void RenderGraph::Cull() {
+  // Walk back from side effects and outputs through writers of read resources
+  std::vector<uint32_t> stack;
+  for (uint32_t p = 0; p < (uint32_t)passes.size(); p++) {
+    Pass& pass = passes[p];
+    pass.culled = true;
+    pass.barriers.clear();
+
+    bool root = pass.sideEffect;
+    for (uint32_t r : pass.writes)
+      root |= resources[r].output;
+    if (root)
+      stack.push_back(p);
+  }
+
+  while (!stack.empty()) {
+    uint32_t p = stack.back();
+    stack.pop_back();
+    if (!passes[p].culled)
+      continue;
+
+    passes[p].culled = false;
+    for (uint32_t r : passes[p].reads)
+      for (uint32_t writer : resources[r].writers)
+        if (passes[writer].culled)
+          stack.push_back(writer);
+  }
+}
+
+bool RenderGraph::Sort() {
+  // Dependencies between kept passes
+  std::vector<std::vector<uint32_t>> next(passes.size());
+  std::vector<uint32_t> incoming(passes.size(), 0);
+  auto addEdge = [&](uint32_t from, uint32_t to) {
+    if (from == to || passes[from].culled || passes[to].culled)
+      return;
+    if (std::find(next[from].begin(), next[from].end(), to) != next[from].end())
+      return;
+    next[from].push_back(to);
+    incoming[to]++;
+  };
+
+  for (const Resource& resource : resources) {
+    for (size_t i = 1; i < resource.writers.size(); i++)
+      addEdge(resource.writers[i - 1], resource.writers[i]);
+
+    for (uint32_t reader : resource.readers) {
+      bool readerWrites = std::find(resource.writers.begin(), resource.writers.end(), reader) != resource.writers.end();
+      for (uint32_t writer : resource.writers) {
+        // Read-modify-write pass sees only writers declared before it
+        if (!readerWrites || writer < reader)
+          addEdge(writer, reader);
+      }
+    }
+  }
+
+  // Kahn's algorithm, declaration order among ready passes
+  std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+  uint32_t kept = 0;
+  for (uint32_t p = 0; p < (uint32_t)passes.size(); p++) {
+    if (passes[p].culled)
+      continue;
+    kept++;
+    if (incoming[p] == 0)
+      ready.push(p);
+  }
+
+  while (!ready.empty()) {
+    uint32_t p = ready.top();
+    ready.pop();
+    order.push_back(p);
+    for (uint32_t n : next[p])
+      if (--incoming[n] == 0)
+        ready.push(n);
+  }
+
+  if (order.size() != kept) {
+    error = "Render graph has a dependency cycle";
+    order.clear();
+    return false;
+  }
+  return true;
+}
+
+void RenderGraph::ComputeLifetimes() {
+  for (Resource& resource : resources)
+    resource.lifetime = Lifetime();
+
+  for (uint32_t pos = 0; pos < (uint32_t)order.size(); pos++) {
+    const Pass& pass = passes[order[pos]];
+    auto touch = [&](uint32_t r) {
+      Lifetime& lifetime = resources[r].lifetime;
+      if (lifetime.first == invalidId)
+        lifetime.first = pos;
+      lifetime.last = pos;
+    };
+
+    for (uint32_t r : pass.reads)
+      touch(r);
+    for (uint32_t r : pass.writes)
+      touch(r);
+  }
+}
+
+void RenderGraph::ComputeBarriers() {
+  enum class State { none, written, read };
+  std::vector<State> states(resources.size(), State::none);
+
+  for (uint32_t p : order) {
+    Pass& pass = passes[p];
+    for (uint32_t r : pass.reads) {
+      if (states[r] == State::written)
+        pass.barriers.push_back({ RenderGraphBarrier::Kind::unbindRenderTargets, r });
+      states[r] = State::read;
+    }
+
+    for (uint32_t r : pass.writes) {
+      bool alsoRead = std::find(pass.reads.begin(), pass.reads.end(), r) != pass.reads.end();
+      if (states[r] == State::read && !alsoRead)
+        pass.barriers.push_back({ RenderGraphBarrier::Kind::unbindShaderResources, r });
+      states[r] = State::written;
+    }
+  }
+}
+
+bool RenderGraph::Execute(RenderGraphBackend& backend) {
+  if (!compiled)
+    return false;
+
+  std::vector<bool> alive(resources.size(), false);
+  for (uint32_t pos = 0; pos < (uint32_t)order.size(); pos++) {
+    Pass& pass = passes[order[pos]];
+
+    for (uint32_t r = 0; r < (uint32_t)resources.size(); r++) {
+      if (resources[r].imported || resources[r].lifetime.first != pos)
+        continue;
+      if (!backend.Acquire(r, resources[r].desc)) {
+        // Passes would run on a missing resource
+        for (uint32_t acquired = 0; acquired < (uint32_t)resources.size(); acquired++)
+          if (alive[acquired])
+            backend.Release(acquired);
+        error = "Transient resource '" + resources[r].name + "' could not be acquired for pass '" + pass.name + "'";
+        return false;
+      }
+      alive[r] = true;
+    }
+
+    // One unbind of each kind is enough
+    bool unbound[2] = { false, false };
+    for (const RenderGraphBarrier& barrier : pass.barriers) {
+      int kind = (int)barrier.kind;
+      if (!unbound[kind])
+        backend.Barrier(barrier);
+      unbound[kind] = true;
+    }
+
+    if (pass.func)
+      pass.func();
+
+    for (uint32_t r = 0; r < (uint32_t)resources.size(); r++) {
+      if (!resources[r].imported && resources[r].lifetime.last == pos) {
+        backend.Release(r);
+        alive[r] = false;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "TransientResourcePool.h"
+
+// Binding change needed before a pass so D3D11 doesn't silently drop conflicting views
+struct RenderGraphBarrier {
+  enum class Kind : int
+  {
+    unbindRenderTargets = 0,   // resource written by an earlier pass is read now
+    unbindShaderResources = 1, // resource read by an earlier pass is written now
+  };
+
+  Kind kind = Kind::unbindRenderTargets;
+  uint32_t resource = 0;
+};
+
+// Allocates transient resources and applies barriers while the graph executes.
+// RenderGraphD3D implements it over RenderTargetPool, a fake which only logs calls may be plugged instead.
+class RenderGraphBackend {
+public:
+  virtual ~RenderGraphBackend() = default;
+
+  virtual bool Acquire(uint32_t resource, const TransientResourceDesc& desc) = 0;
+  virtual void Release(uint32_t resource) = 0;
+  virtual void Barrier(const RenderGraphBarrier& barrier) = 0;
+};
+
+// Frame passes with declared reads and writes of named resources. Graph is rebuilt every frame:
+// Reset, declare resources and passes, Compile (pure CPU), Execute.
+// Compile culls passes whose results are not used by outputs or side effect passes, orders passes
+// (readers after all writers of a resource, writers in declaration order), computes lifetimes of
+// transient resources (so the pool aliases them) and barriers of view hazards.
+class RenderGraph {
+public:
+  typedef std::function<void()> PassFunc;
+
+  static const uint32_t invalidId = ~0u;
+
+  // Position range in execution order where transient resource is alive
+  struct Lifetime {
+    uint32_t first = invalidId;
+    uint32_t last = invalidId;
+  };
+
+  void Reset();
+
+  uint32_t CreateResource(const std::string& name, const TransientResourceDesc& desc);
+  uint32_t ImportResource(const std::string& name); // external, never allocated by the graph
+  void MarkOutput(uint32_t resource);               // writers of outputs are never culled
+
+  uint32_t AddPass(const std::string& name, PassFunc func);
+  void Read(uint32_t pass, uint32_t resource);
+  void Write(uint32_t pass, uint32_t resource);
+  void SetSideEffect(uint32_t pass);                // e.g. readback, never culled
+
+  // Returns false on invalid graph (cycle, transient read without writer), see GetError
+  bool Compile();
+
+  // Returns false if the backend fails to acquire a transient resource: the frame stops before
+  // the first pass using it, resources acquired so far are released, see GetError
+  bool Execute(RenderGraphBackend& backend);
+
+  // Compiled graph
+  const std::vector<uint32_t>& GetOrder() const { return order; }
+  bool IsCulled(uint32_t pass) const { return passes[pass].culled; }
+  const std::vector<RenderGraphBarrier>& GetBarriers(uint32_t pass) const { return passes[pass].barriers; }
+  Lifetime GetLifetime(uint32_t resource) const { return resources[resource].lifetime; }
+  const std::string& GetError() const { return error; }
+
+  uint32_t GetPassCount() const { return (uint32_t)passes.size(); }
+  uint32_t GetResourceCount() const { return (uint32_t)resources.size(); }
+  const std::string& GetPassName(uint32_t pass) const { return passes[pass].name; }
+  const std::string& GetResourceName(uint32_t resource) const { return resources[resource].name; }
+  bool IsImported(uint32_t resource) const { return resources[resource].imported; }
+
+private:
+  struct Resource {
+    std::string name;
+    TransientResourceDesc desc;
+    bool imported = false;
+    bool output = false;
+    std::vector<uint32_t> writers; // in declaration order
+    std::vector<uint32_t> readers;
+    Lifetime lifetime;
+  };
+
+  struct Pass {
+    std::string name;
+    PassFunc func;
+    std::vector<uint32_t> reads;
+    std::vector<uint32_t> writes;
+    bool sideEffect = false;
+    bool culled = true;
+    std::vector<RenderGraphBarrier> barriers;
+  };
+
+  void Cull();
+  bool Sort();
+  void ComputeLifetimes();
+  void ComputeBarriers();
+
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<uint32_t> order;
+  std::string error;
+  bool compiled = false;
+};
@@ -0,0 +1,50 @@
+#include "RenderGraphD3D.h"
+
+void RenderGraphD3D::Begin(ID3D11Device* pDevice, ID3D11DeviceContext* pContext)
+{
+	this->pDevice = pDevice;
+	this->pContext = pContext;
+	textures.clear();
+}
+
+void RenderGraphD3D::Import(uint32_t resource, RenderTargetTexture* rtt)
+{
+	if (resource >= textures.size())
+		textures.resize(resource + 1, nullptr);
+	textures[resource] = rtt;
+}
+
+RenderTargetTexture* RenderGraphD3D::GetTexture(uint32_t resource) const
+{
+	return resource < textures.size() ? textures[resource] : nullptr;
+}
+
+bool RenderGraphD3D::Acquire(uint32_t resource, const TransientResourceDesc& desc)
+{
+	RenderTargetTexture* rtt = pool.Acquire(pDevice, pContext, desc);
+	Import(resource, rtt);
+	return rtt != nullptr;
+}
+
+void RenderGraphD3D::Release(uint32_t resource)
+{
+	RenderTargetTexture* rtt = GetTexture(resource);
+	if (!rtt)
+		return;
+
+	pool.Release(rtt);
+	textures[resource] = nullptr;
+}
+
+void RenderGraphD3D::Barrier(const RenderGraphBarrier& barrier)
+{
+	if (barrier.kind == RenderGraphBarrier::Kind::unbindRenderTargets)
+	{
+		pContext->OMSetRenderTargets(0, nullptr, nullptr);
+		return;
+	}
+
+	ID3D11ShaderResourceView* nullSRVs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+	pContext->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, nullSRVs);
+	pContext->CSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, nullSRVs);
+}
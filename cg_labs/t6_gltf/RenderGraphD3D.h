@@ -0,0 +1,34 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <vector>
+
+#include "RenderGraph.h"
+#include "RenderTargetPool.h"
+
+// Render graph resources on D3D11: transient ones come from RenderTargetPool, imported ones
+// are render target textures owned by their subsystems
+class RenderGraphD3D : public RenderGraphBackend
+{
+public:
+	explicit RenderGraphD3D(RenderTargetPool& pool) : pool(pool) {}
+
+	// Call after RenderGraph::Reset, before resources are imported
+	void Begin(ID3D11Device* pDevice, ID3D11DeviceContext* pContext);
+
+	void Import(uint32_t resource, RenderTargetTexture* rtt);
+
+	// Texture of resource while the graph executes (nullptr outside of resource lifetime)
+	RenderTargetTexture* GetTexture(uint32_t resource) const;
+
+	bool Acquire(uint32_t resource, const TransientResourceDesc& desc) override;
+	void Release(uint32_t resource) override;
+	void Barrier(const RenderGraphBarrier& barrier) override;
+
+private:
+	RenderTargetPool& pool;
+	std::vector<RenderTargetTexture*> textures; // by graph resource
+
+	ID3D11Device* pDevice = nullptr;
+	ID3D11DeviceContext* pContext = nullptr;
+};
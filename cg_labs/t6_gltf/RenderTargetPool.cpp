@@ -0,0 +1,86 @@
+#include "RenderTargetPool.h"
+
+RenderTargetTexture* RenderTargetPool::Acquire(
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext,
+	const TransientResourceDesc& desc)
+{
+	this->pDevice = pDevice;
+	this->pContext = pContext;
+
+	uint32_t handle = pool.Acquire(desc);
+	return handle == TransientResourcePool::invalidHandle ? nullptr : textures[handle];
+}
+
+RenderTargetTexture* RenderTargetPool::Acquire(
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext,
+	int width, int height,
+	DXGI_FORMAT format)
+{
+	TransientResourceDesc desc;
+	desc.width = (uint32_t)width;
+	desc.height = (uint32_t)height;
+	desc.format = (uint32_t)format;
+	desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	return Acquire(pDevice, pContext, desc);
+}
+
+void RenderTargetPool::Release(RenderTargetTexture* rtt)
+{
+	for (uint32_t handle = 0; handle < (uint32_t)textures.size(); handle++)
+	{
+		if (textures[handle] == rtt)
+		{
+			pool.Release(handle);
+			return;
+		}
+	}
+}
+
+bool RenderTargetPool::Create(uint32_t handle, const TransientResourceDesc& desc, uint64_t& bytes)
+{
+	// RenderTargetTexture has no other views
+	if (desc.bindFlags & ~(uint32_t)(D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE))
+		return false;
+
+	RenderTargetTexture* rtt = new RenderTargetTexture((int)desc.width, (int)desc.height, (DXGI_FORMAT)desc.format);
+	if (FAILED(rtt->initResource(pDevice, pContext)))
+	{
+		delete rtt;
+		return false;
+	}
+
+	if (handle >= textures.size())
+		textures.resize(handle + 1, nullptr);
+	textures[handle] = rtt;
+	bytes = (uint64_t)desc.width * desc.height * BytesPerPixel((DXGI_FORMAT)desc.format);
+	return true;
+}
+
+void RenderTargetPool::Destroy(uint32_t handle)
+{
+	delete textures[handle];
+	textures[handle] = nullptr;
+}
+
+uint32_t RenderTargetPool::BytesPerPixel(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		return 16;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R32G32_FLOAT:
+		return 8;
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R32_FLOAT:
+		return 4;
+	case DXGI_FORMAT_R16_FLOAT:
+		return 2;
+	default:
+		return 16;
+	}
+}
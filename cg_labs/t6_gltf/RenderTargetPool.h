@@ -0,0 +1,50 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <vector>
+
+#include "renderTargetTexture.h"
+#include "TransientResourcePool.h"
+
+// Transient render target textures of postprocessing passes.
+// D3D11 can't place several textures into one allocation, so passes with non overlapping
+// lifetimes alias by getting the same texture of the pool.
+class RenderTargetPool : public TransientResourceFactory
+{
+public:
+	RenderTargetPool() : pool(*this) {}
+
+	void BeginFrame() { pool.BeginFrame(); }
+
+	// Texture is valid until Release, its content is undefined (no clear).
+	// Textures have render target and shader resource views, other bind flags fail (nullptr)
+	RenderTargetTexture* Acquire(
+		ID3D11Device* pDevice,
+		ID3D11DeviceContext* pContext,
+		const TransientResourceDesc& desc);
+
+	// Render target and shader resource
+	RenderTargetTexture* Acquire(
+		ID3D11Device* pDevice,
+		ID3D11DeviceContext* pContext,
+		int width, int height,
+		DXGI_FORMAT format = DXGI_FORMAT_R32G32B32A32_FLOAT);
+
+	void Release(RenderTargetTexture* rtt);
+
+	const TransientPoolStats& GetStats() const { return pool.GetStats(); }
+
+	void Clear() { pool.Clear(); }
+
+	bool Create(uint32_t handle, const TransientResourceDesc& desc, uint64_t& bytes) override;
+	void Destroy(uint32_t handle) override;
+
+private:
+	static uint32_t BytesPerPixel(DXGI_FORMAT format);
+
+	TransientResourcePool pool;
+	std::vector<RenderTargetTexture*> textures; // by pool handle
+
+	ID3D11Device* pDevice = nullptr;
+	ID3D11DeviceContext* pContext = nullptr;
+};
@@ -0,0 +1,498 @@
+#include "ShaderCache.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+
+// FNV-1a
+static void HashBytes(uint64_t& hash, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+}
+
+// Strings are hashed with terminating zero, so "ab" + "c" differs from "a" + "bc"
+static void HashString(uint64_t& hash, const std::string& str) {
+  HashBytes(hash, str.c_str(), str.size() + 1);
+}
+
+static bool ReadFile(const std::string& path, std::vector<char>& contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+static bool FileExists(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return (bool)file;
+}
+
+// Source with comments replaced by spaces, line breaks and string literals are kept
+static std::string StripComments(const char* data, size_t size) {
+  std::string text(data, size);
+  size_t i = 0;
+  while (i < size) {
+    if (text[i] == '"') {
+      for (i++; i < size && text[i] != '"' && text[i] != '\n'; i++)
+        if (text[i] == '\\' && i + 1 < size)
+          i++;
+      i++;
+    } else if (text[i] == '/' && i + 1 < size && text[i + 1] == '/') {
+      while (i < size && text[i] != '\n')
+        text[i++] = ' ';
+    } else if (text[i] == '/' && i + 1 < size && text[i + 1] == '*') {
+      text[i] = text[i + 1] = ' ';
+      for (i += 2; i < size && !(text[i] == '*' && i + 1 < size && text[i + 1] == '/'); i++)
+        if (text[i] != '\n')
+          text[i] = ' ';
+      if (i < size) {
+        text[i] = text[i + 1] = ' ';
+        i += 2;
+      }
+    } else {
+      i++;
+    }
+  }
+  return text;
+}
+
+// Result of a condition the scan may not be able to evaluate
+enum class ScanCondition { no, yes, maybe };
+
+static ScanCondition And(ScanCondition a, ScanCondition b) {
+  if (a == ScanCondition::no || b == ScanCondition::no)
+    return ScanCondition::no;
+  return a == ScanCondition::yes && b == ScanCondition::yes ? ScanCondition::yes : ScanCondition::maybe;
+}
+
+static ScanCondition Or(ScanCondition a, ScanCondition b) {
+  if (a == ScanCondition::yes || b == ScanCondition::yes)
+    return ScanCondition::yes;
+  return a == ScanCondition::no && b == ScanCondition::no ? ScanCondition::no : ScanCondition::maybe;
+}
+
+static ScanCondition Not(ScanCondition a) {
+  return a == ScanCondition::maybe ? a : (a == ScanCondition::yes ? ScanCondition::no : ScanCondition::yes);
+}
+
+// Macros seen by the scan: desc defines, then #define and #undef of active lines.
+// Ones changed under conditions the scan can't evaluate are unknown.
+struct ScanDefines {
+  std::map<std::string, std::string> values;
+  std::set<std::string> unknown;
+
+  ScanCondition IsDefined(const std::string& name) const {
+    if (unknown.count(name))
+      return ScanCondition::maybe;
+    return values.count(name) ? ScanCondition::yes : ScanCondition::no;
+  }
+};
+
+// #if expressions: integers, macros with integer values, defined, !, comparisons, && and ||.
+// Anything else makes the value unknown.
+class ScanExpression {
+public:
+  ScanExpression(const std::string& expression, const ScanDefines& scanDefines) : text(expression), defines(scanDefines) {}
+
+  ScanCondition Evaluate() {
+    Value value = ParseOr();
+    SkipSpaces();
+    if (failed || pos != text.size() || !value.known)
+      return ScanCondition::maybe;
+    return value.number != 0 ? ScanCondition::yes : ScanCondition::no;
+  }
+
+private:
+  struct Value {
+    bool known;
+    long long number;
+  };
+
+  void SkipSpaces() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r'))
+      pos++;
+  }
+
+  bool Accept(const char* token) {
+    SkipSpaces();
+    size_t length = std::strlen(token);
+    if (text.compare(pos, length, token) != 0)
+      return false;
+    pos += length;
+    return true;
+  }
+
+  std::string Identifier() {
+    SkipSpaces();
+    size_t begin = pos;
+    while (pos < text.size() && (std::isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+      pos++;
+    return text.substr(begin, pos - begin);
+  }
+
+  static Value Truth(bool known, bool value) { return { known, value ? 1 : 0 }; }
+
+  Value ParseOr() {
+    Value left = ParseAnd();
+    while (Accept("||")) {
+      Value right = ParseAnd();
+      bool isTrue = (left.known && left.number) || (right.known && right.number);
+      left = Truth(isTrue || (left.known && right.known), isTrue);
+    }
+    return left;
+  }
+
+  Value ParseAnd() {
+    Value left = ParseCompare();
+    while (Accept("&&")) {
+      Value right = ParseCompare();
+      bool isFalse = (left.known && !left.number) || (right.known && !right.number);
+      left = Truth(isFalse || (left.known && right.known), !isFalse);
+    }
+    return left;
+  }
+
+  Value ParseCompare() {
+    Value left = ParseUnary();
+    while (true) {
+      const char* ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+      int op = -1;
+      for (int i = 0; i < 6 && op < 0; i++)
+        if (Accept(ops[i]))
+          op = i;
+      if (op < 0)
+        return left;
+
+      Value right = ParseUnary();
+      long long a = left.number, b = right.number;
+      bool results[] = { a == b, a != b, a <= b, a >= b, a < b, a > b };
+      left = Truth(left.known && right.known, results[op]);
+    }
+  }
+
+  Value ParseUnary() {
+    SkipSpaces();
+    if (pos < text.size() && text[pos] == '!' && (pos + 1 >= text.size() || text[pos + 1] != '=')) {
+      pos++;
+      Value value = ParseUnary();
+      return Truth(value.known, !value.number);
+    }
+    if (Accept("(")) {
+      Value value = ParseOr();
+      if (!Accept(")"))
+        failed = true;
+      return value;
+    }
+    if (pos < text.size() && std::isdigit((unsigned char)text[pos])) {
+      const char* begin = text.c_str() + pos;
+      char* end = nullptr;
+      long long number = std::strtoll(begin, &end, 0);
+      pos += end - begin;
+      while (pos < text.size() && std::isalpha((unsigned char)text[pos])) // 1u, 1L
+        pos++;
+      return { true, number };
+    }
+
+    std::string name = Identifier();
+    if (name.empty()) {
+      failed = true;
+      return { false, 0 };
+    }
+    if (name == "defined") {
+      bool parenthesis = Accept("(");
+      ScanCondition defined = defines.IsDefined(Identifier());
+      if (parenthesis && !Accept(")"))
+        failed = true;
+      return Truth(defined != ScanCondition::maybe, defined == ScanCondition::yes);
+    }
+
+    // Undefined macros are 0, values other than integers are not evaluated
+    ScanCondition defined = defines.IsDefined(name);
+    if (defined == ScanCondition::no)
+      return { true, 0 };
+    if (defined == ScanCondition::maybe)
+      return { false, 0 };
+    const std::string& value = defines.values.find(name)->second;
+    char* end = nullptr;
+    long long number = std::strtoll(value.c_str(), &end, 0);
+    return { end != value.c_str() && *end == 0, number };
+  }
+
+  const std::string& text;
+  const ScanDefines& defines;
+  size_t pos = 0;
+  bool failed = false;
+};
+
+// Files included by one compilation in the order the preprocessor reaches them
+struct IncludeScan {
+  ScanDefines defines;
+  std::vector<std::string> files;
+  uint64_t hash = 0;
+};
+
+static const int maxIncludeDepth = 32;
+
+static void HashIncludes(IncludeScan& scan, const std::string& path, const std::vector<char>& source, int depth);
+
+// Hashes the file on its first include and scans it right away, so macros it defines affect the rest
+// of the includer like they do for the compiler
+static void HashInclude(IncludeScan& scan, const std::string& name, const std::string& parentPath, int depth) {
+  std::string path = ShaderIncludeTracker::Resolve(name, parentPath);
+  for (const std::string& file : scan.files)
+    if (file == path)
+      return;
+  scan.files.push_back(path);
+
+  HashString(scan.hash, path);
+  std::vector<char> contents;
+  if (!ReadFile(path, contents)) {
+    // Missing include fails the compilation only if it is reached, the key changes when the file appears
+    HashString(scan.hash, "<missing>");
+    return;
+  }
+  HashBytes(scan.hash, contents.data(), contents.size());
+  if (depth < maxIncludeDepth)
+    HashIncludes(scan, path, contents, depth + 1);
+}
+
+static void HashIncludes(IncludeScan& scan, const std::string& path, const std::vector<char>& source, int depth) {
+  struct Block {
+    ScanCondition parentActive;
+    ScanCondition active;
+    ScanCondition taken; // some branch of the block was active
+  };
+  std::vector<Block> blocks;
+  auto active = [&blocks]() { return blocks.empty() ? ScanCondition::yes : blocks.back().active; };
+
+  std::string text = StripComments(source.data(), source.size());
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t lineEnd = text.find('\n', pos);
+    if (lineEnd == std::string::npos)
+      lineEnd = text.size();
+    std::string line = text.substr(pos, lineEnd - pos);
+    pos = lineEnd + 1;
+
+    size_t i = line.find_first_not_of(" \t\r");
+    if (i == std::string::npos || line[i] != '#')
+      continue;
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == std::string::npos)
+      continue;
+    size_t directiveEnd = i;
+    while (directiveEnd < line.size() && std::isalpha((unsigned char)line[directiveEnd]))
+      directiveEnd++;
+    std::string directive = line.substr(i, directiveEnd - i);
+    std::string rest = line.substr(directiveEnd);
+    size_t restBegin = rest.find_first_not_of(" \t");
+    size_t restEnd = rest.find_last_not_of(" \t\r");
+    rest = restBegin == std::string::npos ? std::string() : rest.substr(restBegin, restEnd - restBegin + 1);
+    std::string name = rest.substr(0, rest.find_first_of(" \t("));
+
+    if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+      ScanCondition condition = directive == "if" ? ScanExpression(rest, scan.defines).Evaluate() : scan.defines.IsDefined(name);
+      if (directive == "ifndef")
+        condition = Not(condition);
+      ScanCondition parent = active();
+      blocks.push_back({ parent, And(parent, condition), condition });
+    } else if (directive == "elif" && !blocks.empty()) {
+      Block& block = blocks.back();
+      ScanCondition condition = block.taken == ScanCondition::yes ? ScanCondition::no : ScanExpression(rest, scan.defines).Evaluate();
+      ScanCondition current = block.taken == ScanCondition::no ? condition : And(Not(block.taken), condition);
+      block.active = And(block.parentActive, current);
+      block.taken = Or(block.taken, condition);
+    } else if (directive == "else" && !blocks.empty()) {
+      Block& block = blocks.back();
+      block.active = And(block.parentActive, Not(block.taken));
+      block.taken = ScanCondition::yes;
+    } else if (directive == "endif" && !blocks.empty()) {
+      blocks.pop_back();
+    } else if (active() == ScanCondition::no) {
+      continue;
+    } else if (directive == "define" || directive == "undef") {
+      if (active() == ScanCondition::maybe) {
+        scan.defines.values.erase(name);
+        scan.defines.unknown.insert(name);
+      } else if (directive == "define") {
+        // Function-like macros are defined but have no value the scan can use
+        size_t valueBegin = rest.find_first_not_of(" \t", name.size());
+        std::string value = valueBegin == std::string::npos || rest[name.size()] == '(' ? std::string() : rest.substr(valueBegin);
+        scan.defines.values[name] = value;
+        scan.defines.unknown.erase(name);
+      } else {
+        scan.defines.values.erase(name);
+        scan.defines.unknown.erase(name);
+      }
+    } else if (directive == "include" && !rest.empty() && (rest[0] == '"' || rest[0] == '<')) {
+      size_t nameEnd = rest.find(rest[0] == '"' ? '"' : '>', 1);
+      if (nameEnd != std::string::npos)
+        HashInclude(scan, rest.substr(1, nameEnd - 1), path, depth);
+    }
+  }
+}
+
+bool ShaderDesc::operator==(const ShaderDesc& other) const {
+  if (file != other.file || entry != other.entry || profile != other.profile || flags != other.flags ||
+    defines.size() != other.defines.size())
+    return false;
+  for (size_t i = 0; i < defines.size(); i++)
+    if (defines[i].name != other.defines[i].name || defines[i].value != other.defines[i].value)
+      return false;
+  return true;
+}
+
+std::string ShaderIncludeTracker::Resolve(const std::string& name, const std::string& parentPath) {
+  bool absolute = !name.empty() && (name[0] == '/' || name[0] == '\\' || (name.size() > 1 && name[1] == ':'));
+  size_t slash = parentPath.find_last_of("/\\");
+  if (!absolute && slash != std::string::npos) {
+    std::string path = parentPath.substr(0, slash + 1) + name;
+    if (FileExists(path))
+      return path;
+  }
+  return name;
+}
+
+const char* ShaderIncludeTracker::Open(const std::string& name, const void* parent, uint32_t& size) {
+  auto parentPath = openPaths.find(parent);
+  std::string path = Resolve(name, parentPath != openPaths.end() ? parentPath->second : source);
+  std::vector<char> contents;
+  if (!ReadFile(path, contents))
+    return nullptr;
+
+  bool known = false;
+  for (const std::string& dependency : dependencies)
+    known = known || dependency == path;
+  if (!known)
+    dependencies.push_back(path);
+
+  char* buffer = new char[contents.size() + 1];
+  if (!contents.empty())
+    std::memcpy(buffer, contents.data(), contents.size());
+  buffer[contents.size()] = 0;
+  size = (uint32_t)contents.size();
+  openPaths[buffer] = path;
+  return buffer;
+}
+
+void ShaderIncludeTracker::Close(const void* data) {
+  openPaths.erase(data);
+  delete[] static_cast<const char*>(data);
+}
+
+bool ComputeShaderKey(const ShaderDesc& desc, uint64_t& key, std::vector<std::string>* dependencies) {
+  uint64_t hash = 14695981039346656037ull;
+  HashString(hash, desc.file);
+  HashString(hash, desc.entry);
+  HashString(hash, desc.profile);
+  HashBytes(hash, &desc.flags, sizeof(desc.flags));
+  for (const ShaderDefine& define : desc.defines) {
+    HashString(hash, define.name);
+    HashString(hash, define.value);
+  }
+
+  std::vector<char> source;
+  if (!ReadFile(desc.file, source))
+    return false;
+  HashBytes(hash, source.data(), source.size());
+
+  // Includes are hashed in the order the preprocessor reaches them, each file once
+  IncludeScan scan;
+  scan.hash = hash;
+  for (const ShaderDefine& define : desc.defines)
+    scan.defines.values[define.name] = define.value;
+  HashIncludes(scan, desc.file, source, 0);
+
+  if (dependencies)
+    *dependencies = scan.files;
+  key = scan.hash;
+  return true;
+}
+
+std::string ShaderCache::KeyName(uint64_t key) {
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  return name;
+}
+
+bool ShaderCache::Load(uint64_t key, std::vector<uint8_t>& bytecode) const {
+  std::vector<char> contents;
+  if (!ReadFile(dir + "/" + KeyName(key) + ".cso", contents) || contents.empty())
+    return false;
+  bytecode.assign(contents.begin(), contents.end());
+  return true;
+}
+
+bool ShaderCache::Store(uint64_t key, const void* bytecode, size_t size) const {
+  // Written under temporary name, so a concurrent reader never sees a partial file
+  std::string path = dir + "/" + KeyName(key) + ".cso";
+  std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    file.write(static_cast<const char*>(bytecode), size);
+    if (!file)
+      return false;
+  }
+  std::remove(path.c_str());
+  return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// Line per desc: file|entry|profile|flags|NAME=VALUE;NAME=VALUE
+bool ShaderCache::LoadIndex(std::vector<ShaderDesc>& descs) const {
+  std::ifstream file(dir + "/index.txt");
+  if (!file)
+    return false;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '|'))
+      fields.push_back(field);
+    if (fields.size() < 4)
+      continue;
+
+    ShaderDesc desc;
+    desc.file = fields[0];
+    desc.entry = fields[1];
+    desc.profile = fields[2];
+    desc.flags = (uint32_t)std::strtoul(fields[3].c_str(), nullptr, 10);
+    if (fields.size() > 4) {
+      std::stringstream defines(fields[4]);
+      std::string define;
+      while (std::getline(defines, define, ';')) {
+        size_t eq = define.find('=');
+        if (eq != std::string::npos)
+          desc.defines.push_back({ define.substr(0, eq), define.substr(eq + 1) });
+      }
+    }
+    descs.push_back(desc);
+  }
+  return true;
+}
+
+bool ShaderCache::StoreIndex(const std::vector<ShaderDesc>& descs) const {
+  std::ofstream file(dir + "/index.txt", std::ios::trunc);
+  if (!file)
+    return false;
+
+  for (const ShaderDesc& desc : descs) {
+    file << desc.file << "|" << desc.entry << "|" << desc.profile << "|" << desc.flags << "|";
+    for (size_t i = 0; i < desc.defines.size(); i++)
+      file << (i > 0 ? ";" : "") << desc.defines[i].name << "=" << desc.defines[i].value;
+    file << "\n";
+  }
+  return (bool)file;
+}
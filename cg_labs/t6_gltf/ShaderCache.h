@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ShaderDefine {
+  std::string name;
+  std::string value;
+};
+
+// One compilation: file is relative to working folder like for D3DCompileFromFile
+struct ShaderDesc {
+  std::string file;
+  std::string entry = "main";
+  std::string profile;
+  std::vector<ShaderDefine> defines;
+  uint32_t flags = 0; // D3DCOMPILE_*
+
+  bool operator==(const ShaderDesc& other) const;
+};
+
+// Include files read for one compilation (D3DInclude opens them through it), same lookup as the compiler:
+// name relative to the folder of the including file, then relative to working folder
+class ShaderIncludeTracker {
+public:
+  explicit ShaderIncludeTracker(const std::string& sourceFile = "") : source(sourceFile) {}
+
+  // parent - data of the including file returned by Open, nullptr for the source file.
+  // File contents or nullptr, memory is valid until Close
+  const char* Open(const std::string& name, const void* parent, uint32_t& size);
+  void Close(const void* data);
+
+  // Path the include of name from parentPath resolves to
+  static std::string Resolve(const std::string& name, const std::string& parentPath);
+
+  // Unique resolved paths in the order of first opening
+  const std::vector<std::string>& GetDependencies() const { return dependencies; }
+
+private:
+  std::string source;
+  std::vector<std::string> dependencies;
+  std::map<const void*, std::string> openPaths; // open data -> its path, to resolve nested includes
+};
+
+// Key of the compilation result: hash of desc, source file and every included file. Includes are found by
+// scanning #include lines outside comments and inactive #if blocks (conditions the scan can't evaluate
+// count as active). A missing include is hashed as missing and listed as a dependency: the compiler
+// fails only if it is actually reached. Returns false if the source file can't be read.
+bool ComputeShaderKey(const ShaderDesc& desc, uint64_t& key, std::vector<std::string>* dependencies = nullptr);
+
+// Bytecode files <key>.cso in cache folder and index of descs compiled before
+class ShaderCache {
+public:
+  ShaderCache(const std::string& cacheDir = "shader_cache") : dir(cacheDir) {};
+
+  const std::string& GetDir() const { return dir; }
+
+  bool Load(uint64_t key, std::vector<uint8_t>& bytecode) const;
+  bool Store(uint64_t key, const void* bytecode, size_t size) const;
+
+  // Descs used in previous runs, so stale ones can be rebuilt before they are requested
+  bool LoadIndex(std::vector<ShaderDesc>& descs) const;
+  bool StoreIndex(const std::vector<ShaderDesc>& descs) const;
+
+  static std::string KeyName(uint64_t key);
+
+private:
+  std::string dir;
+};
@@ -0,0 +1,163 @@
+#include "ShaderLibrary.h"
+#include "D3DInclude.h"
+#include "parallel.h"
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <string>
+
+static std::string ToNarrowPath(const WCHAR* path) {
+  // Shader paths are ASCII
+  std::string result;
+  for (; *path; path++)
+    result.push_back((char)*path);
+  return result;
+}
+
+DWORD ShaderLibrary::DefaultFlags() {
+  DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
+#ifdef _DEBUG
+  // Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
+  // Setting this flag improves the shader debugging experience, but still allows 
+  // the shaders to be optimized and to run exactly the way they will run in 
+  // the release configuration of this program.
+  dwShaderFlags |= D3DCOMPILE_DEBUG;
+
+  // Disable optimizations to further improve shader debugging
+  dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+  return dwShaderFlags;
+}
+
+HRESULT ShaderLibrary::Build(const ShaderDesc& desc, uint64_t key, std::vector<uint8_t>& bytecode) {
+  if (cache.Load(key, bytecode)) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.diskHits++;
+    return S_OK;
+  }
+
+  std::vector<D3D_SHADER_MACRO> macros;
+  for (const ShaderDefine& define : desc.defines)
+    macros.push_back({ define.name.c_str(), define.value.c_str() });
+  macros.push_back({ nullptr, nullptr });
+
+  TRACE_SCOPE(("Shader compile " + desc.file + " " + desc.entry).c_str());
+  auto start = std::chrono::high_resolution_clock::now();
+  std::wstring file(desc.file.begin(), desc.file.end());
+  D3DInclude includeObj(desc.file);
+  ID3DBlob* pBlob = nullptr;
+  ID3DBlob* pErrorBlob = nullptr;
+  HRESULT hr = D3DCompileFromFile(file.c_str(), macros.data(), &includeObj, desc.entry.c_str(), desc.profile.c_str(), desc.flags, 0, &pBlob, &pErrorBlob);
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  if (pErrorBlob)
+  {
+    OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
+    pErrorBlob->Release();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.compileMs += ms;
+  if (FAILED(hr)) {
+    stats.failed++;
+    return hr;
+  }
+
+  stats.compiled++;
+  const uint8_t* data = static_cast<const uint8_t*>(pBlob->GetBufferPointer());
+  bytecode.assign(data, data + pBlob->GetBufferSize());
+  pBlob->Release();
+
+  if (!cache.Store(key, bytecode.data(), bytecode.size()))
+    OutputDebugStringA(("Shader cache: can't write " + desc.file + "\n").c_str());
+  return S_OK;
+}
+
+void ShaderLibrary::Remember(const ShaderDesc& desc) {
+  for (const ShaderDesc& known : index)
+    if (known == desc)
+      return;
+  index.push_back(desc);
+  cache.StoreIndex(index);
+}
+
+HRESULT ShaderLibrary::Compile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut,
+  const D3D_SHADER_MACRO* defines, DWORD flags)
+{
+  ShaderDesc desc;
+  desc.file = ToNarrowPath(szFileName);
+  desc.entry = szEntryPoint;
+  desc.profile = szShaderModel;
+  desc.flags = flags;
+  for (const D3D_SHADER_MACRO* define = defines; define && define->Name; define++)
+    desc.defines.push_back({ define->Name, define->Definition ? define->Definition : "" });
+
+  uint64_t key = 0;
+  if (!ComputeShaderKey(desc, key))
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+  std::vector<uint8_t> bytecode;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded.find(key);
+    if (it != loaded.end()) {
+      stats.memoryHits++;
+      bytecode = it->second;
+    }
+  }
+
+  if (bytecode.empty()) {
+    CreateDirectoryA(cache.GetDir().c_str(), nullptr);
+    HRESULT hr = Build(desc, key, bytecode);
+    if (FAILED(hr))
+      return hr;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    loaded[key] = bytecode;
+    Remember(desc);
+  }
+
+  HRESULT hr = D3DCreateBlob(bytecode.size(), ppBlobOut);
+  if (FAILED(hr))
+    return hr;
+  memcpy((*ppBlobOut)->GetBufferPointer(), bytecode.data(), bytecode.size());
+  return S_OK;
+}
+
+void ShaderLibrary::Warmup() {
+  auto start = std::chrono::high_resolution_clock::now();
+  CreateDirectoryA(cache.GetDir().c_str(), nullptr);
+
+  std::vector<ShaderDesc> descs;
+  cache.LoadIndex(descs);
+
+  // Shaders removed from the project drop out of the index
+  std::vector<ShaderDesc> present;
+  std::vector<uint64_t> keys;
+  for (const ShaderDesc& desc : descs) {
+    uint64_t key = 0;
+    if (ComputeShaderKey(desc, key)) {
+      present.push_back(desc);
+      keys.push_back(key);
+    }
+  }
+
+  ParallelFor(present.size(), [&](size_t i) {
+    std::vector<uint8_t> bytecode;
+    if (FAILED(Build(present[i], keys[i], bytecode)))
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    loaded[keys[i]] = std::move(bytecode);
+  });
+
+  std::lock_guard<std::mutex> lock(mutex);
+  index = present;
+  cache.StoreIndex(index);
+  stats.warmupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  char message[160];
+  sprintf_s(message, "Shader library: %u shaders from cache, %u compiled, %u failed in %.1f ms\n",
+    stats.diskHits, stats.compiled, stats.failed, stats.warmupMs);
+  OutputDebugStringA(message);
+}
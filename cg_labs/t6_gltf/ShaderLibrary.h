@@ -0,0 +1,52 @@
+#pragma once
+
+#include <d3dcompiler.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderCache.h"
+
+struct ShaderLibraryStats {
+  uint32_t memoryHits = 0; // compiled or loaded earlier in this run
+  uint32_t diskHits = 0;
+  uint32_t compiled = 0;
+  uint32_t failed = 0;
+  double compileMs = 0;    // sum over threads
+  double warmupMs = 0;
+};
+
+// Shared shader compilation with bytecode cache keyed on source, includes, defines, entry, profile and flags.
+// Warmup rebuilds stale shaders of the last runs in parallel, so Compile calls during init mostly hit memory.
+class ShaderLibrary {
+public:
+  static ShaderLibrary& GetInstance() {
+    static ShaderLibrary instance;
+    return instance;
+  };
+
+  // Strictness, debug info and no optimization in _DEBUG
+  static DWORD DefaultFlags();
+
+  // Same contract as D3DCompileFromFile: caller releases *ppBlobOut, errors go to debug output
+  HRESULT Compile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut,
+    const D3D_SHADER_MACRO* defines = nullptr, DWORD flags = DefaultFlags());
+
+  // Compiles shaders of the index whose cache entries are missing or stale, on ParallelFor workers
+  void Warmup();
+
+  const ShaderLibraryStats& GetStats() const { return stats; }
+
+private:
+  ShaderLibrary() = default;
+
+  // Bytecode of desc, from disk cache or compiled and stored; mutex is not held
+  HRESULT Build(const ShaderDesc& desc, uint64_t key, std::vector<uint8_t>& bytecode);
+  void Remember(const ShaderDesc& desc);
+
+  ShaderCache cache;
+  std::mutex mutex;
+  std::unordered_map<uint64_t, std::vector<uint8_t>> loaded;
+  std::vector<ShaderDesc> index;
+  ShaderLibraryStats stats;
+};
@@ -0,0 +1,37 @@
+#include "ShaderPermutation.h"
+
+#include <string>
+
+// bits 0-1 view mode, 2 plain normal, 3 plain metal/roughness, 4 plain color, 5 octahedral,
+// 6-9 light count (maxLights + 1 - dynamic loop)
+uint32_t PBRShaderFeatures::Key() const {
+  uint32_t lights = lightCount <= maxLights ? lightCount : maxLights + 1;
+  return (viewMode & 3) | (plainNormal << 2) | (plainMetalRough << 3) | (plainColor << 4) | (octahedralIBL << 5) | (lights << 6);
+}
+
+PBRShaderFeatures PBRShaderFeatures::FromKey(uint32_t key) {
+  PBRShaderFeatures features;
+  features.viewMode = key & 3;
+  features.plainNormal = (key >> 2) & 1;
+  features.plainMetalRough = (key >> 3) & 1;
+  features.plainColor = (key >> 4) & 1;
+  features.octahedralIBL = (key >> 5) & 1;
+  features.lightCount = (key >> 6) & 15;
+  return features;
+}
+
+std::vector<ShaderDefine> PBRShaderFeatures::GetDefines() const {
+  std::vector<ShaderDefine> defines;
+  defines.push_back({ "VIEW_MODE", std::to_string(viewMode) });
+  if (plainNormal)
+    defines.push_back({ "PLAIN_NORMAL", "1" });
+  if (plainMetalRough)
+    defines.push_back({ "PLAIN_METAL_ROUGH", "1" });
+  if (plainColor)
+    defines.push_back({ "PLAIN_COLOR", "1" });
+  if (octahedralIBL)
+    defines.push_back({ "OCTAHEDRAL_IBL", "1" });
+  if (lightCount <= maxLights)
+    defines.push_back({ "LIGHT_COUNT", std::to_string(lightCount) });
+  return defines;
+}
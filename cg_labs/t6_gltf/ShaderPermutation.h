@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "GfxDevice.h"
+#include "ShaderCache.h"
+
+// Feature bits of pbrLightable_PS, every combination is compiled as a separate variant
+struct PBRShaderFeatures {
+  uint32_t viewMode = 0;        // 0 - full, 1 - normal, 2 - roughness/metalness, 3 - texture
+  bool plainNormal = false;     // vertex normal (also for meshes without normal texture)
+  bool plainMetalRough = false; // material constants instead of texture
+  bool plainColor = false;
+  bool octahedralIBL = false;
+  uint32_t lightCount = 0;      // directional lights loop is unrolled up to maxLights, dynamic above
+
+  static const uint32_t maxLights = 10;
+
+  uint32_t Key() const;
+  static PBRShaderFeatures FromKey(uint32_t key);
+
+  // VIEW_MODE, PLAIN_NORMAL, PLAIN_METAL_ROUGH, PLAIN_COLOR, OCTAHEDRAL_IBL and LIGHT_COUNT (if unrolled)
+  std::vector<ShaderDefine> GetDefines() const;
+};
+
+// Shader variants by permutation key, created on first request (failed ones are remembered as null)
+class ShaderPermutationCache {
+public:
+  // create(key) returns the new variant
+  template<typename Factory>
+  GfxHandle Get(uint32_t key, Factory create) {
+    auto it = variants.find(key);
+    if (it != variants.end())
+      return it->second;
+
+    GfxHandle shader = create(key);
+    variants[key] = shader;
+    return shader;
+  }
+
+  // Read-only lookup, gfxNullHandle if the variant was not created
+  GfxHandle Find(uint32_t key) const {
+    auto it = variants.find(key);
+    return it != variants.end() ? it->second : gfxNullHandle;
+  }
+
+  void Release(IGfxDevice& device) {
+    for (auto& variant : variants)
+      device.Release(variant.second);
+    variants.clear();
+  }
+
+  size_t GetCount() const { return variants.size(); }
+
+private:
+  std::unordered_map<uint32_t, GfxHandle> variants;
+};
@@ -0,0 +1,744 @@
+#include "SoftRasterizer.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTRAST_USE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+  const float PI = 3.1415926f;      // same constant as pbrLightable_PS
+  const uint32_t maxLights = 10;    // MAX_LIGHT_SOURCES
+  const float maxReflectionLod = 4.0f;
+  const float subpixels = 16.0f;    // vertex snapping
+  const float guardBand = 2048.0f;  // pixels outside the viewport that are not clipped
+  const size_t verticesPerTask = 8192;
+  const size_t trianglesPerChunk = 2048;
+
+  typedef std::chrono::steady_clock Clock;
+
+  double Ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  float Sqr(float x) { return x * x; }
+  float Dot(const float a[3], const float b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+  float PosDot(const float a[3], const float b[3]) { return std::max(Dot(a, b), 0.0f); }
+
+  void Cross(const float a[3], const float b[3], float r[3]) {
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+  }
+
+  // Zero vector is kept (shader would produce NaN)
+  void Normalize(const float v[3], float r[3]) {
+    float len = sqrtf(Dot(v, v));
+    float inv = len > 0 ? 1.0f / len : 0.0f;
+    for (int i = 0; i < 3; i++)
+      r[i] = v[i] * inv;
+  }
+
+  // v * M, row vector convention
+  void TransformPoint(const float m[16], const float p[3], float w, float r[4]) {
+    for (int c = 0; c < 4; c++)
+      r[c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + w * m[12 + c];
+  }
+
+  void TransformDir(const float m[16], const float d[3], float r[3]) {
+    for (int c = 0; c < 3; c++)
+      r[c] = d[0] * m[c] + d[1] * m[4 + c] + d[2] * m[8 + c];
+  }
+
+  float Saturate(float x) { return std::min(std::max(x, 0.0f), 1.0f); }
+
+  // Bilinear fetch of texel centers, coordinates in texels
+  void Bilinear(const HDRImage& img, float x, float y, bool wrap, float rgba[4]) {
+    x -= 0.5f;
+    y -= 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    float tx = x - fx, ty = y - fy;
+    int x0 = (int)fx, y0 = (int)fy;
+    int w = (int)img.width, h = (int)img.height;
+
+    int xs[2] = { x0, x0 + 1 }, ys[2] = { y0, y0 + 1 };
+    for (int i = 0; i < 2; i++) {
+      if (wrap) {
+        xs[i] = ((xs[i] % w) + w) % w;
+        ys[i] = ((ys[i] % h) + h) % h;
+      }
+      else {
+        xs[i] = std::min(std::max(xs[i], 0), w - 1);
+        ys[i] = std::min(std::max(ys[i], 0), h - 1);
+      }
+    }
+
+    const float* t00 = img.Texel(xs[0], ys[0]);
+    const float* t10 = img.Texel(xs[1], ys[0]);
+    const float* t01 = img.Texel(xs[0], ys[1]);
+    const float* t11 = img.Texel(xs[1], ys[1]);
+    for (int c = 0; c < 4; c++) {
+      float top = t00[c] + (t10[c] - t00[c]) * tx;
+      float bottom = t01[c] + (t11[c] - t01[c]) * tx;
+      rgba[c] = top + (bottom - top) * ty;
+    }
+  }
+
+  // Clip space plane: dot(plane, clip) >= 0 is inside
+  struct ClipPlane {
+    float x, y, z, w;
+
+    float Distance(const float clip[4]) const { return x * clip[0] + y * clip[1] + z * clip[2] + w * clip[3]; }
+  };
+
+  float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return bits * 2.3283064365386963e-10f;
+  }
+
+  float SchlickGGX(float nv, float k) {
+    return nv / (nv * (1 - k) + k);
+  }
+}
+
+void SoftRasterizer::SampleWrap(const SoftScene& scene, int texture, const float uv[2], float rgba[4]) {
+  if (texture < 0 || texture >= (int)scene.textures.size() || scene.textures[texture].width == 0) {
+    rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0.0f;
+    return;
+  }
+
+  const HDRImage& img = scene.textures[texture];
+  Bilinear(img, uv[0] * img.width, uv[1] * img.height, true, rgba);
+}
+
+void SoftRasterizer::ShadePixel(const SoftScene& scene, const SoftMaterial& material, const float camPos[3],
+  const float world[3], const float normal[3], const float tangent[3], const float uv[2], float rgb[3]) {
+  const SoftShadingParams& params = scene.shading;
+
+  float n[3], v[3], toCam[3] = { camPos[0] - world[0], camPos[1] - world[1], camPos[2] - world[2] };
+  Normalize(normal, n);
+  Normalize(toCam, v);
+
+  // Missing textures use material constants like Model::GetPixelShaderKey
+  bool plainNormal = params.isPlainNormal || material.normalTex == -1;
+  bool plainMetalRough = params.isPlainMetalRough || material.metalRoughTex == -1;
+  bool plainColor = params.isPlainColor || material.albedoTex == -1;
+
+  if (!plainNormal) {
+    float binorm[3], nt[3], local[4];
+    Cross(normal, tangent, binorm);
+    Normalize(binorm, binorm);
+    Normalize(tangent, nt);
+    SampleWrap(scene, material.normalTex, uv, local);
+    for (int i = 0; i < 3; i++)
+      local[i] = local[i] * 2.0f - 1.0f;
+
+    float nn[3];
+    Normalize(normal, nn);
+    for (int i = 0; i < 3; i++)
+      n[i] = local[0] * nt[i] + local[1] * binorm[i] + local[2] * nn[i];
+  }
+
+  float roughness = std::max(params.roughness, 0.001f);
+  float metalness = params.metalness;
+  float mr[4];
+  SampleWrap(scene, material.metalRoughTex, uv, mr);
+  if (!plainMetalRough) {
+    roughness = std::max(mr[1], 0.001f);
+    metalness = mr[0];
+  }
+
+  float dielectricF0 = params.dielectricF0;
+  float albedo[3] = { params.albedo[0], params.albedo[1], params.albedo[2] };
+  float texColor[4];
+  SampleWrap(scene, material.albedoTex, uv, texColor);
+  if (!plainColor)
+    memcpy(albedo, texColor, sizeof(albedo));
+
+  if (params.modelViewMode == 1) {
+    for (int i = 0; i < 3; i++)
+      rgb[i] = (n[i] + 1) / 2;
+    return;
+  }
+  if (params.modelViewMode == 2) {
+    rgb[0] = mr[0], rgb[1] = mr[1], rgb[2] = 0.0f;
+    return;
+  }
+  if (params.modelViewMode == 3) {
+    memcpy(rgb, texColor, sizeof(float) * 3);
+    return;
+  }
+
+  // CountPBRColor: lights
+  float result[3] = { 0.0f, 0.0f, 0.0f };
+  float alpha = std::min(std::max(roughness, 0.001f), 1.0f);
+  float alphaSqr = Sqr(alpha);
+  float k = Sqr(alpha + 1) / 8;
+  float nv = PosDot(v, n);
+
+  uint32_t lightCount = std::min((uint32_t)scene.lights.size(), maxLights);
+  for (uint32_t i = 0; i < lightCount; i++) {
+    const SoftLight& light = scene.lights[i];
+    bool directional = light.position[3] > 0.5f;
+
+    float l[3];
+    float distance2 = 0.0f;
+    if (directional)
+      Normalize(light.position, l);
+    else {
+      float toLight[3] = { light.position[0] - world[0], light.position[1] - world[1], light.position[2] - world[2] };
+      distance2 = Dot(toLight, toLight);
+      Normalize(toLight, l);
+    }
+
+    float h[3] = { l[0] + v[0], l[1] + v[1], l[2] + v[2] };
+    Normalize(h, h);
+
+    float D = alphaSqr / (PI * Sqr(Sqr(PosDot(n, h)) * (alphaSqr - 1) + 1));
+    float nl = PosDot(n, l);
+    float G = SchlickGGX(nv, k) * SchlickGGX(nl, k);
+    float fresnelPow = powf(1 - PosDot(h, v), 5);
+
+    for (int c = 0; c < 3; c++) {
+      float F0 = dielectricF0 * (1 - metalness) + albedo[c] * metalness;
+      float F = F0 + (1 - F0) * fresnelPow;
+      float add = (1 - F) * albedo[c] / PI * (1 - metalness) + D * F * G / (0.001f + 4 * (nl * nv));
+
+      // Directional light extracted from environment: color * w is irradiance, not clamped
+      if (directional)
+        result[c] += light.color[c] * light.color[3] * add * nl;
+      else
+        result[c] += Saturate(light.color[c] * add * light.color[3] / (distance2 + 0.01f) * (Dot(l, n) > 0 ? 1.0f : 0.0f));
+    }
+  }
+
+  // IBL specular
+  const SoftIBL& ibl = scene.ibl;
+  float vn = Dot(v, n);
+  float r[3] = { 2.0f * vn * n[0] - v[0], 2.0f * vn * n[1] - v[1], 2.0f * vn * n[2] - v[2] };
+  Normalize(r, r);
+
+  float prefiltered[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  if (ibl.prefiltered.MipLevels() > 0)
+    OctahedralConverter::Sample(ibl.prefiltered, r, roughness * maxReflectionLod, prefiltered);
+
+  float envBRDF[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  if (ibl.brdf.width > 0)
+    Bilinear(ibl.brdf, std::max(vn, 0.0f) * ibl.brdf.width, roughness * ibl.brdf.height, false, envBRDF);
+
+  // IBL diffuse
+  float irradiance[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  if (ibl.irradiance.MipLevels() > 0)
+    OctahedralConverter::Sample(ibl.irradiance, n, 0.0f, irradiance);
+
+  float fresnelPow = powf(1 - PosDot(n, v), 5);
+  float ir = std::max(1 - roughness, 10e-3f);
+  for (int c = 0; c < 3; c++) {
+    float F0 = dielectricF0 + (albedo[c] - dielectricF0) * metalness;
+    float specular = prefiltered[c] * (F0 * envBRDF[0] + envBRDF[1]);
+
+    float F = F0 + (std::max(ir, F0) - F0) * fresnelPow;
+    float kD = (1.0f - F) * (1.0f - metalness);
+    rgb[c] = result[c] + kD * irradiance[c] * albedo[c] + specular;
+  }
+}
+
+void SoftRasterizer::BakeBRDF(uint32_t size, uint32_t samples, HDRImage& brdf) {
+  size = std::max(size, 1u);
+  samples = std::max(samples, 1u);
+  brdf.Resize(size, size);
+
+  // Same integration as BRDFGenerator_PS with the progressive sequence of IBLSampling.h
+  ParallelFor(size, [&](size_t y) {
+    float roughness = (y + 0.5f) / size;
+    float a = roughness * roughness;
+    float alpha = std::min(std::max(roughness, 0.01f), 1.0f);
+    float k = Sqr(alpha) / 2;
+
+    for (uint32_t x = 0; x < size; x++) {
+      float NdotV = (x + 0.5f) / size;
+      float V[3] = { sqrtf(1.0f - NdotV), NdotV, 0.0f };
+      double A = 0, B = 0;
+
+      for (uint32_t i = 0; i < samples; i++) {
+        float xi0 = i * 0.6180339887f;
+        xi0 -= floorf(xi0);
+        float xi1 = RadicalInverse(i);
+
+        float phi = 2.0f * PI * xi0;
+        float cosTheta = sqrtf((1.0f - xi1) / (1.0f + (a * a - 1.0f) * xi1));
+        float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+        float H[3] = { cosf(phi) * sinTheta, cosTheta, sinf(phi) * sinTheta };
+
+        float VdotH = Dot(V, H);
+        float L[3] = { 2.0f * VdotH * H[0] - V[0], 2.0f * VdotH * H[1] - V[1], 2.0f * VdotH * H[2] - V[2] };
+        Normalize(L, L);
+        float NdotL = std::max(L[1], 0.0f);
+        float NdotH = std::max(H[1], 0.0f);
+        VdotH = std::max(VdotH, 0.0f);
+        if (NdotL > 0.0f) {
+          float G = SchlickGGX(std::max(NdotV, 0.0f), k) * SchlickGGX(NdotL, k);
+          float GVis = (G * VdotH) / (NdotH * NdotV);
+          float Fc = powf(1.0f - VdotH, 5.0f);
+          A += (1.0f - Fc) * GVis;
+          B += Fc * GVis;
+        }
+      }
+
+      float* texel = brdf.Texel(x, (uint32_t)y);
+      texel[0] = (float)(A / samples);
+      texel[1] = (float)(B / samples);
+      texel[2] = 0.0f;
+      texel[3] = 1.0f;
+    }
+  });
+}
+
+void SoftRasterizer::BuildIBL(const HDRImage& equirect, const OctahedralPrefilterParams& params, SoftIBL& ibl, uint32_t brdfSize, uint32_t brdfSamples) {
+  OctahedralConverter converter;
+  converter.FromEquirect(equirect, ibl.environment);
+  converter.Prefilter(ibl.environment, params, ibl.prefiltered, ibl.irradiance);
+  BakeBRDF(brdfSize, brdfSamples, ibl.brdf);
+}
+
+bool SoftRasterizer::Invert(const float m[16], float inv[16]) {
+  double a[4][8];
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++) {
+      a[r][c] = m[r * 4 + c];
+      a[r][c + 4] = r == c ? 1.0 : 0.0;
+    }
+
+  // Gauss-Jordan with partial pivoting
+  for (int c = 0; c < 4; c++) {
+    int pivot = c;
+    for (int r = c + 1; r < 4; r++)
+      if (fabs(a[r][c]) > fabs(a[pivot][c]))
+        pivot = r;
+    if (fabs(a[pivot][c]) < 1e-12)
+      return false;
+    for (int i = 0; i < 8; i++)
+      std::swap(a[c][i], a[pivot][i]);
+
+    double scale = 1.0 / a[c][c];
+    for (int i = 0; i < 8; i++)
+      a[c][i] *= scale;
+    for (int r = 0; r < 4; r++) {
+      if (r == c)
+        continue;
+      double f = a[r][c];
+      for (int i = 0; i < 8; i++)
+        a[r][i] -= f * a[c][i];
+    }
+  }
+
+  for (int r = 0; r < 4; r++)
+    for (int c = 0; c < 4; c++)
+      inv[r * 4 + c] = (float)a[r][c + 4];
+  return true;
+}
+
+void SoftRasterizer::TransformVertices(const SoftScene& scene, const SoftCamera& camera) {
+  struct Task {
+    uint32_t mesh;
+    size_t begin, end;
+  };
+  std::vector<Task> tasks;
+
+  meshVertices.resize(scene.meshes.size());
+  for (uint32_t m = 0; m < (uint32_t)scene.meshes.size(); m++) {
+    size_t count = scene.meshes[m].vertices.size();
+    meshVertices[m].resize(count);
+    for (size_t begin = 0; begin < count; begin += verticesPerTask)
+      tasks.push_back({ m, begin, std::min(begin + verticesPerTask, count) });
+  }
+
+  // pbrLightable_VS
+  ParallelFor(tasks.size(), [&](size_t t) {
+    const Task& task = tasks[t];
+    const SoftMesh& mesh = scene.meshes[task.mesh];
+    for (size_t i = task.begin; i < task.end; i++) {
+      const SoftVertex& in = mesh.vertices[i];
+      ShadedVertex& out = meshVertices[task.mesh][i];
+
+      float world[4];
+      TransformPoint(mesh.world, in.pos, 1.0f, world);
+      TransformPoint(camera.viewProjection, world, world[3], out.clip);
+      memcpy(out.world, world, sizeof(out.world));
+      TransformDir(mesh.world, in.norm, out.normal);
+      TransformDir(mesh.world, in.tangent, out.tangent);
+      memcpy(out.uv, in.texUV, sizeof(out.uv));
+    }
+  }, settings.threads);
+}
+
+void SoftRasterizer::ClipAndSetup(const ShadedVertex* triangle[3], uint32_t mesh, std::vector<SetupTriangle>& triangles) const {
+  // Near, far and guard band planes (D3D clip space: 0 <= z <= w)
+  const float bandX = 1.0f + 2.0f * guardBand / width;
+  const float bandY = 1.0f + 2.0f * guardBand / height;
+  const ClipPlane planes[6] = {
+    { 0, 0, 1, 0 }, { 0, 0, -1, 1 },
+    { 1, 0, 0, bandX }, { -1, 0, 0, bandX },
+    { 0, 1, 0, bandY }, { 0, -1, 0, bandY },
+  };
+
+  uint32_t outsideAll = 0x3f, outsideAny = 0;
+  for (int i = 0; i < 3; i++) {
+    uint32_t outside = 0;
+    for (int p = 0; p < 6; p++)
+      if (planes[p].Distance(triangle[i]->clip) < 0)
+        outside |= 1u << p;
+    outsideAll &= outside;
+    outsideAny |= outside;
+  }
+  if (outsideAll)
+    return;
+
+  // Sutherland-Hodgman only for triangles crossing planes, vertex attributes are linear in clip space
+  ShadedVertex buffers[2][9];
+  uint32_t count = 3;
+  for (int i = 0; i < 3; i++)
+    buffers[0][i] = *triangle[i];
+
+  int current = 0;
+  for (int p = 0; p < 6 && count >= 3; p++) {
+    if (!(outsideAny & (1u << p)))
+      continue;
+
+    const ShadedVertex* in = buffers[current];
+    ShadedVertex* out = buffers[1 - current];
+    uint32_t outCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      const ShadedVertex& a = in[i];
+      const ShadedVertex& b = in[(i + 1) % count];
+      float da = planes[p].Distance(a.clip), db = planes[p].Distance(b.clip);
+      if (da >= 0)
+        out[outCount++] = a;
+      if ((da >= 0) != (db >= 0)) {
+        float t = da / (da - db);
+        const float* fa = (const float*)&a;
+        const float* fb = (const float*)&b;
+        float* fo = (float*)&out[outCount++];
+        for (size_t f = 0; f < sizeof(ShadedVertex) / sizeof(float); f++)
+          fo[f] = fa[f] + (fb[f] - fa[f]) * t;
+      }
+    }
+    count = outCount;
+    current = 1 - current;
+  }
+
+  // Fan of the clipped polygon
+  const ShadedVertex* poly = buffers[current];
+  for (uint32_t i = 1; i + 1 < count; i++) {
+    const ShadedVertex* v[3] = { &poly[0], &poly[i], &poly[i + 1] };
+
+    SetupTriangle tri;
+    for (int j = 0; j < 3; j++) {
+      float invW = 1.0f / v[j]->clip[3];
+      tri.x[j] = roundf((v[j]->clip[0] * invW * 0.5f + 0.5f) * width * subpixels) / subpixels;
+      tri.y[j] = roundf((0.5f - v[j]->clip[1] * invW * 0.5f) * height * subpixels) / subpixels;
+      tri.z[j] = v[j]->clip[2] * invW;
+      tri.invW[j] = invW;
+      tri.vertices[j] = *v[j];
+    }
+
+    // Clockwise on screen is front facing (FrontCounterClockwise = false)
+    double area = ((double)tri.x[1] - tri.x[0]) * ((double)tri.y[2] - tri.y[0]) - ((double)tri.x[2] - tri.x[0]) * ((double)tri.y[1] - tri.y[0]);
+    if (area == 0 || (settings.cullBackFaces && area < 0))
+      continue;
+    tri.area = (float)fabs(area);
+
+    // Edge i is opposite to vertex i. It is evaluated from its lower end in (y, x) order,
+    // so triangles sharing the edge compute exactly negated values and no pixel is lost or drawn twice.
+    tri.topLeft = 0;
+    for (int e = 0; e < 3; e++) {
+      int a = (e + 1) % 3, b = (e + 2) % 3;
+      if (tri.y[b] < tri.y[a] || (tri.y[b] == tri.y[a] && tri.x[b] < tri.x[a]))
+        std::swap(a, b);
+
+      float A = tri.y[b] - tri.y[a];
+      float B = tri.x[a] - tri.x[b];
+      double side = (double)A * ((double)tri.x[e] - tri.x[a]) + (double)B * ((double)tri.y[e] - tri.y[a]);
+      if (side < 0)
+        A = -A, B = -B;
+
+      tri.edgeA[e] = A;
+      tri.edgeB[e] = B;
+      tri.edgeX[e] = tri.x[a];
+      tri.edgeY[e] = tri.y[a];
+      if (A > 0 || (A == 0 && B > 0))
+        tri.topLeft |= 1u << e;
+    }
+
+    // Pixels with centers inside the bounds
+    float minX = std::min(std::min(tri.x[0], tri.x[1]), tri.x[2]);
+    float maxX = std::max(std::max(tri.x[0], tri.x[1]), tri.x[2]);
+    float minY = std::min(std::min(tri.y[0], tri.y[1]), tri.y[2]);
+    float maxY = std::max(std::max(tri.y[0], tri.y[1]), tri.y[2]);
+    tri.minX = std::max((int32_t)ceilf(minX - 0.5f), 0);
+    tri.minY = std::max((int32_t)ceilf(minY - 0.5f), 0);
+    tri.maxX = std::min((int32_t)floorf(maxX - 0.5f), (int32_t)width - 1);
+    tri.maxY = std::min((int32_t)floorf(maxY - 0.5f), (int32_t)height - 1);
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+      continue;
+
+    tri.mesh = mesh;
+    triangles.push_back(tri);
+  }
+}
+
+void SoftRasterizer::SetupTriangles(const SoftScene& scene) {
+  // Triangles of all meshes are numbered in draw order and split into chunks
+  std::vector<size_t> meshFirst(scene.meshes.size() + 1, 0);
+  for (size_t m = 0; m < scene.meshes.size(); m++)
+    meshFirst[m + 1] = meshFirst[m] + scene.meshes[m].indices.size() / 3;
+  size_t total = meshFirst.back();
+  stats.trianglesIn = total;
+
+  size_t chunks = (total + trianglesPerChunk - 1) / trianglesPerChunk;
+  uint32_t tiles = tilesX * tilesY;
+  chunkTriangles.resize(chunks);
+  chunkBins.resize(chunks);
+
+  ParallelFor(chunks, [&](size_t c) {
+    std::vector<SetupTriangle>& triangles = chunkTriangles[c];
+    std::vector<std::vector<uint32_t>>& bins = chunkBins[c];
+    triangles.clear();
+    bins.resize(tiles);
+    for (auto& bin : bins)
+      bin.clear();
+
+    size_t begin = c * trianglesPerChunk, end = std::min(begin + trianglesPerChunk, total);
+    size_t mesh = std::upper_bound(meshFirst.begin(), meshFirst.end(), begin) - meshFirst.begin() - 1;
+    for (size_t t = begin; t < end; t++) {
+      while (t >= meshFirst[mesh + 1])
+        mesh++;
+
+      const std::vector<uint32_t>& indices = scene.meshes[mesh].indices;
+      const std::vector<ShadedVertex>& vertices = meshVertices[mesh];
+      size_t first = (t - meshFirst[mesh]) * 3;
+      if (indices[first] >= vertices.size() || indices[first + 1] >= vertices.size() || indices[first + 2] >= vertices.size())
+        continue;
+
+      const ShadedVertex* v[3] = { &vertices[indices[first]], &vertices[indices[first + 1]], &vertices[indices[first + 2]] };
+      size_t firstNew = triangles.size();
+      ClipAndSetup(v, (uint32_t)mesh, triangles);
+
+      for (size_t i = firstNew; i < triangles.size(); i++) {
+        const SetupTriangle& tri = triangles[i];
+        uint32_t tx0 = tri.minX / settings.tileSize, tx1 = tri.maxX / settings.tileSize;
+        uint32_t ty0 = tri.minY / settings.tileSize, ty1 = tri.maxY / settings.tileSize;
+        for (uint32_t ty = ty0; ty <= ty1; ty++)
+          for (uint32_t tx = tx0; tx <= tx1; tx++)
+            bins[ty * tilesX + tx].push_back((uint32_t)i);
+      }
+    }
+  }, settings.threads);
+
+  for (size_t c = 0; c < chunks; c++) {
+    stats.trianglesSetup += chunkTriangles[c].size();
+    for (const auto& bin : chunkBins[c])
+      stats.binnedTriangles += bin.size();
+  }
+}
+
+void SoftRasterizer::RasterizeTile(const SoftScene& scene, const SoftCamera& camera, const float invViewProj[16], uint32_t tile, HDRImage& color) {
+  const uint32_t tileSize = settings.tileSize;
+  const int32_t x0 = (int32_t)((tile % tilesX) * tileSize), y0 = (int32_t)((tile / tilesX) * tileSize);
+  const int32_t x1 = std::min(x0 + (int32_t)tileSize, (int32_t)width), y1 = std::min(y0 + (int32_t)tileSize, (int32_t)height);
+
+  // Depth and visibility (triangle per pixel) of the tile, rows are tileSize wide
+  thread_local std::vector<float> tileDepth;
+  thread_local std::vector<const SetupTriangle*> tileVisibility;
+  tileDepth.assign((size_t)tileSize * tileSize, 1.0f);
+  tileVisibility.assign((size_t)tileSize * tileSize, nullptr);
+
+  for (size_t c = 0; c < chunkBins.size(); c++) {
+    for (uint32_t index : chunkBins[c][tile]) {
+      const SetupTriangle& tri = chunkTriangles[c][index];
+      int32_t minX = std::max(tri.minX, x0), maxX = std::min(tri.maxX, x1 - 1);
+      int32_t minY = std::max(tri.minY, y0), maxY = std::min(tri.maxY, y1 - 1);
+      if (minX > maxX || minY > maxY)
+        continue;
+
+      float invArea = 1.0f / tri.area;
+      float dz1 = (tri.z[1] - tri.z[0]) * invArea, dz2 = (tri.z[2] - tri.z[0]) * invArea;
+
+      // 4 pixels of a row at once, first pixel is aligned to 4 inside the tile
+      int32_t startX = x0 + ((minX - x0) & ~3);
+#ifdef SOFTRAST_USE_SSE
+      __m128 edgeA[3], edgeX[3], topLeft[3];
+      for (int e = 0; e < 3; e++) {
+        edgeA[e] = _mm_set1_ps(tri.edgeA[e]);
+        edgeX[e] = _mm_set1_ps(tri.edgeX[e]);
+        topLeft[e] = _mm_castsi128_ps(_mm_set1_epi32((tri.topLeft >> e) & 1 ? -1 : 0));
+      }
+      const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+      const __m128i laneIndices = _mm_set_epi32(3, 2, 1, 0);
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 z0 = _mm_set1_ps(tri.z[0]), vdz1 = _mm_set1_ps(dz1), vdz2 = _mm_set1_ps(dz2);
+
+      for (int32_t y = minY; y <= maxY; y++) {
+        float py = y + 0.5f;
+        __m128 rowTerm[3];
+        for (int e = 0; e < 3; e++)
+          rowTerm[e] = _mm_set1_ps(tri.edgeB[e] * (py - tri.edgeY[e]));
+
+        float* depthRow = &tileDepth[(size_t)(y - y0) * tileSize];
+        const SetupTriangle** visRow = &tileVisibility[(size_t)(y - y0) * tileSize];
+        for (int32_t x = startX; x <= maxX; x += 4) {
+          __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+          __m128i lane = _mm_add_epi32(_mm_set1_epi32(x), laneIndices);
+          __m128 mask = _mm_castsi128_ps(_mm_and_si128(
+            _mm_cmpgt_epi32(lane, _mm_set1_epi32(minX - 1)), _mm_cmplt_epi32(lane, _mm_set1_epi32(maxX + 1))));
+
+          __m128 edge[3];
+          for (int e = 0; e < 3; e++) {
+            edge[e] = _mm_add_ps(_mm_mul_ps(edgeA[e], _mm_sub_ps(px, edgeX[e])), rowTerm[e]);
+            __m128 inside = _mm_or_ps(_mm_cmpgt_ps(edge[e], zero), _mm_and_ps(_mm_cmpeq_ps(edge[e], zero), topLeft[e]));
+            mask = _mm_and_ps(mask, inside);
+          }
+          if (_mm_movemask_ps(mask) == 0)
+            continue;
+
+          // Screen linear depth from barycentrics of vertices 1 and 2
+          __m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(edge[1], vdz1), _mm_mul_ps(edge[2], vdz2)));
+          float* depthPtr = depthRow + (x - x0);
+          __m128 stored = _mm_loadu_ps(depthPtr);
+          mask = _mm_and_ps(mask, _mm_cmplt_ps(z, stored));
+          int bits = _mm_movemask_ps(mask);
+          if (bits == 0)
+            continue;
+
+          _mm_storeu_ps(depthPtr, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+          for (int lane = 0; lane < 4; lane++)
+            if (bits & (1 << lane))
+              visRow[x - x0 + lane] = &tri;
+        }
+      }
+#else
+      for (int32_t y = minY; y <= maxY; y++) {
+        float py = y + 0.5f;
+        float* depthRow = &tileDepth[(size_t)(y - y0) * tileSize];
+        const SetupTriangle** visRow = &tileVisibility[(size_t)(y - y0) * tileSize];
+        for (int32_t x = startX; x <= maxX; x++) {
+          if (x < minX)
+            continue;
+
+          float px = x + 0.5f;
+          float edge[3];
+          bool inside = true;
+          for (int e = 0; e < 3; e++) {
+            edge[e] = tri.edgeA[e] * (px - tri.edgeX[e]) + tri.edgeB[e] * (py - tri.edgeY[e]);
+            inside = inside && (edge[e] > 0 || (edge[e] == 0 && ((tri.topLeft >> e) & 1)));
+          }
+          if (!inside)
+            continue;
+
+          float z = tri.z[0] + (edge[1] * dz1 + edge[2] * dz2);
+          if (z < depthRow[x - x0]) {
+            depthRow[x - x0] = z;
+            visRow[x - x0] = &tri;
+          }
+        }
+      }
+#endif
+    }
+  }
+
+  // Shade visible pixels once, background is the environment like skybox_PS
+  uint64_t shaded = 0;
+  for (int32_t y = y0; y < y1; y++) {
+    for (int32_t x = x0; x < x1; x++) {
+      size_t local = (size_t)(y - y0) * tileSize + (x - x0);
+      const SetupTriangle* tri = tileVisibility[local];
+      float* out = color.Texel(x, y);
+      depth[(size_t)y * width + x] = tileDepth[local];
+
+      float px = x + 0.5f, py = y + 0.5f;
+      if (!tri) {
+        out[0] = out[1] = out[2] = out[3] = 1.0f;
+        if (scene.ibl.environment.MipLevels() > 0) {
+          float ndc[3] = { px / width * 2.0f - 1.0f, 1.0f - py / height * 2.0f, 1.0f };
+          float farPoint[4];
+          TransformPoint(invViewProj, ndc, 1.0f, farPoint);
+          float dir[3] = { farPoint[0] / farPoint[3] - camera.position[0], farPoint[1] / farPoint[3] - camera.position[1], farPoint[2] / farPoint[3] - camera.position[2] };
+          OctahedralConverter::Sample(scene.ibl.environment, dir, 0.0f, out);
+          out[3] = 1.0f;
+        }
+        continue;
+      }
+
+      // Perspective correct barycentrics
+      float b[3], sum = 0.0f;
+      for (int e = 0; e < 3; e++) {
+        float edge = tri->edgeA[e] * (px - tri->edgeX[e]) + tri->edgeB[e] * (py - tri->edgeY[e]);
+        b[e] = std::max(edge, 0.0f) * tri->invW[e];
+        sum += b[e];
+      }
+      float invSum = sum > 0 ? 1.0f / sum : 0.0f;
+
+      const size_t vertexFloats = sizeof(ShadedVertex) / sizeof(float);
+      float attributes[sizeof(ShadedVertex) / sizeof(float)];
+      for (size_t f = 0; f < vertexFloats; f++) {
+        float value = 0.0f;
+        for (int e = 0; e < 3; e++)
+          value += ((const float*)&tri->vertices[e])[f] * b[e];
+        attributes[f] = value * invSum;
+      }
+
+      const ShadedVertex* in = (const ShadedVertex*)attributes;
+      ShadePixel(scene, scene.meshes[tri->mesh].material, camera.position, in->world, in->normal, in->tangent, in->uv, out);
+      out[3] = 1.0f;
+      shaded++;
+    }
+  }
+  tilePixels[tile] = shaded;
+}
+
+void SoftRasterizer::Render(const SoftScene& scene, const SoftCamera& camera, uint32_t frameWidth, uint32_t frameHeight, HDRImage& color) {
+  auto start = Clock::now();
+  stats = SoftFrameStats();
+
+  width = std::max(frameWidth, 1u);
+  height = std::max(frameHeight, 1u);
+  settings.tileSize = std::max((settings.tileSize + 3) & ~3u, 4u);
+  tilesX = (width + settings.tileSize - 1) / settings.tileSize;
+  tilesY = (height + settings.tileSize - 1) / settings.tileSize;
+  stats.tiles = tilesX * tilesY;
+
+  color.Resize(width, height);
+  depth.assign((size_t)width * height, 1.0f);
+  tilePixels.assign(stats.tiles, 0);
+
+  auto stage = Clock::now();
+  TransformVertices(scene, camera);
+  stats.vertexMs = Ms(stage);
+
+  stage = Clock::now();
+  SetupTriangles(scene);
+  stats.setupMs = Ms(stage);
+
+  float invViewProj[16];
+  if (!Invert(camera.viewProjection, invViewProj))
+    memset(invViewProj, 0, sizeof(invViewProj));
+
+  stage = Clock::now();
+  ParallelFor(stats.tiles, [&](size_t tile) {
+    RasterizeTile(scene, camera, invViewProj, (uint32_t)tile, color);
+  }, settings.threads);
+  stats.rasterMs = Ms(stage);
+
+  for (uint64_t pixels : tilePixels)
+    stats.pixelsShaded += pixels;
+  stats.totalMs = Ms(start);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CubeMapConverter.h"
+#include "OctahedralConverter.h"
+
+// Same layout as Model::Vertex (pbrLightable_VS input)
+struct SoftVertex {
+  float pos[3];
+  float norm[3];
+  float tangent[3];
+  float texUV[2];
+};
+
+// Texture indices into SoftScene::textures, -1 - not bound: shading uses material constants, debug views sample 0 like null SRV
+struct SoftMaterial {
+  int albedoTex = -1;
+  int metalRoughTex = -1; // r - metalness, g - roughness
+  int normalTex = -1;
+};
+
+struct SoftMesh {
+  std::vector<SoftVertex> vertices;
+  std::vector<uint32_t> indices;
+  float world[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }; // row vector convention like XMMATRIX
+  SoftMaterial material;
+};
+
+// Light::GetLightPosition / GetLightColor, position.w > 0.5 - directional light
+struct SoftLight {
+  float position[4];
+  float color[4]; // w - intensity
+};
+
+// WorldMatrixBuffer pbr/albedo and SceneMatrixBuffer viewMode of pbrLightable_PS
+struct SoftShadingParams {
+  float roughness = 0.5f;
+  float metalness = 0.5f;
+  float dielectricF0 = 0.5f;
+  float albedo[3] = { 1.0f, 1.0f, 1.0f };
+
+  int modelViewMode = 0; // 0 - full, 1 - normal, 2 - roughness/metalness, 3 - texture
+  bool isPlainNormal = false;
+  bool isPlainMetalRough = false;
+  bool isPlainColor = false;
+};
+
+// IBL maps in octahedral layout (OCTAHEDRAL_IBL path of the shader), environment is the skybox
+struct SoftIBL {
+  OctahedralImage environment;
+  OctahedralImage irradiance;
+  OctahedralImage prefiltered;
+  HDRImage brdf; // r - scale, g - bias; u - NdotV, v - roughness
+};
+
+struct SoftScene {
+  std::vector<SoftMesh> meshes;
+  std::vector<HDRImage> textures;
+  std::vector<SoftLight> lights; // first 10 are used like MAX_LIGHT_SOURCES
+  SoftShadingParams shading;
+  SoftIBL ibl;
+};
+
+struct SoftCamera {
+  float viewProjection[16]; // row vector convention, D3D clip space (z in [0, w])
+  float position[3];
+};
+
+struct SoftRasterizerSettings {
+  uint32_t tileSize = 64;    // pixels, tiles are rasterized and shaded independently
+  uint32_t threads = 0;      // 0 - all workers
+  bool cullBackFaces = false; // Model renders with CULL_NONE
+};
+
+struct SoftFrameStats {
+  uint64_t trianglesIn = 0;
+  uint64_t trianglesSetup = 0;  // after clipping, culling and degenerate rejection
+  uint64_t binnedTriangles = 0; // triangle-tile pairs
+  uint64_t pixelsShaded = 0;
+  uint32_t tiles = 0;
+  double vertexMs = 0, setupMs = 0, rasterMs = 0, totalMs = 0;
+
+  double MTrisPerSecond() const { return totalMs > 0 ? trianglesIn / (totalMs * 1000.0) : 0.0; }
+  double MPixelsPerSecond() const { return totalMs > 0 ? pixelsShaded / (totalMs * 1000.0) : 0.0; }
+};
+
+// Tile based CPU rasterizer running the pbrLightable pipeline without GPU.
+// Triangles are clipped (near/far and guard band), snapped to 1/16 pixel and binned into screen tiles;
+// every tile is rasterized with 4-wide edge functions into a depth and visibility buffer,
+// then visible pixels are shaded once with the C++ port of pbrLightable_PS. Tiles are spread over ParallelFor
+// and primitive order is kept inside tiles, so the image does not depend on thread count.
+// Local reflection probes are not supported (skybox IBL only).
+class SoftRasterizer {
+public:
+  SoftRasterizer() {};
+
+  SoftRasterizer(const SoftRasterizerSettings& rasterizerSettings) : settings(rasterizerSettings) {};
+
+  void SetSettings(const SoftRasterizerSettings& rasterizerSettings) { settings = rasterizerSettings; }
+  const SoftRasterizerSettings& GetSettings() const { return settings; }
+
+  // Color is RGBA HDR like the scene render target before postprocessing
+  void Render(const SoftScene& scene, const SoftCamera& camera, uint32_t width, uint32_t height, HDRImage& color);
+
+  // Post projection depth of the last frame, 1 - background
+  const std::vector<float>& GetDepth() const { return depth; }
+  const SoftFrameStats& GetStats() const { return stats; }
+
+  // Environment lookup maps from lat-long image, same filtering as OctahedralIBLGenerator
+  static void BuildIBL(const HDRImage& equirect, const OctahedralPrefilterParams& params, SoftIBL& ibl, uint32_t brdfSize = 32, uint32_t brdfSamples = 1024);
+
+  // Split sum BRDF map of BRDFGenerator_PS with fixed sample count
+  static void BakeBRDF(uint32_t size, uint32_t samples, HDRImage& brdf);
+
+  // pbrLightable_PS for one pixel; uv - texture coordinates, world/normal/tangent are interpolated VS outputs
+  static void ShadePixel(const SoftScene& scene, const SoftMaterial& material, const float camPos[3],
+    const float world[3], const float normal[3], const float tangent[3], const float uv[2], float rgb[3]);
+
+  // Bilinear fetch with wrap addressing (Model textures have no mips), 0 for missing texture
+  static void SampleWrap(const SoftScene& scene, int texture, const float uv[2], float rgba[4]);
+
+  static bool Invert(const float m[16], float inv[16]);
+
+private:
+  // pbrLightable_VS output
+  struct ShadedVertex {
+    float clip[4];
+    float world[3];
+    float normal[3];
+    float tangent[3];
+    float uv[2];
+  };
+
+  struct SetupTriangle {
+    float x[3], y[3];    // snapped screen position, counter clockwise after setup
+    float z[3], invW[3];
+    float edgeA[3], edgeB[3], edgeX[3], edgeY[3]; // edge i is opposite to vertex i, anchored at (edgeX, edgeY)
+    uint32_t topLeft;    // bit per edge, pixels exactly on it belong to this triangle
+    float area;          // twice the screen area
+    int32_t minX, minY, maxX, maxY;
+    uint32_t mesh;
+    ShadedVertex vertices[3];
+  };
+
+  void TransformVertices(const SoftScene& scene, const SoftCamera& camera);
+  void SetupTriangles(const SoftScene& scene);
+  void ClipAndSetup(const ShadedVertex* triangle[3], uint32_t mesh, std::vector<SetupTriangle>& triangles) const;
+  void RasterizeTile(const SoftScene& scene, const SoftCamera& camera, const float invViewProj[16], uint32_t tile, HDRImage& color);
+
+  SoftRasterizerSettings settings;
+  SoftFrameStats stats;
+
+  uint32_t width = 0, height = 0;
+  uint32_t tilesX = 0, tilesY = 0;
+  std::vector<float> depth;
+
+  // Frame data
+  std::vector<std::vector<ShadedVertex>> meshVertices;
+  std::vector<std::vector<SetupTriangle>> chunkTriangles;    // setup output by chunks of input triangles
+  std::vector<std::vector<std::vector<uint32_t>>> chunkBins; // [chunk][tile] - triangle indices in chunk
+  std::vector<uint64_t> tilePixels;
+};
@@ -0,0 +1,350 @@
+#include "SoftSceneLoader.h"
+#include "RadianceHDRDecoder.h"
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "../libs/tiny_gltf.h"
+
+namespace {
+  // Row vector product like XMMatrixMultiply
+  void Multiply(const float a[16], const float b[16], float out[16]) {
+    float result[16];
+    for (int r = 0; r < 4; r++)
+      for (int c = 0; c < 4; c++)
+        result[r * 4 + c] = a[r * 4 + 0] * b[0 * 4 + c] + a[r * 4 + 1] * b[1 * 4 + c] + a[r * 4 + 2] * b[2 * 4 + c] + a[r * 4 + 3] * b[3 * 4 + c];
+    memcpy(out, result, sizeof(result));
+  }
+
+  class GLTFReader {
+  public:
+    GLTFReader(const tinygltf::Model& model, const std::vector<uint8_t>& bin) : model(model), bin(bin) {};
+
+    // Accessor elements of count * components floats, missing components are 0 (Model::LoadSpecificTypeArray)
+    bool ReadFloats(int accessorId, int components, std::vector<float>& values) const {
+      if (accessorId < 0 || accessorId >= (int)model.accessors.size())
+        return false;
+      const tinygltf::Accessor& accessor = model.accessors[accessorId];
+      int stored = tinygltf::GetNumComponentsInType(accessor.type);
+      if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || stored <= 0)
+        return false;
+
+      const uint8_t* data = Data(accessor, sizeof(float) * stored);
+      if (!data)
+        return false;
+      values.assign(accessor.count * components, 0.0f);
+      for (size_t i = 0; i < accessor.count; i++)
+        memcpy(&values[i * components], data + i * stored * sizeof(float), sizeof(float) * std::min(stored, components));
+      return true;
+    }
+
+    bool ReadIndices(int accessorId, std::vector<uint32_t>& indices) const {
+      if (accessorId < 0 || accessorId >= (int)model.accessors.size())
+        return false;
+      const tinygltf::Accessor& accessor = model.accessors[accessorId];
+      indices.resize(accessor.count);
+      if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
+        return Convert<uint32_t>(accessor, indices);
+      if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT)
+        return Convert<uint16_t>(accessor, indices);
+      if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_SHORT)
+        return Convert<int16_t>(accessor, indices);
+      return false;
+    }
+
+  private:
+    // Elements are tightly packed from bufferView.byteOffset + accessor.byteOffset of the .bin file, as Model reads them
+    const uint8_t* Data(const tinygltf::Accessor& accessor, size_t elementSize) const {
+      if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size())
+        return nullptr;
+      size_t offset = model.bufferViews[accessor.bufferView].byteOffset + accessor.byteOffset;
+      if (offset > bin.size() || (bin.size() - offset) / elementSize < accessor.count)
+        return nullptr;
+      return bin.data() + offset;
+    }
+
+    template<typename IndexType>
+    bool Convert(const tinygltf::Accessor& accessor, std::vector<uint32_t>& indices) const {
+      const uint8_t* data = Data(accessor, sizeof(IndexType));
+      if (!data)
+        return false;
+      for (size_t i = 0; i < accessor.count; i++) {
+        IndexType index;
+        memcpy(&index, data + i * sizeof(IndexType), sizeof(IndexType));
+        indices[i] = (uint32_t)index;
+      }
+      return true;
+    }
+
+    const tinygltf::Model& model;
+    const std::vector<uint8_t>& bin;
+  };
+
+  bool LoadMesh(const tinygltf::Model& model, const GLTFReader& reader, size_t meshId, SoftMesh& mesh) {
+    const tinygltf::Primitive& primitive = model.meshes[meshId].primitives[0];
+    auto attribute = [&](const char* name) {
+      auto it = primitive.attributes.find(name);
+      return it != primitive.attributes.end() ? it->second : -1;
+    };
+
+    std::vector<float> pos, norm, tangent, texUV;
+    if (!reader.ReadFloats(attribute("POSITION"), 3, pos) || pos.empty())
+      return false;
+    size_t count = pos.size() / 3;
+    // Other attributes may be missing like in Model::GenerateVerticiesArray
+    reader.ReadFloats(attribute("NORMAL"), 3, norm);
+    reader.ReadFloats(attribute("TANGENT"), 3, tangent);
+    reader.ReadFloats(attribute("TEXCOORD_0"), 2, texUV);
+    norm.resize(count * 3, 0.0f);
+    tangent.resize(count * 3, 0.0f);
+    texUV.resize(count * 2, 0.0f);
+
+    mesh.vertices.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      SoftVertex& vertex = mesh.vertices[i];
+      memcpy(vertex.pos, &pos[i * 3], sizeof(vertex.pos));
+      memcpy(vertex.norm, &norm[i * 3], sizeof(vertex.norm));
+      memcpy(vertex.tangent, &tangent[i * 3], sizeof(vertex.tangent));
+      memcpy(vertex.texUV, &texUV[i * 2], sizeof(vertex.texUV));
+      vertex.pos[0] *= -1, vertex.norm[0] *= -1, vertex.tangent[0] *= -1;
+    }
+
+    if (!reader.ReadIndices(primitive.indices, mesh.indices))
+      return false;
+    for (uint32_t index : mesh.indices)
+      if (index >= count)
+        return false;
+
+    // Texture ids of the material to image ids, as Model binds them
+    if (primitive.material < 0 || primitive.material >= (int)model.materials.size())
+      return true;
+    const tinygltf::Material& material = model.materials[primitive.material];
+    auto image = [&](int texture) {
+      return texture >= 0 && texture < (int)model.textures.size() ? model.textures[texture].source : -1;
+    };
+    mesh.material.albedoTex = image(material.pbrMetallicRoughness.baseColorTexture.index);
+    mesh.material.metalRoughTex = image(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+    mesh.material.normalTex = image(material.normalTexture.index);
+    return true;
+  }
+
+  // Model::CountMatrixTransformation: matrix, translation and scale are applied, rotation is not
+  void CountWorldMatrices(const tinygltf::Model& model, int nodeId, const float parent[16], std::vector<SoftMesh>& meshes) {
+    const tinygltf::Node& node = model.nodes[nodeId];
+    float current[16];
+    memcpy(current, parent, sizeof(current));
+    if (node.matrix.size() == 16) {
+      float matrix[16];
+      for (int i = 0; i < 16; i++)
+        matrix[i] = (float)node.matrix[i];
+      Multiply(current, matrix, current);
+    }
+    if (node.translation.size() == 3) {
+      float translation[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0,
+        (float)node.translation[0], (float)node.translation[1], (float)node.translation[2], 1 };
+      Multiply(current, translation, current);
+    }
+    if (node.scale.size() == 3) {
+      float scale[16] = { (float)node.scale[0], 0, 0, 0, 0, (float)node.scale[1], 0, 0, 0, 0, (float)node.scale[2], 0, 0, 0, 0, 1 };
+      Multiply(current, scale, current);
+    }
+
+    if (node.mesh >= 0 && node.mesh < (int)meshes.size())
+      memcpy(meshes[node.mesh].world, current, sizeof(current));
+    for (int child : node.children)
+      if (child >= 0 && child < (int)model.nodes.size())
+        CountWorldMatrices(model, child, current, meshes);
+  }
+
+  void Normalize(float v[3]) {
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int i = 0; i < 3; i++)
+      v[i] /= length;
+  }
+
+  void Cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  }
+
+  void MakeDir(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+  }
+}
+
+bool LoadSoftModel(const std::string& gltfPath, const std::string& binPath, SoftScene& scene, std::string& error) {
+  TRACE_SCOPE("glTF parse and image decode");
+  tinygltf::Model model;
+  tinygltf::TinyGLTF loader;
+  std::string warn;
+  if (!loader.LoadASCIIFromFile(&model, &error, &warn, gltfPath) || !error.empty()) {
+    error = gltfPath + ": " + (error.empty() ? "can't parse" : error);
+    return false;
+  }
+
+  std::ifstream file(binPath, std::ios::binary);
+  if (!file) {
+    error = binPath + ": can't open";
+    return false;
+  }
+  std::vector<uint8_t> bin((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  scene.meshes = std::vector<SoftMesh>(model.meshes.size());
+  GLTFReader reader(model, bin);
+  for (size_t i = 0; i < model.meshes.size(); i++)
+    if (model.meshes[i].primitives.empty() || !LoadMesh(model, reader, i, scene.meshes[i])) {
+      error = gltfPath + ": mesh " + std::to_string(i) + " has unsupported or out of range data";
+      return false;
+    }
+
+  if (!model.scenes.empty()) {
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    const tinygltf::Scene& gltfScene = model.scenes[std::max(model.defaultScene, 0)];
+    for (int nodeId : gltfScene.nodes)
+      if (nodeId >= 0 && nodeId < (int)model.nodes.size())
+        CountWorldMatrices(model, nodeId, identity, scene.meshes);
+  }
+
+  // UNORM or float RGBA like Model::InitTexture
+  scene.textures = std::vector<HDRImage>(model.images.size());
+  for (size_t i = 0; i < model.images.size(); i++) {
+    const tinygltf::Image& image = model.images[i];
+    bool isFloat = image.pixel_type == TINYGLTF_COMPONENT_TYPE_FLOAT;
+    if ((!isFloat && image.pixel_type != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) || image.component != 4) {
+      error = gltfPath + ": image " + std::to_string(i) + " is not RGBA8 or RGBA32F";
+      return false;
+    }
+
+    HDRImage& texture = scene.textures[i];
+    texture.Resize(image.width, image.height);
+    for (size_t j = 0; j < texture.data.size(); j++) {
+      if (isFloat)
+        memcpy(&texture.data[j], &image.image[j * sizeof(float)], sizeof(float));
+      else
+        texture.data[j] = image.image[j] / 255.0f;
+    }
+  }
+  return true;
+}
+
+bool LoadSoftScene(const SceneDesc& desc, SoftScene& scene, std::string& error) {
+  if (!LoadSoftModel(desc.gltfPath, desc.binPath, scene, error))
+    return false;
+
+  RadianceHDRDecoder decoder;
+  HDRImage equirect;
+  if (!decoder.Open(std::wstring(desc.environmentPath.begin(), desc.environmentPath.end()).c_str()) || !decoder.ReadImage(equirect)) {
+    error = desc.environmentPath + ": " + decoder.GetError();
+    return false;
+  }
+  SoftRasterizer::BuildIBL(equirect, OctahedralPrefilterParams(), scene.ibl);
+
+  // Point lights of Scene::Init, lightsIntensity <= 0 turns them off
+  scene.lights.resize(desc.lights.size());
+  for (size_t i = 0; i < desc.lights.size(); i++) {
+    SoftLight& light = scene.lights[i];
+    memcpy(light.position, desc.lights[i].position, sizeof(desc.lights[i].position));
+    memcpy(light.color, desc.lights[i].color, sizeof(desc.lights[i].color));
+    light.position[3] = 0.0f;
+    light.color[3] = std::max(desc.lightsIntensity, 0.0f);
+  }
+
+  // Scene::pbrMaterial
+  scene.shading = SoftShadingParams();
+  scene.shading.roughness = 0.2f;
+  scene.shading.metalness = 0.3f;
+  scene.shading.dielectricF0 = 0.04f;
+  return true;
+}
+
+void MakeSoftCamera(const BatchView& view, uint32_t width, uint32_t height, SoftCamera& camera) {
+  // XMMatrixLookAtLH
+  float zAxis[3] = { view.target[0] - view.eye[0], view.target[1] - view.eye[1], view.target[2] - view.eye[2] };
+  Normalize(zAxis);
+  float xAxis[3], yAxis[3];
+  Cross(view.up, zAxis, xAxis);
+  Normalize(xAxis);
+  Cross(zAxis, xAxis, yAxis);
+
+  float viewMatrix[16] = {};
+  for (int i = 0; i < 3; i++) {
+    viewMatrix[i * 4 + 0] = xAxis[i];
+    viewMatrix[i * 4 + 1] = yAxis[i];
+    viewMatrix[i * 4 + 2] = zAxis[i];
+    viewMatrix[12] -= xAxis[i] * view.eye[i];
+    viewMatrix[13] -= yAxis[i] * view.eye[i];
+    viewMatrix[14] -= zAxis[i] * view.eye[i];
+  }
+  viewMatrix[15] = 1.0f;
+
+  // XMMatrixPerspectiveFovLH
+  const float pi = 3.14159265358979f;
+  float yScale = 1.0f / std::tan(view.fovY * pi / 360.0f);
+  float xScale = yScale * height / width;
+  float range = view.farZ / (view.farZ - view.nearZ);
+  float projection[16] = { xScale, 0, 0, 0, 0, yScale, 0, 0, 0, 0, range, 1, 0, 0, -range * view.nearZ, 0 };
+
+  Multiply(viewMatrix, projection, camera.viewProjection);
+  memcpy(camera.position, view.eye, sizeof(camera.position));
+}
+
+bool RenderSoftBatch(const BatchDesc& desc, const std::vector<size_t>& jobs, const SoftRasterizerSettings& settings,
+  BatchOutputStats& stats, SoftFrameStats& frameStats, std::string& error) {
+  const BatchOutputSettings& output = desc.output;
+  MakeDir(output.outputDir);
+
+  bool loaded = true;
+  BatchOutputQueue queue(output);
+  SoftRasterizer rasterizer(settings);
+  frameStats = SoftFrameStats();
+  for (size_t jobIndex : jobs) {
+    const BatchJob& job = desc.jobs[jobIndex];
+
+    SoftScene scene;
+    std::string jobError;
+    if (!LoadSoftScene(job.scene, scene, jobError)) {
+      error += "failed to load job " + job.name + ": " + jobError + "\n";
+      loaded = false;
+      continue;
+    }
+
+    for (const BatchView& view : job.views) {
+      SoftCamera camera;
+      MakeSoftCamera(view, output.width, output.height, camera);
+      HDRImage image;
+      rasterizer.Render(scene, camera, output.width, output.height, image);
+
+      const SoftFrameStats& frame = rasterizer.GetStats();
+      frameStats.trianglesIn += frame.trianglesIn;
+      frameStats.trianglesSetup += frame.trianglesSetup;
+      frameStats.binnedTriangles += frame.binnedTriangles;
+      frameStats.pixelsShaded += frame.pixelsShaded;
+      frameStats.tiles += frame.tiles;
+      frameStats.vertexMs += frame.vertexMs;
+      frameStats.setupMs += frame.setupMs;
+      frameStats.rasterMs += frame.rasterMs;
+      frameStats.totalMs += frame.totalMs;
+
+      queue.Push(output.outputDir + "/" + job.name + "_" + view.name + ".png", std::move(image));
+    }
+  }
+
+  queue.Wait();
+  stats = queue.GetStats();
+  return loaded && stats.failed == 0;
+}
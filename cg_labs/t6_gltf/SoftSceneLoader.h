@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BatchDesc.h"
+#include "BatchOutput.h"
+#include "SoftRasterizer.h"
+
+// glTF (.gltf + .bin) meshes, node transforms, materials and images in SoftRasterizer form without D3D.
+// Vertex data, x flip and world matrices are the same as Model gives the pbrLightable pipeline.
+bool LoadSoftModel(const std::string& gltfPath, const std::string& binPath, SoftScene& scene, std::string& error);
+
+// Model, environment IBL, lights and material of SceneDesc as Scene::Init sets them up
+bool LoadSoftScene(const SceneDesc& desc, SoftScene& scene, std::string& error);
+
+// XMMatrixLookAtLH * XMMatrixPerspectiveFovLH of the view
+void MakeSoftCamera(const BatchView& view, uint32_t width, uint32_t height, SoftCamera& camera);
+
+// Batch jobs rendered by SoftRasterizer and written by BatchOutputQueue, frame stats are summed over views.
+// Needs no graphics device, returns false if a job could not be loaded (error names them) or an image is not written.
+bool RenderSoftBatch(const BatchDesc& desc, const std::vector<size_t>& jobs, const SoftRasterizerSettings& settings,
+  BatchOutputStats& stats, SoftFrameStats& frameStats, std::string& error);
@@ -1,4 +1,5 @@
 #include "sphere.h"
+#include "ShaderLibrary.h"
 
 HRESULT Sphere::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
   // Create index array
@@ -43,7 +44,7 @@ HRESULT Sphere::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
   ID3D10Blob* vertexShaderBuffer = nullptr;
   ID3D10Blob* pixelShaderBuffer = nullptr;
 
-  hr = CompileShaderFromFile(L"sphere_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
+  hr = ShaderLibrary::GetInstance().Compile(L"sphere_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
   if (FAILED(hr))
   {
     MessageBox(nullptr,
@@ -60,7 +61,7 @@ HRESULT Sphere::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
   }
 
   // Compile the pixel shader
-  hr = CompileShaderFromFile(L"sphere_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer);
+  hr = ShaderLibrary::GetInstance().Compile(L"sphere_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer);
   if (FAILED(hr))
   {
     MessageBox(nullptr,
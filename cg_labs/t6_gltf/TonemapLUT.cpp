@@ -0,0 +1,247 @@
+#include "TonemapLUT.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "parallel.h"
+
+namespace {
+  // Same weights as BrightnessCalc.hlsl
+  const float lumWeights[3] = { 0.2126f, 0.7151f, 0.0722f };
+  const float middleGrey = 0.18f;
+
+  inline float Saturate(float x) {
+    return std::min(std::max(x, 0.0f), 1.0f);
+  }
+
+  inline float Luminance(const float c[3]) {
+    return c[0] * lumWeights[0] + c[1] * lumWeights[1] + c[2] * lumWeights[2];
+  }
+
+  inline void MulMatrix(const float m[3][3], const float in[3], float out[3]) {
+    float r = m[0][0] * in[0] + m[0][1] * in[1] + m[0][2] * in[2];
+    float g = m[1][0] * in[0] + m[1][1] * in[1] + m[1][2] * in[2];
+    float b = m[2][0] * in[0] + m[2][1] * in[1] + m[2][2] * in[2];
+    out[0] = r;
+    out[1] = g;
+    out[2] = b;
+  }
+
+  inline float Uncharted2Curve(float x) {
+    const float A = 0.10f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+    return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+  }
+
+  inline float OutputTransform(TonemapOutput output, float x) {
+    x = Saturate(x);
+    if (output == TonemapOutput::gamma22)
+      return std::pow(x, 1.0f / 2.2f);
+    return x <= 0.0031308f ? x * 12.92f : 1.055f * std::pow(x, 1.0f / 2.4f) - 0.055f;
+  }
+
+  void Grade(const ColorGrading& grading, const float in[3], float out[3]) {
+    float c[3];
+    for (int i = 0; i < 3; i++)
+      c[i] = std::max(in[i] * grading.whiteBalance[i], 0.0f);
+
+    float lum = Luminance(c);
+    for (int i = 0; i < 3; i++)
+      c[i] = std::max(lum + (c[i] - lum) * grading.saturation, 0.0f);
+
+    // Contrast around middle grey, exposure only moves colors along it
+    for (int i = 0; i < 3; i++)
+      out[i] = c[i] > 0.0f ? middleGrey * std::pow(c[i] / middleGrey, grading.contrast) : 0.0f;
+  }
+}
+
+float TonemapLUTParams::DefaultExposureBias(TonemapOperator op) {
+  // Uncharted2 keeps the previous HDR.hlsl scale, others are brought to similar brightness
+  return op == TonemapOperator::uncharted2 ? 8.0f : 2.0f;
+}
+
+void TonemapLUT::ACESFitted(const float in[3], float out[3]) {
+  // sRGB -> RRT input, RRT + ODT fit, ODT output -> sRGB
+  static const float inputMat[3][3] = {
+    { 0.59719f, 0.35458f, 0.04823f },
+    { 0.07600f, 0.90834f, 0.01566f },
+    { 0.02840f, 0.13383f, 0.83777f },
+  };
+  static const float outputMat[3][3] = {
+    { 1.60475f, -0.53108f, -0.07367f },
+    { -0.10208f, 1.10813f, -0.00605f },
+    { -0.00327f, -0.07276f, 1.07602f },
+  };
+
+  float v[3];
+  MulMatrix(inputMat, in, v);
+  for (int i = 0; i < 3; i++) {
+    float a = v[i] * (v[i] + 0.0245786f) - 0.000090537f;
+    float b = v[i] * (0.983729f * v[i] + 0.4329510f) + 0.238081f;
+    v[i] = a / b;
+  }
+  MulMatrix(outputMat, v, out);
+  for (int i = 0; i < 3; i++)
+    out[i] = Saturate(out[i]);
+}
+
+void TonemapLUT::AgX(const float in[3], float out[3]) {
+  static const float inset[3][3] = {
+    { 0.842479062253094f, 0.0784335999999992f, 0.0792237451477643f },
+    { 0.0423282422610123f, 0.878468636469772f, 0.0791661274605434f },
+    { 0.0423756549057051f, 0.0784336f, 0.879142973793104f },
+  };
+  static const float outset[3][3] = {
+    { 1.19687900512017f, -0.0980208811401368f, -0.0990297440797205f },
+    { -0.0528968517574562f, 1.15190312990417f, -0.0989611768448433f },
+    { -0.0529716355144438f, -0.0980434501171241f, 1.15107367264116f },
+  };
+  const float minEv = -12.47393f, maxEv = 4.026069f;
+
+  float v[3];
+  MulMatrix(inset, in, v);
+  for (int i = 0; i < 3; i++) {
+    float ev = std::log2(std::max(v[i], 1e-10f));
+    float x = (std::min(std::max(ev, minEv), maxEv) - minEv) / (maxEv - minEv);
+
+    // Sigmoid fit of AgX base contrast
+    float x2 = x * x, x4 = x2 * x2;
+    v[i] = 15.5f * x4 * x2 - 40.14f * x4 * x + 31.96f * x4 - 6.868f * x2 * x + 0.4298f * x2 + 0.1191f * x - 0.00232f;
+  }
+  MulMatrix(outset, v, out);
+  for (int i = 0; i < 3; i++)
+    out[i] = std::pow(Saturate(out[i]), 2.2f);
+}
+
+void TonemapLUT::ReinhardExtended(const float in[3], float whitePoint, float out[3]) {
+  float lum = Luminance(in);
+  if (lum <= 0.0f) {
+    out[0] = out[1] = out[2] = 0.0f;
+    return;
+  }
+
+  float mapped = lum * (1.0f + lum / (whitePoint * whitePoint)) / (1.0f + lum);
+  for (int i = 0; i < 3; i++)
+    out[i] = Saturate(in[i] * mapped / lum);
+}
+
+void TonemapLUT::Uncharted2(const float in[3], float whitePoint, float out[3]) {
+  float whiteScale = 1.0f / Uncharted2Curve(whitePoint);
+  for (int i = 0; i < 3; i++)
+    out[i] = Saturate(Uncharted2Curve(in[i]) * whiteScale);
+}
+
+float TonemapLUT::ShaperEncode(const TonemapLUTParams& params, float value) {
+  if (!(value > 0.0f))
+    return 0.0f;
+  return Saturate((std::log2(value) - params.minLog2) / (params.maxLog2 - params.minLog2));
+}
+
+float TonemapLUT::ShaperDecode(const TonemapLUTParams& params, float t) {
+  return std::exp2(params.minLog2 + t * (params.maxLog2 - params.minLog2));
+}
+
+void TonemapLUT::Evaluate(const TonemapLUTParams& params, const float in[3], float out[3]) {
+  float graded[3];
+  Grade(params.grading, in, graded);
+  for (int i = 0; i < 3; i++)
+    graded[i] *= params.exposureBias;
+
+  float mapped[3];
+  switch (params.op) {
+  case TonemapOperator::acesFitted:
+    ACESFitted(graded, mapped);
+    break;
+  case TonemapOperator::agx:
+    AgX(graded, mapped);
+    break;
+  case TonemapOperator::reinhardExtended:
+    ReinhardExtended(graded, params.whitePoint, mapped);
+    break;
+  default:
+    Uncharted2(graded, params.whitePoint, mapped);
+    break;
+  }
+
+  for (int i = 0; i < 3; i++)
+    out[i] = OutputTransform(params.output, mapped[i]);
+}
+
+void TonemapLUT::Bake(const TonemapLUTParams& bakeParams) {
+  auto start = std::chrono::steady_clock::now();
+  params = bakeParams;
+  params.size = std::max(params.size, 2u);
+
+  const uint32_t size = params.size;
+  texels.assign((size_t)size * size * size * 4, 0.0f);
+
+  // Slices are independent, so the result doesn't depend on threads count
+  ParallelFor(size, [&](size_t b) {
+    for (uint32_t g = 0; g < size; g++) {
+      for (uint32_t r = 0; r < size; r++) {
+        float in[3] = {
+          ShaperDecode(params, r / (float)(size - 1)),
+          ShaperDecode(params, g / (float)(size - 1)),
+          ShaperDecode(params, b / (float)(size - 1)),
+        };
+
+        float* texel = &texels[(((size_t)b * size + g) * size + r) * 4];
+        Evaluate(params, in, texel);
+        texel[3] = 1.0f;
+      }
+    }
+  });
+
+  bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TonemapLUT::Sample(const float in[3], float out[3]) const {
+  const uint32_t size = params.size;
+  uint32_t i0[3], i1[3];
+  float f[3];
+  for (int c = 0; c < 3; c++) {
+    float x = ShaperEncode(params, in[c]) * (size - 1);
+    i0[c] = std::min((uint32_t)x, size - 2);
+    i1[c] = i0[c] + 1;
+    f[c] = x - i0[c];
+  }
+
+  auto texel = [&](uint32_t r, uint32_t g, uint32_t b) {
+    return &texels[(((size_t)b * size + g) * size + r) * 4];
+  };
+
+  for (int c = 0; c < 3; c++) {
+    float c00 = texel(i0[0], i0[1], i0[2])[c] * (1 - f[0]) + texel(i1[0], i0[1], i0[2])[c] * f[0];
+    float c10 = texel(i0[0], i1[1], i0[2])[c] * (1 - f[0]) + texel(i1[0], i1[1], i0[2])[c] * f[0];
+    float c01 = texel(i0[0], i0[1], i1[2])[c] * (1 - f[0]) + texel(i1[0], i0[1], i1[2])[c] * f[0];
+    float c11 = texel(i0[0], i1[1], i1[2])[c] * (1 - f[0]) + texel(i1[0], i1[1], i1[2])[c] * f[0];
+    float c0 = c00 * (1 - f[1]) + c10 * f[1];
+    float c1 = c01 * (1 - f[1]) + c11 * f[1];
+    out[c] = c0 * (1 - f[2]) + c1 * f[2];
+  }
+}
+
+float TonemapLUT::MeasureError(uint32_t samplesPerAxis) const {
+  if (texels.empty() || samplesPerAxis < 2)
+    return 0.0f;
+
+  float maxError = 0.0f;
+  for (uint32_t b = 0; b < samplesPerAxis; b++) {
+    for (uint32_t g = 0; g < samplesPerAxis; g++) {
+      for (uint32_t r = 0; r < samplesPerAxis; r++) {
+        float in[3] = {
+          ShaperDecode(params, r / (float)(samplesPerAxis - 1)),
+          ShaperDecode(params, g / (float)(samplesPerAxis - 1)),
+          ShaperDecode(params, b / (float)(samplesPerAxis - 1)),
+        };
+
+        float exact[3], sampled[3];
+        Evaluate(params, in, exact);
+        Sample(in, sampled);
+        for (int c = 0; c < 3; c++)
+          maxError = std::max(maxError, std::abs(exact[c] - sampled[c]));
+      }
+    }
+  }
+  return maxError;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class TonemapOperator : int
+{
+  acesFitted = 0,       // RRT + ODT fit of ACES (Stephen Hill)
+  agx = 1,              // AgX base look (Troy Sobotka, polynomial fit by Benjamin Wrensch)
+  reinhardExtended = 2, // on luminance, maps whitePoint to 1
+  uncharted2 = 3,       // John Hable's filmic curve, previous HDR.hlsl operator
+};
+
+enum class TonemapOutput : int
+{
+  gamma22 = 0, // pow(x, 1 / 2.2) like before
+  srgb = 1,    // piecewise sRGB transfer function
+};
+
+// Grading applied to exposed scene color before the operator, independent of exposure
+struct ColorGrading {
+  float whiteBalance[3] = { 1.0f, 1.0f, 1.0f }; // channel gains
+  float saturation = 1.0f;
+  float contrast = 1.0f;                        // in log2 space around middle grey
+};
+
+struct TonemapLUTParams {
+  TonemapOperator op = TonemapOperator::uncharted2;
+  TonemapOutput output = TonemapOutput::gamma22;
+  ColorGrading grading;
+  uint32_t size = 32;         // texels per axis (32 or 64)
+  float exposureBias = 8.0f;  // scale of exposed color before the operator
+  float whitePoint = 11.2f;   // reinhardExtended and uncharted2
+
+  // LUT is indexed by log2 of exposed color (shaper)
+  float minLog2 = -12.0f;
+  float maxLog2 = 8.0f;
+
+  static float DefaultExposureBias(TonemapOperator op);
+};
+
+// Tonemapping stage baked into size^3 RGBA texels: shaper -> grading -> operator -> output transform.
+// Texel (r, g, b) holds the result for exposed color with log2 = minLog2 + t * (maxLog2 - minLog2),
+// t = index / (size - 1); layout is [b][g][r] like a D3D 3D texture. Baking is deterministic.
+class TonemapLUT {
+public:
+  void Bake(const TonemapLUTParams& params);
+
+  const TonemapLUTParams& GetParams() const { return params; }
+  const std::vector<float>& GetTexels() const { return texels; } // RGBA
+  double GetBakeMs() const { return bakeMs; }
+
+  // Exact tonemapping of exposed linear color
+  static void Evaluate(const TonemapLUTParams& params, const float in[3], float out[3]);
+
+  // Trilinear lookup like the shader does
+  void Sample(const float in[3], float out[3]) const;
+
+  // Max absolute difference of Sample and Evaluate over samplesPerAxis^3 colors in shaper range
+  float MeasureError(uint32_t samplesPerAxis = 37) const;
+
+  // Shaper of LUT coordinates, [0, 1]
+  static float ShaperEncode(const TonemapLUTParams& params, float value);
+  static float ShaperDecode(const TonemapLUTParams& params, float t);
+
+  // Operators on linear color, result is linear display referred [0, 1]
+  static void ACESFitted(const float in[3], float out[3]);
+  static void AgX(const float in[3], float out[3]);
+  static void ReinhardExtended(const float in[3], float whitePoint, float out[3]);
+  static void Uncharted2(const float in[3], float whitePoint, float out[3]);
+
+private:
+  TonemapLUTParams params;
+  std::vector<float> texels;
+  double bakeMs = 0;
+};
@@ -0,0 +1,229 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+  std::atomic<uint32_t> recorderIds(0);
+
+  int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  template<typename Char>
+  uint64_t HashName(const Char* name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; name++) {
+      hash ^= (uint64_t)(uint32_t)*name;
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  std::string ToName(const char* name) {
+    return name;
+  }
+
+  std::string ToName(const wchar_t* name) {
+    std::string result;
+    for (; *name; name++)
+      result += *name < 128 ? (char)*name : '?';
+    return result;
+  }
+
+  void WriteJSONString(std::ostream& out, const std::string& str) {
+    out << '"';
+    for (char c : str) {
+      if (c == '"' || c == '\\')
+        out << '\\' << c;
+      else if ((unsigned char)c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+        out << escaped;
+      }
+      else
+        out << c;
+    }
+    out << '"';
+  }
+}
+
+TraceRecorder& TraceRecorder::GetInstance() {
+  static TraceRecorder instance;
+  return instance;
+}
+
+TraceRecorder::TraceRecorder() : id(recorderIds++), recording(false), originNs(NowNs()), nextTid(0) {
+}
+
+TraceRecorder::~TraceRecorder() = default;
+
+TraceRecorder::ThreadState& TraceRecorder::GetThreadState() {
+  thread_local std::vector<std::pair<uint32_t, std::unique_ptr<ThreadState>>> states;
+  for (auto& state : states)
+    if (state.first == id)
+      return *state.second;
+
+  states.emplace_back(id, std::unique_ptr<ThreadState>(new ThreadState()));
+  states.back().second->tid = nextTid++;
+  return *states.back().second;
+}
+
+TraceRecorder::Ring& TraceRecorder::GetRing(ThreadState& state) {
+  if (state.ring)
+    return *state.ring;
+
+  std::lock_guard<std::mutex> guard(ringsLock);
+  rings.emplace_back(new Ring());
+  state.ring = rings.back().get();
+  state.ring->size = std::max(capacity, 1u);
+  state.ring->slots.reset(new Slot[state.ring->size]());
+  state.ring->tid = state.tid;
+  state.ring->threadName = "Thread " + std::to_string(state.tid);
+  return *state.ring;
+}
+
+void TraceRecorder::Start() {
+  originNs = NowNs();
+  recording = true;
+}
+
+template<typename Char>
+void TraceRecorder::BeginNamed(const Char* name) {
+  ThreadState& state = GetThreadState();
+  if (!recording) {
+    state.stack.push_back({ ~0u, 0 });
+    return;
+  }
+
+  uint64_t hash = HashName(name);
+  uint32_t nameId;
+  auto cached = state.nameCache.find(hash);
+  if (cached != state.nameCache.end())
+    nameId = cached->second;
+  else {
+    std::lock_guard<std::mutex> guard(namesLock);
+    auto it = nameIds.find(hash);
+    if (it != nameIds.end())
+      nameId = it->second;
+    else {
+      nameId = (uint32_t)names.size();
+      names.push_back(ToName(name));
+      nameIds[hash] = nameId;
+    }
+    state.nameCache[hash] = nameId;
+  }
+
+  state.stack.push_back({ nameId, NowNs() });
+}
+
+void TraceRecorder::BeginScope(const char* name) {
+  BeginNamed(name);
+}
+
+void TraceRecorder::BeginScope(const wchar_t* name) {
+  BeginNamed(name);
+}
+
+void TraceRecorder::EndScope() {
+  ThreadState& state = GetThreadState();
+  if (state.stack.empty())
+    return;
+
+  Scope scope = state.stack.back();
+  state.stack.pop_back();
+  if (scope.name == ~0u || !recording)
+    return;
+
+  // Single writer seqlock: written is the sequence. The fence keeps the slot stores after the previous
+  // publish, so a reader that sees any of them also sees written past the overwritten event
+  Ring& ring = GetRing(state);
+  uint64_t written = ring.written.load(std::memory_order_relaxed);
+  Slot& slot = ring.slots[written % ring.size];
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(scope.name, std::memory_order_relaxed);
+  slot.startNs.store(scope.startNs, std::memory_order_relaxed);
+  slot.endNs.store(NowNs(), std::memory_order_relaxed);
+  ring.written.store(written + 1, std::memory_order_release);
+}
+
+void TraceRecorder::SetThreadName(const char* name) {
+  ThreadState& state = GetThreadState();
+  Ring& ring = GetRing(state);
+  std::lock_guard<std::mutex> guard(ringsLock);
+  ring.threadName = name;
+}
+
+void TraceRecorder::WriteChromeTrace(std::ostream& out) const {
+  std::vector<std::string> namesCopy;
+  {
+    std::lock_guard<std::mutex> guard(namesLock);
+    namesCopy = names;
+  }
+  int64_t origin = originNs;
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  std::lock_guard<std::mutex> guard(ringsLock);
+  for (const auto& ring : rings) {
+    if (!first)
+      out << ",\n";
+    first = false;
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+    WriteJSONString(out, ring->threadName);
+    out << "}}";
+
+    // Seqlock read: copy published events, then drop the ones the writer could overwrite meanwhile.
+    // Events up to after - size are replaced by published ones, event after - size may be in the middle
+    // of a write. The acquire fence pairs with the writer fence, so after covers every slot store seen
+    uint64_t size = ring->size;
+    uint64_t end = ring->written.load(std::memory_order_acquire);
+    uint64_t begin = end > size ? end - size : 0;
+    std::vector<Event> events;
+    for (uint64_t i = begin; i < end; i++) {
+      const Slot& slot = ring->slots[i % size];
+      events.push_back({ slot.name.load(std::memory_order_relaxed), slot.startNs.load(std::memory_order_relaxed),
+        slot.endNs.load(std::memory_order_relaxed) });
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring->written.load(std::memory_order_relaxed);
+    size_t skip = after + 1 > begin + size ? (size_t)(after + 1 - size - begin) : 0;
+
+    for (size_t i = std::min(skip, events.size()); i < events.size(); i++) {
+      const Event& event = events[i];
+      if (event.startNs < origin || event.name >= namesCopy.size())
+        continue;
+
+      out << ",\n{\"name\":";
+      WriteJSONString(out, namesCopy[event.name]);
+      char times[96];
+      snprintf(times, sizeof(times), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", (event.startNs - origin) * 1e-3,
+        (event.endNs - event.startNs) * 1e-3);
+      out << times << ",\"pid\":1,\"tid\":" << ring->tid << "}";
+    }
+  }
+  out << "\n]}\n";
+}
+
+bool TraceRecorder::ExportChromeTrace(const std::string& path) const {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+  WriteChromeTrace(out);
+  return (bool)out;
+}
+
+TraceStats TraceRecorder::GetStats() const {
+  TraceStats stats;
+  std::lock_guard<std::mutex> guard(ringsLock);
+  stats.threads = (uint32_t)rings.size();
+  for (const auto& ring : rings) {
+    uint64_t written = ring->written.load(std::memory_order_acquire);
+    stats.recorded += written;
+    if (written > ring->size)
+      stats.overwritten += written - ring->size;
+  }
+  return stats;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TraceStats {
+  uint32_t threads = 0;
+  uint64_t recorded = 0;
+  uint64_t overwritten = 0; // older events replaced in full rings
+};
+
+// Timeline of scopes for chrome://tracing and Perfetto. Every thread writes completed scopes
+// into its own ring without locks; export copies the rings and streams Chrome trace JSON.
+// Frame scopes of beginEvent, loader and job scopes are recorded in every build, PROFILE_SCOPE ones
+// only with PROFILER_ENABLED. When recording is off scopes only keep the stack.
+class TraceRecorder {
+public:
+  static TraceRecorder& GetInstance();
+
+  TraceRecorder();
+  ~TraceRecorder();
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+  // Ring size of threads that record first time after the call
+  void SetCapacity(uint32_t eventsPerThread) { capacity = eventsPerThread; }
+
+  // Events before Start are left out of export
+  void Start();
+  void Stop() { recording = false; }
+  bool IsRecording() const { return recording; }
+
+  void BeginScope(const char* name);
+  void BeginScope(const wchar_t* name);
+  void EndScope();
+
+  // Name of the calling thread in the trace
+  void SetThreadName(const char* name);
+
+  // Snapshot of all rings, events of a thread are ordered by end time. Threads may keep recording:
+  // events the writers could overwrite during the copy are left out
+  void WriteChromeTrace(std::ostream& out) const;
+  bool ExportChromeTrace(const std::string& path) const;
+
+  TraceStats GetStats() const;
+
+private:
+  struct Event {
+    uint32_t name;
+    int64_t startNs, endNs;
+  };
+
+  // Ring slot, export may read it while the writer fills it, so fields are relaxed atomics
+  struct Slot {
+    std::atomic<uint32_t> name;
+    std::atomic<int64_t> startNs, endNs;
+  };
+
+  struct Ring {
+    std::unique_ptr<Slot[]> slots;
+    uint64_t size = 0;
+    std::atomic<uint64_t> written;
+    uint32_t tid = 0;
+    std::string threadName;
+
+    Ring() : written(0) {}
+  };
+
+  struct Scope {
+    uint32_t name;
+    int64_t startNs;
+  };
+
+  // Thread-only part: scope stack, name cache and ring of this recorder
+  struct ThreadState {
+    std::vector<Scope> stack;
+    std::unordered_map<uint64_t, uint32_t> nameCache;
+    Ring* ring = nullptr;
+    uint32_t tid = 0;
+  };
+
+  ThreadState& GetThreadState();
+  Ring& GetRing(ThreadState& state);
+  template<typename Char>
+  void BeginNamed(const Char* name);
+
+  const uint32_t id;
+  std::atomic<bool> recording;
+  uint32_t capacity = 1 << 16;
+  std::atomic<int64_t> originNs;
+
+  mutable std::mutex namesLock;
+  std::vector<std::string> names;
+  std::unordered_map<uint64_t, uint32_t> nameIds;
+
+  mutable std::mutex ringsLock;
+  std::vector<std::unique_ptr<Ring>> rings;
+  std::atomic<uint32_t> nextTid;
+};
+
+// Scope guard for loader stages and jobs
+class TraceScope {
+public:
+  explicit TraceScope(const char* name) { TraceRecorder::GetInstance().BeginScope(name); }
+  ~TraceScope() { TraceRecorder::GetInstance().EndScope(); }
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,102 @@
+#include "TransientResourcePool.h"
+
+#include <algorithm>
+
+void TransientResourcePool::BeginFrame() {
+  frame++;
+  stats.frameRequestedBytes = 0;
+
+  for (uint32_t handle = 0; handle < (uint32_t)entries.size(); handle++) {
+    const Entry& entry = entries[handle];
+    if (entry.alive && !entry.inUse && frame - entry.lastFrame > keepFrames) {
+      Destroy(handle);
+      stats.evictions++;
+    }
+  }
+}
+
+uint32_t TransientResourcePool::Acquire(const TransientResourceDesc& desc) {
+  // Prefer resource already used this frame, so fewer resources stay alive
+  uint32_t found = invalidHandle;
+  for (uint32_t handle = 0; handle < (uint32_t)entries.size(); handle++) {
+    const Entry& entry = entries[handle];
+    if (!entry.alive || entry.inUse || !(entry.desc == desc))
+      continue;
+
+    if (found == invalidHandle || entry.lastFrame > entries[found].lastFrame)
+      found = handle;
+  }
+
+  if (found != invalidHandle) {
+    Entry& entry = entries[found];
+    stats.hits++;
+    if (entry.lastFrame == frame)
+      stats.aliases++;
+    entry.inUse = true;
+    entry.lastFrame = frame;
+    stats.inUse++;
+    stats.frameRequestedBytes += entry.bytes;
+    return found;
+  }
+
+  uint32_t handle;
+  if (!deadHandles.empty()) {
+    handle = deadHandles.back();
+    deadHandles.pop_back();
+  }
+  else {
+    handle = (uint32_t)entries.size();
+    entries.push_back(Entry());
+  }
+
+  uint64_t bytes = 0;
+  if (!factory.Create(handle, desc, bytes)) {
+    deadHandles.push_back(handle);
+    return invalidHandle;
+  }
+
+  Entry& entry = entries[handle];
+  entry.desc = desc;
+  entry.bytes = bytes;
+  entry.lastFrame = frame;
+  entry.alive = true;
+  entry.inUse = true;
+
+  stats.misses++;
+  stats.resources++;
+  stats.inUse++;
+  stats.bytes += bytes;
+  stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+  stats.frameRequestedBytes += bytes;
+  return handle;
+}
+
+void TransientResourcePool::Release(uint32_t handle) {
+  if (handle >= entries.size() || !entries[handle].inUse)
+    return;
+
+  entries[handle].inUse = false;
+  stats.inUse--;
+}
+
+void TransientResourcePool::Clear() {
+  for (uint32_t handle = 0; handle < (uint32_t)entries.size(); handle++)
+    if (entries[handle].alive)
+      Destroy(handle);
+  entries.clear();
+  deadHandles.clear();
+  stats.inUse = 0;
+}
+
+void TransientResourcePool::Destroy(uint32_t handle) {
+  Entry& entry = entries[handle];
+  factory.Destroy(handle);
+
+  stats.resources--;
+  stats.bytes -= entry.bytes;
+  if (entry.inUse)
+    stats.inUse--;
+
+  entry = Entry();
+  deadHandles.push_back(handle);
+}
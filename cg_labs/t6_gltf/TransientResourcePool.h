@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Key of pooled resource
+struct TransientResourceDesc {
+  uint32_t width = 0, height = 0;
+  uint32_t format = 0;    // DXGI_FORMAT for D3D resources
+  uint32_t bindFlags = 0;
+
+  bool operator==(const TransientResourceDesc& other) const {
+    return width == other.width && height == other.height && format == other.format && bindFlags == other.bindFlags;
+  }
+};
+
+// Creates and destroys resources of the pool by handle. RenderTargetPool implements it
+// with D3D11 textures, a fake which only counts calls may be plugged instead.
+class TransientResourceFactory {
+public:
+  virtual ~TransientResourceFactory() = default;
+
+  // Create resource for handle, bytes - its memory size
+  virtual bool Create(uint32_t handle, const TransientResourceDesc& desc, uint64_t& bytes) = 0;
+  virtual void Destroy(uint32_t handle) = 0;
+};
+
+struct TransientPoolStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;       // resource had to be created
+  uint64_t aliases = 0;      // hits on resource already used by an earlier pass of the same frame
+  uint64_t evictions = 0;
+  uint32_t resources = 0;
+  uint32_t inUse = 0;
+  uint64_t bytes = 0;        // memory of pooled resources
+  uint64_t peakBytes = 0;
+  uint64_t frameRequestedBytes = 0; // memory the frame would take with a resource per pass
+};
+
+// Pool of transient resources keyed by TransientResourceDesc. Pass acquires resource right
+// before use and releases it as soon as the last reader has been recorded, so passes whose
+// lifetimes don't overlap share one resource within a frame, and resources are kept across
+// frames and resizes. Free resources not used for keepFrames frames are destroyed.
+class TransientResourcePool {
+public:
+  static const uint32_t invalidHandle = ~0u;
+
+  explicit TransientResourcePool(TransientResourceFactory& factory, uint32_t keepFrames = 3)
+    : factory(factory), keepFrames(keepFrames) {}
+
+  void BeginFrame();
+
+  // Returns invalidHandle if the resource could not be created
+  uint32_t Acquire(const TransientResourceDesc& desc);
+  void Release(uint32_t handle);
+
+  // Destroy all resources (all of them must be released)
+  void Clear();
+
+  const TransientResourceDesc& GetDesc(uint32_t handle) const { return entries[handle].desc; }
+  const TransientPoolStats& GetStats() const { return stats; }
+  uint64_t GetFrame() const { return frame; }
+
+private:
+  void Destroy(uint32_t handle);
+
+  struct Entry {
+    TransientResourceDesc desc;
+    uint64_t bytes = 0;
+    uint64_t lastFrame = 0;
+    bool alive = false;
+    bool inUse = false;
+  };
+
+  TransientResourceFactory& factory;
+  uint32_t keepFrames;
+  uint64_t frame = 0;
+  std::vector<Entry> entries;
+  std::vector<uint32_t> deadHandles;
+  TransientPoolStats stats;
+};
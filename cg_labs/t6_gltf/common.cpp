@@ -1,13 +1,23 @@
 #include "common.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
 
 void beginEvent(const wchar_t* str) {
 #ifdef _DEBUG
   DebugEvents::GetInstance().beginEvent(str);
 #endif
+#ifdef PROFILER_ENABLED
+  Profiler::GetInstance().BeginScope(str, true);
+#endif
+  TraceRecorder::GetInstance().BeginScope(str);
 }
 
 void endEvent() {
 #ifdef _DEBUG
   DebugEvents::GetInstance().endEvent();
 #endif
+#ifdef PROFILER_ENABLED
+  Profiler::GetInstance().EndScope();
+#endif
+  TraceRecorder::GetInstance().EndScope();
 }
\ No newline at end of file
@@ -1,12 +1,10 @@
-// Define these only in *one* .cc file.
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-// #define TINYGLTF_NOEXCEPTION // optional. disable exception handling.
-
-
 #include "gltf_model.h"
+#include "ShaderLibrary.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
 
 HRESULT Model::LoadGLTFModelMetadata() {
+  TRACE_SCOPE("glTF parse and image decode");
   tinygltf::TinyGLTF loader;
   std::string err;
   std::string warn;
@@ -20,16 +18,13 @@ HRESULT Model::LoadGLTFModelMetadata() {
   return S_OK;
 }
 
-HRESULT Model::InitTexturesFromlMetadata(ID3D11Device* device) {
-  g_pTextures = std::vector<ID3D11Texture2D*>(model.textures.size(), nullptr);
-  g_pTexturesSRV = std::vector<ID3D11ShaderResourceView*>(model.textures.size(), nullptr);
+HRESULT Model::InitTexturesFromlMetadata() {
+  TRACE_SCOPE("glTF texture upload");
+  textures = std::vector<GfxHandle>(model.images.size(), gfxNullHandle);
 
   HRESULT hr = S_OK;
   for (int i = 0; i < model.images.size(); i++) {
-    hr = InitTexture(device, i);
-    if (FAILED(hr))
-      break;
-    hr = device->CreateShaderResourceView(g_pTextures[i], nullptr, &(g_pTexturesSRV[i]));
+    hr = InitTexture(i);
     if (FAILED(hr))
       break;
   }
@@ -37,46 +32,36 @@ HRESULT Model::InitTexturesFromlMetadata(ID3D11Device* device) {
   return S_OK;
 }
 
-HRESULT Model::InitTexture(ID3D11Device* device, size_t imgId) {
-  DXGI_FORMAT format;
-  size_t bites;
+HRESULT Model::InitTexture(size_t imgId) {
+  GfxFormat format;
   if ((model.images[imgId].pixel_type == TINYGLTF_COMPONENT_TYPE_FLOAT) && (model.images[imgId].component = 4))
-    format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    format = GfxFormat::rgba32Float;
   else if ((model.images[imgId].pixel_type == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) && (model.images[imgId].component = 4))
-    format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    format = GfxFormat::rgba8Unorm;
   else
     return E_FAIL;
 
-  D3D11_TEXTURE2D_DESC txtDesc;
-  txtDesc.Width = model.images[imgId].width;
-  txtDesc.Height = model.images[imgId].height;
-
-  txtDesc.Format = format;
-  txtDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-  txtDesc.Usage = D3D11_USAGE_DEFAULT;
-  txtDesc.CPUAccessFlags = 0;
-  txtDesc.MiscFlags = 0;
-  txtDesc.MipLevels = 1;
-  txtDesc.ArraySize = 1;
-  txtDesc.SampleDesc.Count = 1;
-  txtDesc.SampleDesc.Quality = 0;
-
-  D3D11_SUBRESOURCE_DATA hdrtdata = {};
-  hdrtdata.pSysMem = (void *)(&(model.images[imgId].image[0]));
-  hdrtdata.SysMemPitch = model.images[imgId].component * model.images[imgId].width * (int)(model.images[imgId].bits / 8);
-  hdrtdata.SysMemSlicePitch = 0;
+  GfxTextureDesc txtDesc;
+  txtDesc.width = model.images[imgId].width;
+  txtDesc.height = model.images[imgId].height;
+  txtDesc.format = format;
+  txtDesc.bind = gfxBindShaderResource;
+
+  GfxSubresourceData hdrtdata;
+  hdrtdata.data = &(model.images[imgId].image[0]);
+  hdrtdata.rowPitch = model.images[imgId].component * model.images[imgId].width * (int)(model.images[imgId].bits / 8);
 
   // create texture
-  HRESULT hr = device->CreateTexture2D(&txtDesc, &hdrtdata, &(g_pTextures[imgId]));
-  return hr;
+  textures[imgId] = gfx->CreateTexture(txtDesc, &hdrtdata);
+  return textures[imgId] != gfxNullHandle ? S_OK : E_FAIL;
 }
 
-HRESULT Model::InitSamplersFromlMetadata(ID3D11Device* device) {
-  g_pSamplers = std::vector<ID3D11SamplerState*>(model.samplers.size(), nullptr);
+HRESULT Model::InitSamplersFromlMetadata() {
+  samplers = std::vector<GfxHandle>(model.samplers.size(), gfxNullHandle);
   
   HRESULT hr = S_OK;
   for (int i = 0; i < model.samplers.size(); i++) {
-    hr = InitSampler(device, i);
+    hr = InitSampler(i);
     if (FAILED(hr))
       break;
   }
@@ -85,45 +70,38 @@ HRESULT Model::InitSamplersFromlMetadata(ID3D11Device* device) {
 }
 
 
-HRESULT Model::InitSampler(ID3D11Device* device, size_t smplrId) {
-  D3D11_TEXTURE_ADDRESS_MODE addressModeS, addressModeT;
+HRESULT Model::InitSampler(size_t smplrId) {
+  GfxAddress addressModeS, addressModeT;
   if (model.samplers[smplrId].wrapS == TINYGLTF_TEXTURE_WRAP_REPEAT)
-    addressModeS = D3D11_TEXTURE_ADDRESS_WRAP;
+    addressModeS = GfxAddress::wrap;
   else if (model.samplers[smplrId].wrapS == TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE)
-    addressModeS = D3D11_TEXTURE_ADDRESS_CLAMP;
+    addressModeS = GfxAddress::clamp;
   else if (model.samplers[smplrId].wrapS == TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT)
-    addressModeS = D3D11_TEXTURE_ADDRESS_MIRROR;
+    addressModeS = GfxAddress::mirror;
   else
     return E_FAIL;
 
   if (model.samplers[smplrId].wrapT == TINYGLTF_TEXTURE_WRAP_REPEAT)
-    addressModeT = D3D11_TEXTURE_ADDRESS_WRAP;
+    addressModeT = GfxAddress::wrap;
   else if (model.samplers[smplrId].wrapT == TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE)
-    addressModeT = D3D11_TEXTURE_ADDRESS_CLAMP;
+    addressModeT = GfxAddress::clamp;
   else if (model.samplers[smplrId].wrapT == TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT)
-    addressModeT = D3D11_TEXTURE_ADDRESS_MIRROR;
+    addressModeT = GfxAddress::mirror;
   else
     return E_FAIL;
   
-  D3D11_FILTER filter;
-  if (model.samplers[smplrId].minFilter == TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR)
-    filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-  else
+  if (model.samplers[smplrId].minFilter != TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR)
     return E_FAIL;
 
   // Init samplers
-  D3D11_SAMPLER_DESC descSmplr = {};
-
-  descSmplr.Filter = filter;
-  descSmplr.AddressU = addressModeS;
-  descSmplr.AddressV = addressModeT;
-  descSmplr.AddressW = addressModeT;
-  descSmplr.MinLOD = 0;
-  descSmplr.MaxLOD = D3D11_FLOAT32_MAX;
-  descSmplr.MipLODBias = 0.0f;
-
-  HRESULT hr = device->CreateSamplerState(&descSmplr, &(g_pSamplers[smplrId]));
-  return hr;
+  GfxSamplerDesc descSmplr;
+  descSmplr.filter = GfxFilter::linear;
+  descSmplr.addressU = addressModeS;
+  descSmplr.addressV = addressModeT;
+  descSmplr.addressW = addressModeT;
+
+  samplers[smplrId] = gfx->CreateSampler(descSmplr);
+  return samplers[smplrId] != gfxNullHandle ? S_OK : E_FAIL;
 }
 
 void Model::InitMaterialsFromMetadata() {
@@ -138,18 +116,23 @@ void Model::InitMaterialsFromMetadata() {
                          model.materials[i].normalTexture.index};
 
   meshMaterislIdx = std::vector<int>(model.meshes.size(), -1);
-  for (int i = 0; i < model.meshes.size(); i++)
+  meshEventNames = std::vector<std::string>(model.meshes.size());
+  for (int i = 0; i < model.meshes.size(); i++) {
     meshMaterislIdx[i] = model.meshes[i].primitives[0].material;
+    meshEventNames[i] = "Drawing mesh #" + std::to_string(i + 1);
+  }
 }
 
-HRESULT Model::InitBuffersFromFile(ID3D11Device* device, FILE* binFile) {
-  g_pVertexBuffers = std::vector<ID3D11Buffer*>(model.meshes.size(), nullptr);
-  g_pIndexBuffers = std::vector<ID3D11Buffer*>(model.meshes.size(), nullptr);
+HRESULT Model::InitBuffersFromFile(FILE* binFile) {
+  TRACE_SCOPE("glTF mesh buffers");
+  vertexBuffers = std::vector<GfxHandle>(model.meshes.size(), gfxNullHandle);
+  indexBuffers = std::vector<GfxHandle>(model.meshes.size(), gfxNullHandle);
+  indexFormats = std::vector<GfxFormat>(model.meshes.size(), GfxFormat::r32Uint);
   indeciesLenghts = std::vector<size_t>(model.meshes.size(), 0);
 
   HRESULT hr = S_OK;
   for (int i = 0; i < model.meshes.size(); i++) {
-    hr = LoadMesh(device, binFile, i);
+    hr = LoadMesh(binFile, i);
     if (FAILED(hr))
       break;
   }
@@ -158,7 +141,7 @@ HRESULT Model::InitBuffersFromFile(ID3D11Device* device, FILE* binFile) {
 }
 
 
-HRESULT Model::LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId) {
+HRESULT Model::LoadMesh(FILE* binFile, size_t meshId) {
   // Load vertecies data
   int posAccInd     = model.meshes[meshId].primitives[0].attributes.at("POSITION");
   int normAccInd    = model.meshes[meshId].primitives[0].attributes.at("NORMAL");
@@ -193,7 +176,7 @@ HRESULT Model::LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId) {
     return hr;
 
   // Init vertex buffer
-  hr = InitVerticiesBuffer(device, verticies, meshId);
+  hr = InitVerticiesBuffer(verticies, meshId);
   if (FAILED(hr))
     return hr;
 
@@ -204,7 +187,7 @@ HRESULT Model::LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId) {
     hr = GetDataFromFile(model.accessors[indAccInd], binFile, indicies);
     if (FAILED(hr))
       return hr;
-    hr = InitIndeciesBuffer(device, indicies, meshId);
+    hr = InitIndeciesBuffer(indicies, meshId);
     if (FAILED(hr))
       return hr;
     indeciesLenghts[meshId] = indicies.size();
@@ -214,7 +197,7 @@ HRESULT Model::LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId) {
     hr = GetDataFromFile(model.accessors[indAccInd], binFile, indicies);
     if (FAILED(hr))
       return hr;
-    hr = InitIndeciesBuffer(device, indicies, meshId);
+    hr = InitIndeciesBuffer(indicies, meshId);
     if (FAILED(hr))
       return hr;
     indeciesLenghts[meshId] = indicies.size();
@@ -224,7 +207,7 @@ HRESULT Model::LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId) {
     hr = GetDataFromFile(model.accessors[indAccInd], binFile, indicies);
     if (FAILED(hr))
       return hr;
-    hr = InitIndeciesBuffer(device, indicies, meshId);
+    hr = InitIndeciesBuffer(indicies, meshId);
     if (FAILED(hr))
       return hr;
     indeciesLenghts[meshId] = indicies.size();
@@ -331,55 +314,42 @@ HRESULT Model::GenerateVerticiesArray(std::vector<XMFLOAT3>& posVec, std::vector
 
 
 template<typename IndexType>
-HRESULT Model::InitIndeciesBuffer(ID3D11Device* device, std::vector<IndexType>& indicies, size_t bufferIndex) {
-  D3D11_BUFFER_DESC descInd = {};
-  ZeroMemory(&descInd, sizeof(descInd));
-
-  descInd.ByteWidth = sizeof(IndexType) * indicies.size();
-  descInd.Usage = D3D11_USAGE_IMMUTABLE;
-  descInd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-  descInd.CPUAccessFlags = 0;
-  descInd.MiscFlags = 0;
-  descInd.StructureByteStride = 0;
-
-  D3D11_SUBRESOURCE_DATA dataInd;
-  dataInd.pSysMem = &indicies[0];
-
-  HRESULT hr = device->CreateBuffer(&descInd, &dataInd, &(g_pIndexBuffers[bufferIndex]));
-  return hr;
+HRESULT Model::InitIndeciesBuffer(std::vector<IndexType>& indicies, size_t bufferIndex) {
+  GfxBufferDesc descInd;
+  descInd.size = (uint32_t)(sizeof(IndexType) * indicies.size());
+  descInd.usage = GfxUsage::immutable;
+  descInd.bind = gfxBindIndexBuffer;
+
+  indexFormats[bufferIndex] = sizeof(IndexType) == 2 ? GfxFormat::r16Uint : GfxFormat::r32Uint;
+  indexBuffers[bufferIndex] = gfx->CreateBuffer(descInd, &indicies[0]);
+  return indexBuffers[bufferIndex] != gfxNullHandle ? S_OK : E_FAIL;
 }
 
-HRESULT Model::InitVerticiesBuffer(ID3D11Device* device, std::vector<Vertex>& verticies, size_t bufferIndex) {
-  D3D11_BUFFER_DESC desc = {};
-  desc.ByteWidth = sizeof(Vertex) * verticies.size();
-  desc.Usage = D3D11_USAGE_IMMUTABLE;
-  desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-  desc.CPUAccessFlags = 0;
-  desc.MiscFlags = 0;
-  desc.StructureByteStride = 0;
-
-  D3D11_SUBRESOURCE_DATA data;
-  ZeroMemory(&data, sizeof(data));
-  data.pSysMem = &verticies[0];
-  HRESULT hr = device->CreateBuffer(&desc, &data, &(g_pVertexBuffers[bufferIndex]));
-  return hr;
+HRESULT Model::InitVerticiesBuffer(std::vector<Vertex>& verticies, size_t bufferIndex) {
+  GfxBufferDesc desc;
+  desc.size = (uint32_t)(sizeof(Vertex) * verticies.size());
+  desc.usage = GfxUsage::immutable;
+  desc.bind = gfxBindVertexBuffer;
+
+  vertexBuffers[bufferIndex] = gfx->CreateBuffer(desc, &verticies[0]);
+  return vertexBuffers[bufferIndex] != gfxNullHandle ? S_OK : E_FAIL;
 }
 
 
-HRESULT Model::InitShadersPipeline(ID3D11Device* device) {
+HRESULT Model::InitShadersPipeline() {
+  TRACE_SCOPE("glTF model shaders");
   // Create index array
-  static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
-      {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-      {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-      {"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-      {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0},
+  static const GfxInputElement InputDesc[] = {
+      {"POSITION", 0, GfxFormat::rgb32Float, 0},
+      {"NORMAL", 0, GfxFormat::rgb32Float, 12},
+      {"TANGENT", 0, GfxFormat::rgb32Float, 24},
+      {"TEXCOORD", 0, GfxFormat::rg32Float, 36},
   };
 
   // Compile shaders
   ID3D10Blob* vertexShaderBuffer = nullptr;
-  ID3D10Blob* pixelShaderBuffer = nullptr;
 
-  HRESULT hr = CompileShaderFromFile(L"pbrLightable_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
+  HRESULT hr = ShaderLibrary::GetInstance().Compile(L"pbrLightable_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer);
   if (FAILED(hr))
   {
     MessageBox(nullptr,
@@ -387,43 +357,70 @@ HRESULT Model::InitShadersPipeline(ID3D11Device* device) {
     return hr;
   }
 
-  // Create the vertex shader
-  hr = device->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), nullptr, &g_pVertexShader);
-  if (FAILED(hr))
-  {
-    vertexShaderBuffer->Release();
-    return hr;
-  }
+  // Create the vertex shader and its layout
+  vertexShader = gfx->CreateShader(GfxShaderStage::vertex, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize());
+  int numElements = sizeof(InputDesc) / sizeof(InputDesc[0]);
+  vertexLayout = gfx->CreateInputLayout(InputDesc, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize());
+  vertexShaderBuffer->Release();
+  if (vertexShader == gfxNullHandle || vertexLayout == gfxNullHandle)
+    return E_FAIL;
 
-  // Compile the pixel shader
-  hr = CompileShaderFromFile(L"pbrLightable_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer);
-  if (FAILED(hr))
+  // Production variant, others are compiled on first draw
+  PBRShaderFeatures features;
+  if (pixelShaders.Get(features.Key(), [this](uint32_t key) { return CreatePixelShaderVariant(key); }) == gfxNullHandle)
   {
     MessageBox(nullptr,
       L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
-    return hr;
+    return E_FAIL;
   }
 
-  // Create the pixel shader
-  hr = device->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), nullptr, &g_pPixelShader);
-  pixelShaderBuffer->Release();
-  if (FAILED(hr))
-    return hr;
+  return S_OK;
+}
 
-  int numElements = sizeof(InputDesc) / sizeof(InputDesc[0]);
-  hr = device->CreateInputLayout(InputDesc, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), &g_pVertexLayout);
+GfxHandle Model::CreatePixelShaderVariant(uint32_t key) {
+  std::vector<ShaderDefine> defines = PBRShaderFeatures::FromKey(key).GetDefines();
+  std::vector<D3D_SHADER_MACRO> macros;
+  for (const ShaderDefine& define : defines)
+    macros.push_back({ define.name.c_str(), define.value.c_str() });
+  macros.push_back({ nullptr, nullptr });
+
+  // Bytecode comes from ShaderLibrary cache if the variant was used before
+  ID3D10Blob* pixelShaderBuffer = nullptr;
+  HRESULT hr = ShaderLibrary::GetInstance().Compile(L"pbrLightable_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer, macros.data());
   if (FAILED(hr))
-    return hr;
+    return gfxNullHandle;
 
-  vertexShaderBuffer->Release();
+  GfxHandle shader = gfx->CreateShader(GfxShaderStage::pixel, pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize());
+  pixelShaderBuffer->Release();
+  return shader;
 }
 
-HRESULT Model::InitConstantBuffersFromlMetadata(ID3D11Device* device) {
+uint32_t Model::GetPixelShaderKey(size_t meshId) const {
+  PBRShaderFeatures features;
+  features.viewMode = frameViewMode.modelViewMode;
+  features.plainNormal = frameViewMode.isPlainNormal;
+  features.plainMetalRough = frameViewMode.isPlainMetalRough;
+  features.plainColor = frameViewMode.isPlainColor;
+  features.octahedralIBL = maps.octahedral;
+  features.lightCount = frameLightCount;
+
+  // Meshes without texture use material constants
+  GLTFMaterial material;
+  if (meshMaterislIdx[meshId] != -1)
+    material = gltfMaterials[meshMaterislIdx[meshId]];
+  features.plainNormal |= material.normalTexId == -1;
+  features.plainMetalRough |= material.metalnessTexId == -1;
+  features.plainColor |= material.diffTexId == -1;
+
+  return features.Key();
+}
+
+HRESULT Model::InitConstantBuffersFromlMetadata() {
   // Init all ConstantBuffers as XMMatrixIdentity(); matricies
   meshesWM = std::vector<WorldMatrixBuffer>(model.meshes.size(), { XMMatrixIdentity(), 
                                                                    XMFLOAT4(PBRParams.roughness, PBRParams.metalness, PBRParams.dielectricF0, 0.0f),
                                                                    XMFLOAT4(PBRParams.albedo.x, PBRParams.albedo.y, PBRParams.albedo.z, 0.0f) });
-  g_pWMBuffers = std::vector<ID3D11Buffer*>(model.meshes.size(), nullptr);
+  wmBuffers = std::vector<GfxHandle>(model.meshes.size(), gfxNullHandle);
 
   // Go throw all nodes and save transformation
   for (auto& nodeId : model.scenes[model.defaultScene].nodes) {
@@ -432,38 +429,67 @@ HRESULT Model::InitConstantBuffersFromlMetadata(ID3D11Device* device) {
   }
 
   // Set constant buffers
-  HRESULT hr = S_OK;
+  GfxBufferDesc descWM;
+  descWM.size = sizeof(WorldMatrixBuffer);
+  descWM.bind = gfxBindConstantBuffer;
   for (int i = 0; i < model.meshes.size(); i++) {
-    D3D11_BUFFER_DESC descWM = {};
-    descWM.ByteWidth = sizeof(WorldMatrixBuffer);
-    descWM.Usage = D3D11_USAGE_DEFAULT;
-    descWM.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    descWM.CPUAccessFlags = 0;
-    descWM.MiscFlags = 0;
-    descWM.StructureByteStride = 0;
-
-    D3D11_SUBRESOURCE_DATA data;
-    data.pSysMem = &(meshesWM[i]);
-    data.SysMemPitch = sizeof(meshesWM[i]);
-    data.SysMemSlicePitch = 0;
-
-    hr = device->CreateBuffer(&descWM, &data, &(g_pWMBuffers[i]));
-    if (FAILED(hr))
-      return hr;
+    wmBuffers[i] = gfx->CreateBuffer(descWM, &(meshesWM[i]));
+    if (wmBuffers[i] == gfxNullHandle)
+      return E_FAIL;
   }
 
-  D3D11_BUFFER_DESC descSM = {};
-  descSM.ByteWidth = sizeof(SceneMatrixBuffer);
-  descSM.Usage = D3D11_USAGE_DYNAMIC;
-  descSM.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-  descSM.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-  descSM.MiscFlags = 0;
-  descSM.StructureByteStride = 0;
+  GfxBufferDesc descSM;
+  descSM.size = sizeof(SceneMatrixBuffer);
+  descSM.bind = gfxBindConstantBuffer;
+  descSM.usage = GfxUsage::dynamic;
+
+  smBuffer = gfx->CreateBuffer(descSM);
+  if (smBuffer == gfxNullHandle)
+    return E_FAIL;
+
+  return S_OK;
+}
+
+HRESULT Model::InitClusterBuffers() {
+  GfxBufferDesc desc;
+  desc.size = clusteredLighting.GetGrid().GetClusterCount() * sizeof(ClusterRange);
+  desc.bind = gfxBindShaderResource;
+  desc.usage = GfxUsage::dynamic;
+  desc.stride = sizeof(ClusterRange);
+  clusterRangesBuffer = gfx->CreateBuffer(desc);
+  if (clusterRangesBuffer == gfxNullHandle)
+    return E_FAIL;
 
-  hr = device->CreateBuffer(&descSM, nullptr, &g_pSMBuffer);
+  // Small lists to start with, Update grows them
+  std::vector<ClusterLight> noLights(64);
+  std::vector<uint32_t> noIndices(1024);
+  HRESULT hr = UpdateStructuredBuffer(gfx->GetContext(), lightsBuffer, lightsCapacity, noLights.data(), (uint32_t)noLights.size(), sizeof(ClusterLight));
   if (FAILED(hr))
     return hr;
+  return UpdateStructuredBuffer(gfx->GetContext(), clusterIndicesBuffer, clusterIndicesCapacity, noIndices.data(), (uint32_t)noIndices.size(), sizeof(uint32_t));
+}
+
+HRESULT Model::UpdateStructuredBuffer(IGfxContext& context, GfxHandle& buffer, uint32_t& capacity, const void* data, uint32_t count, uint32_t stride) {
+  if (count == 0)
+    return S_OK;
+
+  if (count > capacity) {
+    gfx->Release(buffer);
+    capacity = max(count, capacity * 2);
+
+    GfxBufferDesc desc;
+    desc.size = capacity * stride;
+    desc.bind = gfxBindShaderResource;
+    desc.usage = GfxUsage::dynamic;
+    desc.stride = stride;
+    buffer = gfx->CreateBuffer(desc);
+    if (buffer == gfxNullHandle) {
+      capacity = 0;
+      return E_FAIL;
+    }
+  }
 
+  context.UpdateBuffer(buffer, data, count * stride);
   return S_OK;
 }
 
@@ -494,74 +520,52 @@ void Model::CountMatrixTransformation(int nodeId, const XMMATRIX& parentTransfor
     CountMatrixTransformation(childID, currentTransformation);
 }
 
-HRESULT Model::InitDX11Vars(ID3D11Device* device) {
+HRESULT Model::InitDX11Vars() {
   // Init samplers
-  D3D11_SAMPLER_DESC envSmplr = {};
-
-  envSmplr.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-  envSmplr.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
-  envSmplr.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
-  envSmplr.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
-  envSmplr.MinLOD = 0;
-  envSmplr.MaxLOD = D3D11_FLOAT32_MAX;
-  envSmplr.MipLODBias = 0.0f;
-
-  HRESULT hr = device->CreateSamplerState(&envSmplr, &g_pEnvSamplerState);
-  if (FAILED(hr))
-    return hr;
-
-  D3D11_SAMPLER_DESC descBRDFSmplr = {};
-
-  descBRDFSmplr.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-  descBRDFSmplr.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
-  descBRDFSmplr.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
-  descBRDFSmplr.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-  descBRDFSmplr.MinLOD = 0;
-  descBRDFSmplr.MaxLOD = D3D11_FLOAT32_MAX;
-  descBRDFSmplr.MipLODBias = 0.0f;
+  GfxSamplerDesc envSmplr;
+  envSmplr.addressU = envSmplr.addressV = envSmplr.addressW = GfxAddress::wrap;
+  envSamplerState = gfx->CreateSampler(envSmplr);
+  if (envSamplerState == gfxNullHandle)
+    return E_FAIL;
 
-  hr = device->CreateSamplerState(&descBRDFSmplr, &g_pBRDFSamplerState);
-  if (FAILED(hr))
-    return hr;
+  GfxSamplerDesc descBRDFSmplr;
+  descBRDFSmplr.addressU = descBRDFSmplr.addressV = descBRDFSmplr.addressW = GfxAddress::clamp;
+  brdfSamplerState = gfx->CreateSampler(descBRDFSmplr);
+  if (brdfSamplerState == gfxNullHandle)
+    return E_FAIL;
 
   // Set rastrizer state
-  D3D11_RASTERIZER_DESC descRast = {};
-  descRast.AntialiasedLineEnable = false;
-  descRast.FillMode = D3D11_FILL_SOLID;
-  descRast.CullMode = D3D11_CULL_NONE;
-  descRast.DepthBias = 0;
-  descRast.DepthBiasClamp = 0.0f;
-  descRast.FrontCounterClockwise = false;
-  descRast.DepthClipEnable = true;
-  descRast.ScissorEnable = false;
-  descRast.MultisampleEnable = false;
-  descRast.SlopeScaledDepthBias = 0.0f;
-
-  hr = device->CreateRasterizerState(&descRast, &g_pRasterizerState);
-  if (FAILED(hr))
-    return hr;
+  GfxRasterizerDesc descRast;
+  descRast.cull = GfxCull::none;
+  descRast.frontCounterClockwise = false;
+  descRast.depthClip = true;
+
+  rasterizerState = gfx->CreateRasterizerState(descRast);
+  return rasterizerState != gfxNullHandle ? S_OK : E_FAIL;
 }
 
-HRESULT Model::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
+HRESULT Model::Init(IGfxDevice& device, int screenWidth, int screenHeight) {
+  gfx = &device;
+
   // Load metadata about whole scene(s)
   HRESULT hr = LoadGLTFModelMetadata();
   if (FAILED(hr))
     return hr;
 
   // Init textures from file
-  hr = InitTexturesFromlMetadata(device);
+  hr = InitTexturesFromlMetadata();
   if (FAILED(hr))
     return hr;
 
   // Init samplers from file
-  hr = InitSamplersFromlMetadata(device);
+  hr = InitSamplersFromlMetadata();
   if (FAILED(hr))
     return hr;
 
   InitMaterialsFromMetadata();
 
   // Init buffers with transforms for meshs
-  hr = InitConstantBuffersFromlMetadata(device);
+  hr = InitConstantBuffersFromlMetadata();
   if (FAILED(hr))
     return hr;
 
@@ -571,17 +575,21 @@ HRESULT Model::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scre
     return E_FAIL;
 
   // Init buffers from file
-  hr = InitBuffersFromFile(device, binData);
+  hr = InitBuffersFromFile(binData);
   fclose(binData);
   if (FAILED(hr))
     return hr;
 
   // Init shaders' pipeline
-  hr = InitShadersPipeline(device);
+  hr = InitShadersPipeline();
+  if (FAILED(hr))
+    return hr;
+
+  hr = InitDX11Vars();
   if (FAILED(hr))
     return hr;
 
-  hr = InitDX11Vars(device);
+  hr = InitClusterBuffers();
   if (FAILED(hr))
     return hr;
 
@@ -589,117 +597,203 @@ HRESULT Model::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scre
 }
 
 void Model::Release() {
-  for (auto& buffer : g_pVertexBuffers)
-    if (buffer) buffer->Release();
-
-  for (auto& buffer : g_pIndexBuffers)
-    if (buffer) buffer->Release();
+  if (!gfx)
+    return;
+
+  for (auto& buffer : vertexBuffers)
+    gfx->Release(buffer);
+
+  for (auto& buffer : indexBuffers)
+    gfx->Release(buffer);
+
+  for (auto& buffer : wmBuffers)
+    gfx->Release(buffer);
+
+  for (auto& texture : textures)
+    gfx->Release(texture);
+
+  for (auto& smplr : samplers)
+    gfx->Release(smplr);
+
+  gfx->Release(smBuffer);
+  gfx->Release(lightsBuffer);
+  gfx->Release(clusterRangesBuffer);
+  gfx->Release(clusterIndicesBuffer);
+  lightsCapacity = clusterIndicesCapacity = 0;
+  pixelShaders.Release(*gfx);
+  gfx->Release(vertexShader);
+  gfx->Release(vertexLayout);
+
+  gfx->Release(rasterizerState);
+  gfx->Release(envSamplerState);
+  gfx->Release(brdfSamplerState);
+  ReleaseOuterViews();
+  gfx = nullptr;
+}
 
-  for (auto& buffer : g_pWMBuffers)
-    if (buffer) buffer->Release();
+void Model::ReleaseOuterViews() {
+  for (GfxHandle* view : { &irrMap, &prefilMap, &brdfMap, &probeIrrArray, &probePrefilArray }) {
+    gfx->Release(*view);
+    *view = gfxNullHandle;
+  }
+  viewsChanged = true;
+}
 
-  for (auto& textureSRV : g_pTexturesSRV)
-    if (textureSRV) textureSRV->Release();
+void Model::ImportOuterViews() {
+  ReleaseOuterViews();
+  irrMap = gfx->ImportShaderResource(maps.pIRRMapSRV);
+  prefilMap = gfx->ImportShaderResource(maps.pPrefilMapSRV);
+  brdfMap = gfx->ImportShaderResource(maps.pBRDFMapSRV);
+  probeIrrArray = gfx->ImportShaderResource(g_pProbeIRRArraySRV);
+  probePrefilArray = gfx->ImportShaderResource(g_pProbePrefilArraySRV);
+  viewsChanged = false;
+}
 
-  for (auto& texture : g_pTextures)
-    if (texture) texture->Release();
+uint64_t Model::GetMeshSortKey(size_t meshId) const {
+  XMVECTOR viewPos = XMVector4Transform(meshesWM[meshId].worldMatrix.r[3], XMLoadFloat4x4(&frameView));
+  uint64_t material = ((uint64_t)GetPixelShaderKey(meshId) << 20) | ((uint32_t)(meshMaterislIdx[meshId] + 1) & 0xFFFFF);
+  return GfxSortKey::Opaque(XMVectorGetZ(viewPos), material);
+}
 
-  for (auto& smplr : g_pSamplers)
-    if (smplr) smplr->Release();
+void Model::Render(IGfxContext& context) {
+  if (viewsChanged)
+    ImportOuterViews();
 
-  if (g_pSMBuffer) g_pSMBuffer->Release();
-  if (g_pPixelShader) g_pPixelShader->Release();
-  if (g_pVertexShader) g_pVertexShader->Release();
-  if (g_pVertexLayout) g_pVertexLayout->Release();
+  PrepareShaders(0, GetMeshCount());
+  commandBuffer.Clear();
+  Record(commandBuffer, 0, GetMeshCount());
+  const GfxCommandBuffer* buffers[] = { &commandBuffer };
+  commandList.Merge(buffers, 1);
 
-  if (g_pRasterizerState) g_pRasterizerState->Release();
-  if (g_pEnvSamplerState) g_pEnvSamplerState->Release();
-  if (g_pBRDFSamplerState) g_pBRDFSamplerState->Release();
+  // Other passes bind D3D state directly
+  context.InvalidateState();
+  if (&context == &gfx->GetContext())
+    submitter.Replay(*gfx, commandList);
+  else
+    commandList.Replay(context);
 }
 
-void Model::Render(ID3D11DeviceContext* context) {
-  for (int i = 0; i < model.meshes.size(); i++) {
-    beginEvent((std::wstring(L"Drawing mesh #") + std::to_wstring(i + 1)).c_str());
-
-    context->RSSetState(g_pRasterizerState);
+void Model::PrepareShaders(uint32_t firstMesh, uint32_t meshCount) {
+  uint32_t endMesh = min(firstMesh + meshCount, GetMeshCount());
+  for (uint32_t i = firstMesh; i < endMesh; i++)
+    pixelShaders.Get(GetPixelShaderKey(i), [this](uint32_t key) { return CreatePixelShaderVariant(key); });
+}
 
-    context->IASetIndexBuffer(g_pIndexBuffers[i], DXGI_FORMAT_R32_UINT, 0);
+void Model::Record(GfxCommandBuffer& context, uint32_t firstMesh, uint32_t meshCount) const {
+  // Every packet sets all state of its draw, packets are reordered after recording
+  const GfxShaderStage vs = GfxShaderStage::vertex, ps = GfxShaderStage::pixel;
+  uint32_t endMesh = min(firstMesh + meshCount, GetMeshCount());
+  for (uint32_t i = firstMesh; i < endMesh; i++) {
+    context.BeginPacket(GetMeshSortKey(i));
+    context.BeginEvent(meshEventNames[i].c_str());
 
-    ID3D11Buffer* vertexBuffers[] = { g_pVertexBuffers[i] };
-    UINT strides[] = { sizeof(Vertex) };
-    UINT offsets[] = { 0 };
+    context.SetRasterizerState(rasterizerState);
 
-    context->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
-    context->IASetInputLayout(g_pVertexLayout);
-    context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST); // TODO :        
+    context.SetIndexBuffer(indexBuffers[i], indexFormats[i]);
+    context.SetVertexBuffer(0, vertexBuffers[i], sizeof(Vertex));
+    context.SetInputLayout(vertexLayout);
+    context.SetTopology(GfxTopology::triangleList); // TODO :        
     
-    context->VSSetShader(g_pVertexShader, nullptr, 0);
-    context->VSSetConstantBuffers(0, 1, &g_pWMBuffers[i]);
-    context->VSSetConstantBuffers(1, 1, &g_pSMBuffer);
+    context.SetShader(vs, vertexShader);
+    context.SetConstantBuffer(vs, 0, wmBuffers[i]);
+    context.SetConstantBuffer(vs, 1, smBuffer);
 
-    context->PSSetShader(g_pPixelShader, nullptr, 0);
-    context->PSSetConstantBuffers(0, 1, &g_pWMBuffers[i]);
-    context->PSSetConstantBuffers(1, 1, &g_pSMBuffer);
+    context.SetShader(ps, pixelShaders.Find(GetPixelShaderKey(i)));
+    context.SetConstantBuffer(ps, 0, wmBuffers[i]);
+    context.SetConstantBuffer(ps, 1, smBuffer);
 
     // TODO: set textures
     if (meshMaterislIdx[i] != -1) {
       auto material = gltfMaterials[meshMaterislIdx[i]];
       if (material.metalnessTexId != -1) {
-        context->PSSetShaderResources(0, 1, &g_pTexturesSRV[gltfTextures[material.metalnessTexId].texId]);
-        context->PSSetSamplers(0, 1, &g_pSamplers[gltfTextures[material.metalnessTexId].samplerId]);
+        context.SetShaderResource(ps, 0, textures[gltfTextures[material.metalnessTexId].texId]);
+        context.SetSampler(ps, 0, samplers[gltfTextures[material.metalnessTexId].samplerId]);
       }
       if (material.normalTexId != -1) {
-        context->PSSetShaderResources(1, 1, &g_pTexturesSRV[gltfTextures[material.normalTexId].texId]);
-        context->PSSetSamplers(1, 1, &g_pSamplers[gltfTextures[material.normalTexId].samplerId]);
+        context.SetShaderResource(ps, 1, textures[gltfTextures[material.normalTexId].texId]);
+        context.SetSampler(ps, 1, samplers[gltfTextures[material.normalTexId].samplerId]);
       }
       if (material.diffTexId != -1) {
-        context->PSSetShaderResources(2, 1, &g_pTexturesSRV[gltfTextures[material.diffTexId].texId]);
-        context->PSSetSamplers(2, 1, &g_pSamplers[gltfTextures[material.diffTexId].samplerId]);
+        context.SetShaderResource(ps, 2, textures[gltfTextures[material.diffTexId].texId]);
+        context.SetSampler(ps, 2, samplers[gltfTextures[material.diffTexId].samplerId]);
       }
     }
 
     // set env params
-    context->PSSetShaderResources(3, 1, &maps.pIRRMapSRV);
-    context->PSSetShaderResources(4, 1, &maps.pPrefilMapSRV);
-    context->PSSetShaderResources(5, 1, &maps.pBRDFMapSRV);
-    context->PSSetSamplers(3, 1, &g_pEnvSamplerState);
-    context->PSSetSamplers(4, 1, &g_pBRDFSamplerState);
+    context.SetShaderResource(ps, 3, irrMap);
+    context.SetShaderResource(ps, 4, prefilMap);
+    context.SetShaderResource(ps, 5, brdfMap);
+    context.SetSampler(ps, 3, envSamplerState);
+    context.SetSampler(ps, 4, brdfSamplerState);
+    context.SetShaderResource(ps, 6, probeIrrArray);
+    context.SetShaderResource(ps, 7, probePrefilArray);
+    context.SetShaderResource(ps, 8, lightsBuffer);
+    context.SetShaderResource(ps, 9, clusterRangesBuffer);
+    context.SetShaderResource(ps, 10, clusterIndicesBuffer);
     
     
-    context->DrawIndexed(indeciesLenghts[i], 0, 0);
+    context.DrawIndexed((uint32_t)indeciesLenghts[i]);
 
-    endEvent();
+    context.EndEvent();
   }
 }
 
-HRESULT Model::Update(ID3D11DeviceContext* context, XMMATRIX& viewMatrix, XMMATRIX& projectionMatrix, XMVECTOR& cameraPos, const std::vector<Light>& lights, PBRRichMaterial pbrMaterial, ViewMode viewMode) {
+std::vector<XMFLOAT3> Model::GetMeshPositions() const {
+  std::vector<XMFLOAT3> positions(meshesWM.size());
+  for (size_t i = 0; i < meshesWM.size(); i++)
+    XMStoreFloat3(&positions[i], meshesWM[i].worldMatrix.r[3]);
+  return positions;
+}
+
+HRESULT Model::Update(IGfxContext& context, XMMATRIX& viewMatrix, XMMATRIX& projectionMatrix, XMVECTOR& cameraPos, const std::vector<ClusterLight>& lights, PBRRichMaterial pbrMaterial, ViewMode viewMode) {
   // Update world matrix angle of first cube
   WorldMatrixBuffer worldMatrixBuffer;
   for (int i = 0; i < model.meshes.size(); i++) {
     worldMatrixBuffer.worldMatrix = meshesWM[i].worldMatrix;
     worldMatrixBuffer.pbrParams = XMFLOAT4(pbrMaterial.roughness, pbrMaterial.metalness, pbrMaterial.dielectricF0, 0.0);// pbrMaterial;
     worldMatrixBuffer.albedo = XMFLOAT4(pbrMaterial.albedo.x, pbrMaterial.albedo.y, pbrMaterial.albedo.z, 0.0);
+    worldMatrixBuffer.probes = ProbeShadingData();
+    if (useProbes && i < probeShading.size())
+      worldMatrixBuffer.probes = probeShading[i];
     
-    context->UpdateSubresource(g_pWMBuffers[i], 0, nullptr, &worldMatrixBuffer, 0, 0);
+    context.UpdateBuffer(wmBuffers[i], &worldMatrixBuffer, sizeof(worldMatrixBuffer));
   }
   
   // Get the view matrix
-  D3D11_MAPPED_SUBRESOURCE subresource;
-  HRESULT hr = context->Map(g_pSMBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
-  if (FAILED(hr))
-    return FAILED(hr);
-
-  SceneMatrixBuffer& sceneBuffer = *reinterpret_cast<SceneMatrixBuffer*>(subresource.pData);
+  SceneMatrixBuffer sceneBuffer;
   sceneBuffer.viewMode = XMFLOAT4(viewMode.modelViewMode, viewMode.isPlainNormal, viewMode.isPlainMetalRough, viewMode.isPlainColor);
   sceneBuffer.viewProjectionMatrix = XMMatrixMultiply(viewMatrix, projectionMatrix);
   sceneBuffer.cameraPos = XMFLOAT4(XMVectorGetX(cameraPos), XMVectorGetY(cameraPos), XMVectorGetZ(cameraPos), 1.0f);
-  sceneBuffer.lightCount = XMINT4((int32_t)lights.size(), 0, 0, 0);
-  for (int i = 0; i < lights.size(); i++) {
-    sceneBuffer.lightPos[i] = lights[i].GetLightPosition();
-    sceneBuffer.lightColor[i] = lights[i].GetLightColor();
+  frameViewMode = viewMode;
+
+  // Assign lights to clusters of this camera
+  XMFLOAT4X4 view, projection;
+  XMStoreFloat4x4(&view, viewMatrix);
+  XMStoreFloat4x4(&projection, projectionMatrix);
+  frameView = view;
+  ClusterGridDesc grid = ClusterGridDesc::FromProjection(&projection._11);
+  {
+    PROFILE_SCOPE("Cluster lights");
+    clusteredLighting.Build(grid, &view._11, lights);
   }
+  const ClusterStats& clusterStats = clusteredLighting.GetStats();
+  frameLightCount = clusterStats.globalLights;
+  sceneBuffer.lightCount = XMINT4(clusterStats.globalLights, (int32_t)clusteredLighting.GetLights().size(), 0, 0);
+  sceneBuffer.clusterSize = XMINT4(grid.tilesX, grid.tilesY, grid.slices, 0);
+  sceneBuffer.clusterDepth = XMFLOAT4(grid.GetSliceScale(), grid.GetSliceBias(), 0, 0);
+
+  const std::vector<ClusterRange>& clusters = clusteredLighting.GetClusters();
+  context.UpdateBuffer(clusterRangesBuffer, clusters.data(), (uint32_t)(clusters.size() * sizeof(ClusterRange)));
+  const std::vector<ClusterLight>& sortedLights = clusteredLighting.GetLights();
+  HRESULT hr = UpdateStructuredBuffer(context, lightsBuffer, lightsCapacity, sortedLights.data(), (uint32_t)sortedLights.size(), sizeof(ClusterLight));
+  if (FAILED(hr))
+    return hr;
+  const std::vector<uint32_t>& indices = clusteredLighting.GetIndices();
+  hr = UpdateStructuredBuffer(context, clusterIndicesBuffer, clusterIndicesCapacity, indices.data(), (uint32_t)indices.size(), sizeof(uint32_t));
+  if (FAILED(hr))
+    return hr;
 
-  context->Unmap(g_pSMBuffer, 0);
+  context.UpdateBuffer(smBuffer, &sceneBuffer, sizeof(sceneBuffer));
 
   return S_OK;
 }
@@ -5,17 +5,21 @@
 #include <string>
 #include <vector>
 #include "rendered.h"
+#include "ClusteredLighting.h"
+#include "GfxCommandBuffer.h"
+#include "GfxDevice.h"
+#include "GfxParallelSubmit.h"
+#include "ShaderPermutation.h"
 #include "materials.h"
 #include "common.h"
 #include "light.h"
 #include "skybox.h"
+#include "ReflectionProbeSystem.h"
 #include "../libs/tiny_gltf.h"
 
-#define MAX_LIGHT_SOURCES 10
 
-
-
-class Model : public Rendered {
+// Draws through IGfxDevice, so its submission runs on D3D11 or on the null backend
+class Model {
 public:
   Model() = default;
 
@@ -33,12 +37,44 @@ public:
 
   void SetIBLMaps(const IBLMaps& _maps) {
     maps = _maps;
+    viewsChanged = true;
+  };
+
+  // Cube map arrays of local reflection probes
+  void SetProbeMaps(ID3D11ShaderResourceView* irrArraySRV, ID3D11ShaderResourceView* prefilArraySRV) {
+    g_pProbeIRRArraySRV = irrArraySRV;
+    g_pProbePrefilArraySRV = prefilArraySRV;
+    viewsChanged = true;
   };
 
-  HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight);
+  // Probes blending per mesh (empty - skybox only), applied in Update
+  void SetProbeShading(const std::vector<ProbeShadingData>& shading) {
+    probeShading = shading;
+  };
+  void EnableProbes(bool enable) { useProbes = enable; }
+
+  // Mesh origins in world space (to choose probes)
+  std::vector<XMFLOAT3> GetMeshPositions() const;
+
+  HRESULT Init(IGfxDevice& device, int screenWidth, int screenHeight);
   void Release();
-  void Render(ID3D11DeviceContext* context);
-  HRESULT Update(ID3D11DeviceContext* context, XMMATRIX& viewMatrix, XMMATRIX& projectionMatrix, XMVECTOR& cameraPos, const std::vector<Light>& lights, PBRRichMaterial pbrMaterial, ViewMode viewMode);
+  // Records meshes into a command list sorted front to back and by material, then replays it
+  void Render(IGfxContext& context);
+  // Compiles pixel shader variants of the meshes for the last Update, main thread only
+  void PrepareShaders(uint32_t firstMesh, uint32_t meshCount);
+  // Packets of meshes [firstMesh, firstMesh + meshCount), keys use the view of the last Update.
+  // Read-only, so several threads may record after PrepareShaders
+  void Record(GfxCommandBuffer& context, uint32_t firstMesh, uint32_t meshCount) const;
+  uint32_t GetMeshCount() const { return (uint32_t)model.meshes.size(); }
+  // Sorted list of the last Render
+  const GfxCommandList& GetCommandList() const { return commandList; }
+  // Splits replay on the device context between deferred contexts
+  GfxParallelSubmitter& GetSubmitter() { return submitter; }
+  // Point lights are assigned to view frustum clusters of the projection, directional ones shade every pixel
+  HRESULT Update(IGfxContext& context, XMMATRIX& viewMatrix, XMMATRIX& projectionMatrix, XMVECTOR& cameraPos, const std::vector<ClusterLight>& lights, PBRRichMaterial pbrMaterial, ViewMode viewMode);
+
+  // Light influence cutoff and stats of the last Update
+  ClusteredLighting& GetClusteredLighting() { return clusteredLighting; }
 
 private:
   struct Vertex
@@ -53,10 +89,10 @@ private:
   HRESULT LoadGLTFModelMetadata();
 
   // methods to init textures and samplers
-  HRESULT InitTexturesFromlMetadata(ID3D11Device* device);
-  HRESULT InitTexture(ID3D11Device* device, size_t imgId);
-  HRESULT InitSamplersFromlMetadata(ID3D11Device* device);
-  HRESULT InitSampler(ID3D11Device* device, size_t smplrId);
+  HRESULT InitTexturesFromlMetadata();
+  HRESULT InitTexture(size_t imgId);
+  HRESULT InitSamplersFromlMetadata();
+  HRESULT InitSampler(size_t smplrId);
 
   // Methods to init materials structures
   struct GLTFTexture {
@@ -71,8 +107,8 @@ private:
   void  InitMaterialsFromMetadata();
 
   // methods to init mesh buffers
-  HRESULT InitBuffersFromFile(ID3D11Device* device, FILE* binFile);
-  HRESULT LoadMesh(ID3D11Device* device, FILE* binFile, size_t meshId);
+  HRESULT InitBuffersFromFile(FILE* binFile);
+  HRESULT LoadMesh(FILE* binFile, size_t meshId);
   // - methods to load *.GLTF type buffers and convert them to ours
   template<typename ArrayType>
   HRESULT LoadSpecificTypeArray(const tinygltf::Accessor& accessor, FILE* binFile, std::vector<ArrayType>& verticiesToLoad);
@@ -81,32 +117,50 @@ private:
   // - methods to init buffers
   HRESULT GenerateVerticiesArray(std::vector<XMFLOAT3>& posVec, std::vector<XMFLOAT3>& normVec, std::vector<XMFLOAT3>& tangentVec, std::vector<XMFLOAT2>& texUVVec, std::vector<Vertex>& verticiesRes);
   template<typename IndexType>
-  HRESULT InitIndeciesBuffer(ID3D11Device* device, std::vector<IndexType>& indicies, size_t bufferIndex);
-  HRESULT InitVerticiesBuffer(ID3D11Device* device, std::vector<Vertex>& verticies, size_t bufferIndex);
+  HRESULT InitIndeciesBuffer(std::vector<IndexType>& indicies, size_t bufferIndex);
+  HRESULT InitVerticiesBuffer(std::vector<Vertex>& verticies, size_t bufferIndex);
 
   // methods to init constant buffers for verticies transforms of meshes
   struct SceneMatrixBuffer {
     XMMATRIX viewProjectionMatrix;
     XMFLOAT4 cameraPos;
     XMINT4 lightCount;
-    XMFLOAT4 lightPos[MAX_LIGHT_SOURCES];
-    XMFLOAT4 lightColor[MAX_LIGHT_SOURCES];
     XMFLOAT4 viewMode;
+    XMINT4 clusterSize;
+    XMFLOAT4 clusterDepth;
   };
 
   struct WorldMatrixBuffer {
     XMMATRIX worldMatrix;
     XMFLOAT4 pbrParams;
     XMFLOAT4 albedo;
+    ProbeShadingData probes;
   };
-  HRESULT InitConstantBuffersFromlMetadata(ID3D11Device* device);
+  HRESULT InitConstantBuffersFromlMetadata();
+
+  // Cluster ranges buffer of the grid size, lights and indices buffers grow in Update
+  HRESULT InitClusterBuffers();
+  HRESULT UpdateStructuredBuffer(IGfxContext& context, GfxHandle& buffer, uint32_t& capacity, const void* data, uint32_t count, uint32_t stride);
   void CountMatrixTransformation(int nodeId, const XMMATRIX& parentTransformation);
 
   // methods to init shaders
-  HRESULT InitShadersPipeline(ID3D11Device* device);
+  HRESULT InitShadersPipeline();
+
+  // Pixel shader variant of the key (PBRShaderFeatures), gfxNullHandle if it fails to compile
+  GfxHandle CreatePixelShaderVariant(uint32_t key);
+
+  // Variant key of the mesh: material textures, view mode, IBL maps and light count of the last Update
+  uint32_t GetPixelShaderKey(size_t meshId) const;
+
+  // Opaque key: view depth of the mesh origin, then shader variant and material
+  uint64_t GetMeshSortKey(size_t meshId) const;
 
   // Method to init other Dx11 stuff
-  HRESULT InitDX11Vars(ID3D11Device* device);
+  HRESULT InitDX11Vars();
+
+  // Outer IBL and probe views as device handles, reimported after SetIBLMaps/SetProbeMaps
+  void ImportOuterViews();
+  void ReleaseOuterViews();
 
   // paths and filenames
   std::string m_gltffile;
@@ -117,18 +171,34 @@ private:
   // var for outer resources (no need to release them)
   IBLMaps maps;
   PBRRichMaterial PBRParams;
-
-  // dx11 vars for shaders
-  ID3D11VertexShader* g_pVertexShader = nullptr;
-  ID3D11PixelShader* g_pPixelShader = nullptr;
-  ID3D11InputLayout* g_pVertexLayout = nullptr;
-
-  // dx11 vars for buffers
-  ID3D11Buffer* g_pSMBuffer = nullptr;
+  ID3D11ShaderResourceView* g_pProbeIRRArraySRV = nullptr;
+  ID3D11ShaderResourceView* g_pProbePrefilArraySRV = nullptr;
+  std::vector<ProbeShadingData> probeShading;
+  bool viewsChanged = true;
+  GfxHandle irrMap = gfxNullHandle, prefilMap = gfxNullHandle, brdfMap = gfxNullHandle;
+  GfxHandle probeIrrArray = gfxNullHandle, probePrefilArray = gfxNullHandle;
+  bool useProbes = true;
+
+  IGfxDevice* gfx = nullptr;
+
+  // Device handles of shaders
+  GfxHandle vertexShader = gfxNullHandle;
+  ShaderPermutationCache pixelShaders;
+  ViewMode frameViewMode = {};
+  XMFLOAT4X4 frameView = {};
+  uint32_t frameLightCount = 0;
+  GfxHandle vertexLayout = gfxNullHandle;
+
+  // Device handles of buffers
+  GfxHandle smBuffer = gfxNullHandle;
+  ClusteredLighting clusteredLighting;
+  GfxHandle lightsBuffer = gfxNullHandle, clusterRangesBuffer = gfxNullHandle, clusterIndicesBuffer = gfxNullHandle;
+  uint32_t lightsCapacity = 0, clusterIndicesCapacity = 0;
   std::vector<WorldMatrixBuffer> meshesWM = std::vector<WorldMatrixBuffer>(0);
-  std::vector<ID3D11Buffer*> g_pWMBuffers = std::vector<ID3D11Buffer*>(0, nullptr);
-  std::vector<ID3D11Buffer*> g_pVertexBuffers = std::vector<ID3D11Buffer*>(0, nullptr);
-  std::vector<ID3D11Buffer*> g_pIndexBuffers = std::vector<ID3D11Buffer*>(0, nullptr);
+  std::vector<GfxHandle> wmBuffers = std::vector<GfxHandle>(0, gfxNullHandle);
+  std::vector<GfxHandle> vertexBuffers = std::vector<GfxHandle>(0, gfxNullHandle);
+  std::vector<GfxHandle> indexBuffers = std::vector<GfxHandle>(0, gfxNullHandle);
+  std::vector<GfxFormat> indexFormats = std::vector<GfxFormat>(0, GfxFormat::r32Uint);
   std::vector<size_t> indeciesLenghts = std::vector<size_t>(0, 0);
   std::vector<size_t> materialsIdxs = std::vector<size_t>(0, 0);
 
@@ -136,13 +206,18 @@ private:
   std::vector<GLTFTexture> gltfTextures = std::vector<GLTFTexture>(0);
   std::vector<GLTFMaterial> gltfMaterials = std::vector<GLTFMaterial>(0);
   std::vector<int> meshMaterislIdx = std::vector<int>(0);
+  std::vector<std::string> meshEventNames;
+
+  // Device handles of textures and samplers
+  std::vector<GfxHandle> textures = std::vector<GfxHandle>(0, gfxNullHandle);
+  std::vector<GfxHandle> samplers = std::vector<GfxHandle>(0, gfxNullHandle);
 
-  // dx11 vars for textures and samplers
-  std::vector<ID3D11Texture2D*> g_pTextures = std::vector<ID3D11Texture2D*>(0, nullptr);
-  std::vector<ID3D11SamplerState*> g_pSamplers = std::vector<ID3D11SamplerState*>(0, nullptr);
-  std::vector<ID3D11ShaderResourceView*> g_pTexturesSRV = std::vector<ID3D11ShaderResourceView*>(0, nullptr);
+  // Render recording, kept to reuse memory
+  GfxCommandBuffer commandBuffer;
+  GfxCommandList commandList;
+  GfxParallelSubmitter submitter;
 
-  ID3D11RasterizerState* g_pRasterizerState = nullptr;
-  ID3D11SamplerState* g_pEnvSamplerState = nullptr;
-  ID3D11SamplerState* g_pBRDFSamplerState = nullptr;
+  GfxHandle rasterizerState = gfxNullHandle;
+  GfxHandle envSamplerState = gfxNullHandle;
+  GfxHandle brdfSamplerState = gfxNullHandle;
 };
@@ -1,4 +1,5 @@
 #include "light.h"
+#include "ShaderLibrary.h"
 
 HRESULT Light::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
   // Create index array
@@ -47,7 +48,7 @@ HRESULT Light::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scre
   flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
 
-  hr = D3DCompileFromFile(L"no_lightning_VS.hlsl", NULL, NULL, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
+  hr = ShaderLibrary::GetInstance().Compile(L"no_lightning_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
@@ -55,7 +56,7 @@ HRESULT Light::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scre
   if (FAILED(hr))
     return hr;
 
-  hr = D3DCompileFromFile(L"no_lightning_PS.hlsl", NULL, NULL, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
+  hr = ShaderLibrary::GetInstance().Compile(L"no_lightning_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
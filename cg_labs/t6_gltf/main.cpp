@@ -1,13 +1,21 @@
 ﻿#include <windows.h>
+#include <shellapi.h>
 #include <xstring>
 #include <mmsystem.h>
+#include <fstream>
 
 #include "resource1.h"
+#include "CommandBenchmark.h"
+#include "JobBenchmark.h"
 #include "renderer.h"
+#include "SoftSceneLoader.h"
+#include "TraceRecorder.h"
 
 #define START_W 1280
 #define START_H 720
 
+#define TRACE_FRAMES 120
+
 #define MAX_LOADSTRING 300
 WCHAR szTitle[MAX_LOADSTRING];                  // The title bar text
 
@@ -19,6 +27,11 @@ HWND            g_hWnd = nullptr;
 
 // Forward declarations
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
+int RunBatch(int argc, LPWSTR* argv);
+int RunJobBench(int argc, LPWSTR* argv);
+int RunCommandBench(int argc, LPWSTR* argv);
+std::string ToNarrow(const std::wstring& str);
+std::string FindTraceArg(int argc, LPWSTR* argv);
 
 
 // Register class and create window
@@ -66,9 +79,6 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
   UNREFERENCED_PARAMETER(hPrevInstance);
   UNREFERENCED_PARAMETER(lpCmdLine);
 
-  if (FAILED(InitWindow(hInstance, nCmdShow)))
-    return 0;
-
   LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
 
 
@@ -84,6 +94,46 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     SetCurrentDirectory(dir.c_str());
   }
 
+  // Batch mode renders without window
+  int argc = 0;
+  std::string tracePath;
+  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+  if (argv)
+  {
+    for (int i = 1; i < argc; i++)
+      if (std::wstring(argv[i]) == L"--batch")
+      {
+        int code = RunBatch(argc, argv);
+        LocalFree(argv);
+        return code;
+      }
+      else if (std::wstring(argv[i]) == L"--bench-jobs")
+      {
+        int code = RunJobBench(argc, argv);
+        LocalFree(argv);
+        return code;
+      }
+      else if (std::wstring(argv[i]) == L"--bench-commands")
+      {
+        int code = RunCommandBench(argc, argv);
+        LocalFree(argv);
+        return code;
+      }
+    tracePath = FindTraceArg(argc, argv);
+    LocalFree(argv);
+  }
+
+  // --trace covers loading and first frames
+  TraceRecorder& trace = TraceRecorder::GetInstance();
+  if (!tracePath.empty())
+  {
+    trace.SetThreadName("Main");
+    trace.Start();
+  }
+
+  if (FAILED(InitWindow(hInstance, nCmdShow)))
+    return 0;
+
   // Init Device
   auto hr = Renderer::GetInstance().Init(g_hWnd, g_hInst, START_W, START_H);
   if (FAILED(hr))
@@ -94,6 +144,7 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
   // Main message loop
   MSG msg = { 0 };
+  int tracedFrames = 0;
   while (WM_QUIT != msg.message)
   {
     if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
@@ -102,8 +153,16 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
       DispatchMessage(&msg);
     }
     if (Renderer::GetInstance().Update())
+    {
       if (FAILED(Renderer::GetInstance().Render()))
         break;
+      if (!tracePath.empty() && ++tracedFrames >= TRACE_FRAMES)
+      {
+        trace.Stop();
+        trace.ExportChromeTrace(tracePath);
+        tracePath.clear();
+      }
+    }
   }
 
   Renderer::GetInstance().CleanupDevice();
@@ -112,6 +171,153 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 }
 
 
+std::string ToNarrow(const std::wstring& str)
+{
+  int size = WideCharToMultiByte(CP_ACP, 0, str.c_str(), (int)str.size(), nullptr, 0, nullptr, nullptr);
+  std::string result(size, '\0');
+  WideCharToMultiByte(CP_ACP, 0, str.c_str(), (int)str.size(), &result[0], size, nullptr, nullptr);
+  return result;
+}
+
+// --trace out.json, empty if not given
+std::string FindTraceArg(int argc, LPWSTR* argv)
+{
+  for (int i = 1; i + 1 < argc; i++)
+    if (std::wstring(argv[i]) == L"--trace")
+      return ToNarrow(argv[i + 1]);
+  return "";
+}
+
+// t6_gltf.exe --batch scenes.json [--warp] [--soft] [--shard index/count] [--trace out.json]
+// Writes PNG files and batch_report.txt into output folder of the description, returns 0 if all images are written
+int RunBatch(int argc, LPWSTR* argv)
+{
+  std::string tracePath = FindTraceArg(argc, argv);
+  TraceRecorder& trace = TraceRecorder::GetInstance();
+  if (!tracePath.empty())
+  {
+    trace.SetThreadName("Main");
+    trace.Start();
+  }
+
+  std::string descPath;
+  bool forceWarp = false, soft = false;
+  unsigned shardIndex = 0, shardCount = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    std::wstring arg = argv[i];
+    if (arg == L"--batch" && i + 1 < argc)
+      descPath = ToNarrow(argv[++i]);
+    else if (arg == L"--warp")
+      forceWarp = true;
+    else if (arg == L"--soft")
+      soft = true;
+    else if (arg == L"--shard" && i + 1 < argc)
+      swscanf_s(argv[++i], L"%u/%u", &shardIndex, &shardCount);
+  }
+
+  BatchDesc desc;
+  std::string error;
+  if (!LoadBatchDesc(descPath, desc, error))
+  {
+    OutputDebugStringA(("Batch: " + error + "\n").c_str());
+    return 1;
+  }
+  if (soft)
+    desc.output.softRasterizer = true;
+
+  HRESULT hr = S_OK;
+  BatchOutputStats stats;
+  SoftFrameStats softStats;
+  if (desc.output.softRasterizer)
+  {
+    // CPU only, no device is created
+    if (!RenderSoftBatch(desc, SelectShard(desc.jobs.size(), shardIndex, shardCount), SoftRasterizerSettings(), stats, softStats, error))
+    {
+      OutputDebugStringA(("Batch: " + error).c_str());
+      hr = E_FAIL;
+    }
+  }
+  else
+  {
+    Renderer& renderer = Renderer::GetInstance();
+    hr = renderer.InitHeadless(desc.output.width, desc.output.height, forceWarp);
+    if (SUCCEEDED(hr))
+      hr = renderer.RenderBatch(desc, SelectShard(desc.jobs.size(), shardIndex, shardCount), stats);
+    renderer.CleanupDevice();
+  }
+
+  std::ofstream report(desc.output.outputDir + "/batch_report.txt");
+  report << "written " << stats.written << ", failed " << stats.failed << ", hr 0x" << std::hex << (unsigned)hr << "\n";
+  for (const std::string& path : stats.failedPaths)
+    report << "failed " << path << "\n";
+
+  if (desc.output.softRasterizer)
+    report << std::dec << "soft rasterizer: " << softStats.trianglesIn << " triangles, " << softStats.pixelsShaded << " pixels in " << softStats.totalMs << " ms, "
+      << softStats.MTrisPerSecond() << " Mtri/s, " << softStats.MPixelsPerSecond() << " Mpix/s\n";
+
+  if (!tracePath.empty())
+  {
+    trace.Stop();
+    if (!trace.ExportChromeTrace(tracePath))
+      report << "trace not written to " << tracePath << "\n";
+  }
+
+  return SUCCEEDED(hr) ? 0 : 1;
+}
+
+
+// t6_gltf.exe --bench-jobs [report.txt] [--max-threads N]
+// Measures JobSystem overhead and scaling, writes job_bench.txt by default
+int RunJobBench(int argc, LPWSTR* argv)
+{
+  std::string reportPath = "job_bench.txt";
+  unsigned maxThreads = 64;
+  for (int i = 1; i < argc; i++)
+  {
+    std::wstring arg = argv[i];
+    if (arg == L"--bench-jobs" && i + 1 < argc && argv[i + 1][0] != L'-')
+      reportPath = ToNarrow(argv[++i]);
+    else if (arg == L"--max-threads" && i + 1 < argc)
+      swscanf_s(argv[++i], L"%u", &maxThreads);
+  }
+
+  std::ofstream report(reportPath);
+  WriteJobBenchmark(report, RunJobBenchmark(maxThreads));
+  return report ? 0 : 1;
+}
+
+// t6_gltf.exe --bench-commands [report.txt] [--draws N] [--buffers N]
+// Records, merges, sorts and replays synthetic draws on the null device, writes command_bench.txt by default
+int RunCommandBench(int argc, LPWSTR* argv)
+{
+  std::string reportPath = "command_bench.txt";
+  unsigned buffers = 0;
+  std::vector<unsigned> draws;
+  for (int i = 1; i < argc; i++)
+  {
+    std::wstring arg = argv[i];
+    unsigned value = 0;
+    if (arg == L"--bench-commands" && i + 1 < argc && argv[i + 1][0] != L'-')
+      reportPath = ToNarrow(argv[++i]);
+    else if (arg == L"--draws" && i + 1 < argc && swscanf_s(argv[++i], L"%u", &value) == 1)
+      draws.push_back(value);
+    else if (arg == L"--buffers" && i + 1 < argc)
+      swscanf_s(argv[++i], L"%u", &buffers);
+  }
+  if (draws.empty())
+    draws = { 1000, 10000, 100000 };
+
+  std::ofstream report(reportPath);
+  for (unsigned count : draws)
+  {
+    WriteCommandBenchmark(report, RunCommandBenchmark(count, buffers));
+    report << "\n";
+  }
+  return report ? 0 : 1;
+}
+
+
 extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 // Called every time the application receives a message
@@ -0,0 +1,34 @@
+// Octahedral environment maps lookup, same mapping as OctahedralConverter:
+// y is the pole axis, every mip has OCT_BORDER texels of padding around (size >> mip) inner texels
+#define OCT_BORDER 1
+
+float2 OctEncode(float3 dir)
+{
+	dir /= abs(dir.x) + abs(dir.y) + abs(dir.z);
+	float2 uv = dir.xz;
+	if (dir.y < 0)
+		uv = (1 - abs(uv.yx)) * (uv >= 0 ? 1.0 : -1.0);
+	return uv;
+}
+
+float3 SampleOctahedralLevel(Texture2D tex, SamplerState smplr, float2 oct, uint mip)
+{
+	uint width, height, levels;
+	tex.GetDimensions(mip, width, height, levels);
+	float inner = width - 2 * OCT_BORDER;
+	float2 uv = (OCT_BORDER + (oct * 0.5 + 0.5) * inner) / width;
+	return tex.SampleLevel(smplr, uv, mip).rgb;
+}
+
+// Padding size is fixed in texels, so mips are blended manually instead of trilinear filtering
+float3 SampleOctahedral(Texture2D tex, SamplerState smplr, float3 dir, float lod)
+{
+	uint width, height, levels;
+	tex.GetDimensions(0, width, height, levels);
+	lod = clamp(lod, 0, levels - 1);
+
+	float2 oct = OctEncode(dir);
+	uint mip0 = (uint)lod;
+	uint mip1 = min(mip0 + 1, levels - 1);
+	return lerp(SampleOctahedralLevel(tex, smplr, oct, mip0), SampleOctahedralLevel(tex, smplr, oct, mip1), lod - mip0);
+}
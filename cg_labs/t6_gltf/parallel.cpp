@@ -0,0 +1,13 @@
+#include "parallel.h"
+#include "JobSystem.h"
+
+#include <thread>
+
+size_t GetWorkerCount() {
+  size_t count = std::thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
+
+void ParallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads) {
+  JobSystem::GetInstance().ParallelFor(count, body, maxThreads);
+}
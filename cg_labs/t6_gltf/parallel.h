@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Number of worker threads used by ParallelFor (hardware concurrency, at least 1)
+size_t GetWorkerCount();
+
+// Calls body(i) for every i in [0, count) on several threads and waits for all of them.
+// Iterations are handed out one by one, so body should do noticeable amount of work.
+// maxThreads == 0 means GetWorkerCount(). Runs on JobSystem::GetInstance(), may be nested.
+void ParallelFor(size_t count, const std::function<void(size_t)>& body, size_t maxThreads = 0);
@@ -1,5 +1,13 @@
 #include "PBRBuffers.h"
 
+// Permutation defines (see ShaderPermutation.h):
+// VIEW_MODE 0 - full, 1 - normal, 2 - roughness/metalness, 3 - texture
+// PLAIN_NORMAL, PLAIN_METAL_ROUGH, PLAIN_COLOR - material constants instead of textures
+// LIGHT_COUNT - unrolled loop over directional lights, lightCount.x is used without it
+#ifndef VIEW_MODE
+#define VIEW_MODE 0
+#endif
+
 // Model params
 Texture2D roughnessTex : register (t0);
 Texture2D normalTex : register (t1);
@@ -9,12 +17,27 @@ SamplerState normalSmplr : register (s1);
 SamplerState FTexSmplr : register (s2);
 
 // Env params
+#ifdef OCTAHEDRAL_IBL
+#include "octahedral.h"
+Texture2D irrTex : register (t3);
+Texture2D prefTex : register (t4);
+#else
 TextureCube irrTex : register (t3);
 TextureCube prefTex : register (t4);
+#endif
 Texture2D brdfTex : register (t5);
 SamplerState envSmplr : register (s3);
 SamplerState brdfSmplr : register (s4);
 
+// Local reflection probes
+TextureCubeArray probeIrrTex : register (t6);
+TextureCubeArray probePrefTex : register (t7);
+
+// Clustered lights
+StructuredBuffer<SceneLight> sceneLights : register (t8);
+StructuredBuffer<uint2> clusterRanges : register (t9); // offset and count in clusterLightIndices
+StructuredBuffer<uint> clusterLightIndices : register (t10);
+
 float sqr(float x)
 {
   return x * x;
@@ -26,19 +49,35 @@ float3 vecToCam(float3 wPos)
 	return normalize(camPos - wPos);
 }
 
-float3 vecToLight(float3 lightPos, float3 wPos)
+// lightPos.w > 0.5 - directional light, xyz is direction towards it
+float3 vecToLight(float4 lightPos, float3 wPos)
+{
+	if (lightPos.w > 0.5f)
+		return normalize(lightPos.xyz);
+	return normalize(lightPos.xyz - wPos);
+}
+
+// Box projected (parallax corrected) lookup direction of probe, same as ReflectionProbeManager::BoxProject
+float3 probeDirection(float3 dir, float3 wPos, int probeIdx)
 {
-	return normalize(lightPos - wPos);
+	float3 firstPlane = (probeBoxMax[probeIdx].xyz - wPos) / dir;
+	float3 secondPlane = (probeBoxMin[probeIdx].xyz - wPos) / dir;
+	float3 furthestPlane = max(firstPlane, secondPlane);
+	float dist = min(min(furthestPlane.x, furthestPlane.y), furthestPlane.z);
+	if (dist <= 0)
+		return dir;
+	return wPos + dir * dist - probePos[probeIdx].xyz;
 }
+
 float posDot(float3 a, float3 b)
 {
 	return max(dot(a, b), 0);
 }
 
-float normalDistribution(float3 wPos, float3 norm, int lightIdx, float roughness)
+float normalDistribution(float3 wPos, float3 norm, float4 lightPosition, float roughness)
 {
 	float3 v = vecToCam(wPos);
-	float3 l = vecToLight(lightPos[lightIdx].xyz, wPos);
+	float3 l = vecToLight(lightPosition, wPos);
 	float3 h = normalize(l + v);
 
 	float alpha = clamp(roughness, 0.001f, 1);
@@ -54,10 +93,10 @@ float SchlickGGX(float3 n, float3 v, float k)
 	return nv / (nv * (1 - k) + k);
 }
 
-float geometry(float3 wPos, float3 norm, int lightIdx, float roughness)
+float geometry(float3 wPos, float3 norm, float4 lightPosition, float roughness)
 {
 	float3 v = vecToCam(wPos);
-	float3 l = vecToLight(lightPos[lightIdx].xyz, wPos);
+	float3 l = vecToLight(lightPosition, wPos);
 	float3 h = normalize(l + v);
 	float alpha = clamp(roughness, 0.001f, 1);
 	float k = sqr(alpha + 1) / 8;
@@ -66,10 +105,10 @@ float geometry(float3 wPos, float3 norm, int lightIdx, float roughness)
 	return SchlickGGX(n, v, k) * SchlickGGX(n, l, k);
 }
 
-float3 fresnel(float3 wPos, float3 norm, int lightIdx, float metalness, float dielectricF0, float3 albedo)
+float3 fresnel(float3 wPos, float3 norm, float4 lightPosition, float metalness, float dielectricF0, float3 albedo)
 {
 	float3 v = vecToCam(wPos);
-	float3 l = vecToLight(lightPos[lightIdx].xyz, wPos);
+	float3 l = vecToLight(lightPosition, wPos);
 	float3 h = normalize(l + v);
 
 	float3 F0 = float3(dielectricF0, dielectricF0, dielectricF0) * (1 - metalness) +  albedo * metalness;
@@ -84,29 +123,65 @@ float3 FresnelSchlickRoughnessFunction(float3 wPos, float3 norm, float roughness
 	return F0 + (max(ir, F0) - F0) * pow(1 - posDot(norm, v), 5);
 }
 
+float3 CountLight(SceneLight light, float3 wPos, float3 n, float3 v, float roughness, float metalness, float dielectricF0, float3 albedo)
+{
+	float3 l = vecToLight(light.position, wPos);
+
+	float D = normalDistribution(wPos, n, light.position, roughness);
+	float G = geometry(wPos, n, light.position, roughness);
+	float3 F = fresnel(wPos, n, light.position, metalness, dielectricF0, albedo);
+
+	float3 result_add = (1 - F) * albedo / 3.1415926 * (1 - metalness) + D * F * G / (0.001f + 4 * (posDot(l, n) * posDot(v, n)));
+
+	// Directional light extracted from environment: color * w is irradiance, not clamped
+	if (light.position.w > 0.5f)
+		return light.color.rgb * light.color.w * result_add * posDot(l, n);
+
+	// Inverse square falloff: l is normalized, distance comes from the unnormalized vector.
+	// Range of clustered lights (ClusteredLighting::GetLightRange) assumes the same falloff
+	float3 toLight = light.position.xyz - wPos;
+	return clamp(light.color.rgb * result_add * light.color.w / (dot(toLight, toLight) + 0.01f) * (dot(l, n) > 0), 0.0f, 1.0f);
+}
+
+// Cluster of the froxel containing wPos
+uint clusterIndex(float3 wPos)
+{
+	float4 clipPos = mul(viewProjectionMatrix, float4(wPos, 1.0f));
+	float2 ndc = clipPos.xy / clipPos.w;
+	uint x = clamp(floor((ndc.x * 0.5f + 0.5f) * clusterSize.x), 0, clusterSize.x - 1);
+	uint y = clamp(floor((0.5f - ndc.y * 0.5f) * clusterSize.y), 0, clusterSize.y - 1);
+	uint z = clamp(floor(log(max(clipPos.w, 1e-4f)) * clusterDepth.x + clusterDepth.y), 0, clusterSize.z - 1);
+	return (z * clusterSize.y + y) * clusterSize.x + x;
+}
+
 float3 CountPBRColor(float3 wPos, float3 n, float3 v, float roughness, float metalness, float dielectricF0, float3 albedo) {
 	float3 result = { 0.f, 0.f, 0.f };
 
-	// Count lighning part
-	for (uint i = 0; i < lightCount.x; ++i)
-	{
-		float3 l = vecToLight(lightPos[i].xyz, wPos);
-
-		float D = normalDistribution(wPos, n, i, roughness);
-		float G = geometry(wPos, n, i, roughness);
-		float3 F = fresnel(wPos, n, i, metalness, dielectricF0, albedo);
+	// Count lighning part: directional lights for every pixel
+#ifdef LIGHT_COUNT
+	[unroll]
+	for (uint i = 0; i < LIGHT_COUNT; ++i)
+#else
+	for (uint i = 0; i < (uint)lightCount.x; ++i)
+#endif
+		result += CountLight(sceneLights[i], wPos, n, v, roughness, metalness, dielectricF0, albedo);
 
-		float3 result_add = { 0.f, 0.f, 0.f };
-		result_add = (1 - F) * albedo / 3.1415926 * (1 - metalness) + D * F * G / (0.001f + 4 * (posDot(l, n) * posDot(v, n)));
-		
-		// dot(l, l) = ||l||^2 -     
-		result += clamp(lightColor[i] * result_add * lightColor[i].w / (dot(l, l) + 0.01f) * (dot(l, n) > 0), 0.0f, 1.0f);
-	}
+	// Point lights of the cluster
+	uint2 range = clusterRanges[clusterIndex(wPos)];
+	for (uint j = 0; j < range.y; ++j)
+		result += CountLight(sceneLights[clusterLightIndices[range.x + j]], wPos, n, v, roughness, metalness, dielectricF0, albedo);
 
 	// Count IBL specular part
 	float3 r = normalize(2.0f * dot(v, n) * n - v);
 	static const float MAX_REFLECTION_LOD = 4.0;
+#ifdef OCTAHEDRAL_IBL
+	float3 prefilteredColor = SampleOctahedral(prefTex, envSmplr, r, roughness * MAX_REFLECTION_LOD);
+#else
 	float3 prefilteredColor = prefTex.SampleLevel(envSmplr, r, roughness * MAX_REFLECTION_LOD);
+#endif
+	prefilteredColor *= probeWeights.z;
+	for (int p = 0; p < probeSlots.z; ++p)
+		prefilteredColor += probeWeights[p] * probePrefTex.SampleLevel(envSmplr, float4(probeDirection(r, wPos, p), probeSlots[p]), roughness * MAX_REFLECTION_LOD).rgb;
 	float3 F0 = lerp(float3(dielectricF0, dielectricF0, dielectricF0), albedo, metalness);
 	float2 splArg = float2(max(dot(n, v), 0.0), roughness);
 	float2 envBRDF = brdfTex.Sample(brdfSmplr, splArg);
@@ -117,7 +192,14 @@ float3 CountPBRColor(float3 wPos, float3 n, float3 v, float roughness, float met
 	float3 kS = F;
 	float3 kD = float3(1.0, 1.0, 1.0) - kS;
 	kD *= 1.0 - metalness;
+#ifdef OCTAHEDRAL_IBL
+	float3 irradiance = SampleOctahedral(irrTex, envSmplr, n, 0);
+#else
 	float3 irradiance = irrTex.Sample(envSmplr, n).rgb;
+#endif
+	irradiance *= probeWeights.z;
+	for (int q = 0; q < probeSlots.z; ++q)
+		irradiance += probeWeights[q] * probeIrrTex.SampleLevel(envSmplr, float4(n, probeSlots[q]), 0).rgb;
 	float3 diffuse = irradiance * albedo;
 	float3 diffuseComponent = kD * diffuse;
 	
@@ -129,41 +211,44 @@ float3 CountPBRColor(float3 wPos, float3 n, float3 v, float roughness, float met
 }
 
 float4 main(PS_INPUT input) : SV_Target0{
+	// Debug views show the bound textures whatever the plain flags are
+#if VIEW_MODE == 2
+	float2 mr = roughnessTex.Sample(roughnessSmplr, input.texUV).rg;
+	return float4(mr.r, mr.g, 0, 1);
+#elif VIEW_MODE == 3
+	return float4(FTex.Sample(FTexSmplr, input.texUV).rgb, 1);
+#else
 	float3 n = normalize(input.normal.xyz);
-	float3 v = vecToCam(input.worldPos);
 
-	if (viewMode.y == 0) {
-		float3 binorm = normalize(cross(input.normal, input.tangent));
-		float3 localNorm = normalTex.Sample(normalSmplr, input.texUV).xyz * 2.0 - 1.0;
-		n = localNorm.x * normalize(input.tangent) + localNorm.y * binorm + localNorm.z * normalize(input.normal);
-	}
+#ifndef PLAIN_NORMAL
+	float3 binorm = normalize(cross(input.normal, input.tangent));
+	float3 localNorm = normalTex.Sample(normalSmplr, input.texUV).xyz * 2.0 - 1.0;
+	n = localNorm.x * normalize(input.tangent) + localNorm.y * binorm + localNorm.z * normalize(input.normal);
+#endif
+
+#if VIEW_MODE == 1
+	return float4((n + 1) / 2, 1);
+#else
+	float3 v = vecToCam(input.worldPos);
 
+#ifdef PLAIN_METAL_ROUGH
 	float roughness = max(pbr.x, 0.001);
 	float metalness = pbr.y;
+#else
 	float2 mr = roughnessTex.Sample(roughnessSmplr, input.texUV).rg;
-	if (viewMode.z == 0) {
-		roughness = max(mr.g, 0.001);
-		metalness = mr.r;
-	}
+	float roughness = max(mr.g, 0.001);
+	float metalness = mr.r;
+#endif
 
 	float dielectricF0 = pbr.z;
-	float3 albd = albedo;
-	float3 texColor = FTex.Sample(FTexSmplr, input.texUV);
-	if (viewMode.w == 0) {
-		albd = texColor;
-	}
+#ifdef PLAIN_COLOR
+	float3 albd = albedo.rgb;
+#else
+	float3 albd = FTex.Sample(FTexSmplr, input.texUV).rgb;
+#endif
 
 	float3 color = CountPBRColor(input.worldPos.xyz, n, v, roughness, metalness, dielectricF0, albd);
-
-	if (viewMode.x == 1) {
-		color = (n + 1) / 2;
-	}
-	if (viewMode.x == 2) {
-		color = float3(mr.r, mr.g, 0);
-	}
-	if (viewMode.x == 3) {
-		color = texColor;
-	}
-
 	return float4(color, 1);
+#endif
+#endif
 }
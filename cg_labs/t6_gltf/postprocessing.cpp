@@ -1,65 +1,12 @@
 #include <d3dcompiler.h>
 #include <cmath>
+#include <string>
 
 #include "postprocessing.h"
+#include "ShaderLibrary.h"
+#include "../libs/ImGUI/imgui.h"
 
-HRESULT Postprocessing::CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
-{
-	HRESULT hr = S_OK;
-
-	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-	// Setting this flag improves the shader debugging experience, but still allows 
-	// the shaders to be optimized and to run exactly the way they will run in 
-	// the release configuration of this program.
-	dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-	// Disable optimizations to further improve shader debugging
-	dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-	D3DInclude includeObj;
-
-	ID3DBlob* pErrorBlob = nullptr;
-	hr = D3DCompileFromFile(szFileName, nullptr, &includeObj, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
-
-	if (FAILED(hr))
-	{
-		if (pErrorBlob)
-		{
-			OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
-			pErrorBlob->Release();
-		}
-		return hr;
-	}
-
-	if (pErrorBlob)
-		pErrorBlob->Release();
-
-	return S_OK;
-}
-
-Postprocessing::Postprocessing() : maxTextureHeight(0), maxTextureWidth(0) {}
-
-void Postprocessing::Update(
-	ID3D11Device* pDevice, 
-	ID3D11DeviceContext* pContext)
-{
-	D3D11_VIEWPORT vp = { 0 };
-	unsigned vpNum = 1;
-	pContext->RSGetViewports(&vpNum, &vp);
-	if (vp.Width != maxTextureWidth || vp.Height != maxTextureHeight)
-	{
-		clearScaledHDRTargets();
-		createDownsamplingRTT((int)vp.Width, (int)vp.Height, pDevice, pContext);
-	}
-
-
-	beginEvent(L"Clearing postprocessing RTV");
-	for (auto& rtt : scaledHDRTargets)
-		rtt->clear(1.f, 1.f, 1.f, pDevice, pContext);
-	endEvent();
-}
+Postprocessing::Postprocessing() {}
 
 HRESULT Postprocessing::Init(
 	ID3D11Device* pDevice,
@@ -68,7 +15,7 @@ HRESULT Postprocessing::Init(
 	// create pixel shaders
 	// Compile the pixel shader
 	ID3DBlob* pPSBlob = nullptr;
-	HRESULT hr = CompileShaderFromFile(L"BrightnessCalc.hlsl", "main", "ps_5_0", &pPSBlob);
+	HRESULT hr = ShaderLibrary::GetInstance().Compile(L"BrightnessCalc.hlsl", "main", "ps_5_0", &pPSBlob);
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr,
@@ -85,7 +32,7 @@ HRESULT Postprocessing::Init(
 
 	// Compile the pixel shader
 	pPSBlob = nullptr;
-	hr = CompileShaderFromFile(L"sampling_PS.hlsl", "main", "ps_5_0", &pPSBlob);
+	hr = ShaderLibrary::GetInstance().Compile(L"sampling_PS.hlsl", "main", "ps_5_0", &pPSBlob);
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr,
@@ -101,7 +48,7 @@ HRESULT Postprocessing::Init(
 
 	// Compile the pixel shader
 	pPSBlob = nullptr;
-	hr = CompileShaderFromFile(L"HDR.hlsl", "main", "ps_5_0", &pPSBlob);
+	hr = ShaderLibrary::GetInstance().Compile(L"HDR.hlsl", "main", "ps_5_0", &pPSBlob);
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr,
@@ -115,28 +62,117 @@ HRESULT Postprocessing::Init(
 	if (FAILED(hr))
 		return hr;
 	
-	// create cpu average lumen texture 
-	D3D11_TEXTURE2D_DESC td;
-	ZeroMemory(&td, sizeof(td));
-	td.Width = 1;
-	td.Height = 1;
-	td.MipLevels = 1;
-	td.ArraySize = 1;
-	td.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  td.SampleDesc.Count = 1;
-	td.SampleDesc.Quality = 0;
-	td.Usage = D3D11_USAGE_STAGING;
-	td.BindFlags = 0;
-	td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-	hr = pDevice->CreateTexture2D(&td, nullptr, &pAverageLumenCPUTexture);
+	// Compile the pixel shaders of bloom
+	const WCHAR* bloomShaders[2] = { L"BloomDownsample.hlsl", L"BloomUpsample.hlsl" };
+	ID3D11PixelShader** bloomPS[2] = { &PSBloomDownsample, &PSBloomUpsample };
+	for (int i = 0; i < 2; i++)
+	{
+		pPSBlob = nullptr;
+		hr = ShaderLibrary::GetInstance().Compile(bloomShaders[i], "main", "ps_5_0", &pPSBlob);
+		if (FAILED(hr))
+		{
+			MessageBox(nullptr,
+				L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+			return hr;
+		}
+
+		hr = pDevice->CreatePixelShader(pPSBlob->GetBufferPointer(), pPSBlob->GetBufferSize(), nullptr, bloomPS[i]);
+		pPSBlob->Release();
+		if (FAILED(hr))
+			return hr;
+	}
+
+	D3D11_BUFFER_DESC bcbd = { 0 };
+	bcbd.Usage = D3D11_USAGE_DEFAULT;
+	bcbd.ByteWidth = sizeof(BloomConstantBuffer);
+	bcbd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	hr = pDevice->CreateBuffer(&bcbd, nullptr, &pBloomConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// Compile the compute shaders of histogram metering
+	ID3DBlob* pCSBlob = nullptr;
+	hr = ShaderLibrary::GetInstance().Compile(L"LumHistogram_CS.hlsl", "main", "cs_5_0", &pCSBlob);
+	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+		return hr;
+	}
+
+	hr = pDevice->CreateComputeShader(pCSBlob->GetBufferPointer(), pCSBlob->GetBufferSize(), nullptr, &CSHistogram);
+	pCSBlob->Release();
+	if (FAILED(hr))
+		return hr;
+
+	pCSBlob = nullptr;
+	hr = ShaderLibrary::GetInstance().Compile(L"LumHistogramAverage_CS.hlsl", "main", "cs_5_0", &pCSBlob);
+	if (FAILED(hr))
+	{
+		MessageBox(nullptr,
+			L"The FX file cannot be compiled.  Please run this executable from the directory that contains the FX file.", L"Error", MB_OK);
+		return hr;
+	}
+
+	hr = pDevice->CreateComputeShader(pCSBlob->GetBufferPointer(), pCSBlob->GetBufferSize(), nullptr, &CSHistogramAverage);
+	pCSBlob->Release();
+	if (FAILED(hr))
+		return hr;
+
+	// Histogram bins, cleared by the average pass after every frame
+	D3D11_BUFFER_DESC hbd = { 0 };
+	hbd.Usage = D3D11_USAGE_DEFAULT;
+	hbd.ByteWidth = luminanceHistogramBins * sizeof(UINT);
+	hbd.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	hbd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+	const std::vector<UINT> zeroBins(luminanceHistogramBins, 0u);
+	D3D11_SUBRESOURCE_DATA hbData = {};
+	hbData.pSysMem = zeroBins.data();
+	hr = pDevice->CreateBuffer(&hbd, &hbData, &pHistogramBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC huav = {};
+	huav.Format = DXGI_FORMAT_R32_TYPELESS;
+	huav.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	huav.Buffer.NumElements = luminanceHistogramBins;
+	huav.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_RAW;
+	hr = pDevice->CreateUnorderedAccessView(pHistogramBuffer, &huav, &pHistogramUAV);
+	if (FAILED(hr))
+		return hr;
+
+	// 1x1 average in the same format as downsampling chain output
+	D3D11_TEXTURE2D_DESC atd;
+	ZeroMemory(&atd, sizeof(atd));
+	atd.Width = 1;
+	atd.Height = 1;
+	atd.MipLevels = 1;
+	atd.ArraySize = 1;
+	atd.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	atd.SampleDesc.Count = 1;
+	atd.Usage = D3D11_USAGE_DEFAULT;
+	atd.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	hr = pDevice->CreateTexture2D(&atd, nullptr, &pAverageLumenTexture);
+	if (FAILED(hr))
+		return hr;
+
+	hr = pDevice->CreateUnorderedAccessView(pAverageLumenTexture, nullptr, &pAverageLumenUAV);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_BUFFER_DESC hcbd = { 0 };
+	hcbd.Usage = D3D11_USAGE_DEFAULT;
+	hcbd.ByteWidth = sizeof(HistogramConstantBuffer);
+	hcbd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	hr = pDevice->CreateBuffer(&hcbd, nullptr, &pHistogramConstantBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	// create cpu average lumen textures
+	hr = lumenSlots.Init(pDevice, lumenReadbackFrames);
 	if (FAILED(hr))
 		return hr;
 
-	D3D11_VIEWPORT vp = { 0 };
-	unsigned vpNum = 1;
-	pContext->RSGetViewports(&vpNum, &vp);
-	createDownsamplingRTT((int)vp.Width, (int)vp.Height, pDevice, pContext);
-	
 	// create texture samplers for downsampling process
 	D3D11_SAMPLER_DESC sd;
 	ZeroMemory(&sd, sizeof(sd));
@@ -158,11 +194,23 @@ HRESULT Postprocessing::Init(
 	if (FAILED(hr))
 		return hr;
 
+	// For LUT and bloom: LUT edges hold the ends of shaper range, bloom taps don't wrap over screen
+	sd.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	hr = pDevice->CreateSamplerState(&sd, &pClampSamplerState);
+	if (FAILED(hr))
+		return hr;
+
+	hr = bakeTonemapLUT(pDevice, pContext);
+	if (FAILED(hr))
+		return hr;
+
 	hr = screenPlane.Init(pDevice, pContext);
 	if (FAILED(hr))
 		return hr;
 
-	const HDRConstantBuffer hdrcb = { { prevExposure, 0.f, 0.f, 0.f } };
+	const HDRConstantBuffer hdrcb = { { eyeAdaptation.GetExposure(), 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 0.f } };
 	D3D11_BUFFER_DESC hdrcbDesc = { 0 };
 	hdrcbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	hdrcbDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -178,64 +226,255 @@ HRESULT Postprocessing::Init(
 	return hr;
 }
 
-void Postprocessing::createDownsamplingRTT(
-	int width, int height,
+void Postprocessing::AddPasses(
+	RenderGraph& graph,
+	RenderGraphD3D& resources,
+	uint32_t input,
+	uint32_t output,
 	ID3D11Device* pDevice,
 	ID3D11DeviceContext* pContext)
 {
-	maxTextureHeight = height;
-	maxTextureWidth = width;
+	uint32_t meteringPass;
+	if (metering == ExposureMetering::histogram)
+	{
+		meteringPass = graph.AddPass("Luminance histogram", [this, &resources, input, pContext]() {
+			beginEvent(L"Count average brightness");
+			computeHistogram(pContext, resources.GetTexture(input));
+			readbackLuminance(pContext, pAverageLumenTexture);
+			endEvent();
+		});
+		graph.Read(meteringPass, input);
+	}
+	else
+	{
+		uint32_t average = addDownsamplePasses(graph, resources, input, pDevice, pContext);
+		meteringPass = graph.AddPass("Luminance readback", [this, &resources, average, pContext]() {
+			readbackLuminance(pContext, resources.GetTexture(average)->getTexture());
+		});
+		graph.Read(meteringPass, average);
+	}
+	graph.SetSideEffect(meteringPass);
+
+	uint32_t bloom = addBloomPasses(graph, resources, input, pDevice, pContext);
+
+	uint32_t tonemapPass = graph.AddPass("Tonemap", [this, &resources, input, bloom, output, pDevice, pContext]() {
+		RenderTargetTexture* bloomRTT = bloom != RenderGraph::invalidId ? resources.GetTexture(bloom) : nullptr;
+		applyTonemap(pDevice, pContext, resources.GetTexture(input), bloomRTT, resources.GetTexture(output));
+	});
+	graph.Read(tonemapPass, input);
+	if (bloom != RenderGraph::invalidId)
+		graph.Read(tonemapPass, bloom);
+	graph.Write(tonemapPass, output);
+}
+
+uint32_t Postprocessing::addDownsamplePasses(
+	RenderGraph& graph,
+	RenderGraphD3D& resources,
+	uint32_t input,
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext)
+{
+	RenderTargetTexture* inputRTT = resources.GetTexture(input);
+	int width = inputRTT->getWidth();
+	int height = inputRTT->getHeight();
 	int rtv_num = static_cast<int>(std::floor(std::log2(width < height ? width : height)));
-	RenderTargetTexture* rtt = new RenderTargetTexture(height, width);
-	rtt->initResource(pDevice, pContext);
-	scaledHDRTargets.push_back(rtt);
-
-	for (size_t i = 0; i <= rtv_num; ++i) {
-		int dim = (1 << (rtv_num - i));
-		rtt = new RenderTargetTexture(dim, dim);
-		rtt->initResource(pDevice, pContext);
-		scaledHDRTargets.push_back(rtt);
+
+	TransientResourceDesc desc;
+	desc.format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	// Convert input RTT into BW texture, then recursive sampling down to 1x1;
+	// every level lives only while the next one is rendered
+	uint32_t prev = input;
+	for (int i = rtv_num + 1; i >= 0; i--)
+	{
+		bool first = i == rtv_num + 1;
+		desc.width = first ? width : 1 << i;
+		desc.height = first ? height : 1 << i;
+		uint32_t level = graph.CreateResource("Brightness " + std::to_string(desc.width) + "x" + std::to_string(desc.height), desc);
+
+		ID3D11PixelShader* ps = first ? PSBrightness : PSCopy;
+		uint32_t pass = graph.AddPass(first ? "Brightness" : "Downsample", [this, &resources, prev, level, ps, pDevice, pContext]() {
+			pContext->PSSetShader(ps, nullptr, 0u);
+			processTexture(resources.GetTexture(prev), resources.GetTexture(level), pDevice, pContext);
+		});
+		graph.Read(pass, prev);
+		graph.Write(pass, level);
+		prev = level;
 	}
+
+	return prev;
 }
 
-HRESULT Postprocessing::applyTonemapEffect(
+uint32_t Postprocessing::addBloomPasses(
+	RenderGraph& graph,
+	RenderGraphD3D& resources,
+	uint32_t input,
 	ID3D11Device* pDevice,
-	ID3D11DeviceContext* pContext,
-	RenderTargetTexture* inputRTT,
-	RenderTargetTexture* resultRTT)
+	ID3D11DeviceContext* pContext)
 {
-	beginEvent(L"Count average brightness");
+	RenderTargetTexture* inputRTT = resources.GetTexture(input);
+	bloomPlan = PlanBloom(bloomSettings, (uint32_t)inputRTT->getWidth(), (uint32_t)inputRTT->getHeight());
+	if (!bloomSettings.enabled || bloomSettings.intensity <= 0.0f)
+		return RenderGraph::invalidId;
+
+	TransientResourceDesc desc;
+	desc.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	// Downsample levels stay alive until their upsample, upsample results only until the next one
+	std::vector<uint32_t> levels(bloomPlan.levels + 1);
+	uint32_t up = RenderGraph::invalidId;
+	for (const BloomPassDesc& pass : bloomPlan.passes)
+	{
+		desc.width = pass.width;
+		desc.height = pass.height;
+		std::string size = std::to_string(pass.width) + "x" + std::to_string(pass.height);
 
-	// Convert input RTT into BW texture
-	pContext->PSSetShader(PSBrightness, nullptr, 0u);
-	processTexture(inputRTT, scaledHDRTargets[0], pDevice, pContext);
+		uint32_t source, level = RenderGraph::invalidId, result;
+		const char* name;
+		if (pass.kind == BloomPassDesc::Kind::upsample)
+		{
+			source = up == RenderGraph::invalidId ? levels[pass.level + 1] : up;
+			level = levels[pass.level];
+			result = up = graph.CreateResource("Bloom up " + size, desc);
+			name = "Bloom upsample";
+		}
+		else
+		{
+			source = pass.kind == BloomPassDesc::Kind::prefilter ? input : levels[pass.level - 1];
+			result = levels[pass.level] = graph.CreateResource("Bloom " + size, desc);
+			name = pass.kind == BloomPassDesc::Kind::prefilter ? "Bloom prefilter" : "Bloom downsample";
+		}
+
+		uint32_t graphPass = graph.AddPass(name, [this, &resources, pass, source, level, result, pDevice, pContext]() {
+			RenderTargetTexture* levelRTT = level != RenderGraph::invalidId ? resources.GetTexture(level) : nullptr;
+			applyBloomPass(pass, resources.GetTexture(source), levelRTT, resources.GetTexture(result), pDevice, pContext);
+		});
+		graph.Read(graphPass, source);
+		if (level != RenderGraph::invalidId)
+			graph.Read(graphPass, level);
+		graph.Write(graphPass, result);
+	}
 
-	// Recursive sampling texture
-	pContext->PSSetShader(PSCopy, nullptr, 0u);
-	for (size_t i = 1; i < scaledHDRTargets.size(); i++)
-		processTexture(scaledHDRTargets[i - 1], scaledHDRTargets[i], pDevice, pContext);
+	// Without levels below base the prefiltered level is the result
+	return up != RenderGraph::invalidId ? up : levels[0];
+}
 
-	// Get average brightness of inputed texture
+void Postprocessing::applyBloomPass(
+	const BloomPassDesc& pass,
+	RenderTargetTexture* sourceRTT,
+	RenderTargetTexture* levelRTT,
+	RenderTargetTexture* resultRTT,
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext)
+{
+	bool prefilter = pass.kind == BloomPassDesc::Kind::prefilter;
+	float threshold = bloomSettings.threshold * eyeAdaptation.GetExposure();
+
+	BloomConstantBuffer bcb;
+	bcb.sourceTexel = DirectX::XMFLOAT4(1.0f / sourceRTT->getWidth(), 1.0f / sourceRTT->getHeight(), bloomSettings.radius, 0.f);
+	bcb.prefilter = DirectX::XMFLOAT4(threshold, bloomSettings.knee, prefilter ? 1.f : 0.f,
+		bloomSettings.downsample == BloomDownsample::dualKawase ? 1.f : 0.f);
+	pContext->UpdateSubresource(pBloomConstantBuffer, 0, nullptr, &bcb, 0, 0);
+
+	beginEvent(prefilter ? L"Bloom prefilter" : (levelRTT ? L"Bloom upsample" : L"Bloom downsample"));
+	pContext->PSSetShader(levelRTT ? PSBloomUpsample : PSBloomDownsample, nullptr, 0u);
+	pContext->PSSetConstantBuffers(0u, 1u, &pBloomConstantBuffer);
+
+	// Level could still be bound as render target of its downsample pass
+	ID3D11ShaderResourceView* pLevelSRV = levelRTT ? levelRTT->getSRV() : nullptr;
 	pContext->OMSetRenderTargets(0, nullptr, nullptr);
-	resultRTT->set(pDevice, pContext);
+	pContext->PSSetShaderResources(1u, 1u, &pLevelSRV);
+	processTexture(sourceRTT, resultRTT, pDevice, pContext, pClampSamplerState);
+
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	pContext->PSSetShaderResources(1u, 1u, &nullSRV);
+	endEvent();
+}
+
+void Postprocessing::readbackLuminance(
+	ID3D11DeviceContext* pContext,
+	ID3D11Resource* pAverageLumen)
+{
+	double time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	ReadbackResult lumen;
+	if (lumenReadback.Poll(lumenSlots, frameIndex, lumen))
+	{
+		eyeAdaptation.SetMeasurement(std::exp(lumen.value) - 1.0f, (float)(time - lumen.submitTime));
+		lumenLatencyFrames = lumen.latencyFrames;
+	}
 
-	D3D11_MAPPED_SUBRESOURCE averageTextureData;
-	ZeroMemory(&averageTextureData, sizeof(averageTextureData));
-	scaledHDRTargets.back()->copyToTexture(pAverageLumenCPUTexture, pDevice, pContext);
+	lumenSlots.SetSource(pContext, pAverageLumen);
+	lumenReadback.Submit(lumenSlots, frameIndex, time);
+	frameIndex++;
+}
 
-	HRESULT hr = pContext->Map(pAverageLumenCPUTexture, 0, D3D11_MAP_READ, 0, &averageTextureData);
-	float averageLogBrightness = std::exp(*(float*)averageTextureData.pData) - 1.0f;
-	pContext->Unmap(pAverageLumenCPUTexture, 0u);
+HRESULT Postprocessing::bakeTonemapLUT(
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext)
+{
+	UINT oldSize = tonemapLUT.GetTexels().empty() ? 0 : tonemapLUT.GetParams().size;
+	tonemapLUT.Bake(tonemapParams);
+	tonemapLUTError = tonemapLUT.MeasureError();
+	tonemapLUTDirty = false;
+
+	UINT size = tonemapLUT.GetParams().size;
+	std::vector<uint16_t> halfs(tonemapLUT.GetTexels().size());
+	HDRFormatEncoder::FloatToHalf(tonemapLUT.GetTexels().data(), halfs.data(), halfs.size());
 
-	// Make exposuring with EyeAdaptation
+	UINT rowPitch = size * 4 * sizeof(uint16_t);
+	if (pTonemapLUTTexture && oldSize == size)
+	{
+		pContext->UpdateSubresource(pTonemapLUTTexture, 0, nullptr, halfs.data(), rowPitch, rowPitch * size);
+		return S_OK;
+	}
+
+	if (pTonemapLUTSRV) pTonemapLUTSRV->Release();
+	if (pTonemapLUTTexture) pTonemapLUTTexture->Release();
+	pTonemapLUTSRV = nullptr;
+	pTonemapLUTTexture = nullptr;
+
+	D3D11_TEXTURE3D_DESC ltd = {};
+	ltd.Width = size;
+	ltd.Height = size;
+	ltd.Depth = size;
+	ltd.MipLevels = 1;
+	ltd.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	ltd.Usage = D3D11_USAGE_DEFAULT;
+	ltd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA ltData = {};
+	ltData.pSysMem = halfs.data();
+	ltData.SysMemPitch = rowPitch;
+	ltData.SysMemSlicePitch = rowPitch * size;
+	HRESULT hr = pDevice->CreateTexture3D(&ltd, &ltData, &pTonemapLUTTexture);
+	if (FAILED(hr))
+		return hr;
+
+	return pDevice->CreateShaderResourceView(pTonemapLUTTexture, nullptr, &pTonemapLUTSRV);
+}
+
+HRESULT Postprocessing::applyTonemap(
+	ID3D11Device* pDevice,
+	ID3D11DeviceContext* pContext,
+	RenderTargetTexture* inputRTT,
+	RenderTargetTexture* bloomRTT,
+	RenderTargetTexture* resultRTT)
+{
+	// Make exposuring with EyeAdaptation, its time is shortened by readback latency
 	const auto old = last;
 	last = std::chrono::steady_clock::now();
 	float duration = std::chrono::duration<float>(last - old).count();
+	float exposure = eyeAdaptation.Update(duration);
 
-	float expGain = (1 - std::exp(-duration / eyeAdaptationS));
-	prevExposure += (averageLogBrightness - prevExposure) * expGain;
-
-	endEvent();
+	if (tonemapLUTDirty)
+	{
+		HRESULT hr = bakeTonemapLUT(pDevice, pContext);
+		if (FAILED(hr))
+			return hr;
+	}
 
 	// Implementing tonemap
 	beginEvent(L"Apply tonemap");
@@ -245,27 +484,151 @@ HRESULT Postprocessing::applyTonemapEffect(
 	// Update data in buffer
 	// Get the view matrix
 	D3D11_MAPPED_SUBRESOURCE subresource;
-	hr = pContext->Map(PSConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+	HRESULT hr = pContext->Map(PSConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
 	if (FAILED(hr))
 		return FAILED(hr);
 
 	HDRConstantBuffer& sceneBuffer = *reinterpret_cast<HDRConstantBuffer*>(subresource.pData);
-	sceneBuffer.averageLumen = DirectX::XMFLOAT4(prevExposure, 0.f, 0.f, 0.f);
+	const TonemapLUTParams& lutParams = tonemapLUT.GetParams();
+	sceneBuffer.averageLumen = DirectX::XMFLOAT4(exposure, 0.f, 0.f, 0.f);
+	sceneBuffer.lutParams = DirectX::XMFLOAT4(lutParams.minLog2, 1.0f / (lutParams.maxLog2 - lutParams.minLog2), (float)lutParams.size, 0.f);
+	float bloomIntensity = bloomRTT ? bloomSettings.intensity / (bloomPlan.levels + 1) : 0.f;
+	sceneBuffer.bloomParams = DirectX::XMFLOAT4(bloomIntensity, 0.f, 0.f, 0.f);
 	pContext->Unmap(PSConstantBuffer, 0);
 
+	ID3D11ShaderResourceView* pSRVs[2] = { pTonemapLUTSRV, bloomRTT ? bloomRTT->getSRV() : nullptr };
 	pContext->PSSetConstantBuffers(0u, 1u, &PSConstantBuffer);
+	pContext->PSSetShaderResources(1u, 2u, pSRVs);
+	pContext->PSSetSamplers(1u, 1u, &pClampSamplerState);
 	processTexture(inputRTT, resultRTT, pDevice, pContext);
 
+	ID3D11ShaderResourceView* nullSRVs[2] = { nullptr, nullptr };
+	pContext->PSSetShaderResources(1u, 2u, nullSRVs);
+
 	endEvent();
 
 	return hr;
 }
 
+void Postprocessing::computeHistogram(
+	ID3D11DeviceContext* pContext,
+	RenderTargetTexture* inputRTT)
+{
+	UINT width = (UINT)inputRTT->getWidth();
+	UINT height = (UINT)inputRTT->getHeight();
+	float range = max(histogramParams.maxLog2Lum - histogramParams.minLog2Lum, 1e-3f);
+
+	HistogramConstantBuffer hcb;
+	hcb.binsParams = DirectX::XMFLOAT4(histogramParams.minLog2Lum, (luminanceHistogramBins - 1) / range, histogramParams.centerWeight, 0.f);
+	hcb.percentiles = DirectX::XMFLOAT4(histogramParams.lowPercentile, histogramParams.highPercentile, 0.f, 0.f);
+	hcb.inputSize = DirectX::XMUINT4(width, height, 0u, 0u);
+	pContext->UpdateSubresource(pHistogramConstantBuffer, 0, nullptr, &hcb, 0, 0);
+
+	ID3D11ShaderResourceView* pSRV = inputRTT->getSRV();
+	ID3D11UnorderedAccessView* pUAVs[2] = { pHistogramUAV, pAverageLumenUAV };
+	pContext->CSSetConstantBuffers(0, 1, &pHistogramConstantBuffer);
+	pContext->CSSetShaderResources(0, 1, &pSRV);
+	pContext->CSSetUnorderedAccessViews(0, 2, pUAVs, nullptr);
+
+	pContext->CSSetShader(CSHistogram, nullptr, 0u);
+	pContext->Dispatch((width + 15) / 16, (height + 15) / 16, 1);
+
+	pContext->CSSetShader(CSHistogramAverage, nullptr, 0u);
+	pContext->Dispatch(1, 1, 1);
+
+	// Unbind for the tonemap pass
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	ID3D11UnorderedAccessView* nullUAVs[2] = { nullptr, nullptr };
+	pContext->CSSetShaderResources(0, 1, &nullSRV);
+	pContext->CSSetUnorderedAccessViews(0, 2, nullUAVs, nullptr);
+	pContext->CSSetShader(nullptr, nullptr, 0u);
+}
+
+void Postprocessing::RenderGUI()
+{
+	ImGui::Begin("Postprocessing");
+
+	ImGui::Text("Exposure metering");
+	ImGui::RadioButton("Histogram", reinterpret_cast<int*>(&metering), static_cast<int>(ExposureMetering::histogram));
+	ImGui::SameLine();
+	ImGui::RadioButton("Downsampling", reinterpret_cast<int*>(&metering), static_cast<int>(ExposureMetering::downsample));
+	if (metering == ExposureMetering::histogram)
+	{
+		ImGui::SliderFloat("Low percentile", &histogramParams.lowPercentile, 0.0f, 1.0f);
+		ImGui::SliderFloat("High percentile", &histogramParams.highPercentile, 0.0f, 1.0f);
+		ImGui::SliderFloat("Center weight", &histogramParams.centerWeight, 0.0f, 1.0f);
+		ImGui::SliderFloat("Min log2 luminance", &histogramParams.minLog2Lum, -20.0f, 0.0f);
+		ImGui::SliderFloat("Max log2 luminance", &histogramParams.maxLog2Lum, 0.0f, 20.0f);
+	}
+
+	float adaptationS = eyeAdaptation.GetAdaptationTime();
+	if (ImGui::SliderFloat("Eye adaptation (s)", &adaptationS, 0.0f, 5.0f))
+		eyeAdaptation.SetAdaptationTime(adaptationS);
+	bool compensate = eyeAdaptation.IsLatencyCompensated();
+	if (ImGui::Checkbox("Compensate readback latency", &compensate))
+		eyeAdaptation.SetLatencyCompensation(compensate);
+	ImGui::Text("Exposure lum %.3f, readback %u frames (%.1f ms)", eyeAdaptation.GetExposure(), lumenLatencyFrames,
+		eyeAdaptation.GetLatency() * 1000.0f);
+
+	ImGui::Separator();
+	ImGui::Checkbox("Bloom", &bloomSettings.enabled);
+	if (bloomSettings.enabled)
+	{
+		ImGui::RadioButton("Half", reinterpret_cast<int*>(&bloomSettings.resolution), static_cast<int>(BloomResolution::half));
+		ImGui::SameLine();
+		ImGui::RadioButton("Quarter", reinterpret_cast<int*>(&bloomSettings.resolution), static_cast<int>(BloomResolution::quarter));
+		ImGui::SameLine();
+		ImGui::RadioButton("Eighth", reinterpret_cast<int*>(&bloomSettings.resolution), static_cast<int>(BloomResolution::eighth));
+		const char* kernels[] = { "13 taps", "Dual Kawase" };
+		ImGui::Combo("Downsample", reinterpret_cast<int*>(&bloomSettings.downsample), kernels, 2);
+		int levels = (int)bloomSettings.levels;
+		if (ImGui::SliderInt("Levels", &levels, 0, 8))
+			bloomSettings.levels = (uint32_t)levels;
+		ImGui::SliderFloat("Threshold", &bloomSettings.threshold, 0.0f, 16.0f);
+		ImGui::SliderFloat("Knee", &bloomSettings.knee, 0.0f, 1.0f);
+		ImGui::SliderFloat("Intensity", &bloomSettings.intensity, 0.0f, 1.0f);
+		ImGui::SliderFloat("Radius", &bloomSettings.radius, 0.5f, 2.0f);
+		ImGui::SliderFloat("Pass budget (Mtaps)", &bloomSettings.passBudgetMTaps, 0.0f, 32.0f);
+		ImGui::Text("1/%d resolution, %u levels, %zu passes, max pass %.2f Mtaps, total %.2f Mtaps%s", 1 << (int)bloomPlan.resolution,
+			bloomPlan.levels, bloomPlan.passes.size(), bloomPlan.maxPassCost / 1e6, bloomPlan.totalCost / 1e6,
+			bloomPlan.budgetLimited ? ", over budget" : "");
+	}
+
+	ImGui::Separator();
+	ImGui::Text("Tonemapping");
+	bool changed = false;
+	const char* operators[] = { "ACES fitted", "AgX", "Reinhard extended", "Uncharted2" };
+	if (ImGui::Combo("Operator", reinterpret_cast<int*>(&tonemapParams.op), operators, 4))
+	{
+		tonemapParams.exposureBias = TonemapLUTParams::DefaultExposureBias(tonemapParams.op);
+		changed = true;
+	}
+	const char* outputs[] = { "Gamma 2.2", "sRGB" };
+	changed |= ImGui::Combo("Output", reinterpret_cast<int*>(&tonemapParams.output), outputs, 2);
+	int lutSize = tonemapParams.size == 64 ? 1 : 0;
+	if (ImGui::Combo("LUT size", &lutSize, "32\0" "64\0"))
+	{
+		tonemapParams.size = lutSize == 1 ? 64 : 32;
+		changed = true;
+	}
+	changed |= ImGui::SliderFloat("Exposure bias", &tonemapParams.exposureBias, 0.25f, 16.0f);
+	if (tonemapParams.op == TonemapOperator::reinhardExtended || tonemapParams.op == TonemapOperator::uncharted2)
+		changed |= ImGui::SliderFloat("White point", &tonemapParams.whitePoint, 1.0f, 20.0f);
+	changed |= ImGui::ColorEdit3("White balance", tonemapParams.grading.whiteBalance);
+	changed |= ImGui::SliderFloat("Saturation", &tonemapParams.grading.saturation, 0.0f, 2.0f);
+	changed |= ImGui::SliderFloat("Contrast", &tonemapParams.grading.contrast, 0.5f, 2.0f);
+	tonemapLUTDirty |= changed;
+	ImGui::Text("LUT %u^3 baked in %.2f ms, max error %.4f", tonemapLUT.GetParams().size, tonemapLUT.GetBakeMs(), tonemapLUTError);
+
+	ImGui::End();
+}
+
 void Postprocessing::processTexture(
 	RenderTargetTexture* inputTex,
 	RenderTargetTexture* resultTex,
 	ID3D11Device* pDevice,
-	ID3D11DeviceContext* pContext)
+	ID3D11DeviceContext* pContext,
+	ID3D11SamplerState* pSampler)
 {
 	ID3D11ShaderResourceView* const pSRV[1] = { nullptr };
 	
@@ -274,31 +637,102 @@ void Postprocessing::processTexture(
 
 	inputTex->setAsResource(pDevice, pContext);
 	resultTex->set(pDevice, pContext);
-	pContext->PSSetSamplers(0, 1, &pSamplerState);
+	pContext->PSSetSamplers(0, 1, pSampler ? &pSampler : &pSamplerState);
 
 	screenPlane.setVS(pDevice, pContext);
 	screenPlane.Render(pDevice, pContext);
 }
 
 void Postprocessing::Release() {
-	clearScaledHDRTargets();
-	
 	if (PSConstantBuffer) PSConstantBuffer->Release();
 
 	screenPlane.Release();
 
 	if (pSamplerState) pSamplerState->Release();
-
-	if (pAverageLumenCPUTexture) pAverageLumenCPUTexture->Release();
-
+	if (pClampSamplerState) pClampSamplerState->Release();
+	if (pTonemapLUTSRV) pTonemapLUTSRV->Release();
+	if (pTonemapLUTTexture) pTonemapLUTTexture->Release();
+
+	lumenSlots.Release();
+
+	if (pHistogramConstantBuffer) pHistogramConstantBuffer->Release();
+	if (pAverageLumenUAV) pAverageLumenUAV->Release();
+	if (pAverageLumenTexture) pAverageLumenTexture->Release();
+	if (pHistogramUAV) pHistogramUAV->Release();
+	if (pHistogramBuffer) pHistogramBuffer->Release();
+	if (CSHistogramAverage) CSHistogramAverage->Release();
+	if (CSHistogram) CSHistogram->Release();
+
+	if (pBloomConstantBuffer) pBloomConstantBuffer->Release();
+	if (PSBloomUpsample) PSBloomUpsample->Release();
+	if (PSBloomDownsample) PSBloomDownsample->Release();
 	if (PSHdr) PSHdr->Release();
 	if (PSCopy) PSCopy->Release();
 	if (PSBrightness) PSBrightness->Release();
 }
 
-void Postprocessing::clearScaledHDRTargets() {
-	for (size_t i = 0; i < scaledHDRTargets.size(); i++) {
-		delete scaledHDRTargets[i];
+
+HRESULT Postprocessing::LuminanceReadbackSlots::Init(ID3D11Device* pDevice, UINT count) {
+	D3D11_TEXTURE2D_DESC td;
+	ZeroMemory(&td, sizeof(td));
+	td.Width = 1;
+	td.Height = 1;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	td.SampleDesc.Count = 1;
+	td.SampleDesc.Quality = 0;
+	td.Usage = D3D11_USAGE_STAGING;
+	td.BindFlags = 0;
+	td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+	D3D11_QUERY_DESC qd = {};
+	qd.Query = D3D11_QUERY_EVENT;
+
+	textures.assign(count, nullptr);
+	queries.assign(count, nullptr);
+	for (UINT i = 0; i < count; i++) {
+		HRESULT hr = pDevice->CreateTexture2D(&td, nullptr, &textures[i]);
+		if (FAILED(hr))
+			return hr;
+
+		hr = pDevice->CreateQuery(&qd, &queries[i]);
+		if (FAILED(hr))
+			return hr;
 	}
-	scaledHDRTargets.clear();
+
+	return S_OK;
+}
+
+void Postprocessing::LuminanceReadbackSlots::Release() {
+	for (auto texture : textures)
+		if (texture) texture->Release();
+	for (auto query : queries)
+		if (query) query->Release();
+
+	textures.clear();
+	queries.clear();
+}
+
+void Postprocessing::LuminanceReadbackSlots::SetSource(ID3D11DeviceContext* pContext, ID3D11Resource* pSource) {
+	this->pContext = pContext;
+	this->pSource = pSource;
+}
+
+void Postprocessing::LuminanceReadbackSlots::Copy(uint32_t slot) {
+	pContext->CopyResource(textures[slot], pSource);
+	pContext->End(queries[slot]);
+}
+
+bool Postprocessing::LuminanceReadbackSlots::TryRead(uint32_t slot, float& value) {
+	if (pContext->GetData(queries[slot], nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	D3D11_MAPPED_SUBRESOURCE data;
+	if (pContext->Map(textures[slot], 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &data) != S_OK)
+		return false;
+
+	value = *(float*)data.pData;
+	pContext->Unmap(textures[slot], 0u);
+	return true;
 }
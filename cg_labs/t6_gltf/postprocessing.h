@@ -7,9 +7,23 @@
 
 #include "common.h"
 
+#include "Bloom.h"
 #include "D3DInclude.h"
+#include "EyeAdaptation.h"
+#include "HDRFormats.h"
+#include "LuminanceHistogram.h"
+#include "ReadbackRing.h"
 #include "screenplane.h"
 #include "RenderTargetTexture.h"
+#include "RenderGraphD3D.h"
+#include "TonemapLUT.h"
+
+// Source of average scene luminance for auto exposure
+enum class ExposureMetering : int
+{
+	histogram = 0,  // log2 luminance histogram with percentile rejection, two compute passes
+	downsample = 1, // mean of log(lum + 1) over mip-like chain of render passes
+};
 
 class Postprocessing
 {
@@ -21,53 +35,150 @@ public:
 		ID3D11Device* pDevice,
 		ID3D11DeviceContext* pContext);
 
-	void Update(
+	// Declare exposure metering, bloom and tonemap passes from input HDR resource into output
+	void AddPasses(
+		RenderGraph& graph,
+		RenderGraphD3D& resources,
+		uint32_t input,
+		uint32_t output,
 		ID3D11Device* pDevice,
 		ID3D11DeviceContext* pContext);
 
-	HRESULT applyTonemapEffect(
-		ID3D11Device* pDevice,
-		ID3D11DeviceContext* pContext,
-		RenderTargetTexture* inputRTT,
-		RenderTargetTexture* resultRTT);
+	void RenderGUI();
 
 	void Release();
 private:
-	HRESULT CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
+	// Staging textures with event queries, slots of luminance readback ring
+	class LuminanceReadbackSlots : public ReadbackSlots {
+	public:
+		HRESULT Init(ID3D11Device* pDevice, UINT count);
+		void Release();
+
+		// Texture copied by the next Copy calls
+		void SetSource(ID3D11DeviceContext* pContext, ID3D11Resource* pSource);
 
-	void clearScaledHDRTargets();
+		void Copy(uint32_t slot) override;
+		bool TryRead(uint32_t slot, float& value) override;
 
-	void createDownsamplingRTT(
-		int width, int height,
+	private:
+		std::vector<ID3D11Texture2D*> textures;
+		std::vector<ID3D11Query*> queries;
+		ID3D11DeviceContext* pContext = nullptr;
+		ID3D11Resource* pSource = nullptr;
+	};
+
+	// Mean of log(lum + 1) by downsampling to 1x1, returns graph resource of the last level
+	uint32_t addDownsamplePasses(
+		RenderGraph& graph,
+		RenderGraphD3D& resources,
+		uint32_t input,
 		ID3D11Device* pDevice,
 		ID3D11DeviceContext* pContext);
 
+	// Bloom chain of pooled levels by bloomPlan, returns graph resource of the result
+	// or RenderGraph::invalidId if bloom is disabled
+	uint32_t addBloomPasses(
+		RenderGraph& graph,
+		RenderGraphD3D& resources,
+		uint32_t input,
+		ID3D11Device* pDevice,
+		ID3D11DeviceContext* pContext);
+
+	void applyBloomPass(
+		const BloomPassDesc& pass,
+		RenderTargetTexture* sourceRTT,
+		RenderTargetTexture* levelRTT,
+		RenderTargetTexture* resultRTT,
+		ID3D11Device* pDevice,
+		ID3D11DeviceContext* pContext);
+
+	// Queue copy of 1x1 average luminance, take the newest finished one
+	void readbackLuminance(
+		ID3D11DeviceContext* pContext,
+		ID3D11Resource* pAverageLumen);
+
+	// Bake tonemapLUT on CPU and upload it, 3D texture is recreated on size change
+	HRESULT bakeTonemapLUT(ID3D11Device* pDevice, ID3D11DeviceContext* pContext);
+
+	HRESULT applyTonemap(
+		ID3D11Device* pDevice,
+		ID3D11DeviceContext* pContext,
+		RenderTargetTexture* inputRTT,
+		RenderTargetTexture* bloomRTT,
+		RenderTargetTexture* resultRTT);
+
+	void computeHistogram(
+		ID3D11DeviceContext* pContext,
+		RenderTargetTexture* inputRTT);
+
 	void processTexture(
 		RenderTargetTexture* inputTex,
 		RenderTargetTexture* resultTex,
 		ID3D11Device* pDevice,
-		ID3D11DeviceContext* pContext);
+		ID3D11DeviceContext* pContext,
+		ID3D11SamplerState* pSampler = nullptr);
 
 	ID3D11PixelShader* PSBrightness;
 	ID3D11PixelShader* PSCopy;
 	ID3D11PixelShader* PSHdr;
+	ID3D11PixelShader* PSBloomDownsample = nullptr;
+	ID3D11PixelShader* PSBloomUpsample = nullptr;
+	ID3D11ComputeShader* CSHistogram = nullptr;
+	ID3D11ComputeShader* CSHistogramAverage = nullptr;
 	
 	// tonemap vars
 	ScreenPlane screenPlane;
 	ID3D11SamplerState* pSamplerState;
-	ID3D11Texture2D* pAverageLumenCPUTexture;
-	std::vector<RenderTargetTexture*> scaledHDRTargets;
-	
-	int maxTextureWidth;
-	int maxTextureHeight;
+	static const UINT lumenReadbackFrames = 3; // average luminance arrives this many frames late
+	LuminanceReadbackSlots lumenSlots;
+	ReadbackRing lumenReadback = ReadbackRing(lumenReadbackFrames);
+	uint64_t frameIndex = 0;
+	uint32_t lumenLatencyFrames = 0;
+
+	// tonemapping LUT vars
+	TonemapLUTParams tonemapParams;
+	TonemapLUT tonemapLUT;
+	bool tonemapLUTDirty = true;
+	float tonemapLUTError = 0.0f;
+	ID3D11Texture3D* pTonemapLUTTexture = nullptr;
+	ID3D11ShaderResourceView* pTonemapLUTSRV = nullptr;
+	ID3D11SamplerState* pClampSamplerState = nullptr;
+
+	// bloom vars
+	BloomSettings bloomSettings;
+	BloomPlan bloomPlan;
+	ID3D11Buffer* pBloomConstantBuffer = nullptr;
+
+	// histogram metering vars
+	ExposureMetering metering = ExposureMetering::histogram;
+	LuminanceHistogramParams histogramParams;
+	ID3D11Buffer* pHistogramBuffer = nullptr;
+	ID3D11UnorderedAccessView* pHistogramUAV = nullptr;
+	ID3D11Texture2D* pAverageLumenTexture = nullptr;
+	ID3D11UnorderedAccessView* pAverageLumenUAV = nullptr;
+	ID3D11Buffer* pHistogramConstantBuffer = nullptr;
 
 	std::chrono::steady_clock::time_point last; 
-	float prevExposure = 0;
-	const float eyeAdaptationS = .30f;
+	EyeAdaptation eyeAdaptation = EyeAdaptation(.30f);
 	ID3D11Buffer* PSConstantBuffer;
 
 	struct HDRConstantBuffer
 	{
 		DirectX::XMFLOAT4 averageLumen;
+		DirectX::XMFLOAT4 lutParams; // min log2, 1 / log2 range, LUT size
+		DirectX::XMFLOAT4 bloomParams; // intensity divided by levels count
+	};
+
+	struct BloomConstantBuffer
+	{
+		DirectX::XMFLOAT4 sourceTexel; // source texel size, upsample radius
+		DirectX::XMFLOAT4 prefilter;   // threshold, knee, is prefilter, is dual Kawase
+	};
+
+	struct HistogramConstantBuffer
+	{
+		DirectX::XMFLOAT4 binsParams;  // min log2 luminance, bins per log2 unit, center weight
+		DirectX::XMFLOAT4 percentiles; // low, high
+		DirectX::XMUINT4 inputSize;
 	};
 };
\ No newline at end of file
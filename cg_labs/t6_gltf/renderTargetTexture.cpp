@@ -1,6 +1,6 @@
 #include "renderTargetTexture.h"
 
-RenderTargetTexture::RenderTargetTexture(int width, int height) : width(width), height(height) {
+RenderTargetTexture::RenderTargetTexture(int width, int height, DXGI_FORMAT format) : width(width), height(height), format(format) {
 	vp.Width = (FLOAT)width;
 	vp.Height = (FLOAT)height;
 	vp.MinDepth = 0.0f;
@@ -21,7 +21,7 @@ HRESULT RenderTargetTexture::initResource(
 	td.Height = height;
 	td.MipLevels = 1;
 	td.ArraySize = 1;
-	td.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	td.Format = format;
 	td.SampleDesc.Count = 1;
 	td.SampleDesc.Quality = 0;
 	td.Usage = D3D11_USAGE_DEFAULT;
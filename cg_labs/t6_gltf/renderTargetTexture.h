@@ -6,7 +6,7 @@
 class RenderTargetTexture
 {
 public:
-	RenderTargetTexture(int width, int height);
+	RenderTargetTexture(int width, int height, DXGI_FORMAT format = DXGI_FORMAT_R32G32B32A32_FLOAT);
 
 	HRESULT initResource(
 		ID3D11Device* pDevice,
@@ -32,6 +32,12 @@ public:
 		ID3D11Device* pDevice,
 		ID3D11DeviceContext* pContext) const;
 
+	ID3D11Texture2D* getTexture() const { return pTexture2D; }
+	ID3D11ShaderResourceView* getSRV() const { return pShaderResourceView; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	DXGI_FORMAT getFormat() const { return format; }
+
 	void setScreenSize(int width, int height) {
 		this->width = width;
 		this->height = height;
@@ -45,6 +51,7 @@ public:
 
 private:
   int width, height;
+	DXGI_FORMAT format;
   
 	ID3D11Texture2D* pTexture2D = nullptr;
 	ID3D11RenderTargetView* pRenderTargetView = nullptr;
@@ -1,6 +1,8 @@
+#include <functional>
 #include <string>
 
 #include "renderer.h"
+#include "ShaderLibrary.h"
 
 using namespace DirectX;
 
@@ -9,14 +11,8 @@ Renderer& Renderer::GetInstance() {
   return rendererInstance;
 }
 
-HRESULT Renderer::InitDevice(const HWND& hWnd) {
-  HRESULT hr = S_OK;
-
-  RECT rc;
-  GetClientRect(hWnd, &rc);
-  UINT width = rc.right - rc.left;
-  UINT height = rc.bottom - rc.top;
-
+HRESULT Renderer::CreateDevice(const D3D_DRIVER_TYPE* driverTypes, UINT numDriverTypes) {
+  HRESULT hr = E_FAIL;
 
   // Create debug layer with DEBUG
   UINT createDeviceFlags = 0;
@@ -24,14 +20,6 @@ HRESULT Renderer::InitDevice(const HWND& hWnd) {
   createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-  D3D_DRIVER_TYPE driverTypes[] =
-  {
-      D3D_DRIVER_TYPE_HARDWARE,
-      D3D_DRIVER_TYPE_WARP,
-      D3D_DRIVER_TYPE_REFERENCE,
-  };
-  UINT numDriverTypes = ARRAYSIZE(driverTypes);
-
   D3D_FEATURE_LEVEL featureLevels[] =
   {
       D3D_FEATURE_LEVEL_11_1,
@@ -58,6 +46,25 @@ HRESULT Renderer::InitDevice(const HWND& hWnd) {
       break;
   }
 
+  return hr;
+}
+
+HRESULT Renderer::InitDevice(const HWND& hWnd) {
+  HRESULT hr = S_OK;
+
+  RECT rc;
+  GetClientRect(hWnd, &rc);
+  UINT width = rc.right - rc.left;
+  UINT height = rc.bottom - rc.top;
+
+
+  D3D_DRIVER_TYPE driverTypes[] =
+  {
+      D3D_DRIVER_TYPE_HARDWARE,
+      D3D_DRIVER_TYPE_WARP,
+      D3D_DRIVER_TYPE_REFERENCE,
+  };
+  hr = CreateDevice(driverTypes, ARRAYSIZE(driverTypes));
   if (FAILED(hr))
     return hr;
 
@@ -144,7 +151,7 @@ HRESULT Renderer::InitDevice(const HWND& hWnd) {
     return hr;
 
   // Create depth buffer
-  hr = InitDepthBuffer();
+  hr = InitDepthBuffer(input.GetWidth(), input.GetHeight());
   if (FAILED(hr))
     return hr;
 
@@ -186,14 +193,14 @@ HRESULT Renderer::InitDevice(const HWND& hWnd) {
   return S_OK;
 }
 
-HRESULT Renderer::InitDepthBuffer() {
+HRESULT Renderer::InitDepthBuffer(UINT width, UINT height) {
   D3D11_TEXTURE2D_DESC desc = {};
   desc.Format = DXGI_FORMAT_D32_FLOAT;
   desc.ArraySize = 1;
   desc.MipLevels = 1;
   desc.Usage = D3D11_USAGE_DEFAULT;
-  desc.Height = input.GetHeight();
-  desc.Width = input.GetWidth();
+  desc.Height = height;
+  desc.Width = width;
   desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
   desc.CPUAccessFlags = 0;
   desc.MiscFlags = 0;
@@ -245,6 +252,7 @@ void Renderer::EnableDepth(bool state)
 }
 
 HRESULT Renderer::Init(const HWND& hWnd, const HINSTANCE& hInstance, UINT screenWidth, UINT screenHeight) {
+  TRACE_SCOPE("Renderer init");
   HRESULT hr = input.InitInputs(hInstance, hWnd, screenWidth, screenHeight);
   if (FAILED(hr))
     return hr;
@@ -271,13 +279,24 @@ HRESULT Renderer::Init(const HWND& hWnd, const HINSTANCE& hInstance, UINT screen
     return hr;
   pSwapChain->Present(0, 0);
 
+  // Stale shaders of the last runs are rebuilt in parallel before scene and postprocessing request them
+  ShaderLibrary::GetInstance().Warmup();
+
 #ifdef _DEBUG
   hr = DebugEvents::GetInstance().Init(pImmediateContext);
   if (FAILED(hr))
     return hr;
 #endif
 
-  hr = sc.Init(pd3dDevice, pImmediateContext, screenWidth, screenHeight);
+#ifdef PROFILER_ENABLED
+  hr = gpuProfiler.Init(pd3dDevice, pImmediateContext);
+  if (FAILED(hr))
+    return hr;
+  Profiler::GetInstance().SetGpuTimer(&gpuProfiler);
+#endif
+
+  gfxDevice.Init(pd3dDevice, pImmediateContext);
+  hr = sc.Init(pd3dDevice, pImmediateContext, gfxDevice, screenWidth, screenHeight);
   if (FAILED(hr))
     return hr;
 
@@ -296,13 +315,17 @@ void Renderer::HandleInput() {
 
 // Update frame method
 bool Renderer::Update() {
+#ifdef PROFILER_ENABLED
+  Profiler::GetInstance().BeginFrame();
+#endif
+  PROFILE_SCOPE("Update");
+
   // update inputs
   input.Update();
   
   // update camera
   HandleInput();
   camera.Update();
-  PP.Update(pd3dDevice, pImmediateContext);
 
   // Get the view matrix
   XMMATRIX mView;
@@ -318,37 +341,337 @@ bool Renderer::Update() {
 }
 
 HRESULT Renderer::Render() {
+  sc.UpdateEnvironment(pd3dDevice, pImmediateContext);
+
+  rttPool.BeginFrame();
+  BuildFrameGraph();
+  if (!frameGraph.Compile()) {
+    OutputDebugStringA(("Frame graph: " + frameGraph.GetError() + "\n").c_str());
+    return E_FAIL;
+  }
+  if (!frameGraph.Execute(graphResources)) {
+    OutputDebugStringA(("Frame graph: " + frameGraph.GetError() + "\n").c_str());
+    return E_FAIL;
+  }
+
+  HRESULT hr = pSwapChain->Present(0, 0);
+#ifdef PROFILER_ENABLED
+  Profiler::GetInstance().EndFrame();
+#endif
+  return hr;
+}
+
+HRESULT Renderer::InitHeadless(UINT width, UINT height, bool forceWarp) {
+  headless = true;
+
+  D3D_DRIVER_TYPE driverTypes[] =
+  {
+      D3D_DRIVER_TYPE_HARDWARE,
+      D3D_DRIVER_TYPE_WARP,
+  };
+  HRESULT hr = forceWarp ? CreateDevice(&driverTypes[1], 1) : CreateDevice(driverTypes, ARRAYSIZE(driverTypes));
+  if (FAILED(hr))
+    return hr;
+  gfxDevice.Init(pd3dDevice, pImmediateContext);
+  ShaderLibrary::GetInstance().Warmup();
+
+#ifdef _DEBUG
+  hr = DebugEvents::GetInstance().Init(pImmediateContext);
+  if (FAILED(hr))
+    return hr;
+#endif
+
+  hr = InitDepthBuffer(width, height);
+  if (FAILED(hr))
+    return hr;
+
+  pRenderedSceneTexture = new RenderTargetTexture(width, height);
+  hr = pRenderedSceneTexture->initResource(pd3dDevice, pImmediateContext, pDepthBufferDSV);
+  if (FAILED(hr))
+    return hr;
+
+  D3D11_TEXTURE2D_DESC desc = {};
+  pRenderedSceneTexture->getTexture()->GetDesc(&desc);
+  desc.Usage = D3D11_USAGE_STAGING;
+  desc.BindFlags = 0;
+  desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+  desc.MiscFlags = 0;
+  return pd3dDevice->CreateTexture2D(&desc, nullptr, &pHeadlessStaging);
+}
+
+HRESULT Renderer::RenderBatch(const BatchDesc& desc, const std::vector<size_t>& jobs, BatchOutputStats& stats) {
+  const BatchOutputSettings& output = desc.output;
+  CreateDirectoryA(output.outputDir.c_str(), nullptr);
+
+  HRESULT result = S_OK;
+  BatchOutputQueue queue(output);
+  for (size_t jobIndex : jobs) {
+    const BatchJob& job = desc.jobs[jobIndex];
+
+    sc.Release();
+    sc = Scene();
+    HRESULT hr = sc.Init(pd3dDevice, pImmediateContext, gfxDevice, output.width, output.height, job.scene);
+    if (FAILED(hr)) {
+      OutputDebugStringA(("Batch: failed to load job " + job.name + "\n").c_str());
+      result = hr;
+      continue;
+    }
+
+    for (const BatchView& view : job.views) {
+      HDRImage image;
+      hr = RenderHeadlessView(view, image);
+      if (FAILED(hr)) {
+        OutputDebugStringA(("Batch: failed to render " + job.name + "/" + view.name + "\n").c_str());
+        result = hr;
+        continue;
+      }
+
+      queue.Push(output.outputDir + "/" + job.name + "_" + view.name + ".png", std::move(image));
+    }
+  }
+
+  queue.Wait();
+  stats = queue.GetStats();
+  return stats.failed > 0 ? E_FAIL : result;
+}
+
+HRESULT Renderer::RenderHeadlessView(const BatchView& view, HDRImage& image) {
+  XMVECTOR eye = XMVectorSet(view.eye[0], view.eye[1], view.eye[2], 1.0f);
+  XMVECTOR target = XMVectorSet(view.target[0], view.target[1], view.target[2], 1.0f);
+  XMVECTOR up = XMVectorSet(view.up[0], view.up[1], view.up[2], 0.0f);
+  XMMATRIX mView = XMMatrixLookAtLH(eye, target, up);
+
+  UINT width = (UINT)pRenderedSceneTexture->getWidth();
+  UINT height = (UINT)pRenderedSceneTexture->getHeight();
+  XMMATRIX mProjection = XMMatrixPerspectiveFovLH(XMConvertToRadians(view.fovY), (FLOAT)width / (FLOAT)height, view.nearZ, view.farZ);
+
+  // IBL bake and probe captures for this view are finished before the image is taken
+  const int maxSettleFrames = 64;
+  for (int frame = 0; frame < maxSettleFrames; frame++) {
+    sc.Update(pImmediateContext, mView, mProjection, eye);
+    sc.UpdateEnvironment(pd3dDevice, pImmediateContext);
+    if (sc.IsEnvironmentSettled())
+      break;
+  }
+
   pImmediateContext->ClearState();
-  ID3D11ShaderResourceView* nullSRV = nullptr;
-  pImmediateContext->PSSetShaderResources(0, 1, &nullSRV);
   pRenderedSceneTexture->set(pd3dDevice, pImmediateContext);
-
-  beginEvent(L"Clear background");
-  
   pRenderedSceneTexture->clear(1.0f, 1.0f, 1.0f, pd3dDevice, pImmediateContext);
-  pPostProcessedTexture->clear(1.0f, 1.0f, 1.0f, pd3dDevice, pImmediateContext);
   pImmediateContext->ClearDepthStencilView(pDepthBufferDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+  EnableDepth(true);
+  sc.Render(pImmediateContext);
 
-  endEvent();
+  pImmediateContext->CopyResource(pHeadlessStaging, pRenderedSceneTexture->getTexture());
 
-  sc.Render(pImmediateContext);
+  D3D11_MAPPED_SUBRESOURCE data;
+  HRESULT hr = pImmediateContext->Map(pHeadlessStaging, 0, D3D11_MAP_READ, 0, &data);
+  if (FAILED(hr))
+    return hr;
+
+  image.Resize(width, height);
+  for (UINT y = 0; y < height; y++)
+    memcpy(image.Texel(0, y), (const uint8_t*)data.pData + (size_t)y * data.RowPitch, (size_t)width * 4 * sizeof(float));
+  pImmediateContext->Unmap(pHeadlessStaging, 0);
+  return S_OK;
+}
+
+void Renderer::BuildFrameGraph() {
+  frameGraph.Reset();
+  graphResources.Begin(pd3dDevice, pImmediateContext);
+
+  uint32_t sceneColor = frameGraph.ImportResource("Scene color");
+  graphResources.Import(sceneColor, pRenderedSceneTexture);
+  uint32_t backBuffer = frameGraph.ImportResource("Back buffer");
+  graphResources.Import(backBuffer, pPostProcessedTexture);
+  frameGraph.MarkOutput(backBuffer);
+
+  uint32_t scenePass = frameGraph.AddPass("Scene", [this]() {
+    pImmediateContext->ClearState();
+    ID3D11ShaderResourceView* nullSRV = nullptr;
+    pImmediateContext->PSSetShaderResources(0, 1, &nullSRV);
+    pRenderedSceneTexture->set(pd3dDevice, pImmediateContext);
+
+    beginEvent(L"Clear background");
+
+    pRenderedSceneTexture->clear(1.0f, 1.0f, 1.0f, pd3dDevice, pImmediateContext);
+    pImmediateContext->ClearDepthStencilView(pDepthBufferDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+
+    endEvent();
+
+    sc.Render(pImmediateContext);
+  });
+  frameGraph.Write(scenePass, sceneColor);
 
-  PP.applyTonemapEffect(pd3dDevice, pImmediateContext, pRenderedSceneTexture, pPostProcessedTexture);
+  PP.AddPasses(frameGraph, graphResources, sceneColor, backBuffer, pd3dDevice, pImmediateContext);
 
-  PrepairImGuiFrame();
-  sc.RenderGUI();
-  RenderImGuiFrames();
+  // GUI is drawn over the tonemapped image
+  uint32_t guiPass = frameGraph.AddPass("GUI", [this]() {
+    pPostProcessedTexture->set(pd3dDevice, pImmediateContext);
 
-  return pSwapChain->Present(0, 0);
+    PrepairImGuiFrame();
+    sc.RenderGUI();
+    PP.RenderGUI();
+    RenderGraphGUI();
+    ProfilerGUI();
+    RenderImGuiFrames();
+  });
+  frameGraph.Write(guiPass, backBuffer);
 }
 
-void Renderer::CleanupDevice() {
-  ReleaseImGui();
+void Renderer::RenderGraphGUI() {
+  ImGui::Begin("Frame graph");
+
+  const std::vector<uint32_t>& order = frameGraph.GetOrder();
+  for (uint32_t pos = 0; pos < order.size(); pos++)
+    ImGui::Text("%u. %s (%u barriers)", pos, frameGraph.GetPassName(order[pos]).c_str(),
+      (unsigned)frameGraph.GetBarriers(order[pos]).size());
+  for (uint32_t pass = 0; pass < frameGraph.GetPassCount(); pass++)
+    if (frameGraph.IsCulled(pass))
+      ImGui::Text("   %s (culled)", frameGraph.GetPassName(pass).c_str());
+
+  const TransientPoolStats& poolStats = rttPool.GetStats();
+  ImGui::Text("Render target pool: %u textures (%u in use), %.2f MB, peak %.2f MB", poolStats.resources, poolStats.inUse,
+    poolStats.bytes / (1024.0 * 1024.0), poolStats.peakBytes / (1024.0 * 1024.0));
+  ImGui::Text("  hits %llu, misses %llu, aliased %llu, evicted %llu, frame without pool %.2f MB",
+    (unsigned long long)poolStats.hits, (unsigned long long)poolStats.misses, (unsigned long long)poolStats.aliases,
+    (unsigned long long)poolStats.evictions, poolStats.frameRequestedBytes / (1024.0 * 1024.0));
+
+  // Model submission through the gfx context since the last GUI frame
+  IGfxContext& gfxContext = gfxDevice.GetContext();
+  const GfxContextStats& gfxStats = gfxContext.GetStats();
+  ImGui::Text("Gfx context: %llu calls, %llu draws, %llu state changes, %llu redundant skipped, %.1f KB uploaded",
+    (unsigned long long)gfxStats.calls, (unsigned long long)gfxStats.draws, (unsigned long long)gfxStats.stateChanges,
+    (unsigned long long)gfxStats.redundantSkipped, gfxStats.bytesUploaded / 1024.0);
+  gfxContext.ResetStats();
+
+  ImGui::End();
+}
+
+void Renderer::ProfilerGUI() {
+  ImGui::Begin("Profiler");
+
+  // Timeline capture for chrome://tracing or ui.perfetto.dev, works in every build
+  TraceRecorder& trace = TraceRecorder::GetInstance();
+  TraceStats traceStats = trace.GetStats();
+  if (!trace.IsRecording()) {
+    if (ImGui::Button("Start trace"))
+      trace.Start();
+  }
+  else if (ImGui::Button("Stop and save trace.json")) {
+    trace.Stop();
+    trace.ExportChromeTrace("trace.json");
+  }
+  ImGui::SameLine();
+  ImGui::Text("%u threads, %llu scopes, %llu overwritten", traceStats.threads,
+    (unsigned long long)traceStats.recorded, (unsigned long long)traceStats.overwritten);
+  ImGui::Separator();
+
+#ifndef PROFILER_ENABLED
+  ImGui::Text("Scopes are compiled out, build with PROFILER_ENABLED");
+#else
+  Profiler& profiler = Profiler::GetInstance();
+  ImGui::Text("Frame %llu, GPU results %u frames late, %u threads", (unsigned long long)profiler.GetFrameIndex(),
+    profiler.GetGpuLatency(), profiler.GetThreadCount());
+
+  // Percentiles of scope totals per frame, children are indented under parents
+  if (ImGui::CollapsingHeader("Scopes", ImGuiTreeNodeFlags_DefaultOpen)) {
+    ImGui::Columns(3, "profilerScopes");
+    ImGui::Text("Scope"); ImGui::NextColumn();
+    ImGui::Text("CPU ms p50 / p95 / p99"); ImGui::NextColumn();
+    ImGui::Text("GPU ms p50 / p95 / p99"); ImGui::NextColumn();
+    ImGui::Separator();
+
+    std::vector<uint32_t> order;
+    std::function<void(uint32_t)> addChildren = [&](uint32_t parent) {
+      for (uint32_t node = 0; node < profiler.GetNodeCount(); node++)
+        if (profiler.GetNode(node).parent == parent) {
+          order.push_back(node);
+          addChildren(node);
+        }
+    };
+    addChildren(~0u);
+
+    for (uint32_t node : order) {
+      ProfilerNode info = profiler.GetNode(node);
+      ProfilerStats cpu = profiler.GetCpuStats(node), gpu = profiler.GetGpuStats(node);
+      ImGui::Text("%*s%s", (int)info.depth * 2, "", info.name.c_str()); ImGui::NextColumn();
+      ImGui::Text("%.3f / %.3f / %.3f", cpu.p50, cpu.p95, cpu.p99); ImGui::NextColumn();
+      if (gpu.samples > 0)
+        ImGui::Text("%.3f / %.3f / %.3f", gpu.p50, gpu.p95, gpu.p99);
+      ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+  }
+
+  // Flame view: lane per CPU thread and GPU lane, depth goes down
+  if (ImGui::CollapsingHeader("Flame view", ImGuiTreeNodeFlags_DefaultOpen)) {
+    const std::vector<ProfilerSample>& cpuFrame = profiler.GetLastCpuFrame();
+    const std::vector<ProfilerSample>& gpuFrame = profiler.GetLastGpuFrame();
+    float frameMs = 0.001f;
+    uint32_t lanes = 1, laneDepth = 1;
+    for (const ProfilerSample& sample : cpuFrame) {
+      frameMs = max(frameMs, sample.endMs);
+      lanes = max(lanes, sample.thread + 2);
+      laneDepth = max(laneDepth, sample.depth + 1);
+    }
+    for (const ProfilerSample& sample : gpuFrame) {
+      frameMs = max(frameMs, sample.endMs);
+      laneDepth = max(laneDepth, sample.depth + 1);
+    }
+
+    const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    const float laneHeight = rowHeight * laneDepth + rowHeight;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = max(ImGui::GetContentRegionAvail().x, 100.0f);
+    float scale = width / frameMs;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    auto drawLane = [&](const std::vector<ProfilerSample>& samples, bool gpu, uint32_t lane, const char* title) {
+      float top = origin.y + lane * laneHeight;
+      drawList->AddText(ImVec2(origin.x, top), IM_COL32(255, 255, 255, 255), title);
+      for (const ProfilerSample& sample : samples) {
+        if (!gpu && sample.thread + 1 != lane)
+          continue;
+
+        ImVec2 rectMin(origin.x + sample.startMs * scale, top + rowHeight * (sample.depth + 1));
+        ImVec2 rectMax(origin.x + max(sample.endMs * scale, sample.startMs * scale + 1.0f), rectMin.y + rowHeight - 1.0f);
+        ImU32 color = ImColor::HSV((sample.node * 0.618034f) - (int)(sample.node * 0.618034f), 0.5f, 0.7f);
+        drawList->AddRectFilled(rectMin, rectMax, color);
+
+        ProfilerNode info = profiler.GetNode(sample.node);
+        if (rectMax.x - rectMin.x > ImGui::CalcTextSize(info.name.c_str()).x)
+          drawList->AddText(rectMin, IM_COL32(0, 0, 0, 255), info.name.c_str());
+        if (ImGui::IsMouseHoveringRect(rectMin, rectMax))
+          ImGui::SetTooltip("%s: %.3f ms", info.name.c_str(), sample.endMs - sample.startMs);
+      }
+    };
+
+    drawLane(gpuFrame, true, 0, "GPU");
+    for (uint32_t lane = 1; lane < lanes; lane++)
+      drawLane(cpuFrame, false, lane, (std::string("CPU thread ") + std::to_string(lane - 1)).c_str());
+    ImGui::Dummy(ImVec2(width, laneHeight * lanes));
+  }
+#endif
+
+  ImGui::End();
+}
 
-  PP.Release();
+void Renderer::CleanupDevice() {
+  // Headless mode has no ImGui and GPU postprocessing
+  if (!headless) {
+    ReleaseImGui();
+    PP.Release();
+  }
+  rttPool.Clear();
   camera.Release();
   input.Release();
   sc.Release();
+  gfxDevice.Release();
+
+#ifdef PROFILER_ENABLED
+  Profiler::GetInstance().SetGpuTimer(nullptr);
+  gpuProfiler.Release();
+#endif
 
 #ifdef _DEBUG
   DebugEvents::GetInstance().Release();
@@ -359,6 +682,7 @@ void Renderer::CleanupDevice() {
 
   if (pDepthBufferDSV) pDepthBufferDSV->Release();
   if (pDepthBuffer) pDepthBuffer->Release();
+  if (pHeadlessStaging) pHeadlessStaging->Release();
 
   if (pPostProcessedTexture)
     delete pPostProcessedTexture;
@@ -421,7 +745,7 @@ HRESULT Renderer::ResizeWindow(const HWND& hWnd) {
         sc.Resize(width, height);
       }
 
-      hr = InitDepthBuffer();
+      hr = InitDepthBuffer(width, height);
       if (FAILED(hr))
         return hr;
 
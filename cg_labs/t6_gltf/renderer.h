@@ -18,7 +18,11 @@
 #include "scene.h"
 #include "input.h"
 
+#include "BatchOutput.h"
+#include "GfxD3D11.h"
+#include "ProfilerD3D11.h"
 #include "renderTargetTexture.h"
+#include "RenderGraphD3D.h"
 #include "postprocessing.h"
 
 // Make renderer class
@@ -32,6 +36,13 @@ public:
   // Init Renderer method
   HRESULT Init(const HWND& hWnd, const HINSTANCE& g_hInstance, UINT screenWidth, UINT screenHeight);
 
+  // Device without window and swap chain for batch rendering, WARP if there is no GPU or forceWarp
+  HRESULT InitHeadless(UINT width, UINT height, bool forceWarp);
+
+  // Renders views of the jobs (indices into desc.jobs) into PNG files of desc.output.outputDir.
+  // Scene is loaded for every job, images are postprocessed on CPU while next views render.
+  HRESULT RenderBatch(const BatchDesc& desc, const std::vector<size_t>& jobs, BatchOutputStats& stats);
+
   // Update frame method
   bool Update();
 
@@ -51,14 +62,29 @@ private:
   // Private constructor (for singleton)
   Renderer() = default;
 
+  // Tries driver types in order
+  HRESULT CreateDevice(const D3D_DRIVER_TYPE* driverTypes, UINT numDriverTypes);
+
   // Initialization device method
   HRESULT InitDevice(const HWND& hWnd);
 
   // Initialization device method
-  HRESULT InitDepthBuffer();
+  HRESULT InitDepthBuffer(UINT width, UINT height);
+
+  // Scene from the view into pRenderedSceneTexture, read back to CPU
+  HRESULT RenderHeadlessView(const BatchView& view, HDRImage& image);
 
   void HandleInput();
 
+  // Declares passes of the frame into frameGraph
+  void BuildFrameGraph();
+
+  // Compiled frame graph and render target pool stats
+  void RenderGraphGUI();
+
+  // Scope percentiles and flame view of the last CPU and GPU frames
+  void ProfilerGUI();
+
   void InitImGUI(HWND window,
     ID3D11Device* pDevice,
     ID3D11DeviceContext* pContext)
@@ -101,6 +127,12 @@ private:
   
   ID3D11DeviceContext*    pImmediateContext = nullptr;
   ID3D11DeviceContext1*   pImmediateContext1 = nullptr;
+
+  // Gfx interface over pd3dDevice and pImmediateContext (used by Model)
+  GfxD3D11Device gfxDevice;
+
+  // GPU timer of Profiler (debug builds)
+  ProfilerD3D11 gpuProfiler;
   
   IDXGISwapChain*         pSwapChain = nullptr;
   IDXGISwapChain1*        pSwapChain1 = nullptr;
@@ -110,8 +142,12 @@ private:
   ID3D11DepthStencilState* pDefaultDepthState = nullptr;
   ID3D11DepthStencilState* pNoDepthState = nullptr;
 
-  RenderTargetTexture* pRenderedSceneTexture;
-  RenderTargetTexture* pPostProcessedTexture;
+  RenderTargetTexture* pRenderedSceneTexture = nullptr;
+  RenderTargetTexture* pPostProcessedTexture = nullptr;
+
+  // Batch mode: no window, ImGui, input and postprocessing on GPU
+  bool headless = false;
+  ID3D11Texture2D* pHeadlessStaging = nullptr;
 
   // initialization other things (camera, input devices, etc.)
   Camera camera;
@@ -120,4 +156,9 @@ private:
 
   // initialization postprocessing pipeline
   Postprocessing PP;
+
+  // Frame passes and their transient render targets
+  RenderTargetPool rttPool;
+  RenderGraph frameGraph;
+  RenderGraphD3D graphResources = RenderGraphD3D(rttPool);
 };
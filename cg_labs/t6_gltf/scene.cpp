@@ -1,30 +1,49 @@
 #include "scene.h"
 
-HRESULT Scene::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
+#include <fstream>
+#include <random>
+
+HRESULT Scene::Init(ID3D11Device* device, ID3D11DeviceContext* context, IGfxDevice& gfxDevice, int screenWidth, int screenHeight, const SceneDesc& desc) {
   HRESULT hr = S_OK;
+  gfx = &gfxDevice;
 
   // Init skybox
-  sb = Skybox(L"./src/envs/env_1k_4.hdr", 30, 30);
+  sb = Skybox(std::wstring(desc.environmentPath.begin(), desc.environmentPath.end()), 30, 30);
   hr = sb.Init(device, context, screenWidth, screenHeight);
   if (FAILED(hr))
     return hr;
   maps = sb.GetMaps();
+  UpdateEnvLights();
+  strncpy_s(envPath, desc.environmentPath.c_str(), _TRUNCATE);
 
   // Init model
   pbrMaterial = PBRRichMaterial(0.2, 0.3, 0.04, XMFLOAT3(1, 1, 1));
-  model = Model("./src/models/rgo/scene.gltf", "./src/models/rgo/scene.bin", sb, pbrMaterial);
+  model = Model(desc.gltfPath, desc.binPath, sb, pbrMaterial);
   //model = Model("./src/models/Fallout 10mm/scene.gltf", "./src/models/Fallout 10mm/scene.bin", sb, pbrMaterial);
-  hr = model.Init(device, context, screenWidth, screenHeight);
+  hr = model.Init(*gfx, screenWidth, screenHeight);
   if (FAILED(hr))
     return hr;
 
   // Init lights
-  lights.reserve(1);
-  lights.push_back(Light(XMFLOAT4(1.f, 0.0f, 0.0f, 0.3f), 2.0f, 2.0f, 2.0f));
-  
-  hr = lights[0].Init(device, context, screenWidth, screenHeight);
+  lights.reserve(desc.lights.size());
+  for (const SceneLightDesc& light : desc.lights) {
+    lights.push_back(Light(XMFLOAT4(light.color[0], light.color[1], light.color[2], 0.3f), light.position[0], light.position[1], light.position[2]));
+
+    hr = lights.back().Init(device, context, screenWidth, screenHeight);
+    if (FAILED(hr))
+      return hr;
+  }
+  isOff = desc.lightsIntensity <= 0.0f;
+  if (!isOff)
+    intensity = desc.lightsIntensity;
+
+  // Init reflection probes
+  probes = ReflectionProbeSystem(probesParams);
+  hr = probes.Init(device, context);
   if (FAILED(hr))
     return hr;
+  model.SetProbeMaps(probes.GetIrradianceSRV(), probes.GetPrefilteredSRV());
+  meshPositions = model.GetMeshPositions();
 
   return hr;
 }
@@ -37,6 +56,8 @@ void Scene::ProvideInput(const Input& input) {
 void Scene::Release() {
   sb.Release();
 
+  probes.Release();
+
   model.Release();
   
   for (auto& light : lights)
@@ -47,7 +68,7 @@ void Scene::Render(ID3D11DeviceContext* context) {
   sb.Render(context);
 
   beginEvent(L"Drawing model");
-  model.Render(context);
+  model.Render(gfx->GetContext());
   endEvent();
 
   for (auto& light : lights)
@@ -55,19 +76,167 @@ void Scene::Render(ID3D11DeviceContext* context) {
 }
 
 bool Scene::Update(ID3D11DeviceContext* context, XMMATRIX viewMatrix, XMMATRIX projectionMatrix, XMVECTOR cameraPos) {
-  sb.Update(context, viewMatrix, projectionMatrix, XMFLOAT3(XMVectorGetX(cameraPos), XMVectorGetY(cameraPos), XMVectorGetZ(cameraPos)));
+  frameView = viewMatrix;
+  frameProjection = projectionMatrix;
+  frameCameraPos = cameraPos;
+  XMStoreFloat3(&cameraPosition, cameraPos);
+
+  // Probes for every mesh, missing ones are requested for capture
+  probes.BeginFrame(cameraPosition);
+  std::vector<ProbeShadingData> probeShading;
+  if (useProbes)
+    for (const XMFLOAT3& pos : meshPositions)
+      probeShading.push_back(probes.GetShadingData(pos));
+  model.SetProbeShading(probeShading);
+
+  UpdateFrameConstants(context);
+  return true;
+}
 
-  model.Update(context, viewMatrix, projectionMatrix, cameraPos, lights, pbrMaterial, viewMode);
+void Scene::UpdateFrameConstants(ID3D11DeviceContext* context) {
+  sb.Update(context, frameView, frameProjection, cameraPosition);
+
+  if (useEnvLights && !envLights.empty()) {
+    shadingLights = lights;
+    shadingLights.insert(shadingLights.end(), envLights.begin(), envLights.end());
+    model.Update(gfx->GetContext(), frameView, frameProjection, frameCameraPos, CollectFrameLights(shadingLights), pbrMaterial, viewMode);
+  }
+  else
+    model.Update(gfx->GetContext(), frameView, frameProjection, frameCameraPos, CollectFrameLights(lights), pbrMaterial, viewMode);
 
   for (auto& light : lights) {
-    light.Update(context, viewMatrix, projectionMatrix, cameraPos);
+    light.Update(context, frameView, frameProjection, frameCameraPos);
     if (isOff)
       light.GetLightColorRef()->w = 0.0f;
     else
       light.GetLightColorRef()->w = intensity;
   }
-  
-  return true;
+}
+
+void Scene::RenderProbeCapture(ID3D11DeviceContext* context, XMMATRIX viewMatrix, XMMATRIX projectionMatrix, XMFLOAT3 position) {
+  XMVECTOR eye = XMLoadFloat3(&position);
+  sb.Update(context, viewMatrix, projectionMatrix, position);
+  model.Update(gfx->GetContext(), viewMatrix, projectionMatrix, eye, CollectFrameLights(useEnvLights && !envLights.empty() ? shadingLights : lights), pbrMaterial, viewMode);
+
+  sb.Render(context);
+  model.Render(gfx->GetContext());
+}
+
+const std::vector<ClusterLight>& Scene::CollectFrameLights(const std::vector<Light>& sceneLights) {
+  frameLights.clear();
+  for (const Light& light : sceneLights) {
+    XMFLOAT4 position = light.GetLightPosition(), color = light.GetLightColor();
+    ClusterLight data;
+    memcpy(data.position, &position, sizeof(position));
+    memcpy(data.color, &color, sizeof(color));
+    frameLights.push_back(data);
+  }
+  frameLights.insert(frameLights.end(), randomLights.begin(), randomLights.end());
+  return frameLights;
+}
+
+void Scene::GenerateRandomLights() {
+  // Around the center of meshes, same lights for the same params
+  XMFLOAT3 center(0, 0, 0);
+  for (const XMFLOAT3& pos : meshPositions) {
+    center.x += pos.x / meshPositions.size();
+    center.y += pos.y / meshPositions.size();
+    center.z += pos.z / meshPositions.size();
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> offset(-randomLightsArea, randomLightsArea), hue(0.0f, 1.0f);
+  randomLights.resize(randomLightsCount);
+  for (ClusterLight& light : randomLights) {
+    light.position[0] = center.x + offset(rng);
+    light.position[1] = center.y + offset(rng);
+    light.position[2] = center.z + offset(rng);
+    light.position[3] = 0.0f;
+    light.color[0] = hue(rng);
+    light.color[1] = hue(rng);
+    light.color[2] = hue(rng);
+    light.color[3] = randomLightsIntensity;
+  }
+}
+
+void Scene::AddProbeAtCamera() {
+  ReflectionProbeDesc desc;
+  const float* pos = &cameraPosition.x;
+  for (int i = 0; i < 3; i++) {
+    desc.position[i] = pos[i];
+    desc.influenceMin[i] = desc.projectionMin[i] = pos[i] - newProbeExtent;
+    desc.influenceMax[i] = desc.projectionMax[i] = pos[i] + newProbeExtent;
+  }
+  desc.blendDistance = newProbeBlend;
+  desc.priority = newProbePriority;
+  probes.GetManager().AddProbe(desc);
+}
+
+void Scene::UpdateEnvironment(ID3D11Device* device, ID3D11DeviceContext* context) {
+  if (envReloadRequested) {
+    envReloadRequested = false;
+
+    EnvLightExtractorParams params;
+    params.maxLights = (uint32_t)envLightsCount;
+    sb.SetEnvLightExtraction(extractEnvLights, params);
+    sb.SetOctahedralIBL(octahedralIBL);
+
+    std::string path(envPath);
+    HRESULT hr = sb.SetEnvironment(device, context, std::wstring(path.begin(), path.end()));
+    if (FAILED(hr))
+      OutputDebugStringA("Failed to load environment\n");
+  }
+
+  if (sb.IsEnvironmentBaking()) {
+    beginEvent(L"Environment IBL update");
+    sb.UpdateEnvironment(device, context, envBakeBudgetMs);
+    endEvent();
+  }
+  sb.PollIBLQualityReport(context);
+
+  // Octahedral maps are switched right in SetEnvironment
+  if (sb.ConsumeMapsUpdate(maps)) {
+    model.SetIBLMaps(maps);
+    UpdateEnvLights();
+    probes.GetManager().InvalidateAll();
+  }
+
+  if (probesParamsChanged) {
+    probesParamsChanged = false;
+    HRESULT hr = probes.SetParams(device, probesParams);
+    if (FAILED(hr))
+      OutputDebugStringA("Failed to resize reflection probes cache\n");
+    model.SetProbeMaps(probes.GetIrradianceSRV(), probes.GetPrefilteredSRV());
+  }
+
+  if (!useProbes)
+    return;
+
+  beginEvent(L"Reflection probes update");
+  model.EnableProbes(false);
+  HRESULT hr = probes.Update(device, context, [this](ID3D11DeviceContext* ctx, XMMATRIX view, XMMATRIX proj, XMFLOAT3 pos) {
+    RenderProbeCapture(ctx, view, proj, pos);
+  });
+  model.EnableProbes(true);
+  if (FAILED(hr))
+    OutputDebugStringA("Failed to capture reflection probe\n");
+
+  // Captures used constant buffers of the model and skybox
+  if (probes.GetLastFrameCaptures() > 0)
+    UpdateFrameConstants(context);
+  endEvent();
+}
+
+void Scene::UpdateEnvLights() {
+  envLights.clear();
+  for (const ExtractedLight& extracted : sb.GetEnvLights()) {
+    // w = 1 marks directional light, color is normalized irradiance with its scale in w
+    const float* e = extracted.irradiance;
+    float scale = max(max(e[0], e[1]), max(e[2], 1e-6f));
+    Light light(XMFLOAT4(e[0] / scale, e[1] / scale, e[2] / scale, scale));
+    *light.GetLightPositionRef() = XMFLOAT4(extracted.direction[0], extracted.direction[1], extracted.direction[2], 1.0f);
+    envLights.push_back(light);
+  }
 }
 
 void Scene::Resize(int screenWidth, int screenHeight) {
@@ -106,5 +275,117 @@ void Scene::RenderGUI() {
     ImGui::SliderFloat("Pos-Z", &lights[i].GetLightPositionRef()->z, -100.f, 100.f);
   }
 
+  ImGui::Text("Clustered lights");
+  bool randomLightsChanged = ImGui::SliderInt("Random lights", &randomLightsCount, 0, 8192);
+  randomLightsChanged |= ImGui::SliderFloat("Random lights area", &randomLightsArea, 1.0f, 100.0f);
+  randomLightsChanged |= ImGui::SliderFloat("Random lights intensity", &randomLightsIntensity, 0.0f, 10.0f);
+  if (randomLightsChanged)
+    GenerateRandomLights();
+  ClusteredLighting& clustered = model.GetClusteredLighting();
+  float cutoff = clustered.GetCutoff();
+  if (ImGui::SliderFloat("Light cutoff", &cutoff, 1e-4f, 0.1f, "%.4f", 4.0f))
+    clustered.SetCutoff(cutoff);
+  const ClusterStats& clusterStats = clustered.GetStats();
+  ImGui::Text("Directional %u, point in view %u, indices %u, max per cluster %u, %.2f ms", clusterStats.globalLights,
+    clusterStats.pointLights, clusterStats.indices, clusterStats.maxPerCluster, clusterStats.buildMs);
+
+  ImGui::Text("Draw list");
+  const GfxCommandList& drawList = model.GetCommandList();
+  GfxCommandListStats drawStats = drawList.GetStats();
+  ImGui::Text("Packets %u, commands %u, payload %u bytes", drawStats.packets, drawStats.commands, drawStats.payloadBytes);
+  // Binary stream and readable listing of the last frame, for offline analysis
+  if (ImGui::Button("Save draw list")) {
+    std::ofstream binary("draw_list.gfxc", std::ios::binary);
+    drawList.Write(binary);
+    std::ofstream listing("draw_list.txt");
+    drawList.Dump(listing);
+  }
+  GfxParallelSubmitter& submitter = model.GetSubmitter();
+  bool parallelSubmit = submitter.IsEnabled();
+  if (ImGui::Checkbox("Parallel submission", &parallelSubmit))
+    submitter.Enable(parallelSubmit);
+  float targetChunkMs = (float)submitter.GetTargetChunkMs();
+  if (ImGui::SliderFloat("Target chunk (ms)", &targetChunkMs, 0.05f, 2.0f))
+    submitter.SetTargetChunkMs(targetChunkMs);
+  const GfxParallelSubmitStats& submitStats = submitter.GetStats();
+  ImGui::Text("Chunks %u x %u packets, %.2f us per packet", submitStats.chunks, submitStats.packetsPerChunk, submitStats.packetUs);
+  ImGui::Text("Record %.3f ms, execute %.3f ms (%.2f us per list), fallback chunks %u", submitStats.recordMs, submitStats.executeMs,
+    submitStats.listUs, submitStats.fallbackChunks);
+
+  ImGui::Text("Environment");
+  ImGui::InputText("Env path", envPath, sizeof(envPath));
+  const char* formats[] = { "RGBA32F", "RGBA16F", "R11G11B10F", "RGB9E5", "BC6H" };
+  if (ImGui::Combo("Env format", reinterpret_cast<int*>(&envFormat), formats, IM_ARRAYSIZE(formats)))
+    sb.SetEnvironmentFormat(envFormat);
+  if (ImGui::Button("Load env"))
+    envReloadRequested = true;
+  const HDRFormatErrorReport& envError = sb.GetEnvironmentErrorReport();
+  ImGui::Text("Env format error: rmse %.4f, max rel %.4f", envError.rmse, envError.maxRelError);
+  ImGui::SliderFloat("IBL bake budget (ms)", &envBakeBudgetMs, 0.25f, 16.0f);
+  if (sb.IsEnvironmentBaking())
+    ImGui::ProgressBar(sb.GetEnvironmentBakeProgress());
+
+  const char* iblMapNames[] = { "Irradiance", "Prefiltered", "BRDF" };
+  bool qualityChanged = false;
+  for (int kind = 0; kind < 2; kind++) {
+    IBLSamplingQuality& quality = iblQuality.Get((IBLMapKind)kind);
+    std::string suffix = std::string("##iblQuality") + std::to_string(kind);
+    ImGui::Text("%s map sampling", iblMapNames[kind]);
+    qualityChanged |= ImGui::SliderFloat(("Target error" + suffix).c_str(), &quality.targetError, 0.0f, 0.1f);
+    qualityChanged |= ImGui::SliderInt(("Max samples" + suffix).c_str(), reinterpret_cast<int*>(&quality.maxSamples), 32, 16384);
+    qualityChanged |= ImGui::SliderFloat(("Time budget (ms)" + suffix).c_str(), &quality.timeBudgetMs, 0.0f, 1000.0f);
+  }
+  if (qualityChanged)
+    sb.SetIBLQuality(iblQuality);
+
+  const IBLBakeQualityReport& iblReport = sb.GetIBLQualityReport();
+  for (int kind = 0; kind < 3; kind++) {
+    const IBLMapQualityReport& report = iblReport.Get((IBLMapKind)kind);
+    if (report.valid)
+      ImGui::Text("%s: samples %.1f / %u, error mean %.4f max %.4f, %.2f ms", iblMapNames[kind], report.meanSamples,
+        report.samplesCap, report.meanError, report.maxError, report.gpuMs);
+  }
+
+  ImGui::Checkbox("Octahedral IBL maps", &octahedralIBL);
+  ImGui::Checkbox("Extract env lights", &extractEnvLights);
+  ImGui::SliderInt("Env lights max", &envLightsCount, 1, 4);
+  ImGui::Checkbox("Use env lights", &useEnvLights);
+  ImGui::Text("Env lights: %d (%.1f%% of energy)", (int)envLights.size(), sb.GetEnvLightsShare() * 100.0f);
+  for (const Light& light : envLights) {
+    XMFLOAT4 dir = light.GetLightPosition(), color = light.GetLightColor();
+    ImGui::Text("  dir (%.2f %.2f %.2f), irradiance %.2f", dir.x, dir.y, dir.z, color.w);
+  }
+
+  ImGui::Text("Reflection probes");
+  ImGui::Checkbox("Use reflection probes", &useProbes);
+  bool paramsChanged = ImGui::SliderInt("Probe cache slots", reinterpret_cast<int*>(&probesParams.cacheSlots), 1, 64);
+  paramsChanged |= ImGui::SliderInt("Probe captures per frame", reinterpret_cast<int*>(&probesParams.maxCapturesPerFrame), 0, 8);
+  paramsChanged |= ImGui::SliderInt("Probe keep frames", reinterpret_cast<int*>(&probesParams.keepFrames), 0, 600);
+  if (paramsChanged)
+    probesParamsChanged = true;
+  ImGui::SliderFloat("New probe extent", &newProbeExtent, 0.5f, 50.0f);
+  ImGui::SliderFloat("New probe blend", &newProbeBlend, 0.0f, 10.0f);
+  ImGui::SliderInt("New probe priority", &newProbePriority, -10, 10);
+  if (ImGui::Button("Add probe at camera"))
+    AddProbeAtCamera();
+  ImGui::SameLine();
+  if (ImGui::Button("Recapture probes"))
+    probes.GetManager().InvalidateAll();
+
+  ReflectionProbeManager& probesManager = probes.GetManager();
+  ReflectionProbeStats probesStats = probesManager.GetStats();
+  ImGui::Text("Probes %u, resident %u, pending %u, captures %llu, evictions %llu", probesStats.probes, probesStats.resident,
+    probesStats.pending, (unsigned long long)probesStats.captures, (unsigned long long)probesStats.evictions);
+  for (uint32_t id = 0; id < probesManager.GetProbeCapacity(); id++) {
+    if (!probesManager.IsAlive(id))
+      continue;
+
+    const ReflectionProbeDesc& desc = probesManager.GetDesc(id);
+    ImGui::Text("  #%u (%.1f %.1f %.1f) slot %d", id, desc.position[0], desc.position[1], desc.position[2], probesManager.GetSlot(id));
+    ImGui::SameLine();
+    if (ImGui::Button((std::string("Remove##probe") + std::to_string(id)).c_str()))
+      probesManager.RemoveProbe(id);
+  }
+
   ImGui::End();
 }
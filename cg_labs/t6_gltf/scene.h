@@ -17,13 +17,17 @@
 #include "Sphere.h"
 #include "box.h"
 #include "gltf_model.h"
+#include "BatchDesc.h"
+#include "ReflectionProbeSystem.h"
 #include "skybox.h"
 
 using namespace DirectX;
 
 class Scene {
 public:
-  HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight);
+  // Model draws through gfx, the rest of the scene uses device and context directly
+  HRESULT Init(ID3D11Device* device, ID3D11DeviceContext* context, IGfxDevice& gfx, int screenWidth, int screenHeight,
+    const SceneDesc& desc = SceneDesc());
 
   void Release();
 
@@ -37,14 +41,74 @@ public:
 
   void RenderGUI();
 
-private:  
+  // Time-sliced regeneration of IBL maps after environment switch and reflection probes capture
+  void UpdateEnvironment(ID3D11Device* device, ID3D11DeviceContext* context);
+
+  // No IBL bake is running and the last UpdateEnvironment captured no probes
+  bool IsEnvironmentSettled() const { return !sb.IsEnvironmentBaking() && probes.GetLastFrameCaptures() == 0; }
+
+private:
+  // Directional lights from skybox extraction (data only, not rendered)
+  void UpdateEnvLights();
+
+  // Constant buffers of skybox, model and lights for frame camera (probe captures overwrite them)
+  void UpdateFrameConstants(ID3D11DeviceContext* context);
+
+  // Scene without probes from probe position into bound target
+  void RenderProbeCapture(ID3D11DeviceContext* context, XMMATRIX viewMatrix, XMMATRIX projectionMatrix, XMFLOAT3 position);
+
+  void AddProbeAtCamera();
+
+  // Scene lights and random point lights in the form of Model::Update
+  const std::vector<ClusterLight>& CollectFrameLights(const std::vector<Light>& sceneLights);
+  void GenerateRandomLights();
+
   bool isOff = true;
   float intensity = 1.0f;
 
+  IGfxDevice* gfx = nullptr;
   Model model;
   PBRRichMaterial pbrMaterial;
   ViewMode viewMode;
   std::vector<Light> lights;
   Skybox sb;
   IBLMaps maps;
+
+  // Environment switching params
+  char envPath[256] = "./src/envs/env_1k_4.hdr";
+  bool envReloadRequested = false;
+  float envBakeBudgetMs = 2.0f;
+  HDRTextureFormat envFormat = HDRTextureFormat::rgba16f;
+  bool octahedralIBL = false;
+  IBLBakeQuality iblQuality;
+
+  // Environment lights extraction params
+  bool extractEnvLights = false;
+  bool useEnvLights = true;
+  int envLightsCount = 2;
+  std::vector<Light> envLights;
+  std::vector<Light> shadingLights;
+
+  // Random point lights around the model (data only, not rendered)
+  int randomLightsCount = 0;
+  float randomLightsArea = 20.0f;
+  float randomLightsIntensity = 1.0f;
+  std::vector<ClusterLight> randomLights;
+  std::vector<ClusterLight> frameLights;
+
+  // Frame camera
+  XMMATRIX frameView;
+  XMMATRIX frameProjection;
+  XMVECTOR frameCameraPos;
+  XMFLOAT3 cameraPosition = XMFLOAT3(0, 0, 0);
+
+  // Local reflection probes
+  ReflectionProbeSystem probes;
+  ReflectionProbeParams probesParams;
+  bool probesParamsChanged = false;
+  std::vector<XMFLOAT3> meshPositions;
+  bool useProbes = true;
+  float newProbeExtent = 5.0f;
+  float newProbeBlend = 1.0f;
+  int newProbePriority = 0;
 };
@@ -1,50 +1,14 @@
 #include <d3dcompiler.h>
-#include "D3DInclude.h"
+#include "ShaderLibrary.h"
 #include "screenplane.h"
 
-HRESULT ScreenPlane::CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut)
-{
-	HRESULT hr = S_OK;
-
-	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS;
-#ifdef _DEBUG
-	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
-	// Setting this flag improves the shader debugging experience, but still allows 
-	// the shaders to be optimized and to run exactly the way they will run in 
-	// the release configuration of this program.
-	dwShaderFlags |= D3DCOMPILE_DEBUG;
-
-	// Disable optimizations to further improve shader debugging
-	dwShaderFlags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif
-	D3DInclude includeObj;
-
-	ID3DBlob* pErrorBlob = nullptr;
-	hr = D3DCompileFromFile(szFileName, nullptr, &includeObj, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob);
-
-	if (FAILED(hr))
-	{
-		if (pErrorBlob)
-		{
-			OutputDebugStringA(reinterpret_cast<const char*>(pErrorBlob->GetBufferPointer()));
-			pErrorBlob->Release();
-		}
-		return hr;
-	}
-
-	if (pErrorBlob)
-		pErrorBlob->Release();
-
-	return S_OK;
-}
-
 HRESULT ScreenPlane::Init(
 	ID3D11Device* pDevice,
 	ID3D11DeviceContext* pContext)
 {
 	// Init shader to draw screen plane with screen texture
 	ID3DBlob * pVSBlob = nullptr;
-	HRESULT hr = CompileShaderFromFile(L"screen_plane_VS.hlsl", "main", "vs_5_0", &pVSBlob);
+	HRESULT hr = ShaderLibrary::GetInstance().Compile(L"screen_plane_VS.hlsl", "main", "vs_5_0", &pVSBlob);
 	if (FAILED(hr))
 	{
 		MessageBox(nullptr,
@@ -22,8 +22,6 @@ public:
 		ID3D11DeviceContext* pContext);
 
 private:
-	HRESULT CompileShaderFromFile(const WCHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut);
-	
 	struct ProcessTextureVertex
 	{
 		struct
@@ -1,7 +1,10 @@
 #include "skybox.h"
+#include "ShaderLibrary.h"
 #include "renderer.h"
+#include "TraceRecorder.h"
 
 HRESULT Skybox::Init(ID3D11Device* device, ID3D11DeviceContext* context, int screenWidth, int screenHeight) {
+  TRACE_SCOPE("Skybox init");
   // Create index array
   static const D3D11_INPUT_ELEMENT_DESC InputDesc[] = {
       {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
@@ -48,7 +51,7 @@ HRESULT Skybox::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
   flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif
 
-  hr = D3DCompileFromFile(L"skybox_VS.hlsl", NULL, NULL, "main", "vs_5_0", flags, 0, &vertexShaderBuffer, NULL);
+  hr = ShaderLibrary::GetInstance().Compile(L"skybox_VS.hlsl", "main", "vs_5_0", &vertexShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
@@ -56,7 +59,7 @@ HRESULT Skybox::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
   if (FAILED(hr))
     return hr;
   
-  hr = D3DCompileFromFile(L"skybox_PS.hlsl", NULL, NULL, "main", "ps_5_0", flags, 0, &pixelShaderBuffer, NULL);
+  hr = ShaderLibrary::GetInstance().Compile(L"skybox_PS.hlsl", "main", "ps_5_0", &pixelShaderBuffer, nullptr, flags);
   if (FAILED(hr))
     return hr;
 
@@ -120,38 +123,27 @@ HRESULT Skybox::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
     return hr;
 
   // load texture
-  hr = txt.InitEx(device, context, txt_path.c_str());
+  EnvironmentData env;
+  hr = LoadEnvironment(device, context, txt_path, txt, hdrCMgen, residualCMgen, octIBLgen, env);
   if (FAILED(hr))
     return hr;
 
-  // init texture shader resource view
-  if (txt_path.find(std::wstring(L".dds")) != std::wstring::npos)
-    txtSRV = txt.GetTexture();
-  else if (txt_path.find(std::wstring(L".hdr")) != std::wstring::npos) {
-    hr = hdrCMgen.Init(device, context);
-    if (FAILED(hr))
-      return hr;
-
-    hr = hdrCMgen.GenerateCubeMap(device, context, txt.GetTexture());
-    if (FAILED(hr))
-      return hr;
-
-    txtSRV = hdrCMgen.GetSRV();
-  }
-  else
-    return E_FAIL;
+  txtSRV = env.srv;
+  envLights = env.lights;
+  envLightsShare = env.lightsShare;
 
   // Generate irradience map
   hr = irrMgen.Init(device, context);
   if (FAILED(hr))
     return hr;
 
-  hr = irrMgen.GenerateMaps(device, context, txtSRV);
+  hr = irrMgen.GenerateMaps(device, context, env.iblSRV);
   if (FAILED(hr))
     return hr;
 
   maps = irrMgen.GetMaps();
-
+  if (env.octahedral)
+    octIBLgen.FillMaps(maps);
 
   // Init sampler
   D3D11_SAMPLER_DESC descSmplr = {};
@@ -177,8 +169,171 @@ HRESULT Skybox::Init(ID3D11Device* device, ID3D11DeviceContext* context, int scr
   return hr;
 }
 
+HRESULT Skybox::LoadEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& texture_path,
+  Texture& envTxt, HDRCubeMapGenerator& envCMgen, HDRCubeMapGenerator& envResidualCMgen, OctahedralIBLGenerator& envOctGen,
+  EnvironmentData& env) {
+  TRACE_SCOPE("Environment load");
+  HRESULT hr = S_OK;
+  env = EnvironmentData();
+
+  // init texture shader resource view
+  if (texture_path.find(std::wstring(L".dds")) != std::wstring::npos) {
+    hr = envTxt.InitEx(device, context, texture_path.c_str());
+    if (FAILED(hr))
+      return hr;
+
+    env.srv = envTxt.GetTexture();
+  }
+  else if (texture_path.find(std::wstring(L".hdr")) != std::wstring::npos) {
+    // Converted on CPU to get mip chain for prefiltered map sampling
+    CubeMapConvertParams params;
+    params.faceSize = cubeMapFaceSize;
+    HDRImage equirect;
+    hr = HDRCubeMapGenerator::LoadEquirect(texture_path.c_str(), params, equirect);
+    if (FAILED(hr))
+      return hr;
+
+    hr = envCMgen.GenerateCubeMap(device, equirect, params, envFormat);
+    if (FAILED(hr))
+      return hr;
+
+    env.srv = envCMgen.GetSRV();
+
+    HDRImage residual;
+    const HDRImage* iblSource = &equirect;
+    UINT iblFaceSize = params.faceSize;
+    if (extractEnvLights) {
+      env.lightsShare = EnvLightExtractor(envLightsParams).Extract(equirect, env.lights, &residual);
+
+      // Without sharp sources IBL maps need less source resolution
+      if (!env.lights.empty()) {
+        iblSource = &residual;
+        iblFaceSize = max(params.faceSize / 2, 64u);
+      }
+    }
+
+    if (octahedralIBL) {
+      // Same texel density as cube map with iblFaceSize faces
+      hr = envOctGen.GenerateMaps(device, *iblSource, 2 * iblFaceSize);
+      if (FAILED(hr))
+        return hr;
+
+      env.octahedral = true;
+    }
+    else if (iblSource == &residual) {
+      CubeMapConvertParams residualParams = params;
+      residualParams.faceSize = iblFaceSize;
+      hr = envResidualCMgen.GenerateCubeMap(device, residual, residualParams, envFormat);
+      if (FAILED(hr))
+        return hr;
+
+      env.iblSRV = envResidualCMgen.GetSRV();
+    }
+  }
+  else
+    return E_FAIL;
+
+  if (!env.iblSRV)
+    env.iblSRV = env.srv;
+  return hr;
+}
+
+HRESULT Skybox::SetEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& texture_path) {
+  // Drop previous unfinished bake
+  irrMgen.CancelIncrementalBake();
+  ReleasePendingEnvironment();
+
+  EnvironmentData env;
+  HRESULT hr = LoadEnvironment(device, context, texture_path, pendingTxt, pendingCMgen, pendingResidualCMgen, pendingOctIBLgen, env);
+  if (FAILED(hr)) {
+    ReleasePendingEnvironment();
+    return hr;
+  }
+  pendingTxtPath = texture_path;
+  pendingTxtSRV = env.srv;
+  pendingEnvLights = env.lights;
+  pendingEnvLightsShare = env.lightsShare;
+
+  // Octahedral maps are already baked
+  if (env.octahedral) {
+    ApplyPendingEnvironment();
+    return S_OK;
+  }
+
+  hr = irrMgen.BeginIncrementalBake(device, context, env.iblSRV);
+  if (FAILED(hr))
+    ReleasePendingEnvironment();
+  return hr;
+}
+
+HRESULT Skybox::UpdateEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, float budgetMs) {
+  bool finished = false;
+  HRESULT hr = irrMgen.StepIncrementalBake(device, context, budgetMs, finished);
+  if (FAILED(hr)) {
+    irrMgen.CancelIncrementalBake();
+    ReleasePendingEnvironment();
+    return hr;
+  }
+
+  if (!finished)
+    return S_OK;
+
+  ApplyPendingEnvironment();
+  return S_OK;
+}
+
+void Skybox::ApplyPendingEnvironment() {
+  txt.Release();
+  hdrCMgen.Release();
+  residualCMgen.Release();
+  octIBLgen.Release();
+
+  txt = pendingTxt;
+  hdrCMgen = pendingCMgen;
+  residualCMgen = pendingResidualCMgen;
+  octIBLgen = pendingOctIBLgen;
+  txtSRV = pendingTxtSRV;
+  txt_path = pendingTxtPath;
+  envLights = pendingEnvLights;
+  envLightsShare = pendingEnvLightsShare;
+
+  pendingTxt = Texture();
+  pendingCMgen = HDRCubeMapGenerator();
+  pendingResidualCMgen = HDRCubeMapGenerator();
+  pendingOctIBLgen = OctahedralIBLGenerator();
+  pendingTxtSRV = nullptr;
+
+  maps = irrMgen.GetMaps();
+  if (octIBLgen.HasMaps())
+    octIBLgen.FillMaps(maps);
+  mapsUpdated = true;
+}
+
+bool Skybox::ConsumeMapsUpdate(IBLMaps& newMaps) {
+  if (!mapsUpdated)
+    return false;
+
+  newMaps = maps;
+  mapsUpdated = false;
+  return true;
+}
+
+void Skybox::ReleasePendingEnvironment() {
+  pendingTxt.Release();
+  pendingCMgen.Release();
+  pendingCMgen = HDRCubeMapGenerator();
+  pendingResidualCMgen.Release();
+  pendingResidualCMgen = HDRCubeMapGenerator();
+  pendingOctIBLgen.Release();
+  pendingTxtSRV = nullptr;
+  pendingEnvLights.clear();
+}
+
 void Skybox::Release() {
+  ReleasePendingEnvironment();
   hdrCMgen.Release();
+  residualCMgen.Release();
+  octIBLgen.Release();
   irrMgen.Release();
   txt.Release();
 
@@ -7,8 +7,10 @@
 #include <string>
 #include <vector>
 
+#include "EnvLightExtractor.h"
 #include "HDRCubeMapGenerator.h"
 #include "IBLMapsGenerator.h"
+#include "OctahedralIBLGenerator.h"
 #include "geomsphere.h"
 #include "rendered.h"
 #include "texture.h"
@@ -36,6 +38,41 @@ public:
 
   IBLMaps GetMaps() { return maps; }
 
+  // Switch to new environment: cube map is built at once, IBL maps are baked over next frames
+  HRESULT SetEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& texture_path);
+
+  // Run slice of IBL bake (~budgetMs of GPU time), new environment is applied when bake is finished
+  HRESULT UpdateEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, float budgetMs);
+
+  // Returns true (once) when maps were changed by finished bake
+  bool ConsumeMapsUpdate(IBLMaps& newMaps);
+
+  // Storage format of environment cube map, applied to the next loaded environment
+  void SetEnvironmentFormat(HDRTextureFormat format) { envFormat = format; }
+  const HDRFormatErrorReport& GetEnvironmentErrorReport() { return hdrCMgen.GetErrorReport(); }
+
+  // Bright sources of next loaded .hdr environment become directional lights, IBL gets the rest
+  void SetEnvLightExtraction(bool enable, const EnvLightExtractorParams& params = EnvLightExtractorParams()) {
+    extractEnvLights = enable;
+    envLightsParams = params;
+  }
+  const std::vector<ExtractedLight>& GetEnvLights() const { return envLights; }
+
+  // Irradience and prefiltered maps of next .hdr environment are octahedral 2D textures baked on CPU at once
+  void SetOctahedralIBL(bool enable) { octahedralIBL = enable; }
+  float GetEnvLightsShare() const { return envLightsShare; }
+
+  bool IsEnvironmentBaking() const { return irrMgen.IsBaking(); }
+  float GetEnvironmentBakeProgress() const { return irrMgen.GetBakeProgress(); }
+
+  // Adaptive sampling of IBL maps, applied to the next bake
+  void SetIBLQuality(const IBLBakeQuality& quality) { irrMgen.SetBakeQuality(quality); }
+  const IBLBakeQuality& GetIBLQuality() const { return irrMgen.GetBakeQuality(); }
+
+  // Reads finished bake statistics without stalling, call once per frame
+  void PollIBLQualityReport(ID3D11DeviceContext* context) { irrMgen.PollQualityReport(context); }
+  const IBLBakeQualityReport& GetIBLQualityReport() const { return irrMgen.GetQualityReport(); }
+
 private:
   struct SBWorldMatrixBuffer {
     XMMATRIX worldMatrix;
@@ -68,4 +105,41 @@ private:
   Texture txt;
   ID3D11ShaderResourceView* txtSRV = nullptr;
   IBLMaps maps;
+  UINT cubeMapFaceSize = 0; // 0 - match source resolution
+  HDRTextureFormat envFormat = HDRTextureFormat::rgba16f;
+
+  // Extracted lights and residual environment used as IBL source
+  bool extractEnvLights = false;
+  EnvLightExtractorParams envLightsParams;
+  HDRCubeMapGenerator residualCMgen;
+  std::vector<ExtractedLight> envLights;
+  float envLightsShare = 0.0f;
+
+  bool octahedralIBL = false;
+  OctahedralIBLGenerator octIBLgen;
+
+  struct EnvironmentData {
+    ID3D11ShaderResourceView* srv = nullptr;    // shown by skybox
+    ID3D11ShaderResourceView* iblSRV = nullptr; // source of IBL maps
+    bool octahedral = false;                    // IBL maps are ready in octahedral generator
+    std::vector<ExtractedLight> lights;
+    float lightsShare = 0.0f;
+  };
+
+  // Environment which is baking now
+  HRESULT LoadEnvironment(ID3D11Device* device, ID3D11DeviceContext* context, const std::wstring& texture_path,
+    Texture& envTxt, HDRCubeMapGenerator& envCMgen, HDRCubeMapGenerator& envResidualCMgen, OctahedralIBLGenerator& envOctGen,
+    EnvironmentData& env);
+  void ApplyPendingEnvironment();
+  void ReleasePendingEnvironment();
+
+  HDRCubeMapGenerator pendingCMgen;
+  HDRCubeMapGenerator pendingResidualCMgen;
+  OctahedralIBLGenerator pendingOctIBLgen;
+  std::vector<ExtractedLight> pendingEnvLights;
+  float pendingEnvLightsShare = 0.0f;
+  std::wstring pendingTxtPath;
+  Texture pendingTxt;
+  ID3D11ShaderResourceView* pendingTxtSRV = nullptr;
+  bool mapsUpdated = false;
 };
@@ -0,0 +1,76 @@
+#include "Test.h"
+
+#include <cmath>
+
+#include "../Bloom.h"
+
+namespace {
+  template<size_t count>
+  float WeightSum(const BloomTap (&taps)[count]) {
+    float sum = 0.0f;
+    for (const BloomTap& tap : taps)
+      sum += tap.weight;
+    return sum;
+  }
+
+  // Thresholded luminance, the curve is continuous where weight is
+  float Bright(float lum, float threshold, float knee) {
+    return BloomThresholdWeight(lum, threshold, knee) * lum;
+  }
+}
+
+TEST(BloomKernelWeightsSumToOne) {
+  CHECK_NEAR(WeightSum(bloomBox13Taps), 1.0f, 1e-6f);
+  CHECK_NEAR(WeightSum(bloomDualKawaseTaps), 1.0f, 1e-6f);
+  CHECK_NEAR(WeightSum(bloomTentTaps), 1.0f, 1e-6f);
+}
+
+TEST(BloomThresholdKneeIsContinuous) {
+  const float threshold = 4.0f, knee = 0.5f, softKnee = threshold * knee, eps = 1e-3f;
+  CHECK(Bright(threshold - softKnee - eps, threshold, knee) == 0.0f);
+  CHECK_NEAR(Bright(threshold - softKnee + eps, threshold, knee), 0.0f, 1e-5f);
+
+  // Knee meets the linear part at threshold + softKnee
+  CHECK_NEAR(Bright(threshold + softKnee - eps, threshold, knee), Bright(threshold + softKnee + eps, threshold, knee), 3e-3f);
+  CHECK_NEAR(Bright(threshold + softKnee, threshold, knee), softKnee, 1e-5f);
+  CHECK_NEAR(Bright(20.0f, threshold, knee), 20.0f - threshold, 1e-5f);
+
+  // Monotonic over the knee
+  float previous = 0.0f;
+  bool monotonic = true;
+  for (float lum = 0.0f; lum < 10.0f; lum += 0.01f) {
+    float bright = Bright(lum, threshold, knee);
+    monotonic = monotonic && bright >= previous;
+    previous = bright;
+  }
+  CHECK(monotonic);
+  CHECK(BloomThresholdWeight(0.0f, threshold, knee) == 0.0f);
+}
+
+TEST(BloomReferenceKeepsUniformImage) {
+  HDRImage input;
+  input.Resize(64, 48);
+  for (size_t i = 0; i < input.data.size(); i += 4) {
+    input.data[i] = 8.0f;
+    input.data[i + 1] = 6.0f;
+    input.data[i + 2] = 4.0f;
+    input.data[i + 3] = 1.0f;
+  }
+
+  // Every level is the thresholded color, the sum of levels is normalized back to it
+  for (BloomDownsample downsample : { BloomDownsample::box13, BloomDownsample::dualKawase }) {
+    BloomSettings settings;
+    settings.downsample = downsample;
+    settings.levels = 3;
+    HDRImage result;
+    BuildBloomReference(input, settings, 1.0f, result);
+
+    float lum = 8.0f * 0.2126f + 6.0f * 0.7151f + 4.0f * 0.0722f;
+    float weight = BloomThresholdWeight(lum, settings.threshold, settings.knee);
+    CHECK(result.width == 32 && result.height == 24);
+    float maxError = 0.0f;
+    for (size_t i = 0; i < result.data.size(); i += 4)
+      maxError = std::fmax(maxError, std::fabs(result.data[i + 1] - 6.0f * weight));
+    CHECK(maxError < 1e-3f);
+  }
+}
@@ -0,0 +1,194 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../ClusteredLighting.h"
+
+namespace {
+  // Grid that is not a multiple of the 4 tile batch, so the padding lanes are used
+  ClusterGridDesc TestGrid() {
+    ClusterGridDesc grid;
+    grid.tilesX = 7;
+    grid.tilesY = 5;
+    grid.slices = 6;
+    grid.tanHalfFovX = 1.2f;
+    grid.tanHalfFovY = 0.7f;
+    grid.nearZ = 0.5f;
+    grid.farZ = 40.0f;
+    return grid;
+  }
+
+  // Rotation around y and translation, row vectors
+  void TestView(float view[16]) {
+    const float angle = 0.4f, c = std::cos(angle), s = std::sin(angle);
+    const float matrix[16] = { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 1.5f, -2.0f, 3.0f, 1 };
+    memcpy(view, matrix, sizeof(matrix));
+  }
+
+  void ToView(const float view[16], const float p[3], double out[3]) {
+    for (int c = 0; c < 3; c++)
+      out[c] = (double)p[0] * view[c] + (double)p[1] * view[4 + c] + (double)p[2] * view[8 + c] + view[12 + c];
+  }
+
+  // Point lights around the frustum, a dark one and two directional ones
+  std::vector<ClusterLight> TestLights() {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<ClusterLight> lights;
+    for (int i = 0; i < 80; i++) {
+      ClusterLight light = { { unit(random) * 50 - 25, unit(random) * 20 - 10, unit(random) * 60 - 12, 0 },
+        { unit(random), unit(random), unit(random), 0.01f + unit(random) } };
+      lights.push_back(light);
+    }
+    lights[10].color[3] = 0.0f;
+    lights.insert(lights.begin() + 3, ClusterLight{ { 0, 1, 0, 1 }, { 1, 1, 1, 2 } });
+    lights.push_back(ClusterLight{ { 1, 0, 0, 1 }, { 1, 1, 1, 1 } });
+    return lights;
+  }
+
+  // Index of the light in the cluster list, by value since Build reorders lights
+  bool ClusterHasLight(const ClusteredLighting& clustering, uint32_t cluster, const ClusterLight& light) {
+    const ClusterRange& range = clustering.GetClusters()[cluster];
+    for (uint32_t i = 0; i < range.count; i++) {
+      const ClusterLight& listed = clustering.GetLights()[clustering.GetIndices()[range.offset + i]];
+      if (memcmp(&listed, &light, sizeof(light)) == 0)
+        return true;
+    }
+    return false;
+  }
+}
+
+TEST(ClusteredLightingMatchesBruteForceBoxTest) {
+  ClusterGridDesc grid = TestGrid();
+  float view[16];
+  TestView(view);
+  std::vector<ClusterLight> lights = TestLights();
+
+  ClusteredLighting clustering;
+  clustering.SetCutoff(0.05f);
+  clustering.Build(grid, view, lights);
+
+  const std::vector<ClusterLight>& sorted = clustering.GetLights();
+  CHECK(clustering.GetStats().globalLights == 2);
+  CHECK(sorted.size() >= 2 && sorted[0].position[3] == 1.0f && sorted[1].position[3] == 1.0f);
+  CHECK(clustering.GetClusters().size() == grid.GetClusterCount());
+
+  // Every light against every cluster box in double precision, the same boxes as the build
+  uint32_t checked = 0, ambiguous = 0;
+  uint64_t found = 0;
+  for (uint32_t slice = 0; slice < grid.slices; slice++) {
+    double sliceNear = grid.nearZ * std::pow((double)grid.farZ / grid.nearZ, (double)slice / grid.slices);
+    double sliceFar = grid.nearZ * std::pow((double)grid.farZ / grid.nearZ, (double)(slice + 1) / grid.slices);
+    for (uint32_t y = 0; y < grid.tilesY; y++)
+      for (uint32_t x = 0; x < grid.tilesX; x++) {
+        double ndcX0 = -1.0 + 2.0 * x / grid.tilesX, ndcX1 = -1.0 + 2.0 * (x + 1) / grid.tilesX;
+        double ndcY0 = 1.0 - 2.0 * (y + 1) / grid.tilesY, ndcY1 = 1.0 - 2.0 * y / grid.tilesY;
+        double boxMin[3] = { std::min(ndcX0 * sliceNear, ndcX0 * sliceFar) * grid.tanHalfFovX,
+          std::min(ndcY0 * sliceNear, ndcY0 * sliceFar) * grid.tanHalfFovY, sliceNear };
+        double boxMax[3] = { std::max(ndcX1 * sliceNear, ndcX1 * sliceFar) * grid.tanHalfFovX,
+          std::max(ndcY1 * sliceNear, ndcY1 * sliceFar) * grid.tanHalfFovY, sliceFar };
+        uint32_t cluster = (slice * grid.tilesY + y) * grid.tilesX + x;
+
+        for (const ClusterLight& light : lights) {
+          if (light.position[3] > 0.5f)
+            continue;
+          double center[3], distance2 = 0.0;
+          ToView(view, light.position, center);
+          for (int c = 0; c < 3; c++) {
+            double d = std::max(boxMin[c] - center[c], 0.0) + std::max(center[c] - boxMax[c], 0.0);
+            distance2 += d * d;
+          }
+          double range = clustering.GetLightRange(light);
+          double range2 = range * range;
+
+          // Spheres touching the box within float error may go either way
+          if (range > 0.0 && std::fabs(distance2 - range2) < 1e-3 * range2) {
+            ambiguous++;
+            continue;
+          }
+          bool expected = range > 0.0 && distance2 < range2;
+          CHECK(ClusterHasLight(clustering, cluster, light) == expected);
+          checked++;
+          found += expected;
+        }
+      }
+  }
+  CHECK(ambiguous < checked / 100);
+  CHECK(found > 100);
+  CHECK(found + ambiguous >= clustering.GetStats().indices);
+  CHECK(found <= clustering.GetStats().indices);
+}
+
+TEST(ClusteredLightingCoversLitPointsOfTheFrustum) {
+  ClusterGridDesc grid = TestGrid();
+  float view[16];
+  TestView(view);
+  std::vector<ClusterLight> lights = TestLights();
+
+  ClusteredLighting clustering;
+  clustering.SetCutoff(0.05f);
+  clustering.Build(grid, view, lights);
+
+  // Cluster of a view space point the way pbrLightable_PS finds it
+  float sliceScale = grid.GetSliceScale(), sliceBias = grid.GetSliceBias();
+  std::mt19937 random(11);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  uint32_t litPoints = 0;
+  for (int i = 0; i < 20000; i++) {
+    float z = grid.nearZ + (grid.farZ - grid.nearZ) * unit(random);
+    float ndcX = unit(random) * 2 - 1, ndcY = unit(random) * 2 - 1;
+    double point[3] = { ndcX * z * grid.tanHalfFovX, ndcY * z * grid.tanHalfFovY, z };
+
+    uint32_t x = std::min((uint32_t)((ndcX * 0.5f + 0.5f) * grid.tilesX), grid.tilesX - 1);
+    uint32_t y = std::min((uint32_t)((0.5f - ndcY * 0.5f) * grid.tilesY), grid.tilesY - 1);
+    float slice = std::floor(std::log(z) * sliceScale + sliceBias);
+    uint32_t sliceId = (uint32_t)std::min(std::max(slice, 0.0f), (float)grid.slices - 1);
+    uint32_t cluster = (sliceId * grid.tilesY + y) * grid.tilesX + x;
+
+    // No light that reaches the point is missing from its cluster
+    for (const ClusterLight& light : lights) {
+      if (light.position[3] > 0.5f)
+        continue;
+      double center[3], distance2 = 0.0;
+      ToView(view, light.position, center);
+      for (int c = 0; c < 3; c++)
+        distance2 += (point[c] - center[c]) * (point[c] - center[c]);
+      double range = clustering.GetLightRange(light);
+      if (distance2 < range * range * 0.999) {
+        CHECK(ClusterHasLight(clustering, cluster, light));
+        litPoints++;
+      }
+    }
+  }
+  CHECK(litPoints > 1000);
+}
+
+TEST(ClusteredLightingDropsLightsOutOfDepthRange) {
+  ClusterGridDesc grid = TestGrid();
+  const float view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+  // Range is 2 with this cutoff
+  std::vector<ClusterLight> lights = {
+    { { 0, 0, -1.6f, 0 }, { 1, 1, 1, 1 } }, // behind the near plane
+    { { 0, 0, 42.1f, 0 }, { 1, 1, 1, 1 } }, // past the far plane
+    { { 0, 0, 41.0f, 0 }, { 1, 1, 1, 1 } }, // reaches the last slice
+    { { 0, 0, 5.0f, 0 }, { 1, 1, 1, 0 } },  // no intensity
+  };
+
+  ClusteredLighting clustering;
+  clustering.SetCutoff(0.25f);
+  CHECK(clustering.GetLightRange(lights[0]) == 2.0f);
+  clustering.Build(grid, view, lights);
+  CHECK(clustering.GetStats().globalLights == 0);
+  CHECK(clustering.GetStats().pointLights == 1);
+  CHECK(clustering.GetLights().size() == 1 && clustering.GetLights()[0].position[2] == 41.0f);
+
+  // Only the center tiles of the last slice see it
+  uint32_t lastSlice = (grid.slices - 1) * grid.tilesX * grid.tilesY;
+  CHECK(clustering.GetClusters()[lastSlice + 2 * grid.tilesX + 3].count == 1);
+  CHECK(clustering.GetClusters()[lastSlice].count == 0);
+  CHECK(clustering.GetClusters()[2 * grid.tilesX + 3].count == 0);
+}
@@ -0,0 +1,147 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../GfxCommandBuffer.h"
+#include "../GfxNull.h"
+
+namespace {
+  // One packet: topology, shader, render targets, draw
+  std::string WriteStream() {
+    GfxCommandBuffer buffer;
+    buffer.BeginPacket(1);
+    buffer.SetTopology(GfxTopology::triangleList);
+    buffer.SetShader(GfxShaderStage::pixel, 5);
+    GfxHandle targets[2] = { 1, 2 };
+    buffer.SetRenderTargets(2, targets, 3);
+    buffer.Draw(3);
+
+    const GfxCommandBuffer* buffers[] = { &buffer };
+    GfxCommandList list;
+    list.Merge(buffers, 1);
+    std::ostringstream out;
+    list.Write(out);
+    return out.str();
+  }
+
+  // Header of 5 words, then one packet
+  GfxCommand* CommandAt(std::string& stream, size_t index) {
+    return reinterpret_cast<GfxCommand*>(&stream[5 * sizeof(uint32_t) + sizeof(GfxCommandPacket) + index * sizeof(GfxCommand)]);
+  }
+
+  bool ReadStream(const std::string& stream, GfxCommandList& list) {
+    std::istringstream in(stream);
+    return list.Read(in);
+  }
+
+  // Packet that binds a shader and draws id vertices, so the replayed draws tell the packet order
+  void AddDraw(GfxCommandBuffer& buffer, uint64_t sortKey, uint32_t id) {
+    buffer.BeginPacket(sortKey);
+    buffer.SetShader(GfxShaderStage::pixel, id);
+    buffer.Draw(id);
+  }
+
+  std::vector<uint32_t> ReplayedDraws(const GfxCommandList& list) {
+    GfxNullContext context;
+    context.EnableRecording(true);
+    list.Replay(context);
+    std::vector<uint32_t> draws;
+    for (const GfxRecordedCall& call : context.GetCalls())
+      if (call.type == GfxCallType::draw)
+        draws.push_back(call.args[0]);
+    return draws;
+  }
+}
+
+TEST(GfxCommandListSortsOpaqueThenTransparent) {
+  GfxCommandBuffer first, second;
+  AddDraw(first, GfxSortKey::Opaque(2.0f, 5), 1);
+  AddDraw(first, GfxSortKey::Transparent(1.0f, 1), 2);
+  AddDraw(first, GfxSortKey::Opaque(1.0f, 9), 3);
+  AddDraw(first, GfxSortKey::Opaque(1.0f, 9), 4);
+  AddDraw(second, GfxSortKey::Opaque(1.0f, 2), 5);
+  AddDraw(second, GfxSortKey::Transparent(3.0f, 1), 6);
+  AddDraw(second, GfxSortKey::Opaque(1.0f, 9), 7);
+  AddDraw(second, GfxSortKey::Transparent(1.0f, 1), 8);
+  const GfxCommandBuffer* buffers[] = { &first, &second };
+
+  // Opaque front to back and by material at one depth, then transparent back to front;
+  // equal keys keep buffer order, then recording order
+  GfxCommandList list;
+  list.Merge(buffers, 2);
+  CHECK(ReplayedDraws(list) == std::vector<uint32_t>({ 5, 3, 4, 7, 1, 6, 2, 8 }));
+  CHECK(list.GetStats().packets == 8 && list.GetStats().commands == 16);
+
+  list.Merge(buffers, 2, false);
+  CHECK(ReplayedDraws(list) == std::vector<uint32_t>({ 1, 2, 3, 4, 5, 6, 7, 8 }));
+}
+
+TEST(GfxCommandListMergeIsStableSort) {
+  // Keys differ in few bytes and repeat often, so skipped radix passes and ties are both covered
+  std::mt19937 random(3);
+  std::vector<GfxCommandBuffer> buffers(3);
+  std::vector<std::tuple<uint64_t, uint32_t>> expected;
+  uint32_t id = 1;
+  for (GfxCommandBuffer& buffer : buffers)
+    for (int i = 0; i < 300; i++, id++) {
+      uint64_t sortKey = random() % 4 == 0 ? GfxSortKey::Transparent((float)(random() % 8), random() % 3)
+        : GfxSortKey::Opaque((float)(random() % 8), (uint64_t)(random() % 3) << 30);
+      AddDraw(buffer, sortKey, id);
+      expected.emplace_back(sortKey, id);
+    }
+  std::stable_sort(expected.begin(), expected.end(),
+    [](const std::tuple<uint64_t, uint32_t>& a, const std::tuple<uint64_t, uint32_t>& b) { return std::get<0>(a) < std::get<0>(b); });
+
+  std::vector<const GfxCommandBuffer*> sources = { &buffers[0], &buffers[1], &buffers[2] };
+  GfxCommandList list;
+  list.Merge(sources.data(), sources.size());
+  std::vector<uint32_t> draws = ReplayedDraws(list);
+  CHECK(draws.size() == expected.size());
+  for (size_t i = 0; i < draws.size() && i < expected.size(); i++)
+    CHECK(draws[i] == std::get<1>(expected[i]));
+  for (size_t i = 1; i < list.GetPackets().size(); i++)
+    CHECK(list.GetPackets()[i - 1].sortKey <= list.GetPackets()[i].sortKey);
+}
+
+TEST(GfxCommandListReadsWrittenStream) {
+  std::string stream = WriteStream();
+  GfxCommandList list;
+  CHECK(ReadStream(stream, list));
+  CHECK(list.GetStats().packets == 1);
+  CHECK(list.GetStats().commands == 4);
+  CHECK(CommandAt(stream, 2)->type == GfxCommandType::renderTargets);
+}
+
+TEST(GfxCommandListRejectsMalformedCommands) {
+  GfxCommandList list;
+
+  std::string stream = WriteStream();
+  CommandAt(stream, 1)->stage = (uint8_t)GfxShaderStage::count;
+  CHECK(!ReadStream(stream, list));
+  CHECK(list.GetStats().commands == 0);
+
+  stream = WriteStream();
+  CommandAt(stream, 0)->args[0] = (uint32_t)GfxTopology::pointList + 1;
+  CHECK(!ReadStream(stream, list));
+
+  stream = WriteStream();
+  CommandAt(stream, 2)->args[0] = IGfxContext::maxRenderTargets + 1;
+  CHECK(!ReadStream(stream, list));
+
+  // Payload size wraps to zero in 32 bits
+  stream = WriteStream();
+  CommandAt(stream, 2)->args[0] = 0x40000000;
+  CHECK(!ReadStream(stream, list));
+
+  stream = WriteStream();
+  CommandAt(stream, 3)->type = GfxCommandType::count;
+  CHECK(!ReadStream(stream, list));
+
+  CHECK(!ReadStream(stream.substr(0, stream.size() - 1), list));
+}
@@ -0,0 +1,196 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../GfxNull.h"
+
+namespace {
+  size_t CountCalls(const GfxNullContext& context, GfxCallType type) {
+    size_t count = 0;
+    for (const GfxRecordedCall& call : context.GetCalls())
+      count += call.type == type;
+    return count;
+  }
+}
+
+TEST(GfxContextSkipsRedundantBindings) {
+  GfxNullDevice device;
+  GfxNullContext& context = device.GetNullContext();
+  context.EnableRecording(true);
+
+  // First binding after InvalidateState always goes through, even a null one
+  context.SetShader(GfxShaderStage::pixel, gfxNullHandle);
+  context.SetShader(GfxShaderStage::pixel, gfxNullHandle);
+  context.SetShader(GfxShaderStage::pixel, 5);
+  context.SetShader(GfxShaderStage::vertex, 5);
+  context.SetConstantBuffer(GfxShaderStage::pixel, 1, 7);
+  context.SetConstantBuffer(GfxShaderStage::pixel, 1, 7);
+  context.SetConstantBuffer(GfxShaderStage::pixel, 2, 7);
+  context.SetTopology(GfxTopology::triangleList);
+  context.SetTopology(GfxTopology::triangleList);
+  // Slot 0 is cached with stride and offset, other slots are not
+  context.SetVertexBuffer(0, 3, 32);
+  context.SetVertexBuffer(0, 3, 32);
+  context.SetVertexBuffer(0, 3, 32, 16);
+  context.SetVertexBuffer(1, 4, 8);
+  context.SetVertexBuffer(1, 4, 8);
+  context.SetIndexBuffer(9, GfxFormat::r16Uint);
+  context.SetIndexBuffer(9, GfxFormat::r32Uint);
+  context.SetIndexBuffer(9, GfxFormat::r32Uint);
+
+  const GfxContextStats& stats = context.GetStats();
+  CHECK(stats.calls == 17);
+  CHECK(stats.stateChanges == 12);
+  CHECK(stats.redundantSkipped == 5);
+  CHECK(context.GetCalls().size() == stats.stateChanges);
+  CHECK(CountCalls(context, GfxCallType::shader) == 3);
+  CHECK(CountCalls(context, GfxCallType::vertexBuffer) == 4);
+  CHECK(CountCalls(context, GfxCallType::indexBuffer) == 2);
+
+  // Bindings made outside the context are not known, so everything goes through again
+  context.InvalidateState();
+  context.SetShader(GfxShaderStage::pixel, 5);
+  context.SetTopology(GfxTopology::triangleList);
+  CHECK(stats.stateChanges == 14);
+  CHECK(stats.redundantSkipped == 5);
+}
+
+TEST(GfxContextRenderTargetsDropCachedResources) {
+  GfxNullDevice device;
+  GfxNullContext& context = device.GetNullContext();
+
+  context.SetShaderResource(GfxShaderStage::pixel, 0, 11);
+  context.SetSampler(GfxShaderStage::pixel, 0, 12);
+  context.SetShaderResource(GfxShaderStage::pixel, 0, 11);
+  context.SetSampler(GfxShaderStage::pixel, 0, 12);
+  CHECK(context.GetStats().redundantSkipped == 2);
+
+  // The backend unbinds a texture bound as a target, only its resource cache is forgotten
+  GfxHandle target = 13;
+  context.SetRenderTargets(1, &target, gfxNullHandle);
+  context.SetShaderResource(GfxShaderStage::pixel, 0, 11);
+  context.SetSampler(GfxShaderStage::pixel, 0, 12);
+  CHECK(context.GetStats().redundantSkipped == 3);
+  CHECK(context.GetStats().stateChanges == 4);
+
+  // Slots past maxSlots are not cached
+  context.SetShaderResource(GfxShaderStage::compute, IGfxContext::maxSlots, 11);
+  context.SetShaderResource(GfxShaderStage::compute, IGfxContext::maxSlots, 11);
+  CHECK(context.GetStats().stateChanges == 6);
+}
+
+TEST(GfxContextCountsWork) {
+  GfxNullDevice device;
+  GfxNullContext& context = device.GetNullContext();
+  const float black[4] = {};
+  const char data[64] = {};
+
+  context.BeginEvent("frame");
+  context.ClearRenderTarget(1, black);
+  context.ClearDepth(2, 1.0f);
+  context.UpdateBuffer(3, data, 64);
+  context.UpdateBuffer(3, data, 16);
+  context.Draw(3);
+  context.DrawIndexed(36, 0, 0);
+  context.Dispatch(8, 8, 1);
+  context.EndEvent();
+
+  GfxContextStats stats = context.GetStats();
+  CHECK(stats.calls == 9);
+  CHECK(stats.stateChanges == 0);
+  CHECK(stats.draws == 2);
+  CHECK(stats.dispatches == 1);
+  CHECK(stats.bufferUpdates == 2);
+  CHECK(stats.bytesUploaded == 80);
+  // Recording is off by default
+  CHECK(context.GetCalls().empty());
+
+  context.AddStats(stats);
+  CHECK(context.GetStats().calls == 18);
+  CHECK(context.GetStats().bytesUploaded == 160);
+  context.ResetStats();
+  CHECK(context.GetStats().calls == 0);
+  CHECK(context.GetStats().draws == 0);
+}
+
+TEST(GfxContextFilterCanBeDisabled) {
+  GfxNullDevice device;
+  GfxNullContext& context = device.GetNullContext();
+  context.EnableRedundancyFilter(false);
+
+  for (int i = 0; i < 4; i++) {
+    context.SetShader(GfxShaderStage::vertex, 1);
+    context.SetVertexBuffer(0, 2, 16);
+    context.SetIndexBuffer(3, GfxFormat::r32Uint);
+  }
+  CHECK(context.GetStats().stateChanges == 12);
+  CHECK(context.GetStats().redundantSkipped == 0);
+}
+
+TEST(GfxNullDeviceTracksHandlesAndBytes) {
+  GfxNullDevice device;
+
+  GfxBufferDesc bufferDesc;
+  bufferDesc.size = 256;
+  GfxHandle buffer = device.CreateBuffer(bufferDesc);
+  CHECK(buffer != gfxNullHandle);
+
+  // 8x4 rgba16 with a full mip chain: 256 + 64 + 16 + 8 bytes, six faces
+  GfxTextureDesc textureDesc;
+  textureDesc.width = 8;
+  textureDesc.height = 4;
+  textureDesc.mipLevels = 4;
+  textureDesc.arraySize = 6;
+  textureDesc.cube = true;
+  textureDesc.format = GfxFormat::rgba16Float;
+  GfxHandle texture = device.CreateTexture(textureDesc);
+  CHECK(texture != gfxNullHandle && texture != buffer);
+
+  // States and shaders have no memory
+  GfxHandle sampler = device.CreateSampler(GfxSamplerDesc());
+  GfxHandle shader = device.CreateShader(GfxShaderStage::pixel, nullptr, 0);
+  CHECK(sampler != gfxNullHandle && shader != gfxNullHandle && sampler != shader);
+
+  CHECK(device.GetLiveResources() == 4);
+  CHECK(device.GetResourceBytes() == 256 + (256 + 64 + 16 + 8) * 6);
+
+  device.Release(texture);
+  CHECK(device.GetLiveResources() == 3);
+  CHECK(device.GetResourceBytes() == 256);
+  // Second release, null and unknown handles are ignored
+  device.Release(texture);
+  device.Release(gfxNullHandle);
+  device.Release(1000);
+  CHECK(device.GetLiveResources() == 3);
+  CHECK(device.GetResourceBytes() == 256);
+
+  device.Release(buffer);
+  device.Release(sampler);
+  device.Release(shader);
+  CHECK(device.GetLiveResources() == 0);
+  CHECK(device.GetResourceBytes() == 0);
+}
+
+TEST(GfxNullDeviceRejectsInvalidResources) {
+  GfxNullDevice device;
+
+  GfxBufferDesc empty;
+  CHECK(device.CreateBuffer(empty) == gfxNullHandle);
+  GfxBufferDesc immutable;
+  immutable.size = 16;
+  immutable.usage = GfxUsage::immutable;
+  CHECK(device.CreateBuffer(immutable) == gfxNullHandle);
+  const char data[16] = {};
+  CHECK(device.CreateBuffer(immutable, data) != gfxNullHandle);
+
+  GfxTextureDesc unknownFormat;
+  unknownFormat.format = GfxFormat::unknown;
+  CHECK(device.CreateTexture(unknownFormat) == gfxNullHandle);
+  GfxTextureDesc zeroSize;
+  zeroSize.width = 0;
+  CHECK(device.CreateTexture(zeroSize) == gfxNullHandle);
+  CHECK(device.ImportShaderResource(nullptr) == gfxNullHandle);
+
+  CHECK(device.GetLiveResources() == 1);
+  CHECK(device.GetResourceBytes() == 16);
+}
@@ -0,0 +1,111 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../GfxNull.h"
+#include "../GfxParallelSubmit.h"
+#include "../JobSystem.h"
+
+namespace {
+  // Packets with changing state, every draw is told apart by its first index
+  void RecordList(uint32_t packets, GfxCommandList& list) {
+    GfxCommandBuffer buffer;
+    for (uint32_t i = 0; i < packets; i++) {
+      buffer.BeginPacket(i);
+      buffer.SetShader(GfxShaderStage::pixel, 10 + i % 7);
+      buffer.SetConstantBuffer(GfxShaderStage::vertex, 0, 100 + i);
+      buffer.SetVertexBuffer(0, 200 + i % 3, 44);
+      buffer.DrawIndexed(36, i);
+    }
+    const GfxCommandBuffer* buffers[] = { &buffer };
+    list.Merge(buffers, 1, false);
+  }
+
+  std::vector<uint32_t> DrawOrder(const GfxNullContext& context) {
+    std::vector<uint32_t> draws;
+    for (const GfxRecordedCall& call : context.GetCalls())
+      if (call.type == GfxCallType::drawIndexed)
+        draws.push_back(call.args[1]);
+    return draws;
+  }
+
+  std::vector<uint32_t> Sequence(uint32_t count) {
+    std::vector<uint32_t> values(count);
+    for (uint32_t i = 0; i < count; i++)
+      values[i] = i;
+    return values;
+  }
+
+  // Null device that runs out of deferred contexts or fails to finish one of them
+  class LimitedNullDevice : public GfxNullDevice {
+  public:
+    IGfxContext* BeginDeferred(uint32_t index) override { return index < contexts ? GfxNullDevice::BeginDeferred(index) : nullptr; }
+    bool FinishDeferred(uint32_t index) override { return index != failedFinish && GfxNullDevice::FinishDeferred(index); }
+
+    uint32_t contexts = maxDeferredContexts;
+    uint32_t failedFinish = maxDeferredContexts;
+  };
+
+  // First frame measures the packet cost on the main context, the second one is split
+  const GfxParallelSubmitStats& ReplayFrames(GfxParallelSubmitter& submitter, GfxNullDevice& device, const GfxCommandList& list) {
+    for (int frame = 0; frame < 2; frame++) {
+      device.GetNullContext().ClearCalls();
+      device.GetContext().ResetStats();
+      device.GetContext().InvalidateState();
+      submitter.Replay(device, list);
+    }
+    return submitter.GetStats();
+  }
+}
+
+TEST(GfxParallelSubmitKeepsDrawOrderAcrossChunks) {
+  GfxCommandList list;
+  RecordList(1000, list);
+
+  JobSystem jobs(4);
+  GfxParallelSubmitter submitter(jobs);
+  submitter.SetTargetChunkMs(1e-6);
+  GfxNullDevice device;
+  device.GetNullContext().EnableRecording(true);
+
+  const GfxParallelSubmitStats& stats = ReplayFrames(submitter, device, list);
+  CHECK(stats.chunks == 4);
+  CHECK(stats.packetsPerChunk == 250);
+  CHECK(stats.fallbackChunks == 0);
+  CHECK(DrawOrder(device.GetNullContext()) == Sequence(1000));
+  // Counters of the deferred contexts are added to the main one
+  CHECK(device.GetContext().GetStats().draws == 1000);
+
+  // Disabled submitter stays on the main context
+  submitter.Enable(false);
+  ReplayFrames(submitter, device, list);
+  CHECK(stats.chunks == 1);
+  CHECK(DrawOrder(device.GetNullContext()) == Sequence(1000));
+}
+
+TEST(GfxParallelSubmitFallsBackWithoutDeferredContexts) {
+  GfxCommandList list;
+  RecordList(1000, list);
+
+  JobSystem jobs(4);
+  GfxParallelSubmitter submitter(jobs);
+  submitter.SetTargetChunkMs(1e-6);
+  LimitedNullDevice device;
+  device.GetNullContext().EnableRecording(true);
+
+  // Third context is not available, the whole list replays on the main context once
+  device.contexts = 2;
+  const GfxParallelSubmitStats& stats = ReplayFrames(submitter, device, list);
+  CHECK(stats.chunks == 1);
+  CHECK(DrawOrder(device.GetNullContext()) == Sequence(1000));
+  CHECK(device.GetContext().GetStats().draws == 1000);
+
+  // Chunk whose list failed to finish replays on the main context in its place
+  device.contexts = IGfxDevice::maxDeferredContexts;
+  device.failedFinish = 1;
+  ReplayFrames(submitter, device, list);
+  CHECK(stats.chunks == 4);
+  CHECK(stats.fallbackChunks == 1);
+  CHECK(DrawOrder(device.GetNullContext()) == Sequence(1000));
+  CHECK(device.GetContext().GetStats().draws == 1000);
+}
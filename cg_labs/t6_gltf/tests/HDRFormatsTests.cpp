@@ -0,0 +1,76 @@
+#include "Test.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "../HDRFormats.h"
+
+namespace {
+  // Values go through the SSE loop (8 at once) and one by one through the scalar tail, both must agree
+  std::vector<float> RoundTrip(const std::vector<float>& values) {
+    std::vector<float> src;
+    for (int copy = 0; copy < 8; copy++)
+      src.insert(src.end(), values.begin(), values.end());
+    std::vector<uint16_t> halfs(src.size());
+    HDRFormatEncoder::FloatToHalf(src.data(), halfs.data(), src.size());
+
+    std::vector<float> result;
+    for (size_t i = 0; i < values.size(); i++) {
+      uint16_t scalar;
+      HDRFormatEncoder::FloatToHalf(&values[i], &scalar, 1);
+      result.push_back(HDRFormatEncoder::HalfToFloat(scalar));
+      bool nan = std::isnan(result.back());
+      CHECK(halfs[i] == scalar || (nan && std::isnan(HDRFormatEncoder::HalfToFloat(halfs[i]))));
+    }
+    return result;
+  }
+}
+
+TEST(HDRFormatsHalfSaturatesBeyondRange) {
+  const float inf = std::numeric_limits<float>::infinity();
+  std::vector<float> result = RoundTrip({ 65504.0f, 65519.0f, 65520.0f, 65536.0f, 125952.0f, 1e6f, -1e6f, 1e30f, inf, -inf,
+    std::numeric_limits<float>::quiet_NaN() });
+  CHECK(result[0] == 65504.0f);
+  CHECK(result[1] == 65504.0f);
+  CHECK(result[2] == 65504.0f);
+  CHECK(result[3] == 65504.0f);
+  CHECK(result[4] == 65504.0f);
+  CHECK(result[5] == 65504.0f);
+  CHECK(result[6] == -65504.0f);
+  CHECK(result[7] == 65504.0f);
+  CHECK(result[8] == inf);
+  CHECK(result[9] == -inf);
+  CHECK(std::isnan(result[10]));
+}
+
+TEST(HDRFormatsHalfRoundsInRange) {
+  std::vector<float> result = RoundTrip({ 0.0f, 1.0f, -2.5f, 1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f, 6e-5f, 1e-7f, 1000.1f });
+  CHECK(result[0] == 0.0f);
+  CHECK(result[1] == 1.0f);
+  CHECK(result[2] == -2.5f);
+  CHECK(result[3] == 1.0f);                  // tie goes to even
+  CHECK(result[4] == 1.0f + 4.0f / 2048.0f); // tie goes to even
+  CHECK_NEAR(result[5], 6e-5f, 1e-7f);
+  CHECK_NEAR(result[6], 1e-7f, 3e-8f);       // subnormal
+  CHECK(result[7] == 1000.0f);
+}
+
+TEST(HDRFormatsEncodeKeepsBrightTexelsFinite) {
+  HDRImage image;
+  image.Resize(4, 4);
+  for (size_t i = 0; i < image.data.size(); i++)
+    image.data[i] = i % 5 == 0 ? 125952.0f : 1.0f;
+
+  for (HDRTextureFormat format : { HDRTextureFormat::rgba16f, HDRTextureFormat::r11g11b10f, HDRTextureFormat::rgb9e5,
+         HDRTextureFormat::bc6h }) {
+    EncodedHDRImage encoded;
+    HDRFormatEncoder::Encode(image, format, encoded);
+    HDRImage decoded;
+    HDRFormatEncoder::Decode(encoded, decoded);
+    bool finite = decoded.data.size() == image.data.size();
+    for (size_t i = 0; i < decoded.data.size(); i++)
+      finite = finite && (i % 4 == 3 || std::isfinite(decoded.data[i]));
+    CHECK(finite);
+  }
+}
@@ -0,0 +1,140 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../IBLBakeScheduler.h"
+
+namespace {
+  // Logs items instead of rendering them
+  class MockExecutor : public IBLBakeExecutor {
+  public:
+    bool ExecuteItem(const IBLBakeItem& item) override {
+      items.push_back(item);
+      return failAt < 0 || (int)items.size() < failAt;
+    }
+    void FinishBake() override { finished++; }
+
+    std::vector<IBLBakeItem> items;
+    int finished = 0;
+    int failAt = -1; // 1-based index of the item that fails, -1 - none
+  };
+
+  IBLBakeLayout SmallLayout() {
+    IBLBakeLayout layout;
+    layout.irradienceTextureSize = 16;
+    layout.irradienceSamples = 100;
+    layout.prefilTextureSize = 64;
+    layout.prefilMipMapLevels = 3;
+    layout.prefilSamples = 10;
+    layout.tileSize = 32;
+    return layout;
+  }
+
+  void RunToEnd(IBLBakeScheduler& scheduler, MockExecutor& executor, double budgetMs) {
+    for (int step = 0; step < 10000 && scheduler.IsActive(); step++)
+      scheduler.Step(executor, budgetMs);
+  }
+}
+
+TEST(IBLBakeSchedulerTilesCoverEveryTexelOnce) {
+  IBLBakeScheduler scheduler;
+  MockExecutor executor;
+  scheduler.Begin(SmallLayout());
+  RunToEnd(scheduler, executor, 1e9);
+
+  // Irradiance: 1 tile per face; prefiltered 64 -> 4 tiles, 32 -> 1, 16 -> 1 per face
+  CHECK(executor.items.size() == 6 * (1 + 4 + 1 + 1));
+  CHECK(executor.finished == 1);
+
+  uint64_t texels[2][6][3] = {};
+  for (const IBLBakeItem& item : executor.items) {
+    CHECK(item.face < 6 && item.mip < 3);
+    texels[(int)item.stage][item.face][item.mip] += (uint64_t)item.width * item.height;
+  }
+  for (uint32_t face = 0; face < 6; face++) {
+    CHECK(texels[0][face][0] == 16 * 16);
+    CHECK(texels[1][face][0] == 64 * 64);
+    CHECK(texels[1][face][1] == 32 * 32);
+    CHECK(texels[1][face][2] == 16 * 16);
+  }
+}
+
+TEST(IBLBakeSchedulerClipsEdgeTiles) {
+  IBLBakeLayout layout = SmallLayout();
+  layout.prefilTextureSize = 48;
+  layout.prefilMipMapLevels = 1;
+  IBLBakeScheduler scheduler;
+  MockExecutor executor;
+  scheduler.Begin(layout);
+  RunToEnd(scheduler, executor, 1e9);
+
+  for (const IBLBakeItem& item : executor.items)
+    if (item.stage == IBLBakeStage::prefiltered) {
+      CHECK(item.x + item.width <= 48 && item.y + item.height <= 48);
+      CHECK_NEAR(item.workUnits, (double)item.width * item.height * layout.prefilSamples, 1e-9);
+    }
+}
+
+TEST(IBLBakeSchedulerStepKeepsPredictedCostInBudget) {
+  IBLBakeScheduler scheduler;
+  MockExecutor executor;
+  scheduler.Begin(SmallLayout());
+  // 1 ms per 32x32 tile of 10 samples
+  scheduler.ReportMeasuredCost(1.0, 1.0 / (32 * 32 * 10));
+  for (int i = 0; i < 50; i++)
+    scheduler.ReportMeasuredCost(32 * 32 * 10, 1.0);
+  CHECK_NEAR(scheduler.GetMsPerUnit(), 1.0 / (32 * 32 * 10), 1e-9);
+
+  size_t executed = 0;
+  while (scheduler.IsActive()) {
+    scheduler.Step(executor, 2.5);
+    CHECK(scheduler.GetLastStepItems() >= 1);
+    if (scheduler.GetLastStepItems() > 1)
+      CHECK(scheduler.GetLastStepPredictedMs() <= 2.5 + 1e-9);
+    executed += scheduler.GetLastStepItems();
+    CHECK(executor.items.size() == executed);
+  }
+  CHECK(executor.finished == 1);
+  CHECK_NEAR(scheduler.GetProgress(), 1.0, 1e-6);
+}
+
+TEST(IBLBakeSchedulerRunsOneItemWhenBudgetIsTooSmall) {
+  IBLBakeScheduler scheduler;
+  MockExecutor executor;
+  scheduler.Begin(SmallLayout());
+  size_t total = scheduler.GetItemsLeft();
+  scheduler.Step(executor, 0.0);
+  CHECK(scheduler.GetLastStepItems() == 1);
+  CHECK(scheduler.GetItemsLeft() == total - 1);
+  CHECK(scheduler.GetProgress() > 0.0f && scheduler.GetProgress() < 1.0f);
+}
+
+TEST(IBLBakeSchedulerMeasuredCostMovesPrediction) {
+  IBLBakeScheduler scheduler;
+  double initial = scheduler.GetMsPerUnit();
+  scheduler.ReportMeasuredCost(1000.0, 1000.0 * initial * 5.0);
+  CHECK(scheduler.GetMsPerUnit() > initial && scheduler.GetMsPerUnit() < initial * 5.0);
+  // Empty measurements are ignored
+  double before = scheduler.GetMsPerUnit();
+  scheduler.ReportMeasuredCost(0.0, 1.0);
+  scheduler.ReportMeasuredCost(1.0, 0.0);
+  CHECK(scheduler.GetMsPerUnit() == before);
+}
+
+TEST(IBLBakeSchedulerFailureCancelsBake) {
+  IBLBakeScheduler scheduler;
+  MockExecutor executor;
+  executor.failAt = 3;
+  scheduler.Begin(SmallLayout());
+  CHECK(!scheduler.Step(executor, 1e9));
+  CHECK(scheduler.HasFailed());
+  CHECK(!scheduler.IsActive());
+  CHECK(executor.items.size() == 3);
+  CHECK(executor.finished == 0);
+
+  // Begin clears the failure
+  executor.failAt = -1;
+  scheduler.Begin(SmallLayout());
+  CHECK(!scheduler.HasFailed());
+  CHECK(scheduler.Step(executor, 1e9));
+}
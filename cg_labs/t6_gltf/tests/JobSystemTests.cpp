@@ -0,0 +1,51 @@
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "../JobSystem.h"
+
+TEST(JobSystemParallelForVisitsEveryIndexOnce) {
+  JobSystem jobs(4);
+  std::vector<std::atomic<int>> visits(1000);
+  for (auto& visit : visits)
+    visit = 0;
+  jobs.ParallelFor(visits.size(), [&visits](size_t i) { visits[i]++; }, 0, 7);
+
+  bool once = true;
+  for (auto& visit : visits)
+    once = once && visit == 1;
+  CHECK(once);
+}
+
+TEST(JobSystemRunAfterWaitsForDependency) {
+  JobSystem jobs(3);
+  JobCounter first, second;
+  std::atomic<int> firstDone(0), orderOk(0);
+  for (int i = 0; i < 8; i++)
+    jobs.Run([&firstDone]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      firstDone++;
+    }, &first);
+  jobs.RunAfter(first, [&]() { orderOk = firstDone == 8 ? 1 : 0; }, &second);
+  jobs.Wait(second);
+  CHECK(orderOk == 1);
+  jobs.Wait(first);
+}
+
+TEST(JobSystemDestructorRunsQueuedJobs) {
+  for (size_t threads = 1; threads <= 4; threads++) {
+    std::atomic<int> done(0);
+    {
+      JobSystem jobs(threads);
+      for (int i = 0; i < 64; i++)
+        jobs.Run([&jobs, &done]() {
+          // Jobs pushed by jobs while the pool stops run too
+          jobs.Run([&done]() { done++; });
+          done++;
+        });
+    }
+    CHECK(done == 128);
+  }
+}
@@ -0,0 +1,197 @@
+#include "Test.h"
+
+#include <thread>
+#include <vector>
+
+#include "../Profiler.h"
+
+namespace {
+  // Checks scope pairs and plays back scripted GPU frames
+  class FakeGpuTimer : public ProfilerGpuTimer {
+  public:
+    void BeginFrame(uint64_t frame) override { frames.push_back(frame); }
+    void BeginScope(uint32_t node) override { open.push_back(node); }
+    void EndScope(uint32_t node) override {
+      CHECK(!open.empty() && open.back() == node);
+      if (!open.empty())
+        open.pop_back();
+    }
+    void EndFrame() override { CHECK(open.empty()); }
+
+    bool Poll(uint64_t& frame, std::vector<ProfilerSample>& samples) override {
+      if (ready.empty())
+        return false;
+      frame = readyFrames.front();
+      samples = ready.front();
+      ready.erase(ready.begin());
+      readyFrames.erase(readyFrames.begin());
+      return true;
+    }
+
+    std::vector<uint64_t> frames;
+    std::vector<uint32_t> open;
+    std::vector<std::vector<ProfilerSample>> ready;
+    std::vector<uint64_t> readyFrames;
+  };
+
+  const ProfilerSample* FindSample(const std::vector<ProfilerSample>& samples, uint32_t node) {
+    for (const ProfilerSample& sample : samples)
+      if (sample.node == node)
+        return &sample;
+    return nullptr;
+  }
+
+  uint32_t FindNode(const Profiler& profiler, const char* name, uint32_t parent) {
+    for (uint32_t node = 0; node < profiler.GetNodeCount(); node++)
+      if (profiler.GetNode(node).name == name && profiler.GetNode(node).parent == parent)
+        return node;
+    return ~0u;
+  }
+}
+
+TEST(ProfilerScopesNestUnderParents) {
+  Profiler profiler;
+  profiler.BeginFrame();
+  profiler.BeginScope("Scene");
+  profiler.BeginScope("Model");
+  profiler.EndScope();
+  profiler.EndScope();
+  profiler.BeginScope(L"Model");
+  profiler.EndScope();
+  profiler.EndFrame();
+
+  uint32_t scene = FindNode(profiler, "Scene", Profiler::frameNode);
+  uint32_t sceneModel = FindNode(profiler, "Model", scene);
+  uint32_t frameModel = FindNode(profiler, "Model", Profiler::frameNode);
+  CHECK(scene != ~0u && sceneModel != ~0u && frameModel != ~0u);
+  CHECK(sceneModel != frameModel);
+  CHECK(profiler.GetNode(sceneModel).depth == 2);
+  CHECK(profiler.GetNode(frameModel).depth == 1);
+
+  const std::vector<ProfilerSample>& samples = profiler.GetLastCpuFrame();
+  CHECK(samples.size() == 4);
+  const ProfilerSample* frame = FindSample(samples, Profiler::frameNode);
+  const ProfilerSample* outer = FindSample(samples, scene);
+  const ProfilerSample* inner = FindSample(samples, sceneModel);
+  CHECK(frame && outer && inner);
+  if (frame && outer && inner) {
+    CHECK(frame->depth == 0 && outer->depth == 1 && inner->depth == 2);
+    CHECK(outer->startMs <= inner->startMs && inner->endMs <= outer->endMs);
+    CHECK(frame->startMs <= outer->startMs && outer->endMs <= frame->endMs);
+  }
+
+  // Same hierarchy next frame reuses the nodes
+  uint32_t nodes = profiler.GetNodeCount();
+  profiler.BeginFrame();
+  profiler.BeginScope("Scene");
+  profiler.BeginScope("Model");
+  profiler.EndScope();
+  profiler.EndScope();
+  profiler.EndFrame();
+  CHECK(profiler.GetNodeCount() == nodes);
+  CHECK(profiler.GetFrameIndex() == 2);
+}
+
+TEST(ProfilerCollectsScopesOfOtherThreads) {
+  Profiler profiler;
+  profiler.BeginFrame();
+  std::thread worker([&profiler]() {
+    profiler.BeginScope("Job");
+    profiler.EndScope();
+  });
+  worker.join();
+  profiler.EndFrame();
+
+  uint32_t job = FindNode(profiler, "Job", ~0u);
+  const ProfilerSample* sample = FindSample(profiler.GetLastCpuFrame(), job);
+  CHECK(sample != nullptr);
+  CHECK(profiler.GetThreadCount() == 2);
+  if (sample)
+    CHECK(sample->thread != profiler.GetLastCpuFrame()[0].thread || sample->depth == 0);
+}
+
+TEST(ProfilerEndFrameClosesOpenScopesAndGpuPairs) {
+  Profiler profiler;
+  FakeGpuTimer timer;
+  profiler.SetGpuTimer(&timer);
+  profiler.BeginFrame();
+  profiler.BeginScope("Open", true);
+  profiler.BeginScope("Also open", true);
+  profiler.EndFrame();
+
+  // FakeGpuTimer::EndFrame checks every GPU scope was ended
+  CHECK(timer.open.empty());
+  CHECK(profiler.GetLastCpuFrame().size() == 3);
+
+  // Next frame starts at the root again
+  profiler.BeginFrame();
+  profiler.BeginScope("Open", true);
+  profiler.EndScope();
+  profiler.EndFrame();
+  CHECK(FindNode(profiler, "Open", Profiler::frameNode) != ~0u);
+  CHECK(profiler.GetNodeCount() == 3);
+}
+
+TEST(ProfilerPercentilesOfFrameTotals) {
+  Profiler profiler;
+  FakeGpuTimer timer;
+  profiler.SetGpuTimer(&timer);
+  profiler.SetHistorySize(100);
+
+  // GPU frame i takes i ms, shuffled; one frame runs the node twice, so totals add up
+  for (uint32_t i = 1; i <= 100; i++) {
+    uint32_t ms = (i * 37) % 100 + 1;
+    std::vector<ProfilerSample> samples(1);
+    samples[0].endMs = (float)ms;
+    if (ms == 100) {
+      samples[0].endMs = 60.0f;
+      samples.push_back(samples[0]);
+      samples[1].startMs = 60.0f;
+      samples[1].endMs = 100.0f;
+    }
+    timer.ready.push_back(samples);
+    timer.readyFrames.push_back(i - 1);
+    profiler.BeginFrame();
+    profiler.EndFrame();
+  }
+
+  ProfilerStats stats = profiler.GetGpuStats(Profiler::frameNode);
+  CHECK(stats.samples == 100);
+  CHECK(stats.p50 == 50.0f);
+  CHECK(stats.p95 == 95.0f);
+  CHECK(stats.p99 == 99.0f);
+  CHECK(stats.last == (float)((100 * 37) % 100 + 1));
+  CHECK(profiler.GetGpuLatency() == 0);
+
+  // History keeps the newest frames only
+  profiler.SetHistorySize(10);
+  for (uint32_t i = 0; i < 20; i++) {
+    timer.ready.push_back(std::vector<ProfilerSample>(1));
+    timer.ready.back()[0].endMs = i < 10 ? 1000.0f : 2.0f;
+    timer.readyFrames.push_back(100 + i);
+    profiler.BeginFrame();
+    profiler.EndFrame();
+  }
+  stats = profiler.GetGpuStats(Profiler::frameNode);
+  CHECK(stats.samples == 10);
+  CHECK(stats.p99 == 2.0f);
+  CHECK(profiler.GetCpuStats(Profiler::frameNode).samples == 10);
+}
+
+TEST(ProfilerBoundsScopesWithoutFrames) {
+  Profiler profiler;
+  uint32_t extra = 1000;
+  for (uint32_t i = 0; i < Profiler::maxClosedScopes + extra; i++) {
+    profiler.BeginScope("Headless");
+    profiler.EndScope();
+  }
+  profiler.BeginFrame();
+  profiler.EndFrame();
+  CHECK(profiler.GetLastCpuFrame().size() == Profiler::maxClosedScopes);
+  CHECK(profiler.GetLastDroppedScopes() == extra + 1); // the frame scope does not fit either
+
+  profiler.BeginFrame();
+  profiler.EndFrame();
+  CHECK(profiler.GetLastCpuFrame().size() == 1);
+  CHECK(profiler.GetLastDroppedScopes() == 0);
+}
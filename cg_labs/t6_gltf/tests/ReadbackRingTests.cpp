@@ -0,0 +1,121 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../ReadbackRing.h"
+
+namespace {
+  // GPU whose copies finish a fixed number of frames after submission; the copied value is the frame
+  class FakeSlots : public ReadbackSlots {
+  public:
+    FakeSlots(uint32_t size, uint64_t delayFrames) : slots(size), delay(delayFrames) {}
+
+    void Copy(uint32_t slot) override {
+      CHECK(slot < slots.size());
+      CHECK(!slots[slot].busy);
+      slots[slot] = { true, frame + delay, (float)frame };
+      copies.push_back(slot);
+    }
+
+    bool TryRead(uint32_t slot, float& value) override {
+      CHECK(slot < slots.size());
+      if (!slots[slot].busy || frame < slots[slot].readyFrame)
+        return false;
+      slots[slot].busy = false;
+      value = slots[slot].value;
+      return true;
+    }
+
+    struct Slot {
+      bool busy = false;
+      uint64_t readyFrame = 0;
+      float value = 0.0f;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> copies;
+    uint64_t delay;
+    uint64_t frame = 0;
+  };
+}
+
+TEST(ReadbackRingValueArrivesWithGPULatency) {
+  ReadbackRing ring(3);
+  FakeSlots gpu(3, 2);
+  for (gpu.frame = 1; gpu.frame <= 20; gpu.frame++) {
+    ReadbackResult result;
+    bool read = ring.Poll(gpu, gpu.frame, result);
+    CHECK(ring.Submit(gpu, gpu.frame, gpu.frame * 0.016));
+    if (gpu.frame <= 2) {
+      CHECK(!read);
+      continue;
+    }
+    CHECK(read);
+    CHECK(result.frame == gpu.frame - 2);
+    CHECK(result.value == (float)result.frame);
+    CHECK(result.latencyFrames == 2);
+    CHECK_NEAR(result.submitTime, result.frame * 0.016, 1e-9);
+  }
+  CHECK(ring.GetStats().skipped == 0);
+  CHECK(ring.GetStats().maxLatencyFrames == 2);
+}
+
+TEST(ReadbackRingReusesSlotsInOrder) {
+  ReadbackRing ring(3);
+  FakeSlots gpu(3, 1);
+  for (gpu.frame = 1; gpu.frame <= 9; gpu.frame++) {
+    ReadbackResult result;
+    ring.Poll(gpu, gpu.frame, result);
+    ring.Submit(gpu, gpu.frame, 0.0);
+  }
+  // With latency 1 only two slots are ever in flight, and they go round the ring
+  CHECK(gpu.copies.size() == 9);
+  for (size_t i = 0; i < gpu.copies.size(); i++)
+    CHECK(gpu.copies[i] == i % 3);
+  CHECK(ring.GetInFlight() == 1);
+}
+
+TEST(ReadbackRingSkipsFramesWhenAllSlotsAreInFlight) {
+  ReadbackRing ring(2);
+  FakeSlots gpu(2, 4);
+  uint64_t submitted = 0;
+  for (gpu.frame = 1; gpu.frame <= 12; gpu.frame++) {
+    ReadbackResult result;
+    if (ring.Poll(gpu, gpu.frame, result))
+      CHECK(result.latencyFrames >= 4);
+    if (ring.Submit(gpu, gpu.frame, 0.0))
+      submitted++;
+    CHECK(ring.GetInFlight() <= 2);
+  }
+  const ReadbackRingStats& stats = ring.GetStats();
+  CHECK(stats.submitted == submitted);
+  CHECK(stats.skipped == 12 - submitted);
+  CHECK(stats.skipped > 0);
+  CHECK(stats.read + ring.GetInFlight() == stats.submitted);
+}
+
+TEST(ReadbackRingPollReturnsNewestFinishedValue) {
+  ReadbackRing ring(4);
+  FakeSlots gpu(4, 1);
+  for (gpu.frame = 1; gpu.frame <= 3; gpu.frame++)
+    ring.Submit(gpu, gpu.frame, 0.0);
+  // Frame 1 to 3 copies have all finished by frame 10
+  gpu.frame = 10;
+  ReadbackResult result;
+  CHECK(ring.Poll(gpu, gpu.frame, result));
+  CHECK(result.frame == 3);
+  CHECK(result.latencyFrames == 7);
+  CHECK(ring.GetInFlight() == 0);
+  CHECK(ring.GetStats().read == 3);
+}
+
+TEST(ReadbackRingResizeDropsInFlightCopies) {
+  ReadbackRing ring(3);
+  FakeSlots gpu(3, 5);
+  gpu.frame = 1;
+  ring.Submit(gpu, 1, 0.0);
+  ring.Submit(gpu, 1, 0.0);
+  ring.Resize(5);
+  CHECK(ring.GetSize() == 5);
+  CHECK(ring.GetInFlight() == 0);
+  CHECK(ring.GetStats().submitted == 0);
+}
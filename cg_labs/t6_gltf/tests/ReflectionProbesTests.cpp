@@ -0,0 +1,63 @@
+#include "Test.h"
+
+#include <vector>
+
+#include "../ReflectionProbes.h"
+
+namespace {
+  void CaptureRequested(ReflectionProbeManager& manager, const float pos[3]) {
+    float camera[3] = { 0, 0, 0 };
+    manager.BeginFrame(camera);
+    manager.Blend(pos);
+    std::vector<uint32_t> toCapture;
+    manager.ScheduleCaptures(toCapture);
+    for (uint32_t id : toCapture)
+      manager.OnCaptured(id);
+    manager.BeginFrame(camera);
+  }
+}
+
+TEST(ReflectionProbesBlendKeepsHighPriorityAmongManyOverlapping) {
+  ReflectionProbeParams params;
+  params.cacheSlots = 32;
+  params.maxCapturesPerFrame = 32;
+  ReflectionProbeManager manager(params);
+
+  // 20 equal probes over the point, the important one is found last
+  ReflectionProbeDesc desc;
+  for (int i = 0; i < 20; i++)
+    manager.AddProbe(desc);
+  desc.priority = 5;
+  uint32_t important = manager.AddProbe(desc);
+
+  float pos[3] = { 0, 0, 0 };
+  CaptureRequested(manager, pos);
+  CHECK(manager.IsCaptured(important));
+
+  ProbeBlend blend = manager.Blend(pos);
+  CHECK(blend.count == ProbeBlend::maxProbes);
+  CHECK(blend.probes[0] == important);
+}
+
+TEST(ReflectionProbesBlendKeepsClosestAmongManyOverlapping) {
+  ReflectionProbeParams params;
+  params.cacheSlots = 32;
+  params.maxCapturesPerFrame = 32;
+  ReflectionProbeManager manager(params);
+
+  // Point is near the border of the first 20 probes and deep inside the last one
+  ReflectionProbeDesc desc;
+  desc.influenceMin[0] = -0.5f;
+  for (int i = 0; i < 20; i++)
+    manager.AddProbe(desc);
+  desc.influenceMin[0] = -5.0f;
+  uint32_t inner = manager.AddProbe(desc);
+
+  float pos[3] = { -0.2f, 0, 0 };
+  CaptureRequested(manager, pos);
+
+  ProbeBlend blend = manager.Blend(pos);
+  CHECK(blend.count >= 1);
+  CHECK(blend.probes[0] == inner);
+  CHECK_NEAR(blend.weights[0], 1.0, 1e-6);
+}
@@ -0,0 +1,241 @@
+#include "Test.h"
+
+#include <string>
+#include <vector>
+
+#include "../RenderGraph.h"
+
+namespace {
+  // Logs backend calls and pass runs as one stream
+  class FakeBackend : public RenderGraphBackend {
+  public:
+    bool Acquire(uint32_t resource, const TransientResourceDesc&) override {
+      if (resource == failResource) {
+        log.push_back("fail " + std::to_string(resource));
+        return false;
+      }
+      log.push_back("acquire " + std::to_string(resource));
+      return true;
+    }
+    void Release(uint32_t resource) override { log.push_back("release " + std::to_string(resource)); }
+    void Barrier(const RenderGraphBarrier& barrier) override {
+      log.push_back(std::string(barrier.kind == RenderGraphBarrier::Kind::unbindRenderTargets ? "unbind rtv " : "unbind srv ") +
+        std::to_string(barrier.resource));
+    }
+
+    std::vector<std::string> log;
+    uint32_t failResource = RenderGraph::invalidId;
+  };
+
+  TransientResourceDesc Desc() {
+    TransientResourceDesc desc;
+    desc.width = desc.height = 16;
+    return desc;
+  }
+
+  bool HasBarrier(const RenderGraph& graph, uint32_t pass, RenderGraphBarrier::Kind kind, uint32_t resource) {
+    for (const RenderGraphBarrier& barrier : graph.GetBarriers(pass))
+      if (barrier.kind == kind && barrier.resource == resource)
+        return true;
+    return false;
+  }
+}
+
+TEST(RenderGraphCullsPassesWithoutUsedResults) {
+  RenderGraph graph;
+  uint32_t backBuffer = graph.ImportResource("back buffer");
+  uint32_t hdr = graph.CreateResource("hdr", Desc());
+  uint32_t unused = graph.CreateResource("unused", Desc());
+  uint32_t stats = graph.CreateResource("stats", Desc());
+  graph.MarkOutput(backBuffer);
+
+  uint32_t scene = graph.AddPass("scene", nullptr);
+  graph.Write(scene, hdr);
+  uint32_t debug = graph.AddPass("debug", nullptr);
+  graph.Read(debug, hdr);
+  graph.Write(debug, unused);
+  uint32_t readback = graph.AddPass("readback", nullptr);
+  graph.Write(readback, stats);
+  graph.SetSideEffect(readback);
+  uint32_t tonemap = graph.AddPass("tonemap", nullptr);
+  graph.Read(tonemap, hdr);
+  graph.Write(tonemap, backBuffer);
+
+  CHECK(graph.Compile());
+  CHECK(!graph.IsCulled(scene));
+  CHECK(graph.IsCulled(debug));
+  CHECK(!graph.IsCulled(readback));
+  CHECK(!graph.IsCulled(tonemap));
+  CHECK(graph.GetOrder() == std::vector<uint32_t>({ scene, readback, tonemap }));
+  CHECK(graph.GetLifetime(unused).first == RenderGraph::invalidId);
+}
+
+TEST(RenderGraphOrdersReadersAfterWriters) {
+  RenderGraph graph;
+  uint32_t out = graph.ImportResource("out");
+  uint32_t a = graph.CreateResource("a", Desc());
+  uint32_t b = graph.CreateResource("b", Desc());
+  graph.MarkOutput(out);
+
+  // Declared in reverse of the dependency order
+  uint32_t combine = graph.AddPass("combine", nullptr);
+  graph.Read(combine, a);
+  graph.Read(combine, b);
+  graph.Write(combine, out);
+  uint32_t makeB = graph.AddPass("make b", nullptr);
+  graph.Read(makeB, a);
+  graph.Write(makeB, b);
+  uint32_t makeA = graph.AddPass("make a", nullptr);
+  graph.Write(makeA, a);
+
+  CHECK(graph.Compile());
+  CHECK(graph.GetOrder() == std::vector<uint32_t>({ makeA, makeB, combine }));
+}
+
+TEST(RenderGraphKeepsWriterDeclarationOrder) {
+  RenderGraph graph;
+  uint32_t target = graph.ImportResource("target");
+  graph.MarkOutput(target);
+  uint32_t sky = graph.AddPass("sky", nullptr);
+  graph.Write(sky, target);
+  uint32_t model = graph.AddPass("model", nullptr);
+  graph.Write(model, target);
+  // Read-modify-write pass runs after writers declared before it only
+  uint32_t blend = graph.AddPass("blend", nullptr);
+  graph.Read(blend, target);
+  graph.Write(blend, target);
+
+  CHECK(graph.Compile());
+  CHECK(graph.GetOrder() == std::vector<uint32_t>({ sky, model, blend }));
+}
+
+TEST(RenderGraphReportsCycle) {
+  RenderGraph graph;
+  uint32_t a = graph.CreateResource("a", Desc());
+  uint32_t b = graph.CreateResource("b", Desc());
+  uint32_t first = graph.AddPass("first", nullptr);
+  graph.Read(first, b);
+  graph.Write(first, a);
+  uint32_t second = graph.AddPass("second", nullptr);
+  graph.Read(second, a);
+  graph.Write(second, b);
+  graph.SetSideEffect(second);
+
+  CHECK(!graph.Compile());
+  CHECK(graph.GetError().find("cycle") != std::string::npos);
+  CHECK(graph.GetOrder().empty());
+
+  // Failed graph executes nothing
+  FakeBackend backend;
+  graph.Execute(backend);
+  CHECK(backend.log.empty());
+}
+
+TEST(RenderGraphReportsTransientReadWithoutWriter) {
+  RenderGraph graph;
+  uint32_t missing = graph.CreateResource("missing", Desc());
+  uint32_t pass = graph.AddPass("pass", nullptr);
+  graph.Read(pass, missing);
+  graph.SetSideEffect(pass);
+
+  CHECK(!graph.Compile());
+  CHECK(graph.GetError().find("missing") != std::string::npos);
+}
+
+TEST(RenderGraphLifetimesLetPoolAlias) {
+  RenderGraph graph;
+  uint32_t out = graph.ImportResource("out");
+  uint32_t first = graph.CreateResource("first", Desc());
+  uint32_t second = graph.CreateResource("second", Desc());
+  graph.MarkOutput(out);
+
+  uint32_t p0 = graph.AddPass("p0", nullptr);
+  graph.Write(p0, first);
+  uint32_t p1 = graph.AddPass("p1", nullptr);
+  graph.Read(p1, first);
+  graph.Write(p1, second);
+  uint32_t p2 = graph.AddPass("p2", nullptr);
+  graph.Read(p2, second);
+  graph.Write(p2, out);
+
+  CHECK(graph.Compile());
+  CHECK(graph.GetLifetime(first).first == 0 && graph.GetLifetime(first).last == 1);
+  CHECK(graph.GetLifetime(second).first == 1 && graph.GetLifetime(second).last == 2);
+  CHECK(graph.GetLifetime(out).first == 2 && graph.GetLifetime(out).last == 2);
+
+  // first is released before p2 acquires anything, imported out is never allocated
+  FakeBackend backend;
+  graph.Reset();
+  out = graph.ImportResource("out");
+  first = graph.CreateResource("first", Desc());
+  second = graph.CreateResource("second", Desc());
+  graph.MarkOutput(out);
+  p0 = graph.AddPass("p0", [&]() { backend.log.push_back("run p0"); });
+  graph.Write(p0, first);
+  p1 = graph.AddPass("p1", [&]() { backend.log.push_back("run p1"); });
+  graph.Read(p1, first);
+  graph.Write(p1, second);
+  p2 = graph.AddPass("p2", [&]() { backend.log.push_back("run p2"); });
+  graph.Read(p2, second);
+  graph.Write(p2, out);
+  CHECK(graph.Compile());
+  graph.Execute(backend);
+  CHECK(backend.log == std::vector<std::string>({ "acquire 1", "run p0", "acquire 2", "unbind rtv 1", "run p1", "release 1",
+    "unbind rtv 2", "run p2", "release 2" }));
+}
+
+TEST(RenderGraphBarriersOfViewHazards) {
+  RenderGraph graph;
+  uint32_t out = graph.ImportResource("out");
+  uint32_t hdr = graph.CreateResource("hdr", Desc());
+  graph.MarkOutput(out);
+
+  uint32_t scene = graph.AddPass("scene", nullptr);
+  graph.Write(scene, hdr);
+  uint32_t blur = graph.AddPass("blur", nullptr);
+  graph.Read(blur, hdr);
+  graph.Write(blur, out);
+  uint32_t compose = graph.AddPass("compose", nullptr);
+  graph.Read(compose, hdr);
+  graph.Read(compose, out);
+  graph.Write(compose, out);
+
+  CHECK(graph.Compile());
+  CHECK(graph.GetBarriers(scene).empty());
+  // Render target written by the previous pass is read now
+  CHECK(HasBarrier(graph, blur, RenderGraphBarrier::Kind::unbindRenderTargets, hdr));
+  CHECK(HasBarrier(graph, compose, RenderGraphBarrier::Kind::unbindRenderTargets, out));
+  // hdr stays a shader resource, read-modify-write of out needs no unbind of its shader views
+  CHECK(!HasBarrier(graph, compose, RenderGraphBarrier::Kind::unbindRenderTargets, hdr));
+  CHECK(!HasBarrier(graph, compose, RenderGraphBarrier::Kind::unbindShaderResources, out));
+}
+
+TEST(RenderGraphStopsWhenAcquireFails) {
+  RenderGraph graph;
+  uint32_t out = graph.ImportResource("out");
+  uint32_t first = graph.CreateResource("first", Desc());
+  uint32_t second = graph.CreateResource("second", Desc());
+  graph.MarkOutput(out);
+
+  FakeBackend backend;
+  backend.failResource = second;
+  uint32_t p0 = graph.AddPass("p0", [&backend]() { backend.log.push_back("run p0"); });
+  graph.Write(p0, first);
+  uint32_t p1 = graph.AddPass("p1", [&backend]() { backend.log.push_back("run p1"); });
+  graph.Read(p1, first);
+  graph.Write(p1, second);
+  uint32_t p2 = graph.AddPass("p2", [&backend]() { backend.log.push_back("run p2"); });
+  graph.Read(p2, second);
+  graph.Write(p2, out);
+  CHECK(graph.Compile());
+
+  // No pass runs on the missing resource, the live one goes back to the pool
+  CHECK(!graph.Execute(backend));
+  CHECK(backend.log == std::vector<std::string>({ "acquire 1", "run p0", "fail 2", "release 1" }));
+  CHECK(graph.GetError().find("second") != std::string::npos);
+
+  backend.log.clear();
+  backend.failResource = RenderGraph::invalidId;
+  CHECK(graph.Execute(backend));
+  CHECK(backend.log.back() == "release 2");
+}
@@ -0,0 +1,204 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDir(path) mkdir(path, 0755)
+#endif
+
+#include "../ShaderCache.h"
+
+namespace {
+  void WriteText(const std::string& path, const std::string& text) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+  }
+
+  bool Contains(const std::vector<std::string>& list, const std::string& value) {
+    return std::find(list.begin(), list.end(), value) != list.end();
+  }
+
+  ShaderDesc Desc(const std::string& file) {
+    ShaderDesc desc;
+    desc.file = file;
+    desc.profile = "ps_5_0";
+    return desc;
+  }
+}
+
+TEST(ShaderCacheKeyResolvesIncludesNextToIncludingFile) {
+  TestTempDir temp("shader_cache_relative");
+  std::string dir = temp.Path() + "/";
+  MakeDir((dir + "inner").c_str());
+  WriteText(dir + "main.hlsl", "#include \"common.h\"\nfloat4 main() : SV_TARGET { return Common(); }\n");
+  WriteText(dir + "common.h", "#include \"inner/deep.h\"\nfloat4 Common() { return Deep(); }\n");
+  WriteText(dir + "inner/deep.h", "#include \"leaf.h\"\nfloat4 Deep() { return 1; }\n");
+  WriteText(dir + "inner/leaf.h", "// leaf\n");
+
+  uint64_t key = 0;
+  std::vector<std::string> dependencies;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ dir + "common.h", dir + "inner/deep.h", dir + "inner/leaf.h" }));
+
+  // Change of a nested include changes the key
+  WriteText(dir + "inner/leaf.h", "// leaf 2\n");
+  uint64_t changed = 0;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), changed));
+  CHECK(changed != key);
+}
+
+TEST(ShaderCacheKeySkipsIncludesInCommentsAndInactiveBlocks) {
+  TestTempDir temp("shader_cache_inactive");
+  std::string dir = temp.Path() + "/";
+  WriteText(dir + "main.hlsl",
+    "// #include \"line_comment.h\"\n"
+    "/* #include \"block_comment.h\"\n"
+    "#include \"block_comment2.h\" */\n"
+    "#if 0\n#include \"if_zero.h\"\n#endif\n"
+    "#ifdef FEATURE\n#include \"feature.h\"\n#else\n#include \"no_feature.h\"\n#endif\n"
+    "#ifndef VIEW_MODE\n#define VIEW_MODE 0\n#endif\n"
+    "#if VIEW_MODE == 2\n#include \"mode2.h\"\n#elif VIEW_MODE == 3 && defined(FEATURE)\n#include \"mode3.h\"\n#else\n#include \"mode_other.h\"\n#endif\n");
+  const char* headers[] = { "line_comment.h", "block_comment.h", "block_comment2.h", "if_zero.h", "feature.h", "no_feature.h",
+    "mode2.h", "mode3.h", "mode_other.h" };
+  for (const char* header : headers)
+    WriteText(dir + header, "\n");
+
+  uint64_t key = 0;
+  std::vector<std::string> dependencies;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ dir + "no_feature.h", dir + "mode_other.h" }));
+
+  ShaderDesc desc = Desc(dir + "main.hlsl");
+  desc.defines = { { "FEATURE", "1" }, { "VIEW_MODE", "3" } };
+  CHECK(ComputeShaderKey(desc, key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ dir + "feature.h", dir + "mode3.h" }));
+
+  desc.defines = { { "VIEW_MODE", "2" } };
+  CHECK(ComputeShaderKey(desc, key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ dir + "no_feature.h", dir + "mode2.h" }));
+}
+
+TEST(ShaderCacheKeyCountsIncludesUnderUnknownConditions) {
+  TestTempDir temp("shader_cache_unknown");
+  std::string dir = temp.Path() + "/";
+  WriteText(dir + "main.hlsl",
+    "#if SIZE + 1 > 2\n#include \"expression.h\"\n#else\n#include \"expression_else.h\"\n#endif\n"
+    "#ifdef NAME\n#define FROM_HEADER 1\n#endif\n"
+    "#ifdef FROM_HEADER\n#include \"maybe.h\"\n#endif\n");
+  WriteText(dir + "expression.h", "\n");
+  WriteText(dir + "expression_else.h", "\n");
+  WriteText(dir + "maybe.h", "\n");
+
+  uint64_t key = 0;
+  std::vector<std::string> dependencies;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), key, &dependencies));
+  CHECK(Contains(dependencies, dir + "expression.h"));
+  CHECK(Contains(dependencies, dir + "expression_else.h"));
+  // NAME is undefined, so FROM_HEADER is known to be undefined
+  CHECK(!Contains(dependencies, dir + "maybe.h"));
+}
+
+TEST(ShaderCacheKeyUsesMacrosOfIncludedFiles) {
+  TestTempDir temp("shader_cache_macros");
+  std::string dir = temp.Path() + "/";
+  WriteText(dir + "main.hlsl", "#include \"config.h\"\n#if USE_EXTRA\n#include \"extra.h\"\n#endif\n");
+  WriteText(dir + "config.h", "#define USE_EXTRA 1\n");
+  WriteText(dir + "extra.h", "\n");
+
+  uint64_t key = 0;
+  std::vector<std::string> dependencies;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ dir + "config.h", dir + "extra.h" }));
+}
+
+TEST(ShaderCacheKeyTreatsMissingIncludeAsDependency) {
+  TestTempDir temp("shader_cache_missing");
+  std::string dir = temp.Path() + "/";
+  WriteText(dir + "main.hlsl", "#ifdef OPTIONAL\n#include \"optional.h\"\n#endif\n#include \"later.h\"\n");
+  std::remove((dir + "later.h").c_str());
+
+  uint64_t key = 0;
+  std::vector<std::string> dependencies;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), key, &dependencies));
+  CHECK(dependencies == std::vector<std::string>({ "later.h" }));
+
+  // The file appearing next to the source changes the key
+  WriteText(dir + "later.h", "\n");
+  uint64_t found = 0;
+  CHECK(ComputeShaderKey(Desc(dir + "main.hlsl"), found, &dependencies));
+  CHECK(found != key);
+  CHECK(dependencies == std::vector<std::string>({ dir + "later.h" }));
+
+  // Only a missing source fails
+  CHECK(!ComputeShaderKey(Desc(dir + "no_such_file.hlsl"), key));
+}
+
+TEST(ShaderCacheKeyDependsOnDesc) {
+  TestTempDir temp("shader_cache_desc");
+  std::string dir = temp.Path() + "/";
+  WriteText(dir + "main.hlsl", "float4 main() : SV_TARGET { return 0; }\n");
+  ShaderDesc desc = Desc(dir + "main.hlsl");
+  uint64_t base = 0, other = 0;
+  CHECK(ComputeShaderKey(desc, base));
+  CHECK(ComputeShaderKey(desc, other) && other == base);
+
+  ShaderDesc changed = desc;
+  changed.entry = "other";
+  CHECK(ComputeShaderKey(changed, other) && other != base);
+  changed = desc;
+  changed.defines = { { "A", "1" } };
+  CHECK(ComputeShaderKey(changed, other) && other != base);
+  changed = desc;
+  changed.flags = 1;
+  CHECK(ComputeShaderKey(changed, other) && other != base);
+}
+
+TEST(ShaderIncludeTrackerResolvesAgainstParent) {
+  TestTempDir temp("shader_cache_tracker");
+  std::string dir = temp.Path() + "/";
+  MakeDir((dir + "sub").c_str());
+  WriteText(dir + "main.hlsl", "\n");
+  WriteText(dir + "sub/a.h", "a");
+  WriteText(dir + "sub/b.h", "b");
+
+  ShaderIncludeTracker tracker(dir + "main.hlsl");
+  uint32_t size = 0;
+  const char* a = tracker.Open("sub/a.h", nullptr, size);
+  CHECK(a && size == 1 && a[0] == 'a');
+  const char* b = a ? tracker.Open("b.h", a, size) : nullptr;
+  CHECK(b && b[0] == 'b');
+  CHECK(!tracker.Open("missing.h", nullptr, size));
+  if (b)
+    tracker.Close(b);
+  if (a)
+    tracker.Close(a);
+  CHECK(tracker.GetDependencies() == std::vector<std::string>({ dir + "sub/a.h", dir + "sub/b.h" }));
+}
+
+TEST(ShaderCacheStoresBytecodeAndIndex) {
+  TestTempDir temp("shader_cache_cache");
+  std::string dir = temp.Path() + "/";
+  ShaderCache cache(dir);
+  const uint8_t bytecode[] = { 1, 2, 3, 0, 255 };
+  CHECK(cache.Store(0x1234abcdull, bytecode, sizeof(bytecode)));
+  std::vector<uint8_t> loaded;
+  CHECK(cache.Load(0x1234abcdull, loaded));
+  CHECK(loaded == std::vector<uint8_t>(bytecode, bytecode + sizeof(bytecode)));
+  CHECK(!cache.Load(0x1234abceull, loaded));
+
+  ShaderDesc desc = Desc("a.hlsl");
+  desc.defines = { { "A", "1" }, { "B", "" } };
+  desc.flags = 5;
+  CHECK(cache.StoreIndex({ desc, Desc("b.hlsl") }));
+  std::vector<ShaderDesc> descs;
+  CHECK(cache.LoadIndex(descs));
+  CHECK(descs.size() == 2 && descs[0] == desc && descs[1] == Desc("b.hlsl"));
+}
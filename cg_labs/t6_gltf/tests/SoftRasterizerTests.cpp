@@ -0,0 +1,236 @@
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+#include "../SoftRasterizer.h"
+
+namespace {
+  // Positions are given in pixels, identity view projection maps them to the screen as is
+  struct ScreenScene {
+    ScreenScene(uint32_t width, uint32_t height) : width(width), height(height) {
+      // View mode 3 shows the albedo texture, so every pixel tells which mesh covers it
+      scene.shading.modelViewMode = 3;
+      const float colors[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+      for (const float* color : colors) {
+        HDRImage texture;
+        texture.Resize(1, 1);
+        memcpy(texture.Texel(0, 0), color, sizeof(float) * 3);
+        texture.Texel(0, 0)[3] = 1.0f;
+        scene.textures.push_back(texture);
+      }
+      memcpy(camera.viewProjection, identity, sizeof(identity));
+      camera.position[0] = camera.position[1] = 0.0f;
+      camera.position[2] = -1.0f;
+    }
+
+    SoftVertex Vertex(float x, float y, float z) const {
+      SoftVertex vertex = {};
+      vertex.pos[0] = x / width * 2.0f - 1.0f;
+      vertex.pos[1] = 1.0f - y / height * 2.0f;
+      vertex.pos[2] = z;
+      vertex.norm[2] = -1.0f;
+      vertex.tangent[0] = 1.0f;
+      return vertex;
+    }
+
+    // Mesh of triangles given by pixel positions (x, y) at one depth, colored by texture
+    void AddMesh(const std::vector<float>& xy, float z, int texture) {
+      SoftMesh mesh;
+      for (size_t i = 0; i + 1 < xy.size(); i += 2) {
+        mesh.indices.push_back((uint32_t)mesh.vertices.size());
+        mesh.vertices.push_back(Vertex(xy[i], xy[i + 1], z));
+      }
+      mesh.material.albedoTex = texture;
+      scene.meshes.push_back(mesh);
+    }
+
+    const SoftFrameStats& Render(SoftRasterizer& rasterizer) {
+      rasterizer.Render(scene, camera, width, height, color);
+      return rasterizer.GetStats();
+    }
+
+    bool IsColor(uint32_t x, uint32_t y, int texture) const {
+      return memcmp(color.Texel(x, y), scene.textures[texture].Texel(0, 0), sizeof(float) * 3) == 0;
+    }
+
+    static const float identity[16];
+
+    uint32_t width, height;
+    SoftScene scene;
+    SoftCamera camera;
+    HDRImage color;
+  };
+
+  const float ScreenScene::identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+  SoftRasterizer Rasterizer(uint32_t tileSize, uint32_t threads = 0) {
+    SoftRasterizerSettings settings;
+    settings.tileSize = tileSize;
+    settings.threads = threads;
+    return SoftRasterizer(settings);
+  }
+
+  // Two triangles per cell of a grid over the whole screen, inner points are jittered off and onto pixel centers
+  std::vector<float> ScreenGrid(uint32_t width, uint32_t height, uint32_t cellsX, uint32_t cellsY) {
+    const float jitter[] = { 0.0f, 0.5f, 0.3f, -0.25f, 0.0625f, -0.5f };
+    auto point = [&](uint32_t i, uint32_t j, float* out) {
+      out[0] = (float)width * i / cellsX;
+      out[1] = (float)height * j / cellsY;
+      if (i > 0 && i < cellsX)
+        out[0] = (int)out[0] + 0.5f + jitter[(i + j) % 6];
+      if (j > 0 && j < cellsY)
+        out[1] = (int)out[1] + 0.5f + jitter[(i * 2 + j) % 6];
+    };
+
+    std::vector<float> xy;
+    for (uint32_t j = 0; j < cellsY; j++)
+      for (uint32_t i = 0; i < cellsX; i++) {
+        float p00[2], p10[2], p01[2], p11[2];
+        point(i, j, p00);
+        point(i + 1, j, p10);
+        point(i, j + 1, p01);
+        point(i + 1, j + 1, p11);
+        // Diagonals alternate, half of the triangles are clockwise
+        if ((i + j) % 2 == 0)
+          xy.insert(xy.end(), { p00[0], p00[1], p10[0], p10[1], p11[0], p11[1], p00[0], p00[1], p01[0], p01[1], p11[0], p11[1] });
+        else
+          xy.insert(xy.end(), { p10[0], p10[1], p01[0], p01[1], p00[0], p00[1], p10[0], p10[1], p11[0], p11[1], p01[0], p01[1] });
+      }
+    return xy;
+  }
+}
+
+TEST(SoftRasterizerSharedEdgesCoverPixelsOnce) {
+  const uint32_t width = 37, height = 29;
+  std::vector<float> grid = ScreenGrid(width, height, 5, 4);
+  SoftRasterizer rasterizer = Rasterizer(16);
+
+  // Pixels of separately drawn triangles add up to the screen: no gaps and no double coverage
+  uint64_t sum = 0;
+  for (size_t t = 0; t < grid.size(); t += 6) {
+    ScreenScene single(width, height);
+    single.AddMesh(std::vector<float>(grid.begin() + t, grid.begin() + t + 6), 0.5f, 0);
+    sum += single.Render(rasterizer).pixelsShaded;
+  }
+  CHECK(sum == width * height);
+
+  ScreenScene all(width, height);
+  all.AddMesh(grid, 0.5f, 0);
+  const SoftFrameStats& stats = all.Render(rasterizer);
+  CHECK(stats.trianglesSetup == grid.size() / 6);
+  CHECK(stats.pixelsShaded == width * height);
+  for (uint32_t y = 0; y < height; y++)
+    for (uint32_t x = 0; x < width; x++)
+      CHECK(all.IsColor(x, y, 0));
+}
+
+TEST(SoftRasterizerNearerTriangleWins) {
+  const uint32_t width = 40, height = 24;
+  const std::vector<float> quad = { 4, 4, 36, 4, 36, 20, 4, 4, 36, 20, 4, 20 };
+  SoftRasterizer rasterizer = Rasterizer(16);
+
+  for (int order = 0; order < 2; order++) {
+    ScreenScene scene(width, height);
+    scene.AddMesh(quad, order == 0 ? 0.25f : 0.75f, order == 0 ? 0 : 1);
+    scene.AddMesh(quad, order == 0 ? 0.75f : 0.25f, order == 0 ? 1 : 0);
+    // Only the farther quad covers this stripe
+    scene.AddMesh({ 20, 0, 40, 0, 40, 24 }, 0.9f, 2);
+    scene.Render(rasterizer);
+
+    CHECK(scene.IsColor(10, 15, 0));
+    CHECK_NEAR(rasterizer.GetDepth()[15 * width + 10], 0.25f, 1e-6f);
+    CHECK(scene.IsColor(38, 2, 2));
+    CHECK_NEAR(rasterizer.GetDepth()[2 * width + 38], 0.9f, 1e-6f);
+    // Background keeps the far plane
+    CHECK(rasterizer.GetDepth()[23 * width + 0] == 1.0f);
+  }
+}
+
+TEST(SoftRasterizerBinsTrianglesByBounds) {
+  const uint32_t width = 64, height = 48;
+  SoftRasterizer rasterizer = Rasterizer(16);
+
+  ScreenScene inside(width, height);
+  inside.AddMesh({ 2, 2, 10, 2, 2, 10 }, 0.5f, 0);
+  const SoftFrameStats& insideStats = inside.Render(rasterizer);
+  CHECK(insideStats.tiles == 4 * 3);
+  CHECK(insideStats.trianglesSetup == 1);
+  CHECK(insideStats.binnedTriangles == 1);
+
+  // Bounds cross a tile corner
+  ScreenScene corner(width, height);
+  corner.AddMesh({ 12, 12, 20, 12, 12, 20 }, 0.5f, 0);
+  CHECK(corner.Render(rasterizer).binnedTriangles == 4);
+
+  // Behind the near plane, degenerate and off screen triangles are not set up
+  ScreenScene rejected(width, height);
+  rejected.AddMesh({ 2, 2, 10, 2, 2, 10 }, -0.5f, 0);
+  rejected.AddMesh({ 2, 2, 10, 10, 20, 20 }, 0.5f, 0);
+  rejected.AddMesh({ -40, 2, -20, 2, -40, 10 }, 0.5f, 0);
+  const SoftFrameStats& rejectedStats = rejected.Render(rasterizer);
+  CHECK(rejectedStats.trianglesIn == 3);
+  CHECK(rejectedStats.trianglesSetup == 0);
+  CHECK(rejectedStats.binnedTriangles == 0);
+  CHECK(rejectedStats.pixelsShaded == 0);
+}
+
+TEST(SoftRasterizerImageDoesNotDependOnThreads) {
+  const uint32_t width = 53, height = 41;
+  ScreenScene scene(width, height);
+  scene.AddMesh(ScreenGrid(width, height, 7, 5), 0.5f, 0);
+  scene.AddMesh({ 3, 5, 50, 9, 20, 38 }, 0.25f, 1);
+  scene.AddMesh({ 30, 2, 52, 40, 8, 30 }, 0.4f, 2);
+
+  SoftRasterizer single = Rasterizer(8, 1);
+  scene.Render(single);
+  HDRImage reference = scene.color;
+  std::vector<float> referenceDepth = single.GetDepth();
+
+  SoftRasterizer parallel = Rasterizer(8);
+  scene.Render(parallel);
+  CHECK(scene.color.data == reference.data);
+  CHECK(parallel.GetDepth() == referenceDepth);
+}
+
+TEST(SoftRasterizerMissingTexturesUseMaterialConstants) {
+  SoftScene scene;
+  scene.shading.roughness = 0.3f;
+  scene.shading.metalness = 0.6f;
+  scene.shading.dielectricF0 = 0.04f;
+  scene.shading.albedo[0] = 0.8f, scene.shading.albedo[1] = 0.4f, scene.shading.albedo[2] = 0.2f;
+  SoftLight light = { { 1, 2, -3, 0 }, { 1, 1, 1, 5 } };
+  scene.lights.push_back(light);
+
+  // Textures holding the same constants: flat normal, metalness/roughness and albedo
+  const float texels[3][4] = { { 0.5f, 0.5f, 1, 1 }, { 0.6f, 0.3f, 0, 1 }, { 0.8f, 0.4f, 0.2f, 1 } };
+  for (const float* texel : texels) {
+    HDRImage texture;
+    texture.Resize(1, 1);
+    memcpy(texture.Texel(0, 0), texel, sizeof(float) * 4);
+    scene.textures.push_back(texture);
+  }
+  SoftMaterial textured;
+  textured.normalTex = 0;
+  textured.metalRoughTex = 1;
+  textured.albedoTex = 2;
+  SoftMaterial missing;
+
+  const float camPos[3] = { 0, 0, -2 }, world[3] = { 0, 0, 0 }, normal[3] = { 0, 0, -1 }, tangent[3] = { 1, 0, 0 }, uv[2] = {};
+  float expected[3], rgb[3];
+  SoftRasterizer::ShadePixel(scene, textured, camPos, world, normal, tangent, uv, expected);
+  SoftRasterizer::ShadePixel(scene, missing, camPos, world, normal, tangent, uv, rgb);
+  CHECK(expected[0] > 0.0f);
+  for (int c = 0; c < 3; c++)
+    CHECK_NEAR(rgb[c], expected[c], 1e-5f);
+
+  // Debug views show what the shader samples from null views
+  scene.shading.modelViewMode = 2;
+  SoftRasterizer::ShadePixel(scene, missing, camPos, world, normal, tangent, uv, rgb);
+  CHECK(rgb[0] == 0.0f && rgb[1] == 0.0f && rgb[2] == 0.0f);
+  scene.shading.modelViewMode = 3;
+  SoftRasterizer::ShadePixel(scene, missing, camPos, world, normal, tangent, uv, rgb);
+  CHECK(rgb[0] == 0.0f && rgb[1] == 0.0f && rgb[2] == 0.0f);
+  SoftRasterizer::ShadePixel(scene, textured, camPos, world, normal, tangent, uv, rgb);
+  CHECK_NEAR(rgb[0], 0.8f, 1e-6f);
+}
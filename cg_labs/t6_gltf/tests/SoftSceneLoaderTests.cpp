@@ -0,0 +1,202 @@
+#include "Test.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../SoftSceneLoader.h"
+#include "../../libs/stb_image_write.h"
+
+namespace {
+  void WriteFile(const std::string& path, const void* data, size_t size) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write((const char*)data, size);
+  }
+
+  // One triangle with every attribute, uint16 indices, a node hierarchy and two textures
+  void WriteModel(const TestTempDir& dir) {
+    const float pos[] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    const float norm[] = { 0.6f, 0.8f, 0, 0.6f, 0.8f, 0, 0.6f, 0.8f, 0 };
+    const float tangent[] = { 1, 0, 0, -1, 1, 0, 0, -1, 1, 0, 0, -1 };
+    const float uv[] = { 0, 0, 1, 0, 0.5f, 1 };
+    const uint16_t indices[] = { 0, 2, 1, 0 };
+    std::vector<uint8_t> bin;
+    for (auto block : { std::make_pair((const void*)pos, sizeof(pos)), std::make_pair((const void*)norm, sizeof(norm)),
+      std::make_pair((const void*)tangent, sizeof(tangent)), std::make_pair((const void*)uv, sizeof(uv)),
+      std::make_pair((const void*)indices, sizeof(indices)) })
+      bin.insert(bin.end(), (const uint8_t*)block.first, (const uint8_t*)block.first + block.second);
+    WriteFile(dir.Path("model.bin"), bin.data(), bin.size());
+
+    const std::string gltf = R"({
+      "asset": { "version": "2.0" },
+      "scene": 0,
+      "scenes": [ { "nodes": [ 0 ] } ],
+      "nodes": [ { "translation": [ 1, 2, 3 ], "children": [ 1 ] }, { "mesh": 0, "scale": [ 2, 2, 2 ] } ],
+      "meshes": [ { "primitives": [ { "attributes": { "POSITION": 0, "NORMAL": 1, "TANGENT": 2, "TEXCOORD_0": 3 }, "indices": 4, "material": 0 } ] } ],
+      "materials": [ { "pbrMetallicRoughness": { "baseColorTexture": { "index": 1 } }, "normalTexture": { "index": 0 } } ],
+      "textures": [ { "source": 1 }, { "source": 0 } ],
+      "images": [ { "uri": "albedo.png" }, { "uri": "normal.png" } ],
+      "buffers": [ { "uri": "model.bin", "byteLength": 152 } ],
+      "bufferViews": [
+        { "buffer": 0, "byteOffset": 0, "byteLength": 36 },
+        { "buffer": 0, "byteOffset": 36, "byteLength": 36 },
+        { "buffer": 0, "byteOffset": 72, "byteLength": 48 },
+        { "buffer": 0, "byteOffset": 120, "byteLength": 24 },
+        { "buffer": 0, "byteOffset": 144, "byteLength": 6 }
+      ],
+      "accessors": [
+        { "bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3" },
+        { "bufferView": 1, "componentType": 5126, "count": 3, "type": "VEC3" },
+        { "bufferView": 2, "componentType": 5126, "count": 3, "type": "VEC4" },
+        { "bufferView": 3, "componentType": 5126, "count": 3, "type": "VEC2" },
+        { "bufferView": 4, "componentType": 5123, "count": 3, "type": "SCALAR" }
+      ]
+    })";
+    WriteFile(dir.Path("model.gltf"), gltf.data(), gltf.size());
+
+    const uint8_t albedo[] = { 255, 0, 0, 255, 0, 51, 0, 255 };
+    const uint8_t normal[] = { 128, 128, 255, 255 };
+    stbi_write_png(dir.Path("albedo.png").c_str(), 2, 1, 4, albedo, 8);
+    stbi_write_png(dir.Path("normal.png").c_str(), 1, 1, 4, normal, 4);
+  }
+
+  // Flat Radiance file of one color
+  void WriteEnvironment(const std::string& path, uint32_t width, uint32_t height) {
+    std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+    std::vector<uint8_t> data(header.begin(), header.end());
+    for (uint32_t i = 0; i < width * height; i++)
+      data.insert(data.end(), { 128, 128, 128, 129 }); // 1.0
+    WriteFile(path, data.data(), data.size());
+  }
+}
+
+TEST(SoftSceneLoaderReadsModelLikeModel) {
+  TestTempDir dir("soft_loader");
+  WriteModel(dir);
+
+  SoftScene scene;
+  std::string error;
+  CHECK(LoadSoftModel(dir.Path("model.gltf"), dir.Path("model.bin"), scene, error));
+  CHECK(error.empty());
+  CHECK(scene.meshes.size() == 1);
+  if (scene.meshes.size() != 1)
+    return;
+
+  // x is flipped, tangent w is dropped
+  const SoftMesh& mesh = scene.meshes[0];
+  CHECK(mesh.vertices.size() == 3);
+  CHECK(mesh.vertices[0].pos[0] == -1.0f && mesh.vertices[1].pos[1] == 1.0f && mesh.vertices[2].pos[2] == 1.0f);
+  CHECK(mesh.vertices[0].norm[0] == -0.6f && mesh.vertices[0].norm[1] == 0.8f);
+  CHECK(mesh.vertices[1].tangent[0] == -1.0f && mesh.vertices[1].tangent[2] == 0.0f);
+  CHECK(mesh.vertices[2].texUV[0] == 0.5f && mesh.vertices[2].texUV[1] == 1.0f);
+  CHECK(mesh.indices == std::vector<uint32_t>({ 0, 2, 1 }));
+
+  // Parent translation, then child scale in row vector order like CountMatrixTransformation
+  const float world[16] = { 2, 0, 0, 0, 0, 2, 0, 0, 0, 0, 2, 0, 2, 4, 6, 1 };
+  CHECK(memcmp(mesh.world, world, sizeof(world)) == 0);
+
+  // Material texture ids go through textures[].source to images
+  CHECK(mesh.material.albedoTex == 0);
+  CHECK(mesh.material.normalTex == 1);
+  CHECK(mesh.material.metalRoughTex == -1);
+  CHECK(scene.textures.size() == 2);
+  if (scene.textures.size() == 2) {
+    CHECK(scene.textures[0].width == 2 && scene.textures[0].height == 1);
+    CHECK(scene.textures[0].Texel(0, 0)[0] == 1.0f);
+    CHECK_NEAR(scene.textures[0].Texel(1, 0)[1], 0.2f, 1e-6f);
+    CHECK_NEAR(scene.textures[1].Texel(0, 0)[0], 128 / 255.0f, 1e-6f);
+  }
+}
+
+TEST(SoftSceneLoaderReportsMissingFiles) {
+  TestTempDir dir("soft_loader_missing");
+  WriteModel(dir);
+
+  SoftScene scene;
+  std::string error;
+  CHECK(!LoadSoftModel(dir.Path("none.gltf"), dir.Path("model.bin"), scene, error));
+  CHECK(error.find("none.gltf") != std::string::npos);
+
+  error.clear();
+  CHECK(!LoadSoftModel(dir.Path("model.gltf"), dir.Path("none.bin"), scene, error));
+  CHECK(error.find("none.bin") != std::string::npos);
+
+  // Accessors past the end of a short .bin
+  std::vector<uint8_t> shortBin(100, 0);
+  WriteFile(dir.Path("short.bin"), shortBin.data(), shortBin.size());
+  error.clear();
+  CHECK(!LoadSoftModel(dir.Path("model.gltf"), dir.Path("short.bin"), scene, error));
+  CHECK(error.find("mesh 0") != std::string::npos);
+}
+
+TEST(SoftSceneLoaderCameraMatchesLookAt) {
+  BatchView view;
+  view.eye[0] = 1, view.eye[1] = 2, view.eye[2] = -3;
+  view.target[0] = 1, view.target[1] = 2, view.target[2] = 0;
+  view.fovY = 90.0f;
+  view.nearZ = 0.5f;
+  view.farZ = 10.0f;
+
+  SoftCamera camera;
+  MakeSoftCamera(view, 200, 100, camera);
+  CHECK(camera.position[0] == 1.0f && camera.position[2] == -3.0f);
+
+  auto project = [&](float x, float y, float z, float out[3]) {
+    float clip[4];
+    for (int c = 0; c < 4; c++)
+      clip[c] = x * camera.viewProjection[c] + y * camera.viewProjection[4 + c] + z * camera.viewProjection[8 + c] + camera.viewProjection[12 + c];
+    for (int c = 0; c < 3; c++)
+      out[c] = clip[c] / clip[3];
+  };
+
+  // Target is in the center, near and far planes go to 0 and 1, +x is right and +y is up with aspect 2
+  float ndc[3];
+  project(1, 2, -2.5f, ndc);
+  CHECK_NEAR(ndc[0], 0.0f, 1e-6f);
+  CHECK_NEAR(ndc[1], 0.0f, 1e-6f);
+  CHECK_NEAR(ndc[2], 0.0f, 1e-6f);
+  project(1, 2, 7.0f, ndc);
+  CHECK_NEAR(ndc[2], 1.0f, 1e-5f);
+  project(2, 3, -2.0f, ndc);
+  CHECK_NEAR(ndc[0], 0.5f, 1e-6f);
+  CHECK_NEAR(ndc[1], 1.0f, 1e-6f);
+}
+
+TEST(SoftSceneLoaderRendersBatchWithoutDevice) {
+  TestTempDir dir("soft_batch");
+  WriteModel(dir);
+  WriteEnvironment(dir.Path("env.hdr"), 16, 8);
+
+  BatchDesc desc;
+  desc.output.width = 32;
+  desc.output.height = 24;
+  desc.output.outputDir = dir.Path("out");
+  desc.output.fixedExposure = 1.0f;
+  BatchJob job;
+  job.name = "triangle";
+  job.scene.gltfPath = dir.Path("model.gltf");
+  job.scene.binPath = dir.Path("model.bin");
+  job.scene.environmentPath = dir.Path("env.hdr");
+  BatchView view;
+  view.name = "front";
+  view.eye[0] = 1, view.eye[1] = 5, view.eye[2] = -2;
+  view.target[0] = 1, view.target[1] = 5, view.target[2] = 6;
+  job.views.push_back(view);
+  desc.jobs.push_back(job);
+  // Second job fails to load, the first one is still written
+  job.name = "missing";
+  job.scene.gltfPath = dir.Path("none.gltf");
+  desc.jobs.push_back(job);
+
+  BatchOutputStats stats;
+  SoftFrameStats frameStats;
+  std::string error;
+  CHECK(!RenderSoftBatch(desc, { 0, 1 }, SoftRasterizerSettings(), stats, frameStats, error));
+  CHECK(error.find("missing") != std::string::npos);
+  CHECK(stats.written == 1 && stats.failed == 0);
+  CHECK(frameStats.trianglesIn == 1);
+  CHECK(frameStats.pixelsShaded > 0);
+  CHECK(std::ifstream(dir.Path("out/triangle_front.png")).good());
+}
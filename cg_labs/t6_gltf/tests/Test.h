@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// Minimal test registry: TEST(name) { CHECK(...); } in any tests/*.cpp, TestMain.cpp runs them all
+typedef void (*TestFunction)();
+
+struct TestCase {
+  const char* name;
+  TestFunction function;
+  TestCase* next;
+};
+
+class TestRegistry {
+public:
+  static TestRegistry& GetInstance();
+
+  void Add(TestCase& test);
+  void Fail(const char* file, int line, const char* expression);
+  // Returns number of failed tests
+  int RunAll(const char* filter);
+
+private:
+  TestCase* first = nullptr;
+  TestCase* last = nullptr;
+  bool currentFailed = false;
+};
+
+struct TestRegistrar {
+  TestRegistrar(TestCase& test) { TestRegistry::GetInstance().Add(test); }
+};
+
+#define TEST(name) \
+  static void name(); \
+  static TestCase name##Case = { #name, name, nullptr }; \
+  static TestRegistrar name##Registrar(name##Case); \
+  static void name()
+
+#define CHECK(expression) \
+  do { if (!(expression)) TestRegistry::GetInstance().Fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define CHECK_NEAR(a, b, eps) CHECK(std::fabs((double)(a) - (double)(b)) <= (eps))
+
+// Fresh folder in the system temp folder, removed with everything in it by the destructor
+class TestTempDir {
+public:
+  explicit TestTempDir(const char* name);
+  ~TestTempDir();
+
+  TestTempDir(const TestTempDir&) = delete;
+  TestTempDir& operator=(const TestTempDir&) = delete;
+
+  // Path of a file inside, empty name gives the folder itself
+  std::string Path(const std::string& name = "") const { return name.empty() ? path : path + "/" + name; }
+
+private:
+  std::string path;
+};
@@ -0,0 +1,115 @@
+#include "Test.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+TestRegistry& TestRegistry::GetInstance() {
+  static TestRegistry registry;
+  return registry;
+}
+
+void TestRegistry::Add(TestCase& test) {
+  if (last)
+    last->next = &test;
+  else
+    first = &test;
+  last = &test;
+}
+
+void TestRegistry::Fail(const char* file, int line, const char* expression) {
+  printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+  currentFailed = true;
+}
+
+int TestRegistry::RunAll(const char* filter) {
+  int run = 0, failed = 0;
+  for (TestCase* test = first; test; test = test->next) {
+    if (filter && !strstr(test->name, filter))
+      continue;
+    currentFailed = false;
+    test->function();
+    run++;
+    if (currentFailed) {
+      printf("FAILED %s\n", test->name);
+      failed++;
+    }
+  }
+  printf("%d tests, %d failed\n", run, failed);
+  return failed;
+}
+
+namespace {
+#ifdef _WIN32
+  void RemoveTree(const std::string& path) {
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+      do {
+        std::string name = data.cFileName;
+        if (name == "." || name == "..")
+          continue;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+          RemoveTree(path + "\\" + name);
+        else
+          DeleteFileA((path + "\\" + name).c_str());
+      } while (FindNextFileA(find, &data));
+      FindClose(find);
+    }
+    RemoveDirectoryA(path.c_str());
+  }
+#else
+  void RemoveTree(const std::string& path) {
+    if (DIR* dir = opendir(path.c_str())) {
+      while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+          continue;
+        std::string child = path + "/" + name;
+        struct stat st;
+        if (lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+          RemoveTree(child);
+        else
+          unlink(child.c_str());
+      }
+      closedir(dir);
+    }
+    rmdir(path.c_str());
+  }
+#endif
+}
+
+TestTempDir::TestTempDir(const char* name) {
+#ifdef _WIN32
+  char temp[MAX_PATH];
+  GetTempPathA(MAX_PATH, temp);
+  std::string base = std::string(temp) + "t6_gltf_" + name + "_" + std::to_string(GetCurrentProcessId());
+  for (int i = 0; i < 100 && path.empty(); i++) {
+    std::string candidate = i > 0 ? base + "_" + std::to_string(i) : base;
+    if (CreateDirectoryA(candidate.c_str(), nullptr))
+      path = candidate;
+  }
+#else
+  const char* temp = getenv("TMPDIR");
+  std::string pattern = std::string(temp && *temp ? temp : "/tmp") + "/t6_gltf_" + name + "_XXXXXX";
+  if (mkdtemp(&pattern[0]))
+    path = pattern;
+#endif
+}
+
+TestTempDir::~TestTempDir() {
+  if (!path.empty())
+    RemoveTree(path);
+}
+
+// t6_gltf_tests [name substring]
+int main(int argc, char** argv) {
+  return TestRegistry::GetInstance().RunAll(argc > 1 ? argv[1] : nullptr) == 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include "Test.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../TonemapLUT.h"
+
+TEST(TonemapLUTTexelsMatchOperator) {
+  for (TonemapOperator op : { TonemapOperator::acesFitted, TonemapOperator::agx, TonemapOperator::reinhardExtended,
+         TonemapOperator::uncharted2 }) {
+    TonemapLUTParams params;
+    params.op = op;
+    params.exposureBias = TonemapLUTParams::DefaultExposureBias(op);
+    params.size = 32;
+    TonemapLUT lut;
+    lut.Bake(params);
+
+    // Grid points are exact, trilinear in between stays close
+    float maxGridError = 0.0f;
+    const float last = (float)(params.size - 1);
+    for (uint32_t i = 0; i < params.size; i += 5) {
+      float in[3] = { TonemapLUT::ShaperDecode(params, i / last), TonemapLUT::ShaperDecode(params, (params.size - 1 - i) / last),
+        TonemapLUT::ShaperDecode(params, (i * 7 % params.size) / last) };
+      float exact[3], sampled[3];
+      TonemapLUT::Evaluate(params, in, exact);
+      lut.Sample(in, sampled);
+      for (int c = 0; c < 3; c++)
+        maxGridError = std::max(maxGridError, std::abs(exact[c] - sampled[c]));
+    }
+    CHECK(maxGridError < 1e-4f);
+
+    // Greys between texels stay within a few 8-bit steps (the toe of the gamma curve is the worst),
+    // colors are worse at saturated ones near the range ends
+    float maxGreyError = 0.0f;
+    for (float t = 0.0f; t <= 1.0f; t += 0.013f) {
+      float value = TonemapLUT::ShaperDecode(params, t);
+      float in[3] = { value, value, value }, exact[3], sampled[3];
+      TonemapLUT::Evaluate(params, in, exact);
+      lut.Sample(in, sampled);
+      maxGreyError = std::max(maxGreyError, std::abs(exact[1] - sampled[1]));
+    }
+    CHECK(maxGreyError < 0.025f);
+    CHECK(lut.MeasureError(17) < 0.1f);
+  }
+}
+
+TEST(TonemapLUTEvaluatesAnalyticOperator) {
+  TonemapLUTParams params;
+  params.op = TonemapOperator::uncharted2;
+  params.output = TonemapOutput::gamma22;
+  params.exposureBias = 1.0f;
+
+  // White point maps to 1, black to 0
+  float white[3] = { params.whitePoint, params.whitePoint, params.whitePoint }, out[3];
+  TonemapLUT::Evaluate(params, white, out);
+  CHECK_NEAR(out[0], 1.0f, 1e-4f);
+  float black[3] = { 0.0f, 0.0f, 0.0f };
+  TonemapLUT::Evaluate(params, black, out);
+  CHECK_NEAR(out[1], 0.0f, 1e-3f); // gamma of the curve's rounding error at 0
+
+  // Reinhard of grey: L (1 + L / w^2) / (1 + L), then sRGB
+  params.op = TonemapOperator::reinhardExtended;
+  params.output = TonemapOutput::srgb;
+  float grey[3] = { 0.5f, 0.5f, 0.5f };
+  TonemapLUT::Evaluate(params, grey, out);
+  float lum = 0.5f * (0.2126f + 0.7151f + 0.0722f);
+  float mapped = 0.5f * (1.0f + lum / (params.whitePoint * params.whitePoint)) / (1.0f + lum);
+  float srgb = 1.055f * std::pow(mapped, 1.0f / 2.4f) - 0.055f;
+  CHECK_NEAR(out[2], srgb, 1e-4f);
+
+  // LUT agrees with the same operator through the shaper
+  params.size = 32;
+  TonemapLUT lut;
+  lut.Bake(params);
+  float sampled[3];
+  lut.Sample(grey, sampled);
+  CHECK_NEAR(sampled[0], srgb, 5e-3f);
+}
@@ -0,0 +1,97 @@
+#include "Test.h"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../TraceRecorder.h"
+
+namespace {
+  size_t CountEvents(const TraceRecorder& recorder, const std::string& name) {
+    std::ostringstream out;
+    recorder.WriteChromeTrace(out);
+    std::string trace = out.str(), pattern = "{\"name\":\"" + name + "\",\"ph\":\"X\"";
+    size_t count = 0;
+    for (size_t pos = trace.find(pattern); pos != std::string::npos; pos = trace.find(pattern, pos + 1))
+      count++;
+    return count;
+  }
+
+  void RecordScopes(TraceRecorder& recorder, const char* name, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      recorder.BeginScope(name);
+      recorder.EndScope();
+    }
+  }
+}
+
+TEST(TraceRecorderExportsRecordedScopes) {
+  TraceRecorder recorder;
+  recorder.SetCapacity(16);
+  RecordScopes(recorder, "Before start", 3);
+  recorder.Start();
+  recorder.BeginScope("Outer");
+  RecordScopes(recorder, "Inner", 5);
+  recorder.EndScope();
+  recorder.Stop();
+  RecordScopes(recorder, "After stop", 3);
+
+  CHECK(CountEvents(recorder, "Outer") == 1);
+  CHECK(CountEvents(recorder, "Inner") == 5);
+  CHECK(CountEvents(recorder, "Before start") == 0);
+  CHECK(CountEvents(recorder, "After stop") == 0);
+  CHECK(recorder.GetStats().recorded == 6);
+  CHECK(recorder.GetStats().overwritten == 0);
+}
+
+TEST(TraceRecorderSkipsSlotsWriterMayOverwrite) {
+  TraceRecorder recorder;
+  recorder.SetCapacity(4);
+  recorder.Start();
+  RecordScopes(recorder, "Scope", 10);
+
+  // The oldest slot of a full ring is the next one written, so it is not exported
+  CHECK(CountEvents(recorder, "Scope") == 3);
+  CHECK(recorder.GetStats().overwritten == 6);
+
+  TraceRecorder exact;
+  exact.SetCapacity(4);
+  exact.Start();
+  RecordScopes(exact, "Scope", 4);
+  CHECK(CountEvents(exact, "Scope") == 3);
+
+  TraceRecorder partial;
+  partial.SetCapacity(4);
+  partial.Start();
+  RecordScopes(partial, "Scope", 3);
+  CHECK(CountEvents(partial, "Scope") == 3);
+}
+
+TEST(TraceRecorderExportsWhileThreadRecords) {
+  TraceRecorder recorder;
+  recorder.SetCapacity(8);
+  recorder.Start();
+
+  // Slots are overwritten all the time during export, dropped ones must not reach the trace
+  std::atomic<bool> stop(false);
+  std::thread writer([&]() {
+    while (!stop)
+      RecordScopes(recorder, "Busy", 1);
+  });
+  while (recorder.GetStats().recorded < 8)
+    std::this_thread::yield();
+
+  for (int i = 0; i < 200; i++) {
+    std::ostringstream out;
+    recorder.WriteChromeTrace(out);
+    std::string trace = out.str();
+    CHECK(trace.find("\"dur\":-") == std::string::npos);
+    CHECK(trace.compare(trace.size() - 4, 4, "\n]}\n") == 0);
+    size_t count = CountEvents(recorder, "Busy");
+    CHECK(count <= 7);
+  }
+  stop = true;
+  writer.join();
+  CHECK(CountEvents(recorder, "Busy") == 7);
+}
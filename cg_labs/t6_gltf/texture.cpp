@@ -1,5 +1,7 @@
 #include <string>
 #include "texture.h"
+#include "HDRFormats.h"
+#include "RadianceHDRDecoder.h"
 
 using namespace DirectX;
 
@@ -28,14 +30,14 @@ HRESULT Texture::CreateTextureFromFileEx(ID3D11Device* device, ID3D11DeviceConte
 }
 
 HRESULT Texture::CreateHDRTextureFromFile(ID3D11Device* device, const wchar_t* filename) {
-  // read file
-  int h = 0, w = 0, c = 0;
-  char *tmpPath = new char[300];
-  sprintf(tmpPath, "%ws", filename);
-  auto imgData = stbi_loadf(tmpPath, &w, &h, &c, 4);
-  delete[] tmpPath;
-
-  if (c == 0)
+  // read file straight to half floats, alpha is unused anyway
+  RadianceHDRDecoder decoder;
+  if (!decoder.Open(filename))
+    return E_FAIL;
+
+  UINT w = decoder.GetWidth(), h = decoder.GetHeight();
+  std::vector<uint16_t> halfData((size_t)w * h * 4);
+  if (!decoder.ReadRows(h, halfData.data()))
     return E_FAIL;
 
   // create texture
@@ -43,7 +45,7 @@ HRESULT Texture::CreateHDRTextureFromFile(ID3D11Device* device, const wchar_t* f
   txtDesc.Width = w;
   txtDesc.Height = h;
 
-  txtDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  txtDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
   txtDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
   txtDesc.Usage = D3D11_USAGE_DEFAULT;
   txtDesc.CPUAccessFlags = 0;
@@ -54,8 +56,8 @@ HRESULT Texture::CreateHDRTextureFromFile(ID3D11Device* device, const wchar_t* f
   txtDesc.SampleDesc.Quality = 0;
 
   D3D11_SUBRESOURCE_DATA hdrtdata = {};
-  hdrtdata.pSysMem = imgData;
-  hdrtdata.SysMemPitch = 4u * w * sizeof(float);
+  hdrtdata.pSysMem = halfData.data();
+  hdrtdata.SysMemPitch = 4u * w * sizeof(uint16_t);
   hdrtdata.SysMemSlicePitch = 0;
 
   // create texture